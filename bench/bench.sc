@@ -0,0 +1,37 @@
+""""bench
+    =====
+
+    helpers shared by the benchmark workloads in this directory. results are
+    printed to stdout as one JSON object per line, so that the output of two
+    commits can be compared line by line.
+
+let C =
+    include
+        """"#include <stdio.h>
+            #include <time.h>
+
+            double bench_now () {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return ts.tv_sec * 1000.0 + ts.tv_nsec * 1e-6;
+            }
+
+            void bench_report (const char *name, double ms) {
+                printf("{\"bench\": \"%s\", \"ms\": %.3f}\n", name, ms);
+                fflush(stdout);
+            }
+
+inline report (name ms)
+    """"prints the result of benchmark `name`, which took `ms` milliseconds
+    C.extern.bench_report (name as rawstring) ms
+
+inline measure (name f)
+    """"runs `f` once and reports how long it took under `name`
+    let t = (C.extern.bench_now)
+    f;
+    report name ((C.extern.bench_now) - t)
+
+do
+    let report measure
+    let bench-now = C.extern.bench_now
+    locals;
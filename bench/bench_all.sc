@@ -0,0 +1,107 @@
+# runs the benchmark suite. every workload runs in a fresh compiler process,
+  first with an empty cache ("cold"), then again with the cache it populated
+  ("warm"). results are printed as one JSON object per line:
+
+      {"bench": "<name>", "ms": <milliseconds>}
+
+  a failed run is reported with "ms": -1. workloads may report finer grained
+  results of their own. usage:
+
+      scopes bench/bench_all.sc [repeat-count]
+
+import .bench
+
+let C =
+    include
+        """"#include <stdio.h>
+            #include <stdlib.h>
+            #include <unistd.h>
+            #include <sys/stat.h>
+            #include <time.h>
+
+            static char bench_dir_path[256];
+
+            // creates and returns a new empty cache directory
+            const char *bench_cache_dir (const char *name) {
+                snprintf(bench_dir_path, sizeof(bench_dir_path),
+                    "/tmp/scopes-bench-%d-%s", (int)getpid(), name);
+                char cmd[512];
+                snprintf(cmd, sizeof(cmd), "rm -rf '%s'", bench_dir_path);
+                system(cmd);
+                mkdir(bench_dir_path, 0755);
+                return bench_dir_path;
+            }
+
+            void bench_remove_dir (const char *path) {
+                char cmd[512];
+                snprintf(cmd, sizeof(cmd), "rm -rf '%s'", path);
+                system(cmd);
+            }
+
+            // runs script in a new compiler process and returns the elapsed
+            // wall clock time in milliseconds, or -1 if the process failed
+            double bench_run (const char *compiler, const char *cache,
+                const char *script) {
+                char cmd[4096];
+                snprintf(cmd, sizeof(cmd), "SCOPES_CACHE='%s' '%s' '%s'",
+                    cache, compiler, script);
+                struct timespec t0, t1;
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                int ret = system(cmd);
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                if (ret != 0)
+                    return -1.0;
+                return (t1.tv_sec - t0.tv_sec) * 1000.0
+                    + (t1.tv_nsec - t0.tv_nsec) * 1e-6;
+            }
+
+            static char bench_module_path[256];
+
+            // writes a module of count functions in which every function
+            // calls its predecessor; returns its path or 0 on failure
+            const char *bench_generate_module (int count) {
+                snprintf(bench_module_path, sizeof(bench_module_path),
+                    "/tmp/scopes-bench-%d-generated.sc", (int)getpid());
+                FILE *f = fopen(bench_module_path, "w");
+                if (!f)
+                    return 0;
+                fprintf(f, "fn f0 (x)\n    x * 3\n");
+                for (int i = 1; i < count; ++i) {
+                    fprintf(f, "fn f%d (x)\n    ((f%d x) + %d) ^ (x << %d)\n",
+                        i, i - 1, i, i % 31);
+                }
+                fprintf(f, "print (f%d 1)\n", count - 1);
+                if (fclose(f) != 0)
+                    return 0;
+                return bench_module_path;
+            }
+
+let GENERATED_FUNCTIONS = 2000
+
+inline run-workload (name script)
+    let cache = (C.extern.bench_cache_dir name)
+    let cold = (C.extern.bench_run compiler-path cache script)
+    let warm = (C.extern.bench_run compiler-path cache script)
+    bench.report (.. name "-cold") cold
+    bench.report (.. name "-warm") warm
+    C.extern.bench_remove_dir cache
+
+fn main ()
+    let source-path argc argv = (script-launch-args)
+    let repeat =
+        if (argc > 0)
+            C.extern.atoi (argv @ 0)
+        else 1
+    # the generated module lives next to the caches, outside of the tree
+    let genpath = (C.extern.bench_generate_module GENERATED_FUNCTIONS)
+    assert (genpath != null) "failed to generate module"
+    for i in (range repeat)
+        run-workload "boot" (.. module-dir "/boot.sc")
+        run-workload "large-module" genpath
+        run-workload "glm" (.. module-dir "/glm.sc")
+        run-workload "import-c" (.. module-dir "/import_c.sc")
+        run-workload "spirv" (.. module-dir "/spirv.sc")
+        run-workload "runtime" (.. module-dir "/runtime.sc")
+    C.extern.bench_remove_dir genpath
+
+main;
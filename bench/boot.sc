@@ -0,0 +1,3 @@
+# an empty script; timing it measures how long the compiler takes to boot
+  and load core.sc, either with an empty or with a populated cache.
+;
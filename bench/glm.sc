@@ -0,0 +1,31 @@
+# heavily generic workload: instantiates vector and matrix math from glm for
+  every scalar type.
+
+using import glm
+
+fn vector-work (a b)
+    let c = (a + b * b)
+    let d = (a - c)
+    (dot c d) + (dot (a * b) (b - a))
+
+fn matrix-work (m v)
+    let w = (m * v)
+    (transpose m) * (w + v)
+
+inline instantiate (V M)
+    compile (typify vector-work V V)
+    compile (typify matrix-work M V)
+
+instantiate vec2 mat2
+instantiate vec3 mat3
+instantiate vec4 mat4
+instantiate dvec2 dmat2
+instantiate dvec3 dmat3
+instantiate dvec4 dmat4
+instantiate ivec2 imat2
+instantiate ivec3 imat3
+instantiate ivec4 imat4
+instantiate uvec2 umat2
+instantiate uvec3 umat3
+instantiate uvec4 umat4
+;
@@ -0,0 +1,13 @@
+# imports a set of large system headers through clang.
+
+include
+    """"#include <stdio.h>
+        #include <stdlib.h>
+        #include <string.h>
+        #include <math.h>
+        #include <time.h>
+        #include <pthread.h>
+        #include <signal.h>
+        #include <wchar.h>
+        #include <locale.h>
+;
@@ -0,0 +1,69 @@
+# runtime microbenchmarks for Map, Array and String. every benchmark is
+  compiled before it is timed, so only the generated code is measured.
+
+using import Map
+using import Array
+using import String
+import .bench
+
+let COUNT = 1000000
+
+fn map-insert-lookup ()
+    local map : (Map i32 i32)
+    for i in (range COUNT)
+        'set map i (i * 2)
+    local sum = 0
+    for i in (range COUNT)
+        sum += ('getdefault map i 0)
+    sum
+
+fn map-discard ()
+    local map : (Map i32 i32)
+    for i in (range COUNT)
+        'set map i i
+    for i in (range COUNT)
+        'discard map i
+    countof map
+
+fn array-append ()
+    local a : (GrowingArray i32)
+    for i in (range COUNT)
+        'append a i
+    local sum = 0
+    for x in a
+        sum += x
+    sum
+
+fn array-sort ()
+    local a : (GrowingArray i32)
+    for i in (range COUNT)
+        'append a ((i * 7919) % COUNT)
+    'sort a
+    a @ 0
+
+fn string-append ()
+    local s : String
+    for i in (range COUNT)
+        'append s "abc"
+    countof s
+
+fn string-compare ()
+    local a : String = "the quick brown fox jumps over the lazy dog"
+    local b = (copy a)
+    local equal = 0
+    for i in (range COUNT)
+        if (a == b)
+            equal += 1
+    equal
+
+inline run (name f)
+    let f = (compile (typify f))
+    bench.measure name f
+
+run "map-insert-lookup" map-insert-lookup
+run "map-discard" map-discard
+run "array-append" array-append
+run "array-sort" array-sort
+run "string-append" string-append
+run "string-compare" string-compare
+;
@@ -0,0 +1,37 @@
+# compiles permutations of a fragment shader to SPIR-V.
+
+using import glm
+using import glsl
+
+out out_Color : vec4
+    location = 0
+
+inline shader-variant (N)
+    fn ()
+        local acc = (vec4 0)
+        for i in (range N)
+            acc += (vec4 (i as f32))
+        out_Color = acc
+
+inline compile-variant (N)
+    compile-spirv 0 'fragment
+        typify (shader-variant N)
+        'O2
+
+compile-variant 1
+compile-variant 2
+compile-variant 3
+compile-variant 4
+compile-variant 5
+compile-variant 6
+compile-variant 7
+compile-variant 8
+compile-variant 9
+compile-variant 10
+compile-variant 11
+compile-variant 12
+compile-variant 13
+compile-variant 14
+compile-variant 15
+compile-variant 16
+;
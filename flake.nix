@@ -86,6 +86,9 @@
                     llvmpkgs.clang
                     llvmpkgs.libclang
                     llvmpkgs.llvm.dev
+                    # the lld drivers are linked into the runtime
+                    llvmpkgs.lld.dev
+                    llvmpkgs.lld.lib
                     # llvmpkgs.llvm-polly
                     pkgs.spirv-tools
                     selfpkgs.genie
@@ -166,6 +169,24 @@
           testDir = ./testing;
         }
           "cp -r $testDir ./testing && SCOPES_CACHE=./scopes-cache scopes testing/test_all.sc && touch $out";
+        # the unit tests, built with single word value references
+        compact-valueref = let
+          pkgs = nixpkgsFor.${system};
+          scopes = self.packages.${system}.scopes.nolibs.overrideAttrs (old: {
+            pname = "scopes-compact-valueref";
+            NIX_CFLAGS_COMPILE = "-DSCOPES_COMPACT_VALUEREF=1";
+          });
+        in pkgs.runCommandNoCC "compact-valueref-tests" {
+          testDir = ./testing;
+        } ''
+          mkdir --parents root/bin root/lib
+          cp ${scopes}/bin/scopes root/bin/scopes
+          cp ${scopes}/lib/libscopesrt.so root/lib/
+          cp -r ${./lib/scopes} root/lib/scopes
+          cp -r $testDir ./testing
+          SCOPES_CACHE=./scopes-cache root/bin/scopes testing/test_all.sc
+          touch $out
+        '';
       });
 
       defaultPackage = forAllSystems (system: self.packages.${system}.scopes);
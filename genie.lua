@@ -123,7 +123,7 @@ local LLVM_CXXFLAGS = pkg_config(LLVM_CONFIG .. " --cxxflags")
 local TARGET_COMPONENTS = table.concat(target_components, " ")
 local LLVM_LIBS = pkg_config(LLVM_CONFIG .. " --link-static --libs orcjit"
     .. " engine passes option objcarcopts coverage support lto coroutines"
-    .. " frontendopenmp orcshared orctargetprocess jitlink"
+    .. " frontendopenmp orcshared orctargetprocess jitlink debuginfodwarf"
     .. " " .. TARGET_COMPONENTS)
 local LLVM_INCLUDEDIR = pkg_config(LLVM_CONFIG .. " --includedir")
 local ABSL_DIR = ""
@@ -142,6 +142,13 @@ local CLANG_DEPS = {
     "-lclangLex",
     "-lclangBasic",
 }
+local LLD_DEPS = {
+    "-llldCOFF",
+    "-llldELF",
+    "-llldMachO2",
+    "-llldWasm",
+    "-llldCommon",
+}
 --local POLLY_DEPS = {
 --    "-lPolly",
 --    "-lPollyISL",
@@ -198,6 +205,8 @@ project "scopesrt"
         "src/utils.cpp",
         "src/symbol.cpp",
         "src/timer.cpp",
+        "src/trace.cpp",
+        "src/profiler.cpp",
         "src/source_file.cpp",
         "src/anchor.cpp",
         "src/type.cpp",
@@ -238,6 +247,17 @@ project "scopesrt"
         "src/globals.cpp",
         "src/hash.cpp",
         "src/cache.cpp",
+        "src/syntax_image.cpp",
+        "src/core_image.cpp",
+        "src/module_digest.cpp",
+        "src/regex.cpp",
+        "src/thread_pool.cpp",
+        "src/io_loop.cpp",
+        "src/memo.cpp",
+        "src/file_map.cpp",
+        "src/process.cpp",
+        "src/server.cpp",
+        "src/interpreter.cpp",
         "external/linenoise-ng/src/linenoise.cpp",
         "external/linenoise-ng/src/ConvertUTF.cpp",
         "external/linenoise-ng/src/wcwidth.cpp",
@@ -367,6 +387,7 @@ project "scopesrt"
         }
         linkoptions(LLVM_LDFLAGS)
         linkoptions(CLANG_DEPS)
+        linkoptions(LLD_DEPS)
         --linkoptions(POLLY_DEPS)
         --linkoptions { "-Wl,--whole-archive" }
         linkoptions(LLVM_LIBS)
@@ -451,6 +472,7 @@ project "scopesrt"
         }
         linkoptions(LLVM_LDFLAGS)
         linkoptions(CLANG_DEPS)
+        linkoptions(LLD_DEPS)
         linkoptions(LLVM_LIBS)
 
         if os.is("windows") then
@@ -503,6 +525,7 @@ project "scopesrt"
 
         linkoptions(LLVM_LDFLAGS)
         linkoptions(CLANG_DEPS)
+        linkoptions(LLD_DEPS)
         --linkoptions(POLLY_DEPS)
         linkoptions(LLVM_LIBS)
 
@@ -18,21 +18,44 @@
 // any location error aborts immediately and can not be caught
 #define SCOPES_EARLY_ABORT 0
 
-// print a list of cumulative timers on program exit
+// print a list of cumulative timers on program exit; setting the environment
+// variable SCOPES_TIMERS to a non-zero value does the same at runtime.
+// setting SCOPES_TRACE to a path writes a Chrome trace of compiler phases there,
+// and setting SCOPES_CACHE_STATS prints cache statistics on exit.
+// setting SCOPES_SHARED_CACHE to a directory, which may be on a network share,
+// shares compiled objects between machines through that directory.
 #define SCOPES_PRINT_TIMERS 0
 
 // if 0, will never cache modules
 #define SCOPES_ALLOW_CACHE 1
 
+// if 1, parsed source files are cached as binary syntax images
+#define SCOPES_CACHE_SYNTAX_IMAGES 1
+
+// if 1, the bindings and code produced by import-c are cached
+#define SCOPES_CACHE_C_IMPORTS 1
+
+// if 1, import-c builds precompiled headers for the leading includes of a
+// source and reuses them across imports
+#define SCOPES_C_IMPORT_PCH 1
+
+// size in bytes of the buffer for text written to stdout. output to a
+// terminal is written out at the end of each line; piped output only when
+// the buffer is full or explicitly flushed. SCOPES_STDOUT_BUFFER overrides
+// the size at runtime, in bytes or with a K, M or G suffix; 0 disables
+// buffering.
+#define SCOPES_STDOUT_BUFFER_SIZE (64 << 10)
+
 // if 1, will warn about missing C type support, such as for some union types
 #define SCOPES_WARN_MISSING_CTYPE_SUPPORT 0
 
-// maximum size in bytes of object cache. by default, this is set to 100 MB
+// maximum size in bytes of object cache. by default, this is set to 100 MB.
+// when the cache exceeds it, the least recently and least frequently used
+// entries are evicted until it is no larger than SCOPES_MIN_CACHE_SIZE.
+// SCOPES_CACHE_HIGH_WATERMARK and SCOPES_CACHE_LOW_WATERMARK override both
+// at runtime, in bytes or with a K, M or G suffix.
 #define SCOPES_MAX_CACHE_SIZE (100 << 20)
-// maximum number of inodes in cache directory
-// we keep this one friendly with FAT32, whose limit is 65534
-// and some versions of ext, where the limit is 64000
-#define SCOPES_MAX_CACHE_INODES 63000
+#define SCOPES_MIN_CACHE_SIZE (SCOPES_MAX_CACHE_SIZE / 4 * 3)
 
 // maximum number of recursions permitted during partial evaluation
 // if you think you need more, ask yourself if ad-hoc compiling a pure C function
@@ -40,6 +63,28 @@
 // 100% of the time, the answer is yes because the performance is much better.
 #define SCOPES_MAX_RECURSIONS 64
 
+// maximum number of memoized expansions of pure sugar macros; the table is
+// flushed when it fills up
+#define SCOPES_MAX_SUGAR_MEMO (1 << 16)
+
+// maximum number of compiled regular expressions kept for sc_string_match;
+// the least recently used pattern is evicted when the cache is full
+#define SCOPES_REGEX_CACHE_SIZE 256
+
+// maximum number of source files and buffers kept mapped and indexed for the
+// source lines of diagnostics; the least recently shown one is dropped when
+// the cache is full
+#define SCOPES_SOURCE_CACHE_SIZE 64
+
+// maximum number of states a regular expression builds for each of its two
+// DFAs; when the limit is reached, the states are discarded and this one
+// search falls back to the backtracking matcher
+#define SCOPES_REGEX_MAX_DFA_STATES 2048
+
+// number of exported functions that compile-object generates into one module
+// when a scope is compiled with compile-flag-chunked
+#define SCOPES_COMPILE_OBJECT_CHUNK_SIZE 1024
+
 // folder name in ~/.cache in which all cache files are stored
 #define SCOPES_CACHE_DIRNAME "scopes"
 
@@ -70,5 +115,53 @@
 #define SCOPES_MAX_STACK_SIZE ((1 << 20) * 7)
 #endif
 
+// call the vector variants of math functions in glibc's libmvec for vector
+// operands, where they exist
+#if defined(__linux__) && defined(__x86_64__)
+#define SCOPES_USE_LIBMVEC 1
+#else
+#define SCOPES_USE_LIBMVEC 0
+#endif
+
+// the number of connections to the compile server that can wait to be
+// accepted, and the largest request a client may send, in bytes
+#define SCOPES_SERVER_BACKLOG 64
+#define SCOPES_SERVER_MAX_REQUEST_SIZE ((1 << 20) * 16)
+
+// if 1, the JIT materializes code on a pool of its own threads, so that code
+// that has already been compiled keeps running on other threads while new
+// modules are linked in and their definitions are looked up
+#define SCOPES_JIT_CONCURRENT 1
+
+// if 1, reference parameters whose values the function received unique are
+// marked noalias. the borrow checker makes the reference the only checked way
+// to its value for the duration of the call; pointers taken from the value
+// with `&` beforehand mustn't be used to access it while the call lasts.
+#define SCOPES_NOALIAS_UNIQUE_REFERENCES 1
+
+// if 1, functions of object files compiled at O2 or above whose generated
+// code is identical are merged into one, which leaves one copy of generic code
+// instantiated for types of the same layout. merged functions may share their
+// address; jitted functions are never merged.
+#define SCOPES_MERGE_FUNCTIONS 1
+
+// size of the stack of each coroutine task
+#define SCOPES_TASK_STACK_SIZE ((1 << 10) * 256)
+
+// the largest number of instructions, counted over a function and the
+// functions it calls, that a compile time function may have to be interpreted
+// rather than compiled
+#define SCOPES_INTERPRETER_MAX_COST 256
+
+// if 1, references to values are a single word wide instead of two: the
+// anchor is kept in the value when it is the one the value was first
+// referenced with, and in an interned cell otherwise. halves the size of
+// argument, parameter and instruction lists, but changes the layout of the
+// Value type and of sc_valueref_t. can also be set by defining it when
+// building, as the SCOPES_COMPACT_VALUEREF option of the cmake build does.
+#ifndef SCOPES_COMPACT_VALUEREF
+#define SCOPES_COMPACT_VALUEREF 0
+#endif
+
 #endif // SCOPES_CONFIG_H
 
@@ -56,6 +56,7 @@ namespace scopes {
     struct Frame;
     struct Value;
     struct Closure;
+    struct Context;
 }
 
 extern "C" {
@@ -70,6 +71,7 @@ typedef scopes::Parameter sc_parameter_t;
 typedef scopes::Frame sc_frame_t;
 typedef scopes::Value sc_value_t;
 typedef scopes::Closure sc_closure_t;
+typedef scopes::Context sc_context_t;
 
 typedef scopes::ValueRef sc_valueref_t;
 
@@ -93,8 +95,13 @@ typedef struct sc_parameter_ sc_parameter_t;
 typedef struct sc_frame_ sc_frame_t;
 typedef struct sc_value_ sc_value_t;
 typedef struct sc_closure_ sc_closure_t;
+typedef struct sc_context_ sc_context_t;
 
+#if SCOPES_COMPACT_VALUEREF
+typedef struct sc_valueref_ { sc_value_t *_0; } sc_valueref_t;
+#else
 typedef struct sc_valueref_ { sc_value_t *_0; const sc_anchor_t *_1; } sc_valueref_t;
+#endif
 
 #endif
 
@@ -142,6 +149,7 @@ SCOPES_TYPEDEF_RESULT_RAISES(sc_uint_raises, uint32_t);
 SCOPES_TYPEDEF_RESULT_RAISES(sc_symbol_raises, sc_symbol_t);
 SCOPES_TYPEDEF_RESULT_RAISES(sc_type_raises, const sc_type_t *);
 SCOPES_TYPEDEF_RESULT_RAISES(sc_bool_raises, bool);
+SCOPES_TYPEDEF_RESULT_RAISES(sc_list_raises, const sc_list_t *);
 
 SCOPES_TYPEDEF_RESULT_RAISES(sc_valueref_list_scope_raises, sc_valueref_list_scope_tuple_t);
 SCOPES_TYPEDEF_RESULT_RAISES(sc_list_scope_raises, sc_list_scope_tuple_t);
@@ -153,44 +161,103 @@ typedef sc_valueref_raises_t (*sc_ast_macro_func_t)(sc_valueref_t);
 typedef sc_valueref_raises_t (*sc_typecast_func_t)(sc_valueref_t, const sc_type_t *);
 typedef sc_list_scope_raises_t (*sc_syntax_wildcard_func_t)(const sc_list_t *, const sc_scope_t *);
 typedef void (*sc_autocomplete_func_t)(const char *, void *);
+typedef sc_void_raises_t (*sc_parse_each_func_t)(sc_valueref_t, void *);
+typedef void (*sc_parallel_chunk_func_t)(void *, int64_t, int64_t, int64_t);
+typedef void (*sc_task_func_t)(void *);
 
 // booting
 
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_load_from_executable(const char *path);
 SCOPES_LIBEXPORT void sc_init(void *c_main, int argc, char *argv[]);
 SCOPES_LIBEXPORT int sc_main();
+// write the syntax images and objects of everything loaded so far to path
+SCOPES_LIBEXPORT sc_void_raises_t sc_snapshot_save(const sc_string_t *path);
+// serve the contents of the snapshot at path from memory; call after sc_init
+// and before sc_main to boot from it
+SCOPES_LIBEXPORT sc_void_raises_t sc_snapshot_load(const sc_string_t *path);
 
 // stats & info
 
 SCOPES_LIBEXPORT sc_i32_i32_i32_tuple_t sc_compiler_version();
 SCOPES_LIBEXPORT int sc_cache_misses();
+// returns a list of (name value) pairs; times are in milliseconds
+SCOPES_LIBEXPORT const sc_list_t *sc_cache_stats();
+SCOPES_LIBEXPORT void sc_cache_stats_reset();
+// the number of tiered functions whose optimized code has been swapped in
+SCOPES_LIBEXPORT int sc_tier_up_count();
+SCOPES_LIBEXPORT void sc_set_timers_enabled(bool enable);
+// returns a list of (name count inclusive-ms exclusive-ms max-ms) entries
+SCOPES_LIBEXPORT const sc_list_t *sc_timers_snapshot();
+SCOPES_LIBEXPORT void sc_timers_reset();
+// returns a list of (name objects bytes) entries, one per compiler subsystem
+SCOPES_LIBEXPORT const sc_list_t *sc_memory_stats();
+SCOPES_LIBEXPORT void sc_set_trace_enabled(bool enable);
+// writes all trace events recorded so far as Chrome trace JSON and discards them
+SCOPES_LIBEXPORT bool sc_write_trace(const sc_string_t *path);
+// samples the call stacks of the process hz times per second of CPU time
+// (1000 if hz is 0); starting discards the samples of the previous run.
+// returns false if the profiler is running or unsupported on this platform
+SCOPES_LIBEXPORT bool sc_profiler_start(int hz);
+SCOPES_LIBEXPORT void sc_profiler_stop();
+SCOPES_LIBEXPORT bool sc_profiler_running();
+// samples recorded, and samples dropped because the buffer was full
+SCOPES_LIBEXPORT uint64_t sc_profiler_sample_count();
+SCOPES_LIBEXPORT uint64_t sc_profiler_dropped_count();
+// writes the samples recorded so far as folded stacks for flame graph tools
+SCOPES_LIBEXPORT bool sc_profiler_write(const sc_string_t *path);
+// malloc and free that count bytes and allocations per element type and
+// calling function; DefaultAllocator uses them when the compiler was started
+// with SCOPES_ALLOC_PROFILE set. sc_alloc_profile_stats lists
+// (site type allocations bytes live-bytes) entries, the largest first
+SCOPES_LIBEXPORT void *sc_alloc_profile_malloc(const sc_type_t *T, size_t size);
+SCOPES_LIBEXPORT void sc_alloc_profile_free(void *ptr);
+SCOPES_LIBEXPORT const sc_list_t *sc_alloc_profile_stats();
+SCOPES_LIBEXPORT void sc_alloc_profile_print();
 
 // compiler
 
 SCOPES_LIBEXPORT sc_valueref_list_scope_raises_t sc_expand(sc_valueref_t expr, const sc_list_t *next, const sc_scope_t *scope);
+SCOPES_LIBEXPORT void sc_sugar_macro_set_pure(sc_syntax_wildcard_func_t f);
+SCOPES_LIBEXPORT sc_list_scope_raises_t sc_sugar_macro_call(sc_syntax_wildcard_func_t f, const sc_list_t *topexpr, const sc_scope_t *scope);
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_eval(const sc_anchor_t *anchor, const sc_list_t *expr, const sc_scope_t *scope);
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_eval_stage(const sc_anchor_t *anchor, const sc_list_t *expr, const sc_scope_t *scope);
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_prove(sc_valueref_t expr);
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_typify(const sc_closure_t *f, int numtypes, const sc_type_t **typeargs);
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_typify_template(sc_valueref_t f, int numtypes, const sc_type_t **typeargs);
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_compile(sc_valueref_t srcl, uint64_t flags);
+SCOPES_LIBEXPORT bool sc_function_is_interpretable(sc_valueref_t func);
+SCOPES_LIBEXPORT sc_valueref_raises_t sc_interpret(sc_valueref_t func);
 SCOPES_LIBEXPORT sc_string_raises_t sc_compile_spirv(int version, sc_symbol_t target, sc_valueref_t srcl, uint64_t flags);
 SCOPES_LIBEXPORT sc_string_raises_t sc_compile_glsl(int version, sc_symbol_t target, sc_valueref_t srcl, uint64_t flags);
 SCOPES_LIBEXPORT const sc_string_t *sc_spirv_to_glsl(const sc_string_t *binary);
 SCOPES_LIBEXPORT const sc_string_t *sc_default_target_triple();
 SCOPES_LIBEXPORT sc_void_raises_t sc_compile_object(const sc_string_t *target_triple, int file_kind, const sc_string_t *path, const sc_scope_t *table, uint64_t flags);
+SCOPES_LIBEXPORT sc_list_raises_t sc_compile_spirv_batch(const sc_list_t *jobs);
+SCOPES_LIBEXPORT sc_list_raises_t sc_compile_glsl_batch(const sc_list_t *jobs);
 SCOPES_LIBEXPORT sc_string_raises_t sc_compile_object_to_buffer(const sc_string_t *target_triple, int file_kind, const sc_string_t *module_name, const sc_scope_t *table, uint64_t flags);
+SCOPES_LIBEXPORT void sc_set_object_target_cpu(const sc_string_t *cpu, const sc_string_t *features);
+SCOPES_LIBEXPORT sc_void_raises_t sc_thin_link_objects(const sc_string_t *target_triple, const sc_list_t *inputs, const sc_string_t *output_prefix, uint64_t flags);
+SCOPES_LIBEXPORT sc_void_raises_t sc_link_objects(const sc_string_t *target_triple, const sc_list_t *inputs, const sc_string_t *path);
+SCOPES_LIBEXPORT sc_void_raises_t sc_set_optimization_pipeline(const sc_string_t *pipeline);
+SCOPES_LIBEXPORT void sc_set_profile_path(const sc_string_t *path);
 SCOPES_LIBEXPORT void sc_enter_solver_cli ();
 SCOPES_LIBEXPORT void sc_show_targets();
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_eval_inline(const sc_anchor_t *anchor, const sc_list_t *expr, const sc_scope_t *scope);
 SCOPES_LIBEXPORT sc_rawstring_i32_array_tuple_t sc_launch_args();
+// the working directory of the process, which in workers of a compile server
+// is that of the client, unlike the `working-dir` constant
+SCOPES_LIBEXPORT const sc_string_t *sc_working_dir();
 SCOPES_LIBEXPORT void sc_set_typecast_handler(sc_typecast_func_t func);
+SCOPES_LIBEXPORT int sc_sweep_functions();
+SCOPES_LIBEXPORT void sc_set_sweep_threshold(uint64_t bytes);
+SCOPES_LIBEXPORT void sc_advance_fingerprint_epoch();
 
 // value
 
 SCOPES_LIBEXPORT const sc_string_t *sc_value_repr (sc_valueref_t value);
 SCOPES_LIBEXPORT const sc_string_t *sc_value_content_repr (sc_valueref_t value);
 SCOPES_LIBEXPORT const sc_string_t *sc_value_ast_repr (sc_valueref_t value);
+SCOPES_LIBEXPORT const sc_string_t *sc_value_ast_image (sc_valueref_t value);
 SCOPES_LIBEXPORT const sc_string_t *sc_value_tostring (sc_valueref_t value);
 SCOPES_LIBEXPORT const sc_type_t *sc_value_type (sc_valueref_t value);
 SCOPES_LIBEXPORT const sc_type_t *sc_value_qualified_type (sc_valueref_t value);
@@ -223,6 +290,8 @@ SCOPES_LIBEXPORT void sc_template_append_parameter(sc_valueref_t fn, sc_valueref
 SCOPES_LIBEXPORT void sc_template_set_body(sc_valueref_t fn, sc_valueref_t value);
 SCOPES_LIBEXPORT void sc_template_set_inline(sc_valueref_t fn);
 SCOPES_LIBEXPORT bool sc_template_is_inline(sc_valueref_t fn);
+SCOPES_LIBEXPORT void sc_template_set_fast_math(sc_valueref_t fn, uint32_t flags);
+SCOPES_LIBEXPORT uint32_t sc_template_get_fast_math(sc_valueref_t fn);
 SCOPES_LIBEXPORT int sc_template_parameter_count(sc_valueref_t fn);
 SCOPES_LIBEXPORT sc_valueref_t sc_template_parameter(sc_valueref_t fn, int index);
 
@@ -287,6 +356,8 @@ SCOPES_LIBEXPORT sc_valueref_t sc_const_extract_at(const sc_valueref_t value, in
 SCOPES_LIBEXPORT const void *sc_const_pointer_extract(const sc_valueref_t value);
 SCOPES_LIBEXPORT sc_valueref_t sc_const_string_new(const sc_string_t *str);
 SCOPES_LIBEXPORT const sc_string_t *sc_const_string_extract(sc_valueref_t value);
+SCOPES_LIBEXPORT sc_valueref_raises_t sc_const_blob_new(const sc_type_t *element_type, const sc_string_t *data);
+SCOPES_LIBEXPORT sc_valueref_raises_t sc_const_blob_from_path(const sc_type_t *element_type, const sc_string_t *path);
 
 SCOPES_LIBEXPORT sc_valueref_t sc_quote_new(sc_valueref_t value);
 SCOPES_LIBEXPORT sc_valueref_t sc_unquote_new(sc_valueref_t value);
@@ -298,7 +369,11 @@ SCOPES_LIBEXPORT sc_valueref_t sc_merge_new(sc_valueref_t label, sc_valueref_t v
 // parsing
 
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_parse_from_path(const sc_string_t *path);
+SCOPES_LIBEXPORT sc_void_raises_t sc_parse_each_from_path(const sc_string_t *path, sc_parse_each_func_t func, void *ctx);
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_parse_from_string(const sc_string_t *str);
+SCOPES_LIBEXPORT sc_valueref_raises_t sc_parse_incremental(sc_valueref_t previous, const sc_string_t *str, int offset, int removed, int inserted);
+SCOPES_LIBEXPORT sc_valueref_raises_t sc_parse_ast_image(const sc_string_t *image);
+SCOPES_LIBEXPORT void sc_prefetch_module(const sc_string_t *path);
 
 // stdin/out
 
@@ -313,6 +388,8 @@ SCOPES_LIBEXPORT void sc_prompt_add_completion_from_scope(void *ctx,
 
 SCOPES_LIBEXPORT const sc_string_t *sc_format_message(const sc_anchor_t *anchor, const sc_string_t *message);
 SCOPES_LIBEXPORT void sc_write(const sc_string_t *value);
+// writes out everything buffered for stdout
+SCOPES_LIBEXPORT void sc_flush();
 
 // file I/O
 
@@ -321,6 +398,77 @@ SCOPES_LIBEXPORT const sc_string_t *sc_dirname(const sc_string_t *path);
 SCOPES_LIBEXPORT const sc_string_t *sc_basename(const sc_string_t *path);
 SCOPES_LIBEXPORT bool sc_is_file(const sc_string_t *path);
 SCOPES_LIBEXPORT bool sc_is_directory(const sc_string_t *path);
+SCOPES_LIBEXPORT uint64_t sc_file_mtime(const sc_string_t *path);
+// the names of the entries of the directory at path, without . and .., in
+// sorted order; empty if path can't be read as a directory
+SCOPES_LIBEXPORT const sc_list_t *sc_list_directory(const sc_string_t *path);
+
+// file maps
+
+// maps the file at path into memory, read-only unless writable is set; if
+// size is not negative, the file is resized to size bytes first, and created
+// when writable. returns null on failure, with the error in sc_io_errno.
+SCOPES_LIBEXPORT void *sc_file_map_open(const sc_string_t *path, bool writable, int64_t size);
+SCOPES_LIBEXPORT void *sc_file_map_data(void *map);
+SCOPES_LIBEXPORT uint64_t sc_file_map_size(void *map);
+// advice is 0 for normal, 1 for sequential, 2 for random access, 3 if the
+// range will be needed soon and 4 if it won't be needed
+SCOPES_LIBEXPORT int sc_file_map_advise(void *map, uint64_t offset, uint64_t count, int advice);
+SCOPES_LIBEXPORT int sc_file_map_sync(void *map, uint64_t offset, uint64_t count);
+SCOPES_LIBEXPORT void sc_file_map_close(void *map);
+
+// processes
+
+// runs the shell commands in the list, at most jobs at a time, or one per core
+// if jobs is less than 1; if history_path is not empty, the commands that took
+// longest the last time start first, and their durations are recorded there
+// under the strings in keys, one per command, or under the commands if keys
+// is empty. returns a list of (status seconds output) entries, in order of
+// commands.
+SCOPES_LIBEXPORT sc_list_raises_t sc_run_commands(const sc_list_t *commands, const sc_list_t *keys, int jobs, const sc_string_t *history_path);
+
+// threads
+
+// the number of threads that run a parallel loop, counting the caller
+SCOPES_LIBEXPORT int sc_thread_count();
+// calls func(ctx, chunk, chunk-begin, chunk-end) for every chunk of chunk_size
+// indices in [begin, end) on the thread pool, and returns when all completed
+SCOPES_LIBEXPORT void sc_parallel_for(int64_t begin, int64_t end, int64_t chunk_size, sc_parallel_chunk_func_t func, void *ctx);
+// queues func(ctx) on the thread pool and returns a handle that must be passed
+// to either sc_task_join or sc_task_detach; a coroutine task runs on a stack
+// of its own and can be suspended while it waits
+SCOPES_LIBEXPORT void *sc_task_spawn(sc_task_func_t func, void *ctx, bool coroutine);
+SCOPES_LIBEXPORT void sc_task_join(void *task);
+SCOPES_LIBEXPORT void sc_task_detach(void *task);
+SCOPES_LIBEXPORT void sc_task_yield();
+SCOPES_LIBEXPORT void *sc_waitgroup_new();
+SCOPES_LIBEXPORT void sc_waitgroup_add(void *wg, int64_t count);
+SCOPES_LIBEXPORT void sc_waitgroup_done(void *wg);
+SCOPES_LIBEXPORT void sc_waitgroup_wait(void *wg);
+SCOPES_LIBEXPORT void sc_waitgroup_free(void *wg);
+
+// io
+
+// non-blocking operations on descriptors, which park the calling coroutine
+// task on the event loop while they wait, and otherwise block the thread;
+// all return -errno on failure
+SCOPES_LIBEXPORT int sc_io_wait(int fd, bool write);
+SCOPES_LIBEXPORT int sc_io_set_nonblocking(int fd);
+SCOPES_LIBEXPORT int64_t sc_io_read(int fd, void *buf, int64_t size);
+SCOPES_LIBEXPORT int64_t sc_io_write(int fd, const void *buf, int64_t size);
+SCOPES_LIBEXPORT int sc_io_accept(int fd);
+SCOPES_LIBEXPORT int sc_io_connect(int fd, const void *addr, int addrlen);
+// writes count buffers, given as pairs of pointer and 64-bit size, with one
+// call; returns the number of bytes written, which can be less than their sum
+SCOPES_LIBEXPORT int64_t sc_io_writev(int fd, const void *slices, int count);
+// opens the file at path for reading (mode 0), writing (1) or appending (2);
+// writing and appending create the file, and writing truncates it
+SCOPES_LIBEXPORT int sc_io_open(const sc_string_t *path, int mode);
+// hints at how the range of the file will be read, with advice as for
+// sc_file_map_advise
+SCOPES_LIBEXPORT int sc_io_advise(int fd, int64_t offset, int64_t count, int advice);
+// the errno value of the last failed call to the C library on this thread
+SCOPES_LIBEXPORT int sc_io_errno();
 
 // globals
 
@@ -328,12 +476,28 @@ SCOPES_LIBEXPORT const sc_scope_t *sc_get_globals();
 SCOPES_LIBEXPORT const sc_scope_t *sc_get_original_globals();
 SCOPES_LIBEXPORT void sc_set_globals(const sc_scope_t *s);
 
+// contexts
+
+// a context keeps its own globals, which start out as the globals current at
+// its creation, typically those of the booted core. entering a context waits
+// until no other thread has one entered; once hosts use contexts, every
+// thread must enter one before it calls into the compiler. contexts are left
+// in the reverse order they were entered in.
+SCOPES_LIBEXPORT sc_context_t *sc_context_new();
+SCOPES_LIBEXPORT void sc_context_free(sc_context_t *ctx);
+SCOPES_LIBEXPORT void sc_context_enter(sc_context_t *ctx);
+SCOPES_LIBEXPORT void sc_context_leave(sc_context_t *ctx);
+
 // error handling
 
 SCOPES_LIBEXPORT void sc_error_append_calltrace(sc_error_t *err, sc_valueref_t callexpr);
 SCOPES_LIBEXPORT const sc_string_t *sc_format_error(const sc_error_t *err);
 SCOPES_LIBEXPORT void sc_dump_error(const sc_error_t *err);
 SCOPES_LIBEXPORT sc_error_t *sc_error_new(const sc_string_t *msg);
+// between these calls, runtime functions on this thread raise one shared
+// error without details, for callers that discard what they catch
+SCOPES_LIBEXPORT void sc_speculation_begin();
+SCOPES_LIBEXPORT void sc_speculation_end();
 SCOPES_LIBEXPORT void sc_set_signal_abort(bool value);
 SCOPES_LIBEXPORT void sc_abort();
 SCOPES_LIBEXPORT void sc_exit(int c);
@@ -342,6 +506,18 @@ SCOPES_LIBEXPORT void sc_exit(int c);
 
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_map_get(sc_valueref_t key);
 SCOPES_LIBEXPORT void sc_map_set(sc_valueref_t key, sc_valueref_t value);
+// keys are grouped into namespaces by their first value; a capacity of 0
+// leaves the table of a namespace unbounded
+SCOPES_LIBEXPORT void sc_memo_set_capacity(sc_valueref_t ns, int capacity);
+SCOPES_LIBEXPORT void sc_memo_clear(sc_valueref_t ns);
+// returns a list of (namespace hits misses evictions size capacity) entries
+SCOPES_LIBEXPORT const sc_list_t *sc_memo_stats();
+// while enabled, the prover counts the specializations of every template and
+// the time spent proving them, and the JIT the size of their machine code;
+// sc_instance_stats lists (name instances signatures prove-ms code-bytes)
+// per template, the largest first
+SCOPES_LIBEXPORT void sc_set_instance_stats_enabled(bool enable);
+SCOPES_LIBEXPORT const sc_list_t *sc_instance_stats();
 
 // hashing
 
@@ -353,6 +529,7 @@ SCOPES_LIBEXPORT uint64_t sc_hashbytes (const char *data, size_t size);
 
 SCOPES_LIBEXPORT sc_scope_raises_t sc_import_c(const sc_string_t *path,
     const sc_string_t *content, const sc_list_t *arglist, const sc_scope_t *scope);
+SCOPES_LIBEXPORT sc_list_raises_t sc_import_c_batch(const sc_list_t *jobs);
 SCOPES_LIBEXPORT sc_void_raises_t sc_load_library(const sc_string_t *name);
 SCOPES_LIBEXPORT sc_void_raises_t sc_load_object(const sc_string_t *path);
 
@@ -391,13 +568,18 @@ SCOPES_LIBEXPORT sc_symbol_t sc_symbol_style(sc_symbol_t name);
 SCOPES_LIBEXPORT const sc_string_t *sc_string_new(const char *ptr, size_t count);
 SCOPES_LIBEXPORT const sc_string_t *sc_string_new_from_cstr(const char *ptr);
 SCOPES_LIBEXPORT const sc_string_t *sc_string_join(const sc_string_t *a, const sc_string_t *b);
+SCOPES_LIBEXPORT const sc_string_t *sc_string_join_many(int count, const sc_string_t **strings);
 SCOPES_LIBEXPORT sc_bool_i32_i32_raises_t sc_string_match(const sc_string_t *pattern, const sc_string_t *text);
+SCOPES_LIBEXPORT sc_bool_i32_i32_raises_t sc_string_match_from(const sc_string_t *pattern, const sc_string_t *text, int offset);
 SCOPES_LIBEXPORT size_t sc_string_count(const sc_string_t *str);
 SCOPES_LIBEXPORT sc_rawstring_size_t_tuple_t sc_string_buffer(const sc_string_t *str);
 SCOPES_LIBEXPORT const sc_string_t *sc_string_lslice(const sc_string_t *str, size_t offset);
 SCOPES_LIBEXPORT const sc_string_t *sc_string_rslice(const sc_string_t *str, size_t offset);
 SCOPES_LIBEXPORT int sc_string_compare(const sc_string_t *a, const sc_string_t *b);
 SCOPES_LIBEXPORT const sc_string_t *sc_string_unescape(const sc_string_t *str);
+// formats value into dest as tostring does, for f32 if single is set, and
+// returns the length of the text, which was only written if it is less than size
+SCOPES_LIBEXPORT size_t sc_format_real(char *dest, size_t size, double value, bool single);
 
 // lists
 
@@ -0,0 +1,442 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""Allocator
+    =========
+
+    Provides the allocators that the standard containers obtain their memory
+    from. An allocator is a type that supplies two functions:
+
+        :::scopes
+        inline alloc-array (T count) # returns a (mutable pointer T)
+        inline free (ptr)
+
+    Containers take an allocator type as an optional parameter, and default
+    to `DefaultAllocator`, which uses the heap. The module also provides an
+    `Arena`, which releases all its allocations at once, and a `Pool`, which
+    recycles blocks of a single size. `allocator-for` turns an instance of
+    either into an allocator type:
+
+        :::scopes
+        global frame-arena : Arena
+        let FrameArray = (GrowingArray i32 (allocator-for frame-arena))
+
+    `SlabAllocator` keeps a slab of blocks for every type it allocates, on
+    every thread, and is meant for `Box` and `Rc` values of types that are
+    allocated in large numbers. A type can make it the default for the boxes
+    and reference counted values that hold it, by declaring it as its
+    `__allocator`:
+
+        :::scopes
+        struct Node
+            let __allocator = SlabAllocator
+            value : i32
+        let node = (Box.new Node 1) # allocated from a slab
+
+using import struct
+
+""""The supertype of all allocator types.
+typedef Allocator
+
+""""The allocator used by containers unless another one is specified, which
+    allocates from the heap with `malloc-array` and `free`. If `alloc-profile?`
+    is true, it allocates through `sc_alloc_profile_malloc` instead, which
+    records the bytes allocated by the calling function for each element
+    type; `sc_alloc_profile_print` reports them.
+typedef DefaultAllocator < Allocator
+    inline alloc-array (T count)
+        static-if alloc-profile?
+            bitcast
+                sc_alloc_profile_malloc T ((sizeof T) * (count as usize))
+                mutable @T
+        else
+            malloc-array T count
+
+    inline free (ptr)
+        static-if alloc-profile?
+            sc_alloc_profile_free (bitcast ptr (mutable voidstar))
+        else
+            free ptr
+
+# the allocator that T declares as its __allocator, or DefaultAllocator
+spice type-allocator (T)
+    T as:= type
+    let allocator =
+        try ('@ T '__allocator)
+        except (err)
+            return `DefaultAllocator
+    if (not ((allocator as type) < Allocator))
+        error "__allocator must be an allocator type"
+    allocator
+
+run-stage;
+
+typedef+ Allocator
+    """"Internally used by containers. Returns `allocator`, or, if it is
+        none, the allocator that the element type `T` declares as its
+        `__allocator`, or `DefaultAllocator`.
+    inline resolve (allocator T)
+        static-if (none? allocator)
+            static-if (none? T) DefaultAllocator
+            else (type-allocator T)
+        else
+            static-assert (allocator < Allocator) "allocator type expected"
+            allocator
+
+    """"Internally used by containers. Returns the text that is appended to
+        the name of a container type that uses `allocator`.
+    inline type-name-suffix (allocator)
+        static-if (allocator == DefaultAllocator) ""
+        else (.. " " (tostring allocator))
+
+""""Returns an allocator type that allocates from `instance`, which must be a
+    global `Arena`, `Pool` or any other value that implements the methods
+    `alloc-array (self T count)` and `free (self ptr)`.
+@@ memo
+inline allocator-for (instance)
+    typedef (.. "<Allocator " (tostring (typeof instance)) ">") < Allocator
+        inline alloc-array (T count)
+            'alloc-array instance T count
+
+        inline free (ptr)
+            'free instance ptr
+
+################################################################################
+
+# blocks and chunks start with a link to the next one in their list, and
+  leave the rest of this header unused to keep what follows aligned.
+let HEADER_SIZE = 16:usize
+let HEADER_ALIGN = 16:usize
+
+inline link (block)
+    bitcast block (mutable @(mutable @u8))
+
+fn free-linked-blocks (block)
+    loop (block = block)
+        if ((ptrtoint block usize) == 0:usize)
+            break;
+        let next = (load (link block))
+        free block
+        next
+
+inline align-offset (offset align)
+    (offset + (align - 1:usize)) & (~ (align - 1:usize))
+
+let ARENA_BLOCK_SIZE = (64:usize << 10:usize)
+
+""""A bump allocator that hands out memory from large blocks. Freeing a
+    single allocation does nothing; instead, all allocations are released at
+    once when the arena is reset or dropped.
+
+    To construct an arena with a block size other than 64 KiB:
+
+        :::scopes
+        local arena = (Arena (block-size = ...))
+struct Arena
+    _block : (mutable @u8)
+    _offset : usize
+    _end : usize
+    _block-size : usize
+
+    inline __typecall (cls block-size)
+        Struct.__typecall cls
+            _block-size =
+                static-if (none? block-size) ARENA_BLOCK_SIZE
+                else (block-size as usize)
+
+    fn new-block (self size)
+        let size = (max (deref self._block-size) (HEADER_SIZE + size))
+        let block = (malloc-array u8 size)
+        store (deref self._block) (link block)
+        self._block = block
+        self._offset = HEADER_SIZE
+        self._end = size
+
+    # returns the address of size bytes with the given alignment
+    fn allocate (self size align)
+        let offset = (align-offset (deref self._offset) align)
+        let offset =
+            if ((offset + size) > self._end)
+                # blocks are only aligned to HEADER_ALIGN
+                new-block self (size + (max align HEADER_ALIGN))
+                align-offset (deref self._offset) align
+            else offset
+        self._offset = offset + size
+        (ptrtoint (deref self._block) usize) + offset
+
+    """"Returns uninitialized memory for `count` elements of type `T`, which
+        stays valid until the arena is reset or dropped.
+    inline alloc-array (self T count)
+        let size = ((sizeof T) * (count as usize))
+        inttoptr (allocate self size (alignof T)) (mutable pointer T)
+
+    """"Does nothing; memory is only released when the arena is reset.
+    inline free (self ptr)
+        lose ptr
+
+    """"Releases all allocations at once. The most recent block is kept for
+        reuse; all others are freed.
+    fn reset (self)
+        let block = (deref self._block)
+        if ((ptrtoint block usize) == 0:usize)
+            return;
+        free-linked-blocks (load (link block))
+        store (nullof (mutable @u8)) (link block)
+        self._offset = HEADER_SIZE
+        return;
+
+    inline __drop (self)
+        free-linked-blocks (deref self._block)
+
+let POOL_CHUNK_BLOCKS = 64:usize
+
+""""An allocator for blocks of a single size, which keeps freed blocks for
+    reuse and allocates new ones in chunks. Requests larger than the block
+    size raise an assertion. This makes pools a good fit for `Box` and `Rc`
+    values of a single type.
+
+    To construct a new pool for blocks of at least `size` bytes:
+
+        :::scopes
+        local pool = (Pool size [(chunk-blocks = ...)])
+struct Pool
+    # unused blocks, linked through their first word
+    _free : (mutable @u8)
+    # chunks of blocks, linked through their header
+    _chunk : (mutable @u8)
+    _block-size : usize
+    _chunk-blocks : usize
+
+    inline __typecall (cls block-size chunk-blocks)
+        Struct.__typecall cls
+            # blocks must be able to hold the link and keep elements aligned
+            _block-size = (align-offset (max (block-size as usize) HEADER_ALIGN) HEADER_ALIGN)
+            _chunk-blocks =
+                static-if (none? chunk-blocks) POOL_CHUNK_BLOCKS
+                else (chunk-blocks as usize)
+
+    fn new-chunk (self)
+        let size = (deref self._block-size)
+        let count = (deref self._chunk-blocks)
+        let chunk = (malloc-array u8 (HEADER_SIZE + count * size))
+        store (deref self._chunk) (link chunk)
+        self._chunk = chunk
+        for i in (rrange count)
+            let block = (getelementptr chunk (HEADER_SIZE + i * size))
+            store (deref self._free) (link block)
+            self._free = block
+
+    fn allocate (self size)
+        assert (size <= self._block-size) "allocation exceeds the pool's block size"
+        if ((ptrtoint (deref self._free) usize) == 0:usize)
+            new-chunk self
+        let block = (deref self._free)
+        self._free = (load (link block))
+        block
+
+    """"Returns an unused block as uninitialized memory for `count` elements of
+        type `T`.
+    inline alloc-array (self T count)
+        bitcast (allocate self ((sizeof T) * (count as usize))) (mutable pointer T)
+
+    """"Returns the block at `ptr` to the pool.
+    fn free (self ptr)
+        let block = (bitcast (deref ptr) (mutable @u8))
+        if ((ptrtoint block usize) == 0:usize)
+            return;
+        store (deref self._free) (link block)
+        self._free = block
+        return;
+
+    """"Returns the size of the blocks handed out by the pool.
+    inline block-size (self)
+        deref self._block-size
+
+    inline __drop (self)
+        free-linked-blocks (deref self._chunk)
+
+################################################################################
+
+let SLAB_CHUNK_SIZE = (64:usize << 10:usize)
+# chunks are aligned to their size, and start with a pointer to the heap they
+  belong to, which leaves the rest of a cache line unused
+let SLAB_HEADER_SIZE = 64:usize
+
+let posix_memalign =
+    extern 'posix_memalign
+        function i32 (mutable pointer voidstar) usize usize
+let _aligned_malloc =
+    extern '_aligned_malloc
+        function voidstar usize usize
+
+fn alloc-slab-chunk ()
+    let chunk =
+        static-if (operating-system == 'windows)
+            _aligned_malloc SLAB_CHUNK_SIZE SLAB_CHUNK_SIZE
+        else
+            local ptr = (nullof voidstar)
+            posix_memalign (& ptr) SLAB_CHUNK_SIZE SLAB_CHUNK_SIZE
+            deref ptr
+    assert ((ptrtoint chunk usize) != 0:usize) "out of memory"
+    bitcast chunk (mutable @u8)
+
+# a thread local byte, whose address identifies the calling thread
+let thread-token =
+    extern unnamed u8 'thread-local (storage-class = 'Private)
+
+# the blocks of a single type that one thread allocates
+struct SlabHeap plain
+    # the address of the thread-token of the owning thread
+    _thread : usize
+    # the next heap for the same type, on another thread
+    _next : usize
+    _block-size : usize
+    # blocks freed by the owning thread, linked through their first word
+    _free : (mutable @u8)
+    # blocks freed by other threads, which the owning thread takes over as a
+      whole once its own list is empty
+    _remote : usize
+    # the unused blocks at the end of the newest chunk
+    _bump : usize
+    _bump-end : usize
+    _allocated : u64
+    _freed : u64
+    _remote-freed : u64
+    _chunks : u64
+
+# the list of all heaps for T, and the heap of the calling thread
+@@ memo
+inline slab-of (T)
+    _
+        private usize
+        extern unnamed (mutable pointer SlabHeap) 'thread-local
+            storage-class = 'Private
+
+# blocks hold the link to the next free block in their first word
+inline slab-block-size (T)
+    align-offset (max (sizeof T) 8:usize) (max (alignof T) 8:usize)
+
+fn new-slab-heap (heaps heap block-size)
+    let ptr = (malloc SlabHeap)
+    store
+        SlabHeap
+            _thread = (ptrtoint thread-token usize)
+            _block-size = block-size
+        ptr
+    let h = (ptr @ 0)
+    loop ()
+        let first = (atomic-load heaps)
+        h._next = first
+        let old ok = (cmpxchg heaps first (ptrtoint ptr usize))
+        if ok
+            break;
+    store ptr heap
+    ptr
+
+fn slab-alloc (heap)
+    let h = (heap @ 0)
+    let block =
+        if ((ptrtoint (deref h._free) usize) != 0:usize)
+            deref h._free
+        else
+            let remote = (atomicrmw xchg (& h._remote) 0:usize)
+            if (remote != 0:usize)
+                inttoptr remote (mutable @u8)
+            else
+                if (h._bump == h._bump-end)
+                    let chunk = (alloc-slab-chunk)
+                    store (bitcast heap (mutable @u8)) (link chunk)
+                    let count = ((SLAB_CHUNK_SIZE - SLAB_HEADER_SIZE) // h._block-size)
+                    h._bump = (ptrtoint chunk usize) + SLAB_HEADER_SIZE
+                    h._bump-end = h._bump + count * h._block-size
+                    h._chunks += 1:u64
+                let block = (inttoptr (deref h._bump) (mutable @u8))
+                h._bump += h._block-size
+                store (nullof (mutable @u8)) (link block)
+                block
+    h._free = (load (link block))
+    h._allocated += 1:u64
+    block
+
+fn slab-free (block)
+    if ((ptrtoint block usize) == 0:usize)
+        return;
+    let chunk =
+        inttoptr ((ptrtoint block usize) & (~ (SLAB_CHUNK_SIZE - 1:usize)))
+            \ (mutable @u8)
+    let h = ((bitcast (load (link chunk)) (mutable pointer SlabHeap)) @ 0)
+    if (h._thread == (ptrtoint thread-token usize))
+        store (deref h._free) (link block)
+        h._free = block
+        h._freed += 1:u64
+    else
+        loop ()
+            let first = (atomic-load (& h._remote))
+            store (inttoptr first (mutable @u8)) (link block)
+            let old ok = (cmpxchg (& h._remote) first (ptrtoint block usize))
+            if ok
+                break;
+        atomicrmw add (& h._remote-freed) 1:u64
+        ;
+    return;
+
+fn slab-stats (heaps)
+    loop (ptr live chunks = (atomic-load heaps) 0:i64 0:u64)
+        if (ptr == 0:usize)
+            break live chunks
+        let h = ((inttoptr ptr (mutable pointer SlabHeap)) @ 0)
+        let freed = (h._freed + (atomic-load (& h._remote-freed)))
+        _ (deref h._next)
+            live + (h._allocated as i64) - (freed as i64)
+            chunks + h._chunks
+
+""""An allocator that keeps a slab of blocks for every type it allocates,
+    on every thread. Blocks are allocated and freed without locking; a block
+    freed by another thread than the one that allocated it is passed back to
+    its slab through a list that the owning thread takes over once its own
+    blocks are used up.
+
+    Slabs grow in chunks of 64 KiB, which stay reserved for their type until
+    the program exits, and a slab of a thread that has exited is only reused
+    for blocks freed afterwards. Only single values of up to 16 KiB can be
+    allocated.
+typedef SlabAllocator < Allocator
+    """"Returns a block for a single value of type `T` from the slab of the
+        calling thread.
+    inline alloc-array (T count)
+        static-assert ((alignof T) <= SLAB_HEADER_SIZE)
+            "slab blocks can't be aligned to more than 64 bytes"
+        static-assert ((sizeof T) <= (SLAB_CHUNK_SIZE >> 2:usize))
+            "slab blocks can't be larger than 16 KiB"
+        assert ((count as usize) == 1:usize) "slabs only hold single values"
+        let heaps heap = (slab-of T)
+        let ptr = (load heap)
+        let ptr =
+            if ((ptrtoint ptr usize) == 0:usize)
+                new-slab-heap heaps heap (slab-block-size T)
+            else ptr
+        bitcast (slab-alloc ptr) (mutable pointer T)
+
+    """"Returns the block at `ptr` to the slab it was allocated from.
+    inline free (ptr)
+        slab-free (bitcast ptr (mutable @u8))
+
+    """"Returns the number of values of type `T` that are allocated and not
+        yet freed, and the number of chunks holding them, over all threads.
+        The counts of other threads can lag behind while they allocate.
+        `Rc` values are allocated as the `StorageType` of their `Rc` type.
+    inline stats (T)
+        let heaps = (slab-of T)
+        slab-stats heaps
+
+    """"Returns the number of values of type `T` that are allocated and not
+        yet freed.
+    inline live-count (T)
+        let live = (stats T)
+        live
+
+do
+    let Allocator DefaultAllocator Arena Pool SlabAllocator allocator-for
+    locals;
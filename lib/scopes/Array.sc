@@ -7,15 +7,53 @@
     =====
 
     Provides mutable array types that store their elements on the heap rather
-    than in registers or the stack.
+    than in registers or the stack. `SmallArray` keeps its first elements
+    inside the array itself and only moves to the heap when they outgrow it.
 
 using import struct
+using import Allocator
+using import Span
 
 # declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
                                         i64 <len>, i1 <isvolatile>)
 let llvm.memcpy.p0i8.p0i8.i64 =
     extern 'llvm.memcpy.p0i8.p0i8.i64
         function void (mutable rawstring) rawstring i64 bool
+# declare void @llvm.memmove.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
+                                         i64 <len>, i1 <isvolatile>)
+let llvm.memmove.p0i8.p0i8.i64 =
+    extern 'llvm.memmove.p0i8.p0i8.i64
+        function void (mutable rawstring) rawstring i64 bool
+
+# moves count elements within an array; moves are bitwise for all element
+  types, so this is a single block move.
+inline move-elements (dest src count)
+    let ET = (elementof (typeof dest))
+    llvm.memmove.p0i8.p0i8.i64
+        bitcast dest (mutable rawstring)
+        bitcast src rawstring
+        ((count as usize) * (sizeof ET)) as i64
+        false
+
+spice drop-many? (T)
+    T as:= type
+    try
+        '@ T '__drop-many
+        `true
+    except (err)
+        `false
+
+run-stage;
+
+# drops the elements in [start, end); plain elements are skipped, and element
+  types that define `__drop-many (items count)` drop them in one call
+inline drop-elements (items start end)
+    let ET = (elementof (typeof items))
+    static-if (drop-many? ET)
+        ET.__drop-many (getelementptr items start) (end - start)
+    elseif (not (plain? ET))
+        for idx in (range start end)
+            __drop (items @ idx)
 
 fn iParent (i)
     (i - 1:i64) // 2
@@ -29,7 +67,8 @@ inline... array-generator (self, offset : usize = 0:usize)
     Generator
         inline () offset
         inline (i) (i < self._count)
-        inline (i) (self @ i)
+        # the generator checks the index itself
+        inline (i) (unchecked@ self i)
         inline (i) (i + 1:usize)
 
 inline array-collector (self)
@@ -44,6 +83,7 @@ inline array-collector (self)
 typedef Array < Struct
 typedef FixedArray < Array
 typedef GrowingArray < Array
+typedef SmallArray < Array
 
 """"The abstract supertype of both `FixedArray` and `GrowingArray` which
     supplies methods shared by both implementations.
@@ -61,22 +101,24 @@ typedef+ Array
         Generator
             inline () (deref self._count)
             inline (i) (i > offset)
-            inline (i) (self @ (i - 1:usize))
+            inline (i) (unchecked@ self (i - 1:usize))
             inline (i) (i - 1:usize)
 
     """"Implements support for pointer casts, to pass the array to C functions
-        for example.
+        for example, and for implicit conversion to a `Span` of its elements.
     inline __imply (cls T)
         static-match T
         case pointer
-            inline (self) (self._items as cls.PointerType)
+            inline (self) (('internal-items self) as cls.PointerType)
         case voidstar
-            inline (self) (self._items as voidstar)
+            inline (self) (('internal-items self) as voidstar)
         case cls.PointerType
-            inline (self) (self._items as cls.PointerType)
+            inline (self) (('internal-items self) as cls.PointerType)
+        case cls.ViewType
+            inline (self) ('span self)
         default ()
 
-    inline __typecall (cls element-type capacity)
+    inline __typecall (cls element-type capacity allocator)
         """"Construct a mutable array type of `element-type` with a variable or
             fixed maximum capacity.
 
@@ -84,11 +126,14 @@ typedef+ Array
             of array elements permitted. If it is undefined, then an initial
             capacity of 16 elements is assumed, which is doubled whenever
             it is exceeded, allowing for an indefinite number of elements.
+
+            If `allocator` is defined, the array obtains its memory from it
+            rather than from the heap.
         static-assert (cls == Array)
         static-if (none? capacity)
-            GrowingArray element-type
+            GrowingArray element-type allocator
         else
-            FixedArray element-type capacity
+            FixedArray element-type capacity allocator
 
     """"Implements support for the `countof` operator. Returns the current
         number of elements stored in `self` as a value of `usize` type.
@@ -97,17 +142,41 @@ typedef+ Array
 
     """"Implements support for the `@` operator. Returns a view reference to the
         element at `index` of array `self`.
-    fn __@ (self index)
+    inline __@ (self index)
         let index = (index as usize)
-        assert (index < self._count) "index out of bounds"
-        self._items @ index
-
-    fn last (self)
+        static-if bounds-checks?
+            assert (likely (index < self._count)) "index out of bounds"
+        ('internal-items self) @ index
+
+    """"Implements support for the `unchecked@` operator. Returns a view
+        reference to the element at `index` of array `self` without checking
+        that `index` is in bounds.
+    inline __unchecked@ (self index)
+        ('internal-items self) @ (index as usize)
+
+    """"Returns a `Span` of the elements in `[start, end)`, or of all elements,
+        which views the memory of the array rather than copying it.
+    inline span (self start end)
+        let cls = (typeof self)
+        let count = (deref self._count)
+        let start =
+            static-if (none? start) 0:usize
+            else (min (start as usize) count)
+        let end =
+            static-if (none? end) count
+            else (max start (min (end as usize) count))
+        cls.ViewType (getelementptr ('internal-items self) start) (end - start)
+
+    """"Hashes the elements of the array the same as a `Span` of them.
+    fn __hash (self)
+        hash ('span self)
+
+    inline last (self)
         assert (self._count > 0) "empty array has no last element"
-        self._items @ (self._count - 1:usize)
+        ('internal-items self) @ (self._count - 1:usize)
 
     @@ memo
-    inline gen-sort (key predicate)
+    inline gen-sort (key predicate stable?)
         let key =
             static-if (none? key)
                 inline (x) x
@@ -117,6 +186,39 @@ typedef+ Array
                 inline (a b) (< a b)
             else predicate
 
+        # moves count elements as plain memory, without running constructors
+          or destructors
+        inline move-items (dest src count)
+            let ET = (elementof (typeof dest))
+            llvm.memcpy.p0i8.p0i8.i64
+                bitcast dest (mutable rawstring)
+                bitcast src rawstring
+                ((count as usize) * (sizeof ET)) as i64
+                false
+
+        # orders the elements at indices a and b
+        inline sort2 (items a b ...)
+            let v_a = (items @ a)
+            let v_b = (items @ b)
+            if (pred (key v_b ...) (key v_a ...) ...)
+                swap v_a v_b
+
+        # sorts the inclusive range lo..hi; stable
+        fn insertion-sort (items lo hi ...)
+            loop (i = (lo + 1:i64))
+                if (i > hi)
+                    break;
+                loop (j = i)
+                    if (j <= lo)
+                        break;
+                    let v_prev = (items @ (j - 1:i64))
+                    let v_j = (items @ j)
+                    if (not (pred (key v_j ...) (key v_prev ...) ...))
+                        break;
+                    swap v_prev v_j
+                    j - 1:i64
+                i + 1:i64
+
         fn siftDown (items start end ...)
             loop (root = start)
                 if ((iLeftChild root) > end)
@@ -144,7 +246,7 @@ typedef+ Array
                 else
                     step1 root v_root k_root
 
-        fn "sort-array" (items count ...)
+        fn heap-sort (items count ...)
             let count-1 = (count - 1:i64)
 
             # heapify
@@ -164,12 +266,203 @@ typedef+ Array
                 siftDown items 0:i64 end ...
                 repeat end
 
+        # partitions the inclusive range lo..hi around the median of its first,
+          middle and last element and returns the final index of the pivot.
+          elements equal to the pivot stop both scans, so ranges with many
+          duplicates still split evenly.
+        fn partition (items lo hi ...)
+            let mid = (lo + ((hi - lo) // 2:i64))
+            sort2 items lo mid ...
+            sort2 items mid hi ...
+            sort2 items lo mid ...
+            swap (items @ lo) (items @ mid)
+            # the pivot stays at lo until the scans have met
+            let pivot = (key (items @ lo) ...)
+            let j =
+                loop (i j = lo (hi + 1:i64))
+                    let i =
+                        loop (i = (i + 1:i64))
+                            if ((i >= hi) or (not (pred (key (items @ i) ...) pivot ...)))
+                                break i
+                            i + 1:i64
+                    let j =
+                        loop (j = (j - 1:i64))
+                            if (not (pred pivot (key (items @ j) ...) ...))
+                                break j
+                            j - 1:i64
+                    if (i >= j)
+                        break j
+                    swap (items @ i) (items @ j)
+                    _ i j
+            swap (items @ lo) (items @ j)
+            j
+
+        # quicksort that falls back to heapsort for ranges that keep
+          partitioning badly, and to insertion sort for short ranges
+        fn introsort (items lo hi depth ...)
+            returning void
+            loop (lo hi depth = lo hi depth)
+                if ((hi - lo) < 16:i64)
+                    insertion-sort items lo hi ...
+                    break;
+                if (depth <= 0)
+                    heap-sort (getelementptr items lo) (hi - lo + 1:i64) ...
+                    break;
+                let p = (partition items lo hi ...)
+                let depth = (depth - 1)
+                # recurse into the smaller side and iterate on the larger one,
+                  which bounds the stack depth by log2 of the count
+                if ((p - lo) < (hi - p))
+                    this-function items lo (p - 1:i64) depth ...
+                    _ (p + 1:i64) hi depth
+                else
+                    this-function items (p + 1:i64) hi depth ...
+                    _ lo (p - 1:i64) depth
+            ;
+
+        # keys of these types are sorted by their bits; typedefs are left to
+          their own comparison operators
+        inline radix-sortable? (KT)
+            static-if (KT != (storageof KT)) false
+            elseif (KT < integer) true
+            else (KT < real)
+
+        # maps a key to an unsigned integer with the same order
+        inline radix-key (k)
+            let k = (deref k)
+            let KT = (typeof k)
+            static-if (KT == f32)
+                let u = (bitcast k u32)
+                let u =
+                    ? ((u & 0x80000000:u32) == 0:u32) (u | 0x80000000:u32) (~ u)
+                u as u64
+            elseif (KT == f64)
+                let u = (bitcast k u64)
+                ? ((u & 0x8000000000000000:u64) == 0:u64)
+                    u | 0x8000000000000000:u64
+                    ~ u
+            elseif (signed? KT)
+                # flipping the sign bit moves negative values first
+                let bits = ((bitcountof KT) as u64)
+                let u = ((k as i64) as u64)
+                (u ^ (1:u64 << (bits - 1:u64))) & (-1:u64 >> (64:u64 - bits))
+            else
+                k as u64
+
+        # stable LSD radix sort over the bytes of the key. all digit histograms
+          are gathered in one pass, and digits that are equal for every element
+          are skipped.
+        fn radix-sort (items count ...)
+            let ET = (elementof (typeof items))
+            let KT = (unqualified (typeof (key (items @ 0) ...)))
+            let digits = ((sizeof KT) as i64)
+            let counts = (malloc-array u64 ((digits * 256:i64) as usize))
+            for i in (range (digits * 256:i64))
+                counts @ i = 0:u64
+            for i in (range count)
+                let k = (radix-key (key (items @ i) ...))
+                for d in (range digits)
+                    let b = ((k >> ((d * 8:i64) as u64)) & 0xff:u64)
+                    counts @ (d * 256:i64 + (b as i64)) += 1:u64
+            let tmp = (malloc-array ET (count as usize))
+            let first = (radix-key (key (items @ 0) ...))
+            let src =
+                loop (d src dest = 0:i64 items tmp)
+                    if (d == digits)
+                        break src
+                    let shift = ((d * 8:i64) as u64)
+                    let hist = (getelementptr counts (d * 256:i64))
+                    if ((hist @ ((first >> shift) & 0xff:u64)) == (count as u64))
+                        repeat (d + 1:i64) src dest
+                    # turn counts into offsets
+                    loop (b ofs = 0:i64 0:u64)
+                        if (b == 256:i64)
+                            break;
+                        let c = (deref (hist @ b))
+                        hist @ b = ofs
+                        _ (b + 1:i64) (ofs + c)
+                    for i in (range count)
+                        let b = (((radix-key (key (src @ i) ...)) >> shift) & 0xff:u64)
+                        let pos = (deref (hist @ b))
+                        move-items (getelementptr dest pos) (getelementptr src i) 1
+                        hist @ b = pos + 1:u64
+                    _ (d + 1:i64) dest src
+            if (src != items)
+                move-items items src count
+            free tmp
+            free counts
+
+        # merges the sorted ranges lo..mid and mid..hi, exclusive. the left
+          run is moved out of the way; the right run is merged in place, as
+          the write position never overtakes it.
+        fn merge (items tmp lo mid hi ...)
+            let n = (mid - lo)
+            move-items tmp (getelementptr items lo) n
+            loop (i j k = 0:i64 mid lo)
+                if (i == n)
+                    break;
+                # taking from the right only when strictly smaller keeps
+                  equal elements in order
+                if ((j < hi) and (pred (key (items @ j) ...) (key (tmp @ i) ...) ...))
+                    move-items (getelementptr items k) (getelementptr items j) 1
+                    _ i (j + 1:i64) (k + 1:i64)
+                else
+                    move-items (getelementptr items k) (getelementptr tmp i) 1
+                    _ (i + 1:i64) j (k + 1:i64)
+
+        fn merge-sort (items count ...)
+            let ET = (elementof (typeof items))
+            # sort short runs in place, then merge them bottom up
+            loop (lo = 0:i64)
+                if (lo >= count)
+                    break;
+                insertion-sort items lo (min (lo + 15:i64) (count - 1:i64)) ...
+                lo + 16:i64
+            let tmp = (malloc-array ET (count as usize))
+            loop (width = 16:i64)
+                if (width >= count)
+                    break;
+                loop (lo = 0:i64)
+                    let mid = (lo + width)
+                    if (mid >= count)
+                        break;
+                    let hi = (min (mid + width) count)
+                    merge items tmp lo mid hi ...
+                    hi
+                width * 2:i64
+            free tmp
+
+        static-if (none? stable?)
+            fn "sort-array" (items count ...)
+                if (count < 2:i64)
+                    return;
+                let KT = (unqualified (typeof (key (items @ 0) ...)))
+                static-if (none? predicate)
+                    static-if (radix-sortable? KT)
+                        if (count >= 256:i64)
+                            radix-sort items count ...
+                            return;
+                # twice the depth of a balanced partitioning
+                let depth =
+                    loop (depth n = 0 count)
+                        if (n <= 1:i64)
+                            break (depth * 2)
+                        _ (depth + 1) (n // 2:i64)
+                introsort items 0:i64 (count - 1:i64) depth ...
+        else
+            fn "stable-sort-array" (items count ...)
+                if (count < 2:i64)
+                    return;
+                merge-sort items count ...
+
     """"Sort elements of array `self` from smallest to largest, either using
         the `<` operator supplied by the element type, or by using the key
         supplied by the callable `key`, which is expected to return a comparable
-        value for each element value supplied.
+        value for each element value supplied. The order of equal elements is
+        not preserved. Plain integer and real keys are sorted with a radix
+        sort, any other keys with an introsort.
     inline sort (self key ...)
-        (gen-sort key) (deref self._items) ((deref self._count) as i64) ...
+        (gen-sort key) ('internal-items self) ((deref self._count) as i64) ...
 
     """"Sort elements of array `self` from smallest to largest, either using
         the `<` operator supplied by the element type, or by using the predicate
@@ -177,14 +470,25 @@ typedef+ Array
         is expected to return true if the first argument is smaller than the
         second one.
     inline predicated-sort (self predicate ...)
-        (gen-sort (predicate = predicate)) (deref self._items) ((deref self._count) as i64) ...
+        (gen-sort (predicate = predicate)) ('internal-items self) ((deref self._count) as i64) ...
+
+    """"Sort elements of array `self` like `sort`, but keep equal elements in
+        the order they were in. Uses a merge sort with a temporary buffer the
+        size of the array.
+    inline stable-sort (self key ...)
+        (gen-sort key (stable? = true)) ('internal-items self) ((deref self._count) as i64) ...
+
+    """"Sort elements of array `self` like `predicated-sort`, but keep equal
+        elements in the order they were in.
+    inline predicated-stable-sort (self predicate ...)
+        (gen-sort (predicate = predicate) (stable? = true)) ('internal-items self) ((deref self._count) as i64) ...
 
     fn append-slots (self n)
         let idx = (deref self._count)
         let new-count = (idx + n)
         'reserve self new-count
         self._count = new-count
-        self._items @ idx
+        ('internal-items self) @ idx
 
     """"Append `value` as an element to the array `self` and return a reference
         to the new element. When the `array` is of `GrowingArray` type, this
@@ -223,10 +527,10 @@ typedef+ Array
             let count = (deref self._count)
             assert (index <= count) "insertion index out of bounds"
             append-slots self 1:usize
-            let items = self._items
-            for i in (rrange index count)
-                assign (dupe (items @ i)) (items @ (i + 1))
-            let slot = (self._items @ index)
+            let items = ('internal-items self)
+            move-elements (getelementptr items (index + 1)) (getelementptr items index)
+                count - index
+            let slot = (items @ index)
             assign value slot
             slot
         inline... insert
@@ -241,7 +545,7 @@ typedef+ Array
         assert (&count > 0) "can't pop from empty array"
         &count -= 1
         let idx = (deref &count)
-        dupe (deref (self._items @ idx))
+        dupe (deref (('internal-items self) @ idx))
 
     """"Remove element at index from array `self` and return it.
         This operation offsets the index of each following element by -1.
@@ -249,18 +553,17 @@ typedef+ Array
         let &count = self._count
         assert (index < &count) "can't remove from empty array"
         &count -= 1
-        let items = self._items
+        let items = ('internal-items self)
         let result =
             dupe (deref (items @ index))
-        for i in (range index &count)
-            assign (dupe (items @ (i + 1))) (items @ i)
+        move-elements (getelementptr items index) (getelementptr items (index + 1))
+            &count - index
         result
 
     """"Clear the array and reset its element count to zero. This will drop
         all elements that have been previously contained by the array.
     fn clear (self)
-        for idx in (range (deref self._count))
-            __drop (self._items @ idx)
+        drop-elements ('internal-items self) 0:usize (deref self._count)
         self._count = 0:usize
         return;
 
@@ -273,22 +576,22 @@ typedef+ Array
             delta := count - self._count
             emplace-append-many self delta args...
         else
-            offset := self._count - count
-            for idx in (range offset (deref self._count))
-                __drop (self._items @ idx)
+            drop-elements ('internal-items self) count (deref self._count)
             self._count = count
 
     """"Implements support for freeing the array's memory when it goes out
         of scope.
     fn __drop (self)
         returning void
-        for idx in (range (deref self._count))
-            __drop (self._items @ idx)
-        free self._items
+        let cls = (typeof self)
+        drop-elements ('internal-items self) 0:usize (deref self._count)
+        if (not ('internal-inline? self))
+            cls.Allocator.free self._items
 
     """"Safely swap the contents of two indices.
     fn swap (self a b)
-        swap (self._items @ a) (self._items @ b)
+        let items = ('internal-items self)
+        swap (items @ a) (items @ b)
 
     """"Implements support for the `copy` operation.
     fn __copy (self)
@@ -296,22 +599,34 @@ typedef+ Array
         returning (uniqueof (typeof self) -1)
         local newarr = (dupe (deref self))
         let count = (deref self._count)
-        let old-items = (deref self._items)
+        let old-items = ('internal-items self)
         let T = (typeof self)
         let capacity = ('capacity self)
-        let new-items = (malloc-array T.ElementType capacity)
-        loop (idx = 0)
-            if (idx < count)
-                assign (copy (old-items @ idx)) (new-items @ idx)
-                repeat (idx + 1)
-            else
-                break;
-        assign new-items newarr._items
+        # the bitwise duplicate already has room for inline elements
+        if (not ('internal-inline? self))
+            assign (T.Allocator.alloc-array T.ElementType capacity) newarr._items
+        let new-items = ('internal-items newarr)
+        static-if (plain? T.ElementType)
+            llvm.memcpy.p0i8.p0i8.i64
+                bitcast new-items (mutable rawstring)
+                bitcast old-items rawstring
+                (count * (sizeof T.ElementType)) as i64
+                false
+        else
+            loop (idx = 0)
+                if (idx < count)
+                    assign (copy (old-items @ idx)) (new-items @ idx)
+                    repeat (idx + 1)
+                else
+                    break;
         newarr
 
     @@ memo
     inline __== (cls T)
-        static-if (cls == T)
+        static-if (T == cls.ViewType)
+            inline (self other)
+                ('span self) == other
+        elseif (cls == T)
             fn (self other)
                 and
                     self._count == other._count
@@ -353,11 +668,13 @@ inline assign-items (cls count dest items...)
 
         :::scopes
         local new-array : (FixedArray element-type capacity)
+
+    An allocator type may be passed as third argument.
 typedef+ FixedArray
     let parent-type = this-type
 
     @@ memo
-    inline gen-fixed-array-type (element-type capacity)
+    inline gen-fixed-array-type (element-type capacity allocator)
         static-assert ((typeof element-type) == type)
         static-assert ((typeof capacity) == i32)
         let parent-type = this-type
@@ -366,6 +683,7 @@ typedef+ FixedArray
                 tostring element-type
                 " x "
                 tostring capacity
+                Allocator.type-name-suffix allocator
                 ">"
             \ < parent-type
 
@@ -375,17 +693,20 @@ typedef+ FixedArray
             let
                 ElementType = element-type
                 PointerType = (pointer element-type)
+                ViewType = (Span element-type)
                 Capacity = capacity
+                Allocator = allocator
 
     inline __typecall (cls opts...)
         static-if (cls == this-type)
-            let element-type capacity = opts...
+            let element-type capacity allocator = opts...
             gen-fixed-array-type element-type (capacity as i32)
+                Allocator.resolve allocator
         else
             let items... = (filter-items opts...)
             let count = (va-countof items...)
             static-assert (count <= cls.Capacity) "capacity exceeded"
-            let items = (malloc-array cls.ElementType cls.Capacity)
+            let items = (cls.Allocator.alloc-array cls.ElementType cls.Capacity)
             assign-items cls count items items...
             Struct.__typecall cls
                 _items = items
@@ -411,11 +732,24 @@ typedef+ FixedArray
         let T = (typeof self)
         assert (count <= T.Capacity) "capacity exceeded"
 
+    """"Internally used by the type. Returns a pointer to the elements of
+        array `self`.
+    inline internal-items (self)
+        deref self._items
+
+    """"Internally used by the type. Fixed arrays are never stored inline.
+    inline internal-inline? (self) false
 
     unlet gen-fixed-array-type parent-type
 
 let DEFAULT_CAPACITY = (1:usize << 2:usize)
 
+fn nearest-capacity (capacity count)
+    loop (new-capacity = capacity)
+        if (new-capacity < count)
+            repeat (new-capacity * 27:usize // 10:usize)
+        break new-capacity
+
 """"The supertype and constructor for arrays of growing size. New instances
     have a default capacity of 4, and grow by a factor of 2.7 each time their
     capacity is exceeded.
@@ -429,16 +763,19 @@ let DEFAULT_CAPACITY = (1:usize << 2:usize)
 
         :::scopes
         local new-array : (GrowingArray element-type) [(capacity = ...)]
+
+    An allocator type may be passed as second argument.
 typedef+ GrowingArray
     let parent-type = this-type
 
     @@ memo
-    inline gen-growing-array-type (element-type)
+    inline gen-growing-array-type (element-type allocator)
         static-assert ((typeof element-type) == type)
         let parent-type = this-type
         struct
             .. "<GrowingArray "
                 tostring element-type
+                Allocator.type-name-suffix allocator
                 ">"
             \ < parent-type
             _items : (mutable pointer element-type)
@@ -448,16 +785,13 @@ typedef+ GrowingArray
             let
                 ElementType = element-type
                 PointerType = (pointer element-type)
-
-    fn nearest-capacity (capacity count)
-        loop (new-capacity = capacity)
-            if (new-capacity < count)
-                repeat (new-capacity * 27:usize // 10:usize)
-            break new-capacity
+                ViewType = (Span element-type)
+                Allocator = allocator
 
     inline __typecall (cls opts...)
         static-if (cls == this-type)
-            gen-growing-array-type opts...
+            let element-type allocator = opts...
+            gen-growing-array-type element-type (Allocator.resolve allocator)
         else
             let capacity =
                 nearest-capacity DEFAULT_CAPACITY
@@ -465,7 +799,7 @@ typedef+ GrowingArray
             let items... = (filter-items opts...)
             let count = (va-countof items...)
             let capacity = (nearest-capacity capacity count)
-            let items = (malloc-array cls.ElementType capacity)
+            let items = (cls.Allocator.alloc-array cls.ElementType capacity)
             assign-items cls count items items...
             Struct.__typecall cls
                 _items = items
@@ -488,6 +822,14 @@ typedef+ GrowingArray
     inline capacity (self)
         deref self._capacity
 
+    """"Internally used by the type. Returns a pointer to the elements of
+        array `self`.
+    inline internal-items (self)
+        deref self._items
+
+    """"Internally used by the type. Growing arrays are never stored inline.
+    inline internal-inline? (self) false
+
     """"Internally used by the type. Ensures that array `self` can hold at least
         `count` elements. A growing array will always attempt to comply.
     fn reserve (self count)
@@ -501,20 +843,149 @@ typedef+ GrowingArray
             let T = (typeof self)
             let count = (deref self._count)
             let old-items = (deref self._items)
-            let new-items = (malloc-array T.ElementType new-capacity)
+            let new-items = (T.Allocator.alloc-array T.ElementType new-capacity)
+            llvm.memcpy.p0i8.p0i8.i64
+                bitcast (view new-items) (mutable rawstring)
+                bitcast old-items rawstring
+                (count * (sizeof T.ElementType)) as i64
+                false
+            T.Allocator.free old-items
+            assign new-items self._items
+            self._capacity = new-capacity
+        return;
+
+    unlet gen-growing-array-type parent-type
+
+""""The supertype and constructor for arrays that store up to a fixed number
+    of elements inline, without allocating. When that number is exceeded, the
+    elements move to the heap, and the array grows like a `GrowingArray`.
+
+    To construct a new small array type:
+
+        :::scopes
+        SmallArray element-type inline-capacity
+
+    Instantiate a new array with mutable memory:
+
+        :::scopes
+        local new-array : (SmallArray element-type inline-capacity) [(capacity = ...)]
+
+    An allocator type for the heap elements may be passed as third argument.
+typedef+ SmallArray
+    let parent-type = this-type
+
+    @@ memo
+    inline gen-small-array-type (element-type capacity allocator)
+        static-assert ((typeof element-type) == type)
+        static-assert ((typeof capacity) == i32)
+        static-assert (capacity > 0) "inline capacity must be at least 1"
+        let parent-type = this-type
+        struct
+            .. "<SmallArray "
+                tostring element-type
+                " x "
+                tostring capacity
+                Allocator.type-name-suffix allocator
+                ">"
+            \ < parent-type
+            # null while the elements are inline
+            _items : (mutable pointer element-type)
+            # elements are kept as their storage type, so that the array can
+              be copied to the stack when it is passed by value
+            _inline : (array (storageof element-type) capacity)
+            _count : usize
+            _capacity : usize
+
+            let
+                ElementType = element-type
+                PointerType = (pointer element-type)
+                ViewType = (Span element-type)
+                InlineCapacity = (capacity as usize)
+                Allocator = allocator
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            let element-type capacity allocator = opts...
+            gen-small-array-type element-type (capacity as i32)
+                Allocator.resolve allocator
+        else
+            let items... = (filter-items opts...)
+            let count = (va-countof items...)
+            # default initialization zeroes the inline elements
+            local self =
+                Struct.__typecall cls
+                    _count = 0:usize
+                    _capacity = cls.InlineCapacity
+            'reserve self
+                max ((va-option capacity opts... 0:usize) as usize) (count as usize)
+            assign-items cls count ('internal-items self) items...
+            self._count = count
+            deref self
+
+    """"Implements support for the `repr` operation.
+    fn __repr (self)
+        ..
+            "[count="
+            repr self._count
+            " capacity="
+            repr self._capacity
+            " items="
+            repr ('internal-items self)
+            "]"
+
+    """"Returns the current maximum capacity of array `self`, which is at least
+        its inline capacity.
+    inline capacity (self)
+        deref self._capacity
+
+    """"Internally used by the type. Returns true if the elements of array
+        `self` are stored inline.
+    inline internal-inline? (self)
+        self._capacity <= ((typeof self) . InlineCapacity)
+
+    """"Internally used by the type. Returns a pointer to the elements of
+        array `self`, which may point into the array itself; an array that is
+        passed by value is first copied to the stack.
+    inline internal-items (self)
+        let PT = (mutable pointer ((typeof self) . ElementType))
+        static-if (&? self)
+            ? ('internal-inline? self)
+                bitcast (& self._inline) PT
+                deref self._items
+        else
+            local storage = (deref self._inline)
+            ? ('internal-inline? self)
+                bitcast (& storage) PT
+                deref self._items
+
+    """"Internally used by the type. Ensures that array `self` can hold at least
+        `count` elements, moving the elements to the heap when they no longer
+        fit inline.
+    fn reserve (self count)
+        if (count <= self._capacity)
+            return;
+        do
+            let new-capacity =
+                nearest-capacity (max DEFAULT_CAPACITY (deref self._capacity)) count
+            let T = (typeof self)
+            let count = (deref self._count)
+            let inline? = ('internal-inline? self)
+            let old-items = ('internal-items self)
+            let new-items = (T.Allocator.alloc-array T.ElementType new-capacity)
             llvm.memcpy.p0i8.p0i8.i64
                 bitcast (view new-items) (mutable rawstring)
                 bitcast old-items rawstring
                 (count * (sizeof T.ElementType)) as i64
                 false
-            free old-items
+            if (not inline?)
+                T.Allocator.free old-items
             assign new-items self._items
             self._capacity = new-capacity
         return;
 
-    unlet gen-growing-array-type parent-type nearest-capacity
+    unlet gen-small-array-type parent-type
 
 do
-    let Array FixedArray GrowingArray
+    let Array FixedArray GrowingArray SmallArray
     locals;
 
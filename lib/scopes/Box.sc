@@ -6,31 +6,42 @@
 """"Box
     ===
 
-    Provides a unique reference container for heap allocated values.
+    Provides a unique reference container for heap allocated values. The
+    value is allocated from the heap, unless an allocator type is passed as
+    `(Box T allocator)`, or `T` declares one as its `__allocator`.
+
+using import Allocator
 
 typedef Box
 
     @@ memo
-    inline gen-type (T)
-        typedef (.. "<Box " (tostring T) ">") < this-type :: (mutable pointer T)
+    inline gen-type (T allocator)
+        typedef
+            .. "<Box " (tostring T) (Allocator.type-name-suffix allocator) ">"
+            \ < this-type :: (mutable pointer T)
             let Type = T
+            let Allocator = allocator
+            let NonNull = true
             inline __typecall (cls args...)
-                let ptr = (malloc T)
+                let ptr = (allocator.alloc-array T 1)
                 store (T args...) ptr
                 bitcast ptr this-type
 
     inline... __typecall
     case (cls, T : type)
-        gen-type T
+        gen-type T (Allocator.resolve none T)
+    case (cls, T : type, allocator : type)
+        gen-type T (Allocator.resolve allocator)
 
     inline new (T args...)
-        (gen-type T) args...
+        (gen-type T (Allocator.resolve none T)) args...
 
     inline wrap (value)
         let ET = (typeof value)
-        let ptr = (malloc ET)
+        let BoxT = (gen-type ET (Allocator.resolve none ET))
+        let ptr = (BoxT.Allocator.alloc-array ET 1)
         store value ptr
-        bitcast ptr (gen-type ET)
+        bitcast ptr BoxT
 
     inline view (self)
         ptrtoref (storagecast (view self))
@@ -70,7 +81,8 @@ typedef Box
 
     inline __drop (self)
         __drop (view self)
-        free self
+        let cls = (typeof self)
+        cls.Allocator.free (bitcast self (mutable pointer cls.Type))
 
     unlet gen-type
 
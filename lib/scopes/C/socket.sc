@@ -6,11 +6,11 @@ include
         #include "unistd.h"
 
 do
-    using lib.define filter "^(AF_(.+)|PF_(.+)|SOCK_(.+)|IPPROTO_(.+)|INADDR_(.+)|SHUT_(.+))$"
+    using lib.define filter "^(AF_(.+)|PF_(.+)|SOCK_(.+)|IPPROTO_(.+)|INADDR_(.+)|SHUT_(.+)|SOL_(.+)|SO_(.+))$"
     #using lib.const filter "^(INADDR_(.+))$"
     #using lib.typedef filter "^(sockaddr)$"
     using lib.struct filter "^(sockaddr|sockaddr_(.+))$"
-    using lib.extern filter "^(socket|bind|listen|accept|connect|htons|htonl|close|read|recv|write|shutdown|setsockopt|inet_(.+))$"
+    using lib.extern filter "^(socket|socketpair|bind|listen|accept|connect|htons|htonl|ntohs|close|read|recv|write|shutdown|setsockopt|getsockname|inet_(.+))$"
 
     let
         INADDR_ANY       = 0x00000000:u32
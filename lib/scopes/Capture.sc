@@ -9,6 +9,12 @@
     A capture is a runtime closure that transparently captures (hence the name)
     runtime values outside of the function.
 
+    `capture` returns a closure of a type of its own, which is called
+    directly and never allocates. Implying it to a `Capture` erases its type,
+    so that closures of the same signature can be stored together; the
+    captured values are then kept inside the `Capture` if they fit into
+    `Capture.InlineSize` bytes, and on the heap otherwise.
+
 #-------------------------------------------------------------------------------
 # runtime closures
 #-------------------------------------------------------------------------------
@@ -16,6 +22,10 @@
 let DropFuncType =
     pointer (function void voidstar)
 
+# environments that fit are stored in the capture itself rather than on the
+  heap; a heap environment keeps its address in the first element
+let CaptureBuffer = (array u64 2)
+
 @@ memo
 inline dropper (T)
     static-typify
@@ -27,21 +37,34 @@ inline dropper (T)
         voidstar
 
 typedef Capture
+    let InlineSize = (sizeof CaptureBuffer)
+
+    # closures never change their environment, so an inline environment can
+      be handed to them as a copy on the stack
     inline __call (self args...)
-        let f env = (unpack (storagecast (view self)))
-        f env args...
+        let f dropf buffer inline? = (unpack (storagecast (view self)))
+        if inline?
+            local env = buffer
+            f (bitcast (& env) voidstar) args...
+        else
+            f (inttoptr (buffer @ 0) voidstar) args...
 
     @@ memo
     inline make-type (ftype fdrop)
         static-assert (ftype < function) "function type expected"
-        let ST = (tuple (pointer ftype) voidstar DropFuncType)
+        let ST = (tuple (pointer ftype) DropFuncType CaptureBuffer bool)
         typedef (.. "Capture<" (tostring ftype) ">") < this-type :: ST
             let FunctionType = ftype
 
     inline __drop (self)
-        let f env dropf = (unpack (storagecast (view self)))
-        dropf env
-        free (bitcast env (mutable pointer i8))
+        let f dropf buffer inline? = (unpack (storagecast (view self)))
+        if inline?
+            local env = buffer
+            dropf (bitcast (& env) voidstar)
+        else
+            let env = (inttoptr (buffer @ 0) voidstar)
+            dropf env
+            free (bitcast env (mutable pointer i8))
 
     inline __typecall (cls args...)
         static-if (cls == this-type)
@@ -50,10 +73,16 @@ typedef Capture
         else
             let f envtuple = args...
             let envT = (typeof envtuple)
-            let env = (malloc envT)
-            store envtuple env
-            let closure = (tupleof f (env as voidstar) (dropper envT))
-            bitcast closure cls
+            static-if (((sizeof envT) <= InlineSize)
+                and ((alignof envT) <= (alignof CaptureBuffer)))
+                local buffer : CaptureBuffer
+                store envtuple (bitcast (& buffer) (mutable pointer envT))
+                bitcast (tupleof f (dropper envT) (deref buffer) true) cls
+            else
+                let env = (malloc envT)
+                store envtuple env
+                let buffer = (arrayof u64 (ptrtoint env u64) 0:u64)
+                bitcast (tupleof f (dropper envT) buffer false) cls
 
     inline function (return-type param-types...)
         function return-type (viewof voidstar 1) param-types...
@@ -0,0 +1,395 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""FlatMap
+    =======
+
+    This module implements open addressing hashtables in the style of
+    SwissTable, as an alternative to `Map` and `Set`. Next to the keys, the
+    table keeps one control byte per slot, which either marks the slot as
+    empty or deleted, or holds 7 bits of the hash of the key in it. Probing
+    loads the control bytes of a group of 16 slots into a vector and matches
+    all of them at once, so that keys are compared only for slots whose
+    control byte matches.
+
+    `FlatMap key-type value-type` and `FlatSet key-type` support the same
+    operations as their `Map` and `Set` counterparts, and also accept
+    `(hash-function = ...)` and `(allocator = ...)`.
+
+using import struct
+using import Allocator
+using import Map
+
+# declare i16 @llvm.cttz.i16(i16 <src>, i1 <is_zero_undef>)
+let llvm.cttz.i16 =
+    extern 'llvm.cttz.i16
+        function u16 u16 bool
+
+let GroupWidth = 16:u64
+let GroupType = (vector u8 16)
+
+# control bytes of slots that hold no entry; full slots store the low 7 bits
+  of their hash, so their high bit is always clear
+let
+    CtrlEmpty = 0x80:u8
+    CtrlDeleted = 0xfe:u8
+
+# the value type of sets, which store no values
+let NoValue = (tuple)
+
+inline first-bit (bits)
+    (llvm.cttz.i16 bits false) as u64
+
+# bit i is set for each slot i of the group whose control byte equals byte
+inline match-byte (group byte)
+    bitcast (group == (vector.smear byte 16)) u16
+
+inline match-empty (group)
+    match-byte group CtrlEmpty
+
+inline match-empty-or-deleted (group)
+    bitcast (group >= (vector.smear CtrlEmpty 16)) u16
+
+inline hash-group (keyhash)
+    keyhash >> 7:u64
+
+inline hash-tag (keyhash)
+    (keyhash & 0x7f:u64) as u8
+
+# the number of entries a table with capacity slots holds before it grows
+inline max-load (capacity)
+    capacity - (capacity >> 3:u64)
+
+typedef FlatTable < Struct
+    let MinCapacity = 16:u64
+
+    @@ memo
+    inline gen-type (parent-type name key-type value-type hash-function allocator)
+        let hash-function =
+            static-if (none? hash-function) hash
+            else hash-function
+        struct
+            .. name (Allocator.type-name-suffix allocator) ">"
+            \ < parent-type
+            let KeyType = key-type
+            let ValueType = value-type
+            let HashFunction = hash-function
+            let Allocator = allocator
+
+            _ctrl : (mutable pointer GroupType)
+            _keys : (mutable pointer KeyType)
+            _values : (mutable pointer ValueType)
+            # the number of slots, a multiple of GroupWidth
+            _capacity : u64
+            _count : u64
+            # the number of empty slots that can still be filled before the
+              table must grow
+            _growth-left : u64
+
+    inline has-values? (cls)
+        cls.ValueType != NoValue
+
+    inline ctrl-bytes (self)
+        bitcast (deref self._ctrl) (mutable @u8)
+
+    inline full-slot? (self i)
+        ((ctrl-bytes self) @ i) < CtrlEmpty
+
+    inline key-hash (self key)
+        let cls = (typeof self)
+        (cls.HashFunction (key as cls.KeyType)) as u64
+
+    inline alloc-slots (cls capacity)
+        let groups = (capacity // GroupWidth)
+        let ctrl = (cls.Allocator.alloc-array GroupType groups)
+        for i in (range groups)
+            ctrl @ i = (vector.smear CtrlEmpty 16)
+        _ ctrl
+            cls.Allocator.alloc-array cls.KeyType capacity
+            cls.Allocator.alloc-array cls.ValueType capacity
+
+    inline init (cls capacity)
+        let ctrl keys values = (alloc-slots cls capacity)
+        Struct.__typecall cls
+            _ctrl = ctrl
+            _keys = keys
+            _values = values
+            _capacity = capacity
+            _count = 0:u64
+            _growth-left = (max-load capacity)
+
+    # returns the slot holding key, or -1:u64
+    fn find-index (self key keyhash)
+        let groupmask = ((self._capacity // GroupWidth) - 1:u64)
+        let tag = (hash-tag keyhash)
+        # triangular probing visits every group once
+        loop (g stride = ((hash-group keyhash) & groupmask) 0:u64)
+            let group = (deref (self._ctrl @ g))
+            loop (bits = (match-byte group tag))
+                if (bits == 0:u16)
+                    break;
+                let slot = (g * GroupWidth + (first-bit bits))
+                if ((deref (self._keys @ slot)) == key)
+                    return slot
+                bits & (bits - 1:u16)
+            # a key is never placed past a group with an empty slot
+            if ((match-empty group) != 0:u16)
+                return -1:u64
+            let stride = (stride + 1:u64)
+            _ ((g + stride) & groupmask) stride
+
+    # returns the first empty or deleted slot on the probe sequence of keyhash
+    fn find-free-slot (self keyhash)
+        let groupmask = ((self._capacity // GroupWidth) - 1:u64)
+        loop (g stride = ((hash-group keyhash) & groupmask) 0:u64)
+            let bits = (match-empty-or-deleted (deref (self._ctrl @ g)))
+            if (bits != 0:u16)
+                return (g * GroupWidth + (first-bit bits))
+            let stride = (stride + 1:u64)
+            _ ((g + stride) & groupmask) stride
+
+    # moves all entries into new storage with new-capacity slots, which also
+      discards all deleted slots
+    fn resize (self new-capacity)
+        let cls = (typeof self)
+        let old-bytes = (ctrl-bytes self)
+        let old-ctrl old-keys old-values old-capacity =
+            deref self._ctrl
+            deref self._keys
+            deref self._values
+            deref self._capacity
+        let ctrl keys values = (alloc-slots cls new-capacity)
+        self._ctrl = ctrl
+        self._keys = keys
+        self._values = values
+        self._capacity = new-capacity
+        self._growth-left = ((max-load new-capacity) - self._count)
+        let bytes = (ctrl-bytes self)
+        for i in (range old-capacity)
+            if ((old-bytes @ i) < CtrlEmpty)
+                let keyhash = (key-hash self (old-keys @ i))
+                # extract as new uniques
+                let key = (dupe (deref (old-keys @ i)))
+                let slot = (find-free-slot self keyhash)
+                bytes @ slot = (hash-tag keyhash)
+                assign key (self._keys @ slot)
+                static-if (has-values? cls)
+                    assign (dupe (deref (old-values @ i))) (self._values @ slot)
+        cls.Allocator.free old-ctrl
+        cls.Allocator.free old-keys
+        cls.Allocator.free old-values
+        return;
+
+    # returns the slot for key and whether key was already in it; a new slot
+      is claimed, but left uninitialized
+    fn prepare-insert (self key keyhash)
+        let slot = (find-index self key keyhash)
+        if (slot != -1:u64)
+            return slot true
+        if (self._growth-left == 0:u64)
+            let capacity = (deref self._capacity)
+            # if deleted slots take up most of the room, rehashing in place
+              frees enough of it
+            resize self
+                ? ((self._count * 2:u64) < (max-load capacity)) capacity
+                    capacity * 2:u64
+        let slot = (find-free-slot self keyhash)
+        let bytes = (ctrl-bytes self)
+        if ((bytes @ slot) == CtrlEmpty)
+            self._growth-left -= 1:u64
+        bytes @ slot = (hash-tag keyhash)
+        self._count += 1:u64
+        _ slot false
+
+    fn erase-slot (self slot)
+        let cls = (typeof self)
+        __drop (self._keys @ slot)
+        static-if (has-values? cls)
+            __drop (self._values @ slot)
+        let bytes = (ctrl-bytes self)
+        # a group only regains an empty slot if it still has one, so no
+          probe ever went past it to place a key
+        if ((match-empty (deref (self._ctrl @ (slot // GroupWidth)))) != 0:u16)
+            bytes @ slot = CtrlEmpty
+            self._growth-left += 1:u64
+        else
+            bytes @ slot = CtrlDeleted
+        self._count -= 1:u64
+        return;
+
+    fn drop-entries (self)
+        let cls = (typeof self)
+        for i in (range 0:u64 self._capacity)
+            if (full-slot? self i)
+                __drop (self._keys @ i)
+                static-if (has-values? cls)
+                    __drop (self._values @ i)
+
+    fn reserve (self count)
+        """"Makes room for `count` entries in total, so that inserting up to
+            that many entries does not grow the table.
+        let count = (count as u64)
+        let capacity =
+            loop (capacity = (deref self._capacity))
+                if ((max-load capacity) >= count)
+                    break capacity
+                capacity << 1:u64
+        if (capacity > self._capacity)
+            resize self capacity
+        return;
+
+    fn clear (self)
+        """"Removes all entries, but keeps the storage.
+        drop-entries self
+        for i in (range (self._capacity // GroupWidth))
+            self._ctrl @ i = (vector.smear CtrlEmpty 16)
+        self._count = 0:u64
+        self._growth-left = (max-load self._capacity)
+        return;
+
+    fn in? (self key)
+        (find-index self key (key-hash self key)) != -1:u64
+
+    @@ memo
+    inline __rin (elemT cls)
+        let KeyType = cls.KeyType
+        static-if (imply? elemT KeyType)
+            inline (key self)
+                in? self (imply key KeyType)
+
+    fn discard (self key)
+        """"Erases the entry for key; if there is none, nothing happens.
+        let slot = (find-index self key (key-hash self key))
+        if (slot != -1:u64)
+            erase-slot self slot
+        return;
+
+    inline slot-generator (self at)
+        inline next (i)
+            loop (i = (i + 1:u64))
+                if ((i >= self._capacity) or (full-slot? self i))
+                    break i
+                i + 1:u64
+        Generator
+            inline ()
+                if (full-slot? self 0:u64) 0:u64
+                else (next 0:u64)
+            inline (i) (i < self._capacity)
+            inline (i) (at i)
+            next
+
+    inline __tobool (self)
+        self._count != 0:u64
+
+    inline __countof (self)
+        (deref self._count) as usize
+
+    fn __drop (self)
+        returning void
+        let cls = (typeof self)
+        drop-entries self
+        cls.Allocator.free self._ctrl
+        cls.Allocator.free self._keys
+        cls.Allocator.free self._values
+        _;
+
+    unlet has-values? ctrl-bytes full-slot? alloc-slots find-free-slot resize
+        \ erase-slot drop-entries
+
+typedef FlatMap < FlatTable
+    fn set (self key value)
+        """"Inserts a new key -> value association into the map. If the key
+            already exists, its value is updated.
+        let cls = (typeof self)
+        local key : cls.KeyType = key
+        let slot found? = ('prepare-insert self key ('key-hash self key))
+        if found?
+            self._values @ slot = value
+        else
+            assign key (self._keys @ slot)
+            local value : cls.ValueType = value
+            assign value (self._values @ slot)
+        return;
+
+    fn getdefault (self key value)
+        """"Returns the value associated with key, or value if there is none.
+        let slot = ('find-index self key ('key-hash self key))
+        if (slot == -1:u64)
+            return (view value)
+        deref (self._values @ slot)
+
+    fn get (self key)
+        """"Returns the value associated with key or raises an error.
+        let slot = ('find-index self key ('key-hash self key))
+        if (slot == -1:u64)
+            raise (MapError.KeyNotFound)
+        self._values @ slot
+
+    inline __as (cls T)
+        static-if (T == Generator)
+            inline (self)
+                'slot-generator self
+                    inline (i)
+                        _ (deref (self._keys @ i)) (deref (self._values @ i))
+        else
+            ;
+
+    fn __copy (self)
+        local other : (typeof self)
+        'reserve other self._count
+        for k v in self
+            'set other (copy k) (copy v)
+        other
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            inline gen (key-type value-type hash-function allocator)
+                FlatTable.gen-type this-type
+                    .. "<FlatMap " (tostring key-type) "=" (tostring value-type)
+                    \ key-type value-type hash-function
+                    Allocator.resolve allocator
+            gen opts...
+        else
+            FlatTable.init cls FlatTable.MinCapacity
+
+typedef FlatSet < FlatTable
+    fn insert (self key)
+        """"Inserts a new key into the set.
+        let cls = (typeof self)
+        local key : cls.KeyType = key
+        let slot found? = ('prepare-insert self key ('key-hash self key))
+        if (not found?)
+            assign key (self._keys @ slot)
+        return;
+
+    inline __as (cls T)
+        static-if (T == Generator)
+            inline (self)
+                'slot-generator self
+                    inline (i) (deref (self._keys @ i))
+        else
+            ;
+
+    fn __copy (self)
+        local other : (typeof self)
+        'reserve other self._count
+        for k in self
+            'insert other (copy k)
+        other
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            inline gen (key-type hash-function allocator)
+                FlatTable.gen-type this-type
+                    .. "<FlatSet " (tostring key-type)
+                    \ key-type NoValue hash-function
+                    Allocator.resolve allocator
+            gen opts...
+        else
+            FlatTable.init cls FlatTable.MinCapacity
+
+do
+    let FlatMap FlatSet
+    locals;
@@ -46,6 +46,25 @@
         handler activated with argument 2
         last handler activated with argument 2
         handler activated with argument 3
+
+    Calling a function chain expands every function of the chain at the call
+    site. `'freeze` compiles the chain into a single function instead, which
+    can be called through a pointer:
+
+        :::scopes
+        let f = ('freeze activate i32)
+        f 4
+
+# the chain changes identity with every modification, so a frozen chain is
+  compiled again after the chain has changed
+@@ memo
+inline freeze-chain (chain types...)
+    static-typify
+        fn "frozen-chain" (args...)
+            chain args...
+            ;
+        types...
+
 typedef FunctionChain : (storageof type)
     inline __repr (self)
         repr (bitcast self type)
@@ -77,11 +96,20 @@ typedef FunctionChain : (storageof type)
         static-assert (constant? cls)
         let oldfn = cls.chain
         'define-symbol cls 'chain
-            inline (cls args...)
+            inline (args...)
                 f args...
                 oldfn args...
         self
 
+    inline freeze (self types...)
+        """"Returns the function chain compiled into a single function that
+            takes arguments of `types...` and calls every function of the
+            chain directly. Freezing the chain again after it has changed
+            returns a new function.
+        let cls = (bitcast self type)
+        static-assert (constant? cls)
+        freeze-chain cls.chain types...
+
     inline on (self)
         """"Returns a decorator that appends the provided function to the
             function chain.
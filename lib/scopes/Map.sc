@@ -6,13 +6,16 @@
 """"Map
     ===
 
-    This module implements a key -> value store using hashtables.
+    This module implements a key -> value store using hashtables. The map
+    obtains its memory from the heap, unless an allocator type is passed as
+    `(Map key-type value-type (allocator = ...))`.
 
 # generic Hashmap implementing Robin Hood Hashing, see
      http://sebastiansylvan.com/2013/05/08/robin-hood-hashing-should-be-your-default-hash-table-implementation/
 
 using import enum
 using import struct
+using import Allocator
 
 # declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
                                         i64 <len>, i1 <isvolatile>)
@@ -43,23 +46,49 @@ case (k : u64, mask : u64)
 enum MapError
     KeyNotFound
 
+# the view type of a key type that declares one, such as the `StringView` of
+  a `String`, or Nothing
+spice key-view-type (T)
+    T as:= type
+    try ('@ T 'ViewType)
+    except (err) `Nothing
+
+run-stage;
+
 typedef Map < Struct
     let MinCapacity = 16:u64
     let MinMask = (MinCapacity - 1:u64)
     let BitfieldType = u64
+    # the number of keys that lookup-many hashes and prefetches at once
+    let LookupBatchSize = 16:usize
 
     @@ memo
-    inline gen-type (key-type value-type hash-function)
+    inline gen-type (key-type value-type hash-function allocator)
         let parent-type = this-type
         let hash-function =
             static-if (none? hash-function) hash
             else hash-function
-        struct (.. "<Map " (tostring key-type) "=" (tostring value-type) ">") < parent-type
+        struct
+            .. "<Map " (tostring key-type) "=" (tostring value-type)
+                Allocator.type-name-suffix allocator
+                ">"
+            \ < parent-type
             let KeyType = key-type
             let ValueType = value-type
             let HashFunction = hash-function
+            let Allocator = allocator
+
+            inline from-generator (items count-hint)
+                """"Returns a new map holding the key -> value pairs produced
+                    by `items`. If the number of pairs is known, passing it as
+                    `count-hint` sizes the map once up front.
+                local self = (this-type)
+                'insert-many self items count-hint
+                self
 
             _valid : (mutable pointer BitfieldType)
+            # the hash of every key, so probing never has to rehash keys
+            _hashes : (mutable pointer u64)
             _keys : (mutable pointer KeyType)
             _values : (mutable pointer ValueType)
             _count : u64
@@ -83,13 +112,28 @@ typedef Map < Struct
         let ofs = (idx // 64:u64)
         ((self._valid @ ofs) & flag) == flag
 
+    # hashes a key that is about to be looked up; keys of the view type of
+      the key type are hashed as they are, which gives the same hash without
+      building a key first
+    inline lookup-hash (self key)
+        let selfT = (typeof self)
+        let hash-function = selfT.HashFunction
+        let view-key? =
+            (unqualified (typeof key)) == (key-view-type selfT.KeyType)
+        let default-hash? =
+            static-if ((typeof hash-function) == type) (hash-function == hash)
+            else false
+        static-if (view-key? and default-hash?)
+            (hash key) as u64
+        else
+            (hash-function (key as selfT.KeyType)) as u64
+
     fn terseness (self)
         """"Computes the hashmap load as a normal between 0.0 and 1.0.
         self._count / (self._mask + 1:u64)
 
     inline insert_entry (self key keyhash value mask)
         let cls = (typeof self)
-        let hash = ((typeof self) . HashFunction)
         let mask =
             static-if (none? mask) (deref self._mask)
             else mask
@@ -105,7 +149,7 @@ typedef Map < Struct
             let index = (addpos pos i mask)
             if (valid-slot? self index) # already occupied
                 let pos_key = (self._keys @ index)
-                let pos_keyhash = ((hash (deref pos_key)) as u64)
+                let pos_keyhash = (deref (self._hashes @ index))
                 let pd = (keydistance pos_keyhash index mask)
                 repeat (i + 1:u64)
                     + 1:u64
@@ -114,19 +158,20 @@ typedef Map < Struct
                             let pos_value = (self._values @ index)
                             swap pos_key (view key)
                             swap pos_value (view value)
+                            self._hashes @ index = keyhash
                             keyhash = pos_keyhash
                             dupe pd
                         else
                             dist
             else # free
                 set-slot self index
+                self._hashes @ index = keyhash
                 assign key (self._keys @ index)
                 assign value (self._values @ index)
                 self._count += 1
                 break;
 
     inline erase_pos (self pos mask)
-        let hash = ((typeof self) . HashFunction)
         let mask =
             static-if (none? mask) self._mask
             else mask
@@ -144,12 +189,14 @@ typedef Map < Struct
                 let atvalue = (self._values @ index)
                 let prev_key = (self._keys @ index_prev)
                 let prev_value = (self._values @ index_prev)
-                let pd = (keydistance ((hash atkey) as u64) index mask)
+                let athash = (deref (self._hashes @ index))
+                let pd = (keydistance athash index mask)
                 if ((pd == 0) or (not (valid-slot? self index)))
                     unset-slot self index_prev
                     merge done
                 swap atkey prev_key
                 swap atvalue prev_value
+                self._hashes @ index_prev = athash
                 i + 1:u64
         self._count = self._count - 1:u32
         _ key value
@@ -157,22 +204,21 @@ typedef Map < Struct
     inline lookup (self key keyhash successf failf mask)
         """"Finds the index and address of an entry associated with key or
             invokes label failf on failure.
-        let hash = ((typeof self) . HashFunction)
         let mask =
             static-if (none? mask) (deref self._mask)
             else mask
         loop (pos dist = (keypos keyhash mask) 0:u64)
             if (not (valid-slot? self pos))
                 return (failf)
-            let pos_key = (deref (self._keys @ pos))
-            if (pos_key == key)
+            let pos_keyhash = (deref (self._hashes @ pos))
+            # only keys with an equal hash need to be compared
+            if ((pos_keyhash == keyhash) and ((deref (self._keys @ pos)) == key))
                 return (successf pos)
-            elseif (dist > (keydistance ((hash pos_key) as u64) pos mask))
+            elseif (dist > (keydistance pos_keyhash pos mask))
                 return (failf)
             repeat (nextpos pos mask) (dist + 1:u64)
 
     fn rehash (self newmask)
-        let hash = ((typeof self) . HashFunction)
         let oldmask = (deref self._mask)
         self._mask = newmask
         let mask =
@@ -182,7 +228,7 @@ typedef Map < Struct
             if (not (valid-slot? self i))
                 continue;
             let key value = (self._keys @ i) (self._values @ i)
-            let keyhash = ((hash key) as u64)
+            let keyhash = (deref (self._hashes @ i))
             lookup self key keyhash
                 inline "ok" (idx)
                     assert (idx == i)
@@ -195,22 +241,29 @@ typedef Map < Struct
                     insert_entry self key keyhash value
                 newmask
 
-    fn reserve (self new-capacity)
+    fn reserve-capacity (self new-capacity)
         let cls = (typeof self)
         let capacity = (deref self._capacity)
         let old-valid = (deref self._valid)
+        let old-hashes = (deref self._hashes)
         let old-keys = (deref self._keys)
         let old-values = (deref self._values)
         let validsize = ((capacity + 63:u64) // 64:u64)
         let new-validsize = ((new-capacity + 63:u64) // 64:u64)
-        let new-valid = (malloc-array BitfieldType new-validsize)
-        let new-keys = (malloc-array cls.KeyType new-capacity)
-        let new-values = (malloc-array cls.ValueType new-capacity)
+        let new-valid = (cls.Allocator.alloc-array BitfieldType new-validsize)
+        let new-hashes = (cls.Allocator.alloc-array u64 new-capacity)
+        let new-keys = (cls.Allocator.alloc-array cls.KeyType new-capacity)
+        let new-values = (cls.Allocator.alloc-array cls.ValueType new-capacity)
         llvm.memcpy.p0i8.p0i8.i64
             bitcast (view new-valid) (mutable rawstring)
             bitcast (view old-valid) rawstring
             (validsize * (sizeof BitfieldType)) as i64
             false
+        llvm.memcpy.p0i8.p0i8.i64
+            bitcast (view new-hashes) (mutable rawstring)
+            bitcast (view old-hashes) rawstring
+            (capacity * (sizeof u64)) as i64
+            false
         llvm.memcpy.p0i8.p0i8.i64
             bitcast (view new-keys) (mutable rawstring)
             bitcast (view old-keys) rawstring
@@ -223,10 +276,12 @@ typedef Map < Struct
             false
         for i in (range validsize new-validsize)
             new-valid @ i = 0:u64
-        free old-valid
-        free old-keys
-        free old-values
+        cls.Allocator.free old-valid
+        cls.Allocator.free old-hashes
+        cls.Allocator.free old-keys
+        cls.Allocator.free old-values
         assign new-valid self._valid
+        assign new-hashes self._hashes
         assign new-keys self._keys
         assign new-values self._values
         self._capacity = new-capacity
@@ -238,13 +293,35 @@ typedef Map < Struct
         if (l >= 0.9)
             if (self._mask >= maxmask)
                 # we must expand capacity
-                reserve self (self._capacity << 1:u64)
+                reserve-capacity self (self._capacity << 1:u64)
             # expand
             rehash self ((self._mask << 1:u64) + 1:u64)
         elseif ((l <= 0.225) and (self._mask > MinCapacity))
             # compact
             rehash self (self._mask >> 1:u64)
 
+    # like auto-rehash, but never compacts, so that space set aside by reserve
+      is kept while it is being filled
+    fn auto-expand (self)
+        if ((terseness self) >= 0.9)
+            auto-rehash self
+
+    fn reserve (self count)
+        """"Makes room for `count` entries in total, so that inserting up to
+            that many entries does not rehash the table.
+        let count = (count as u64)
+        let newmask =
+            loop (capacity = MinCapacity)
+                # stay below the load at which auto-rehash expands
+                if ((count * 10:u64) < (capacity * 9:u64))
+                    break (capacity - 1:u64)
+                capacity << 1:u64
+        if (newmask > self._mask)
+            if (newmask >= self._capacity)
+                reserve-capacity self (newmask + 1:u64)
+            rehash self newmask
+        return;
+
     fn clear (self)
         for i in (range 0:u64 (self._mask + 1:u64))
             if (valid-slot? self i)
@@ -255,10 +332,7 @@ typedef Map < Struct
         self._mask = MinMask
         return;
 
-    fn set (self key value)
-        """"Inserts a new key -> value association into map; key can be the
-            output of any custom hash function. If the key already exists,
-            it will be updated.
+    inline set-entry (self key value rehashf)
         let selfT = (typeof self)
         let hash = selfT.HashFunction
         let keyhash = ((hash (key as selfT.KeyType)) as u64)
@@ -268,9 +342,62 @@ typedef Map < Struct
                 return;
             inline "fail" ()
                 insert_entry self key keyhash value
-                auto-rehash self
+                rehashf self
                 return;
 
+    fn set (self key value)
+        """"Inserts a new key -> value association into map; key can be the
+            output of any custom hash function. If the key already exists,
+            it will be updated.
+        set-entry self key value auto-rehash
+
+    fn insert-entry (self key value)
+        set-entry self key value auto-expand
+
+    inline insert-many (self items count-hint)
+        """"Inserts all key -> value pairs produced by `items`, updating keys
+            that already exist. If the number of pairs is known, passing it as
+            `count-hint` grows the map once instead of repeatedly.
+        static-if (not (none? count-hint))
+            reserve self ((deref self._count) + (count-hint as u64))
+        for key value in items
+            insert-entry self key value
+
+    # returns the slot holding key, or -1:u64
+    fn find-index (self key keyhash)
+        lookup self key keyhash
+            inline "ok" (idx) idx
+            inline "fail" () -1:u64
+
+    inline lookup-many (self keys successf failf)
+        """"Looks up every key in the array-like `keys`, and calls
+            `successf i value` for each `keys @ i` that is in the map, or
+            `failf i` for each one that isn't. Keys are hashed in batches, and
+            the slots of a batch are prefetched before any of them is probed.
+        let count = ((countof keys) as usize)
+        local hashes : (array u64 LookupBatchSize)
+        loop (start = 0:usize)
+            if (start >= count)
+                break;
+            let n = (min (count - start) LookupBatchSize)
+            let mask = (deref self._mask)
+            for i in (range n)
+                let keyhash = (lookup-hash self (keys @ (start + i)))
+                hashes @ i = keyhash
+                let pos = (keypos keyhash mask)
+                prefetch (getelementptr (deref self._valid) (pos // 64:u64))
+                prefetch (getelementptr (deref self._hashes) pos)
+                prefetch (getelementptr (deref self._keys) pos)
+            for i in (range n)
+                let idx = (find-index self (keys @ (start + i)) (deref (hashes @ i)))
+                if (idx == -1:u64)
+                    failf (start + i)
+                    ;
+                else
+                    successf (start + i) (self._values @ idx)
+                    ;
+            start + n
+
     inline key-value-generator (self)
         inline next (i)
             let fin = (deref self._mask)
@@ -297,24 +424,23 @@ typedef Map < Struct
             ;
 
     fn in? (self key)
-        let selfT = (typeof self)
-        let hash = selfT.HashFunction
-        lookup self key ((hash (key as selfT.KeyType)) as u64)
+        lookup self key (lookup-hash self key)
             inline "ok" (idx) true
             inline "fail" () false
 
     @@ memo
     inline __rin (elemT cls)
         let KeyType = cls.KeyType
-        static-if (imply? elemT KeyType)
+        static-if (elemT == (key-view-type KeyType))
+            inline (key self)
+                in? self key
+        elseif (imply? elemT KeyType)
             inline (key self)
                 in? self (imply key KeyType)
 
     fn getdefault (self key value)
         """"Returns the value associated with key or raises an error.
-        let selfT = (typeof self)
-        let hash = selfT.HashFunction
-        lookup self key ((hash (key as selfT.KeyType)) as u64)
+        lookup self key (lookup-hash self key)
             inline "ok" (idx)
                 return (deref (self._values @ idx))
             inline "fail" ()
@@ -322,9 +448,7 @@ typedef Map < Struct
 
     fn get (self key)
         """"Returns the value associated with key or raises an error.
-        let selfT = (typeof self)
-        let hash = selfT.HashFunction
-        lookup self key ((hash (key as selfT.KeyType)) as u64)
+        lookup self key (lookup-hash self key)
             inline "ok" (idx)
                 return (self._values @ idx)
             inline "fail" ()
@@ -333,9 +457,7 @@ typedef Map < Struct
     fn discard (self key)
         """"Erases a key -> value association from the map; if the map does not
             contain this key, nothing happens.
-        let selfT = (typeof self)
-        let hash = selfT.HashFunction
-        lookup self key ((hash (key as selfT.KeyType)) as u64)
+        lookup self key (lookup-hash self key)
             inline "ok" (idx)
                 erase_pos self idx
                 auto-rehash self
@@ -345,9 +467,7 @@ typedef Map < Struct
 
     fn pop (self key)
         """"Erases a key -> value association from the map and pops the old value
-        let selfT = (typeof self)
-        let hash = selfT.HashFunction
-        lookup self key ((hash (key as selfT.KeyType)) as u64)
+        lookup self key (lookup-hash self key)
             inline "ok" (idx)
                 let k v = (erase_pos self idx)
                 auto-rehash self
@@ -363,13 +483,15 @@ typedef Map < Struct
 
     fn __drop (self)
         returning void
+        let cls = (typeof self)
         for i in (range 0:u64 (self._mask + 1:u64))
             if (valid-slot? self i)
                 __drop (self._keys @ i)
                 __drop (self._values @ i)
-        free self._valid
-        free self._keys
-        free self._values
+        cls.Allocator.free self._valid
+        cls.Allocator.free self._hashes
+        cls.Allocator.free self._keys
+        cls.Allocator.free self._values
         _;
 
     fn __copy (self)
@@ -380,18 +502,22 @@ typedef Map < Struct
 
     inline __typecall (cls opts...)
         static-if (cls == this-type)
-            let key-type value-type function-type = opts...
-            gen-type key-type value-type function-type
+            # the allocator is usually passed by keyword
+            inline gen (key-type value-type hash-function allocator)
+                gen-type key-type value-type hash-function
+                    Allocator.resolve allocator
+            gen opts...
         else
             let numsets = ((MinCapacity + 63:u64) // 64:u64)
-            let validset = (malloc-array BitfieldType numsets)
+            let validset = (cls.Allocator.alloc-array BitfieldType numsets)
             for i in (range 0:u64 numsets)
                 validset @ i = 0:u64
             let self =
                 Struct.__typecall cls
                     _valid = validset
-                    _keys = (malloc-array cls.KeyType MinCapacity)
-                    _values = (malloc-array cls.ValueType MinCapacity)
+                    _hashes = (cls.Allocator.alloc-array u64 MinCapacity)
+                    _keys = (cls.Allocator.alloc-array cls.KeyType MinCapacity)
+                    _values = (cls.Allocator.alloc-array cls.ValueType MinCapacity)
                     _count = 0:usize
                     _mask = MinMask
                     _capacity = MinCapacity
@@ -406,7 +532,8 @@ typedef Map < Struct
         print "terseness" (terseness self) "mask" self._mask "count" self._count
 
 
-    unlet unset-slot rehash auto-rehash lookup insert_entry reserve
+    unlet unset-slot rehash auto-rehash auto-expand lookup insert_entry
+        \ reserve-capacity find-index set-entry insert-entry lookup-hash
         \ erase_pos key-value-generator gen-type set-slot valid-slot?
 
 do
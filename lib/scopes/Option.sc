@@ -8,6 +8,11 @@
 
     Provides a value type that can be undefined.
 
+    An option of a type that declares `NonNull`, such as `Box` and `Rc`, is
+    stored as a null pointer when it is empty, and takes no more space than
+    the value itself. Raw pointers are stored with a tag, since null is a
+    valid pointer.
+
 using import .enum
 
 spice option-rimply (other-cls cls T)
@@ -20,6 +25,58 @@ spice option-rimply (other-cls cls T)
         return `(inline (self) (cls.Some (conv self)))
     return `()
 
+inline niche-null? (self)
+    (ptrtoint (storagecast (view self)) usize) == 0:usize
+
+# types with pointer storage whose values are never null leave null free
+  to mark the empty option
+spice null-niche? (T)
+    T as:= type
+    if (('storageof T) < pointer)
+        try
+            return `[(('@ T 'NonNull) as bool)]
+        except (err)
+            ;
+    `false
+
+# the payload of an option stored as a null pointer, following the rules of
+  enum payloads: views and references are aliased, other values are moved
+spice extract-niche-payload (self T)
+    T as:= type
+    let qcls = ('qualifiersof self)
+    let refer = ('refer? qcls)
+    let extracted =
+        if refer
+            let ptrT = ('change-element-type ('refer->pointer-type qcls) T)
+            spice-quote
+                ptrtoref (bitcast (reftoptr self) ptrT)
+        else
+            `(bitcast self T)
+    if (('view? qcls) or (not refer)) extracted
+    else
+        spice-quote
+            let newextracted = (dupe extracted)
+            lose self
+            newextracted
+
+spice dispatch-niche (self T handlers...)
+    let some-f none-f default-f =
+        fold (some-f none-f default-f = `none `none `none)
+            \ for i in (range ('argcount handlers...))
+            let key arg = ('dekey ('getarg handlers... i))
+            if (key == 'Some) (_ arg none-f default-f)
+            elseif (key == 'None) (_ some-f arg default-f)
+            elseif (key == unnamed) (_ some-f none-f arg)
+            else
+                error (.. "no such field in option: " (repr key))
+    inline pick (handler)
+        if (('typeof handler) == Nothing) default-f
+        else handler
+    let some-f none-f = (pick some-f) (pick none-f)
+    spice-quote
+        if (niche-null? self) (none-f)
+        else (some-f (extract-niche-payload self T))
+
 run-stage;
 
 let extract-payload = Enum.unsafe-extract-payload
@@ -30,10 +87,83 @@ typedef UnwrapError : (tuple)
 
 type Option < Enum
 
+@@ memo
+inline gen-niche-type (T)
+    typedef (.. "(Option " (tostring T) ")") < Option :: (storageof T)
+        inline None ()
+            inttoptr 0:usize this-type
+
+        inline Some (value)
+            bitcast (imply value T) this-type
+
+        inline... __typecall
+        case (cls : type,)
+            None;
+        case (cls : type, value)
+            # follow same rules as assignment
+            imply value this-type
+
+        inline __dispatch (self handlers...)
+            dispatch-niche self T handlers...
+
+        fn __repr (self)
+            viewing self
+            if (niche-null? self)
+                (.. "(" (tostring (typeof self)) ")") as string
+            else
+                .. "(" (repr (extract-niche-payload self T)) " as Option)"
+
+        inline __tobool (self)
+            not (niche-null? self)
+
+        inline swap (self newvalue)
+            let value = (deref (dupe self))
+            assign (imply newvalue this-type) self
+            value
+
+        inline __rimply (other-cls cls)
+            option-rimply other-cls cls T
+
+        inline force-unwrap (self)
+            assert self "unwrapping empty Option failed"
+            extract-niche-payload self T
+
+        inline unwrap (self)
+            if (not self)
+                raise (UnwrapError)
+            extract-niche-payload self T
+
+        fn __copy (self)
+            viewing self
+            if (niche-null? self) (None)
+            else (Some (copy (extract-niche-payload self T)))
+
+        inline __drop (self)
+            if (not (niche-null? self))
+                __drop (extract-niche-payload (view self) T)
+
+        inline __== (A B)
+            static-if (A == B)
+                fn (a b)
+                    viewing a
+                    viewing b
+                    let a-null? b-null? = (niche-null? a) (niche-null? b)
+                    if (a-null? or b-null?) (a-null? and b-null?)
+                    else
+                        (extract-niche-payload a T) == (extract-niche-payload b T)
+
+        fn __hash (self)
+            viewing self
+            if (niche-null? self) (nullof hash)
+            else (hash (extract-niche-payload self T))
+
 @@ memo
 inline gen-type (T)
     T := (unqualified T)
 
+    static-if (null-niche? T)
+        return (gen-niche-type T)
+
     enum (.. "(Option " (tostring T) ")") < Option
         None
         Some : T
@@ -0,0 +1,600 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""OrderedMap
+    ==========
+
+    This module implements B+ trees, which keep their keys in ascending
+    order, as an alternative to `Map` and `Set` when entries must be visited
+    in order or by ranges of keys. The entries are stored in leaves, next to
+    each other in arrays of up to 32 keys and values. Above the leaves,
+    inner nodes hold the keys that separate their children. The leaves are
+    linked in order, so that iterating from any position on only follows
+    one pointer per leaf:
+
+        :::scopes
+        local map : (OrderedMap i64 f32)
+        for t in (range 1000)
+            'set map (t as i64) ((t as f32) * 0.5)
+
+        # visit the entries with keys in [100, 200)
+        for t value in ('range map 100:i64 200:i64)
+            print t value
+
+    `OrderedMap key-type value-type` and `OrderedSet key-type` support the
+    same operations as their `Map` and `Set` counterparts, and also accept
+    `(allocator = ...)`. Keys are ordered by `<`. Besides iterating all
+    entries, `lower-bound`, `upper-bound` and `range` return generators of
+    the entries from a key on, which can be passed to the functions of
+    `itertools`. `load-sorted` appends sorted input to the tree in bulk,
+    filling each node before it starts the next one.
+
+    Erasing an entry never merges nodes; leaves that lose all their entries
+    stay in the tree until it is cleared.
+
+using import struct
+using import Allocator
+using import Map
+
+# the number of keys a node holds
+let NodeCapacity = 32:usize
+# the number of children an inner node has
+let ChildCapacity = 33:usize
+# full nodes are split into halves at this key
+let SplitIndex = 16:usize
+
+# nodes are stored as untyped pointers, and cast to their type only when
+  they are used
+let NodePointer = (mutable @u8)
+
+# the value type of sets, which store no values
+let NoValue = (tuple)
+
+inline null-node ()
+    nullof NodePointer
+
+inline null-node? (p)
+    (ptrtoint p usize) == 0:usize
+
+# moves the value at src to dest, which must not hold a value; src is left
+  without one
+inline move-to (src dest)
+    assign (dupe (deref src)) dest
+
+# the index of the first of the count keys that is not less than key, or, if
+  upper?, that is greater than key
+inline bound-index (keys count key upper?)
+    loop (lo hi = 0:usize (deref count))
+        if (lo >= hi)
+            break lo
+        let mid = ((lo + hi) >> 1:usize)
+        let k = (keys @ mid)
+        let after? =
+            static-if upper? (not (key < k))
+            else (k < key)
+        if after?
+            _ (mid + 1:usize) hi
+        else
+            _ lo mid
+
+typedef OrderedTable < Struct
+    @@ memo
+    inline gen-type (parent-type name key-type value-type allocator)
+        struct LeafNode
+            count : usize
+            # the next leaf in order
+            next : NodePointer
+            keys : (array key-type NodeCapacity)
+            values : (array value-type NodeCapacity)
+
+        # the keys of child i + 1 are not less than key i, and the keys of
+          child i are less than it
+        struct InnerNode
+            count : usize
+            keys : (array key-type NodeCapacity)
+            children : (array NodePointer ChildCapacity)
+
+        struct
+            .. name (Allocator.type-name-suffix allocator) ">"
+            \ < parent-type
+            let KeyType = key-type
+            let ValueType = value-type
+            let Allocator = allocator
+            let LeafNode = LeafNode
+            let InnerNode = InnerNode
+
+            _root : NodePointer
+            _first : NodePointer
+            _last : NodePointer
+            # the number of levels of inner nodes above the leaves
+            _height : usize
+            _count : usize
+
+    inline has-values? (cls)
+        cls.ValueType != NoValue
+
+    inline leaf-at (cls p)
+        (bitcast p (mutable pointer cls.LeafNode)) @ 0
+
+    inline inner-at (cls p)
+        (bitcast p (mutable pointer cls.InnerNode)) @ 0
+
+    inline new-leaf (cls)
+        let p = (cls.Allocator.alloc-array cls.LeafNode 1)
+        let node = (p @ 0)
+        node.count = 0:usize
+        node.next = (null-node)
+        bitcast p NodePointer
+
+    inline new-inner (cls)
+        let p = (cls.Allocator.alloc-array cls.InnerNode 1)
+        (p @ 0) . count = 0:usize
+        bitcast p NodePointer
+
+    inline init (cls)
+        let root = (new-leaf cls)
+        Struct.__typecall cls
+            _root = root
+            _first = root
+            _last = root
+            _height = 0:usize
+            _count = 0:usize
+
+    """"Internally used by the ordered containers. Returns references to the
+        key and value of entry `i` of leaf `p`.
+    inline entry-refs (self p i)
+        let node = (leaf-at (typeof self) p)
+        _ (node.keys @ i) (node.values @ i)
+
+    # returns the leaf that holds key if there is an entry for it
+    fn find-leaf (self key)
+        let cls = (typeof self)
+        loop (p level = (deref self._root) (deref self._height))
+            if (level == 0:usize)
+                break p
+            let node = (inner-at cls p)
+            let i = (bound-index node.keys node.count key true)
+            _ (deref (node.children @ i)) (level - 1:usize)
+
+    # skips past the ends of leaves from entry i of leaf p, and returns the
+      first leaf and index that hold an entry, or a null leaf
+    inline skip-empty (cls p i)
+        loop (p i = p i)
+            if ((null-node? p) or (i < ((leaf-at cls p) . count)))
+                break p i
+            _ (deref ((leaf-at cls p) . next)) 0:usize
+
+    inline bound-position (self key upper?)
+        let cls = (typeof self)
+        let p = (find-leaf self key)
+        let node = (leaf-at cls p)
+        skip-empty cls p (bound-index node.keys node.count key upper?)
+
+    """"Internally used by the ordered containers. Returns the leaf and index
+        of the entry for `key`, and whether there is one.
+    inline find-entry (self key)
+        let cls = (typeof self)
+        let p i = (bound-position self key false)
+        let found? =
+            if (null-node? p) false
+            else (not (key < ((leaf-at cls p) . keys @ i)))
+        _ p i found?
+
+    inline full? (self p level)
+        let cls = (typeof self)
+        if (level == 0:usize)
+            ((leaf-at cls p) . count) == NodeCapacity
+        else
+            ((inner-at cls p) . count) == NodeCapacity
+
+    # inserts child after child i of node, which must have room for it, and
+      leaves key i uninitialized
+    inline open-child (node i child)
+        let count = (deref node.count)
+        loop (j = count)
+            if (j == i)
+                break;
+            move-to (node.keys @ (j - 1:usize)) (node.keys @ j)
+            node.children @ (j + 1:usize) = node.children @ j
+            j - 1:usize
+        node.children @ (i + 1:usize) = child
+        node.count = count + 1:usize
+
+    # splits the full child i of the inner node parent in half, and inserts
+      the new right half and the key that separates the halves into parent,
+      which must not be full
+    fn split-child (self parent i level)
+        let cls = (typeof self)
+        let parent = (inner-at cls parent)
+        let left = (deref (parent.children @ i))
+        if (level == 0:usize)
+            let l = (leaf-at cls left)
+            let right = (new-leaf cls)
+            let r = (leaf-at cls right)
+            for j in (range SplitIndex NodeCapacity)
+                move-to (l.keys @ j) (r.keys @ (j - SplitIndex))
+                static-if (has-values? cls)
+                    move-to (l.values @ j) (r.values @ (j - SplitIndex))
+            l.count = SplitIndex
+            r.count = NodeCapacity - SplitIndex
+            r.next = l.next
+            l.next = right
+            if (left == (deref self._last))
+                self._last = right
+            open-child parent i right
+            assign (copy (r.keys @ 0)) (parent.keys @ i)
+        else
+            let l = (inner-at cls left)
+            let right = (new-inner cls)
+            let r = (inner-at cls right)
+            let offset = (SplitIndex + 1:usize)
+            for j in (range offset NodeCapacity)
+                move-to (l.keys @ j) (r.keys @ (j - offset))
+            for j in (range offset ChildCapacity)
+                r.children @ (j - offset) = l.children @ j
+            l.count = SplitIndex
+            r.count = NodeCapacity - offset
+            open-child parent i right
+            # the middle key moves up
+            move-to (l.keys @ SplitIndex) (parent.keys @ i)
+        return;
+
+    """"Internally used by the ordered containers. Returns the leaf and index
+        of the entry for `key`, and whether there is one. If there is none, a
+        slot is claimed for it at that position, but left uninitialized.
+    fn prepare-insert (self key)
+        let cls = (typeof self)
+        # nodes are split on the way down, so that a split never has to
+          propagate back up; a full root is hung under a new one first
+        if (full? self (deref self._root) (deref self._height))
+            let root = (new-inner cls)
+            (inner-at cls root) . children @ 0 = self._root
+            split-child self root 0:usize (deref self._height)
+            self._root = root
+            self._height += 1:usize
+        loop (p level = (deref self._root) (deref self._height))
+            if (level == 0:usize)
+                let node = (leaf-at cls p)
+                let count = (deref node.count)
+                let i = (bound-index node.keys count key false)
+                if ((i < count) and (not (key < (node.keys @ i))))
+                    return p i true
+                loop (j = count)
+                    if (j == i)
+                        break;
+                    move-to (node.keys @ (j - 1:usize)) (node.keys @ j)
+                    static-if (has-values? cls)
+                        move-to (node.values @ (j - 1:usize)) (node.values @ j)
+                    j - 1:usize
+                node.count = count + 1:usize
+                self._count += 1:usize
+                return p i false
+            let node = (inner-at cls p)
+            let i = (bound-index node.keys node.count key true)
+            let level = (level - 1:usize)
+            let i =
+                if (full? self (deref (node.children @ i)) level)
+                    split-child self p i level
+                    # the new key i bounds the right half from below
+                    ? (key < (node.keys @ i)) i (i + 1:usize)
+                else i
+            _ (deref (node.children @ i)) level
+
+    """"Internally used by the ordered containers. Returns whether `key` is
+        greater than all keys in the tree, so that it can be appended to the
+        last leaf.
+    inline appends? (self key)
+        let cls = (typeof self)
+        let node = (leaf-at cls (deref self._last))
+        let count = (deref node.count)
+        if (count == 0:usize)
+            # an empty last leaf is only known to bound no keys if it is
+              the root
+            self._height == 0:usize
+        else
+            (node.keys @ (count - 1:usize)) < key
+
+    """"Internally used by the ordered containers. Claims a slot for `key` at
+        the end of the last leaf, for which `appends?` must hold, and returns
+        its leaf and index; the slot is left uninitialized. A full leaf is
+        followed by a new one, which is hung under the rightmost inner node
+        that has room, so that appending keeps all nodes but the rightmost
+        ones full.
+    fn append-last (self key)
+        let cls = (typeof self)
+        let last = (deref self._last)
+        let node = (leaf-at cls last)
+        let count = (deref node.count)
+        self._count += 1:usize
+        if (count < NodeCapacity)
+            node.count = count + 1:usize
+            return last count
+        let leaf = (new-leaf cls)
+        (leaf-at cls leaf) . count = 1:usize
+        node.next = leaf
+        self._last = leaf
+        # the rightmost inner nodes from the root down
+        local path : (array NodePointer 64)
+        let height = (deref self._height)
+        loop (d p = 0:usize (deref self._root))
+            if (d == height)
+                break;
+            path @ d = p
+            let inner = (inner-at cls p)
+            _ (d + 1:usize) (deref (inner.children @ inner.count))
+        # every new node starts with key, which separates it at each level
+        loop (d child = height leaf)
+            if (d == 0:usize)
+                let root = (new-inner cls)
+                let inner = (inner-at cls root)
+                inner.children @ 0 = self._root
+                inner.children @ 1 = child
+                assign (copy key) (inner.keys @ 0)
+                inner.count = 1:usize
+                self._root = root
+                self._height += 1:usize
+                break;
+            let d = (d - 1:usize)
+            let inner = (inner-at cls (deref (path @ d)))
+            let count = (deref inner.count)
+            if (count < NodeCapacity)
+                assign (copy key) (inner.keys @ count)
+                inner.children @ (count + 1:usize) = child
+                inner.count = count + 1:usize
+                break;
+            let p = (new-inner cls)
+            (inner-at cls p) . children @ 0 = child
+            _ d p
+        _ leaf 0:usize
+
+    fn drop-node (self p level)
+        returning void
+        let cls = (typeof self)
+        if (level == 0:usize)
+            let node = (leaf-at cls p)
+            for i in (range (deref node.count))
+                __drop (node.keys @ i)
+                static-if (has-values? cls)
+                    __drop (node.values @ i)
+        else
+            let node = (inner-at cls p)
+            let count = (deref node.count)
+            for i in (range count)
+                __drop (node.keys @ i)
+            for i in (range (count + 1:usize))
+                this-function self (deref (node.children @ i)) (level - 1:usize)
+        cls.Allocator.free p
+        ;
+
+    fn clear (self)
+        """"Removes all entries, and frees all nodes but an empty root.
+        let cls = (typeof self)
+        drop-node self (deref self._root) (deref self._height)
+        let root = (new-leaf cls)
+        self._root = root
+        self._first = root
+        self._last = root
+        self._height = 0:usize
+        self._count = 0:usize
+        return;
+
+    fn in? (self key)
+        let p i found? = (find-entry self key)
+        found?
+
+    @@ memo
+    inline __rin (elemT cls)
+        let KeyType = cls.KeyType
+        static-if (imply? elemT KeyType)
+            inline (key self)
+                in? self (imply key KeyType)
+
+    fn discard (self key)
+        """"Erases the entry for key; if there is none, nothing happens.
+        let cls = (typeof self)
+        let p i found? = (find-entry self key)
+        if found?
+            let node = (leaf-at cls p)
+            let count = (deref node.count)
+            __drop (node.keys @ i)
+            static-if (has-values? cls)
+                __drop (node.values @ i)
+            for j in (range (i + 1:usize) count)
+                move-to (node.keys @ j) (node.keys @ (j - 1:usize))
+                static-if (has-values? cls)
+                    move-to (node.values @ j) (node.values @ (j - 1:usize))
+            node.count = count - 1:usize
+            self._count -= 1:usize
+        return;
+
+    # a generator of the entries from the position that start returns on,
+      for as long as their key passes the test before?
+    inline entries-from (self start before?)
+        let cls = (typeof self)
+        Generator
+            inline () (start)
+            inline (p i)
+                if (null-node? p) false
+                else (before? ((leaf-at cls p) . keys @ i))
+            inline (p i)
+                'entry-at self (leaf-at cls p) i
+            inline (p i)
+                skip-empty cls p (i + 1:usize)
+
+    inline always (key) true
+
+    """"Returns a generator of the entries in order, from the first one whose
+        key is not less than `key` on.
+    inline lower-bound (self key)
+        entries-from self (inline () (bound-position self key false)) always
+
+    """"Returns a generator of the entries in order, from the first one whose
+        key is greater than `key` on.
+    inline upper-bound (self key)
+        entries-from self (inline () (bound-position self key true)) always
+
+    inline __as (cls T)
+        static-if (T == Generator)
+            inline (self)
+                entries-from self
+                    inline () (skip-empty cls (deref self._first) 0:usize)
+                    always
+        else
+            ;
+
+    inline __tobool (self)
+        self._count != 0:usize
+
+    inline __countof (self)
+        deref self._count
+
+    fn __drop (self)
+        returning void
+        drop-node self (deref self._root) (deref self._height)
+        _;
+
+    # defined last, so that the methods above still see the global range
+    """"Returns a generator of the entries in order whose keys are not less
+        than `lo` and less than `hi`.
+    inline range (self lo hi)
+        entries-from self (inline () (bound-position self lo false))
+            inline (key) (key < hi)
+
+    unlet has-values? leaf-at inner-at new-leaf new-inner find-leaf skip-empty
+        \ bound-position full? open-child split-child drop-node entries-from
+        \ always
+
+typedef OrderedMap < OrderedTable
+    inline entry-at (self node i)
+        _ (deref (node.keys @ i)) (deref (node.values @ i))
+
+    # stores a new entry for key, which must be greater than all keys
+    inline append-entry (self key value)
+        let cls = (typeof self)
+        local key : cls.KeyType = key
+        let p i = ('append-last self key)
+        let keyref valueref = ('entry-refs self p i)
+        assign key keyref
+        local value : cls.ValueType = value
+        assign value valueref
+
+    fn set (self key value)
+        """"Inserts a new key -> value association into the map. If the key
+            already exists, its value is updated.
+        let cls = (typeof self)
+        local key : cls.KeyType = key
+        let p i found? = ('prepare-insert self key)
+        let keyref valueref = ('entry-refs self p i)
+        if found?
+            valueref = value
+        else
+            assign key keyref
+            local value : cls.ValueType = value
+            assign value valueref
+        return;
+
+    fn load-sorted (self items)
+        """"Inserts the key -> value pairs of the generator `items`. Pairs
+            whose keys are greater than all keys in the map are appended to
+            its last leaf, so that loading input sorted by key takes linear
+            time and fills every node; other pairs are inserted as by `set`.
+        for key value in items
+            if ('appends? self key)
+                append-entry self key value
+            else
+                'set self key value
+        return;
+
+    fn getdefault (self key value)
+        """"Returns the value associated with key, or value if there is none.
+        let p i found? = ('find-entry self key)
+        if (not found?)
+            return (view value)
+        let keyref valueref = ('entry-refs self p i)
+        deref valueref
+
+    fn get (self key)
+        """"Returns the value associated with key or raises an error.
+        let p i found? = ('find-entry self key)
+        if (not found?)
+            raise (MapError.KeyNotFound)
+        let keyref valueref = ('entry-refs self p i)
+        valueref
+
+    fn __copy (self)
+        local other : (typeof self)
+        for k v in self
+            append-entry other (copy k) (copy v)
+        other
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            inline gen (key-type value-type allocator)
+                OrderedTable.gen-type this-type
+                    .. "<OrderedMap " (tostring key-type) "=" (tostring value-type)
+                    \ key-type value-type
+                    Allocator.resolve allocator
+            gen opts...
+        else
+            OrderedTable.init cls
+
+    unlet append-entry
+
+typedef OrderedSet < OrderedTable
+    inline entry-at (self node i)
+        deref (node.keys @ i)
+
+    # stores key, which must be greater than all keys
+    inline append-key (self key)
+        let cls = (typeof self)
+        local key : cls.KeyType = key
+        let p i = ('append-last self key)
+        let keyref = ('entry-refs self p i)
+        assign key keyref
+
+    fn insert (self key)
+        """"Inserts a new key into the set.
+        let cls = (typeof self)
+        local key : cls.KeyType = key
+        let p i found? = ('prepare-insert self key)
+        if (not found?)
+            let keyref = ('entry-refs self p i)
+            assign key keyref
+        return;
+
+    fn load-sorted (self items)
+        """"Inserts the keys of the generator `items`. Keys that are greater
+            than all keys in the set are appended to its last leaf, so that
+            loading sorted input takes linear time and fills every node;
+            other keys are inserted as by `insert`.
+        for key in items
+            if ('appends? self key)
+                append-key self key
+            else
+                'insert self key
+        return;
+
+    fn __copy (self)
+        local other : (typeof self)
+        for k in self
+            append-key other (copy k)
+        other
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            inline gen (key-type allocator)
+                OrderedTable.gen-type this-type
+                    .. "<OrderedSet " (tostring key-type)
+                    \ key-type NoValue
+                    Allocator.resolve allocator
+            gen opts...
+        else
+            OrderedTable.init cls
+
+    unlet append-key
+
+do
+    let OrderedMap OrderedSet
+    locals;
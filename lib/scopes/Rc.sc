@@ -8,7 +8,17 @@
 
     A reference counted value that is dropped when all users are dropped. This
     module provides a strong reference type `Rc`, as well as a weak reference
-    type `Weak`.
+    type `Weak`. Values are allocated from the heap, unless an allocator type
+    is passed as `(Rc T allocator)`, or `T` declares one as its
+    `__allocator`.
+
+    `Rc` counts references without synchronization and must not be shared
+    across threads; `Arc` is the same type with atomic reference counts.
+    Either one can be created without support for weak references, as
+    `(Rc T (weak? = false))`, which saves the weak count in the header of the
+    value, as well as the work of maintaining it.
+
+using import Allocator
 
 define DEBUG_DOUBLE_FREES false
 
@@ -17,25 +27,63 @@ let
     WEAKRC_INDEX = 1
 
 let RefType = i32
-let MetaDataType =
-    tuple RefType RefType
-
-let HEADERSIZE = 16:usize
 
 typedef ReferenceCounted
     let RefType = RefType
-    let MetaDataType = MetaDataType
 
 inline _mdptr (self)
-    inttoptr (sub (ptrtoint (view self) usize) (sizeof MetaDataType)) (mutable @MetaDataType)
+    let MDT = ((typeof self) . MetaDataType)
+    inttoptr (sub (ptrtoint (view self) usize) (sizeof MDT)) (mutable @MDT)
 inline _baseptr (self)
-    let T = (elementof (typeof self))
     let ptr =
-        inttoptr (sub (ptrtoint (view self) usize) HEADERSIZE) (mutable @u8)
+        inttoptr (sub (ptrtoint (view self) usize) ((typeof self) . HeaderSize))
+            \ (mutable @u8)
     ptr
+inline _refcount (self index)
+    getelementptr (_mdptr self) 0 index
+
+# increments the count at ptr
+inline _inc (cls ptr)
+    static-if cls.AtomicCount
+        atomicrmw add ptr 1
+        ;
+    else
+        store (add (load ptr) 1) ptr
+
+# decrements the count at ptr and returns the new count
+inline _dec (cls ptr)
+    let rc =
+        static-if cls.AtomicCount
+            sub (atomicrmw sub ptr 1) 1
+        else
+            let rc = (sub (load ptr) 1)
+            store rc ptr
+            rc
+    assert (rc >= 0) "corrupt refcount encountered"
+    rc
+
+# increments the count at ptr unless it is zero, and returns whether it did
+inline _inc-nonzero (cls ptr)
+    static-if cls.AtomicCount
+        loop (rc = (load ptr))
+            assert (rc >= 0) "corrupt refcount encountered"
+            if (rc == 0)
+                break false
+            let old success = (cmpxchg ptr rc (add rc 1))
+            if success
+                break true
+            old
+    else
+        let rc = (load ptr)
+        assert (rc >= 0) "corrupt refcount encountered"
+        if (rc == 0) false
+        else
+            store (add rc 1) ptr
+            true
 
 typedef Weak < ReferenceCounted
 typedef Rc < ReferenceCounted
+typedef Arc < Rc
 
 let use-rc free-rc =
     static-if DEBUG_DOUBLE_FREES
@@ -52,61 +100,99 @@ let use-rc free-rc =
             else
                 assert false "Rc: double free detected"
                 unreachable;
-            free ptr
+            let cls = (typeof self)
+            cls.Allocator.free ptr
 
         _ use-rc free-rc
     else
-        _ (inline ()) (inline ())
+        inline free-rc (self)
+            let cls = (typeof self)
+            cls.Allocator.free (_baseptr self)
+
+        _ (inline ()) free-rc
 
 @@ memo
-inline gen-type (T)
+inline gen-type (T allocator atomic? weak?)
     let storage-type =
         mutable pointer T
+    let MDT =
+        static-if weak? (tuple RefType RefType)
+        else (tuple RefType)
+    # the metadata directly precedes the value, and the header is padded in
+      front so the value stays aligned
+    let align = (max (alignof T) (alignof MDT))
+    let header-size = ((((sizeof MDT) + align) - 1:usize) // align * align)
+    let padding = (header-size - (sizeof MDT))
+    # allocated as a whole so allocators can align the header and value
+    let StorageType =
+        static-if (padding == 0:usize) (tuple MDT T)
+        else (tuple (array u8 padding) MDT T)
+    let name-suffix =
+        .. (Allocator.type-name-suffix allocator)
+            ? weak? "" " strong-only"
     let WeakType =
-        typedef (.. "<Weak " (tostring T) ">") < Weak
-            \ :: storage-type
+        static-if weak?
+            typedef (.. "<Weak " (tostring T) name-suffix ">") < Weak
+                \ :: storage-type
+        else Nothing
     let RcType =
-        typedef (.. "<Rc " (tostring T) ">") < Rc
-            \ :: storage-type
-
-    typedef+ WeakType
-        let Type = T
-        let RcType = RcType
-
-        inline... __typecall
-        case (cls, value : RcType)
-            let md = (_mdptr value)
-            let refcount =
-                getelementptr md 0 WEAKRC_INDEX
-            let rc = (add (load refcount) 1)
-            store rc refcount
-            bitcast (dupe (view value)) this-type
-        case (cls)
-            # null-weak that will never upgrade
-            inttoptr 0:usize this-type
+        typedef
+            .. (? atomic? "<Arc " "<Rc ") (tostring T) name-suffix ">"
+            \ < (? atomic? Arc Rc) :: storage-type
+
+    static-if weak?
+        typedef+ WeakType
+            let Type = T
+            let RcType = RcType
+            let Allocator = allocator
+            let AtomicCount = atomic?
+            let WeakCount = weak?
+            let MetaDataType = MDT
+            let HeaderSize = header-size
+
+            inline... __typecall
+            case (cls, value : RcType)
+                _inc this-type (_refcount value WEAKRC_INDEX)
+                bitcast (dupe (view value)) this-type
+            case (cls)
+                # null-weak that will never upgrade
+                inttoptr 0:usize this-type
 
     typedef+ RcType
         let Type = T
         let WeakType = WeakType
+        let Allocator = allocator
+        let AtomicCount = atomic?
+        let WeakCount = weak?
+        let MetaDataType = MDT
+        let HeaderSize = header-size
+        # the type that values are allocated as, header included
+        let StorageType = StorageType
+        let NonNull = true
 
         fn wrap (value)
-            let self = (nullof storage-type)
-            let MDT = super-type.MetaDataType
-            let mdsize = (sizeof MDT)
-            let fullsize = (HEADERSIZE + (sizeof T))
-            let ptr = (malloc-array u8 fullsize)
-            use-rc ptr
-            let self = (inttoptr (add (ptrtoint ptr usize) HEADERSIZE) storage-type)
+            let ptr = (allocator.alloc-array StorageType 1)
+            use-rc (bitcast ptr (mutable @u8))
+            let self = (inttoptr (add (ptrtoint ptr usize) header-size) storage-type)
             store value self
-            let mdptr = (_mdptr self)
+            let mdptr =
+                inttoptr (sub (ptrtoint self usize) (sizeof MDT)) (mutable @MDT)
             store 1 (getelementptr mdptr 0 STRONGRC_INDEX)
-            store 0 (getelementptr mdptr 0 WEAKRC_INDEX)
+            static-if weak?
+                # all strong references share a single weak reference, which
+                  keeps the memory alive until the value has been dropped
+                store 1 (getelementptr mdptr 0 WEAKRC_INDEX)
             bitcast self this-type
 
         inline __typecall (cls args...)
             wrap (T args...)
     RcType
 
+inline resolve-type (atomic? T allocator weak?)
+    gen-type T (Allocator.resolve allocator T) atomic?
+        static-if (none? weak?) true
+        else weak?
+
 typedef UpgradeError : (tuple)
     inline __typecall (cls)
         bitcast none this-type
@@ -123,27 +209,29 @@ typedef+ ReferenceCounted
         viewing value
         if (not (ptrtoint value usize))
             return 1
-        let md = (_mdptr value)
-        dupe (load (getelementptr md 0 WEAKRC_INDEX))
+        let cls = (typeof value)
+        static-if cls.WeakCount
+            let md = (_mdptr value)
+            let rc = (load (getelementptr md 0 WEAKRC_INDEX))
+            # leave out the weak reference held by the strong references
+            if ((load (getelementptr md 0 STRONGRC_INDEX)) > 0) (rc - 1)
+            else rc
+        else 0
 
 typedef+ Weak
     inline... __typecall
     case (cls, T : type)
-        (gen-type T) . WeakType
+        (resolve-type false T) . WeakType
+    case (cls, T : type, allocator : type)
+        (resolve-type false T allocator) . WeakType
 
     fn _drop (self)
         if (not (ptrtoint (view self) usize))
             return;
-        let md = (_mdptr self)
-        let refcount = (getelementptr md 0 WEAKRC_INDEX)
-        let rc = (sub (load refcount) 1)
-        assert (rc >= 0) "corrupt refcount encountered"
-        store rc refcount
-        if (rc == 0)
-            let strongrefcount = (getelementptr md 0 STRONGRC_INDEX)
-            if ((load strongrefcount) == 0)
-                free-rc self
-            # otherwise last strong reference will clean this up
+        let cls = (typeof self)
+        if ((_dec cls (_refcount self WEAKRC_INDEX)) == 0)
+            # the strong references have all been dropped
+            free-rc self
 
     inline __rimply (T cls)
         static-if (T == Nothing)
@@ -161,62 +249,40 @@ typedef+ Weak
     fn... __copy (self : Weak,)
         viewing self
         if (ptrtoint self usize)
-            let md = (_mdptr self)
-            let refcount =
-                getelementptr md 0 WEAKRC_INDEX
-            let rc = (add (load refcount) 1)
-            store rc refcount
+            _inc (typeof self) (_refcount self WEAKRC_INDEX)
         deref (dupe self)
 
     fn upgrade (self)
         viewing self
         if (not (ptrtoint self usize))
             raise (UpgradeError)
-        let md = (_mdptr self)
-        let refcount = (getelementptr md 0 STRONGRC_INDEX)
-        let rc = (load refcount)
-        assert (rc >= 0) "corrupt refcount encountered"
-        if (rc == 0)
+        let cls = (typeof self)
+        if (not (_inc-nonzero cls (_refcount self STRONGRC_INDEX)))
             raise (UpgradeError)
-        let RcType = ((typeof self) . RcType)
-        let rc = (add rc 1)
-        store rc refcount
-        deref (bitcast (dupe self) RcType)
+        deref (bitcast (dupe self) cls.RcType)
 
     fn force-upgrade (self)
         viewing self
         assert (ptrtoint self usize) "upgrading Weak failed"
-        let md = (_mdptr self)
-        let refcount = (getelementptr md 0 STRONGRC_INDEX)
-        let rc = (load refcount)
-        assert (rc >= 0) "corrupt refcount encountered"
-        assert (rc > 0) "upgrading Weak failed"
-        let RcType = ((typeof self) . RcType)
-        let rc = (add rc 1)
-        store rc refcount
-        deref (bitcast (dupe self) RcType)
+        let cls = (typeof self)
+        let ok = (_inc-nonzero cls (_refcount self STRONGRC_INDEX))
+        assert ok "upgrading Weak failed"
+        deref (bitcast (dupe self) cls.RcType)
 
 typedef+ Rc
-    inline... __typecall
-    case (cls, T : type)
-        gen-type T
+    inline __typecall (cls T allocator weak?)
+        resolve-type false T allocator weak?
 
     inline new (T args...)
-        (gen-type T) args...
+        (resolve-type false T) args...
 
     fn... __copy (value : Rc,)
         viewing value
-        let md = (_mdptr value)
-        let refcount =
-            getelementptr md 0 STRONGRC_INDEX
-        let rc = (load refcount)
-        assert (rc >= 0) "corrupt refcount encountered"
-        let rc = (add rc 1)
-        store rc refcount
+        _inc (typeof value) (_refcount value STRONGRC_INDEX)
         deref (dupe value)
 
     inline wrap (value)
-        ((gen-type (typeof value)) . wrap) value
+        ((resolve-type false (typeof value)) . wrap) value
 
     let _view = view
     inline... view (self : Rc,)
@@ -272,7 +338,8 @@ typedef+ Rc
             otherT as:= type
             static-if (not const?)
                 let WeakT = ('@ selfT 'WeakType)
-                if ((otherT == Weak) or (otherT == (WeakT as type)))
+                if (((WeakT as type) != Nothing)
+                    and ((otherT == Weak) or (otherT == (WeakT as type))))
                     return WeakT
             let selfT = (('@ selfT 'Type) as type)
             let conv = (f selfT otherT const?)
@@ -287,28 +354,34 @@ typedef+ Rc
     fn _drop (self)
         viewing self
         returning void
-        let md = (_mdptr self)
-        let refcount = (getelementptr md 0 STRONGRC_INDEX)
-        let rc = (sub (load refcount) 1)
-        assert (rc >= 0) "corrupt refcount encountered"
-        if (rc == 0)
-            let payload = (view self)
-            __drop payload
-            # update refcount after drop so weak pointers don't attempt to
-                delete this pointer prematurely
-            store 0 refcount
-            let weakrefcount = (getelementptr md 0 WEAKRC_INDEX)
-            if ((load weakrefcount) == 0)
+        let cls = (typeof self)
+        if ((_dec cls (_refcount self STRONGRC_INDEX)) == 0)
+            static-if (not (plain? cls.Type))
+                let payload = (view self)
+                __drop payload
+            static-if cls.WeakCount
+                # release the weak reference shared by the strong references;
+                  the last weak reference frees the memory otherwise
+                if ((_dec cls (_refcount self WEAKRC_INDEX)) == 0)
+                    free-rc self
+            else
                 free-rc self
-            # otherwise the last weak reference will free this value
-        else
-            store rc refcount
 
     inline __drop (self)
         _drop (deref self)
 
     unlet _view _drop
 
+typedef+ Arc
+    inline __typecall (cls T allocator weak?)
+        resolve-type true T allocator weak?
+
+    inline new (T args...)
+        (resolve-type true T) args...
+
+    inline wrap (value)
+        ((resolve-type true (typeof value)) . wrap) value
+
 do
-    let Rc Weak UpgradeError
+    let Rc Arc Weak UpgradeError
     locals;
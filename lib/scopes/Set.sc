@@ -6,7 +6,9 @@
 """"Set
     ===
 
-    This module implements mathematical sets using hashtables.
+    This module implements mathematical sets using hashtables. The set
+    obtains its memory from the heap, unless an allocator type is passed as
+    `(Set key-type (allocator = ...))`.
 
 # generic Hashmap implementing Robin Hood Hashing, see
      http://sebastiansylvan.com/2013/05/08/robin-hood-hashing-should-be-your-default-hash-table-implementation/
@@ -14,6 +16,7 @@
 using import enum
 using import struct
 using import Map
+using import Allocator
 
 # declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
                                         i64 <len>, i1 <isvolatile>)
@@ -48,17 +51,32 @@ typedef Set < Struct
     let MinCapacity = 16:u64
     let MinMask = (MinCapacity - 1:u64)
     let BitfieldType = u64
+    # the number of keys that lookup-many hashes and prefetches at once
+    let LookupBatchSize = 16:usize
 
     @@ memo
-    inline gen-type (key-type hash-function)
+    inline gen-type (key-type hash-function allocator)
         let parent-type = this-type
         let hash-function =
             static-if (none? hash-function) hash
             else hash-function
-        struct (.. "<Set " (tostring key-type) ">") < parent-type
+        struct
+            .. "<Set " (tostring key-type)
+                Allocator.type-name-suffix allocator
+                ">"
+            \ < parent-type
             let KeyType = key-type
             let HashFunction = hash-function
 
+            inline from-generator (items count-hint)
+                """"Returns a new set holding the keys produced by `items`. If
+                    the number of keys is known, passing it as `count-hint`
+                    sizes the set once up front.
+                local self = (this-type)
+                'insert-many self items count-hint
+                self
+            let Allocator = allocator
+
             _valid : (mutable pointer BitfieldType)
             _keys : (mutable pointer KeyType)
             _count : u64
@@ -188,15 +206,15 @@ typedef Set < Struct
                     ;
                 newmask
 
-    fn reserve (self new-capacity)
+    fn reserve-capacity (self new-capacity)
         let cls = (typeof self)
         let capacity = (deref self._capacity)
         let old-valid = (deref self._valid)
         let old-keys = (deref self._keys)
         let validsize = ((capacity + 63:u64) // 64:u64)
         let new-validsize = ((new-capacity + 63:u64) // 64:u64)
-        let new-valid = (malloc-array BitfieldType new-validsize)
-        let new-keys = (malloc-array cls.KeyType new-capacity)
+        let new-valid = (cls.Allocator.alloc-array BitfieldType new-validsize)
+        let new-keys = (cls.Allocator.alloc-array cls.KeyType new-capacity)
         llvm.memcpy.p0i8.p0i8.i64
             bitcast (view new-valid) (mutable rawstring)
             bitcast (view old-valid) rawstring
@@ -209,8 +227,8 @@ typedef Set < Struct
             false
         for i in (range validsize new-validsize)
             new-valid @ i = 0:u64
-        free old-valid
-        free old-keys
+        cls.Allocator.free old-valid
+        cls.Allocator.free old-keys
         assign new-valid self._valid
         assign new-keys self._keys
         self._capacity = new-capacity
@@ -222,13 +240,35 @@ typedef Set < Struct
         if (l >= 0.9)
             if (self._mask >= maxmask)
                 # we must expand capacity
-                reserve self (self._capacity << 1:u64)
+                reserve-capacity self (self._capacity << 1:u64)
             # expand
             rehash self ((self._mask << 1:u64) + 1:u64)
         elseif ((l <= 0.225) and (self._mask > MinCapacity))
             # compact
             rehash self (self._mask >> 1:u64)
 
+    # like auto-rehash, but never compacts, so that space set aside by reserve
+      is kept while it is being filled
+    fn auto-expand (self)
+        if ((terseness self) >= 0.9)
+            auto-rehash self
+
+    fn reserve (self count)
+        """"Makes room for `count` entries in total, so that inserting up to
+            that many entries does not rehash the table.
+        let count = (count as u64)
+        let newmask =
+            loop (capacity = MinCapacity)
+                # stay below the load at which auto-rehash expands
+                if ((count * 10:u64) < (capacity * 9:u64))
+                    break (capacity - 1:u64)
+                capacity << 1:u64
+        if (newmask > self._mask)
+            if (newmask >= self._capacity)
+                reserve-capacity self (newmask + 1:u64)
+            rehash self newmask
+        return;
+
     fn clear (self)
         for i in (range 0:u64 (self._mask + 1:u64))
             if (valid-slot? self i)
@@ -238,18 +278,69 @@ typedef Set < Struct
         self._mask = MinMask
         return;
 
-    fn insert (self key)
-        """"Inserts a new key into set.
+    inline insert-key (self key rehashf)
         let hash = ((typeof self) . HashFunction)
         let keyhash = ((hash key) as u64)
         lookup self key keyhash
             inline "ok" (idx)
                 deref (self._keys @ idx)
             inline "fail" ()
-                auto-rehash self
+                rehashf self
                 let index = (insert_entry self key keyhash)
                 deref (self._keys @ index)
 
+    fn insert (self key)
+        """"Inserts a new key into set.
+        insert-key self key auto-rehash
+
+    fn insert-entry (self key)
+        insert-key self key auto-expand
+
+    inline insert-many (self items count-hint)
+        """"Inserts all keys produced by `items`. If the number of keys is
+            known, passing it as `count-hint` grows the set once instead of
+            repeatedly.
+        static-if (not (none? count-hint))
+            reserve self ((deref self._count) + (count-hint as u64))
+        for key in items
+            insert-entry self key
+            ;
+
+    # returns the slot holding key, or -1:u64
+    fn find-index (self key keyhash)
+        lookup self key keyhash
+            inline "ok" (idx) idx
+            inline "fail" () -1:u64
+
+    inline lookup-many (self keys successf failf)
+        """"Looks up every key in the array-like `keys`, and calls `successf i`
+            for each `keys @ i` that is in the set, or `failf i` for each one
+            that isn't. Keys are hashed in batches, and the slots of a batch
+            are prefetched before any of them is probed.
+        let hash = ((typeof self) . HashFunction)
+        let count = ((countof keys) as usize)
+        local hashes : (array u64 LookupBatchSize)
+        loop (start = 0:usize)
+            if (start >= count)
+                break;
+            let n = (min (count - start) LookupBatchSize)
+            let mask = (deref self._mask)
+            for i in (range n)
+                let keyhash = ((hash (keys @ (start + i))) as u64)
+                hashes @ i = keyhash
+                let pos = (keypos keyhash mask)
+                prefetch (getelementptr (deref self._valid) (pos // 64:u64))
+                prefetch (getelementptr (deref self._keys) pos)
+            for i in (range n)
+                let idx = (find-index self (keys @ (start + i)) (deref (hashes @ i)))
+                if (idx == -1:u64)
+                    failf (start + i)
+                    ;
+                else
+                    successf (start + i)
+                    ;
+            start + n
+
     fn dump (self)
         for i in (range 0:u64 (self._mask + 1:u64))
             if (valid-slot? self i)
@@ -343,31 +434,35 @@ typedef Set < Struct
 
     let __drop =
         fn "__drop" (self)
+            let cls = (typeof self)
             for i in (range 0:u64 (self._mask + 1:u64))
                 if (valid-slot? self i)
                     __drop (self._keys @ i)
-            free self._valid
-            free self._keys
+            cls.Allocator.free self._valid
+            cls.Allocator.free self._keys
 
     inline __typecall (cls opts...)
         static-if (cls == this-type)
-            let key-type function-type = opts...
-            gen-type key-type function-type
+            # the allocator is usually passed by keyword
+            inline gen (key-type hash-function allocator)
+                gen-type key-type hash-function (Allocator.resolve allocator)
+            gen opts...
         else
             let numsets = ((MinCapacity + 63:u64) // 64:u64)
-            let validset = (malloc-array BitfieldType numsets)
+            let validset = (cls.Allocator.alloc-array BitfieldType numsets)
             for i in (range 0:u64 numsets)
                 validset @ i = 0:u64
             let self =
                 Struct.__typecall cls
                     _valid = validset
-                    _keys = (malloc-array cls.KeyType MinCapacity)
+                    _keys = (cls.Allocator.alloc-array cls.KeyType MinCapacity)
                     _count = 0:usize
                     _mask = MinMask
                     _capacity = MinCapacity
             self
 
-    unlet unset-slot rehash auto-rehash lookup insert_entry reserve
+    unlet unset-slot rehash auto-rehash auto-expand lookup insert_entry
+        \ reserve-capacity find-index insert-key insert-entry
         \ erase_pos set-generator valid-slot? gen-type set-slot
 
 do
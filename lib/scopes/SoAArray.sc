@@ -0,0 +1,306 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""SoAArray
+    ========
+
+    Provides a growing array of structs that stores each field in an array
+    of its own, rather than storing whole structs next to each other. Loops
+    that only touch some of the fields then only load those, and loops over a
+    single field run over contiguous memory and vectorize:
+
+        :::scopes
+        struct Particle plain
+            position : vec3
+            velocity : vec3
+            age : f32
+
+        local particles : (SoAArray Particle)
+        'append particles (Particle (age = 1.0))
+        (particles @ 0) . age += 1.0
+
+        let ages = ('span particles 'age)
+        for i in (range (countof particles))
+            ages @ i += 1.0
+
+    All fields must have plain types.
+
+using import struct
+using import Allocator
+
+# declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
+                                        i64 <len>, i1 <isvolatile>)
+let llvm.memcpy.p0i8.p0i8.i64 =
+    extern 'llvm.memcpy.p0i8.p0i8.i64
+        function void (mutable rawstring) rawstring i64 bool
+
+inline copy-elements (dest src count)
+    let ET = (elementof (typeof dest))
+    llvm.memcpy.p0i8.p0i8.i64
+        bitcast dest (mutable rawstring)
+        bitcast src rawstring
+        ((count as usize) * (sizeof ET)) as i64
+        false
+
+# a tuple that holds a pointer to the elements of each field of struct type T,
+  keyed by the field names
+spice field-pointers-type (T)
+    let T = (T as type)
+    let count = ('element-count T)
+    let types = (alloca-array type count)
+    for i in (range count)
+        let name FT = ('keyof ('element@ T i))
+        if (not ('plain? FT))
+            error
+                .. "field " (repr name) " of type " (repr FT)
+                    \ " is not plain and can't be stored in an SoAArray"
+        types @ i = (sc_key_type name ('mutable (pointer.type FT)))
+    `[(sc_tuple_type count types)]
+
+spice field-count (T)
+    `[('element-count (T as type))]
+
+let DEFAULT_CAPACITY = (1:usize << 2:usize)
+
+fn nearest-capacity (capacity count)
+    loop (new-capacity = capacity)
+        if (new-capacity < count)
+            repeat (new-capacity * 27:usize // 10:usize)
+        break new-capacity
+
+typedef SoAArray < Struct
+
+""""The supertype and constructor for arrays of structs that store their
+    fields in separate arrays. New instances start out empty, and grow by a
+    factor of 2.7 each time their capacity is exceeded.
+
+    To construct a new SoA array type:
+
+        :::scopes
+        SoAArray element-type
+
+    An allocator type may be passed as second argument.
+
+    Indexing an array returns a view of the element, whose fields can be read
+    and assigned like those of the struct itself.
+typedef+ SoAArray
+    @@ memo
+    inline gen-soa-array-type (element-type allocator)
+        static-assert ((typeof element-type) == type)
+        let parent-type = this-type
+        let PT = (field-pointers-type element-type)
+        let count = (field-count element-type)
+        let VT =
+            typedef (.. "<SoAElement " (tostring element-type) ">") : PT
+                let ElementType = element-type
+                let FieldCount = count
+
+                inline __getattr (self name)
+                    (extractvalue (storagecast self) name) @ 0
+
+                inline __imply (cls T)
+                    static-if (T == cls.ElementType)
+                        inline (self)
+                            let ptrs = (storagecast self)
+                            T
+                                va-map
+                                    inline (i) (deref ((extractvalue ptrs i) @ 0))
+                                    va-range cls.FieldCount
+
+        struct
+            .. "<SoAArray "
+                tostring element-type
+                Allocator.type-name-suffix allocator
+                ">"
+            \ < parent-type
+            _fields : PT
+            _count : usize
+            _capacity : usize
+
+            let
+                ElementType = element-type
+                ElementView = VT
+                FieldPointers = PT
+                FieldCount = count
+                Allocator = allocator
+
+    inline __typecall (cls element-type allocator)
+        static-if (cls == this-type)
+            gen-soa-array-type element-type (Allocator.resolve allocator)
+        else
+            Struct.__typecall cls
+                _fields = (nullof cls.FieldPointers)
+
+    # calls f with the index of every field; unrolled at compile time
+    inline each-field (cls f)
+        va-map f (va-range cls.FieldCount)
+
+    """"Implements support for the `countof` operator. Returns the current
+        number of elements stored in `self` as a value of `usize` type.
+    inline __countof (self)
+        deref self._count
+
+    """"Returns the current maximum capacity of array `self`.
+    inline capacity (self)
+        deref self._capacity
+
+    """"Implements support for the `@` operator. Returns a view of the element
+        at `index` of array `self`, which remains valid until the array grows.
+    inline __@ (self index)
+        static-if bounds-checks?
+            assert (likely ((index as usize) < self._count)) "index out of bounds"
+        unchecked@ self index
+
+    """"Implements support for the `unchecked@` operator. Returns a view of
+        the element at `index` of array `self` without checking that `index`
+        is in bounds.
+    inline __unchecked@ (self index)
+        let cls = (typeof self)
+        let index = (index as usize)
+        let ptrs = (deref self._fields)
+        bitcast
+            cls.FieldPointers
+                each-field cls
+                    inline (i)
+                        getelementptr (extractvalue ptrs i) index
+            cls.ElementView
+
+    """"Returns a pointer to the contiguous elements of the field `name`,
+        which remains valid until the array grows. Loops over a single field
+        should go through this pointer.
+    inline span (self name)
+        extractvalue (deref self._fields) name
+
+    """"Implements support for the `as` operator. Arrays can be cast to
+        `Generator`, or directly passed to `for`, which yields a view of each
+        element.
+    inline __as (cls T)
+        static-if (T == Generator)
+            inline (self)
+                Generator
+                    inline () 0:usize
+                    inline (i) (i < self._count)
+                    inline (i) (unchecked@ self i)
+                    inline (i) (i + 1:usize)
+
+    """"Ensures that array `self` can hold at least `count` elements.
+    fn reserve (self count)
+        if (count <= self._capacity)
+            return;
+        let cls = (typeof self)
+        let new-capacity =
+            nearest-capacity (max (deref self._capacity) DEFAULT_CAPACITY) count
+        let size = (deref self._count)
+        let ptrs = (deref self._fields)
+        self._fields =
+            cls.FieldPointers
+                each-field cls
+                    inline (i)
+                        let old-items = (extractvalue ptrs i)
+                        let new-items =
+                            cls.Allocator.alloc-array
+                                elementof (typeof old-items)
+                                new-capacity
+                        copy-elements new-items old-items size
+                        cls.Allocator.free old-items
+                        new-items
+        self._capacity = new-capacity
+        return;
+
+    """"Append `value`, which must be of the array's element type, by
+        scattering its fields into their arrays.
+    fn append (self value)
+        let cls = (typeof self)
+        let value = (imply value cls.ElementType)
+        let index = (deref self._count)
+        reserve self (index + 1:usize)
+        let ptrs = (deref self._fields)
+        each-field cls
+            inline (i)
+                (extractvalue ptrs i) @ index = (extractvalue value i)
+                ;
+        self._count = index + 1:usize
+        return;
+
+    """"Construct a new element from `args...` and append it to array `self`.
+    inline emplace-append (self args...)
+        append self (((typeof self) . ElementType) args...)
+
+    """"Remove the element with the highest index from array `self` and return
+        it.
+    fn pop (self)
+        let &count = self._count
+        assert (&count > 0) "can't pop from empty array"
+        &count -= 1
+        imply (self @ (deref &count)) ((typeof self) . ElementType)
+
+    """"Move the last element into the slot at `index`, then remove the last
+        element; this removes an element in constant time, but doesn't keep
+        the order of the elements.
+    fn swap-remove (self index)
+        let cls = (typeof self)
+        let index = (index as usize)
+        let &count = self._count
+        assert (index < &count) "index out of bounds"
+        &count -= 1
+        let last = (deref &count)
+        let ptrs = (deref self._fields)
+        each-field cls
+            inline (i)
+                let items = (extractvalue ptrs i)
+                items @ index = (items @ last)
+                ;
+        return;
+
+    """"Resize the array to the specified count. Appended elements are
+        constructed from `args...`.
+    fn resize (self count args...)
+        let count = (count as usize)
+        let size = (deref self._count)
+        if (size < count)
+            reserve self count
+            for i in (range size count)
+                emplace-append self args...
+        else
+            self._count = count
+        return;
+
+    """"Clear the array and reset its element count to zero.
+    fn clear (self)
+        self._count = 0:usize
+        return;
+
+    """"Implements support for freeing the array's memory when it goes out
+        of scope.
+    fn __drop (self)
+        returning void
+        let cls = (typeof self)
+        let ptrs = (deref self._fields)
+        each-field cls
+            inline (i)
+                cls.Allocator.free (extractvalue ptrs i)
+        return;
+
+    """"Implements support for the `copy` operation.
+    fn __copy (self)
+        viewing self
+        returning (uniqueof (typeof self) -1)
+        let cls = (typeof self)
+        let count = (deref self._count)
+        local newarr = (cls)
+        reserve newarr count
+        let old-fields = (deref self._fields)
+        let new-fields = (deref newarr._fields)
+        each-field cls
+            inline (i)
+                copy-elements (extractvalue new-fields i) (extractvalue old-fields i) count
+        newarr._count = count
+        newarr
+
+    unlet gen-soa-array-type each-field
+
+do
+    let SoAArray
+    locals;
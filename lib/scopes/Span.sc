@@ -0,0 +1,246 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""Span
+    ====
+
+    Provides types that view a range of elements stored elsewhere, without
+    owning or copying them. Slicing a span produces another span of the same
+    memory, so that a tokenizer or parser can take substrings apart without
+    allocating:
+
+        :::scopes
+        using import String
+        using import Span
+
+        local s = (String "key=value")
+        let v = ('span s)
+        let key = (lslice v 3)
+        let value = (rslice v 4)
+        test (key == "key")
+
+    `String` and `Array` convert to spans of their elements implicitly, and
+    compare with and hash the same as them, so that a `Map` keyed by strings
+    can be searched by a `StringView` without building a string first.
+
+    A span is a plain pair of pointer and count that is not tracked by the
+    borrow checker; it must not outlive the storage it views, nor be used
+    after that storage has been resized.
+
+using import struct
+
+inline &chararray? (T)
+    and
+        &? T
+        (unqualified T) < array
+        (elementof T) == char
+
+# LLVM knows memcmp, and expands short and constant size compares inline
+let memcmp =
+    extern 'memcmp
+        function i32 rawstring rawstring usize
+
+inline span-generator (self)
+    let items = (deref self._items)
+    let count = (deref self._count)
+    Generator
+        inline () 0:usize
+        inline (i) (i < count)
+        inline (i) (items @ i)
+        inline (i) (i + 1:usize)
+
+fn compare-spans== (self other)
+    let ET = ((typeof self) . ElementType)
+    let count = (deref self._count)
+    if (count != other._count) false
+    else
+        let a b = (deref self._items) (deref other._items)
+        # integer elements are equal exactly when their bytes are
+        static-if (ET < integer)
+            let size = (count * (sizeof ET))
+            return ((memcmp (bitcast a rawstring) (bitcast b rawstring) size) == 0)
+        loop (i = 0:usize)
+            if (i == count)
+                break true
+            if ((a @ i) != (b @ i))
+                break false
+            i + 1:usize
+
+# returns -1, 0 or 1 as self orders before, with or after other
+fn compare-spans (self other)
+    let lcount rcount = (deref self._count) (deref other._count)
+    let a b = (deref self._items) (deref other._items)
+    loop (i = 0:usize)
+        if (i == lcount)
+            break (? (i == rcount) 0 -1)
+        elseif (i == rcount)
+            break 1
+        let x y = (deref (a @ i)) (deref (b @ i))
+        if (x < y)
+            break -1
+        elseif (x > y)
+            break 1
+        i + 1:usize
+
+inline span-binary-op (f)
+    @@ memo
+    inline (cls T)
+        static-if (cls == T) f
+
+typedef Span < Struct
+
+""""The supertype and constructor for views of `count` elements at `items`.
+
+    To construct a new span type:
+
+        :::scopes
+        Span element-type
+
+    To view memory as a span:
+
+        :::scopes
+        (Span element-type) items count
+typedef+ Span
+    @@ memo
+    inline gen-type (element-type)
+        static-assert ((typeof element-type) == type)
+        let parent-type = this-type
+        struct (.. "<Span " (tostring element-type) ">") < parent-type
+            _items : (pointer element-type)
+            _count : usize
+
+            let
+                ElementType = element-type
+                PointerType = (pointer element-type)
+
+    inline... from-arguments
+    case (cls : type,)
+        Struct.__typecall cls
+            _items = (nullof cls.PointerType)
+            _count = 0:usize
+    case (cls : type, items, count)
+        Struct.__typecall cls
+            _items = (imply items cls.PointerType)
+            _count = (count as usize)
+
+    inline __typecall (cls args...)
+        static-if (cls == this-type)
+            gen-type args...
+        else
+            from-arguments cls args...
+
+    """"Implements support for the `countof` operator. Returns the number of
+        elements in the span.
+    inline __countof (self)
+        deref self._count
+
+    """"Returns a pointer to the first element of the span.
+    inline data (self)
+        deref self._items
+
+    """"Implements support for the `@` operator. Returns a reference to the
+        element at `index`.
+    inline __@ (self index)
+        let index = (index as usize)
+        static-if bounds-checks?
+            assert (likely (index < self._count)) "index out of bounds"
+        (deref self._items) @ index
+
+    """"Implements support for the `unchecked@` operator. Returns a reference
+        to the element at `index` without checking that it is in bounds.
+    inline __unchecked@ (self index)
+        (deref self._items) @ (index as usize)
+
+    """"Implements support for the `as` operator. Spans can be cast to
+        `Generator`, or directly passed to `for`; spans of characters can be
+        cast to `string`.
+    inline __as (cls T)
+        static-if (T == Generator) span-generator
+        elseif ((cls.ElementType == char) and (T == string))
+            inline (self)
+                string (deref self._items) (deref self._count)
+
+    """"Implements support for pointer casts, to pass the span to C functions
+        for example.
+    inline __imply (cls T)
+        static-match T
+        case pointer
+            inline (self) (deref self._items)
+        case voidstar
+            inline (self) ((deref self._items) as voidstar)
+        case cls.PointerType
+            inline (self) (deref self._items)
+        default ()
+
+    """"String constants and character arrays convert to spans of characters
+        implicitly.
+    inline __rimply (T cls)
+        static-if (cls.ElementType == char)
+            static-if ((T == string) or (&chararray? T))
+                inline (value)
+                    cls (value as rawstring) (countof value)
+
+    """"Implements support for the `lslice` operator. Returns a span of the
+        first `offset` elements, which views the same memory.
+    inline... __lslice (self, offset : usize)
+        let cls = (typeof self)
+        cls (deref self._items) (min offset (deref self._count))
+
+    """"Implements support for the `rslice` operator. Returns a span of the
+        elements from `offset` on, which views the same memory.
+    inline... __rslice (self, offset : usize)
+        let cls = (typeof self)
+        let offset = (min offset (deref self._count))
+        cls (getelementptr (deref self._items) offset) (self._count - offset)
+
+    """"Hashes the bytes of plain elements, or combines the hashes of other
+        elements, which gives the same hash as an equal `String` or `Array`.
+    fn __hash (self)
+        let ET = ((typeof self) . ElementType)
+        static-if (plain? ET)
+            hash.from-bytes (bitcast (deref self._items) rawstring)
+                (deref self._count) * (sizeof ET)
+        else
+            fold (h = (hash (deref self._count))) for item in self
+                hash h item
+
+    """"Implements support for the `repr` operation.
+    fn __repr (self)
+        let cls = (typeof self)
+        static-if (cls.ElementType == char)
+            repr (string (deref self._items) (deref self._count))
+        else
+            ..
+                "[count="
+                repr self._count
+                " items="
+                repr self._items
+                "]"
+
+    let
+        __== = (span-binary-op compare-spans==)
+        __!= =
+            span-binary-op
+                inline (self other) (not (compare-spans== self other))
+        __< =
+            span-binary-op
+                inline (self other) ((compare-spans self other) < 0)
+        __<= =
+            span-binary-op
+                inline (self other) ((compare-spans self other) <= 0)
+        __> =
+            span-binary-op
+                inline (self other) ((compare-spans self other) > 0)
+        __>= =
+            span-binary-op
+                inline (self other) ((compare-spans self other) >= 0)
+
+    unlet gen-type from-arguments
+
+let StringView = (Span char)
+
+do
+    let Span StringView
+    locals;
@@ -10,6 +10,8 @@
     on the heap. Strings are guaranteed to be zero-terminated.
 
 using import struct
+using import Allocator
+using import Span
 
 let &chararray = (& (array char))
 
@@ -18,6 +20,15 @@ let &chararray = (& (array char))
 let llvm.memcpy.p0i8.p0i8.i64 =
     extern 'llvm.memcpy.p0i8.p0i8.i64
         function void (mutable rawstring) rawstring i64 bool
+# declare void @llvm.memmove.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
+                                         i64 <len>, i1 <isvolatile>)
+let llvm.memmove.p0i8.p0i8.i64 =
+    extern 'llvm.memmove.p0i8.p0i8.i64
+        function void (mutable rawstring) rawstring i64 bool
+# LLVM knows memcmp, and expands short and constant size compares inline
+let memcmp =
+    extern 'memcmp
+        function i32 rawstring rawstring usize
 # declare void @llvm.memset.p0i8.i64(i8* <dest>, i8 <val>,
                                    i64 <len>, i1 <isvolatile>)
 let llvm.memset.p0i8.i64 =
@@ -28,7 +39,8 @@ inline string-generator (self)
     Generator
         inline () 0:usize
         inline (i) (i < self._count)
-        inline (i) (self @ i)
+        # the generator checks the index itself
+        inline (i) (unchecked@ self i)
         inline (i) (i + 1:usize)
 
 inline string-collector (self)
@@ -55,11 +67,15 @@ typedef StringBase < Struct
 
         :::scopes
         local new-string : (FixedString element-type capacity)
+
+    An allocator type may be passed as third argument.
 typedef FixedString < StringBase
 
 """"The supertype and constructor for strings of growing size. New instances
     have a default capacity of 4, and grow by a factor of 2.7 each time their
-    capacity is exceeded.
+    capacity is exceeded. Strings of plain elements that fit into the string
+    object itself, which on 64-bit targets is up to 23 characters plus the
+    trailing zero, are stored inline and not allocated on the heap.
 
     To construct a new growing string type:
 
@@ -70,6 +86,8 @@ typedef FixedString < StringBase
 
         :::scopes
         local new-string : (GrowingString element-type) [(capacity = ...)]
+
+    An allocator type may be passed as second argument.
 typedef GrowingString < StringBase
 
 fn zero-terminated-length (value)
@@ -82,19 +100,39 @@ fn zero-terminated-length (value)
                 break i
             i + 1
 
+# copies count elements from src to dest as a block when the element type
+  is plain, or one at a time otherwise.
+inline copy-elements (dest src count)
+    let ET = (elementof (typeof dest))
+    static-if (plain? ET)
+        llvm.memcpy.p0i8.p0i8.i64
+            bitcast dest (mutable rawstring)
+            bitcast src rawstring
+            ((count as usize) * (sizeof ET)) as i64
+            false
+    else
+        for i in (range count)
+            dest @ i = src @ i
+
+# as copy-elements, but the ranges may overlap; elements are moved rather
+  than copied, so this is a block move for every element type.
+inline move-elements (dest src count)
+    let ET = (elementof (typeof dest))
+    llvm.memmove.p0i8.p0i8.i64
+        bitcast dest (mutable rawstring)
+        bitcast src rawstring
+        ((count as usize) * (sizeof ET)) as i64
+        false
+
 fn copy-from-memory (self other count)
     let cls = (typeof self)
     let ZE = cls.ZeroElement
     let olditems = ('internal-reserve self count)
-    let items = self._items
-    loop (i = 0)
-        if (i == count)
-            items @ i = ZE
-            self._count = i
-            break;
-        items @ i = other @ i
-        i + 1
-    free olditems
+    let items = ('internal-items self)
+    copy-elements items other count
+    items @ count = ZE
+    self._count = count
+    cls.Allocator.free olditems
 
 fn join-from-memory (self other count)
     local self = (copy self)
@@ -103,22 +141,23 @@ fn join-from-memory (self other count)
     let start = (countof self)
     let totalcount = (start + count)
     'reserve self totalcount
-    let items = self._items
-    loop (i j = 0 start)
-        if (i == count)
-            items @ j = ZE
-            self._count = j
-            break;
-        items @ j = other @ i
-        _ (i + 1) (j + 1)
+    let items = ('internal-items self)
+    copy-elements (getelementptr items start) other count
+    items @ totalcount = ZE
+    self._count = totalcount
     self
 
 fn compare-strings== (self other count)
     let cls = (typeof self)
+    let ET = cls.ElementType
     let lcount = (countof self)
     if (lcount != count) false
     else
-        let items = self._items
+        let items = ('internal-items self)
+        # integer elements are equal exactly when their bytes are
+        static-if (ET < integer)
+            let size = ((count as usize) * (sizeof ET))
+            return ((memcmp (bitcast items rawstring) (bitcast other rawstring) size) == 0)
         loop (i = 0)
             if (i == count)
                 break true
@@ -133,7 +172,7 @@ inline gen-compare-strings (pred< pred= pred>)
     fn compare-strings (self other count)
         let cls = (typeof self)
         let lcount = (countof self)
-        let items = self._items
+        let items = ('internal-items self)
         loop (i = 0)
             if (i == lcount)
                 if (i == count)
@@ -170,6 +209,9 @@ inline string-binary-op (f superf)
         elseif ((ET == char) and ((T == string) or (&chararray? T)))
             inline (self other)
                 f self (other as rawstring) (countof other)
+        elseif (T == cls.ViewType)
+            inline (self other)
+                f self ('data other) (countof other)
         elseif (not none? superf)
             superf cls T
 
@@ -201,10 +243,13 @@ typedef+ StringBase
         elseif (T == Collector) string-collector
         elseif ((cls.ElementType == char) and (T == string))
             inline (self)
-                string self._items self._count
+                string ('internal-items self) self._count
+        elseif (T == cls.ViewType)
+            inline (self) ('span self)
 
     inline __ras (T cls)
         static-if ((cls.ElementType == char) and (T == string)) cls
+        elseif (T == cls.ViewType) cls
 
     inline... __lslice (self, offset : usize)
         let T = (typeof self)
@@ -222,23 +267,38 @@ typedef+ StringBase
         else
             T (& (self @ offset)) ((countof self) - offset)
 
+    """"Returns a `Span` of the elements in `[start, end)`, or of all elements,
+        which views the memory of the string rather than copying it.
+    inline span (self start end)
+        let cls = (typeof self)
+        let count = (deref self._count)
+        let start =
+            static-if (none? start) 0:usize
+            else (min (start as usize) count)
+        let end =
+            static-if (none? end) count
+            else (max start (min (end as usize) count))
+        cls.ViewType (getelementptr ('internal-items self) start) (end - start)
+
     inline reverse (self)
         Generator
             inline () (deref self._count)
             inline (i) (i > 0:usize)
-            inline (i) (self @ (i - 1:usize))
+            inline (i) (unchecked@ self (i - 1:usize))
             inline (i) (i - 1:usize)
 
     """"Implements support for pointer casts, to pass the string to C functions
-        for example.
+        for example, and for implicit conversion to a `Span` of its elements.
     inline __imply (cls T)
         static-match T
         case pointer
-            inline (self) (self._items as cls.PointerType)
+            inline (self) (('internal-items self) as cls.PointerType)
         case voidstar
-            inline (self) (self._items as voidstar)
+            inline (self) (('internal-items self) as voidstar)
         case cls.PointerType
-            inline (self) (self._items as cls.PointerType)
+            inline (self) (('internal-items self) as cls.PointerType)
+        case cls.ViewType
+            inline (self) ('span self)
         default ()
 
     inline __static-rimply (T cls)
@@ -247,7 +307,7 @@ typedef+ StringBase
             static-if (&chararray? T) cls
             elseif (T == string) cls
 
-    inline __typecall (cls element-type capacity)
+    inline __typecall (cls element-type capacity allocator)
         """"Construct a mutable string type of `element-type` with a variable or
             fixed maximum capacity.
 
@@ -255,11 +315,14 @@ typedef+ StringBase
             of string elements permitted. If it is undefined, then an initial
             capacity of 16 elements is assumed, which is doubled whenever
             it is exceeded, allowing for an indefinite number of elements.
+
+            If `allocator` is defined, the string obtains its memory from it
+            rather than from the heap.
         static-assert (cls == StringBase)
         static-if (none? capacity)
-            GrowingString element-type
+            GrowingString element-type allocator
         else
-            FixedString element-type capacity
+            FixedString element-type capacity allocator
 
     let
         __= = (string-binary-op copy-from-memory super-type.__=)
@@ -287,24 +350,32 @@ typedef+ StringBase
 
     """"Implements support for the `@` operator. Returns a view reference to the
         element at `index` of string `self`.
-    fn __@ (self index)
+    inline __@ (self index)
         let index = (index as usize)
-        assert (index <= self._count) "index out of bounds"
-        self._items @ index
+        static-if bounds-checks?
+            assert (likely (index <= self._count)) "index out of bounds"
+        ('internal-items self) @ index
+
+    """"Implements support for the `unchecked@` operator. Returns a view
+        reference to the element at `index` of string `self` without checking
+        that `index` is in bounds.
+    inline __unchecked@ (self index)
+        ('internal-items self) @ (index as usize)
 
+    """"Hashes the elements of the string the same as a `Span` of them.
     fn __hash (self)
-        hash.from-bytes (self as rawstring) (countof self)
+        hash ('span self)
 
-    fn last (self)
+    inline last (self)
         assert (self._count > 0) "empty string has no last element"
-        self._items @ (self._count - 1:usize)
+        ('internal-items self) @ (self._count - 1:usize)
 
     fn append-slots (self n)
         let idx = (deref self._count)
         let new-count = (idx + n)
         'reserve self new-count
         self._count = new-count
-        self._items @ idx
+        ('internal-items self) @ idx
 
     """"Append `value` as an element to the string `self` and return a reference
         to the new element. When the array is of `GrowingString` type, this
@@ -347,6 +418,17 @@ typedef+ StringBase
             (count * (sizeof cls.ElementType)) as i64
             false
         ;
+    case (self, value : (typematch T < Span))
+        let cls = (typeof self)
+        static-assert (cls.ViewType == (typeof value))
+        let count = (countof value)
+        let ptr = (append-slots self count)
+        llvm.memcpy.p0i8.p0i8.i64
+            bitcast (& ptr) (mutable rawstring)
+            bitcast ('data value) rawstring
+            (count * (sizeof cls.ElementType)) as i64
+            false
+        ;
     case using append
 
     """"Construct a new element with arguments `args...` directly in a newly
@@ -378,10 +460,10 @@ typedef+ StringBase
             let count = (deref self._count)
             assert (index <= count) "insertion index out of bounds"
             append-slots self 1:usize
-            let items = self._items
-            for i in (rrange index count)
-                assign (dupe (items @ i)) (items @ (i + 1))
-            let slot = (self._items @ index)
+            let items = ('internal-items self)
+            move-elements (getelementptr items (index + 1)) (getelementptr items index)
+                count - index
+            let slot = (items @ index)
             assign value slot
             slot
         inline... insert
@@ -396,8 +478,9 @@ typedef+ StringBase
         assert (&count > 0) "can't pop from empty string"
         &count -= 1
         let idx = (deref &count)
-        let result = (dupe (deref (self._items @ idx)))
-        store ((typeof self) . ZeroElement) (getelementptr self._items idx)
+        let items = ('internal-items self)
+        let result = (dupe (deref (items @ idx)))
+        store ((typeof self) . ZeroElement) (getelementptr items idx)
         result
 
     """"Remove element at index from string `self` and return it.
@@ -406,12 +489,12 @@ typedef+ StringBase
         let &count = self._count
         assert (index < &count) "can't pop from empty string"
         &count -= 1
-        let items = self._items
+        let items = ('internal-items self)
         let result =
             dupe (deref (items @ index))
-        for i in (range index &count)
-            assign (dupe (items @ (i + 1))) (items @ i)
-        store ((typeof self) . ZeroElement) (getelementptr self._items &count)
+        move-elements (getelementptr items index) (getelementptr items (index + 1))
+            &count - index
+        store ((typeof self) . ZeroElement) (getelementptr items &count)
         result
 
     """"Clear the string and reset its element count to zero. This will drop
@@ -422,7 +505,7 @@ typedef+ StringBase
         self._count = 0:usize
         # null remainder of memory
         llvm.memset.p0i8.i64
-            bitcast self._items (mutable rawstring)
+            bitcast ('internal-items self) (mutable rawstring)
             0:char
             (offset * (sizeof cls.ElementType)) as i64
             false
@@ -442,38 +525,48 @@ typedef+ StringBase
             self._count = count
             # null remainder of memory
             llvm.memset.p0i8.i64
-                bitcast (getelementptr self._items count) (mutable rawstring)
+                bitcast (getelementptr ('internal-items self) count) (mutable rawstring)
                 0:char
                 (offset * (sizeof cls.ElementType)) as i64
                 false
 
     fn reserve (self count)
-        free ('internal-reserve self count)
+        let cls = (typeof self)
+        cls.Allocator.free ('internal-reserve self count)
 
     """"Implements support for freeing the string's memory when it goes out
         of scope.
     inline __drop (self)
-        free self._items
+        if (not ('internal-inline? self))
+            let cls = (typeof self)
+            cls.Allocator.free self._items
 
     """"Safely swap the contents of two indices.
     fn swap (self a b)
-        swap (self._items @ a) (self._items @ b)
+        let items = ('internal-items self)
+        swap (items @ a) (items @ b)
 
     """"Implements support for the `copy` operation.
     fn __copy (self)
         viewing self
         local newarr = (dupe (deref self))
+        if ('internal-inline? self)
+            # inline elements are plain and have been copied with the string
+            return newarr
         let count = (deref self._count)
         let old-items = (deref self._items)
         let cls = (typeof self)
         let capacity = ('capacity self)
-        let new-items = (malloc-array cls.ElementType capacity)
-        loop (idx = 0)
-            if (idx < count)
-                assign (copy (old-items @ idx)) (new-items @ idx)
-                repeat (idx + 1)
-            else
-                break;
+        let new-items = (cls.Allocator.alloc-array cls.ElementType capacity)
+        static-if (plain? cls.ElementType)
+            copy-elements (view new-items) old-items count
+        else
+            loop (idx = 0)
+                if (idx < count)
+                    assign (copy (old-items @ idx)) (new-items @ idx)
+                    repeat (idx + 1)
+                else
+                    break;
         # null remainder of memory
         llvm.memset.p0i8.i64
             bitcast (getelementptr (view new-items) count) (mutable rawstring)
@@ -489,7 +582,7 @@ typedef+ FixedString
     let parent-type = this-type
 
     @@ memo
-    inline gen-fixed-string-type (element-type capacity)
+    inline gen-fixed-string-type (element-type capacity allocator)
         static-assert ((typeof element-type) == type)
         static-assert ((typeof capacity) == i32)
         static-assert (capacity >= 0)
@@ -499,6 +592,7 @@ typedef+ FixedString
                 tostring element-type
                 " x "
                 tostring capacity
+                Allocator.type-name-suffix allocator
                 ">"
             \ < parent-type
 
@@ -508,16 +602,19 @@ typedef+ FixedString
             let
                 ElementType = element-type
                 PointerType = (pointer element-type)
+                ViewType = (Span element-type)
                 ZeroElement = (nullof element-type)
                 Capacity = (capacity + 1)
+                Allocator = allocator
 
     inline __typecall (cls opts...)
         static-if (cls == this-type)
-            let element-type capacity = opts...
+            let element-type capacity allocator = opts...
             gen-fixed-string-type element-type (capacity as i32)
+                Allocator.resolve allocator
         else
             let ET = cls.ElementType
-            let items = (malloc-array ET cls.Capacity)
+            let items = (cls.Allocator.alloc-array ET cls.Capacity)
             store cls.ZeroElement items
             Struct.__typecall cls
                 _items = items
@@ -548,32 +645,55 @@ typedef+ FixedString
         assert (count < T.Capacity) "capacity exceeded"
         nullof (typeof self._items)
 
+    """"Internally used by the type. Returns a pointer to the elements of
+        string `self`.
+    inline internal-items (self)
+        deref self._items
+
+    """"Internally used by the type. Fixed strings are never stored inline.
+    inline internal-inline? (self) false
+
     unlet gen-fixed-string-type parent-type
 
 
 
 let DEFAULT_CAPACITY = (1:usize << 2:usize)
+# bytes of a growing string that hold inline elements in place of the heap
+  pointer; together with the pointer itself, that is 24 bytes on 64-bit targets.
+let INLINE_PADDING = 16:usize
 
 typedef+ GrowingString
     let parent-type = this-type
 
     @@ memo
-    inline gen-growing-string-type (element-type)
+    inline gen-growing-string-type (element-type allocator)
         static-assert ((typeof element-type) == type)
         let parent-type = this-type
         struct
             .. "<GrowingString "
                 tostring element-type
+                Allocator.type-name-suffix allocator
                 ">"
             \ < parent-type
+            # when the string is inline, its elements overlay both fields
             _items : (mutable pointer element-type)
+            _inline : (array u8 INLINE_PADDING)
             _count : usize
             _capacity : usize
 
             let
                 ElementType = element-type
                 PointerType = (pointer element-type)
+                ViewType = (Span element-type)
                 ZeroElement = (nullof element-type)
+                Allocator = allocator
+                # the largest capacity that is stored inline, including the
+                  trailing zero; only plain elements with no more than pointer
+                  alignment are stored inline.
+                InlineCapacity =
+                    static-if ((plain? element-type) and ((alignof element-type) <= (alignof voidstar)))
+                        ((sizeof voidstar) + INLINE_PADDING) // (sizeof element-type)
+                    else 0:usize
 
     fn nearest-capacity (capacity count)
         loop (new-capacity = capacity)
@@ -583,28 +703,39 @@ typedef+ GrowingString
 
     @@ memo
     inline from-arguments (cls)
-        from cls let PointerType
+        from cls let PointerType ViewType
 
-        inline from-rawstring (data count)
-            let capacity =
-                nearest-capacity DEFAULT_CAPACITY (count + 1)
+        # returns an empty string that can hold at least count elements
+        inline from-capacity (count)
             let ET = cls.ElementType
-            let items = (malloc-array ET capacity)
+            if ((cls.InlineCapacity > 0:usize) and ((count + 1) <= cls.InlineCapacity))
+                # default initialization zeroes the inline elements
+                Struct.__typecall cls
+                    _count = 0:usize
+                    _capacity = cls.InlineCapacity
+            else
+                let capacity =
+                    nearest-capacity DEFAULT_CAPACITY (count + 1)
+                let items = (cls.Allocator.alloc-array ET capacity)
+                llvm.memset.p0i8.i64
+                    bitcast items (mutable rawstring)
+                    0:char
+                    (capacity * (sizeof ET)) as i64
+                    false
+                Struct.__typecall cls
+                    _items = items
+                    _count = 0:usize
+                    _capacity = capacity
+
+        inline from-rawstring (data count)
+            local self = (from-capacity count)
             llvm.memcpy.p0i8.p0i8.i64
-                bitcast (view items) (mutable rawstring)
+                bitcast ('internal-items self) (mutable rawstring)
                 bitcast data rawstring
                 (count * (sizeof cls.ElementType)) as i64
                 false
-            # null remainder of memory
-            llvm.memset.p0i8.i64
-                bitcast (getelementptr (view items) count) (mutable rawstring)
-                0:char
-                ((capacity - count) * (sizeof ET)) as i64
-                false
-            Struct.__typecall cls
-                _items = items
-                _count = count
-                _capacity = capacity
+            self._count = count
+            deref self
 
         inline... string-constructor
         case (data : PointerType, count : usize)
@@ -612,19 +743,7 @@ typedef+ GrowingString
         #case (data : PointerType,)
             this-function data (zero-terminated-length data)
         case (capacity : usize = DEFAULT_CAPACITY,)
-            let capacity =
-                nearest-capacity DEFAULT_CAPACITY (capacity + 1)
-            let ET = cls.ElementType
-            let items = (malloc-array ET capacity)
-            llvm.memset.p0i8.i64
-                bitcast items (mutable rawstring)
-                0:char
-                (capacity * (sizeof ET)) as i64
-                false
-            Struct.__typecall cls
-                _items = items
-                _count = 0:usize
-                _capacity = capacity
+            from-capacity capacity
         case (s : &chararray, ...)
             local self = (from-rawstring (s as rawstring) (countof s))
             va-map
@@ -639,6 +758,13 @@ typedef+ GrowingString
                     'append self arg
                 ...
             deref self
+        case (s : ViewType, ...)
+            local self = (from-rawstring ('data s) (countof s))
+            va-map
+                inline (arg)
+                    'append self arg
+                ...
+            deref self
         case (s : cls, ...)
             local self = (copy s)
             va-map
@@ -649,7 +775,8 @@ typedef+ GrowingString
 
     inline __typecall (cls opts...)
         static-if (cls == this-type)
-            gen-growing-string-type opts...
+            let element-type allocator = opts...
+            gen-growing-string-type element-type (Allocator.resolve allocator)
         else
             (from-arguments cls) opts...
 
@@ -659,7 +786,7 @@ typedef+ GrowingString
     fn __repr (self)
         let cls = (typeof self)
         if (cls.ElementType == char)
-            string self._items self._count
+            string ('internal-items self) self._count
         else
             ..
                 "[count="
@@ -675,6 +802,31 @@ typedef+ GrowingString
     inline capacity (self)
         deref self._capacity
 
+    """"Internally used by the type. Returns true if the elements of string
+        `self` are stored inline.
+    inline internal-inline? (self)
+        let cls = (typeof self)
+        static-if (cls.InlineCapacity == 0:usize) false
+        else (self._capacity <= cls.InlineCapacity)
+
+    """"Internally used by the type. Returns a pointer to the elements of
+        string `self`, which may point into the string itself; a string that
+        is passed by value is first copied to the stack.
+    inline internal-items (self)
+        let cls = (typeof self)
+        let PT = (mutable pointer cls.ElementType)
+        static-if (cls.InlineCapacity == 0:usize)
+            deref self._items
+        elseif (&? self)
+            ? ('internal-inline? self)
+                bitcast (& self._items) PT
+                deref self._items
+        else
+            local storage = (tupleof (deref self._items) (deref self._inline))
+            ? ('internal-inline? self)
+                bitcast (& storage) PT
+                deref self._items
+
     """"Internally used by the type. Ensures that string `self` can hold at least
         `count` elements. A growing string will always attempt to comply.
     fn internal-reserve (self count)
@@ -686,8 +838,9 @@ typedef+ GrowingString
                 nearest-capacity (deref self._capacity) (count + 1)
             let T = (typeof self)
             let count = (deref self._count)
-            let old-items = (deref self._items)
-            let new-items = (malloc-array T.ElementType new-capacity)
+            let inline? = ('internal-inline? self)
+            let old-items = ('internal-items self)
+            let new-items = (T.Allocator.alloc-array T.ElementType new-capacity)
             llvm.memcpy.p0i8.p0i8.i64
                 bitcast (view new-items) (mutable rawstring)
                 bitcast old-items rawstring
@@ -701,7 +854,9 @@ typedef+ GrowingString
                 false
             assign new-items self._items
             self._capacity = new-capacity
-            dupe old-items
+            # inline elements have no memory of their own to be freed
+            if inline? (nullof (typeof self._items))
+            else (dupe old-items)
         else
             nullof (typeof self._items)
 
@@ -716,5 +871,5 @@ spice prefix:S (str)
 
 do
     #let StringBase FixedString GrowingString
-    let String prefix:S
+    let String StringView prefix:S
     locals;
@@ -7,7 +7,9 @@
     =====
 
     This module provides UTF-8 encoder and decoder collectors, as well as
-    a UTF-8 aware `char` function.
+    a UTF-8 aware `char` function. For bulk conversions, `validate`,
+    `decode-into` and `encode-into` work on whole buffers and skip over runs
+    of ASCII characters 16 bytes at a time.
 
 using import enum
 
@@ -20,6 +22,16 @@ let llvm.ctlz.u32 =
     extern 'llvm.ctlz.i32
         function u32 u32 bool
 
+# declare i32   @llvm.cttz.i32  (i32   <src>, i1 <is_zero_undef>)
+let llvm.cttz.u32 =
+    extern 'llvm.cttz.i32
+        function u32 u32 bool
+# declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
+                                        i64 <len>, i1 <isvolatile>)
+let llvm.memcpy.p0i8.p0i8.i64 =
+    extern 'llvm.memcpy.p0i8.p0i8.i64
+        function void (mutable rawstring) rawstring i64 bool
+
 inline ctlz (c)
     llvm.ctlz.i8 c false
 inline ctlz-u32 (c)
@@ -137,6 +149,144 @@ inline decoder (coll)
     static-if (none? coll) _decoder
     else (_decoder coll)
 
+################################################################################
+
+let BLOCK_SIZE = 16:usize
+let BlockType = (vector u8 16)
+
+# accepts string constants as well as String buffers
+inline byte-pointer (src)
+    static-if ((typeof src) == string) (src as rawstring)
+    else (bitcast (imply src pointer) rawstring)
+
+# returns the number of leading ASCII bytes in the block at ptr, which need
+  not be aligned
+inline ascii-prefix (ptr)
+    local block : BlockType
+    llvm.memcpy.p0i8.p0i8.i64
+        bitcast (& block) (mutable rawstring)
+        bitcast ptr rawstring
+        (sizeof BlockType) as i64
+        false
+    let bits = (bitcast (block >= (vector.smear 0x80:u8 16)) u16)
+    # a guard bit yields the block size for blocks of ASCII only
+    (llvm.cttz.u32 ((bits as u32) | 0x10000:u32) false) as usize
+
+# returns the offset of the first byte at or after i that isn't ASCII, or count
+fn skip-ascii (ptr i count)
+    loop (i = i)
+        if ((i + BLOCK_SIZE) > count)
+            break
+                loop (i = i)
+                    if ((i == count) or (((ptr @ i) as u8) >= 0x80:u8))
+                        break i
+                    i + 1:usize
+        let n = (ascii-prefix (getelementptr ptr i))
+        if (n < BLOCK_SIZE)
+            break (i + n)
+        i + BLOCK_SIZE
+
+# decodes the sequence that starts at byte i and returns the codepoint and the
+  length of the sequence, or -1 and 1 if the sequence is ill-formed; overlong
+  forms, surrogates and codepoints beyond U+10FFFF are rejected.
+fn decode-sequence (ptr i count)
+    let c0 = ((ptr @ i) as u8 as u32)
+    if (c0 < 0x80:u32)
+        return (c0 as i32) 1:usize
+    # the length of the sequence and the range of its second byte, by lead byte
+    let n lo hi =
+        if (c0 < 0xc2:u32) (_ 0:usize 0:u32 0:u32)
+        elseif (c0 < 0xe0:u32) (_ 2:usize 0x80:u32 0xbf:u32)
+        elseif (c0 == 0xe0:u32) (_ 3:usize 0xa0:u32 0xbf:u32)
+        elseif (c0 == 0xed:u32) (_ 3:usize 0x80:u32 0x9f:u32)
+        elseif (c0 < 0xf0:u32) (_ 3:usize 0x80:u32 0xbf:u32)
+        elseif (c0 == 0xf0:u32) (_ 4:usize 0x90:u32 0xbf:u32)
+        elseif (c0 < 0xf4:u32) (_ 4:usize 0x80:u32 0xbf:u32)
+        elseif (c0 == 0xf4:u32) (_ 4:usize 0x80:u32 0x8f:u32)
+        else (_ 0:usize 0:u32 0:u32)
+    if ((n == 0:usize) or ((i + n) > count))
+        return -1 1:usize
+    let c1 = ((ptr @ (i + 1:usize)) as u8 as u32)
+    if ((c1 < lo) or (c1 > hi))
+        return -1 1:usize
+    # the lead byte keeps 7 - n bits
+    loop (k cp = 2:usize (((c0 & (0x7f:u32 >> (n as u32))) << 6:u32) | (c1 & 0x3f:u32)))
+        if (k == n)
+            return (cp as i32) n
+        let c = ((ptr @ (i + k)) as u8 as u32)
+        if ((c & 0xc0:u32) != 0x80:u32)
+            return -1 1:usize
+        _ (k + 1:usize) ((cp << 6:u32) | (c & 0x3f:u32))
+
+fn validate (ptr count)
+    """"Returns the offset of the first byte of the `count` bytes at `ptr` that
+        is not part of a well-formed UTF-8 sequence, or `count` if there is
+        none.
+    let ptr = (byte-pointer ptr)
+    let count = (count as usize)
+    loop (i = 0:usize)
+        let i = (skip-ascii ptr i count)
+        if (i == count)
+            break i
+        let cp n = (decode-sequence ptr i count)
+        if (cp < 0)
+            break i
+        i + n
+
+inline decode-into (dest src)
+    """"Decodes the UTF-8 text in the string `src` and appends its codepoints
+        to `dest`, which can be any growing array or string of `i32`. As
+        with `decoder`, the bytes of ill-formed sequences are appended as
+        negative numbers; the function returns how many there were.
+    let ptr = (byte-pointer src)
+    let count = ((countof src) as usize)
+    # there are never more codepoints than bytes
+    'reserve dest (((countof dest) as usize) + count)
+    loop (i errors = 0:usize 0:usize)
+        if (i == count)
+            break errors
+        let ascii-end = (skip-ascii ptr i count)
+        for k in (range i ascii-end)
+            'append dest ((ptr @ k) as u8 as i32)
+        if (ascii-end == count)
+            break errors
+        let cp n = (decode-sequence ptr ascii-end count)
+        if (cp < 0)
+            'append dest (- ((ptr @ ascii-end) as u8 as i32))
+            repeat (ascii-end + 1:usize) (errors + 1:usize)
+        'append dest cp
+        _ (ascii-end + n) errors
+
+inline encode-into (dest src)
+    """"Encodes the codepoints in `src`, which can be any array or string of
+        integers, as UTF-8 and appends them to the string `dest`. Negative
+        numbers are written as the bytes they stand for in the output of
+        `decoder` and `decode-into`, and codepoints beyond U+10FFFF as U+FFFD.
+    let count = ((countof src) as usize)
+    # there are at least as many bytes as codepoints
+    'reserve dest (((countof dest) as usize) + count)
+    for i in (range count)
+        let c = ((src @ i) as i32)
+        if (c < 0x80)
+            if (c >= 0)
+                'append dest (c as char)
+            else
+                'append dest ((- c) as char)
+        else
+            let c =
+                ? (c > 0x10ffff) 0xfffd:u32 (c as u32)
+            let nm = (ctlz-u32 c)
+            if (nm >= 21:u32)
+                'append dest (0xc0:char | ((c >> 6:u32) & 0x1f:u32) as char)
+            elseif (nm >= 16:u32)
+                'append dest (0xe0:char | ((c >> 12:u32) & 0xf:u32) as char)
+                'append dest (0x80:char | ((c >> 6:u32) & 0x3f:u32) as char)
+            else
+                'append dest (0xf0:char | ((c >> 18:u32) & 0x7:u32) as char)
+                'append dest (0x80:char | ((c >> 12:u32) & 0x3f:u32) as char)
+                'append dest (0x80:char | ((c >> 6:u32) & 0x3f:u32) as char)
+            'append dest (0x80:char | (c & 0x3f:u32) as char)
+
 spice char32 (value)
     using import itertools
     let value =
@@ -165,5 +315,5 @@ spice prefix:c (str)
     `(char32 str)
 
 do
-    let encoder decoder char32 prefix:c
+    let encoder decoder validate decode-into encode-into char32 prefix:c
     locals;
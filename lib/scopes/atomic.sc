@@ -0,0 +1,166 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""atomic
+    ======
+
+    Provides typed atomic values with explicit memory orders, and helpers for
+    building lock-free data structures on top of them.
+
+    Every operation takes the memory order as an optional last argument, one
+    of `memory-order-relaxed`, `memory-order-acquire`, `memory-order-release`,
+    `memory-order-acq-rel` and `memory-order-seq-cst`. Loads default to
+    acquire, stores to release, and all other operations to sequential
+    consistency:
+
+        :::scopes
+        using import atomic
+
+        local hits = (Atomic u64)
+        'fetch-add hits 1 memory-order-relaxed
+        let ready = (Atomic bool)
+        'store ready true memory-order-release
+
+    `fence` orders the memory accesses around it without accessing memory
+    itself, and `CachePadded` pads the size of a value to a whole number of
+    cache lines; it keeps values apart in memory only where they start on a
+    cache line boundary.
+
+using import struct
+
+let CACHE_LINE_SIZE = 64:usize
+
+#-------------------------------------------------------------------------------
+
+typedef Atomic < Struct
+
+""""A value of plain type `T` that is only accessed through atomic
+    operations, and is zero unless initialized otherwise:
+
+        :::scopes
+        local counter = ((Atomic i32) 10)
+typedef+ Atomic
+    @@ memo
+    inline gen-type (T)
+        static-assert (plain? T) "atomic values must be of plain type"
+        let parent-type = this-type
+        struct (.. "<Atomic " (tostring T) ">") < parent-type
+            _value : T = (nullof T)
+
+            let ElementType = T
+
+    inline __typecall (cls args...)
+        static-if (cls == this-type)
+            gen-type args...
+        else
+            Struct.__typecall cls args...
+
+    inline gen-fetch-op (op fop)
+        inline (self value order...)
+            let ET = ((typeof self) . ElementType)
+            atomicrmw
+                static-if (ET < real) fop
+                else op
+                \ (& self._value) (imply value ET) order...
+
+    inline gen-signed-fetch-op (sop uop)
+        inline (self value order...)
+            let ET = ((typeof self) . ElementType)
+            atomicrmw
+                static-if (signed? ET) sop
+                else uop
+                \ (& self._value) (imply value ET) order...
+
+    """"Returns the value. `order` is relaxed, acquire or seq_cst.
+    inline load (self order...)
+        atomic-load (& self._value) order...
+
+    """"Replaces the value. `order` is relaxed, release or seq_cst.
+    inline store (self value order...)
+        let ET = ((typeof self) . ElementType)
+        atomic-store (imply value ET) (& self._value) order...
+
+    """"Replaces the value and returns the previous one.
+    inline exchange (self value order...)
+        let ET = ((typeof self) . ElementType)
+        atomicrmw xchg (& self._value) (imply value ET) order...
+
+    """"Replaces the value with `desired` if it equals `expected`. Returns the
+        previous value, and whether it was replaced. The optional orders are
+        the order of the exchange, and the order of the load when the values
+        differ, which can not be release or acq_rel and defaults to the load
+        part of the first order.
+    inline compare-exchange (self expected desired order...)
+        let ET = ((typeof self) . ElementType)
+        cmpxchg (& self._value) (imply expected ET) (imply desired ET) order...
+
+    """"Replaces the value with `(f value)` until no other thread changes it
+        in between, and returns the previous value. `f` may be called more
+        than once.
+    inline update (self f order...)
+        let ET = ((typeof self) . ElementType)
+        loop (old = ('load self memory-order-relaxed))
+            let prev ok =
+                'compare-exchange self old (imply (f old) ET) order...
+            if ok
+                break old
+            repeat prev
+
+    # these combine the value with `value` and return the previous value
+    let
+        fetch-add = (gen-fetch-op add fadd)
+        fetch-sub = (gen-fetch-op sub fsub)
+        fetch-and = (gen-fetch-op band band)
+        fetch-or = (gen-fetch-op bor bor)
+        fetch-xor = (gen-fetch-op bxor bxor)
+        fetch-min = (gen-signed-fetch-op smin umin)
+        fetch-max = (gen-signed-fetch-op smax umax)
+
+    unlet gen-type gen-fetch-op gen-signed-fetch-op
+
+#-------------------------------------------------------------------------------
+
+typedef CachePadded < Struct
+
+""""Holds a value of type `T` in `value`, followed by padding up to a whole
+    number of cache lines. Only the size is padded, not the alignment: the
+    value has cache lines of its own where it starts on a cache line
+    boundary, such as at the start of an allocation aligned to
+    `CACHE_LINE_SIZE`. Elsewhere it can share the first and the last line
+    it overlaps with its neighbours:
+
+        :::scopes
+        struct Counters
+            produced : (CachePadded (Atomic u64))
+            consumed : (CachePadded (Atomic u64))
+typedef+ CachePadded
+    @@ memo
+    inline gen-type (T)
+        let parent-type = this-type
+        let size = (sizeof T)
+        let pad = ((CACHE_LINE_SIZE - (size % CACHE_LINE_SIZE)) % CACHE_LINE_SIZE)
+        static-if (pad == 0)
+            struct (.. "<CachePadded " (tostring T) ">") < parent-type
+                value : T
+                let ElementType = T
+        else
+            struct (.. "<CachePadded " (tostring T) ">") < parent-type
+                value : T
+                _pad : (array u8 pad)
+                let ElementType = T
+
+    inline __typecall (cls args...)
+        static-if (cls == this-type)
+            gen-type args...
+        else
+            Struct.__typecall cls args...
+
+    unlet gen-type
+
+#-------------------------------------------------------------------------------
+
+do
+    let Atomic CachePadded CACHE_LINE_SIZE
+    locals;
@@ -0,0 +1,529 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""concurrent
+    ==========
+
+    Provides containers that can be shared between threads: a bounded queue
+    for a single producer and a single consumer, a bounded queue for any
+    number of producers and consumers, and a hash map. The queues never lock,
+    and keep the positions that producers and consumers update on cache lines
+    of their own, so that the two sides don't slow each other down.
+
+    Containers are shared by passing a pointer to them:
+
+        :::scopes
+        using import concurrent
+        using import itertools
+
+        local queue = ((MPMCQueue i32) 1024)
+        let q = (& queue)
+        parallel-for 1000
+            inline (i q)
+                'push (@ q) (i as i32)
+            q
+
+    The queues hold plain elements only.
+
+    `AtomTable` interns names as `Symbol` values without going through the
+    symbol tables of the compiler.
+
+using import struct
+using import Array
+using import Map
+using import Option
+using import String
+using import Allocator
+
+let CACHE_LINE_SIZE = 64:usize
+
+# fills the rest of the cache line after a usize
+let CachePad = (array u8 (CACHE_LINE_SIZE - (sizeof usize)))
+
+fn nearest-power-of-two (count)
+    let count = (max (count as usize) 2:usize)
+    loop (capacity = 2:usize)
+        if (capacity < count)
+            repeat (capacity << 1:usize)
+        break capacity
+
+# test-and-test-and-set, so that waiting threads only read the lock
+inline acquire (lock)
+    loop ()
+        if ((atomic-load lock) == 0)
+            let old ok = (cmpxchg lock 0 1)
+            if ok
+                break;
+        repeat;
+
+inline release (lock)
+    atomic-store 0 lock
+
+#-------------------------------------------------------------------------------
+
+typedef SPSCQueue < Struct
+
+""""A bounded queue for one producing and one consuming thread, which never
+    blocks. The capacity is rounded up to the next power of two.
+
+    To construct a new queue:
+
+        :::scopes
+        (SPSCQueue element-type) capacity
+typedef+ SPSCQueue
+    @@ memo
+    inline gen-type (element-type)
+        static-assert (plain? element-type) "queue elements must be of plain type"
+        let parent-type = this-type
+        struct (.. "<SPSCQueue " (tostring element-type) ">") < parent-type
+            # the next position to pop, only written by the consumer
+            _head : usize
+            _pad0 : CachePad
+            # the next position to push, only written by the producer
+            _tail : usize
+            _pad1 : CachePad
+            _items : (mutable pointer element-type)
+            _mask : usize
+
+            let ElementType = element-type
+
+    inline __typecall (cls args...)
+        static-if (cls == this-type)
+            gen-type args...
+        else
+            let capacity = (nearest-power-of-two args...)
+            Struct.__typecall cls
+                _items = (malloc-array cls.ElementType capacity)
+                _mask = (capacity - 1:usize)
+
+    """"Returns the maximum number of elements the queue holds.
+    inline capacity (self)
+        self._mask + 1:usize
+
+    """"Returns the number of elements in the queue, which may already have
+        changed by the time it returns.
+    inline __countof (self)
+        (atomic-load (& self._tail)) - (atomic-load (& self._head))
+
+    """"Append `value` to the queue from the producing thread. Returns false
+        if the queue is full.
+    fn push (self value)
+        let cls = (typeof self)
+        let value = (imply value cls.ElementType)
+        let tail = (deref self._tail)
+        if ((tail - (atomic-load (& self._head))) > self._mask)
+            return false
+        store value (getelementptr (deref self._items) (tail & self._mask))
+        atomic-store (tail + 1:usize) (& self._tail)
+        true
+
+    """"Remove the oldest element from the queue from the consuming thread,
+        and return it as `Option`, which is empty if the queue is empty.
+    fn pop (self)
+        let cls = (typeof self)
+        let OptionT = (Option cls.ElementType)
+        let head = (deref self._head)
+        if (head == (atomic-load (& self._tail)))
+            return (OptionT)
+        let value = (load (getelementptr (deref self._items) (head & self._mask)))
+        atomic-store (head + 1:usize) (& self._head)
+        OptionT value
+
+    inline __drop (self)
+        free (deref self._items)
+
+    unlet gen-type
+
+#-------------------------------------------------------------------------------
+
+typedef MPMCQueue < Struct
+
+""""A bounded queue for any number of producing and consuming threads, which
+    never blocks. The capacity is rounded up to the next power of two.
+
+    Every slot of the queue carries a sequence number, which tells producers
+    whether it is free, and consumers whether it is filled, for the current
+    round through the queue; claiming a slot then takes a single
+    compare-and-swap.
+
+    To construct a new queue:
+
+        :::scopes
+        (MPMCQueue element-type) capacity
+typedef+ MPMCQueue
+    @@ memo
+    inline gen-type (element-type)
+        static-assert (plain? element-type) "queue elements must be of plain type"
+        let parent-type = this-type
+        struct (.. "<MPMCQueue " (tostring element-type) ">") < parent-type
+            _enqueue : usize
+            _pad0 : CachePad
+            _dequeue : usize
+            _pad1 : CachePad
+            _sequences : (mutable pointer usize)
+            _items : (mutable pointer element-type)
+            _mask : usize
+
+            let ElementType = element-type
+
+    inline __typecall (cls args...)
+        static-if (cls == this-type)
+            gen-type args...
+        else
+            let capacity = (nearest-power-of-two args...)
+            let sequences = (malloc-array usize capacity)
+            for i in (range capacity)
+                sequences @ i = i
+            Struct.__typecall cls
+                _sequences = sequences
+                _items = (malloc-array cls.ElementType capacity)
+                _mask = (capacity - 1:usize)
+
+    """"Returns the maximum number of elements the queue holds.
+    inline capacity (self)
+        self._mask + 1:usize
+
+    """"Returns the number of elements in the queue, which may already have
+        changed by the time it returns.
+    inline __countof (self)
+        let dequeue = (atomic-load (& self._dequeue))
+        let enqueue = (atomic-load (& self._enqueue))
+        ? (enqueue > dequeue) (enqueue - dequeue) 0:usize
+
+    """"Append `value` to the queue. Returns false if the queue is full.
+    fn push (self value)
+        let cls = (typeof self)
+        let value = (imply value cls.ElementType)
+        let mask = (deref self._mask)
+        let sequences = (deref self._sequences)
+        loop (pos = (atomic-load (& self._enqueue)))
+            let sequence = (getelementptr sequences (pos & mask))
+            # the slot is free when its sequence number has caught up with pos
+            let dif = (((atomic-load sequence) - pos) as i64)
+            if (dif == 0:i64)
+                let old ok = (cmpxchg (& self._enqueue) pos (pos + 1:usize))
+                if ok
+                    store value (getelementptr (deref self._items) (pos & mask))
+                    atomic-store (pos + 1:usize) sequence
+                    break true
+                repeat old
+            elseif (dif < 0:i64)
+                break false
+            else
+                repeat (atomic-load (& self._enqueue))
+
+    """"Remove the oldest element from the queue and return it as `Option`,
+        which is empty if the queue is empty.
+    fn pop (self)
+        let cls = (typeof self)
+        let OptionT = (Option cls.ElementType)
+        let mask = (deref self._mask)
+        let sequences = (deref self._sequences)
+        loop (pos = (atomic-load (& self._dequeue)))
+            let sequence = (getelementptr sequences (pos & mask))
+            # the slot is filled when its sequence number is one past pos
+            let dif = (((atomic-load sequence) - (pos + 1:usize)) as i64)
+            if (dif == 0:i64)
+                let old ok = (cmpxchg (& self._dequeue) pos (pos + 1:usize))
+                if ok
+                    let value =
+                        load (getelementptr (deref self._items) (pos & mask))
+                    # free the slot for the next round
+                    atomic-store (pos + mask + 1:usize) sequence
+                    break (OptionT value)
+                repeat old
+            elseif (dif < 0:i64)
+                break (OptionT)
+            else
+                repeat (atomic-load (& self._dequeue))
+
+    inline __drop (self)
+        free (deref self._sequences)
+        free (deref self._items)
+
+    unlet gen-type
+
+#-------------------------------------------------------------------------------
+
+# the top bits of the hash pick the shard, the map of the shard uses the
+  bottom bits
+let SHARD_BITS = 6:u64
+let SHARD_COUNT = (1:u64 << SHARD_BITS)
+
+typedef ConcurrentMap < Struct
+
+""""A hash map that can be read and changed by many threads at once. Keys
+    are spread over a fixed number of shards, each of which is a `Map` behind
+    a lock of its own, so threads only wait for each other when they use keys
+    of the same shard. Shards are padded to whole cache lines.
+
+    Values are returned as copies, since references into the map could be
+    invalidated by other threads at any time.
+
+    To construct a new map:
+
+        :::scopes
+        (ConcurrentMap key-type value-type)
+typedef+ ConcurrentMap
+    @@ memo
+    inline gen-type (key-type value-type)
+        let parent-type = this-type
+        let MapType = (Map key-type value-type)
+        let ShardType =
+            struct (.. "<ConcurrentMapShard " (tostring key-type) "=" (tostring value-type) ">")
+                _lock : i32
+                _map : MapType
+                _pad : (array u8 CACHE_LINE_SIZE)
+        struct
+            .. "<ConcurrentMap " (tostring key-type) "=" (tostring value-type) ">"
+            \ < parent-type
+            _shards : (Array ShardType)
+
+            let
+                KeyType = key-type
+                ValueType = value-type
+                MapType = MapType
+                ShardType = ShardType
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            gen-type opts...
+        else
+            local self =
+                Struct.__typecall cls
+                    _shards = ((Array cls.ShardType))
+            for i in (range SHARD_COUNT)
+                'append self._shards
+                    cls.ShardType (_map = (cls.MapType))
+            self
+
+    # calls f with the map of the shard that holds key, while holding its lock
+    inline locked (self key f)
+        let cls = (typeof self)
+        let keyhash = ((hash (key as cls.KeyType)) as u64)
+        let shard = (self._shards @ (keyhash >> (64:u64 - SHARD_BITS)))
+        acquire (& shard._lock)
+        let result = (f shard._map)
+        release (& shard._lock)
+        result
+
+    """"Associate `key` with `value`, replacing the previous value.
+    inline set (self key value)
+        locked self key
+            inline (map)
+                'set map key value
+
+    """"Returns a copy of the value associated with `key` as `Option`, which
+        is empty if the map doesn't contain `key`.
+    inline get (self key)
+        let OptionT = (Option ((typeof self) . ValueType))
+        locked self key
+            inline (map)
+                try
+                    OptionT (copy ('get map key))
+                except (err)
+                    OptionT;
+
+    """"Returns a copy of the value associated with `key`, or `value` if the
+        map doesn't contain `key`.
+    inline getdefault (self key value)
+        locked self key
+            inline (map)
+                copy ('getdefault map key value)
+
+    """"Returns true if the map contains `key`.
+    inline in? (self key)
+        locked self key
+            inline (map)
+                'in? map key
+
+    """"Replace the value associated with `key`, or `init` if the map doesn't
+        contain `key`, with `f value`, without other threads changing the
+        value in between; `f` runs while the shard is locked.
+    inline update (self key init f)
+        locked self key
+            inline (map)
+                let value = (f ('getdefault map key init))
+                'set map key value
+
+    """"Erase the association of `key`, if there is one.
+    inline discard (self key)
+        locked self key
+            inline (map)
+                'discard map key
+
+    """"Returns the number of keys in the map, which may already have changed
+        by the time it returns.
+    fn __countof (self)
+        fold (count = 0:usize) for shard in self._shards
+            acquire (& shard._lock)
+            let n = (countof shard._map)
+            release (& shard._lock)
+            count + n
+
+    """"Removes all keys from the map.
+    fn clear (self)
+        for shard in self._shards
+            acquire (& shard._lock)
+            'clear shard._map
+            release (& shard._lock)
+
+    unlet gen-type locked
+
+#-------------------------------------------------------------------------------
+
+let memcmp =
+    extern 'memcmp
+        function i32 rawstring rawstring usize
+
+# where the name of an atom is stored in the name buffer of its shard
+struct AtomName plain
+    offset : usize
+    count : usize
+
+# the offset of the names of ids that have no atom
+let NO_ATOM = (~ 0:usize)
+
+typedef AtomTable < Struct
+
+""""A table that interns names as `Symbol` values for programs that create
+    symbols at runtime. Symbols are identified by the hash of their name, so
+    an atom is equal to the symbol of the same name that the compiler knows,
+    but interning an atom neither locks nor grows the symbol tables of the
+    compiler. Like `ConcurrentMap`, the table is spread over shards with a
+    lock of their own, so that many threads can intern names at once.
+
+    The table copies the names into buffers that it obtains from
+    `allocator`, and releases all of them when it is dropped, so that a table
+    that is used for a single frame or request can take its memory from an
+    `Arena`.
+
+    To construct a new table:
+
+        :::scopes
+        local atoms = ((AtomTable))
+        let key = ('intern atoms "position")
+        assert (key == 'position)
+
+    To take the names from an arena:
+
+        :::scopes
+        global arena : Arena
+        local atoms = ((AtomTable (allocator-for arena)))
+typedef+ AtomTable
+    @@ memo
+    inline gen-type (allocator)
+        let parent-type = this-type
+        let MapType = (Map u64 AtomName)
+        let NamesType = (GrowingArray char allocator)
+        let ShardType =
+            struct (.. "<AtomTableShard" (Allocator.type-name-suffix allocator) ">")
+                _lock : i32
+                _ids : MapType
+                _names : NamesType
+                _pad : (array u8 CACHE_LINE_SIZE)
+        struct
+            .. "<AtomTable" (Allocator.type-name-suffix allocator) ">"
+            \ < parent-type
+            _shards : (Array ShardType)
+
+            let
+                MapType = MapType
+                NamesType = NamesType
+                ShardType = ShardType
+
+    inline __typecall (cls allocator)
+        static-if (cls == this-type)
+            gen-type (Allocator.resolve allocator)
+        else
+            local self =
+                Struct.__typecall cls
+                    _shards = ((Array cls.ShardType))
+            for i in (range SHARD_COUNT)
+                'append self._shards
+                    cls.ShardType
+                        _ids = (cls.MapType)
+                        _names = (cls.NamesType)
+            self
+
+    inline shard-of (self id)
+        self._shards @ (id >> (64:u64 - SHARD_BITS))
+
+    # the location of the name of id in its shard, which must be locked
+    inline find-name (shard id)
+        copy ('getdefault shard._ids id (AtomName NO_ATOM 0:usize))
+
+    """"Returns the symbol named by the `count` characters at `data`, and
+        copies the name into the table if it has no atom of that name yet.
+    fn intern-bytes (self data count)
+        let data = (bitcast data rawstring)
+        let count = (count as usize)
+        if (count == 0:usize)
+            # the empty name is the unnamed symbol
+            return (bitcast 0:u64 Symbol)
+        let id = (sc_hashbytes data count)
+        let shard = (shard-of self id)
+        acquire (& shard._lock)
+        let entry = (find-name shard id)
+        if (entry.offset == NO_ATOM)
+            let offset = (countof shard._names)
+            for i in (range count)
+                'append shard._names (data @ i)
+            'set shard._ids id (AtomName offset count)
+        else
+            let name = (bitcast (& (shard._names @ entry.offset)) rawstring)
+            assert
+                (entry.count == count) and ((memcmp name data count) == 0)
+                "atom hash collision"
+        release (& shard._lock)
+        bitcast id Symbol
+
+    """"Returns the symbol named by `name`, which is a `string` or a `String`.
+    inline intern (self name)
+        let name = (name as string)
+        intern-bytes self (name as rawstring) (countof name)
+
+    """"Returns true if `sym` has been interned in the table.
+    fn in? (self sym)
+        let id = (bitcast sym u64)
+        let shard = (shard-of self id)
+        acquire (& shard._lock)
+        let result = ('in? shard._ids id)
+        release (& shard._lock)
+        result
+
+    """"Returns the name of `sym` as a `String`. Symbols that have not been
+        interned in the table, such as those the program was compiled with,
+        are named by the compiler.
+    fn name (self sym)
+        let id = (bitcast sym u64)
+        let shard = (shard-of self id)
+        acquire (& shard._lock)
+        let entry = (find-name shard id)
+        let result =
+            if (entry.offset == NO_ATOM) (String)
+            else
+                String (& (shard._names @ entry.offset)) entry.count
+        release (& shard._lock)
+        if (entry.offset == NO_ATOM)
+            String (sym as string)
+        else result
+
+    """"Returns the number of atoms in the table, which may already have
+        changed by the time it returns.
+    fn __countof (self)
+        fold (count = 0:usize) for shard in self._shards
+            acquire (& shard._lock)
+            let n = (countof shard._ids)
+            release (& shard._lock)
+            count + n
+
+    unlet gen-type shard-of find-name
+
+unlet nearest-power-of-two acquire release memcmp NO_ATOM
+
+do
+    let SPSCQueue MPMCQueue ConcurrentMap AtomTable
+    locals;
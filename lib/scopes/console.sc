@@ -327,19 +327,43 @@ case (global-scope, show-logo : bool = false, history-path : string = "")
                     except (err)
             _ unnamed `()
 
+        # returns what `repr` prints for a constant, or an empty string if
+          the type of the constant has a repr function, which must be compiled
+        fn constant-repr (value)
+            let T = ('typeof value)
+            try
+                sc_type_at T '__repr
+                return str""
+            except (err)
+            let s = (sc_value_content_repr value)
+            if ((sc_type_is_default_suffix T) or (T == NullType))
+                return s
+            .. s (default-styler style-operator ":")
+                default-styler style-type (tostring T)
+
         let counter eval-scope =
             try
                 let user-expr = (list-parse cmdlist)
                 let expression-anchor = ('anchor user-expr)
                 let user-expr = (user-expr as list)
                 let bound-name bound-val = (get-bound-name eval-scope user-expr)
-                if (bound-name != unnamed)
+                let bound-repr =
+                    if ((bound-name != unnamed) and ('constant? bound-val))
+                        constant-repr bound-val
+                    else str""
+                if (not (empty? bound-repr))
+                    # constants are printed without compiling anything
+                    print bound-name (default-styler style-operator "=") bound-repr
+                    _ counter eval-scope
+                elseif (bound-name != unnamed)
                     # just print the value
                     @@ spice-quote
                     fn expr ()
                         raising Error
                         print-bound-names bound-name bound-val
-                    let f = (sc_compile (sc_typify_template expr 0 null) 0:u64)
+                    let f =
+                        sc_compile (sc_typify_template expr 0 null)
+                            (compile-flag-release | compile-flag-quick)
                     let fptr = (f as (pointer (raises (function void) Error)))
                     fptr;
                     _ counter eval-scope
@@ -362,7 +386,9 @@ case (global-scope, show-logo : bool = false, history-path : string = "")
                     hide-traceback;
                     let expression = (sc_eval
                         expression-anchor list-expression (Scope eval-scope))
-                    let f = (sc_compile expression 0:u64)
+                    let f =
+                        sc_compile expression
+                            (compile-flag-release | compile-flag-quick)
                     let fptr =
                         f as (pointer (raises (function (Arguments i32 Scope)) Error))
                     fptr;
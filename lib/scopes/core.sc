@@ -100,6 +100,19 @@ inline error@+ (error anchor traceback-msg)
     sc_error_append_calltrace error (sc_valueref_tag anchor `traceback-msg)
     raise error
 
+# calls f args... while speculating, so that the runtime functions it calls
+  fail with a shared error that carries no details and costs nothing to raise;
+  for probes that discard the error, or repeat the call to report it.
+inline speculate (f args...)
+    sc_speculation_begin;
+    try
+        let result = (f args...)
+        sc_speculation_end;
+        result
+    except (err)
+        sc_speculation_end;
+        raise err
+
 inline prefix:str (s)
     sc_string_unescape (sc_const_string_extract `s)
 
@@ -174,6 +187,8 @@ let TypeArrayPointer =
     sc_pointer_type type pointer-flag-non-writable unnamed
 let ValueArrayPointer =
     sc_pointer_type Value pointer-flag-non-writable unnamed
+let StringArrayPointer =
+    sc_pointer_type string pointer-flag-non-writable unnamed
 let SpiceMacroFunction = (sc_type_storage SpiceMacro)
 
 # dynamically construct a new symbol
@@ -551,14 +566,15 @@ sc_type_set_symbol typename '__methodcall
                 hide-traceback;
                 let sym = (unbox-symbol symval Symbol)
                 let T = (sc_value_type self)
-                try (return (sc_type_at T sym))
+                try (return (speculate sc_type_at T sym))
                 except (err)
                     # if calling method of type, try typemethod
                     if (ptrcmp== T type)
                         if (sc_value_is_constant self)
                             let self = (unbox-pointer self type)
                             return (sc_type_at self sym)
-                    raise err
+                    # repeat the lookup for the full error
+                    sc_type_at T sym
 
             let argcount = (sc_argcount args)
             verify-count argcount 2 -1
@@ -1090,6 +1106,7 @@ run-stage; # 3
 'define-symbols string
     join = sc_string_join
     match? = sc_string_match
+    match-from? = sc_string_match_from
 
 'define-symbols Error
     format = sc_format_error
@@ -1672,7 +1689,7 @@ fn cast-converter (symbol rsymbol vQT T)
     let vT = ('strip-qualifiers vQT)
     label next
         let f =
-            try ('@ vT symbol)
+            try (speculate sc_type_at vT symbol)
             except (err) (merge next)
         let conv = (sc_prove `(f vT T))
         if (operator-valid? conv) (return conv)
@@ -1681,7 +1698,7 @@ fn cast-converter (symbol rsymbol vQT T)
             if (operator-valid? conv) (return conv)
     label next
         let f =
-            try ('@ T rsymbol)
+            try (speculate sc_type_at T rsymbol)
             except (err) (merge next)
         let conv = (sc_prove `(f vT T))
         if (operator-valid? conv) (return conv)
@@ -1698,7 +1715,7 @@ fn imply-converter (vQT T static?)
         return `_
     if (ptrcmp== T bool)
         try
-            return ('@ vT '__tobool)
+            return (speculate sc_type_at vT '__tobool)
         except (err)
     if static?
         let conv =
@@ -1714,7 +1731,7 @@ fn as-converter (vQT T static?)
         return `_
     if (ptrcmp== T bool)
         try
-            return ('@ vT '__tobool)
+            return (speculate sc_type_at vT '__tobool)
         except (err)
     let conv = (cast-converter '__as '__ras vQT T)
     if (operator-valid? conv) (return conv)
@@ -1751,7 +1768,7 @@ fn unary-operator (symbol T)
         macro.
     label next
         let f =
-            try ('@ T symbol)
+            try (speculate sc_type_at T symbol)
             except (err) (merge next)
         let op = (sc_prove `(f T))
         if (operator-valid? op) (return op)
@@ -1765,7 +1782,7 @@ fn binary-operator (symbol qlhsT qrhsT)
     let rhsT = ('strip-qualifiers qrhsT)
     label next
         let f =
-            try ('@ lhsT symbol)
+            try (speculate sc_type_at lhsT symbol)
             except (err) (merge next)
         let op = (sc_prove `(f qlhsT qrhsT))
         if (operator-valid? op) (return op)
@@ -1781,7 +1798,7 @@ fn binary-operator-r (rsymbol lhsT rhsT)
     let rhsT = ('strip-qualifiers rhsT)
     label next
         let f =
-            try ('@ rhsT rsymbol)
+            try (speculate sc_type_at rhsT rsymbol)
             except (err) (merge next)
         let op = (sc_prove `(f lhsT rhsT))
         if (operator-valid? op) (return op)
@@ -1907,7 +1924,7 @@ fn unbalanced-binary-operation (args symbol rtype friendly-op-name)
             else
                 cast-error "can't coerce secondary argument of type " rhsT rtype
     let f =
-        try ('@ lhsT symbol)
+        try (speculate sc_type_at lhsT symbol)
         except (err)
             unary-op-error friendly-op-name lhsT
     'tag `(f lhs rhs) ('anchor args)
@@ -1919,7 +1936,7 @@ fn unary-operation (args symbol friendly-op-name)
     let u = ('getarg args 0)
     let T = ('typeof u)
     let f =
-        try ('@ T symbol)
+        try (speculate sc_type_at T symbol)
         except (err)
             hide-traceback;
             unary-op-error friendly-op-name T
@@ -2379,7 +2396,7 @@ inline intdiv (a b)
                 let self = (unbox-pointer self type)
                 let key = (unbox-symbol key Symbol)
                 let f =
-                    try ('@ self '__typeattr)
+                    try (speculate sc_type_at self '__typeattr)
                     else
                         hide-traceback;
                         return (sc_type_at self key)
@@ -2536,7 +2553,7 @@ let getattr =
             let sym = (unbox-symbol rhs Symbol)
             label skip-accessor-lookup
                 let prop =
-                    try ('@ lhsT sym)
+                    try (speculate sc_type_at lhsT sym)
                     else (merge skip-accessor-lookup)
                 if (ptrcmp!= ('typeof prop) Accessor)
                     merge skip-accessor-lookup;
@@ -2547,7 +2564,7 @@ let getattr =
                 return
                     'tag `(prop lhs rhs) ('anchor args)
             let f =
-                try ('@ lhsT '__getattr)
+                try (speculate sc_type_at lhsT '__getattr)
                 else
                     # produce a more helpful error message
                     '@ lhsT sym
@@ -2603,11 +2620,11 @@ let tostring =
             let value = ('getarg args 0)
             let T = ('typeof value)
             try
-                let f = ('@ T '__tostring)
+                let f = (speculate sc_type_at T '__tostring)
                 `(f value)
             else
                 try
-                    let f = (sc_type_at T '__repr)
+                    let f = (speculate sc_type_at T '__repr)
                     `(f value)
                 else
                     if ('constant? value)
@@ -2999,13 +3016,13 @@ fn pointer-type-imply? (src dest)
         # try dispatch
         label next
             let f =
-                try ('@ ET '__pointer-imply?)
+                try (speculate sc_type_at ET '__pointer-imply?)
                 except (err) (merge next)
             return (as (sc_prove `(f src dest)) bool)
         let ET = ('element@ dest 0)
         label next
             let f =
-                try ('@ ET '__pointer-rimply?)
+                try (speculate sc_type_at ET '__pointer-rimply?)
                 except (err) (merge next)
             return (as (sc_prove `(f dest src)) bool)
     return false
@@ -3288,7 +3305,7 @@ fn list-handler (topexpr env)
         let expr env =
             try
                 hide-traceback;
-                head topexpr env
+                sc_sugar_macro_call (bitcast head SugarMacroFunction) topexpr env
             except (err)
                 hide-traceback;
                 let msg = `"while expanding sugar macro"
@@ -3457,6 +3474,49 @@ fn rtl-multiop (args target mincount)
                 _ i op
         'anchor args
 
+# joins more than two strings, of which some are only known at runtime, in a
+  single call, which interns only the final string rather than each partial
+  result of joining them pair by pair
+fn join-multiop (args)
+    raising Error
+    let argc = ('argcount args)
+    let strings? =
+        loop (i dynamic? = 0 false)
+            if (== i argc)
+                break dynamic?
+            let arg = ('getarg args i)
+            if (icmp== ('kind arg) value-kind-const-string)
+                _ (add i 1) dynamic?
+            elseif (ptrcmp== (sc_strip_qualifiers ('typeof arg)) string)
+                _ (add i 1) true
+            else
+                break false
+    if (icmp<=s argc 2)
+        return (rtl-multiop args `.. 2)
+    if strings?
+        return
+            'tag
+                spice-quote
+                    let strings = (alloca-array string argc)
+                    spice-unquote
+                        let body = (sc_expression_new)
+                        loop (i = 0)
+                            if (icmp== i argc)
+                                break;
+                            let arg = ('getarg args i)
+                            let arg =
+                                if (icmp== ('kind arg) value-kind-const-string)
+                                    sc_const_pointer_new string
+                                        bitcast (sc_const_string_extract arg) voidstar
+                                else arg
+                            sc_expression_append body
+                                `(store arg (getelementptr strings i))
+                            add i 1
+                        body
+                    sc_string_join_many argc (bitcast strings StringArrayPointer)
+                'anchor args
+    rtl-multiop args `.. 2
+
 # extracting options from varargs
 
 # (va-option-branch key elsef args...)
@@ -3491,6 +3551,34 @@ let modules = (sc_global_new 'modules Scope 0:u32 'Private)
 sc_global_set_initializer modules `[(Scope)]
 let modules = `(ptrtoref modules)
 
+""""`module-dependents` maps the full path of every imported module to a
+    scope whose keys are the paths of the modules that imported it, and
+    `module-mtimes` maps it to the modification time its file had when it
+    was loaded. `loading-module` is the path of the module that is presently
+    being loaded.
+
+    these symbols are private to core.
+let module-dependents = (sc_global_new 'module-dependents Scope 0:u32 'Private)
+sc_global_set_initializer module-dependents `[(Scope)]
+let module-dependents = `(ptrtoref module-dependents)
+let module-mtimes = (sc_global_new 'module-mtimes Scope 0:u32 'Private)
+sc_global_set_initializer module-mtimes `[(Scope)]
+let module-mtimes = `(ptrtoref module-mtimes)
+let loading-module = (sc_global_new 'loading-module Symbol 0:u32 'Private)
+sc_global_set_initializer loading-module `[unnamed]
+let loading-module = `(ptrtoref loading-module)
+
+""""`module-paths` maps every module name that was looked up, or the base
+    directory and name of a relative import, to a list of the search path
+    it was looked up in and the full path it was found at, which is empty
+    if it wasn't found. Lookups with the same search path resolve to the
+    same path, without searching the file system again.
+
+    this symbol is private to core.
+let module-paths = (sc_global_new 'module-paths Scope 0:u32 'Private)
+sc_global_set_initializer module-paths `[(Scope)]
+let module-paths = `(ptrtoref module-paths)
+
 """"`__env` is a special symbol table of type `Scope` describing the module
     environment. `import`, `include` and `shared-library` depend on its
     contents. Modules imported with `import` inherit the environment presently
@@ -3748,7 +3836,7 @@ let
     define-infix> = (sugar-scope-macro (make-expand-define-infix '>))
     define-infix< = (sugar-scope-macro (make-expand-define-infix '<))
     define-infix* = (sugar-scope-macro (make-expand-define-infix '*))
-    .. = (spice-macro (fn (args) (rtl-multiop args `.. 2)))
+    .. = (spice-macro join-multiop)
     + = (spice-macro (fn (args) (ltr-multiop args `+ 2)))
     * = (spice-macro (fn (args) (ltr-multiop args `* 2)))
     @ = (spice-macro (fn (args) (ltr-multiop args `@ 1)))
@@ -4132,6 +4220,65 @@ define for
 # hashing
 #---------------------------------------------------------------------------
 
+# XXH64 of values of up to 8 bytes, computing the same hashes as sc_hash and
+  sc_hash2x64 do, so that hashing fixed size values inlines to a handful of
+  multiplies and shifts instead of an opaque call into the runtime.
+let xxh64-u64 xxh64-hash2 =
+    do
+        let P1 = 0x9e3779b185ebca87:u64
+        let P2 = 0xc2b2ae3d27d4eb4f:u64
+        let P3 = 0x165667b19e3779f9:u64
+        let P4 = 0x85ebca77c2b2ae63:u64
+        let P5 = 0x27d4eb2f165667c5:u64
+        # the seed used by hash_bytes in src/hash.cpp
+        let seed = 0x2a47eba5d9afb4ef:u64
+
+        inline rotl (x r)
+            bor (shl x r) (lshr x (sub 64:u64 r))
+
+        inline round (input)
+            mul (rotl (mul input P2) 31:u64) P1
+
+        inline avalanche (h)
+            let h = (mul (bxor h (lshr h 33:u64)) P2)
+            let h = (mul (bxor h (lshr h 29:u64)) P3)
+            bxor h (lshr h 32:u64)
+
+        inline process1 (h byte)
+            mul (rotl (bxor h (mul byte P5)) 11:u64) P1
+
+        inline process4 (h word)
+            add (mul (rotl (bxor h (mul word P1)) 23:u64) P2) P3
+
+        inline process8 (h k)
+            add (mul (rotl (bxor h (round k)) 27:u64) P1) P4
+
+        # hashes the low size bytes of value; size is a constant of at most 8,
+          so all branches fold away
+        inline xxh64-u64 (value size)
+            let h = (add (add seed P5) (bitcast size u64))
+            if (size == 8:usize)
+                avalanche (process8 h value)
+            else
+                let word? = (size >= 4:usize)
+                let h = (? word? (process4 h (band value 0xffffffff:u64)) h)
+                let value = (? word? (lshr value 32:u64) value)
+                let count = (? word? (sub size 4:usize) size)
+                avalanche
+                    loop (h value count = h value count)
+                        if (count == 0:usize)
+                            break h
+                        _ (process1 h (band value 0xff:u64)) (lshr value 8:u64)
+                            sub count 1:usize
+
+        inline xxh64-hash2 (a b)
+            if ((band a b) == 0:u64)
+                xxh64-u64 (bor a b) 8:usize
+            else
+                add (mul (bxor a (round b)) P1) P4
+
+        _ xxh64-u64 xxh64-hash2
+
 let hash-storage =
     spice-macro
         fn "hash-storage" (args)
@@ -4143,6 +4290,9 @@ let hash-storage =
                 if ('opaque? OT) OT
                 else ('storageof OT)
             let bits = ('bitcount T)
+            let size = ('sizeof T)
+            # sc_hash never hashes more than the first 8 bytes of a value
+            let size = (? (size > 8:usize) 8:usize size)
             if (bits <= 64)
                 let conv_u64 =
                     switch ('kind T)
@@ -4158,17 +4308,17 @@ let hash-storage =
                         else
                             error
                                 .. "can't hash storage of type " (repr OT)
-                `(bitcast (sc_hash conv_u64 [('sizeof T)]) hash)
+                `(bitcast (xxh64-u64 conv_u64 [size]) hash)
             else
                 let chunk-count = ((bits + (64 - 1)) // 64)
-                let first-chunk = `(sc_hash (itrunc value u64) [('sizeof T)])
+                let first-chunk = `(xxh64-u64 (itrunc value u64) [size])
                 let hash-chain =
                     loop (chunk-index computed = 1 first-chunk)
                         if (chunk-index == chunk-count)
                             break computed
                         let chunk =
-                            `(sc_hash (itrunc (value >> (64 * chunk-index)) u64) [('sizeof T)])
-                        _ (chunk-index + 1) `(sc_hash2x64 computed chunk)
+                            `(xxh64-u64 (itrunc (value >> (64 * chunk-index)) u64) [size])
+                        _ (chunk-index + 1) `(xxh64-hash2 computed chunk)
 
                 `(bitcast hash-chain hash)
 
@@ -4196,7 +4346,7 @@ let hash-storage =
         do
             inline hash2 (a b)
                 bitcast
-                    sc_hash2x64
+                    xxh64-hash2
                         bitcast (hash1 a) u64
                         bitcast (hash1 b) u64
                     hash
@@ -4282,24 +4432,34 @@ fn exec-module (expr eval-scope)
                 tostring `[(sc_anchor_lineno expr-anchor)]
         sc_template_set_name wrapf (Symbol path)
         let wrapf = (sc_typify_template wrapf 0 (undef TypeArrayPointer))
-        let f =
-            do
-                hide-traceback;
-                sc_compile wrapf compile-flag-module
-        if (('typeof f) == StageFunctionType)
-            let fptr = (f as StageFunctionType)
-            let result =
+        let stage? = (('typeof wrapf) == StageFunctionType)
+        let result =
+            # stages that only build their scope are run without generating
+              code for them
+            if (sc_function_is_interpretable wrapf)
                 do
                     hide-traceback;
-                    fptr;
-            let result = (bitcast result Value)
+                    sc_interpret wrapf
+            else
+                let f =
+                    do
+                        hide-traceback;
+                        sc_compile wrapf compile-flag-module
+                if stage?
+                    let fptr = (f as StageFunctionType)
+                    let result =
+                        do
+                            hide-traceback;
+                            fptr;
+                    bitcast result Value
+                else
+                    let fptr = (f as ModuleFunctionType)
+                    do
+                        hide-traceback;
+                        fptr;
+        if stage?
             repeat result ('anchor result)
         else
-            let fptr = (f as ModuleFunctionType)
-            let result =
-                do
-                    hide-traceback;
-                    fptr;
             break result
 
 let slash-char = 47:char # "/"
@@ -4329,6 +4489,73 @@ fn dots-to-slashes (pattern)
             repeat (i + 1:usize) (i + 1:usize)
                 .. result (rslice (lslice pattern i) start) "/"
 
+fn patterns-from-namestr (base-dir namestr env)
+    # if namestr starts with a slash (because it started with a dot),
+        we only search base-dir
+    if ((@ namestr 0:usize) == slash-char)
+        list
+            .. base-dir str"?.sc"
+            .. base-dir str"?/init.sc"
+    else
+        ('@ env 'module-search-path) as list
+
+# returns the module name of a top level `import` or `using import` form, or
+  an empty string if form is neither
+fn import-form-name (form)
+    if (('typeof form) != list)
+        return ""
+    let args = (form as list)
+    if (empty? args)
+        return ""
+    let head rest = (decons args)
+    let head rest =
+        if ((('typeof head) == Symbol) and ((head as Symbol) == 'using))
+            if (empty? rest)
+                return ""
+            decons rest
+        else
+            _ head rest
+    if (not ((('typeof head) == Symbol) and ((head as Symbol) == 'import)))
+        return ""
+    if (empty? rest)
+        return ""
+    let sxname = (decons rest)
+    if (('kind sxname) == value-kind-const-string)
+        sxname as string
+    elseif (('typeof sxname) == Symbol)
+        (sxname as Symbol) as string
+    else ""
+
+# start parsing the modules that are imported at the top level of expr and
+  not loaded yet on worker threads, so that they are ready by the time the
+  imports run
+fn prefetch-imports (expr module-dir env)
+    loop (forms = (expr as list))
+        if (empty? forms)
+            break;
+        let form forms = (decons forms)
+        let name = (import-form-name form)
+        if (empty? name)
+            repeat forms
+        let namestr = (dots-to-slashes name)
+        loop (patterns = (patterns-from-namestr module-dir namestr env))
+            if (empty? patterns)
+                break;
+            let pattern patterns = (decons patterns)
+            let module-path =
+                sc_realpath (make-module-path (pattern as string) namestr)
+            if ((empty? module-path) or (not (sc_is_file module-path)))
+                repeat patterns
+            let loaded? =
+                try
+                    '@ (deref modules) (Symbol module-path)
+                    true
+                except (err) false
+            if (not loaded?)
+                sc_prefetch_module module-path
+            break;
+        repeat forms
+
 fn load-module (module-name module-path env opts...)
     let command = (va-option command opts...)
     let command? = (not (none? command))
@@ -4351,6 +4578,7 @@ fn load-module (module-name module-path env opts...)
             inline ()
                 hide-traceback;
                 sc_parse_from_path module-path
+    prefetch-imports expr module-dir env
     let eval-scope =
         'bind-symbols
             va-option scope opts...
@@ -4372,93 +4600,170 @@ fn load-module (module-name module-path env opts...)
             else
                 "while loading module " .. module-path
 
-fn patterns-from-namestr (base-dir namestr env)
-    # if namestr starts with a slash (because it started with a dot),
-        we only search base-dir
-    if ((@ namestr 0:usize) == slash-char)
-        list
-            .. base-dir str"?.sc"
-            .. base-dir str"?/init.sc"
-    else
-        ('@ env 'module-search-path) as list
-
 inline slice (value start end)
     rslice (lslice value end) start
 
+# returns the full path of the first module of name namestr that is in the
+  search path, or is already loaded, or an empty string if there is none
+fn resolve-module-path (base-dir namestr patterns)
+    let key =
+        if ((@ namestr 0:usize) == slash-char) (Symbol (.. base-dir namestr))
+        else (Symbol namestr)
+    let cached =
+        try (('@ (deref module-paths) key) as list)
+        except (err) '()
+    if (not (empty? cached))
+        let cached-patterns path = (decons cached 2)
+        if ((cached-patterns as list) == patterns)
+            return (path as string)
+    let module-path =
+        loop (patterns = patterns)
+            if (empty? patterns)
+                break str""
+            let pattern patterns = (decons patterns)
+            let pattern = (pattern as string)
+            let module-path = (sc_realpath (make-module-path pattern namestr))
+            if (empty? module-path)
+                repeat patterns
+            let loaded? =
+                try
+                    '@ (deref modules) (Symbol module-path)
+                    true
+                except (err) false
+            if (loaded? or (sc_is_file module-path))
+                break module-path
+            repeat patterns
+    module-paths =
+        'bind (deref module-paths) key (list patterns module-path)
+    module-path
+
+# raises the error of a module that isn't in any of the paths of patterns
+fn module-not-found (what name namestr patterns)
+    hide-traceback;
+    error
+        .. "failed to " what " module '" (repr name) "'\n"
+            \ "no such module '" (as name string) "' in paths:"
+            loop (patterns str = patterns str"")
+                if (empty? patterns)
+                    break str
+                let pattern patterns = (decons patterns)
+                let pattern = (pattern as string)
+                let module-path = (make-module-path pattern namestr)
+                repeat patterns
+                    .. str "\n"  "    " module-path
+
 fn find-module-path (base-dir name env)
     #assert-typeof name Symbol
     let namestr = (dots-to-slashes (name as string))
     let all-patterns = (patterns-from-namestr base-dir namestr env)
-    loop (patterns = all-patterns)
-        if (empty? patterns)
-            hide-traceback;
-            error
-                .. "failed to find module '" (repr name) "'\n"
-                    \ "no such module '" (as name string) "' in paths:"
-                    loop (patterns str = all-patterns str"")
-                        if (empty? patterns)
-                            break str
-                        let pattern patterns = (decons patterns)
-                        let pattern = (pattern as string)
-                        let module-path = (make-module-path pattern namestr)
-                        repeat patterns
-                            .. str "\n"  "    " module-path
-        let pattern patterns = (decons patterns)
-        let pattern = (pattern as string)
-        let module-path = (sc_realpath (make-module-path pattern namestr))
-        if (empty? module-path)
-            repeat patterns
-        if (not (sc_is_file module-path))
-            repeat patterns
-        return module-path
+    let module-path = (resolve-module-path base-dir namestr all-patterns)
+    if (empty? module-path)
+        hide-traceback;
+        module-not-found "find" name namestr all-patterns
+    module-path
 
 fn require-from (base-dir name env)
     #assert-typeof name Symbol
     let namestr = (dots-to-slashes (name as string))
     let all-patterns = (patterns-from-namestr base-dir namestr env)
-    loop (patterns = all-patterns)
-        if (empty? patterns)
-            hide-traceback;
+    let module-path = (resolve-module-path base-dir namestr all-patterns)
+    if (empty? module-path)
+        hide-traceback;
+        module-not-found "import" name namestr all-patterns
+    let module-path-sym = (Symbol module-path)
+    fn get-modules () (deref modules)
+    fn get-modules-path (symbol) ('@ (get-modules) symbol)
+    fn set-modules-path (symbol value)
+        modules =
+            'bind (get-modules) symbol value
+    fn add-module-dependent (symbol)
+        let parent = (deref loading-module)
+        if (parent != unnamed)
+            let dependents = (deref module-dependents)
+            let parents =
+                try (('@ dependents symbol) as Scope)
+                except (err) (Scope)
+            module-dependents =
+                'bind dependents symbol ('bind parents parent true)
+    add-module-dependent module-path-sym
+    let content =
+        try (get-modules-path module-path-sym)
+        except (err)
+            set-modules-path module-path-sym incomplete
+            module-mtimes =
+                'bind (deref module-mtimes) module-path-sym
+                    sc_file_mtime module-path
+            let parent = (deref loading-module)
+            loading-module = module-path-sym
+            let content =
+                try
+                    hide-traceback;
+                    load-module (name as string) module-path env
+                except (err)
+                    loading-module = parent
+                    raise err
+            loading-module = parent
+            set-modules-path module-path-sym content
+            return content
+    if (('typeof content) == type)
+        if (content == incomplete)
             error
-                .. "failed to import module '" (repr name) "'\n"
-                    \ "no such module '" (as name string) "' in paths:"
-                    loop (patterns str = all-patterns str"")
-                        if (empty? patterns)
-                            break str
-                        let pattern patterns = (decons patterns)
-                        let pattern = (pattern as string)
-                        let module-path = (make-module-path pattern namestr)
-                        repeat patterns
-                            .. str "\n"  "    " module-path
-        let pattern patterns = (decons patterns)
-        let pattern = (pattern as string)
-        let module-path = (sc_realpath (make-module-path pattern namestr))
-        if (empty? module-path)
-            repeat patterns
-        let module-path-sym = (Symbol module-path)
-        fn get-modules () (deref modules)
-        fn get-modules-path (symbol) ('@ (get-modules) symbol)
-        fn set-modules-path (symbol value)
-            modules =
-                'bind (get-modules) symbol value
-        let content =
-            try (get-modules-path module-path-sym)
-            except (err)
-                if (not (sc_is_file module-path))
-                    repeat patterns
-                set-modules-path module-path-sym incomplete
-                let content =
-                    do
-                        hide-traceback;
-                        load-module (name as string) module-path env
-                set-modules-path module-path-sym content
-                return content
-        if (('typeof content) == type)
-            if (content == incomplete)
-                error
-                    .. "trying to import module " (repr name)
-                        " while it is being imported"
-        return content
+                .. "trying to import module " (repr name)
+                    " while it is being imported"
+    content
+
+""""Removes the module at the full path `module-path` and every module that
+    imported it, directly or indirectly, from the module cache. The next
+    import of any of them loads it again from source, while all other
+    modules stay loaded. Functions of the reloaded modules whose contents
+    did not change reuse their previous specializations. Modules are looked
+    up in the search path again, in case files were added or removed.
+    Returns the number of modules removed.
+fn invalidate-module (module-path)
+    # the reloaded modules may reuse what was proven for their previous
+    # contents
+    sc_advance_fingerprint_epoch;
+    # module files may have been added or removed as well
+    module-paths = (Scope)
+    let dependents = (deref module-dependents)
+    loop (pending count = (list (Symbol module-path)) 0)
+        if (empty? pending)
+            break count
+        let key pending = (decons pending)
+        let key = (key as Symbol)
+        let loaded? =
+            try
+                '@ (deref modules) key
+                true
+            except (err) false
+        if (not loaded?)
+            repeat pending count
+        modules = ('unbind (deref modules) key)
+        module-mtimes = ('unbind (deref module-mtimes) key)
+        let parents =
+            try (('@ dependents key) as Scope)
+            except (err) (Scope)
+        let pending =
+            loop (last-index pending = -1 pending)
+                let parent value index = ('next parents last-index)
+                if (index < 0)
+                    break pending
+                repeat index (cons parent pending)
+        repeat pending (count + 1)
+
+""""Removes every module whose file has changed since it was loaded from the
+    module cache, together with the modules that depend on it, as with
+    `invalidate-module`. Returns the number of modules removed.
+fn invalidate-changed-modules ()
+    let mtimes = (deref module-mtimes)
+    loop (last-index count = -1 0)
+        let key mtime index = ('next mtimes last-index)
+        if (index < 0)
+            break count
+        let path = (key as Symbol as string)
+        if ((sc_file_mtime path) == (mtime as u64))
+            repeat index count
+        repeat index (count + (invalidate-module path))
 
 let import =
     sugar-scope-macro
@@ -4990,6 +5295,16 @@ let parse-compile-flags =
                         \ " " (repr 'dump-function)
                         \ " " (repr 'dump-time)
                         \ " " (repr 'no-debug-info)
+                        \ " " (repr 'line-tables-only)
+                        \ " " (repr 'parallel)
+                        \ " " (repr 'lazy)
+                        \ " " (repr 'tiered)
+                        \ " " (repr 'release)
+                        \ " " (repr 'profile-generate)
+                        \ " " (repr 'profile-use)
+                        \ " " (repr 'quick)
+                        \ " " (repr 'c-abi)
+                        \ " " (repr 'chunked)
                         \ " " (repr 'O0)
                         \ " " (repr 'O1)
                         \ " " (repr 'O2)
@@ -5007,6 +5322,16 @@ let parse-compile-flags =
                     case 'dump-function compile-flag-dump-function
                     case 'dump-time compile-flag-dump-time
                     case 'no-debug-info compile-flag-no-debug-info
+                    case 'line-tables-only compile-flag-line-tables-only
+                    case 'parallel compile-flag-parallel
+                    case 'lazy compile-flag-lazy
+                    case 'tiered compile-flag-tiered
+                    case 'release compile-flag-release
+                    case 'profile-generate compile-flag-profile-generate
+                    case 'profile-use compile-flag-profile-use
+                    case 'quick compile-flag-quick
+                    case 'c-abi compile-flag-c-abi
+                    case 'chunked compile-flag-chunked
                     case 'O0 compile-flag-O0
                     case 'O1 compile-flag-O1
                     case 'O2 compile-flag-O2
@@ -5030,6 +5355,31 @@ spice-quote
     inline compile-object-to-buffer (target file-kind module-name table flags...)
         sc_compile_object_to_buffer target file-kind module-name table (parse-compile-flags flags...)
 
+    inline set-object-target-cpu (cpu features)
+        """"Selects the cpu and the comma separated list of features, such as
+            `"+simd128,+bulk-memory,+atomics"` for `wasm32-unknown-unknown`,
+            that `compile-object` generates code for. A `cpu` of `"native"`
+            selects the host cpu and, if `features` is empty, its features,
+            for targets of the architecture of the host only.
+        sc_set_object_target_cpu cpu features
+
+    inline thin-link-objects (target inputs output-prefix flags...)
+        """"Runs ThinLTO across the list of bitcode files `inputs`, which were
+            written by `compile-object` with `compiler-file-kind-thin-bc`, and
+            writes the object for the input at index `i` to
+            `output-prefix .. "." .. (tostring i) .. ".o"`. Units are optimized
+            in parallel, with cross-module inlining.
+        sc_thin_link_objects target inputs output-prefix (parse-compile-flags flags...)
+
+    inline link-objects (target inputs path)
+        """"Links the list of object files and libraries `inputs`, such as the
+            objects written by `compile-object` with
+            `compiler-file-kind-object` or `thin-link-objects`, into a shared
+            library at `path`, with the linker built into the compiler, which
+            matches the object format of `target`. Strings in `inputs` that
+            begin with `-` are passed to the linker as options.
+        sc_link_objects target inputs path
+
 inline convert-assert-args (args cond msg)
     if ((countof args) == 2) msg
     else
@@ -5049,6 +5399,50 @@ define-sugar-macro assert
     let msg = (convert-assert-args args cond msg)
     list __assert cond (list inline '() msg)
 
+""""A boolean constant that is false if the compiler was started with the
+    environment variable `SCOPES_UNCHECKED` set to a value other than `0`,
+    which compiles the bounds checks of the `@` operator of containers out,
+    as if every access used `unchecked@`.
+let bounds-checks? =
+    do
+        let value = (sc_getenv "SCOPES_UNCHECKED")
+        (value == "") or (value == "0")
+
+""""A boolean constant that is true if the compiler was started with the
+    environment variable `SCOPES_ALLOC_PROFILE` set to a value other than
+    `0`, which makes `DefaultAllocator` count the allocations of every
+    calling function and element type.
+let alloc-profile? =
+    do
+        let value = (sc_getenv "SCOPES_ALLOC_PROFILE")
+        not ((value == "") or (value == "0"))
+
+# indexes with the __unchecked@ method of the type, or with @
+let unchecked-at =
+    spice-macro
+        fn (args)
+            let argc = ('argcount args)
+            verify-count argc 2 2
+            let self index =
+                'getarg args 0
+                'getarg args 1
+            let T = ('strip-qualifiers ('typeof self))
+            try
+                let f = (sc_type_at T '__unchecked@)
+                `(f self index)
+            except (err)
+                `(@ self index)
+
+""""Returns the element at `index` of `self` like `@`, but without checking
+    that `index` is in bounds; further indices select nested elements. Types
+    opt in by implementing `__unchecked@`; all other values are indexed by
+    `@`. A module can opt out of bounds checks as a whole by rebinding `@`:
+
+        :::scopes
+        let @ = unchecked@
+let unchecked@ =
+    spice-macro (fn (args) (ltr-multiop args `unchecked-at 2))
+
 define-sugar-macro while
     let cond body = (decons args)
     list loop '()
@@ -5533,7 +5927,7 @@ fn vector-binary-operator (symbol lhsT rhsT)
         if (ptrcmp== lhsT rhsT)
             let ET = ('element@ lhsT 0)
             let f =
-                try ('@ ET symbol)
+                try (speculate sc_type_at ET symbol)
                 except (err)
                     merge next
             return f
@@ -5827,6 +6221,7 @@ let extern =
                             elseif (k == 'restrict) global-flag-restrict
                             elseif (k == 'block) global-flag-block
                             elseif (k == 'thread-local) global-flag-thread-local
+                            elseif (k == 'spec-constant) global-flag-spec-constant
                             else
                                 error ("unrecognized flag: " .. (repr k))
                         _ (bor flags newflag) storage-class location binding set
@@ -6520,6 +6915,64 @@ spice memocall (f args...)
         sc_map_set key value
         value
 
+# marks a sugar macro as pure: its result depends only on the expression
+# and scope it is invoked with, so the expander may reuse the result of an
+# earlier expansion of the same expression in the same scope.
+spice pure-sugar (f)
+    let m = (f as SugarMacro)
+    sc_sugar_macro_set_pure (bitcast m SugarMacroFunction)
+    f
+
+spice apply-fast-math (f flags)
+    let tmpl = (sc_closure_get_template (f as Closure))
+    sc_template_set_fast_math tmpl (flags as u32)
+    f
+
+# relaxes the IEEE floating point rules for the instructions of a function;
+# as a decorator, `@@ fast-math` relaxes all of them, and
+# `@@ fast-math 'contract 'reassoc` only the named ones.
+let fast-math =
+    spice-macro
+        fn "fast-math" (args)
+            inline flag-error (flag)
+                error
+                    .. "illegal flag: " (repr flag)
+                        ". try one of"
+                        \ " " (repr 'reassoc)
+                        \ " " (repr 'contract)
+                        \ " " (repr 'arcp)
+                        \ " " (repr 'nnan)
+                        \ " " (repr 'ninf)
+                        \ " " (repr 'nsz)
+                        \ " " (repr 'afn)
+                        \ " " (repr 'fast)
+            let argc = ('argcount args)
+            if (argc == 1)
+                let f = ('getarg args 0)
+                if (('typeof f) == Closure)
+                    return `(apply-fast-math f fast-math-flag-fast)
+            let flags =
+                loop (i flags = 0 0:u32)
+                    if (i == argc)
+                        break `flags
+                    let arg = ('getarg args i)
+                    let flag = (arg as Symbol)
+                    let flag =
+                        switch flag
+                        case 'reassoc fast-math-flag-reassoc
+                        case 'contract fast-math-flag-contract
+                        case 'arcp fast-math-flag-arcp
+                        case 'nnan fast-math-flag-nnan
+                        case 'ninf fast-math-flag-ninf
+                        case 'nsz fast-math-flag-nsz
+                        case 'afn fast-math-flag-afn
+                        case 'fast fast-math-flag-fast
+                        default (flag-error flag)
+                    _ (i + 1) (flags | flag)
+            spice-quote
+                inline "fast-math" (f)
+                    apply-fast-math f flags
+
 #-------------------------------------------------------------------------------
 # static-compile*
 #-------------------------------------------------------------------------------
@@ -6675,7 +7128,23 @@ spice overloaded-fn-append (T args...)
             let ftypes = ('@ T 'parameter-types)
             let fdefaults = ('@ T 'parameter-defaults)
             let count = ('argcount args...)
-            for f FT defs in (zip ('args fns) (zip ('args ftypes) ('args fdefaults)))
+            # options are only ever appended, so the first option matching a
+            # signature stays the same as long as the option count does
+            let key =
+                loop (i key = 0 (sc_argument_list_join_values `() cls `[('argcount fns)]))
+                    if (i == count)
+                        break (sc_prove key)
+                    let arg = ('getarg args... i)
+                    repeat (i + 1)
+                        sc_argument_list_join_values key
+                            `[('qualified-typeof arg)]
+                            `[('constant? arg)]
+            let cached =
+                try ((speculate sc_map_get key) as i32)
+                except (err) -1
+            for k f FT defs in (enumerate (zip ('args fns) (zip ('args ftypes) ('args fdefaults))))
+                if ((cached >= 0) & (k != cached))
+                    continue;
                 let FT = (FT as type)
                 let has-defs? = (('typeof defs) != Nothing)
                 let defs =
@@ -6686,39 +7155,41 @@ spice overloaded-fn-append (T args...)
                     (argcount > 0) and
                         ((sc_arguments_type_getarg FT (argcount - 1)) == Variadic)
                 let defcount = ('argcount defs)
-                if has-defs?
-                    assert (argcount <= defcount)
-                        "number of defaults must match number of arguments"
-                    if ((not variadic?) & (count > argcount))
-                        continue;
-                elseif variadic?
-                    if ((count + 1) < argcount)
-                        continue;
-                elseif (count != argcount)
-                    continue;
-                let failed = (ptrtoref (alloca bool))
-                failed = false
                 let explicit-argcount = (? variadic? (argcount - 1) argcount)
-                for i in (range explicit-argcount)
-                    inline no-match ()
-                        failed = true
-                        break;
-                    let arg =
-                        if (i < count) ('getarg args... i)
-                        elseif has-defs?
-                            let arg = ('getarg defs i)
-                            if (nodefault? arg) # argument missing
-                                no-match;
+                if (cached < 0)
+                    if has-defs?
+                        assert (argcount <= defcount)
+                            "number of defaults must match number of arguments"
+                        if ((not variadic?) & (count > argcount))
                             continue;
-                        else
+                    elseif variadic?
+                        if ((count + 1) < argcount)
+                            continue;
+                    elseif (count != argcount)
+                        continue;
+                    let failed = (ptrtoref (alloca bool))
+                    failed = false
+                    for i in (range explicit-argcount)
+                        inline no-match ()
+                            failed = true
+                            break;
+                        let arg =
+                            if (i < count) ('getarg args... i)
+                            elseif has-defs?
+                                let arg = ('getarg defs i)
+                                if (nodefault? arg) # argument missing
+                                    no-match;
+                                continue;
+                            else
+                                no-match;
+                        let qargT = ('qualified-typeof arg)
+                        let qparamT = (sc_arguments_type_getarg FT i)
+                        let argT = ('strip-qualifiers qargT)
+                        if (not (spice-typematch? qparamT qargT ('constant? arg)))
                             no-match;
-                    let qargT = ('qualified-typeof arg)
-                    let qparamT = (sc_arguments_type_getarg FT i)
-                    let argT = ('strip-qualifiers qargT)
-                    if (not (spice-typematch? qparamT qargT ('constant? arg)))
-                        no-match;
-                if failed
-                    continue;
+                    if failed
+                        continue;
+                    sc_map_set key `k
                 # success, generate call
                 let lasti = (argcount - 1)
                 let outargs = ('tag (sc_call_new f) ('anchor args))
@@ -7209,6 +7680,7 @@ let
     decorate-typedef = decorate-fn
     decorate-type = decorate-fn
     decorate-struct = decorate-fn
+    decorate-sugar = decorate-fn
 
 define-sugar-macro decorate-let
     raising Error
@@ -7272,6 +7744,7 @@ define-sugar-scope-macro sugar-eval
 
 let
     io-write! = sc_write
+    io-flush! = sc_flush
     compiler-version = sc_compiler_version
     default-styler = sc_default_styler
     realpath = sc_realpath
@@ -7282,8 +7755,10 @@ let
     exit = sc_exit
     launch-args = sc_launch_args
     set-signal-abort! = sc_set_signal_abort
+    set-optimization-pipeline! = sc_set_optimization_pipeline
     list-load = sc_parse_from_path
     list-parse = sc_parse_from_string
+    list-reparse = sc_parse_incremental
     #eval = sc_eval
     load-library = sc_load_library
     load-object = sc_load_object
@@ -7293,6 +7768,22 @@ spice static-library (path)
     sc_load_library path
     ;
 
+""""Returns a constant array of elements of the plain type `T` that holds
+    the bytes of the string constant `data`. Unlike an array constant, the
+    array is stored and emitted as a single block of bytes.
+spice blob (T data)
+    T as:= type
+    data as:= string
+    sc_const_blob_new T data
+
+""""Returns a constant array of elements of the plain type `T` that holds
+    the contents of the file at `path`, which is read at compile time. The
+    size of the file must be a multiple of the size of `T`.
+spice blob-file (T path)
+    T as:= type
+    path as:= string
+    sc_const_blob_from_path T path
+
 sugar fold-locals (args...)
     fn stage-constant? (value)
         ('pure? value) and (('typeof value) != SpiceMacro)
@@ -8094,16 +8585,18 @@ sugar include (args...)
 
     let modulename = (('@ sugar-scope 'module-path) as string)
     let env = (('@ sugar-scope '__env) as Scope)
-    loop (args modulename ext opts includestr scope = args... modulename str".c" '() str"" (nullof Scope))
+    loop (args modulename ext opts includestr scope lazy = args... modulename str".c" '() str"" (nullof Scope) false)
         sugar-match args
         case (('using name) rest...)
             let value = ((sc_expand name '() sugar-scope) as Scope)
-            repeat rest... modulename ext opts includestr value
+            repeat rest... modulename ext opts includestr value lazy
+        case ('lazy rest...)
+            repeat rest... modulename ext opts includestr scope true
         case (('extern "C++") rest...)
             if (modulename == ".cpp")
                 hide-traceback;
                 error "duplicate 'extern \"C++\"'"
-            repeat rest... modulename str".cpp" opts includestr scope
+            repeat rest... modulename str".cpp" opts includestr scope lazy
         case (('options opts...) rest...)
             let opts =
                 loop (outopts inopts = '() opts...)
@@ -8119,12 +8612,12 @@ sugar include (args...)
                     val as:= string
                     outopts := (cons val outopts)
                     repeat outopts next
-            repeat rest... modulename ext opts includestr scope
+            repeat rest... modulename ext opts includestr scope lazy
         case ((s as string) rest...)
             if (not (empty? includestr))
                 hide-traceback;
                 error "duplicate include string"
-            repeat rest... modulename ext opts s scope
+            repeat rest... modulename ext opts s scope lazy
         case ()
             let sz = (countof includestr)
             if (sz == 0)
@@ -8145,6 +8638,10 @@ sugar include (args...)
                         repeat
                             cons "-I" at opts
                             next
+            # translated on first use
+            let opts =
+                if lazy (cons str"--lazy" opts)
+                else opts
             return
                 gen-code (.. modulename ext) includestr opts scope
                 next-expr
@@ -8497,6 +8994,149 @@ fn nested-union-field-accessor (qcls name)
             constructor cls args...
     __drop = destructor
 
+# struct comparison and hashing
+#-------------------------------------------------------------------------------
+
+# LLVM knows memcmp, and expands short and constant size compares inline
+let memcmp = (extern 'memcmp (function i32 voidstar voidstar usize))
+
+# true if equal values of the struct T have equal bytes: its storage has no
+  padding, and holds only integers, pointers, symbols, hashes, C enums and
+  nested structs with the same property that don't compare on their own
+fn bytewise-struct? (T)
+    fn custom-comparison? (T)
+        loop (T = T)
+            if ((T == Struct) or (T == CStruct))
+                break false
+            if (try ('local@ T '__==) true
+                except (err) false)
+                break true
+            if (try ('local@ T '__hash) true
+                except (err) false)
+                break true
+            'superof T
+    fn bytewise-type? (T)
+        returning bool
+        let T = ('strip-qualifiers T)
+        let _ T = ('keyof T)
+        switch ('kind T)
+        case type-kind-integer true
+        case type-kind-pointer true
+        case type-kind-array
+            this-function ('element@ T 0)
+        case type-kind-vector
+            let ET = ('element@ T 0)
+            and
+                this-function ET
+                ('sizeof T) == (('sizeof ET) * ('element-count T))
+        case type-kind-tuple
+            let count = ('element-count T)
+            loop (i size = 0 0:usize)
+                if (i == count)
+                    break (size == ('sizeof T))
+                let ET = ('element@ T i)
+                if (not (this-function ET))
+                    break false
+                _ (i + 1) (size + ('sizeof ET))
+        case type-kind-typename
+            if ((T < Struct) or (T < CStruct))
+                if (custom-comparison? T) false
+                else (this-function ('storageof T))
+            else
+                (T == Symbol) or (T == hash) or (T < CEnum)
+        default false
+    if ('opaque? T) false
+    elseif (not ('plain? T)) false
+    else
+        bytewise-type? T
+
+# true if the storage of the struct T is a tuple of integer and pointer
+  fields that fit a u64 together
+fn flat-struct? (T)
+    let ST = ('storageof T)
+    let count = ('element-count ST)
+    if (('sizeof ST) > 8:usize) false
+    else
+        loop (i = 0)
+            if (i == count)
+                break true
+            let _ ET = ('keyof ('element@ ST i))
+            let ET = ('storageof ET)
+            let kind = ('kind ET)
+            if ((kind != type-kind-integer) and (kind != type-kind-pointer))
+                break false
+            i + 1
+
+spice struct-equal? (self other)
+    let T = ('strip-qualifiers ('typeof self))
+    let ST = ('storageof T)
+    if (bytewise-struct? T)
+        let size = ('sizeof ST)
+        spice-quote
+            local a = self
+            local b = other
+            (memcmp (bitcast (& a) voidstar) (bitcast (& b) voidstar) size) == 0
+    else
+        fold (result = `true) for i in (rrange ('element-count ST))
+            let _ ET = ('keyof ('element@ ST i))
+            # vectors compare element-wise
+            let equal =
+                if (('kind ('storageof ET)) == type-kind-vector)
+                    `(all? (== (extractvalue self i) (extractvalue other i)))
+                else
+                    `(== (extractvalue self i) (extractvalue other i))
+            spice-quote
+                if equal result
+                else false
+
+spice struct-fields-hash (self)
+    let T = ('strip-qualifiers ('typeof self))
+    let ST = ('storageof T)
+    let count = ('element-count ST)
+    if (bytewise-struct? T)
+        let size = ('sizeof ST)
+        if (flat-struct? T)
+            # combine the fields into the bytes of a single u64
+            let value =
+                fold (value = `0:u64) for i in (range count)
+                    let shift = (((sc_type_offsetof ST i) * 8:usize) as u64)
+                    let _ ET = ('keyof ('element@ ST i))
+                    let ET = ('storageof ET)
+                    let field = `(storagecast (extractvalue self i))
+                    let field =
+                        if (('kind ET) == type-kind-pointer)
+                            `(ptrtoint field u64)
+                        elseif (('bitcount ET) == 64)
+                            `(bitcast field u64)
+                        else
+                            `(zext field u64)
+                    `(| value (field << shift))
+            `(bitcast (xxh64-u64 value size) hash)
+        else
+            spice-quote
+                local a = self
+                hash.from-bytes (bitcast (& a) rawstring) size
+    elseif (count == 0)
+        `(nullof hash)
+    else
+        loop (i result = 1 `(hash (extractvalue self 0)))
+            if (i == count)
+                break result
+            _ (i + 1) `(hash result (extractvalue self i))
+
+do
+    @@ memo
+    inline struct== (cls T)
+        static-if (cls == T)
+            fn (self other) (struct-equal? self other)
+
+    'set-symbols Struct
+        __== = struct==
+        __hash = struct-fields-hash
+    'set-symbols CStruct
+        __== = struct==
+        __hash = struct-fields-hash
+
 # unions
 #-------------------------------------------------------------------------------
 
@@ -8611,6 +9251,19 @@ typedef+ string
     case (cls : type, buf : rawstring, size : usize)
         sc_string_new buf size
 
+    """"Returns a generator over the start and end offsets of all matches of
+        the regular expression `pattern` in `text` that don't overlap.
+    inline matches (pattern text)
+        inline search (offset)
+            'match-from? pattern text offset
+        Generator
+            inline () (search 0)
+            inline (ok start end) ok
+            inline (ok start end) (_ start end)
+            inline (ok start end)
+                # step past empty matches
+                search (? (start == end) (end + 1) end)
+
 #-------------------------------------------------------------------------------
 # defer
 #-------------------------------------------------------------------------------
@@ -8781,6 +9434,16 @@ spice typematch? (paramT argT arg-constant?)
 let trap = (extern 'llvm.trap (function noreturn))
 let debugtrap = (extern 'llvm.debugtrap (function void))
 
+""""Returns `cond`, and tells the optimizer that it is most likely true, so
+    that the code of branches taken when it is true is placed on the fast
+    path.
+inline likely (cond)
+    expect (imply cond bool) true
+
+""""Returns `cond`, and tells the optimizer that it is most likely false.
+inline unlikely (cond)
+    expect (imply cond bool) false
+
 inline distance (a b)
     length (a - b)
 
@@ -8912,6 +9575,8 @@ sugar static-shared-library (name...)
 unlet _memo dot-char dot-sym ellipsis-symbol _Value constructor destructor
     \ gen-tupleof nested-struct-field-accessor nested-union-field-accessor
     \ tuple-comparison gen-arrayof MethodsAccessor-typeattr floorf modules
+    \ module-dependents module-mtimes loading-module module-paths memcmp
+    \ bytewise-struct? flat-struct? struct-equal? struct-fields-hash
     \ string-array-ref-type? llvm.memcpy.p0i8.p0i8.i64
 
 run-stage; # 12
@@ -8970,6 +9635,16 @@ fn print-help (exename)
             -v, --version           print runtime version and exit.
             -e, --env               run program from project environment.
             -s, --signal-abort      raise SIGABRT when calling `abort!`.
+            --server path           keep the booted compiler resident and run the
+                                    command lines of clients that connect to the
+                                    socket at path, which they do when
+                                    SCOPES_SERVER is set to it.
+            --precompile path ...   load the modules in path, in processes of
+                                    their own and without running main, to
+                                    fill the cache, then exit (terminates
+                                    option list). every path is a module file,
+                                    a directory whose .sc files are loaded
+                                    recursively, or a module name.
             -c command              program passed in as string (terminates option list)
             -m module               run module on path (terminates option list)
             filename                program read from scopes file.
@@ -9007,14 +9682,77 @@ fn print-version ()
 let minus-char = 45:char # "-"
 let project-filename-pattern = "/__env.sc"
 let project-module-name = "__env"
+
+# the module files that --precompile loads for paths in order: module files,
+  the .sc files in directories and their subdirectories, skipping hidden
+  entries, and the files of modules in the search path
+fn precompile-module-files (paths base-dir env)
+    loop (pending files = paths '())
+        if (empty? pending)
+            break ('reverse files)
+        let path pending = (decons pending)
+        let path = (path as string)
+        if (sc_is_directory path)
+            let entries =
+                fold (entries = '()) for entry in (sc_list_directory path)
+                    let name = (entry as string)
+                    let count = (countof name)
+                    let subpath = (.. path "/" name)
+                    let module? =
+                        (count > 3:usize) and ((rslice name (count - 3:usize)) == ".sc")
+                    if ((lslice name 1) == ".") entries
+                    elseif ((sc_is_directory subpath) or module?)
+                        cons subpath entries
+                    else entries
+            # entries are in reverse, so the first one is pending first
+            repeat
+                fold (pending = pending) for entry in entries
+                    cons entry pending
+                files
+        elseif (sc_is_file path)
+            repeat pending (cons (sc_realpath path) files)
+        else
+            hide-traceback;
+            repeat pending
+                cons (find-module-path base-dir (Symbol path) env) files
+
+# loads a single module in the running process, or every module in a worker
+  process that is passed that module alone
+fn precompile (paths base-dir env)
+    let files = (precompile-module-files paths base-dir env)
+    if ((countof files) == 1)
+        let path = (decons files)
+        hide-traceback;
+        load-module "" (path as string) env
+        exit 0
+    let commands =
+        fold (commands = '()) for path in files
+            cons
+                .. "\"" compiler-path "\" --precompile \"" (path as string) "\""
+                commands
+    let results = (sc_run_commands ('reverse commands) '() 0 "")
+    let failed =
+        fold (failed = 0) for path result in (zip files results)
+            let status seconds output = (decons (result as list) 3)
+            if ((status as i32) == 0) failed
+            else
+                print "failed to precompile" (path as string)
+                io-write! (output as string)
+                failed + 1
+    print (countof files) "modules precompiled," failed "failed."
+    exit (? (failed == 0) 0 1)
+
 fn run-main ()
     let argc argv = (launch-args)
+    # the constant holds the directory of the compile server in its workers
+    let working-dir = (sc_working_dir)
     let exename = (load (getelementptr argv 0))
     let exename = (sc_string_new_from_cstr exename)
     local sourcearg = str""
     local module? = false
     local command? = false
     local project? = false
+    local precompile? = false
     let start-offset =
         loop (i = 1)
             if (i >= argc)
@@ -9031,6 +9769,18 @@ fn run-main ()
                     set-signal-abort! true
                 elseif ((== arg "--env") or (== arg "-e"))
                     project? = true
+                elseif (== arg "--server")
+                    # with a path, the option is handled before the core runs
+                    print "Argument expected for the --server option"
+                        \ ". Try --help for help."
+                    exit 255
+                elseif (== arg "--precompile")
+                    precompile? = true
+                    if (k == argc)
+                        print "Argument expected for the --precompile option"
+                            \ ". Try --help for help."
+                        exit 255
+                    break k
                 elseif (== arg "-c")
                     command? = true
                     if (k == argc)
@@ -9064,6 +9814,14 @@ fn run-main ()
             _ (deref sourcearg) (deref module?)
     let console? = (module? & (sourcearg == "console"))
     let core-module-env = (set-project-dir __env compiler-dir true)
+    if precompile?
+        let paths =
+            loop (i paths = (argc - 1) '())
+                if (i < start-offset)
+                    break paths
+                repeat (i - 1) (cons (string (argv @ i)) paths)
+        hide-traceback;
+        precompile paths (working-dir as string) core-module-env
     let argc = (argc - start-offset)
     let argv = (& (@ argv start-offset))
     @@ spice-quote
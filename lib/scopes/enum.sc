@@ -55,15 +55,26 @@ fn... _extract-payload (enum-value, extractT, unpack? = true)
                 `('explode extracted)
         else extracted
 
+# fields are bound as symbols of their enum, which are found without
+  searching all fields
+fn field-by-key (cls key)
+    try
+        let field = (('@ cls key) as type)
+        if (field < (('@ cls 'FieldType) as type))
+            return field
+    except (err)
+        ;
+    # report an unknown field as the tuple of fields does
+    let fields = (('@ cls '__fields) as type)
+    let i = (sc_type_field_index fields key)
+    ('getarg ('@ cls '__fields__) i) as type
+
 @@ memo
 inline gen-dispatch-from-tag (f)
     fn "dispatch-from-tag" (tag handlers self...)
         let first-self = self...
         let qcls = ('qualified-typeof first-self)
         let cls = ('strip-qualifiers qcls)
-        let fields = (('@ cls '__fields) as type)
-        let field-types = ('@ cls '__fields__)
-        let field-type-args = ('args field-types)
         let sw = (sc_switch_new tag)
         for arg in ('args handlers)
             let anchor = ('anchor arg)
@@ -71,9 +82,7 @@ inline gen-dispatch-from-tag (f)
             if (key == unnamed)
                 sc_switch_append_default sw `(arg)
             else
-                let i = (sc_type_field_index fields key)
-                let ET = ('key-type ('element@ fields i) unnamed)
-                let field = (('getarg field-types i) as type)
+                let field = (field-by-key cls key)
                 let lit = ('@ field 'Literal)
                 let extractT = ('@ field 'Type)
                 let payloads... = (f extractT self...)
@@ -171,17 +180,41 @@ spice define-field (enum-type name opts...)
         else (_ ('getarg opts... 0) ('getarglist opts... 1))
     define-field-runtime T name field-type index-value
 
-fn shabbysort (buf sz)
-    for i in (range sz)
-        for j in (range (i + 1) sz)
-            let a = (load (getelementptr buf i))
-            let ak = (extractvalue a 0)
-            let b = (load (getelementptr buf j))
-            let bk = (extractvalue b 0)
-            if (ak > bk)
-                # swap
-                store b (getelementptr buf i)
-                store a (getelementptr buf j)
+# heapsort of (index field) pairs by index
+fn sort-by-index (buf sz)
+    inline key (i)
+        extractvalue (load (getelementptr buf i)) 0
+    inline swap (i j)
+        let a = (load (getelementptr buf i))
+        let b = (load (getelementptr buf j))
+        store b (getelementptr buf i)
+        store a (getelementptr buf j)
+    inline sift-down (start end)
+        loop (root = start)
+            let child = (root * 2 + 1)
+            if (child >= end)
+                break;
+            let child =
+                if (((child + 1) < end) and ((key child) < (key (child + 1))))
+                    child + 1
+                else child
+            if ((key root) < (key child))
+                swap root child
+                repeat child
+            break;
+    loop (start = (sz // 2))
+        if (start == 0)
+            break;
+        let start = (start - 1)
+        sift-down start sz
+        repeat start
+    loop (end = sz)
+        if (end <= 1)
+            break;
+        let end = (end - 1)
+        swap 0 end
+        sift-down 0 end
+        repeat end
 
 spice static-repr-switch-case (litT self allow-dupes? style? field-types...)
     litT as:= type
@@ -189,39 +222,25 @@ spice static-repr-switch-case (litT self allow-dupes? style? field-types...)
     style? as:= bool
     let value = (sc_const_int_extract self)
     let numfields = ('argcount field-types...)
-    let sorted = (alloca-array (tuple u64 type) numfields)
-    for i in (range numfields)
-        let field = (('getarg field-types... i) as type)
-        let field = (field as type)
-        let index = (('@ field 'Index) as u64)
-        store (tupleof index field) (getelementptr sorted i)
-    # sort array so duplicates are next to each other and merge names
-    shabbysort sorted numfields
-    loop (i = 0)
-        if (i == numfields)
-            break `"?invalid?"
-        let index field = (unpack (load (getelementptr sorted i)))
-        if (index == value)
-            let name = (('@ field 'Name) as Symbol as string)
-            # accumulate all fields with the same index
-            let name =
-                loop (i name = (i + 1) name)
-                    if (i == numfields)
-                        break name
-                    let index2 field2 = (unpack (load (getelementptr sorted i)))
-                    if (index2 == index)
-                        if (not allow-dupes?)
-                            error "duplicate tags not permitted for tagged unions"
-                        let name2 = (('@ field2 'Name) as Symbol as string)
-                        repeat (i + 1) (.. name "|" name2)
-                    else
-                        break name
-            let name =
-                if style?
-                    sc_default_styler style-number name
-                else name
-            break `name
-        i + 1
+    # a single constant only needs the names of the fields with its index
+    let name =
+        fold (name = str"") for i in (range numfields)
+            let field = (('getarg field-types... i) as type)
+            if ((('@ field 'Index) as u64) == value)
+                let fieldname = (('@ field 'Name) as Symbol as string)
+                if (empty? name) fieldname
+                else
+                    if (not allow-dupes?)
+                        error "duplicate tags not permitted for tagged unions"
+                    .. name "|" fieldname
+            else name
+    if (empty? name)
+        return `"?invalid?"
+    let name =
+        if style?
+            sc_default_styler style-number name
+        else name
+    `name
 
 fn build-repr-switch-case (litT self allow-dupes? style? field-types)
     let numfields = ('argcount field-types)
@@ -232,7 +251,7 @@ fn build-repr-switch-case (litT self allow-dupes? style? field-types)
         let index = (('@ field 'Index) as u64)
         store (tupleof index field) (getelementptr sorted i)
     # sort array so duplicates are next to each other and merge names
-    shabbysort sorted numfields
+    sort-by-index sorted numfields
     let sw = (sc_switch_new self)
     loop (i = 0)
         if (i == numfields)
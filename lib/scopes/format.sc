@@ -32,13 +32,28 @@ using import String
                 name = "Joana"
                 age = 42
 
+    `format` returns its fragments, which are concatenated by the caller.
+    `format-string` and `format-append` instead write all fragments into a
+    single `String`, which reserves its storage once for the estimated
+    length, and write numbers without converting them to strings first:
+
+        :::scopes
+        local line : String
+        for i in (range 10)
+            'clear line
+            # reuses the storage of line
+            format-append line "{}: {}" i ((i as f32) / 10.0)
+            print line
+
 fn string-array-ref-type? (T)
     if (icmp== ('kind T) type-kind-array)
         & ('refer? T)
             ptrcmp== ('element@ T 0) i8
     else false
 
-spice format (str args...)
+# parses the format string str, which is constant, into an array of string
+  constants and the arguments they surround
+fn parse-format (str args)
     using import UTF-8
 
     anchor := ('anchor str)
@@ -87,11 +102,11 @@ spice format (str args...)
             substr := (slice str start i)
             let nextarg body =
                 if (substr == "")
-                    _ (nextarg + 1) ('getarg args... nextarg)
+                    _ (nextarg + 1) ('getarg args nextarg)
                 else
                     let val k = (parse-integer substr)
                     if (k == 0) # key
-                        for arg in ('args args...)
+                        for arg in ('args args)
                             let key arg = ('dekey arg)
                             if (key as string == substr)
                                 break nextarg arg
@@ -99,15 +114,11 @@ spice format (str args...)
                             parse-error (start + 1)
                                 .. "no argument with key " (repr `substr)
                     elseif (k == (countof substr)) # index
-                        _ nextarg ('getarg args... (val as i32))
+                        _ nextarg ('getarg args (val as i32))
                     else
                         parse-error (start + k + 1)
                             "invalid character in index expression"
-            QT := ('qualifiersof body)
-            T := ('strip-qualifiers QT)
-            'append block
-                if ((T == String) | (T == string) | (string-array-ref-type? QT)) body
-                else `(tostring body)
+            'append block body
             _ (i + 1) nextarg
         else
             # read string chunk up to the next variable and append to result,
@@ -130,8 +141,112 @@ spice format (str args...)
                 repeat (k + 1)
             'append block (substr as string)
             _ i nextarg
+    deref block
+
+fn string-fragment? (fragment)
+    QT := ('qualifiersof fragment)
+    T := ('strip-qualifiers QT)
+    (T == String) | (T == string) | (string-array-ref-type? QT)
+
+spice format (str args...)
+    local block : (Array Value)
+    for fragment in (parse-format str args...)
+        'append block
+            if (string-fragment? fragment) fragment
+            else `(tostring fragment)
     sc_argument_list_new ((countof block) as i32) (& (block @ 0))
 
+# the most characters that integers and reals take, before the string grows
+let INTEGER_SIZE_ESTIMATE = 20:usize
+let REAL_SIZE_ESTIMATE = 24:usize
+
+fn append-digits (dest value)
+    let value = (value as u64)
+    let count =
+        loop (count rest = 1:usize (value // 10:u64))
+            if (rest == 0:u64)
+                break count
+            repeat (count + 1:usize) (rest // 10:u64)
+    let ptr = (& ('append-slots dest count))
+    loop (i rest = count value)
+        let i = (i - 1:usize)
+        ptr @ i = ((48:u64 + (rest % 10:u64)) as char)
+        if (i == 0:usize)
+            break;
+        repeat i (rest // 10:u64)
+
+fn append-signed (dest value)
+    let value = (value as i64)
+    if (value < 0:i64)
+        'append dest c"-"
+        # negate as unsigned so that the smallest value doesn't overflow
+        append-digits dest (0:u64 - (bitcast value u64))
+    else
+        append-digits dest (bitcast value u64)
+
+fn append-real (dest value single?)
+    let count = (countof dest)
+    # the text is written into free slots, along with its trailing zero
+    let size =
+        sc_format_real (& ('append-slots dest REAL_SIZE_ESTIMATE))
+            \ REAL_SIZE_ESTIMATE (value as f64) single?
+    if (size >= REAL_SIZE_ESTIMATE)
+        'resize dest count
+        sc_format_real (& ('append-slots dest (size + 1:usize)))
+            \ (size + 1:usize) (value as f64) single?
+    'resize dest (count + size)
+
+spice format-append (dest str args...)
+    """"Append the fragments of the format string `str` to the `String`
+        `dest`, as `format` would return them. The string is parsed at
+        compile time into a writer for exactly these arguments, which reserves
+        storage once and writes integers, reals and booleans directly.
+    # constant text is measured now, strings when the writer runs, and
+      numbers are estimated
+    local static-size = 0:usize
+    local sizes : (Array Value)
+    local block : (Array Value)
+    for fragment in (parse-format str args...)
+        QT := ('qualifiersof fragment)
+        T := ('strip-qualifiers QT)
+        'append block
+            if (('constant? fragment) & (T == string))
+                static-size += (countof (fragment as string))
+                `('append dest fragment)
+            elseif (string-fragment? fragment)
+                'append sizes `(countof fragment)
+                `('append dest fragment)
+            elseif (T == bool)
+                static-size += 5:usize
+                `('append dest (? fragment "true" "false"))
+            elseif (T < integer)
+                static-size += INTEGER_SIZE_ESTIMATE
+                if ('signed? ('storageof T))
+                    `(append-signed dest fragment)
+                else
+                    `(append-digits dest fragment)
+            elseif (T < real)
+                static-size += REAL_SIZE_ESTIMATE
+                `(append-real dest fragment [(('storageof T) == f32)])
+            else
+                `('append dest (tostring fragment))
+    let size =
+        fold (size = `((countof dest) + [(deref static-size)])) for count in sizes
+            `(size + count)
+    let expr = (sc_expression_new)
+    sc_expression_append expr `('reserve dest size)
+    for write in block
+        sc_expression_append expr write
+    sc_expression_append expr `(_)
+    expr
+
+inline format-string (str args...)
+    """"Returns a new `String` with the fragments of the format string `str`,
+        written as `format-append` does.
+    local result : String
+    format-append result str args...
+    deref result
+
 do
-    let format
+    let format format-append format-string
     locals;
@@ -670,9 +670,18 @@ typedef+ mat-type
 
     unlet make-diagonal-vector mat-type-constructor
 
+    # returns the linear combination of the columns of lhs with the elements
+      of vec as weights; every term is a whole column times a smeared element,
+      so the product maps straight onto vector lanes without gathering rows.
+    fn combine-columns (lhs vec VT count)
+        fold (sum = `()) for k in (range count)
+            let term =
+                `((extractvalue lhs k) * (VT (extractelement vec k)))
+            if (k == 0) term
+            else `(sum + term)
+
     @@ spice-binary-op-macro
     fn __* (lhsT rhsT)
-        let mat-row = row
         if (and
                 (lhsT < mat-type)
                 (rhsT < mat-type)
@@ -683,33 +692,29 @@ typedef+ mat-type
             let
                 dest-columns = (('@ rhsT 'Columns) as i32)
                 dest-rows = (('@ lhsT 'Rows) as i32)
+                count = (('@ lhsT 'Columns) as i32)
             let destT = `(construct-mat-type ET dest-columns dest-rows)
             spice-quote
                 inline (lhs rhs)
                     spice-unquote
-                        # because we know the destination has the same number of rows as lhs
-                        let rows = (alloca-array Value dest-rows)
-                        for i in (range dest-rows)
-                            rows @ i = `(mat-row lhs i)
-                        # a row has dest-columns elements, so we iterate on that
+                        # column i of the product is lhs * (column i of rhs)
                         fold (mat = `(nullof destT)) for i in (range dest-columns)
                             let vec =
-                                fold (vec = `(nullof VT)) for j in (range dest-rows)
-                                    let row = (deref (rows @ j))
-                                    `(insertelement vec (dot row (extractvalue rhs i)) j)
+                                combine-columns lhs `(extractvalue rhs i) VT count
                             `(insertvalue mat vec i)
         elseif (rhsT == (('@ lhsT 'RowType) as type))
             let VT = ('element@ lhsT 0)
-            let sz = ('element-count VT)
+            let count = (('@ lhsT 'Columns) as i32)
             # mat(i,j) * vec(i) -> vec(j)
             spice-quote
                 inline (lhs rhs)
                     spice-unquote
-                        fold (vec = `(nullof VT)) for i in (range sz)
-                            `(insertelement vec (dot (mat-row lhs i) rhs) i)
+                        combine-columns lhs rhs VT count
         else
             `()
 
+    unlet combine-columns
+
     @@ spice-binary-op-macro
     fn __r* (lhsT rhsT)
         if (lhsT == ('element@ rhsT 0))
@@ -756,17 +761,139 @@ typedef+ mat-type
         else
             return `()
 
+fn shuffle-mask (a b c d)
+    let entries = (alloca-array Value 4)
+    entries @ 0 = `a
+    entries @ 1 = `b
+    entries @ 2 = `c
+    entries @ 3 = `d
+    sc_const_aggregate_new (vector.type i32 4) 4 entries
+
+# interleaves pairs of columns, then pairs of the interleaved halves; eight
+  shuffles instead of sixteen element moves
+inline transpose4 (m TT lo hi first second)
+    let VT = TT.ColumnType
+    let c0 c1 c2 c3 = (unpack m)
+    let t0 = (shufflevector c0 c1 lo)
+    let t1 = (shufflevector c2 c3 lo)
+    let t2 = (shufflevector c0 c1 hi)
+    let t3 = (shufflevector c2 c3 hi)
+    TT
+        bitcast (shufflevector t0 t1 first) VT
+        bitcast (shufflevector t0 t1 second) VT
+        bitcast (shufflevector t2 t3 first) VT
+        bitcast (shufflevector t2 t3 second) VT
+
 spice _transpose (m)
     let T = ('typeof m)
     assert (T < mat-type)
     let TT = (('@ T 'TransposedType) as type)
-    fold (self = `(nullof TT)) for i in (range (('@ T 'Rows) as i32))
-        `(insertvalue self ('row m i) i)
+    let cols = (('@ T 'Columns) as i32)
+    let rows = (('@ T 'Rows) as i32)
+    if ((cols == 4) and (rows == 4))
+        let lo hi first second =
+            shuffle-mask 0 4 1 5; shuffle-mask 2 6 3 7
+            shuffle-mask 0 1 4 5; shuffle-mask 2 3 6 7
+        `(transpose4 m TT lo hi first second)
+    else
+        fold (self = `(nullof TT)) for i in (range rows)
+            `(insertvalue self ('row m i) i)
 
 @@ spice-quote
 inline transpose (m)
     _transpose m
 
+# the 2x2 determinants of rows p and q from the columns c1 c2 c3, in the
+  order that the cofactors of inverse4 expect them
+inline subfactors (VT c1 c2 c3 p q)
+    -
+        (VT (c2 @ p) (c2 @ p) (c1 @ p) (c1 @ p)) * (VT (c3 @ q) (c3 @ q) (c3 @ q) (c2 @ q))
+        (VT (c3 @ p) (c3 @ p) (c3 @ p) (c2 @ p)) * (VT (c2 @ q) (c2 @ q) (c1 @ q) (c1 @ q))
+
+inline inverse2 (m)
+    let MT = (typeof m)
+    let VT = MT.ColumnType
+    let c0 c1 = (unpack m)
+    let det = ((c0 @ 0) * (c1 @ 1) - (c1 @ 0) * (c0 @ 1))
+    let s = (VT (/ det))
+    MT
+        (VT (c1 @ 1) (- (c0 @ 1))) * s
+        (VT (- (c1 @ 0)) (c0 @ 0)) * s
+
+inline inverse3 (m)
+    let MT = (typeof m)
+    let VT = MT.ColumnType
+    inline cross (u v)
+        -
+            (VT (u @ 1) (u @ 2) (u @ 0)) * (VT (v @ 2) (v @ 0) (v @ 1))
+            (VT (u @ 2) (u @ 0) (u @ 1)) * (VT (v @ 1) (v @ 2) (v @ 0))
+    let c0 c1 c2 = (unpack m)
+    let r0 r1 r2 = (_ (cross c1 c2) (cross c2 c0) (cross c0 c1))
+    let s = (VT (/ (dot c0 r0)))
+    # the cross products are the rows of the adjugate
+    transpose (MT (r0 * s) (r1 * s) (r2 * s))
+
+inline inverse4 (m)
+    let MT = (typeof m)
+    let VT = MT.ColumnType
+    let c0 c1 c2 c3 = (unpack m)
+    let f0 f1 f2 f3 f4 f5 =
+        subfactors VT c1 c2 c3 2 3
+        subfactors VT c1 c2 c3 1 3
+        subfactors VT c1 c2 c3 1 2
+        subfactors VT c1 c2 c3 0 3
+        subfactors VT c1 c2 c3 0 2
+        subfactors VT c1 c2 c3 0 1
+    inline spread (k)
+        VT (c1 @ k) (c0 @ k) (c0 @ k) (c0 @ k)
+    let v0 v1 v2 v3 = (_ (spread 0) (spread 1) (spread 2) (spread 3))
+    let one = VT.One
+    let sign-a = (VT one (- one) one (- one))
+    let sign-b = (VT (- one) one (- one) one)
+    let i0 = ((v1 * f0 - v2 * f1 + v3 * f2) * sign-a)
+    let i1 = ((v0 * f0 - v2 * f3 + v3 * f4) * sign-b)
+    let i2 = ((v0 * f1 - v1 * f3 + v3 * f5) * sign-a)
+    let i3 = ((v0 * f2 - v1 * f4 + v2 * f5) * sign-b)
+    let det = (dot c0 (VT (i0 @ 0) (i1 @ 0) (i2 @ 0) (i3 @ 0)))
+    let s = (VT (/ det))
+    MT (i0 * s) (i1 * s) (i2 * s) (i3 * s)
+
+""""Returns the inverse of the square floating point matrix `m`. The result
+    is undefined if `m` is singular.
+inline inverse (m)
+    let MT = (typeof m)
+    static-assert (MT < mat-type) "matrix expected"
+    static-assert (MT.Columns == MT.Rows) "square matrix expected"
+    static-assert ((MT.ElementType == f32) or (MT.ElementType == f64))
+        "floating point matrix expected"
+    static-match MT.Columns
+    case 2 (inverse2 m)
+    case 3 (inverse3 m)
+    default (inverse4 m)
+
+""""Stores `m * (src @ i)` in `dest @ i` for every element of `src`; `dest`
+    must have room for as many elements. The elements of `src` have the
+    matrix' row type, or are points with one coordinate less, which are
+    transformed with an implied w of 1 and truncated again.
+inline transform-many (dest src m)
+    let MT = (typeof m)
+    static-assert (MT < mat-type) "matrix expected"
+    let RT = MT.RowType
+    for i in (range (countof src))
+        let v = (src @ i)
+        let VT = (typeof v)
+        let result =
+            static-if (VT == RT) (m * v)
+            else
+                static-assert ((VT.Count + 1) == MT.Columns)
+                    "vector must have as many elements as the matrix has columns, or one less"
+                let r = (m * (RT v RT.One))
+                VT
+                    va-map
+                        inline (k) (r @ k)
+                        va-range VT.Count
+        dest @ i = result
+
 spice mix (a b x)
     let Ta = ('typeof a)
     let Tx = ('typeof x)
@@ -810,5 +937,5 @@ do
     let mat4x4 dmat4x4 imat4x4 umat4x4 bmat4x4
     let mat4 dmat4 imat4 umat4 bmat4
 
-    let dot transpose mix
+    let dot transpose inverse transform-many mix
     locals;
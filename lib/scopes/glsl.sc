@@ -344,6 +344,26 @@ fn config-uniform (anchor name T layout)
         else 'UniformConstant
     config-xvar 0:u32 storage anchor name T layout
 
+fn config-spec-constant (anchor name T layout)
+    local id = -1
+    local init = (sc_prove `(nullof T))
+    for arg in ('args layout)
+        let k v = ('dekey arg)
+        switch k
+        case 'id
+            id = ((sc_prove `(imply v i32)) as i32)
+        case 'default
+            init = (sc_prove `(imply v T))
+        default
+            error (.. "unsupported key: " (k as string))
+    if (id < 0)
+        error "specialization constant needs an id"
+    let glob =
+        'tag (sc_global_new name T global-flag-spec-constant 'Private) anchor
+    sc_global_set_location glob id
+    sc_global_set_initializer glob init
+    glob
+
 fn config-inout (anchor name T layout)
     let tname =
         .. "<inout " (name as string) " : " ('string T) ">"
@@ -403,6 +423,63 @@ let shared =
             spice-quote
                 ptrtoref val
 
+# subgroup instructions are generic over the types of their operands, so an
+  extern is declared for every signature they are used with
+@@ memo
+inline subgroup-op0 (name RT)
+    extern name (function RT)
+
+@@ memo
+inline subgroup-op1 (name RT T1)
+    extern name (function RT T1)
+
+@@ memo
+inline subgroup-op2 (name RT T1 T2)
+    extern name (function RT T1 T2)
+
+inline subgroup-call1 (name RT value)
+    (subgroup-op1 name RT (typeof value)) value
+
+inline subgroup-call2 (name RT value arg)
+    (subgroup-op2 name RT (typeof value) (typeof arg)) value arg
+
+# the name of the arithmetic subgroup instruction that applies op to values
+  of type T, followed by the suffix that selects the group operation
+spice subgroup-arith-name (T op suffix)
+    T as:= type
+    op as:= Symbol
+    suffix as:= string
+    let ET =
+        if (T < vector) ('element@ T 0)
+        else T
+    let bitwise? = ((op == 'And) or (op == 'Or) or (op == 'Xor))
+    let minmax? = ((op == 'Min) or (op == 'Max))
+    let kind =
+        if (ET == bool)
+            if (not bitwise?)
+                error (.. "subgroup operation " (op as string)
+                    " does not apply to booleans")
+            "Logical"
+        elseif bitwise? "Bitwise"
+        elseif (ET < real) "F"
+        elseif (minmax? and ('signed? ET)) "S"
+        elseif minmax? "U"
+        else "I"
+    let name =
+        Symbol (.. "spirv.OpGroupNonUniform" kind (op as string) suffix)
+    `name
+
+inline gen-subgroup-arith (op suffix)
+    inline "subgroup-arith" (value)
+        let T = (typeof value)
+        subgroup-call1 (subgroup-arith-name T op suffix) T value
+
+inline gen-subgroup-clustered (op)
+    inline "subgroup-clustered" (value cluster-size)
+        let T = (typeof value)
+        subgroup-call2 (subgroup-arith-name T op ".ClusteredReduce") T value
+            cluster-size as u32
+
 let
     smoothstep_f32 = (extern 'GLSL.std.450.SmoothStep (function f32 f32 f32 f32))
     smoothstep_vec2 = (extern 'GLSL.std.450.SmoothStep (function vec2 vec2 vec2 vec2))
@@ -498,6 +575,8 @@ do
         out = (gen-xvar-sugar "out" (wrap-xvar-global (inline (...) (config-xvar 0:u32 'Output ...))))
         buffer = (gen-xvar-sugar "buffer" (wrap-xvar-global config-buffer))
         uniform = (gen-xvar-sugar "uniform" (wrap-xvar-global config-uniform))
+        # specialized when the pipeline is created
+        spec-constant = (gen-xvar-sugar "spec-constant" (wrap-xvar-global config-spec-constant))
         inout = (gen-xvar-sugar "inout" config-inout)
         # output is an unsized array
         inout-geometry = (gen-xvar-sugar "inout-geometry" config-inout-geometry)
@@ -524,6 +603,17 @@ do
         gl_GlobalInvocationID = (ptrtoref (extern 'spirv.GlobalInvocationId uvec3 (storage-class = 'Input)))
         gl_LocalInvocationIndex = (ptrtoref (extern 'spirv.LocalInvocationIndex u32 (storage-class = 'Input)))
 
+        # GL_KHR_shader_subgroup
+        gl_SubgroupSize = (ptrtoref (extern 'spirv.SubgroupSize u32 (storage-class = 'Input)))
+        gl_SubgroupInvocationID = (ptrtoref (extern 'spirv.SubgroupLocalInvocationId u32 (storage-class = 'Input)))
+        gl_NumSubgroups = (ptrtoref (extern 'spirv.NumSubgroups u32 (storage-class = 'Input)))
+        gl_SubgroupID = (ptrtoref (extern 'spirv.SubgroupId u32 (storage-class = 'Input)))
+        gl_SubgroupEqMask = (ptrtoref (extern 'spirv.SubgroupEqMaskKHR uvec4 (storage-class = 'Input)))
+        gl_SubgroupGeMask = (ptrtoref (extern 'spirv.SubgroupGeMaskKHR uvec4 (storage-class = 'Input)))
+        gl_SubgroupGtMask = (ptrtoref (extern 'spirv.SubgroupGtMaskKHR uvec4 (storage-class = 'Input)))
+        gl_SubgroupLeMask = (ptrtoref (extern 'spirv.SubgroupLeMaskKHR uvec4 (storage-class = 'Input)))
+        gl_SubgroupLtMask = (ptrtoref (extern 'spirv.SubgroupLtMaskKHR uvec4 (storage-class = 'Input)))
+
     inline texelFetch (sampler P ...)
         'fetch (sampler as gsampler) P ...
 
@@ -693,6 +783,102 @@ do
     inline memoryBarrierShared ()
         __barrier barrier-kind-memory-shared
 
+    # subgroup operations; the invocations of a subgroup exchange values
+      without going through shared memory
+
+    inline subgroupElect ()
+        (subgroup-op0 'spirv.OpGroupNonUniformElect bool)
+
+    inline subgroupAll (value)
+        subgroup-call1 'spirv.OpGroupNonUniformAll bool (imply value bool)
+    inline subgroupAny (value)
+        subgroup-call1 'spirv.OpGroupNonUniformAny bool (imply value bool)
+    inline subgroupAllEqual (value)
+        subgroup-call1 'spirv.OpGroupNonUniformAllEqual bool value
+
+    inline subgroupBroadcast (value id)
+        subgroup-call2 'spirv.OpGroupNonUniformBroadcast (typeof value) value
+            id as u32
+    inline subgroupBroadcastFirst (value)
+        subgroup-call1 'spirv.OpGroupNonUniformBroadcastFirst (typeof value) value
+
+    inline subgroupBallot (value)
+        subgroup-call1 'spirv.OpGroupNonUniformBallot uvec4 (imply value bool)
+    inline subgroupInverseBallot (value)
+        subgroup-call1 'spirv.OpGroupNonUniformInverseBallot bool (imply value uvec4)
+    inline subgroupBallotBitExtract (value index)
+        subgroup-call2 'spirv.OpGroupNonUniformBallotBitExtract bool
+            imply value uvec4
+            index as u32
+    inline subgroupBallotBitCount (value)
+        subgroup-call1 'spirv.OpGroupNonUniformBallotBitCount u32 (imply value uvec4)
+    inline subgroupBallotInclusiveBitCount (value)
+        subgroup-call1 'spirv.OpGroupNonUniformBallotBitCount.InclusiveScan u32
+            imply value uvec4
+    inline subgroupBallotExclusiveBitCount (value)
+        subgroup-call1 'spirv.OpGroupNonUniformBallotBitCount.ExclusiveScan u32
+            imply value uvec4
+    inline subgroupBallotFindLSB (value)
+        subgroup-call1 'spirv.OpGroupNonUniformBallotFindLSB u32 (imply value uvec4)
+    inline subgroupBallotFindMSB (value)
+        subgroup-call1 'spirv.OpGroupNonUniformBallotFindMSB u32 (imply value uvec4)
+
+    inline subgroupShuffle (value id)
+        subgroup-call2 'spirv.OpGroupNonUniformShuffle (typeof value) value
+            id as u32
+    inline subgroupShuffleXor (value mask)
+        subgroup-call2 'spirv.OpGroupNonUniformShuffleXor (typeof value) value
+            mask as u32
+    inline subgroupShuffleUp (value delta)
+        subgroup-call2 'spirv.OpGroupNonUniformShuffleUp (typeof value) value
+            delta as u32
+    inline subgroupShuffleDown (value delta)
+        subgroup-call2 'spirv.OpGroupNonUniformShuffleDown (typeof value) value
+            delta as u32
+
+    inline subgroupQuadBroadcast (value id)
+        subgroup-call2 'spirv.OpGroupNonUniformQuadBroadcast (typeof value) value
+            id as u32
+    inline subgroupQuadSwapHorizontal (value)
+        subgroup-call2 'spirv.OpGroupNonUniformQuadSwap (typeof value) value 0:u32
+    inline subgroupQuadSwapVertical (value)
+        subgroup-call2 'spirv.OpGroupNonUniformQuadSwap (typeof value) value 1:u32
+    inline subgroupQuadSwapDiagonal (value)
+        subgroup-call2 'spirv.OpGroupNonUniformQuadSwap (typeof value) value 2:u32
+
+    let
+        subgroupAdd = (gen-subgroup-arith 'Add "")
+        subgroupMul = (gen-subgroup-arith 'Mul "")
+        subgroupMin = (gen-subgroup-arith 'Min "")
+        subgroupMax = (gen-subgroup-arith 'Max "")
+        subgroupAnd = (gen-subgroup-arith 'And "")
+        subgroupOr = (gen-subgroup-arith 'Or "")
+        subgroupXor = (gen-subgroup-arith 'Xor "")
+
+        subgroupInclusiveAdd = (gen-subgroup-arith 'Add ".InclusiveScan")
+        subgroupInclusiveMul = (gen-subgroup-arith 'Mul ".InclusiveScan")
+        subgroupInclusiveMin = (gen-subgroup-arith 'Min ".InclusiveScan")
+        subgroupInclusiveMax = (gen-subgroup-arith 'Max ".InclusiveScan")
+        subgroupInclusiveAnd = (gen-subgroup-arith 'And ".InclusiveScan")
+        subgroupInclusiveOr = (gen-subgroup-arith 'Or ".InclusiveScan")
+        subgroupInclusiveXor = (gen-subgroup-arith 'Xor ".InclusiveScan")
+
+        subgroupExclusiveAdd = (gen-subgroup-arith 'Add ".ExclusiveScan")
+        subgroupExclusiveMul = (gen-subgroup-arith 'Mul ".ExclusiveScan")
+        subgroupExclusiveMin = (gen-subgroup-arith 'Min ".ExclusiveScan")
+        subgroupExclusiveMax = (gen-subgroup-arith 'Max ".ExclusiveScan")
+        subgroupExclusiveAnd = (gen-subgroup-arith 'And ".ExclusiveScan")
+        subgroupExclusiveOr = (gen-subgroup-arith 'Or ".ExclusiveScan")
+        subgroupExclusiveXor = (gen-subgroup-arith 'Xor ".ExclusiveScan")
+
+        subgroupClusteredAdd = (gen-subgroup-clustered 'Add)
+        subgroupClusteredMul = (gen-subgroup-clustered 'Mul)
+        subgroupClusteredMin = (gen-subgroup-clustered 'Min)
+        subgroupClusteredMax = (gen-subgroup-clustered 'Max)
+        subgroupClusteredAnd = (gen-subgroup-clustered 'And)
+        subgroupClusteredOr = (gen-subgroup-clustered 'Or)
+        subgroupClusteredXor = (gen-subgroup-clustered 'Xor)
+
     struct DispatchIndirectCommand plain
         num_groups_x : u32 = 1
         num_groups_y : u32 = 1
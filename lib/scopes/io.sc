@@ -0,0 +1,639 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""io
+    ==
+
+    Provides non-blocking sockets for services that handle many connections
+    at once. An operation that has to wait parks the calling coroutine with
+    the event loop of the runtime, which uses epoll, or kqueue on macOS, and
+    resumes it on the thread pool once the socket is ready. Outside of a
+    coroutine, the calling thread runs other tasks while it waits. `serve`
+    runs every connection in a coroutine of its own:
+
+        :::scopes
+        using import io
+
+        let listener = (listen-tcp 8080)
+        serve listener
+            inline (client)
+                local buffer = (Buffer)
+                while (('read-from buffer client) > 0)
+                    'write-to buffer client
+
+    A `Buffer` receives data straight into its free space and sends data
+    straight from its unread bytes; data is only copied when the unread bytes
+    are moved to the front to make room.
+
+    Files are opened as a `File`, which is read and written directly like a
+    socket. A `Reader` reads a file or socket in large chunks, and a `Writer`
+    collects small writes, so that most reads and writes don't need a system
+    call:
+
+        :::scopes
+        let file = (File "access.log")
+        'advise file 'sequential
+        local reader = (Reader file)
+        local count = 0
+        for line in ('lines reader)
+            if ((lslice line 3) == "GET")
+                count += 1
+
+    Lines and chunks are `Span`s of the buffered bytes, which parsers can
+    work on in place; they remain valid until the next read. `'writev` sends
+    the collected bytes and further buffers with a single system call.
+
+    Failed operations raise an `IOError`. Windows is not supported yet.
+
+using import C.socket
+using import task
+using import Span
+
+# declare void @llvm.memmove.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
+                                         i64 <len>, i1 <isvolatile>)
+let llvm.memmove.p0i8.p0i8.i64 =
+    extern 'llvm.memmove.p0i8.p0i8.i64
+        function void (mutable rawstring) rawstring i64 bool
+
+inline move-bytes (dest src count)
+    llvm.memmove.p0i8.p0i8.i64
+        bitcast dest (mutable rawstring)
+        bitcast src rawstring
+        count as i64
+        false
+
+let memchr =
+    extern 'memchr
+        function voidstar voidstar i32 usize
+
+let LISTEN_BACKLOG = 128
+let DEFAULT_BUFFER_CAPACITY = 4096:usize
+let DEFAULT_READ_SIZE = 4096:usize
+# readers and writers move data in chunks of this size
+let DEFAULT_CHUNK_SIZE = 65536:usize
+
+typedef IOError : i32
+    """"The error of a failed operation, which carries the errno value.
+    inline __typecall (cls code)
+        bitcast (code as i32) cls
+
+    """"Returns the errno value of the error.
+    inline code (self)
+        storagecast self
+
+# raises the error of a runtime io function, which returns -errno
+inline check (result)
+    if (result < 0)
+        raise (IOError (- result))
+    result
+
+# raises the error of a C library function, which sets errno
+inline check-errno (result)
+    if (result < 0)
+        raise (IOError (sc_io_errno))
+    result
+
+fn write-all-fd (fd buf size)
+    let size = (size as i64)
+    let buf = (bitcast buf rawstring)
+    loop (offset = 0:i64)
+        if (offset >= size)
+            break;
+        let written =
+            check
+                sc_io_write fd (bitcast (& (buf @ offset)) voidstar)
+                    size - offset
+        repeat (offset + written)
+
+inline advice-code (advice)
+    static-match advice
+    case 'normal 0
+    case 'sequential 1
+    case 'random 2
+    case 'will-need 3
+    case 'dont-need 4
+    default
+        static-error "advice must be one of 'normal 'sequential 'random 'will-need 'dont-need"
+
+typedef Socket :: i32
+    """"A non-blocking socket, which is closed when it is dropped.
+
+    """"Takes ownership of the descriptor `fd` and makes it non-blocking.
+    inline __typecall (cls fd)
+        let fd = (fd as i32)
+        check (sc_io_set_nonblocking fd)
+        bitcast fd cls
+
+    """"Returns the descriptor of the socket.
+    inline fd (self)
+        storagecast (view self)
+
+    """"Read up to `size` bytes into `buf`, and return the number of bytes
+        read, which is 0 at the end of the stream.
+    inline read (self buf size)
+        check (sc_io_read ('fd self) (bitcast buf voidstar) (size as i64))
+
+    """"Write up to `size` bytes from `buf`, and return the number of bytes
+        written.
+    inline write (self buf size)
+        check (sc_io_write ('fd self) (bitcast buf voidstar) (size as i64))
+
+    """"Write all `size` bytes from `buf`.
+    inline write-all (self buf size)
+        write-all-fd ('fd self) buf size
+
+    """"Wait for the next connection on a listening socket and return its
+        socket.
+    inline accept (self)
+        bitcast (check (sc_io_accept ('fd self))) Socket
+
+    """"Returns the port that the socket is bound to.
+    inline local-port (self)
+        local sa : sockaddr_in
+        local size = ((sizeof sa) as u32)
+        check-errno
+            getsockname ('fd self) (bitcast &sa (mutable pointer sockaddr))
+                &size
+        (ntohs sa.sin_port) as i32
+
+    inline __drop (self)
+        close (storagecast (view self))
+        ;
+
+""""Returns a socket that listens for TCP connections on `port` of all
+    addresses of the host. If `port` is 0, the system picks a free port, which
+    `'local-port` returns.
+fn listen-tcp (port)
+    let listener =
+        Socket
+            check-errno
+                socket PF_INET
+                    SOCK_STREAM as integer
+                    IPPROTO_TCP as integer
+    let fd = ('fd listener)
+    local reuse = 1
+    check-errno
+        setsockopt fd (SOL_SOCKET as integer) (SO_REUSEADDR as integer)
+            bitcast &reuse voidstar
+            (sizeof reuse) as u32
+    local sa =
+        sockaddr_in
+            sin_family = AF_INET
+            sin_port = (htons (port as u16))
+            sin_addr =
+                typeinit
+                    s_addr = (htonl INADDR_ANY)
+    check-errno (bind fd (bitcast &sa (pointer sockaddr)) ((sizeof sa) as u32))
+    check-errno (listen fd LISTEN_BACKLOG)
+    listener
+
+""""Returns a socket connected to `port` of the host with the IPv4 address
+    `address`, which is given as string in dotted notation.
+fn connect-tcp (address port)
+    let client =
+        Socket
+            check-errno
+                socket PF_INET
+                    SOCK_STREAM as integer
+                    IPPROTO_TCP as integer
+    local sa =
+        sockaddr_in
+            sin_family = AF_INET
+            sin_port = (htons (port as u16))
+            sin_addr =
+                typeinit
+                    s_addr = (inet_addr (address as rawstring))
+    check
+        sc_io_connect ('fd client) (bitcast &sa voidstar) ((sizeof sa) as i32)
+    client
+
+""""Returns a pair of connected sockets.
+fn socket-pair ()
+    local fds = (arrayof i32 -1 -1)
+    check-errno
+        socketpair AF_UNIX (SOCK_STREAM as integer) 0
+            bitcast &fds (mutable pointer i32)
+    _ (Socket (fds @ 0)) (Socket (fds @ 1))
+
+""""Accept connections on the listening socket `listener` until accepting
+    fails, and call `f client args...` in a coroutine of its own for every
+    connection, where `client` is the `Socket` of the connection. Errors
+    raised by `f` end the connection.
+inline serve (listener f args...)
+    loop ()
+        let fd = (check (sc_io_accept ('fd listener)))
+        'detach
+            spawn-coroutine
+                inline (fd args...)
+                    try
+                        f (bitcast fd Socket) args...
+                        ;
+                    except (err)
+                        ;
+                fd
+                args...
+        repeat;
+
+""""A growing byte buffer for data received from and sent to sockets, which
+    keeps the unread bytes ahead of its free space.
+struct Buffer
+    _data : (mutable @u8)
+    _head : usize
+    _tail : usize
+    _capacity : usize
+
+    """"Returns the number of unread bytes.
+    inline __countof (self)
+        self._tail - self._head
+
+    """"Returns a pointer to the unread bytes.
+    inline data (self)
+        getelementptr (deref self._data) (deref self._head)
+
+    """"Mark the first `count` unread bytes as read.
+    fn consume (self count)
+        let head = (self._head + (count as usize))
+        assert (head <= self._tail) "can't consume more bytes than are unread"
+        if (head == self._tail)
+            # without unread bytes, the free space starts over at the front
+            self._head = 0:usize
+            self._tail = 0:usize
+        else
+            self._head = head
+        return;
+
+    """"Returns a pointer to free space for at least `count` bytes that
+        follows the unread bytes.
+    fn reserve (self count)
+        let count = (count as usize)
+        let head = (deref self._head)
+        let size = (self._tail - head)
+        if ((self._capacity - self._tail) < count)
+            if ((self._capacity - size) >= count)
+                move-bytes (deref self._data) (getelementptr (deref self._data) head) size
+            else
+                let capacity =
+                    loop (capacity = (max (deref self._capacity) DEFAULT_BUFFER_CAPACITY))
+                        if (capacity < (size + count))
+                            repeat (capacity * 2:usize)
+                        break capacity
+                let data = (malloc-array u8 capacity)
+                let old-data = (deref self._data)
+                if ((ptrtoint old-data usize) != 0:usize)
+                    move-bytes data (getelementptr old-data head) size
+                    free old-data
+                self._data = data
+                self._capacity = capacity
+            self._head = 0:usize
+            self._tail = size
+        getelementptr (deref self._data) (deref self._tail)
+
+    """"Mark `count` bytes written to the space returned by `'reserve` as
+        unread.
+    fn commit (self count)
+        let tail = (self._tail + (count as usize))
+        assert (tail <= self._capacity) "can't commit more bytes than reserved"
+        self._tail = tail
+        return;
+
+    """"Append the `size` bytes at `src`, or the bytes of the string `src`.
+    inline append (self src size)
+        let src size =
+            static-if (none? size)
+                _ (src as rawstring) (countof src)
+            else
+                _ (bitcast src rawstring) size
+        let size = (size as usize)
+        move-bytes ('reserve self size) src size
+        'commit self size
+
+    """"Receive up to `size` bytes from `socket`, or as many as fit into one
+        default read, straight into the free space, and return the number of
+        bytes received, which is 0 at the end of the stream.
+    inline read-from (self socket size)
+        let size =
+            static-if (none? size) DEFAULT_READ_SIZE
+            else (size as usize)
+        let count = ('read socket ('reserve self size) size)
+        'commit self count
+        count
+
+    """"Send all unread bytes to `socket` and mark them as read.
+    inline write-to (self socket)
+        let count = (countof self)
+        'write-all socket ('data self) count
+        'consume self count
+
+    """"Mark all bytes as read.
+    fn clear (self)
+        self._head = 0:usize
+        self._tail = 0:usize
+        return;
+
+    inline __drop (self)
+        free (deref self._data)
+
+typedef File :: i32
+    """"A file descriptor, which is closed when it is dropped. Reads and writes
+        on files block the calling thread.
+
+        To open the file at `path`:
+
+            :::scopes
+            File path ['read | 'write | 'append]
+
+        Files are opened for reading unless another mode is given. Writing
+        creates the file or truncates it, and appending creates the file or
+        writes past its end.
+    inline __typecall (cls path mode)
+        let mode =
+            static-if (none? mode) 0
+            else
+                static-match mode
+                case 'read 0
+                case 'write 1
+                case 'append 2
+                default
+                    static-error "mode must be one of 'read 'write 'append"
+        bitcast (check (sc_io_open path mode)) cls
+
+    """"Returns the descriptor of the file.
+    inline fd (self)
+        storagecast (view self)
+
+    """"Read up to `size` bytes into `buf`, and return the number of bytes
+        read, which is 0 at the end of the file.
+    inline read (self buf size)
+        check (sc_io_read ('fd self) (bitcast buf voidstar) (size as i64))
+
+    """"Write up to `size` bytes from `buf`, and return the number of bytes
+        written.
+    inline write (self buf size)
+        check (sc_io_write ('fd self) (bitcast buf voidstar) (size as i64))
+
+    """"Write all `size` bytes from `buf`.
+    inline write-all (self buf size)
+        write-all-fd ('fd self) buf size
+
+    """"Hint at how `count` bytes of the file from `offset` on will be read,
+        or all of the file if no range is given. `advice` is one of
+        `'normal`, `'sequential`, `'random`, `'will-need` and `'dont-need`.
+    inline advise (self advice offset count)
+        let offset = (static-if (none? offset) 0 else offset)
+        # a count of 0 reaches to the end of the file
+        let count = (static-if (none? count) 0 else count)
+        check
+            sc_io_advise ('fd self) (offset as i64) (count as i64)
+                advice-code advice
+        ;
+
+    inline __drop (self)
+        close (storagecast (view self))
+        ;
+
+# a buffer to write, laid out like struct iovec
+struct IOSlice plain
+    data : voidstar
+    size : u64
+
+inline slice-of (value)
+    let T = (typeof value)
+    static-if (T == string)
+        IOSlice (bitcast (value as rawstring) voidstar) ((countof value) as u64)
+    else
+        let view =
+            static-if ((unqualified T) < Span) value
+            else ('span value)
+        let ET = ((typeof view) . ElementType)
+        IOSlice (bitcast ('data view) voidstar)
+            ((countof view) * (sizeof ET)) as u64
+
+# writes all count slices, which are changed to skip what was written
+fn write-slices (fd slices count)
+    loop (first = 0)
+        if (first == count)
+            break;
+        let written =
+            check
+                sc_io_writev fd (bitcast (& (slices @ first)) voidstar)
+                    count - first
+        # skip the slices that were written completely, and the written part
+          of the first one that was not
+        loop (first written = first (written as u64))
+            if (first == count)
+                break first
+            let slice = (slices @ first)
+            if (written < slice.size)
+                slice.data =
+                    bitcast (getelementptr (bitcast slice.data (pointer u8)) written)
+                        voidstar
+                slice.size -= written
+                break first
+            _ (first + 1) (written - slice.size)
+
+""""Reads a file or socket in chunks, and gives direct access to the bytes it
+    has read ahead.
+
+    To read from `source`, which is a `File`, a `Socket` or any value
+    with a `'fd` method, in chunks of `size` bytes or 64 KiB:
+
+        :::scopes
+        local reader = (Reader source [size])
+
+    The reader does not own the descriptor of `source`, which must remain
+    open for as long as the reader is used.
+struct Reader
+    _fd : i32
+    _buffer : Buffer
+    _chunk-size : usize
+
+    inline __typecall (cls source size)
+        Struct.__typecall cls
+            _fd = ('fd source)
+            _chunk-size =
+                static-if (none? size) DEFAULT_CHUNK_SIZE
+                else (size as usize)
+
+    """"Returns the number of bytes that have been read ahead and not yet
+        consumed.
+    inline __countof (self)
+        countof self._buffer
+
+    """"Returns a pointer to the bytes that have been read ahead.
+    inline data (self)
+        'data self._buffer
+
+    """"Returns a `Span` of the bytes that have been read ahead.
+    inline span (self)
+        (Span u8) ('data self._buffer) (countof self._buffer)
+
+    """"Mark the first `count` bytes that have been read ahead as consumed.
+    inline consume (self count)
+        'consume self._buffer count
+
+    """"Read the next chunk behind the bytes that have been read ahead, and
+        return the number of bytes read, which is 0 at the end of the stream.
+        Pointers to the bytes read ahead are no longer valid afterwards.
+    fn fill (self)
+        let size = (deref self._chunk-size)
+        let count =
+            check
+                sc_io_read self._fd (bitcast ('reserve self._buffer size) voidstar)
+                    size as i64
+        'commit self._buffer count
+        count
+
+    """"Copy up to `size` bytes to `dest`, and return the number of bytes
+        copied, which is less than `size` only at the end of the stream.
+    fn read (self dest size)
+        let size = (size as usize)
+        let dest = (bitcast dest (mutable @u8))
+        loop (done = 0:usize)
+            if (done == size)
+                break done
+            let count = (countof self._buffer)
+            if (count == 0:usize)
+                # large reads skip the buffer
+                if ((size - done) >= self._chunk-size)
+                    let count =
+                        check
+                            sc_io_read self._fd
+                                bitcast (getelementptr dest done) voidstar
+                                (size - done) as i64
+                    if (count == 0)
+                        break done
+                    repeat (done + (count as usize))
+                if (('fill self) == 0)
+                    break done
+                repeat done
+            let n = (min count (size - done))
+            move-bytes (getelementptr dest done) ('data self._buffer) n
+            'consume self._buffer n
+            done + n
+
+    """"Return the next line without its line feed as a `StringView` of the
+        bytes read ahead, and whether there was one. The last line of the
+        stream doesn't need to end with a line feed.
+    fn read-line (self)
+        loop (scanned = 0:usize)
+            let data = ('data self._buffer)
+            let count = (countof self._buffer)
+            let found =
+                memchr (bitcast (getelementptr data scanned) voidstar) 10
+                    count - scanned
+            if ((ptrtoint found usize) != 0:usize)
+                let length = ((ptrtoint found usize) - (ptrtoint data usize))
+                let line = (StringView (bitcast data rawstring) length)
+                'consume self._buffer (length + 1:usize)
+                return line true
+            if (('fill self) == 0)
+                let line = (StringView (bitcast data rawstring) count)
+                'consume self._buffer count
+                return line (count > 0:usize)
+            repeat count
+
+    """"Returns a generator of the lines of the stream, as `read-line`
+        returns them. Every line is valid until the next one is read.
+    inline lines (self)
+        Generator
+            inline () ('read-line self)
+            inline (line ok?) ok?
+            inline (line ok?) line
+            inline (line ok?) ('read-line self)
+
+    """"Returns a generator of the bytes of the stream as a `Span` of every
+        chunk that has been read ahead, which is consumed once the next one
+        is read.
+    inline chunks (self)
+        inline next ()
+            if (((countof self._buffer) > 0:usize) or (('fill self) > 0))
+                'span self
+            else
+                (Span u8)
+        Generator
+            inline () (next)
+            inline (chunk) ((countof chunk) > 0:usize)
+            inline (chunk) chunk
+            inline (chunk)
+                'consume self._buffer (countof chunk)
+                next;
+
+""""Collects writes to a file or socket, and writes them in chunks.
+
+    To write to `target`, which is a `File`, a `Socket` or any value with a
+    `'fd` method, in chunks of `size` bytes or 64 KiB:
+
+        :::scopes
+        local writer = (Writer target [size])
+
+    The collected bytes are written when a chunk is full, by `'flush` or when
+    the writer is dropped, where failures go unnoticed; call `'flush` to see
+    them. The writer does not own the descriptor of `target`, which must
+    remain open for as long as the writer is used.
+struct Writer
+    _fd : i32
+    _buffer : Buffer
+    _chunk-size : usize
+
+    inline __typecall (cls target size)
+        Struct.__typecall cls
+            _fd = ('fd target)
+            _chunk-size =
+                static-if (none? size) DEFAULT_CHUNK_SIZE
+                else (size as usize)
+
+    """"Returns the number of collected bytes that have not been written.
+    inline __countof (self)
+        countof self._buffer
+
+    """"Write all collected bytes.
+    fn flush (self)
+        let count = (countof self._buffer)
+        write-all-fd self._fd ('data self._buffer) count
+        'consume self._buffer count
+        return;
+
+    """"Collect the `size` bytes at `src`, or the bytes of `src`, which is a
+        string, a `String`, an `Array` or a `Span`. Writes that would fill
+        more than a chunk write the collected bytes first, and writes of a
+        chunk or more bypass the collected bytes.
+    inline write (self src size)
+        let slice =
+            static-if (none? size) (slice-of src)
+            else (IOSlice (bitcast src voidstar) (size as u64))
+        let size = (slice.size as usize)
+        if (((countof self._buffer) + size) > self._chunk-size)
+            'flush self
+        if (size >= self._chunk-size)
+            write-all-fd self._fd slice.data size
+        else
+            'append self._buffer slice.data size
+
+    """"Write the collected bytes followed by the bytes of each of `values`,
+        which are strings, `String`s, `Array`s or `Span`s, with as few system
+        calls as the system allows, usually one.
+    inline writev (self values...)
+        local slices =
+            arrayof IOSlice
+                IOSlice (bitcast ('data self._buffer) voidstar)
+                    (countof self._buffer) as u64
+                va-map slice-of values...
+        write-slices self._fd (bitcast &slices (mutable pointer IOSlice))
+            (va-countof values...) + 1
+        'clear self._buffer
+
+    inline __drop (self)
+        try ('flush self)
+        except (err)
+            ;
+        Struct.__drop self
+
+unlet check check-errno move-bytes write-all-fd advice-code slice-of
+    \ write-slices
+
+do
+    let IOError Socket Buffer File Reader Writer listen-tcp connect-tcp
+        \ socket-pair serve
+    locals;
@@ -7,7 +7,8 @@
     =========
 
     itertools provides various utilities which simplify the composition of
-    generators and collectors.
+    generators and collectors, as well as loops that run on all threads of
+    the runtime's thread pool.
 
 using import spicetools
 
@@ -675,9 +676,130 @@ inline retain (mapl ...)
 
 unlet cascade1 retain1
 
+#---------------------------------------------------------------------------
+# parallel loops
+#---------------------------------------------------------------------------
+
+# with several chunks per thread, threads that finish early can take over
+  work from the others
+let PARALLEL_CHUNKS_PER_THREAD = 8:i64
+
+inline default-chunk-size (count)
+    let threads = ((sc_thread_count) as i64)
+    max 1:i64
+        (count as i64) // (threads * PARALLEL_CHUNKS_PER_THREAD)
+
+@@ memo
+inline chunk-runner (ContextType body)
+    static-typify
+        fn (ctx chunk begin end)
+            let args = (@ (bitcast ctx (pointer ContextType)))
+            body chunk begin end (unpack args)
+            ;
+        \ voidstar i64 i64 i64
+
+# calls body (chunk begin end args...) for every chunk on the thread pool;
+  the arguments travel to the other threads by copy
+inline run-chunks (count chunk-size body args...)
+    local ctx = (tupleof args...)
+    sc_parallel_for 0:i64 count chunk-size
+        chunk-runner (typeof ctx) body
+        bitcast (& ctx) voidstar
+
+inline parallel-options (count opts...)
+    let chunk-size =
+        va-option chunk-size opts... (default-chunk-size count)
+    _ (max 1:i64 (chunk-size as i64))
+        va-map
+            inline (k...) (static-if ((keyof k...) == unnamed) k...)
+            opts...
+
+inline parallel-for (count f args...)
+    """"Calls `f i args...` for every `i` in the range `[0, count)`, using all
+        threads of the runtime's thread pool, and returns when all calls have
+        completed. The calls happen in no particular order.
+
+        `f` is inlined into the loop over each chunk of the range, so it must
+        not capture runtime values; these are passed as `args...` instead,
+        which are copied to the other threads. Mutable state is best passed
+        by pointer:
+
+            :::scopes
+            let ages = ('span particles 'age)
+            parallel-for (countof particles)
+                inline (i ages)
+                    ages @ i += 1.0
+                ages
+
+        An argument `(chunk-size = n)` sets the number of indices per chunk.
+        Loops that run inside a parallel loop are split up among the threads
+        that are idle.
+    let count = (count as i64)
+    let chunk-size args... = (parallel-options count args...)
+    run-chunks count chunk-size
+        inline (chunk begin end args...)
+            for i in (range begin end)
+                f i args...
+        args...
+
+inline parallel-each (src f args...)
+    """"Calls `f (src @ i) args...` for every element of `src`, which can be
+        any array or other reference that supports `countof` and `@`, in
+        parallel as `parallel-for` does.
+    let count = ((countof src) as i64)
+    let chunk-size args... = (parallel-options count args...)
+    run-chunks count chunk-size
+        inline (chunk begin end src args...)
+            let src = (@ src)
+            for i in (range begin end)
+                f (src @ i) args...
+        & src
+        args...
+
+inline parallel-reduce (count init f combine args...)
+    """"Returns the combination of `f i args...` for every `i` in the range
+        `[0, count)` through `combine`, computed in parallel as `parallel-for`
+        does. Each chunk folds its own values starting at `init`, so `init`
+        must leave values unchanged under `combine`; the results of the
+        chunks are then combined in order, so `combine` must be associative,
+        but needn't be commutative.
+
+            :::scopes
+            let sum =
+                parallel-reduce (countof values) 0:f64
+                    inline (i values) ((values @ i) as f64)
+                    +
+                    values
+    let count = (count as i64)
+    let T = (typeof init)
+    static-assert (plain? T) "reduction value must be of plain type"
+    let chunk-size args... = (parallel-options count args...)
+    let numchunks = ((count + chunk-size - 1:i64) // chunk-size)
+    if (numchunks <= 0:i64)
+        deref init
+    else
+        let partials = (malloc-array T numchunks)
+        run-chunks count chunk-size
+            inline (chunk begin end partials init args...)
+                let acc =
+                    fold (acc = (deref init)) for i in (range begin end)
+                        combine acc (f i args...)
+                partials @ chunk = acc
+            partials
+            init
+            args...
+        let result =
+            fold (acc = (deref (partials @ 0))) for i in (range 1:i64 numchunks)
+                combine acc (partials @ i)
+        free partials
+        result
+
+unlet default-chunk-size chunk-runner run-chunks parallel-options
+
 do
     let span dim bitdim imap ipair join zip span join collect each compose cat
         \ ->> flatten map reduce drain limit gate filter take cascade mux
         \ demux retain permutate-range iterbits closest va-ordered-insert
+        \ parallel-for parallel-each parallel-reduce
 
     locals;
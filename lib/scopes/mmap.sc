@@ -0,0 +1,139 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""mmap
+    ====
+
+    Maps files into memory, so that their contents can be read, and written,
+    in place rather than through buffers. Pages are only loaded as they are
+    touched, so files larger than the available memory can be processed:
+
+        :::scopes
+        using import mmap
+
+        let map = (MappedFile "data.bin")
+        'advise map 'sequential
+        local sum = 0:u64
+        for byte in map
+            sum += byte
+
+    Writes to a writable map change the file itself; they reach the disk when
+    the map is synced or dropped, or whenever the system sees fit.
+
+typedef MapError : i32
+    """"The error of a failed mapping, which carries the errno value.
+    inline __typecall (cls code)
+        bitcast (code as i32) cls
+
+    """"Returns the errno value of the error.
+    inline code (self)
+        storagecast self
+
+inline advice-code (advice)
+    static-match advice
+    case 'normal 0
+    case 'sequential 1
+    case 'random 2
+    case 'will-need 3
+    case 'dont-need 4
+    default
+        static-error "advice must be one of 'normal 'sequential 'random 'will-need 'dont-need"
+
+inline checked (result)
+    if (result < 0)
+        raise (MapError (sc_io_errno))
+    ;
+
+typedef MappedFile :: voidstar
+    """"A file mapped into memory as a whole, which is unmapped when it is
+        dropped.
+
+        To map the file at `path`:
+
+            :::scopes
+            MappedFile path [(writable? = false)] [(size = n)]
+
+        A writable map can be written through its data pointer; writing to a
+        map that is only readable crashes. If `size` is passed, the file is
+        resized to `size` bytes before it is mapped, and created if it is
+        writable. Failures raise a `MapError`.
+    inline __typecall (cls path opts...)
+        let writable? = (va-option writable? opts... false)
+        let size = (va-option size opts... -1)
+        let map = (sc_file_map_open path writable? (size as i64))
+        if ((ptrtoint map usize) == 0:usize)
+            raise (MapError (sc_io_errno))
+        bitcast map cls
+
+    inline handle (self)
+        storagecast (view self)
+
+    """"Implements support for the `countof` operator. Returns the size of the
+        file in bytes.
+    inline __countof (self)
+        (sc_file_map_size ('handle self)) as usize
+
+    """"Returns a pointer to the first byte of the file, which is null if the
+        file is empty.
+    inline data (self)
+        bitcast (sc_file_map_data ('handle self)) (mutable @u8)
+
+    """"Returns a pointer to the contents of the file as elements of type `T`,
+        and the number of whole elements that fit into the file.
+    inline span (self T)
+        _ (bitcast ('data self) (mutable pointer T))
+            (countof self) // (sizeof T)
+
+    """"Implements support for the `@` operator. Returns the byte at `index`.
+    inline __@ (self index)
+        let index = (index as usize)
+        assert (index < (countof self)) "index out of bounds"
+        deref (('data self) @ index)
+
+    """"Implements support for the `as` operator. Maps can be cast to
+        `Generator`, or directly passed to `for`, which yields every byte.
+    inline __as (cls T)
+        static-if (T == Generator)
+            inline (self)
+                let data = ('data self)
+                let count = (countof self)
+                Generator
+                    inline () 0:usize
+                    inline (i) (i < count)
+                    inline (i) (deref (data @ i))
+                    inline (i) (i + 1:usize)
+
+    """"Tell the system how the bytes in `[offset, offset + count)`, or the
+        whole file, will be accessed, as one of `'normal`, `'sequential`,
+        `'random`, `'will-need` or `'dont-need`.
+    inline advise (self advice offset count)
+        let offset =
+            static-if (none? offset) 0:u64
+            else (offset as u64)
+        let count =
+            static-if (none? count) (sc_file_map_size ('handle self))
+            else (count as u64)
+        checked
+            sc_file_map_advise ('handle self) offset count (advice-code advice)
+
+    """"Write the changes to the bytes in `[offset, offset + count)`, or to
+        the whole file, back to the disk, and wait until they are written.
+    inline sync (self offset count)
+        let offset =
+            static-if (none? offset) 0:u64
+            else (offset as u64)
+        let count =
+            static-if (none? count) (sc_file_map_size ('handle self))
+            else (count as u64)
+        checked (sc_file_map_sync ('handle self) offset count)
+
+    inline __drop (self)
+        sc_file_map_close ('handle self)
+
+unlet advice-code checked
+
+do
+    let MappedFile MapError
+    locals;
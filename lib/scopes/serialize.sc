@@ -0,0 +1,362 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""serialize
+    =========
+
+    Encodes values into bytes and decodes them again, with an encoder and a
+    decoder that are generated for every type at compile time from the
+    layout of the type:
+
+        :::scopes
+        using import serialize
+        using import struct
+        using import Array
+        using import String
+
+        struct Record
+            name : String
+            scores : (Array f32)
+
+        local buffer : (Array u8)
+        encode buffer (Record (String "ada") ((Array f32)))
+        local decoder = (Decoder buffer)
+        let record = (decode Record decoder)
+
+    Plain values, such as numbers, vectors and structs of plain fields, are
+    copied as they are laid out in memory. `String` and `Array` write their
+    element count followed by their elements, which are copied in a single
+    block when they are plain. Other structs and tuples write their fields in
+    order, and tagged enums write their tag followed by the payload of the
+    tag. Types can provide their own encoding by implementing
+    `__encode (self buffer)` and `__decode (cls decoder)`.
+
+    Values are encoded in the byte order and layout of the target, and are
+    meant to be read back by programs built for the same target.
+
+    For arrays of plain records that are read back directly from memory, the
+    fixed layout variant writes a header followed by the records as they are
+    laid out in memory. `read-fixed` checks the header and returns a `Span`
+    of the records in place, without decoding anything, which makes it
+    suited to files mapped with `mmap`:
+
+        :::scopes
+        using import mmap
+        let map = (MappedFile "particles.bin")
+        let particles = (read-fixed Particle ('data map) (countof map))
+
+using import enum
+using import struct
+using import Array
+using import Span
+
+# declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
+                                        i64 <len>, i1 <isvolatile>)
+let llvm.memcpy.p0i8.p0i8.i64 =
+    extern 'llvm.memcpy.p0i8.p0i8.i64
+        function void (mutable rawstring) rawstring i64 bool
+
+enum SerializeError
+    # the input ended in the middle of a value
+    Truncated
+    # an enum tag that the type does not have
+    InvalidTag
+    # a fixed layout header that doesn't match the record type
+    LayoutMismatch
+
+inline copy-bytes (dest src size)
+    llvm.memcpy.p0i8.p0i8.i64
+        bitcast dest (mutable rawstring)
+        bitcast src rawstring
+        (size as usize) as i64
+        false
+
+# appends size bytes at ptr to the byte array buffer
+inline write-bytes (buffer ptr size)
+    let size = (size as usize)
+    let dest = ('emplace-append-many buffer size)
+    copy-bytes dest ptr size
+
+spice has-symbol? (T symbol)
+    T as:= type
+    symbol as:= Symbol
+    try
+        '@ T symbol
+        `true
+    except (err)
+        `false
+
+# String and Array, whose elements can be viewed as a Span
+inline sequence? (T)
+    has-symbol? T 'ViewType
+
+# the type of the tag of an enum
+spice tag-type (T)
+    T as:= type
+    'element@ ('storageof T) 0
+
+# the bytes of a type's storage and its field types as a constant, which
+  identifies the layout of fixed records
+spice layout-hash (T)
+    T as:= type
+    `[((hash (tostring ('storageof T))) as u64)]
+
+run-stage;
+
+typedef Decoder < Struct
+
+""""Reads encoded values from a range of bytes, which it does not own.
+
+    To decode the bytes `[data, data + count)`:
+
+        :::scopes
+        local decoder = (Decoder data count)
+
+    A `Span` of bytes, an `Array` of bytes or a mapped file can be passed in
+    place of both arguments.
+typedef+ Decoder
+    struct Decoder < this-type
+        _data : (pointer u8)
+        _count : usize
+        _offset : usize
+
+    inline... __typecall
+    case (cls : type, data, count)
+        Struct.__typecall cls
+            _data = (bitcast data (pointer u8))
+            _count = (count as usize)
+            _offset = 0:usize
+    case (cls : type, source)
+        this-function cls (bitcast ('data source) (pointer u8)) (countof source)
+    case (cls : type, source : (typematch T < Array))
+        this-function cls ('span source)
+
+    """"Returns the number of bytes that have not been decoded yet.
+    inline remaining (self)
+        self._count - self._offset
+
+    """"Raises `SerializeError.Truncated` unless at least `size` bytes remain.
+    fn require (self size)
+        if (size > ('remaining self))
+            raise (SerializeError.Truncated)
+
+    """"Copies the next `size` bytes to `dest`, and raises
+        `SerializeError.Truncated` if fewer remain.
+    fn read (self dest size)
+        let size = (size as usize)
+        'require self size
+        copy-bytes dest (getelementptr self._data self._offset) size
+        self._offset += size
+        ;
+
+#-------------------------------------------------------------------------------
+
+# the block of an expression calling the encoder of codec for every field of
+  value
+spice encode-fields (codec buffer value)
+    let encode = ('@ (codec as type) 'encoder)
+    let T = ('strip-qualifiers ('typeof value))
+    let ST = ('storageof T)
+    let block = (sc_expression_new)
+    for i in (range ('element-count ST))
+        let _ ET = ('keyof ('element@ ST i))
+        sc_expression_append block
+            `((encode ET) buffer (extractvalue value i))
+    block
+
+# constructs T from a value of every field type, decoded by the decoder of
+  codec
+spice decode-fields (T codec decoder)
+    T as:= type
+    let decode = ('@ (codec as type) 'decoder)
+    let ST = ('storageof T)
+    let fields =
+        sc_argument_list_map_new ('element-count ST)
+            inline (i)
+                let _ ET = ('keyof ('element@ ST i))
+                `((decode ET) decoder)
+    `(T fields)
+
+# switches over the tag of the enum T, constructing the value of the tag
+  from its decoded payload
+spice decode-enum (T tag codec decoder)
+    T as:= type
+    let decode = ('@ (codec as type) 'decoder)
+    let sw = (sc_switch_new tag)
+    for field in ('args ('@ T '__fields__))
+        let FT = (field as type)
+        let lit = ('@ FT 'Literal)
+        let PT = (('@ FT 'Type) as type)
+        let value =
+            if (PT == Nothing) `(FT)
+            else
+                let args =
+                    sc_argument_list_map_new ('element-count PT)
+                        inline (i)
+                            let _ ET = ('keyof ('element@ PT i))
+                            `((decode ET) decoder)
+                `(FT args)
+        sc_switch_append_case sw lit value
+    sc_switch_append_default sw `(raise (SerializeError.InvalidTag))
+    sw
+
+run-stage;
+
+# holds the generated encoders and decoders, which look up the codecs of
+  their elements through the type
+typedef Codec
+    @@ memo
+    inline encoder (T)
+        static-if (has-symbol? T '__encode)
+            fn (buffer value)
+                '__encode value buffer
+        elseif (plain? T)
+            fn (buffer value)
+                local value : T = value
+                write-bytes buffer (& value) (sizeof T)
+        elseif (sequence? T)
+            let ET = T.ElementType
+            fn (buffer value)
+                let count = (countof value)
+                (this-type.encoder u64) buffer (count as u64)
+                static-if (plain? ET)
+                    write-bytes buffer ('data ('span value)) (count * (sizeof ET))
+                else
+                    for element in value
+                        (this-type.encoder ET) buffer element
+        elseif (T < Enum)
+            let TagT = (tag-type T)
+            fn (buffer value)
+                'apply value
+                    inline (FT payload...)
+                        (this-type.encoder TagT) buffer (FT.Literal as TagT)
+                        va-map
+                            inline (x)
+                                (this-type.encoder (unqualified (typeof x))) buffer x
+                            payload...
+                        ;
+        elseif ((T < Struct) or (T < tuple))
+            fn (buffer value)
+                encode-fields this-type buffer value
+        else
+            static-error (.. "can't encode values of type " (tostring T))
+
+    @@ memo
+    inline decoder (T)
+        static-if (has-symbol? T '__decode)
+            fn (d)
+                T.__decode d
+        elseif (plain? T)
+            fn (d)
+                local value = (nullof T)
+                'read d (& value) (sizeof T)
+                deref value
+        elseif (sequence? T)
+            let ET = T.ElementType
+            fn (d)
+                let count = (((this-type.decoder u64) d) as usize)
+                local result = (T)
+                static-if (plain? ET)
+                    let size = (count * (sizeof ET))
+                    # don't allocate for a count that the input can't hold
+                    'require d size
+                    'resize result count
+                    if (count > 0:usize)
+                        'read d (& (result @ 0)) size
+                else
+                    for i in (range count)
+                        'append result ((this-type.decoder ET) d)
+                deref result
+        elseif (T < Enum)
+            fn (d)
+                let tag = ((this-type.decoder (tag-type T)) d)
+                decode-enum T tag this-type d
+        elseif ((T < Struct) or (T < tuple))
+            fn (d)
+                decode-fields T this-type d
+        else
+            static-error (.. "can't decode values of type " (tostring T))
+
+""""Appends the encoding of `value` to the byte array `buffer`.
+inline encode (buffer value)
+    (Codec.encoder (unqualified (typeof value))) buffer value
+
+""""Decodes the next value of type `T` from `decoder`. Raises a
+    `SerializeError` if the input is truncated or does not encode a `T`.
+inline decode (T decoder)
+    (Codec.decoder T) decoder
+
+#-------------------------------------------------------------------------------
+
+let FixedMagic = 0x58464353:u32 # "SCFX"
+
+""""The header of records in fixed layout, which is followed by `count`
+    records of `element-size` bytes each.
+struct FixedHeader plain
+    magic : u32
+    element-size : u32
+    count : u64
+    # identifies the layout of the record type
+    layout : u64
+    _reserved : u64
+
+# records following a header are aligned to this many bytes
+let FixedAlignment = 16:usize
+
+""""Appends the plain records of the `Array` or `Span` `items` in fixed
+    layout to the byte array `buffer`: after padding to a multiple of 16
+    bytes, a `FixedHeader` followed by a copy of the records in memory.
+inline write-fixed (buffer items)
+    let items =
+        static-if ((typeof items) < Span) items
+        else ('span items)
+    let T = ((typeof items) . ElementType)
+    static-assert (plain? T) "fixed records must be of plain type"
+    static-assert ((alignof T) <= FixedAlignment)
+        "fixed records can't be aligned to more than 16 bytes"
+    let padding = ((FixedAlignment - ((countof buffer) % FixedAlignment)) % FixedAlignment)
+    'emplace-append-many buffer padding
+    local header =
+        FixedHeader
+            magic = FixedMagic
+            element-size = ((sizeof T) as u32)
+            count = ((countof items) as u64)
+            layout = (layout-hash T)
+    write-bytes buffer (& header) (sizeof FixedHeader)
+    write-bytes buffer ('data items) ((countof items) * (sizeof T))
+
+""""Returns a `Span` of the records of type `T` that `write-fixed` stored at
+    `[data, data + size)`, which views the records in place. Raises
+    `SerializeError.LayoutMismatch` if the header was written for a different
+    record type or the records are misaligned, and `SerializeError.Truncated`
+    if the range doesn't hold all records.
+inline read-fixed (T data size)
+    let data = (bitcast data (pointer u8))
+    let size = (size as usize)
+    let SpanT = (Span T)
+    fn (data size)
+        if (size < (sizeof FixedHeader))
+            raise (SerializeError.Truncated)
+        local header : FixedHeader
+        copy-bytes (& header) data (sizeof FixedHeader)
+        if ((header.magic != FixedMagic)
+            or (header.element-size != ((sizeof T) as u32))
+            or (header.layout != (layout-hash T)))
+            raise (SerializeError.LayoutMismatch)
+        let count = (header.count as usize)
+        if (((size - (sizeof FixedHeader)) // (sizeof T)) < count)
+            raise (SerializeError.Truncated)
+        let records = (getelementptr data (sizeof FixedHeader))
+        if (((ptrtoint records usize) % (alignof T)) != 0:usize)
+            raise (SerializeError.LayoutMismatch)
+        SpanT (bitcast records (pointer T)) count
+    \ data size
+
+unlet Codec encode-fields decode-fields decode-enum has-symbol?
+    \ sequence? tag-type layout-hash copy-bytes write-bytes
+
+do
+    let encode decode Decoder SerializeError FixedHeader write-fixed read-fixed
+    locals;
@@ -0,0 +1,121 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""task
+    ====
+
+    Runs functions as tasks on the thread pool of the runtime, which also runs
+    the parallel loops of `itertools`. Every thread of the pool keeps a queue
+    of the tasks it spawns, and a thread that runs out of tasks steals from
+    the queues of the others:
+
+        :::scopes
+        using import task
+
+        let task =
+            spawn
+                inline (x)
+                    print x
+                42
+        'join task
+
+    A thread that waits for a task runs other tasks in the meantime. A task
+    spawned with `spawn-coroutine` runs on a stack of its own instead, and is
+    suspended whenever it yields or waits, so that its thread is free to run
+    other tasks until it can resume, possibly on another thread.
+
+    The arguments passed to the spawned function are copied to the task, and
+    must be plain; shared state is best passed by pointer.
+
+# calls f with the arguments stored at ctx, then frees them
+@@ memo
+inline task-runner (ContextType f)
+    static-typify
+        fn (ctx)
+            let ptr = (bitcast ctx (mutable pointer ContextType))
+            f (unpack (@ ptr))
+            free ptr
+            ;
+        voidstar
+
+typedef Task :: voidstar
+    """"A handle to a spawned task, which waits for the task to complete when
+        it is dropped.
+
+    """"Wait for the task to complete. Other tasks run on the calling thread
+        in the meantime, or, in a coroutine, the coroutine is suspended.
+    inline join (self)
+        sc_task_join (storagecast (view self))
+        lose self
+
+    """"Release the handle without waiting; the task completes on its own.
+    inline detach (self)
+        sc_task_detach (storagecast (view self))
+        lose self
+
+    inline __drop (self)
+        sc_task_join (storagecast (view self))
+
+typedef WaitGroup :: voidstar
+    """"Counts pending work, so that a thread can wait for several tasks at
+        once. Tasks that share a wait group receive it by pointer:
+
+            :::scopes
+            local wg = (WaitGroup)
+            'add wg 10
+            for i in (range 10)
+                'detach
+                    spawn
+                        inline (i wg)
+                            'done (@ wg)
+                        i
+                        & wg
+            'wait wg
+    inline __typecall (cls)
+        bitcast (sc_waitgroup_new) cls
+
+    """"Add `count` to the number of pending calls to `done`.
+    inline add (self count)
+        sc_waitgroup_add (storagecast (view self)) (count as i64)
+
+    """"Mark one unit of work as done.
+    inline done (self)
+        sc_waitgroup_done (storagecast (view self))
+
+    """"Wait until `done` has been called as often as the count added; other
+        tasks run in the meantime, as they do for `'join`.
+    inline wait (self)
+        sc_waitgroup_wait (storagecast (view self))
+
+    inline __drop (self)
+        sc_waitgroup_free (storagecast (view self))
+
+inline spawn-task (coroutine? f args...)
+    let ctx = (tupleof args...)
+    let ptr = (malloc (typeof ctx))
+    store ctx ptr
+    bitcast
+        sc_task_spawn (task-runner (typeof ctx) f) (ptr as voidstar) coroutine?
+        Task
+
+inline spawn (f args...)
+    """"Queue a call to `f args...` on the thread pool and return its `Task`.
+    spawn-task false f args...
+
+inline spawn-coroutine (f args...)
+    """"Queue a call to `f args...` as a coroutine on the thread pool and
+        return its `Task`.
+    spawn-task true f args...
+
+inline yield ()
+    """"Suspend the calling coroutine, so that other tasks can run before it
+        resumes. Outside of a coroutine, run one queued task, if there is one.
+    sc_task_yield;
+
+unlet task-runner spawn-task
+
+do
+    let Task WaitGroup spawn spawn-coroutine yield
+    locals;
@@ -9,22 +9,86 @@
     The testing module simplifies writing and running tests in an ad-hoc
     fashion.
 
+    `test-modules` runs its modules one after the other in the running
+    process. If the environment variable `SCOPES_TEST_JOBS` is set to a
+    number, every module runs in a process of its own instead, with that
+    many processes at a time, or one per core for `0`. The processes share
+    the object cache, start with the modules that took longest the last
+    time, and the wall time of every module is reported at the end.
+
+fn print-test-summary (total failed-modules)
+    let failed = (i32 (countof failed-modules))
+    if (failed > 0)
+        print;
+        print "List of failed modules"
+        print "======================"
+        for m in failed-modules
+            print "*" (m as Symbol as string)
+    print;
+    print total "tests executed," (total - failed) "succeeded," failed "failed."
+    print "done."
+
+# the number of processes at a time that SCOPES_TEST_JOBS asks for, or -1
+fn test-jobs ()
+    let value = (sc_getenv "SCOPES_TEST_JOBS")
+    let count = (countof value)
+    if (count == 0)
+        return -1
+    loop (i jobs = 0:usize 0)
+        if (i == count)
+            break jobs
+        let c = ((value @ i) as i32)
+        if ((c < 48) or (c > 57))
+            break -1
+        repeat (i + 1) (jobs * 10 + (c - 48))
+
+fn run-test-modules-in-processes (module-dir modules jobs)
+    let total =
+        i32 (countof modules)
+    let commands =
+        fold (commands = '()) for module in modules
+            let name = (module as Symbol as string)
+            let name =
+                if ((lslice name 1) == ".") (rslice name 1)
+                else name
+            cons
+                .. "\"" compiler-path "\" \"" module-dir "/" name ".sc\""
+                commands
+    # durations are kept out of the source tree, and recorded per module
+        rather than per command, which holds the compiler path
+    let keys =
+        fold (keys = '()) for module in modules
+            cons (module as Symbol as string) keys
+    let results =
+        sc_run_commands ('reverse commands) ('reverse keys) jobs
+            .. cache-dir "/test-durations"
+    let failed-modules =
+        fold (failed-modules = '()) for module result in (zip modules results)
+            let status seconds output = (decons (result as list) 3)
+            print "* running" (module as Symbol as string)
+            print "***********************************************"
+            io-write! (output as string)
+            if ((status as i32) == 0) failed-modules
+            else
+                cons module failed-modules
+    print;
+    print "Wall time per module"
+    print "===================="
+    for module result in (zip modules results)
+        let status seconds = (decons (result as list) 2)
+        print (module as Symbol as string) (seconds as f64) "s"
+    print-test-summary total failed-modules
+
 fn __test-modules (module-dir modules)
+    let jobs = (test-jobs)
+    if (jobs >= 0)
+        return (run-test-modules-in-processes module-dir modules jobs)
     let total =
         i32 (countof modules)
 
     loop (modules failed-modules = modules '())
         if (empty? modules)
-            let failed = (i32 (countof failed-modules))
-            if (failed > 0)
-                print;
-                print "List of failed modules"
-                print "======================"
-                for m in failed-modules
-                    print "*" (m as Symbol as string)
-            print;
-            print total "tests executed," (total - failed) "succeeded," failed "failed."
-            print "done."
+            print-test-summary total failed-modules
             return;
 
         let module modules = (decons modules)
@@ -21,7 +21,6 @@ namespace scopes { namespace abi_aarch64 {
 // Return NULL if the structure is in fact empty, i.e. no nested elements.
 static const Type *is_hfa0 (const Type *ST) {
     switch (ST->kind()) {
-    case TK_Vector:
     case TK_Array:
     case TK_Matrix: {
         auto tt = cast<ArrayLikeType>(ST);
@@ -47,7 +46,6 @@ static const Type *is_hfa0 (const Type *ST) {
 // of the non-structure elements are the same as CANDIDATE.
 static bool is_hfa1 (const Type *ST, const Type *candidate) {
     switch (ST->kind()) {
-    case TK_Vector:
     case TK_Array:
     case TK_Matrix: {
         auto tt = cast<ArrayLikeType>(ST);
@@ -70,8 +68,8 @@ static bool is_hfa1 (const Type *ST, const Type *candidate) {
 /* Determine if TY may be allocated to the FP registers.  This is both an
    fp scalar type as well as an homogenous floating point aggregate (HFA).
    That is, a structure consisting of 1 to 4 members of all the same type,
-   where that type is an fp scalar.
-   Returns non-zero iff TY is an HFA.  The result is the AARCH64_RET_*
+   where that type is an fp scalar, or a short vector of 8 or 16 bytes (HVA).
+   Returns non-zero iff TY is an HFA or HVA.  The result is the AARCH64_RET_*
    constant for the type.  */
 static int is_vfp_type (const Type *ty, const Type *&candidate) {
     size_t size, ele_count;
@@ -82,7 +80,6 @@ static int is_vfp_type (const Type *ty, const Type *&candidate) {
         candidate = ty;
         return 1;
     } break;
-    case TK_Vector:
     case TK_Array:
     case TK_Matrix:
     case TK_Tuple: {
@@ -101,8 +98,8 @@ static int is_vfp_type (const Type *ty, const Type *&candidate) {
     if (!candidate)
         return 0;
 
-    // If the first member is not a floating point type, it's not an HFA.
-    // Also quickly re-check the size of the structure.
+    // If the first member is not a floating point type or a short vector,
+    // it's not an HFA or HVA. Also quickly re-check the size of the structure.
     switch (candidate->kind()) {
     case TK_Real: {
         size_t c_size = size_of(candidate).assert_ok();
@@ -110,6 +107,14 @@ static int is_vfp_type (const Type *ty, const Type *&candidate) {
         if (size != ele_count * c_size)
             return 0;
     } break;
+    case TK_Vector: {
+        size_t c_size = size_of(candidate).assert_ok();
+        if ((c_size != 8) && (c_size != 16))
+            return 0;
+        ele_count = size / c_size;
+        if (size != ele_count * c_size)
+            return 0;
+    } break;
     default: return 0;
     }
     if (ele_count > 4)
@@ -125,6 +130,22 @@ size_t classify(const Type *T, ABIClass *classes) {
     classes[0] = ABI_CLASS_NO_CLASS;
     if (is_opaque(T))
         return 1;
+    switch(T->kind()) {
+    case TK_Array:
+    case TK_Matrix:
+    case TK_Tuple: {
+        // an HVA is passed in up to four vector registers, one per member
+        const Type *ET = nullptr;
+        int count = is_vfp_type(T, ET);
+        if (count && (ET->kind() == TK_Vector)) {
+            for (int i = 0; i < count; ++i) {
+                classes[i] = ABI_CLASS_VECTOR;
+            }
+            return count;
+        }
+    } break;
+    default: break;
+    }
     size_t sz = size_of(T).assert_ok();
     if (sz > 16)
         return 0;
@@ -184,6 +184,12 @@ static size_t classify(const Type *T, ABIClass *classes, size_t offset) {
     } break;
     case TK_Vector: {
         auto tt = cast<VectorType>(T);
+        // like __m128, a 16 byte vector takes up a whole vector register
+        if ((size_of(T).assert_ok() == 16) && !offset) {
+            classes[0] = ABI_CLASS_SSE;
+            classes[1] = ABI_CLASS_SSEUP;
+            return 2;
+        }
         return classify_array_like(size_of(T).assert_ok(),
             storage_type(tt->element_type).assert_ok(), tt->count(), classes, offset);
     } break;
@@ -8,6 +8,11 @@
 #define SCOPES_ALLOC_HPP
 
 #include <vector>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <stdint.h>
+#include <stdlib.h>
 
 namespace scopes {
   constexpr void no_tracking(void* ptr, size_t size) {}
@@ -61,6 +66,92 @@ namespace scopes {
     uint8_t* heap;
     std::vector<uint8_t*> cleanup;
   };
+
+  // bump allocator for objects that share a lifetime; all objects are
+  // destroyed and their memory released at once. no memory is claimed
+  // before the first allocation.
+  struct Arena
+  {
+  public:
+    enum {
+      MinChunkSize = 1 << 12,
+      MaxChunkSize = 1 << 16,
+    };
+
+    inline Arena() : left(0), next_size(MinChunkSize), heap(nullptr), used(0) {}
+    inline ~Arena() { release(); }
+    Arena(const Arena &other) = delete;
+
+    template<typename T, typename ... Args>
+    inline T* make(Args&& ... args) {
+      void* ptr = alloc(sizeof(T), alignof(T));
+      T* obj = new (ptr) T(std::forward<Args>(args)...);
+      if (!std::is_trivially_destructible<T>::value) {
+        dtors.push_back({ obj, [](void* p) { ((T*)p)->~T(); } });
+      }
+      return obj;
+    }
+
+    inline void* alloc(size_t size, size_t align) {
+      size_t pad = (align - ((uintptr_t)heap & (align - 1))) & (align - 1);
+      if ((size + pad) > left) {
+        _grow(size + align);
+        pad = (align - ((uintptr_t)heap & (align - 1))) & (align - 1);
+      }
+      uint8_t* ptr = heap + pad;
+      heap = ptr + size;
+      left -= size + pad;
+      used += size;
+      return ptr;
+    }
+
+    // true if ptr points into memory handed out by this arena
+    inline bool contains(const void* ptr) const {
+      for (auto&& chunk : chunks) {
+        if ((ptr >= chunk.first) && (ptr < (chunk.first + chunk.second)))
+          return true;
+      }
+      return false;
+    }
+
+    // number of bytes handed out since the last release
+    inline size_t size() const { return used; }
+
+    // destroys objects in reverse order of construction
+    inline void release() {
+      for (auto it = dtors.rbegin(); it != dtors.rend(); ++it)
+        it->second(it->first);
+      dtors.clear();
+      for (auto&& chunk : chunks)
+        free(chunk.first);
+      chunks.clear();
+      heap = nullptr;
+      left = 0;
+      next_size = MinChunkSize;
+      used = 0;
+    }
+
+  private:
+    inline void _grow(size_t min) {
+      size_t size = next_size;
+      while (size < min)
+        size *= 2;
+      if (next_size < MaxChunkSize)
+        next_size *= 2;
+      heap = (uint8_t*)malloc(size);
+      if (heap == nullptr) // out of memory
+        abort();
+      chunks.push_back({ heap, size });
+      left = size;
+    }
+
+    size_t left;
+    size_t next_size;
+    uint8_t* heap;
+    size_t used;
+    std::vector< std::pair<uint8_t*, size_t> > chunks;
+    std::vector< std::pair<void*, void (*)(void*)> > dtors;
+  };
 }
 
 #endif
\ No newline at end of file
@@ -7,8 +7,12 @@
 #include "anchor.hpp"
 #include "source_file.hpp"
 #include "hash.hpp"
+#include "intern.hpp"
+#include "alloc.hpp"
+#include "timer.hpp"
 
-#include "absl/container/flat_hash_set.h"
+#include <new>
+#include <atomic>
 
 namespace scopes {
 
@@ -31,7 +35,18 @@ struct KeyEqual {
 };
 } // namespace AnchorSet
 
-static absl::flat_hash_set<const Anchor *, AnchorSet::Hash, AnchorSet::KeyEqual> anchors;
+static InternSet<const Anchor *, AnchorSet::Hash, AnchorSet::KeyEqual> anchors;
+
+// one pool per thread; pools are never freed, as other threads may be
+// holding anchors from it
+static thread_local GreedyAlloc<&no_tracking> *anchor_pool = nullptr;
+static std::atomic<uint64_t> unique_anchors(0);
+
+static MemoryStat anchors_memory("anchors", [](MemoryUsage &usage) {
+    anchors.measure(usage.objects, usage.bytes);
+    usage.objects += unique_anchors.load(std::memory_order_relaxed);
+    usage.bytes += usage.objects * sizeof(Anchor);
+});
 
 static const Anchor *_builtin_anchor = nullptr;
 static const Anchor *_unknown_anchor = nullptr;
@@ -76,12 +91,10 @@ bool Anchor::is_same(const Anchor *other) const {
 const Anchor *Anchor::from(
     Symbol _path, int _lineno, int _column, int _offset, const String *_buffer) {
     Anchor key(_path, _lineno, _column, _offset, _buffer);
-    auto it = anchors.find(&key);
-    if (it != anchors.end())
-        return *it;
-    auto result = new Anchor(_path, _lineno, _column, _offset, _buffer);
-    anchors.insert(result);
-    return result;
+    return anchors.intern(&key, [&]() {
+        return (const Anchor *)new Anchor(
+            _path, _lineno, _column, _offset, _buffer);
+    });
 }
 
 const Anchor *Anchor::from(
@@ -93,6 +106,22 @@ const Anchor *Anchor::from(
     }
 }
 
+const Anchor *Anchor::from_unique(
+    Symbol _path, int _lineno, int _column, int _offset, const String *_buffer) {
+    if (!anchor_pool) {
+        anchor_pool = new GreedyAlloc<&no_tracking>();
+    }
+    // all allocations from the pool have this size, so they stay aligned
+    void *ptr = anchor_pool->alloc(sizeof(Anchor));
+    unique_anchors.fetch_add(1, std::memory_order_relaxed);
+    return new (ptr) Anchor(_path, _lineno, _column, _offset, _buffer);
+}
+
+const Anchor *Anchor::from_unique(
+    const std::unique_ptr<SourceFile> &file, int _lineno, int _column, int _offset) {
+    return Anchor::from_unique(file->path, _lineno, _column, _offset, file->_str);
+}
+
 StyledStream& Anchor::stream(StyledStream& ost) const {
     ost << Style_Location;
     auto ss = StyledStream::plain(ost);
@@ -102,15 +131,7 @@ StyledStream& Anchor::stream(StyledStream& ost) const {
 }
 
 StyledStream &Anchor::stream_source_line(StyledStream &ost, const char *indent) const {
-    if (buffer) {
-        SourceFile::stream_buffer(ost, offset, buffer->data, buffer->count);
-    } else {
-        auto file = SourceFile::from_file(path);
-        if (file) {
-            file->stream(ost, offset, indent);
-        }
-    }
-    return ost;
+    return SourceFile::stream_source(ost, path, buffer, offset, indent);
 }
 
 //------------------------------------------------------------------------------
@@ -37,6 +37,14 @@ public:
     static const Anchor *from(
         const std::unique_ptr<SourceFile> &file, int _lineno, int _column, int _offset = 0);
 
+    // creates an anchor that is not interned, for parsers that make one for
+    // every token; equal anchors can then differ in address, so compare
+    // them with is_same.
+    static const Anchor *from_unique(
+        Symbol _path, int _lineno, int _column, int _offset = 0, const String *buffer = nullptr);
+    static const Anchor *from_unique(
+        const std::unique_ptr<SourceFile> &file, int _lineno, int _column, int _offset = 0);
+
     StyledStream& stream(StyledStream& ost) const;
 
     StyledStream &stream_source_line(StyledStream &ost, const char *indent = "    ") const;
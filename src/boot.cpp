@@ -14,6 +14,9 @@
 
 #include "boot.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
+#include "profiler.hpp"
+#include "cache.hpp"
 #include "gc.hpp"
 #include "error.hpp"
 #include "lexerparser.hpp"
@@ -27,6 +30,10 @@
 #include "types.hpp"
 #include "gen_llvm.hpp"
 #include "compiler_flags.hpp"
+#include "syntax_image.hpp"
+#include "core_image.hpp"
+#include "server.hpp"
+#include "utils.hpp"
 
 #include "scopes/scopes.h"
 
@@ -52,24 +59,87 @@
 namespace scopes {
 
 static Timer *main_compile_time = nullptr;
+static bool print_timers = SCOPES_PRINT_TIMERS;
+static bool print_cache_stats_on_exit = false;
+static bool print_instance_stats_on_exit = false;
+static bool print_alloc_profile_on_exit = false;
+// if set, a Chrome trace of the whole run is written here on exit
+static const char *trace_path = nullptr;
+// if set, the whole run is sampled and the folded stacks written here on exit
+static const char *profile_path = nullptr;
 void on_startup() {
+    const char *env = getenv("SCOPES_TIMERS");
+    if (env && *env && strcmp(env, "0")) {
+        Timer::set_enabled(true);
+        print_timers = true;
+    }
+    env = getenv("SCOPES_CACHE_STATS");
+    print_cache_stats_on_exit = (env && *env && strcmp(env, "0"));
+    env = getenv("SCOPES_INSTANCE_STATS");
+    if (env && *env && strcmp(env, "0")) {
+        set_instance_stats_enabled(true);
+        print_instance_stats_on_exit = true;
+    }
+    // also read by core.sc, which routes DefaultAllocator through the profiler
+    env = getenv("SCOPES_ALLOC_PROFILE");
+    print_alloc_profile_on_exit = (env && *env && strcmp(env, "0"));
+    trace_path = getenv("SCOPES_TRACE");
+    if (trace_path && *trace_path) {
+        set_trace_enabled(true);
+    } else {
+        trace_path = nullptr;
+    }
+    profile_path = getenv("SCOPES_PROFILE");
+    if (profile_path && *profile_path) {
+        // SCOPES_PROFILE_HZ overrides the default rate of 1000 samples per second
+        env = getenv("SCOPES_PROFILE_HZ");
+        if (!start_profiler(env?atoi(env):0))
+            profile_path = nullptr;
+    } else {
+        profile_path = nullptr;
+    }
     main_compile_time = new Timer(TIMER_Main);
 }
 
 void on_shutdown() {
     delete main_compile_time;
-#if SCOPES_PRINT_TIMERS
-    //print_profiler_info();
-    Timer::print_timers();
-    StyledStream ss(SCOPES_CERR);
-    ss << "largest recorded stack size: " << g_largest_stack_size << std::endl;
-#endif
+    main_compile_time = nullptr;
+    if (trace_path) {
+        if (!write_trace(trace_path)) {
+            StyledStream ss(SCOPES_CERR);
+            ss << "failed to write trace to " << trace_path << std::endl;
+        }
+        trace_path = nullptr;
+    }
+    if (profile_path) {
+        stop_profiler();
+        if (!write_profile(profile_path)) {
+            StyledStream ss(SCOPES_CERR);
+            ss << "failed to write profile to " << profile_path << std::endl;
+        }
+        profile_path = nullptr;
+    }
+    if (print_timers) {
+        //print_profiler_info();
+        Timer::print_timers();
+    }
+    if (print_cache_stats_on_exit) {
+        print_cache_stats();
+    }
+    if (print_instance_stats_on_exit) {
+        print_instance_stats();
+    }
+    if (print_alloc_profile_on_exit) {
+        print_alloc_profile();
+    }
 }
 
 bool signal_abort = false;
 void f_abort() {
     on_shutdown();
     if (signal_abort) {
+        // stdout may be fully buffered, and abort doesn't flush it
+        fflush(stdout);
         std::abort();
     } else {
         exit(1);
@@ -118,7 +188,8 @@ SCOPES_RESULT(ValueRef) load_custom_core(const char *executable_path) {
     }
     auto head = it->at;
     auto sym = SCOPES_GET_RESULT(extract_symbol_constant(head));
-    if (sym != Symbol("core-size"))  {
+    bool image = (sym == Symbol("core-image"));
+    if (!image && (sym != Symbol("core-size")))  {
         SCOPES_ERROR(InvalidFooter);
     }
     it = it->next;
@@ -126,9 +197,13 @@ SCOPES_RESULT(ValueRef) load_custom_core(const char *executable_path) {
         SCOPES_ERROR(InvalidFooter);
     }
     auto script_size = SCOPES_GET_RESULT(extract_integer_constant(it->at));
-    if (script_size <= 0) {
+    // the footer was parsed, so the cursor is within the file
+    if ((script_size == 0) || (script_size > (uint64_t)(cursor - ptr))) {
         SCOPES_ERROR(InvalidFooter);
     }
+    if (image) {
+        return load_core_image(cursor - script_size, script_size);
+    }
     LexerParser parser(std::move(file), cursor - script_size - ptr, script_size);
     return parser.parse();
 }
@@ -155,6 +230,27 @@ SCOPES_RESULT(ValueRef) load_custom_core(const char *executable_path) {
    $ wc -c < mycore.sc >> myscopes
    $ echo ")" >> myscopes
 
+   in place of the source, the footer (core-image <size>) announces a core
+   image, which boots without lexing the core or compiling its stages. the
+   compiler writes the image of the core it boots with to the path in
+   SCOPES_WRITE_CORE_IMAGE, once all stages are compiled:
+
+   $ SCOPES_WRITE_CORE_IMAGE=core.img scopes -e ""
+   $ cp scopes myscopes
+   $ cat core.img >> myscopes
+   $ echo "(core-image " >> myscopes
+   $ wc -c < core.img >> myscopes
+   $ echo ")" >> myscopes
+
+   to skip booting altogether, a compile server keeps a booted compiler
+   resident, and every run of the compiler with SCOPES_SERVER set to the
+   socket of the server is forwarded to it; runs of a different build, or
+   without a server to connect to, boot as usual:
+
+   $ scopes --server /tmp/scopes.socket &
+   $ export SCOPES_SERVER=/tmp/scopes.socket
+   $ scopes script.sc
+
    */
 
 
@@ -173,8 +269,29 @@ static bool terminal_supports_ansi() {
 #endif
 }
 
+static void setup_stdout_buffer(bool terminal) {
+#ifdef SCOPES_WIN32
+    // the console is written to unbuffered, see below
+    if (terminal)
+        return;
+#endif
+    size_t size = SCOPES_STDOUT_BUFFER_SIZE;
+    const char *env = getenv("SCOPES_STDOUT_BUFFER");
+    if (env)
+        parse_size(env, size);
+    if (!size) {
+        setvbuf(stdout, nullptr, _IONBF, 0);
+        return;
+    }
+    // stays alive until exit, when stdio writes out what is left
+    char *buffer = (char *)malloc(size);
+    setvbuf(stdout, buffer, terminal?_IOLBF:_IOFBF, size);
+}
+
 static void setup_stdio() {
-    if (terminal_supports_ansi()) {
+    bool terminal = terminal_supports_ansi();
+    setup_stdout_buffer(terminal);
+    if (terminal) {
         stream_default_style = stream_ansi_style;
         #ifdef SCOPES_WIN32
         #ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
@@ -208,6 +325,11 @@ static void setup_stdio() {
 
 void init(void *c_main, int argc, char *argv[]) {
     using namespace scopes;
+    {
+        int status;
+        if (forward_to_server(argc, argv, status))
+            exit(status);
+    }
     scopes_compiler_path = nullptr;
     scopes_compiler_dir = nullptr;
     scopes_working_dir = nullptr;
@@ -227,6 +349,8 @@ void init(void *c_main, int argc, char *argv[]) {
 #endif
 
     on_startup();
+    // every cache entry used from here on goes into core images and snapshots
+    record_cache_keys();
 
     Symbol::_init_symbols();
     init_llvm();
@@ -260,6 +384,12 @@ SCOPES_RESULT(int) try_main() {
     SCOPES_RESULT_TYPE(int);
     using namespace scopes;
 
+    const char *server_path = nullptr;
+    if ((scopes_argc > 2) && !strcmp(scopes_argv[1], "--server")) {
+        server_path = scopes_argv[2];
+        disable_concurrent_jit();
+    }
+
     ValueRef expr = SCOPES_GET_RESULT(load_custom_core(scopes_compiler_path));
     if (expr) {
         goto skip_regular_load;
@@ -280,11 +410,14 @@ SCOPES_RESULT(int) try_main() {
         if (!sf) {
             SCOPES_ERROR(CoreMissing, name);
         }
-        LexerParser parser(std::move(sf));
-        expr = SCOPES_GET_RESULT(parser.parse());
+        expr = SCOPES_GET_RESULT(parse_source_file(std::move(sf)));
     }
 
 skip_regular_load:
+    const char *image_path = getenv("SCOPES_WRITE_CORE_IMAGE");
+    if (image_path && !*image_path) {
+        image_path = nullptr;
+    }
     const Anchor *anchor = expr.anchor();
     auto list = SCOPES_GET_RESULT(extract_list_constant(expr));
     TemplateRef tmpfn = SCOPES_GET_RESULT(expand_module(anchor, list, sc_get_globals()));
@@ -304,7 +437,11 @@ skip_regular_load:
     auto stage_func_type = native_opaque_pointer_type(raising_function_type(
         arguments_type({TYPE_CompileStage}), {}));
 
-    const int compile_flags = CF_Module;
+    // stages are cached by their digest and emitted quickly, without
+    // optimization or debug info; every stage is proven by the one before it
+    // runs, so the only work that can overlap is the emission of a stage that
+    // isn't cached yet, which is split over the thread pool
+    const int compile_flags = CF_Module | CF_Parallel | CF_Quick;
 
 compile_stage:
     if (fn->get_type() == stage_func_type) {
@@ -337,6 +474,16 @@ compile_stage:
 
     typedef sc_void_raises_t (*MainFuncType)();
     MainFuncType fptr = (MainFuncType)SCOPES_GET_RESULT(compile(fn, compile_flags))->value;
+    if (image_path) {
+        SCOPES_CHECK_RESULT(write_core_image(image_path, expr));
+    }
+    if (server_path) {
+        // only returns in the child that answers a request, which runs main
+        // with the command line and the streams of the client
+        SCOPES_CHECK_RESULT(serve_requests(server_path));
+        stream_default_style = stream_plain_style;
+        setup_stdio();
+    }
     {
         auto result = fptr();
         if (!result.ok) {
@@ -19,12 +19,17 @@
 #include "prover.hpp"
 #include "dyn_cast.inc"
 #include "timer.hpp"
+#include "trace.hpp"
 #include "compiler_flags.hpp"
 #include "ordered_map.hpp"
+#include "cache.hpp"
+#include "hash.hpp"
+#include "module_digest.hpp"
 
 #include "scopes/scopes.h"
 
 #include <llvm-c/Core.h>
+#include <llvm-c/TargetMachine.h>
 
 #include "llvm/IR/Module.h"
 
@@ -33,10 +38,18 @@
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/AST/RecordLayout.h"
 #include "clang/CodeGen/CodeGenAction.h"
+#include "clang/Frontend/FrontendActions.h"
 #include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Lex/LiteralSupport.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <mutex>
+#include <thread>
+#include <atomic>
 
 #ifdef _MSC_VER
 #include "stdlib_ex.h"
@@ -73,6 +86,9 @@ struct CNamespaces {
     PureMap constants;
     PureMap externs;
     PureMap defines;
+    // the names that typenames were requested with, before they were made
+    // unique
+    absl::flat_hash_map<const Type *, const String *> titles;
 };
 
 class CVisitor : public clang::RecursiveASTVisitor<CVisitor> {
@@ -102,6 +118,7 @@ public:
         dest = _dest;
         const Type *T = plain_typename_type(String::from("__builtin_va_list"), nullptr,
             array_type(TYPE_I8, sizeof(va_list)).assert_ok()).assert_ok();
+        dest->titles.insert({T, String::from("__builtin_va_list")});
         dest->typedefs.insert(Symbol("__builtin_va_list"), ConstPointer::type_from(T));
     }
 
@@ -244,6 +261,7 @@ public:
                     String::join(name.name(), String::from(">"))));
         }
         const Type *T = incomplete_typename_type(type_title, supertype);
+        dest->titles.insert({T, type_title});
         if (name != SYM_Unnamed) {
             auto ok = map.insert(name, ConstPointer::type_from(T));
             assert(ok);
@@ -785,13 +803,237 @@ public:
 
 };
 
+//------------------------------------------------------------------------------
+// LAZY IMPORTS
+//------------------------------------------------------------------------------
+
+/* a lazy import keeps the clang AST alive and indexes its top level
+   declarations by the namespace and name that translating them produces.
+   the namespace scopes then resolve a name by translating only the
+   declarations it was indexed with, and the types these refer to. */
+
+enum CImportNamespace {
+    CIN_Struct,
+    CIN_Union,
+    CIN_Enum,
+    CIN_Const,
+    CIN_TypeDef,
+    CIN_Extern,
+    CIN_Count
+};
+
+struct CImportIndex {
+    typedef absl::flat_hash_map<Symbol, std::vector<clang::Decl *>, Symbol::Hash> DeclMap;
+
+    std::mutex mutex;
+    CNamespaces ns;
+    CVisitor visitor;
+    // owns the AST; never freed
+    clang::CompilerInstance *compiler = nullptr;
+    DeclMap decls[CIN_Count];
+    // all indexed declarations in the order they were parsed
+    std::vector<clang::Decl *> order;
+    absl::flat_hash_set<clang::Decl *> translated;
+    // set once every declaration has been translated
+    bool complete = false;
+
+    void index(CImportNamespace kind, llvm::StringRef name, clang::Decl *D) {
+        if (name.empty())
+            return;
+        decls[kind][Symbol::from_bytes(name.data(), name.size())].push_back(D);
+    }
+
+    // returns false if the declaration had to be translated and failed
+    bool add_decl(clang::Decl *D) {
+        using namespace clang;
+        if (auto ls = llvm::dyn_cast<LinkageSpecDecl>(D)) {
+            if (ls->getLanguage() == LinkageSpecDecl::lang_c) {
+                for (auto child : ls->decls()) {
+                    if (!add_decl(child))
+                        return false;
+                }
+            }
+            return true;
+        }
+        if (auto rd = llvm::dyn_cast<RecordDecl>(D)) {
+            if (rd->isAnonymousStructOrUnion() || !rd->getIdentifier()
+                || !(rd->isStruct() || rd->isUnion())) {
+                return translate_now(D);
+            }
+            index(rd->isUnion()?CIN_Union:CIN_Struct, rd->getName(), D);
+        } else if (auto ed = llvm::dyn_cast<EnumDecl>(D)) {
+            index(CIN_Enum, ed->getName(), D);
+            for (auto it : ed->enumerators()) {
+                index(CIN_Const, it->getName(), D);
+            }
+        } else if (auto td = llvm::dyn_cast<TypedefDecl>(D)) {
+            index(CIN_TypeDef, td->getName(), D);
+        } else if (auto fd = llvm::dyn_cast<FunctionDecl>(D)) {
+            index(CIN_Extern, fd->getNameInfo().getName().getAsString(), D);
+        } else if (auto vd = llvm::dyn_cast<VarDecl>(D)) {
+            if (!vd->isExternC())
+                return true;
+            index(CIN_Extern, vd->getName(), D);
+        } else {
+            // everything else is rare enough to be translated right away
+            return translate_now(D);
+        }
+        order.push_back(D);
+        return true;
+    }
+
+    bool translate_now(clang::Decl *D) {
+        translated.insert(D);
+        visitor.TraverseDecl(D);
+        return visitor.ok.ok();
+    }
+
+    // a failed translation only fails the names it was indexed with
+    void translate(clang::Decl *D) {
+        using namespace clang;
+        if (!translated.insert(D).second)
+            return;
+        visitor.ok = Result<void>();
+        if (auto rd = llvm::dyn_cast<RecordDecl>(D)) {
+            auto result = visitor.TranslateRecord(rd);
+            if (!result.ok())
+                visitor.ok = Result<void>::raise(result.unsafe_error());
+        } else if (auto ed = llvm::dyn_cast<EnumDecl>(D)) {
+            auto result = visitor.TranslateEnum(ed);
+            if (!result.ok())
+                visitor.ok = Result<void>::raise(result.unsafe_error());
+        } else {
+            visitor.TraverseDecl(D);
+        }
+    }
+
+    void translate_all() {
+        if (complete)
+            return;
+        for (auto D : order) {
+            translate(D);
+        }
+        complete = true;
+    }
+
+    template<typename T>
+    static bool find_in(const T &map, Symbol name, PureRef &dest) {
+        int index = map.find_index(name);
+        if (index == -1)
+            return false;
+        dest = map.entries[index].second;
+        return true;
+    }
+
+    bool find(CImportNamespace kind, Symbol name, PureRef &dest) const {
+        switch(kind) {
+        case CIN_Struct: return find_in(ns.structs, name, dest);
+        case CIN_Union: return find_in(ns.unions, name, dest);
+        case CIN_Enum: return find_in(ns.enums, name, dest);
+        case CIN_Const: return find_in(ns.constants, name, dest);
+        case CIN_TypeDef: return find_in(ns.typedefs, name, dest);
+        case CIN_Extern: return find_in(ns.externs, name, dest);
+        default: return false;
+        }
+    }
+
+    bool resolve_locked(CImportNamespace kind, Symbol name, PureRef &dest) {
+        // may have been translated along with another declaration
+        if (find(kind, name, dest))
+            return true;
+        if (complete)
+            return false;
+        auto it = decls[kind].find(name);
+        if (it == decls[kind].end())
+            return false;
+        for (auto D : it->second) {
+            translate(D);
+        }
+        return find(kind, name, dest);
+    }
+
+    bool resolve(CImportNamespace kind, Symbol name, PureRef &dest) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return resolve_locked(kind, name, dest);
+    }
+
+    // as find_value_in_namespaces
+    bool resolve_any(Symbol name, PureRef &dest) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return resolve_locked(CIN_TypeDef, name, dest)
+            || resolve_locked(CIN_Const, name, dest)
+            || resolve_locked(CIN_Extern, name, dest)
+            || find_in(ns.defines, name, dest);
+    }
+
+    template<typename T>
+    static void append_entries(const T &map,
+        std::vector< std::pair<ConstRef, ScopeMapEntry> > &dest) {
+        for (int i = 0; i < map.entries.size(); ++i) {
+            if (map.is_discarded(i))
+                continue;
+            auto &&symbol = map.entries[i].first;
+            PureRef value = map.entries[i].second;
+            dest.push_back({ ref(value.anchor(), ConstInt::symbol_from(symbol)),
+                { value, nullptr } });
+        }
+    }
+
+    void resolve_all(CImportNamespace kind,
+        std::vector< std::pair<ConstRef, ScopeMapEntry> > &dest) {
+        std::lock_guard<std::mutex> lock(mutex);
+        translate_all();
+        switch(kind) {
+        case CIN_Struct: append_entries(ns.structs, dest); break;
+        case CIN_Union: append_entries(ns.unions, dest); break;
+        case CIN_Enum: append_entries(ns.enums, dest); break;
+        case CIN_Const: append_entries(ns.constants, dest); break;
+        case CIN_TypeDef: append_entries(ns.typedefs, dest); break;
+        case CIN_Extern: append_entries(ns.externs, dest); break;
+        default: break;
+        }
+    }
+};
+
+struct CImportResolver : ScopeResolver {
+    CImportIndex *index;
+    CImportNamespace kind;
+
+    CImportResolver(CImportIndex *_index, CImportNamespace _kind) :
+        index(_index), kind(_kind) {}
+
+    bool resolve(const ConstRef &name, ScopeMapEntry &dest) const override {
+        if (name->get_type() != TYPE_Symbol)
+            return false;
+        Symbol sym = Symbol::wrap(name.cast<ConstInt>()->value());
+        PureRef value;
+        if (!index->resolve(kind, sym, value))
+            return false;
+        dest = { value, nullptr };
+        return true;
+    }
+
+    void resolve_all(
+        std::vector< std::pair<ConstRef, ScopeMapEntry> > &dest) const override {
+        index->resolve_all(kind, dest);
+    }
+};
+
 // see ASTConsumers.h for more utilities
 class EmitLLVMOnlyAction : public clang::EmitLLVMOnlyAction {
 public:
     CNamespaces *dest;
     Result<void> result;
+    // declarations come partially from a precompiled header
+    bool use_pch = false;
+    // if set, declarations are indexed instead of translated
+    CImportIndex *index = nullptr;
+    // if set, declarations are only collected, to be translated on the
+    // importing thread once the action has ended
+    std::vector<clang::Decl *> *deferred = nullptr;
+    clang::ASTContext *ast_context = nullptr;
 
-    EmitLLVMOnlyAction(CNamespaces *dest_);
+    EmitLLVMOnlyAction(CNamespaces *dest_, llvm::LLVMContext *context);
 
     std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI,
         clang::StringRef InFile) override;
@@ -800,34 +1042,83 @@ public:
 class CodeGenProxy : public clang::ASTConsumer {
 public:
     EmitLLVMOnlyAction &act;
-    CVisitor visitor;
+    CVisitor own_visitor;
+    // translates declarations after the import for lazy imports
+    CVisitor &visitor;
+    clang::ASTContext *context = nullptr;
+    bool external_decls_visited = false;
+
+    CodeGenProxy(EmitLLVMOnlyAction &_act) : act(_act),
+        visitor(_act.index?_act.index->visitor:own_visitor) {
+    }
 
-    CodeGenProxy(EmitLLVMOnlyAction &_act) : act(_act) {
+    bool HandleDecl(clang::Decl *D) {
+        if (act.deferred) {
+            act.deferred->push_back(D);
+            return true;
+        }
+        if (act.index) {
+            act.index->add_decl(D);
+        } else {
+            visitor.TraverseDecl(D);
+        }
+        if (!visitor.ok.ok()) {
+            act.result = visitor.ok;
+            return false;
+        }
+        return true;
     }
     virtual ~CodeGenProxy() {}
 
     virtual void Initialize(clang::ASTContext &Context) {
-        visitor.SetContext(&Context, act.dest);
+        context = &Context;
+        act.ast_context = &Context;
+        if (!act.deferred) {
+            visitor.SetContext(&Context, act.dest);
+        }
+    }
+
+    // declarations loaded from a precompiled header are not passed to
+    // HandleTopLevelDecl, so they are visited in order before the first one
+    // that is
+    bool HandleExternalDecls() {
+        if (!act.use_pch || external_decls_visited)
+            return true;
+        external_decls_visited = true;
+        for (auto D : context->getTranslationUnitDecl()->decls()) {
+            if (!D->isFromASTFile())
+                continue;
+            if (!HandleDecl(D))
+                return false;
+        }
+        return true;
+    }
+
+    // these are visited by HandleExternalDecls
+    virtual void HandleInterestingDecl(clang::DeclGroupRef D) {}
+
+    virtual void HandleTranslationUnit(clang::ASTContext &Context) {
+        HandleExternalDecls();
     }
 
     virtual bool HandleTopLevelDecl(clang::DeclGroupRef D) {
+        if (!HandleExternalDecls())
+            return false;
         if (!visitor.ok.ok()) {
             act.result = visitor.ok;
             return false;
         }
         for (clang::DeclGroupRef::iterator b = D.begin(), e = D.end(); b != e; ++b) {
-            visitor.TraverseDecl(*b);
-            if (!visitor.ok.ok()) {
-                act.result = visitor.ok;
+            if (!HandleDecl(*b))
                 return false;
-            }
         }
         return true;
     }
 };
 
-EmitLLVMOnlyAction::EmitLLVMOnlyAction(CNamespaces *dest_) :
-    clang::EmitLLVMOnlyAction((llvm::LLVMContext *)LLVMGetGlobalContext()),
+EmitLLVMOnlyAction::EmitLLVMOnlyAction(CNamespaces *dest_,
+    llvm::LLVMContext *context) :
+    clang::EmitLLVMOnlyAction(context),
     dest(dest_)
 {
 }
@@ -841,98 +1132,6 @@ std::unique_ptr<clang::ASTConsumer> EmitLLVMOnlyAction::CreateASTConsumer(clang:
     return std::make_unique<clang::MultiplexConsumer>(std::move(consumers));
 }
 
-static std::vector<LLVMModuleRef> llvm_c_modules;
-
-static void add_c_macro(clang::Preprocessor & PP,
-    const clang::IdentifierInfo * II,
-    clang::MacroDirective * MD, CNamespaces::PureMap &map, std::list< std::pair<Symbol, Symbol> > &aliases) {
-    if(!II->hasMacroDefinition())
-        return;
-    clang::MacroInfo * MI = MD->getMacroInfo();
-    if(MI->isFunctionLike())
-        return;
-    bool negate = false;
-    const clang::Token * Tok;
-    auto numtokens = MI->getNumTokens();
-    if(numtokens == 2 && MI->getReplacementToken(0).is(clang::tok::minus)) {
-        negate = true;
-        Tok = &MI->getReplacementToken(1);
-    } else if(numtokens == 1) {
-        Tok = &MI->getReplacementToken(0);
-    } else {
-        return;
-    }
-
-    if ((numtokens == 1) && Tok->is(clang::tok::identifier)) {
-        // aliases need to be resolved once the whole namespace is known
-        const String *name = String::from_cstr(II->getName().str().c_str());
-        const String *value = String::from_cstr(Tok->getIdentifierInfo()->getName().str().c_str());
-        aliases.push_back({ Symbol(name), Symbol(value) });
-        return;
-    }
-
-    if ((numtokens == 1) && Tok->is(clang::tok::string_literal)) {
-        clang::Token tokens[] = { *Tok };
-        clang::StringLiteralParser Literal(tokens, PP, false);
-        const String *name = String::from_cstr(II->getName().str().c_str());
-        std::string svalue = Literal.GetString().data();
-        const String *value = String::from(svalue.c_str(), svalue.size());
-        const Anchor *anchor = anchor_from_location(PP.getSourceManager(),
-            MI->getDefinitionLoc());
-
-        map.insert(name, ref(anchor, ConstString::from(value)));
-        return;
-    }
-
-    if(Tok->isNot(clang::tok::numeric_constant))
-        return;
-
-    clang::SmallString<64> IntegerBuffer;
-    bool NumberInvalid = false;
-    clang::StringRef Spelling = PP.getSpelling(*Tok, IntegerBuffer, &NumberInvalid);
-    clang::NumericLiteralParser Literal(Spelling, Tok->getLocation(),
-        PP.getSourceManager(), PP.getLangOpts(), PP.getTargetInfo(),
-        PP.getDiagnostics());
-    if(Literal.hadError)
-        return;
-    const String *name = String::from_cstr(II->getName().str().c_str());
-    std::string suffix;
-    if (Literal.hasUDSuffix()) {
-        suffix = Literal.getUDSuffix().data();
-        std::cout << "TODO: macro literal suffix: " << suffix << std::endl;
-    }
-    const Anchor *anchor = anchor_from_location(PP.getSourceManager(),
-        MI->getDefinitionLoc());
-    if(Literal.isFloatingLiteral()) {
-        llvm::APFloat Result(0.0);
-        Literal.GetFloatValue(Result);
-        double V = Result.convertToDouble();
-        if (negate)
-            V = -V;
-        PureRef val;
-        if (Literal.isFloat) {
-            val = ConstReal::from(TYPE_F32, V);
-        } else {
-            val = ConstReal::from(TYPE_F64, V);
-        }
-        map.insert(name, ref(anchor, val));
-    } else {
-        llvm::APInt Result(64,0);
-        Literal.GetIntegerValue(Result);
-        PureRef val;
-        if (Literal.isUnsigned) {
-            uint64_t i = Result.getZExtValue();
-            val = ConstInt::from((Literal.isLongLong?TYPE_U64:TYPE_U32), i);
-        } else {
-            int64_t i = Result.getSExtValue();
-            if (negate)
-                i = -i;
-            val = ConstInt::from((Literal.isLongLong?TYPE_I64:TYPE_I32), i);
-        }
-        map.insert(name, ref(anchor, val));
-    }
-}
-
 template<typename T>
 static void build_namespace_symbols (const Scope *scope, Symbol symbol, T&map) {
     auto &&top = scope->table();
@@ -988,177 +1187,2274 @@ static bool find_value_in_namespaces(const CNamespaces &ns, Symbol symbol, PureR
     return false;
 }
 
-SCOPES_RESULT(const Scope *) import_c_module (
-    const std::string &path, const std::vector<std::string> &args,
-    const char *buffer,
-    const Scope *scope) {
-    using namespace clang;
-    SCOPES_RESULT_TYPE(const Scope *);
-    Timer sum_clang_time(TIMER_ImportC);
+//------------------------------------------------------------------------------
+// MACRO EVALUATION
+//------------------------------------------------------------------------------
 
-    std::vector<const char *> aargs;
-    aargs.push_back("clang");
-    aargs.push_back(path.c_str());
-    aargs.push_back("-fno-common");
+/* object-like macros are evaluated once all of them are known. evaluating a
+   macro first evaluates the macros it names, so each is visited once and
+   enters the namespace after everything it depends on. besides literals and
+   aliases, constant expressions of arithmetic, comparison, logic and casts to
+   arithmetic types are folded, following the conversions of C. */
+
+struct CMacroEvaluator {
+    struct Number {
+        // an IntegerType or RealType
+        const Type *T;
+        uint64_t i;
+        double r;
+
+        bool is_real() const { return isa<RealType>(T); }
+        bool is_signed() const {
+            return !is_real() && cast<IntegerType>(T)->issigned;
+        }
+        int width() const {
+            return is_real()?(int)cast<RealType>(T)->width
+                :(int)cast<IntegerType>(T)->width;
+        }
+        int64_t s() const { return (int64_t)i; }
+        double real() const {
+            if (is_real()) return r;
+            return is_signed()?(double)s():(double)i;
+        }
+    };
+
+    enum State {
+        Pending,
+        Visiting,
+        Done,
+    };
+
+    struct Macro {
+        const clang::IdentifierInfo *II;
+        clang::MacroInfo *MI;
+        State state;
+        PureRef value;
+    };
+
+    clang::Preprocessor &PP;
+    CNamespaces &ns;
+    CImportIndex *index;
+    absl::flat_hash_map<const clang::IdentifierInfo *, int> lookup;
+    std::vector<Macro> macros;
+
+    CMacroEvaluator(clang::Preprocessor &_PP, CNamespaces &_ns,
+        CImportIndex *_index) : PP(_PP), ns(_ns), index(_index) {}
+
+    void add(const clang::IdentifierInfo *II, clang::MacroDirective *MD) {
+        if (!II->hasMacroDefinition())
+            return;
+        clang::MacroInfo *MI = MD->getMacroInfo();
+        if (!MI || MI->isFunctionLike() || !MI->getNumTokens())
+            return;
+        lookup.insert({II, (int)macros.size()});
+        macros.push_back({ II, MI, Pending, PureRef() });
+    }
 
-    // grab compiler args from the nix wrapper variable
-    const char* envstr = getenv("NIX_CFLAGS_COMPILE");
-    std::vector<std::string> nixargs;
-    if(envstr != nullptr)
-    {
-        std::string nixenv(envstr);
-        size_t last = 0;
-        size_t pos = 0;
-        while((pos = nixenv.find(" ", last)) != std::string::npos)
-        {
-            if(last != pos)
-            {
-                nixargs.push_back(nixenv.substr(last, pos - last));
-            }
-            last = pos + 1;
+    void evaluate_all() {
+        for (int i = 0; i < macros.size(); ++i) {
+            evaluate(i);
         }
-        nixargs.push_back(nixenv.substr(last));
-        for (auto &it : nixargs) {
-            aargs.push_back(it.c_str());
+    }
+
+    // returns a null value if the macro has no constant value
+    PureRef evaluate(int index) {
+        auto &macro = macros[index];
+        if (macro.state != Pending)
+            return macro.value;
+        macro.state = Visiting;
+        auto MI = macro.MI;
+        auto value = evaluate_tokens(MI->tokens(), MI->getDefinitionLoc());
+        macro.state = Done;
+        macro.value = value;
+        if (value) {
+            auto name = macro.II->getName();
+            ns.defines.insert(Symbol::from_bytes(name.data(), name.size()),
+                value);
         }
+        return value;
     }
 
-#ifdef SCOPES_WIN32
-    // Unfuck the windows stdio header
-    aargs.push_back("-D_NO_CRT_STDIO_INLINE=1");
-#endif
+    bool find_value(Symbol name, PureRef &dest) {
+        if (index)
+            return index->resolve_any(name, dest);
+        return find_value_in_namespaces(ns, name, dest);
+    }
 
-#ifdef SCOPES_ADD_IMPORT_CFLAGS
-    std::vector<std::string> addargs;
-    {
-        std::string addflags = SCOPES_ADD_IMPORT_CFLAGS;
-        size_t last = 0;
-        size_t pos = 0;
-        //split by ! because defining a symbol to a string containing spaces through escaping and an environment variable was too painful
-        while((pos = addflags.find("!", last)) != std::string::npos)
-        {
-            if(last != pos)
-            {
-                addargs.push_back(addflags.substr(last, pos - last));
+    // the value of an identifier in an expansion; a macro that is being
+    // expanded names whatever the identifier means outside of macros, as in
+    // #define stdin stdin
+    PureRef identifier_value(const clang::IdentifierInfo *II) {
+        auto it = lookup.find(II);
+        if ((it != lookup.end()) && (macros[it->second].state != Visiting))
+            return evaluate(it->second);
+        PureRef value;
+        auto name = II->getName();
+        if (find_value(Symbol::from_bytes(name.data(), name.size()), value))
+            return value;
+        return PureRef();
+    }
+
+    PureRef evaluate_tokens(llvm::ArrayRef<clang::Token> tokens,
+        clang::SourceLocation loc) {
+        using namespace clang;
+        // adjacent strings are concatenated
+        bool strings = true;
+        for (auto &&tok : tokens) {
+            if (!tok.is(tok::string_literal)) {
+                strings = false;
+                break;
             }
-            last = pos + 1;
         }
-        addargs.push_back(addflags.substr(last));
-        for (auto &it : addargs) {
-            aargs.push_back(it.c_str());
+        const Anchor *anchor = anchor_from_location(PP.getSourceManager(), loc);
+        if (strings) {
+            StringLiteralParser Literal(tokens, PP, false);
+            if (Literal.hadError)
+                return PureRef();
+            auto str = Literal.GetString();
+            return ref(anchor, ConstString::from(String::from(str.data(), str.size())));
+        }
+        // a lone identifier aliases whatever it names, as is
+        size_t begin = 0;
+        size_t end = tokens.size();
+        while (((end - begin) >= 3) && tokens[begin].is(tok::l_paren)
+            && tokens[end - 1].is(tok::r_paren)) {
+            begin++;
+            end--;
         }
+        if (((end - begin) == 1) && tokens[begin].is(tok::identifier)) {
+            return identifier_value(tokens[begin].getIdentifierInfo());
+        }
+        this->tokens = tokens;
+        pos = 0;
+        Number value;
+        if (!parse_conditional(value) || (pos != tokens.size()))
+            return PureRef();
+        if (value.is_real())
+            return ref(anchor, ConstReal::from(value.T, value.r));
+        return ref(anchor, ConstInt::from(value.T, value.i));
     }
-#endif
 
-    auto argcount = args.size();
-    std::string object_file;
-    for (size_t i = 0; i < argcount; ++i) {
-        if ((args[i] == "-c") && ((i + 1) < argcount)) {
-            object_file = args[i + 1];
-            i += 2;
-            continue;
+    // expression parser; state is saved across nested macro evaluations
+    llvm::ArrayRef<clang::Token> tokens;
+    size_t pos = 0;
+
+    bool at(clang::tok::TokenKind kind) const {
+        return (pos < tokens.size()) && tokens[pos].is(kind);
+    }
+
+    bool accept(clang::tok::TokenKind kind) {
+        if (!at(kind))
+            return false;
+        pos++;
+        return true;
+    }
+
+    static uint64_t normalize(const Type *T, uint64_t value) {
+        auto it = cast<IntegerType>(T);
+        if (it->width >= 64)
+            return value;
+        uint64_t mask = (1ull << it->width) - 1;
+        value &= mask;
+        if (it->issigned && (value >> (it->width - 1)))
+            value |= ~mask;
+        return value;
+    }
+
+    static Number make_int(const Type *T, uint64_t value) {
+        return { T, normalize(T, value), 0.0 };
+    }
+
+    static Number make_real(const Type *T, double value) {
+        return { T, 0, value };
+    }
+
+    static bool convert(const Number &value, const Type *T, Number &dest) {
+        if (isa<RealType>(T)) {
+            dest = make_real(T, value.real());
+        } else if (value.is_real()) {
+            if (cast<IntegerType>(T)->issigned) {
+                dest = make_int(T, (uint64_t)(int64_t)value.r);
+            } else {
+                dest = make_int(T, (uint64_t)value.r);
+            }
+        } else {
+            dest = make_int(T, value.i);
         }
-        aargs.push_back(args[i].c_str());
+        return true;
     }
 
-    CompilerInstance compiler;
-    compiler.setInvocation(createInvocationFromCommandLine(aargs));
+    static const Type *promote(const Number &value) {
+        if (value.is_real() || (value.width() >= 32))
+            return value.T;
+        return TYPE_I32;
+    }
 
-    if (buffer) {
-        auto &opts = compiler.getPreprocessorOpts();
+    // the usual arithmetic conversions
+    static const Type *common_type(const Number &a, const Number &b) {
+        if (a.is_real() || b.is_real()) {
+            if (a.is_real() && b.is_real())
+                return (a.width() >= b.width())?a.T:b.T;
+            return a.is_real()?a.T:b.T;
+        }
+        auto ta = cast<IntegerType>(promote(a));
+        auto tb = cast<IntegerType>(promote(b));
+        if (ta->issigned == tb->issigned)
+            return (ta->width >= tb->width)?ta:tb;
+        auto u = ta->issigned?tb:ta;
+        auto s = ta->issigned?ta:tb;
+        if (u->width >= s->width)
+            return u;
+        return s;
+    }
 
-        llvm::MemoryBuffer * membuffer =
-            llvm::MemoryBuffer::getMemBuffer(buffer, "<buffer>").release();
+    bool parse_number(const clang::Token &tok, Number &dest) {
+        using namespace clang;
+        SmallString<64> buffer;
+        bool invalid = false;
+        StringRef spelling = PP.getSpelling(tok, buffer, &invalid);
+        if (invalid)
+            return false;
+        NumericLiteralParser Literal(spelling, tok.getLocation(),
+            PP.getSourceManager(), PP.getLangOpts(), PP.getTargetInfo(),
+            PP.getDiagnostics());
+        if (Literal.hadError || Literal.hasUDSuffix())
+            return false;
+        if (Literal.isFloatingLiteral()) {
+            llvm::APFloat Result(0.0);
+            Literal.GetFloatValue(Result);
+            dest = make_real(Literal.isFloat?TYPE_F32:TYPE_F64,
+                Result.convertToDouble());
+            return true;
+        }
+        llvm::APInt Result(64, 0);
+        if (Literal.GetIntegerValue(Result))
+            return false;
+        uint64_t value = Result.getZExtValue();
+        // the first of these types that can hold the value, unless the
+        // literal is long long
+        bool decimal = (spelling.size() < 2) || (spelling[0] != '0');
+        const Type *types[] = { TYPE_I32, TYPE_U32, TYPE_I64, TYPE_U64 };
+        for (auto T : types) {
+            auto it = cast<IntegerType>(T);
+            if (Literal.isLongLong && (it->width < 64))
+                continue;
+            if (Literal.isUnsigned && it->issigned)
+                continue;
+            // decimal literals without suffix are never unsigned
+            if (decimal && !Literal.isUnsigned && !it->issigned
+                && (it->width < 64))
+                continue;
+            uint64_t max = it->issigned?((1ull << (it->width - 1)) - 1)
+                :((it->width >= 64)?~0ull:((1ull << it->width) - 1));
+            if (value <= max) {
+                dest = make_int(T, value);
+                return true;
+            }
+        }
+        return false;
+    }
 
-        opts.addRemappedFile(path, membuffer);
+    bool to_number(const PureRef &value, Number &dest) {
+        if (!value)
+            return false;
+        if (auto ci = value.dyn_cast<ConstInt>()) {
+            auto T = ci->get_type();
+            // enumerators are of their enum type
+            if (auto tn = dyn_cast<TypenameType>(T)) {
+                if (!tn->is_complete() || tn->is_opaque())
+                    return false;
+                T = tn->storage();
+            }
+            if (!isa<IntegerType>(T) || (ci->words.size() != 1))
+                return false;
+            dest = make_int(T, ci->value());
+            return true;
+        } else if (auto cr = value.dyn_cast<ConstReal>()) {
+            if (!isa<RealType>(cr->get_type()))
+                return false;
+            dest = make_real(cr->get_type(), cr->value);
+            return true;
+        }
+        return false;
     }
 
-    // Create the compilers actual diagnostics engine.
-    compiler.createDiagnostics();
+    // parses a parenthesized arithmetic type name at pos
+    bool parse_cast_type(const Type *&dest) {
+        using namespace clang;
+        auto &&TI = PP.getTargetInfo();
+        size_t start = pos;
+        if (!accept(tok::l_paren))
+            return false;
+        if (at(tok::identifier)) {
+            auto II = tokens[pos].getIdentifierInfo();
+            // a macro names a value
+            if (!lookup.count(II)) {
+                PureRef value;
+                auto name = II->getName();
+                if (find_value(Symbol::from_bytes(name.data(), name.size()), value)
+                    && (value->get_type() == TYPE_Type)) {
+                    auto T = (const Type *)value.cast<ConstPointer>()->value;
+                    if ((isa<IntegerType>(T) || isa<RealType>(T))
+                        && tokens.size() > (pos + 1)
+                        && tokens[pos + 1].is(tok::r_paren)) {
+                        pos += 2;
+                        dest = T;
+                        return true;
+                    }
+                }
+            }
+            pos = start;
+            return false;
+        }
+        int is_signed = -1;
+        int longs = 0;
+        bool is_short = false, is_char = false, is_int = false;
+        bool is_float = false, is_double = false;
+        bool any = false;
+        while (true) {
+            if (accept(tok::kw_signed)) is_signed = 1;
+            else if (accept(tok::kw_unsigned)) is_signed = 0;
+            else if (accept(tok::kw_long)) longs++;
+            else if (accept(tok::kw_short)) is_short = true;
+            else if (accept(tok::kw_char)) is_char = true;
+            else if (accept(tok::kw_int)) is_int = true;
+            else if (accept(tok::kw_float)) is_float = true;
+            else if (accept(tok::kw_double)) is_double = true;
+            else break;
+            any = true;
+        }
+        if (!any || !accept(tok::r_paren)) {
+            pos = start;
+            return false;
+        }
+        if (is_float || is_double) {
+            if (longs || is_short || is_char || is_int || (is_signed != -1)
+                || (is_float && is_double)) {
+                pos = start;
+                return false;
+            }
+            dest = is_float?TYPE_F32:TYPE_F64;
+            return true;
+        }
+        unsigned width;
+        if (is_char) {
+            width = TI.getCharWidth();
+            if (is_signed == -1)
+                is_signed = PP.getLangOpts().CharIsSigned?1:0;
+        } else if (is_short) {
+            width = TI.getShortWidth();
+        } else if (longs == 1) {
+            width = TI.getLongWidth();
+        } else if (longs >= 2) {
+            width = TI.getLongLongWidth();
+        } else {
+            width = TI.getIntWidth();
+        }
+        dest = integer_type(width, is_signed != 0);
+        return true;
+    }
 
-    // Infer the builtin include path if unspecified.
-    //~ if (compiler.getHeaderSearchOpts().UseBuiltinIncludes &&
-        //~ compiler.getHeaderSearchOpts().ResourceDir.empty())
-        //~ compiler.getHeaderSearchOpts().ResourceDir =
-            //~ CompilerInvocation::GetResourcesPath(scopes_argv[0], MainAddr);
+    bool parse_primary(Number &dest) {
+        using namespace clang;
+        if (pos >= tokens.size())
+            return false;
+        auto &&tok = tokens[pos];
+        if (tok.is(tok::numeric_constant)) {
+            pos++;
+            return parse_number(tok, dest);
+        } else if (tok.is(tok::char_constant)) {
+            pos++;
+            SmallString<16> buffer;
+            bool invalid = false;
+            StringRef spelling = PP.getSpelling(tok, buffer, &invalid);
+            if (invalid)
+                return false;
+            CharLiteralParser Literal(spelling.begin(), spelling.end(),
+                tok.getLocation(), PP, tok::char_constant);
+            if (Literal.hadError())
+                return false;
+            dest = make_int(TYPE_I32, Literal.getValue());
+            return true;
+        } else if (tok.is(tok::identifier)) {
+            pos++;
+            // nested evaluations parse their own tokens
+            auto saved_tokens = tokens;
+            auto saved_pos = pos;
+            auto value = identifier_value(tok.getIdentifierInfo());
+            tokens = saved_tokens;
+            pos = saved_pos;
+            return to_number(value, dest);
+        } else if (tok.is(tok::l_paren)) {
+            const Type *T;
+            if (parse_cast_type(T)) {
+                Number value;
+                return parse_unary(value) && convert(value, T, dest);
+            }
+            pos++;
+            return parse_conditional(dest) && accept(tok::r_paren);
+        }
+        return false;
+    }
 
-    LLVMModuleRef M = NULL;
+    bool parse_unary(Number &dest) {
+        using namespace clang;
+        if (accept(tok::plus)) {
+            Number value;
+            if (!parse_unary(value)) return false;
+            return convert(value, promote(value), dest);
+        } else if (accept(tok::minus)) {
+            Number value;
+            if (!parse_unary(value)) return false;
+            auto T = promote(value);
+            if (value.is_real()) {
+                dest = make_real(T, -value.r);
+            } else {
+                dest = make_int(T, -value.i);
+            }
+            return true;
+        } else if (accept(tok::tilde)) {
+            Number value;
+            if (!parse_unary(value) || value.is_real()) return false;
+            dest = make_int(promote(value), ~value.i);
+            return true;
+        } else if (accept(tok::exclaim)) {
+            Number value;
+            if (!parse_unary(value)) return false;
+            dest = make_int(TYPE_I32, value.is_real()?(value.r == 0.0):(value.i == 0));
+            return true;
+        }
+        return parse_primary(dest);
+    }
 
-    CNamespaces ns;
-    if (scope) {
-        build_namespace_symbols(scope, SYM_Struct, ns.structs);
-        build_namespace_symbols(scope, SYM_Union, ns.unions);
-        build_namespace_symbols(scope, SYM_Enum, ns.enums);
-        build_namespace_symbols(scope, KW_Define, ns.defines);
-        build_namespace_symbols(scope, SYM_Const, ns.constants);
-        build_namespace_symbols(scope, SYM_TypeDef, ns.typedefs);
-        build_namespace_symbols(scope, SYM_Extern, ns.externs);
+    static bool is_true(const Number &value) {
+        return value.is_real()?(value.r != 0.0):(value.i != 0);
     }
 
-    // Create and execute the frontend to generate an LLVM bitcode module.
-    std::unique_ptr<EmitLLVMOnlyAction> Act(new EmitLLVMOnlyAction(&ns));
-    if (compiler.ExecuteAction(*Act)) {
-        SCOPES_CHECK_RESULT(Act->result);
-
-        clang::Preprocessor & PP = compiler.getPreprocessor();
-        PP.getDiagnostics().setClient(new IgnoringDiagConsumer(), true);
-
-        std::list< std::pair<Symbol, Symbol> > todo;
-        for(Preprocessor::macro_iterator it = PP.macro_begin(false),end = PP.macro_end(false);
-            it != end; ++it) {
-            const IdentifierInfo * II = it->first;
-            MacroDirective * MD = it->second.getLatest();
-
-            add_c_macro(PP, II, MD, ns.defines, todo);
-        }
-
-        while (!todo.empty()) {
-            auto sz = todo.size();
-            for (auto it = todo.begin(); it != todo.end();) {
-                PureRef val;
-                Symbol sym = it->second;
-                if (find_value_in_namespaces(ns, sym, val)) {
-                    ns.defines.insert(it->first, val);
-                    auto oldit = it++;
-                    todo.erase(oldit);
+    // applies a binary operator of precedence level to both operands
+    bool apply(clang::tok::TokenKind op, const Number &a, const Number &b,
+        Number &dest) {
+        using namespace clang;
+        switch(op) {
+        case tok::ampamp:
+            dest = make_int(TYPE_I32, is_true(a) && is_true(b));
+            return true;
+        case tok::pipepipe:
+            dest = make_int(TYPE_I32, is_true(a) || is_true(b));
+            return true;
+        case tok::lessless:
+        case tok::greatergreater: {
+            if (a.is_real() || b.is_real())
+                return false;
+            auto T = promote(a);
+            Number lhs;
+            convert(a, T, lhs);
+            uint64_t n = b.i;
+            if (n >= (uint64_t)lhs.width())
+                return false;
+            if (op == tok::lessless) {
+                dest = make_int(T, lhs.i << n);
+            } else if (lhs.is_signed()) {
+                dest = make_int(T, (uint64_t)(lhs.s() >> n));
+            } else {
+                dest = make_int(T, lhs.i >> n);
+            }
+            return true;
+        } break;
+        default: break;
+        }
+        auto T = common_type(a, b);
+        Number x, y;
+        convert(a, T, x);
+        convert(b, T, y);
+        int cmp = -2;
+        if (x.is_real()) {
+            switch(op) {
+            case tok::star: dest = make_real(T, x.r * y.r); return true;
+            case tok::slash: dest = make_real(T, x.r / y.r); return true;
+            case tok::plus: dest = make_real(T, x.r + y.r); return true;
+            case tok::minus: dest = make_real(T, x.r - y.r); return true;
+            case tok::less: cmp = x.r < y.r; break;
+            case tok::greater: cmp = x.r > y.r; break;
+            case tok::lessequal: cmp = x.r <= y.r; break;
+            case tok::greaterequal: cmp = x.r >= y.r; break;
+            case tok::equalequal: cmp = x.r == y.r; break;
+            case tok::exclaimequal: cmp = x.r != y.r; break;
+            default: return false;
+            }
+        } else {
+            bool s = x.is_signed();
+            switch(op) {
+            case tok::star: dest = make_int(T, x.i * y.i); return true;
+            case tok::slash:
+            case tok::percent: {
+                if (!y.i)
+                    return false;
+                // the one quotient that overflows
+                if (s && (y.s() == -1)) {
+                    dest = make_int(T, (op == tok::slash)?-x.i:0);
+                    return true;
+                }
+                uint64_t r;
+                if (op == tok::slash) {
+                    r = s?(uint64_t)(x.s() / y.s()):(x.i / y.i);
                 } else {
-                    it++;
+                    r = s?(uint64_t)(x.s() % y.s()):(x.i % y.i);
                 }
-            }
-            // couldn't resolve any more keys, abort
-            if (todo.size() == sz) break;
-        }
-
-        M = (LLVMModuleRef)Act->takeModule().release();
-        assert(M);
-        llvm_c_modules.push_back(M);
-        if (!object_file.empty()) {
-            auto target_machine = get_object_target_machine();
-            assert(target_machine);
-
-            char *errormsg;
-            static char filename[PATH_MAX];
-            strncpy(filename, object_file.c_str(), PATH_MAX - 1);
-            if (LLVMTargetMachineEmitToFile(target_machine, M,
-                filename, LLVMObjectFile, &errormsg)) {
-                SCOPES_ERROR(CGenBackendFailed, errormsg);
+                dest = make_int(T, r);
+                return true;
+            } break;
+            case tok::plus: dest = make_int(T, x.i + y.i); return true;
+            case tok::minus: dest = make_int(T, x.i - y.i); return true;
+            case tok::amp: dest = make_int(T, x.i & y.i); return true;
+            case tok::caret: dest = make_int(T, x.i ^ y.i); return true;
+            case tok::pipe: dest = make_int(T, x.i | y.i); return true;
+            case tok::less: cmp = s?(x.s() < y.s()):(x.i < y.i); break;
+            case tok::greater: cmp = s?(x.s() > y.s()):(x.i > y.i); break;
+            case tok::lessequal: cmp = s?(x.s() <= y.s()):(x.i <= y.i); break;
+            case tok::greaterequal: cmp = s?(x.s() >= y.s()):(x.i >= y.i); break;
+            case tok::equalequal: cmp = (x.i == y.i); break;
+            case tok::exclaimequal: cmp = (x.i != y.i); break;
+            default: return false;
             }
         }
-        SCOPES_CHECK_RESULT(add_module(M, PointerMap(), CF_Cache));
+        dest = make_int(TYPE_I32, cmp);
+        return true;
+    }
 
-        const Scope *result = Scope::from(nullptr, nullptr);
-        merge_namespace_symbols(result, SYM_Struct, ns.structs);
-        merge_namespace_symbols(result, SYM_Union, ns.unions);
-        merge_namespace_symbols(result, SYM_Enum, ns.enums);
-        merge_namespace_symbols(result, KW_Define, ns.defines);
-        merge_namespace_symbols(result, SYM_Const, ns.constants);
-        merge_namespace_symbols(result, SYM_TypeDef, ns.typedefs);
-        merge_namespace_symbols(result, SYM_Extern, ns.externs);
-        result->table();
+    static int precedence(clang::tok::TokenKind kind) {
+        using namespace clang;
+        switch(kind) {
+        case tok::pipepipe: return 1;
+        case tok::ampamp: return 2;
+        case tok::pipe: return 3;
+        case tok::caret: return 4;
+        case tok::amp: return 5;
+        case tok::equalequal:
+        case tok::exclaimequal: return 6;
+        case tok::less:
+        case tok::greater:
+        case tok::lessequal:
+        case tok::greaterequal: return 7;
+        case tok::lessless:
+        case tok::greatergreater: return 8;
+        case tok::plus:
+        case tok::minus: return 9;
+        case tok::star:
+        case tok::slash:
+        case tok::percent: return 10;
+        default: return 0;
+        }
+    }
+
+    // precedence climbing over all binary operators of at least level
+    bool parse_binary(int level, Number &dest) {
+        if (!parse_unary(dest))
+            return false;
+        while (pos < tokens.size()) {
+            auto op = tokens[pos].getKind();
+            int prec = precedence(op);
+            if (!prec || (prec < level))
+                break;
+            pos++;
+            Number rhs;
+            if (!parse_binary(prec + 1, rhs))
+                return false;
+            Number lhs = dest;
+            if (!apply(op, lhs, rhs, dest))
+                return false;
+        }
+        return true;
+    }
+
+    bool parse_conditional(Number &dest) {
+        using namespace clang;
+        Number cond;
+        if (!parse_binary(1, cond))
+            return false;
+        if (!accept(tok::question)) {
+            dest = cond;
+            return true;
+        }
+        Number a, b;
+        if (!parse_conditional(a) || !accept(tok::colon) || !parse_conditional(b))
+            return false;
+        auto T = common_type(a, b);
+        return convert(is_true(cond)?a:b, T, dest);
+    }
+};
+
+//------------------------------------------------------------------------------
+// IMPORT CACHE
+//------------------------------------------------------------------------------
+
+/* a cached import is a binary image of the namespaces that the visitor and
+   the macro scan produced, alongside the size and modification time of every
+   file that clang read, and a second entry with the object compiled from the
+   module. a warm import checks the files, then rebuilds types and values from
+   the image without starting clang.
+
+   the image is a sequence of type records, each defining the next type id
+   in the order the writer first reached the type, followed by the entries of
+   all namespaces. typenames are declared before their storage is visited, so
+   that records can refer to typenames that are not complete yet. */
+
+// bump whenever the encoding changes
+#define SCOPES_C_IMPORT_IMAGE_VERSION 1
+#define SCOPES_C_IMPORT_IMAGE_MAGIC "SCCI"
+
+struct CImportDependency {
+    std::string path;
+    uint64_t mtime;
+    uint64_t size;
+};
+
+enum CImportImageTag {
+    // type records that define the next type id
+    CIT_Builtin = 1,
+    CIT_Integer,
+    CIT_Real,
+    CIT_Pointer,
+    CIT_Array,
+    CIT_Vector,
+    CIT_Tuple,
+    CIT_Function,
+    CIT_Arguments,
+    CIT_Key,
+    CIT_Refer,
+    CIT_Typename,
+    // type records that modify a typename
+    CIT_Complete,
+    CIT_Opaque,
+    CIT_Bind,
+    // values
+    CIV_Backref,
+    CIV_Int,
+    CIV_Real,
+    CIV_String,
+    CIV_Type,
+    CIV_Global,
+    CIV_PureCast,
+};
+
+// typenames that imports refer to, but don't create
+static const Type *c_import_builtin_type(uint64_t index) {
+    switch(index) {
+    case 0: return TYPE_CStruct;
+    case 1: return TYPE_CUnion;
+    case 2: return TYPE_CEnum;
+    case 3: return TYPE_Typename;
+    default: return nullptr;
+    }
+}
+
+struct CImportImageWriter {
+    const CNamespaces &ns;
+    std::vector<char> deps;
+    std::vector<char> records;
+    std::vector<char> body;
+    std::vector<const String *> strings;
+    absl::flat_hash_map<const String *, uint32_t> string_ids;
+    absl::flat_hash_map<const Type *, uint64_t> type_ids;
+    // globals are not interned, so values that the namespaces share must
+    // stay shared
+    absl::flat_hash_map<std::pair<const Value *, const Anchor *>, uint64_t> value_ids;
+    uint64_t dep_count = 0;
+    uint64_t type_count = 0;
+    uint64_t record_count = 0;
+    uint64_t value_count = 0;
+
+    CImportImageWriter(const CNamespaces &_ns) : ns(_ns) {}
+
+    static void write_varint(std::vector<char> &dest, uint64_t value) {
+        while (value >= 0x80) {
+            dest.push_back((char)((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        dest.push_back((char)value);
+    }
+
+    uint32_t string_id(const String *str) {
+        auto it = string_ids.find(str);
+        if (it != string_ids.end())
+            return it->second;
+        uint32_t id = strings.size();
+        strings.push_back(str);
+        string_ids.insert({str, id});
+        return id;
+    }
+
+    void write_symbol(std::vector<char> &dest, Symbol sym) {
+        write_varint(dest, string_id(sym.name()));
+    }
+
+    void add_dependency(const CImportDependency &dep) {
+        write_varint(deps, string_id(String::from_stdstring(dep.path)));
+        write_varint(deps, dep.mtime);
+        write_varint(deps, dep.size);
+        dep_count++;
+    }
+
+    bool write_anchor(std::vector<char> &dest, const Anchor *anchor) {
+        if (anchor == unknown_anchor()) {
+            write_varint(dest, 0);
+            return true;
+        }
+        if (anchor->buffer)
+            return false;
+        write_varint(dest, string_id(anchor->path.name()) + 1);
+        write_varint(dest, (uint32_t)anchor->lineno);
+        write_varint(dest, (uint32_t)anchor->column);
+        write_varint(dest, (uint32_t)anchor->offset);
+        return true;
+    }
+
+    // types are only encoded if the constructor that the reader is going to
+    // use gives back the very same type
+    bool type_id(const Type *T, uint64_t &id) {
+        auto it = type_ids.find(T);
+        if (it != type_ids.end()) {
+            id = it->second;
+            return true;
+        }
+        for (uint64_t i = 0; c_import_builtin_type(i); ++i) {
+            if (c_import_builtin_type(i) == T) {
+                records.push_back(CIT_Builtin);
+                write_varint(records, i);
+                return define_type(T, id);
+            }
+        }
+        switch(T->kind()) {
+        case TK_Integer: {
+            auto ity = cast<IntegerType>(T);
+            if (integer_type(ity->width, ity->issigned) != T)
+                return false;
+            records.push_back(CIT_Integer);
+            write_varint(records, ity->width);
+            write_varint(records, ity->issigned);
+        } break;
+        case TK_Real: {
+            auto rt = cast<RealType>(T);
+            if (real_type(rt->width) != T)
+                return false;
+            records.push_back(CIT_Real);
+            write_varint(records, rt->width);
+        } break;
+        case TK_Pointer: {
+            auto pt = cast<PointerType>(T);
+            uint64_t ET;
+            if (!type_id(pt->element_type, ET))
+                return false;
+            if (pointer_type(pt->element_type, pt->flags, pt->storage_class) != T)
+                return false;
+            records.push_back(CIT_Pointer);
+            write_varint(records, ET);
+            write_varint(records, pt->flags);
+            write_symbol(records, pt->storage_class);
+        } break;
+        case TK_Array:
+        case TK_Vector: {
+            auto at = cast<ArrayLikeType>(T);
+            uint64_t ET;
+            if (!type_id(at->element_type, ET))
+                return false;
+            auto result = (T->kind() == TK_Array)
+                ?array_type(at->element_type, at->_count, at->_zterm)
+                :vector_type(at->element_type, at->_count);
+            if (!result.ok() || (result.assert_ok() != T))
+                return false;
+            records.push_back((T->kind() == TK_Array)?CIT_Array:CIT_Vector);
+            write_varint(records, ET);
+            write_varint(records, at->_count);
+            if (T->kind() == TK_Array)
+                write_varint(records, at->_zterm);
+        } break;
+        case TK_Tuple: {
+            auto tt = cast<TupleType>(T);
+            std::vector<uint64_t> ids;
+            if (!type_ids_of(tt->values, ids))
+                return false;
+            size_t alignment = tt->explicit_alignment?tt->align:0;
+            auto result = tuple_type(tt->values, tt->packed, alignment);
+            if (!result.ok() || (result.assert_ok() != T))
+                return false;
+            records.push_back(CIT_Tuple);
+            write_varint(records, tt->packed);
+            write_varint(records, alignment);
+            write_ids(ids);
+        } break;
+        case TK_Function: {
+            auto ft = cast<FunctionType>(T);
+            uint64_t RT;
+            std::vector<uint64_t> ids;
+            if (!type_id(ft->return_type, RT)
+                || !type_ids_of(ft->argument_types, ids))
+                return false;
+            if (function_type(ft->return_type, ft->argument_types, ft->flags) != T)
+                return false;
+            records.push_back(CIT_Function);
+            write_varint(records, RT);
+            write_varint(records, ft->flags);
+            write_ids(ids);
+        } break;
+        case TK_Arguments: {
+            auto at = cast<ArgumentsType>(T);
+            std::vector<uint64_t> ids;
+            if (!type_ids_of(at->values, ids))
+                return false;
+            if (arguments_type(at->values) != T)
+                return false;
+            records.push_back(CIT_Arguments);
+            write_ids(ids);
+        } break;
+        case TK_Qualify: {
+            auto qt = cast<QualifyType>(T);
+            uint64_t ET;
+            if (!type_id(qt->type, ET))
+                return false;
+            if (qt->mask == (1 << QK_Key)) {
+                auto kq = cast<KeyQualifier>(qt->qualifiers[QK_Key]);
+                if (key_type(kq->key, qt->type) != T)
+                    return false;
+                records.push_back(CIT_Key);
+                write_symbol(records, kq->key);
+                write_varint(records, ET);
+            } else if (qt->mask == (1 << QK_Refer)) {
+                auto rq = cast<ReferQualifier>(qt->qualifiers[QK_Refer]);
+                if (refer_type(qt->type, rq->flags, rq->storage_class) != T)
+                    return false;
+                records.push_back(CIT_Refer);
+                write_varint(records, ET);
+                write_varint(records, rq->flags);
+                write_symbol(records, rq->storage_class);
+            } else {
+                return false;
+            }
+        } break;
+        case TK_Typename: {
+            return typename_id(cast<TypenameType>(T), id);
+        } break;
+        default: return false;
+        }
+        return define_type(T, id);
+    }
+
+    bool define_type(const Type *T, uint64_t &id) {
+        id = type_count++;
+        type_ids.insert({T, id});
+        record_count++;
+        return true;
+    }
+
+    bool type_ids_of(const Types &types, std::vector<uint64_t> &ids) {
+        for (auto T : types) {
+            uint64_t id;
+            if (!type_id(T, id))
+                return false;
+            ids.push_back(id);
+        }
+        return true;
+    }
+
+    void write_ids(const std::vector<uint64_t> &ids) {
+        write_varint(records, ids.size());
+        for (auto id : ids) {
+            write_varint(records, id);
+        }
+    }
+
+    bool typename_id(const TypenameType *T, uint64_t &id) {
+        auto title = ns.titles.find(T);
+        if (title == ns.titles.end())
+            return false;
+        uint64_t super;
+        if (!type_id(T->super(), super))
+            return false;
+        records.push_back(CIT_Typename);
+        write_varint(records, string_id(title->second));
+        write_varint(records, super);
+        define_type(T, id);
+        if (T->is_complete()) {
+            if (T->is_opaque()) {
+                records.push_back(CIT_Opaque);
+                write_varint(records, id);
+            } else {
+                uint64_t ST;
+                if (!type_id(T->storage(), ST))
+                    return false;
+                records.push_back(CIT_Complete);
+                write_varint(records, id);
+                write_varint(records, ST);
+                write_varint(records, T->is_plain()?TNF_Plain:0);
+            }
+            record_count++;
+        }
+        auto &&symbols = T->get_symbols();
+        for (int i = 0; i < symbols.entries.size(); ++i) {
+            if (symbols.is_discarded(i))
+                continue;
+            auto &&entry = symbols.entries[i];
+            if (entry.second.doc)
+                return false;
+            auto value = entry.second.expr.dyn_cast<Pure>();
+            if (!value || !prepare_value(value))
+                return false;
+            records.push_back(CIT_Bind);
+            write_varint(records, id);
+            write_symbol(records, entry.first);
+            if (!write_value(records, value, false))
+                return false;
+            record_count++;
+        }
+        return true;
+    }
+
+    // writes records for all types that value refers to
+    bool prepare_value(const PureRef &value) {
+        uint64_t id;
+        switch(value->kind()) {
+        case VK_ConstInt:
+        case VK_ConstReal:
+        case VK_ConstString:
+            return type_id(value->get_type(), id);
+        case VK_ConstPointer: {
+            if (value->get_type() != TYPE_Type)
+                return false;
+            return type_id((const Type *)value.cast<ConstPointer>()->value, id);
+        } break;
+        case VK_Global: {
+            auto g = value.cast<Global>();
+            if (g->initializer || g->constructor || (g->location != -1)
+                || (g->binding != -1) || (g->descriptor_set != -1))
+                return false;
+            return type_id(g->element_type, id);
+        } break;
+        case VK_PureCast: {
+            auto pc = value.cast<PureCast>();
+            return type_id(pc->get_type(), id) && prepare_value(pc->value);
+        } break;
+        default: break;
+        }
+        return false;
+    }
+
+    uint64_t prepared_type_id(const Type *T) {
+        auto it = type_ids.find(T);
+        assert(it != type_ids.end());
+        return it->second;
+    }
+
+    // only values in the namespaces are memoized, because the reader reads
+    // the records before the namespaces
+    bool write_value(std::vector<char> &dest, const PureRef &value, bool memo) {
+        auto key = std::make_pair((const Value *)value.unref(), value.anchor());
+        if (memo) {
+            auto it = value_ids.find(key);
+            if (it != value_ids.end()) {
+                dest.push_back(CIV_Backref);
+                write_varint(dest, it->second);
+                return true;
+            }
+        }
+        switch(value->kind()) {
+        case VK_ConstInt: {
+            auto ci = value.cast<ConstInt>();
+            if (ci->words.size() != 1)
+                return false;
+            dest.push_back(CIV_Int);
+            if (!write_anchor(dest, value.anchor())) return false;
+            write_varint(dest, prepared_type_id(ci->get_type()));
+            write_varint(dest, ci->value());
+        } break;
+        case VK_ConstReal: {
+            auto cr = value.cast<ConstReal>();
+            dest.push_back(CIV_Real);
+            if (!write_anchor(dest, value.anchor())) return false;
+            write_varint(dest, prepared_type_id(cr->get_type()));
+            char buf[sizeof(double)];
+            memcpy(buf, &cr->value, sizeof(double));
+            dest.insert(dest.end(), buf, buf + sizeof(double));
+        } break;
+        case VK_ConstString: {
+            auto cs = value.cast<ConstString>();
+            dest.push_back(CIV_String);
+            if (!write_anchor(dest, value.anchor())) return false;
+            write_varint(dest, prepared_type_id(cs->get_type()));
+            write_varint(dest, string_id(cs->value));
+        } break;
+        case VK_ConstPointer: {
+            auto cp = value.cast<ConstPointer>();
+            dest.push_back(CIV_Type);
+            if (!write_anchor(dest, value.anchor())) return false;
+            write_varint(dest, prepared_type_id((const Type *)cp->value));
+        } break;
+        case VK_Global: {
+            auto g = value.cast<Global>();
+            dest.push_back(CIV_Global);
+            if (!write_anchor(dest, value.anchor())) return false;
+            write_varint(dest, prepared_type_id(g->element_type));
+            write_symbol(dest, g->name);
+            write_varint(dest, g->flags);
+            write_symbol(dest, g->storage_class);
+        } break;
+        case VK_PureCast: {
+            auto pc = value.cast<PureCast>();
+            dest.push_back(CIV_PureCast);
+            if (!write_anchor(dest, value.anchor())) return false;
+            write_varint(dest, prepared_type_id(pc->get_type()));
+            if (!write_value(dest, pc->value, memo)) return false;
+        } break;
+        default: return false;
+        }
+        if (memo) {
+            value_ids.insert({key, value_count++});
+        }
+        return true;
+    }
+
+    template<typename T>
+    bool write_namespace(const T &map) {
+        write_varint(body, map.count());
+        for (int i = 0; i < map.entries.size(); ++i) {
+            if (map.is_discarded(i))
+                continue;
+            auto &&entry = map.entries[i];
+            PureRef value = entry.second;
+            if (!prepare_value(value))
+                return false;
+            write_symbol(body, entry.first);
+            if (!write_value(body, value, true))
+                return false;
+        }
+        return true;
+    }
+
+    bool write_namespaces() {
+        return write_namespace(ns.structs)
+            && write_namespace(ns.unions)
+            && write_namespace(ns.enums)
+            && write_namespace(ns.defines)
+            && write_namespace(ns.constants)
+            && write_namespace(ns.typedefs)
+            && write_namespace(ns.externs);
+    }
+
+    void finalize(std::vector<char> &dest) {
+        dest.clear();
+        dest.reserve(deps.size() + records.size() + body.size()
+            + strings.size() * 16 + 32);
+        dest.insert(dest.end(), SCOPES_C_IMPORT_IMAGE_MAGIC,
+            SCOPES_C_IMPORT_IMAGE_MAGIC + 4);
+        write_varint(dest, SCOPES_C_IMPORT_IMAGE_VERSION);
+        write_varint(dest, strings.size());
+        for (auto str : strings) {
+            write_varint(dest, str->count);
+            dest.insert(dest.end(), str->data, str->data + str->count);
+        }
+        write_varint(dest, dep_count);
+        dest.insert(dest.end(), deps.begin(), deps.end());
+        write_varint(dest, record_count);
+        dest.insert(dest.end(), records.begin(), records.end());
+        dest.insert(dest.end(), body.begin(), body.end());
+    }
+};
+
+struct CImportImageReader {
+    const char *ptr;
+    const char *end;
+    bool failed = false;
+    std::vector<const String *> strings;
+    std::vector<const Type *> types;
+    std::vector<PureRef> values;
+
+    CImportImageReader(const char *data, size_t size) :
+        ptr(data), end(data + size) {}
+
+    uint64_t read_varint() {
+        uint64_t value = 0;
+        int shift = 0;
+        while (true) {
+            if ((ptr == end) || (shift > 63)) {
+                failed = true;
+                return 0;
+            }
+            uint8_t c = (uint8_t)*ptr++;
+            value |= (uint64_t)(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                break;
+            shift += 7;
+        }
+        return value;
+    }
+
+    int read_tag() {
+        if (ptr == end) {
+            failed = true;
+            return 0;
+        }
+        return *ptr++;
+    }
+
+    const String *read_string() {
+        auto id = read_varint();
+        if (failed || (id >= strings.size())) {
+            failed = true;
+            return nullptr;
+        }
+        return strings[id];
+    }
+
+    Symbol read_symbol() {
+        auto str = read_string();
+        if (failed)
+            return SYM_Unnamed;
+        return Symbol(str);
+    }
+
+    const Type *read_type() {
+        auto id = read_varint();
+        if (failed || (id >= types.size())) {
+            failed = true;
+            return nullptr;
+        }
+        return types[id];
+    }
+
+    const TypenameType *read_typename() {
+        auto T = read_type();
+        if (failed)
+            return nullptr;
+        auto tn = dyn_cast<TypenameType>(T);
+        if (!tn)
+            failed = true;
+        return tn;
+    }
+
+    bool read_types(Types &dest) {
+        auto count = read_varint();
+        if (failed || (count > (uint64_t)(end - ptr)))
+            return false;
+        dest.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            auto T = read_type();
+            if (failed)
+                return false;
+            dest.push_back(T);
+        }
+        return true;
+    }
+
+    const Type *check(const Result<const Type *> &result) {
+        if (!result.ok()) {
+            failed = true;
+            return nullptr;
+        }
+        return result.assert_ok();
+    }
+
+    const Anchor *read_anchor() {
+        auto path = read_varint();
+        if (failed)
+            return nullptr;
+        if (!path)
+            return unknown_anchor();
+        if (path > strings.size()) {
+            failed = true;
+            return nullptr;
+        }
+        int lineno = (int)(uint32_t)read_varint();
+        int column = (int)(uint32_t)read_varint();
+        int offset = (int)(uint32_t)read_varint();
+        if (failed)
+            return nullptr;
+        return Anchor::from(Symbol(strings[path - 1]), lineno, column, offset);
+    }
+
+    bool read_header() {
+        if (((end - ptr) < 4) || memcmp(ptr, SCOPES_C_IMPORT_IMAGE_MAGIC, 4))
+            return false;
+        ptr += 4;
+        if (read_varint() != SCOPES_C_IMPORT_IMAGE_VERSION)
+            return false;
+        auto count = read_varint();
+        if (failed || (count > (uint64_t)(end - ptr)))
+            return false;
+        strings.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            auto size = read_varint();
+            if (failed || (size > (uint64_t)(end - ptr)))
+                return false;
+            strings.push_back(String::from(ptr, size));
+            ptr += size;
+        }
+        return true;
+    }
+
+    // false if any file that the import read has changed; the files are
+    // appended to deps if given
+    bool check_dependencies(std::vector<CImportDependency> *deps = nullptr) {
+        auto count = read_varint();
+        for (uint64_t i = 0; (i < count) && !failed; ++i) {
+            auto path = read_string();
+            auto mtime = read_varint();
+            auto size = read_varint();
+            if (failed)
+                return false;
+            struct stat s;
+            if (stat(path->data, &s) != 0)
+                return false;
+            if (((uint64_t)s.st_mtime != mtime) || ((uint64_t)s.st_size != size))
+                return false;
+            if (deps)
+                deps->push_back({ path->data, mtime, size });
+        }
+        return !failed;
+    }
+
+    bool read_records() {
+        auto count = read_varint();
+        for (uint64_t i = 0; (i < count) && !failed; ++i) {
+            int tag = read_tag();
+            const Type *T = nullptr;
+            switch(tag) {
+            case CIT_Builtin: {
+                T = c_import_builtin_type(read_varint());
+            } break;
+            case CIT_Integer: {
+                auto width = read_varint();
+                auto issigned = read_varint();
+                if (failed || !width || (width > 128)) break;
+                T = integer_type(width, issigned != 0);
+            } break;
+            case CIT_Real: {
+                auto width = read_varint();
+                if (failed) break;
+                T = real_type(width);
+            } break;
+            case CIT_Pointer: {
+                auto ET = read_type();
+                auto flags = read_varint();
+                auto storage_class = read_symbol();
+                if (failed) break;
+                T = pointer_type(ET, flags, storage_class);
+            } break;
+            case CIT_Array: {
+                auto ET = read_type();
+                auto count = read_varint();
+                auto zterm = read_varint();
+                if (failed) break;
+                T = check(array_type(ET, count, zterm != 0));
+            } break;
+            case CIT_Vector: {
+                auto ET = read_type();
+                auto count = read_varint();
+                if (failed) break;
+                T = check(vector_type(ET, count));
+            } break;
+            case CIT_Tuple: {
+                auto packed = read_varint();
+                auto alignment = read_varint();
+                Types fields;
+                if (!read_types(fields)) break;
+                T = check(tuple_type(fields, packed != 0, alignment));
+            } break;
+            case CIT_Function: {
+                auto RT = read_type();
+                auto flags = read_varint();
+                Types args;
+                if (!read_types(args)) break;
+                T = function_type(RT, args, flags);
+            } break;
+            case CIT_Arguments: {
+                Types args;
+                if (!read_types(args)) break;
+                T = arguments_type(args);
+            } break;
+            case CIT_Key: {
+                auto key = read_symbol();
+                auto ET = read_type();
+                if (failed) break;
+                T = key_type(key, ET);
+            } break;
+            case CIT_Refer: {
+                auto ET = read_type();
+                auto flags = read_varint();
+                auto storage_class = read_symbol();
+                if (failed) break;
+                T = refer_type(ET, flags, storage_class);
+            } break;
+            case CIT_Typename: {
+                auto title = read_string();
+                auto super = read_type();
+                if (failed) break;
+                T = incomplete_typename_type(title, super);
+            } break;
+            case CIT_Complete: {
+                auto tn = read_typename();
+                auto ST = read_type();
+                auto flags = read_varint();
+                if (failed) break;
+                if (!tn->complete(ST, flags).ok())
+                    failed = true;
+                continue;
+            } break;
+            case CIT_Opaque: {
+                auto tn = read_typename();
+                if (failed) break;
+                if (!tn->complete().ok())
+                    failed = true;
+                continue;
+            } break;
+            case CIT_Bind: {
+                auto tn = read_typename();
+                auto name = read_symbol();
+                if (failed) break;
+                auto value = read_value(false);
+                if (failed) break;
+                tn->bind(name, value);
+                continue;
+            } break;
+            default: break;
+            }
+            if (!T) {
+                failed = true;
+                break;
+            }
+            types.push_back(T);
+        }
+        return !failed;
+    }
+
+    PureRef read_value(bool memo) {
+        int tag = read_tag();
+        if (failed)
+            return PureRef();
+        if (tag == CIV_Backref) {
+            auto id = read_varint();
+            if (failed || (id >= values.size())) {
+                failed = true;
+                return PureRef();
+            }
+            return values[id];
+        }
+        auto anchor = read_anchor();
+        auto T = read_type();
+        if (failed)
+            return PureRef();
+        PureRef result;
+        switch(tag) {
+        case CIV_Int: {
+            auto value = read_varint();
+            if (failed) break;
+            result = ref(anchor, ConstInt::from(T, value));
+        } break;
+        case CIV_Real: {
+            if ((size_t)(end - ptr) < sizeof(double)) {
+                failed = true;
+                break;
+            }
+            double value;
+            memcpy(&value, ptr, sizeof(double));
+            ptr += sizeof(double);
+            result = ref(anchor, ConstReal::from(T, value));
+        } break;
+        case CIV_String: {
+            auto str = read_string();
+            if (failed) break;
+            result = ref(anchor, ConstString::from(T, str));
+        } break;
+        case CIV_Type: {
+            result = ref(anchor, ConstPointer::type_from(T));
+        } break;
+        case CIV_Global: {
+            auto name = read_symbol();
+            auto flags = read_varint();
+            auto storage_class = read_symbol();
+            if (failed) break;
+            result = ref(anchor, Global::from(T, name, flags, storage_class));
+        } break;
+        case CIV_PureCast: {
+            auto value = read_value(memo);
+            if (failed) break;
+            result = ref(anchor, PureCast::from(T, value));
+        } break;
+        default: {
+            failed = true;
+        } break;
+        }
+        if (failed)
+            return PureRef();
+        if (memo) {
+            values.push_back(result);
+        }
         return result;
-    } else {
+    }
+
+    bool to_entry(const PureRef &value, PureRef &dest) {
+        dest = value;
+        return true;
+    }
+
+    bool to_entry(const PureRef &value, ConstPointerRef &dest) {
+        dest = value.dyn_cast<ConstPointer>();
+        return (bool)dest;
+    }
+
+    template<typename V>
+    bool read_namespace(OrderedMap<Symbol, V, Symbol::Hash> &map) {
+        auto count = read_varint();
+        for (uint64_t i = 0; (i < count) && !failed; ++i) {
+            auto name = read_symbol();
+            if (failed)
+                return false;
+            auto value = read_value(true);
+            if (failed)
+                return false;
+            V entry;
+            if (!to_entry(value, entry)) {
+                failed = true;
+                return false;
+            }
+            map.insert(name, entry);
+        }
+        return !failed;
+    }
+
+    bool read_namespaces(CNamespaces &ns) {
+        return read_namespace(ns.structs)
+            && read_namespace(ns.unions)
+            && read_namespace(ns.enums)
+            && read_namespace(ns.defines)
+            && read_namespace(ns.constants)
+            && read_namespace(ns.typedefs)
+            && read_namespace(ns.externs)
+            && (ptr == end);
+    }
+};
+
+static uint64_t c_import_cache_seed() {
+    return hash2(SCOPES_C_IMPORT_IMAGE_VERSION,
+        hash_bytes(scopes_compile_time_date(),
+            strlen(scopes_compile_time_date())));
+}
+
+// the image and the object of an import are separate entries, keyed on the
+// same content
+static const String *get_c_import_object_key(const std::string &keydata) {
+    return get_cache_key(hash2(c_import_cache_seed(), 1),
+        keydata.data(), keydata.size());
+}
+
+static const Scope *build_c_import_scope(const CNamespaces &ns);
+
+// records every file that clang read, except for skip_path
+static void collect_c_import_dependencies(clang::SourceManager &SM,
+    const char *skip_path, std::vector<CImportDependency> &deps) {
+    for (auto it = SM.fileinfo_begin(); it != SM.fileinfo_end(); ++it) {
+        const clang::FileEntry *FE = it->first;
+        auto name = FE->getName();
+        if (skip_path && (name == skip_path))
+            continue;
+        deps.push_back({ name.str(),
+            (uint64_t)FE->getModificationTime(), (uint64_t)FE->getSize() });
+    }
+}
+
+// returns null if the import is not cached, or any of the files it read
+// have since changed
+static SCOPES_RESULT(const Scope *) get_cached_c_import(const std::string &keydata) {
+    SCOPES_RESULT_TYPE(const Scope *);
+    auto key = get_cache_key(c_import_cache_seed(),
+        keydata.data(), keydata.size());
+    size_t size = 0;
+    auto data = get_cache(key, size);
+    if (!data)
+        return nullptr;
+    size_t objsize = 0;
+    auto obj = get_cache(get_c_import_object_key(keydata), objsize);
+    if (!obj)
+        return nullptr;
+    CImportImageReader reader(data, size);
+    if (!reader.read_header() || !reader.check_dependencies())
+        return nullptr;
+    CNamespaces ns;
+    if (!reader.read_records() || !reader.read_namespaces(ns))
+        return nullptr;
+    // the cache mapping outlives the JIT, so no copy is necessary
+    if (objsize) {
+        auto t = std::chrono::steady_clock::now();
+        SCOPES_CHECK_RESULT(add_object(
+            LLVMCreateMemoryBufferWithMemoryRange(obj, objsize, "", false)));
+        count_cache_object_load(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - t).count());
+    }
+    return build_c_import_scope(ns);
+}
+
+// adds the module to the JIT; if the namespaces can be encoded, the image and
+// the compiled object are written to the cache along the way. a module that
+// defines nothing is passed as null and cached as an empty object.
+static SCOPES_RESULT(void) set_cached_c_import(const std::string &keydata,
+    const CNamespaces &ns, const std::vector<CImportDependency> &deps,
+    LLVMModuleRef M) {
+    SCOPES_RESULT_TYPE(void);
+    CImportImageWriter writer(ns);
+    for (auto &&dep : deps) {
+        writer.add_dependency(dep);
+    }
+    if (!writer.write_namespaces()) {
+        if (!M)
+            return {};
+        return add_module(M, PointerMap(), CF_Cache);
+    }
+    std::vector<char> image;
+    writer.finalize(image);
+
+    if (!M) {
+        set_cache(get_c_import_object_key(keydata), nullptr, 0, "", 0);
+        set_cache(get_cache_key(c_import_cache_seed(),
+                keydata.data(), keydata.size()),
+            keydata.data(), keydata.size(), image.data(), image.size());
+        return {};
+    }
+
+    auto target_machine = get_jit_target_machine();
+    assert(target_machine);
+    char *errormsg;
+    LLVMMemoryBufferRef membuf = nullptr;
+    TraceScope emit_trace("codegen",
+        [&]() { return trace_emit_name(M); });
+    if (LLVMTargetMachineEmitToMemoryBuffer(target_machine, M,
+        LLVMObjectFile, &errormsg, &membuf)) {
+        SCOPES_ERROR(CGenBackendFailed, errormsg);
+    }
+    set_cache(get_c_import_object_key(keydata), nullptr, 0,
+        LLVMGetBufferStart(membuf), LLVMGetBufferSize(membuf));
+    // written last, so that an image is never found without its object
+    set_cache(get_cache_key(c_import_cache_seed(),
+            keydata.data(), keydata.size()),
+        keydata.data(), keydata.size(), image.data(), image.size());
+    return add_object(membuf);
+}
+
+//------------------------------------------------------------------------------
+// CLANG SESSION
+//------------------------------------------------------------------------------
+
+/* import-c keeps some clang state between imports on the same thread: the
+   invocation for each argument list, which spares running the driver again,
+   and the file manager, whose cache of file and directory lookups lets
+   header search for repeated includes stay in memory. the file manager
+   assumes that headers don't change while the process runs. */
+
+struct CImportSession {
+    // source extension and arguments, without the source path
+    absl::flat_hash_map<std::string,
+        std::shared_ptr<clang::CompilerInvocation> > invocations;
+    llvm::IntrusiveRefCntPtr<clang::FileManager> files;
+
+    clang::FileManager *file_manager() {
+        if (!files) {
+            files = new clang::FileManager(clang::FileSystemOptions());
+        }
+        return files.get();
+    }
+
+    // drops all cached lookups, e.g. after a file has been written
+    void reset_file_manager() {
+        files = nullptr;
+    }
+
+    // aargs[1] is the source path
+    std::shared_ptr<clang::CompilerInvocation> create_invocation(
+        const std::vector<const char *> &aargs, const std::string &path) {
+        std::string key;
+        auto ext = path.find_last_of('.');
+        if (ext != std::string::npos)
+            key = path.substr(ext);
+        for (size_t i = 0; i < aargs.size(); ++i) {
+            key.push_back(0);
+            if (i != 1)
+                key.append(aargs[i]);
+        }
+        auto it = invocations.find(key);
+        if (it == invocations.end()) {
+            std::shared_ptr<clang::CompilerInvocation> invocation =
+                clang::createInvocationFromCommandLine(aargs);
+            if (!invocation)
+                return nullptr;
+            it = invocations.insert({key, invocation}).first;
+        }
+        auto &&templ = *it->second;
+        assert(templ.getFrontendOpts().Inputs.size() == 1);
+        auto result = std::make_shared<clang::CompilerInvocation>(templ);
+        auto &&inputs = result->getFrontendOpts().Inputs;
+        inputs[0] = clang::FrontendInputFile(path, inputs[0].getKind());
+        auto slash = path.find_last_of("/\\");
+        result->getCodeGenOpts().MainFileName =
+            (slash == std::string::npos)?path:path.substr(slash + 1);
+        return result;
+    }
+};
+
+static thread_local CImportSession c_import_session;
+
+// arguments from the environment and the build, which are the same for all
+// imports
+static const std::vector<std::string> &c_import_env_args() {
+    static const std::vector<std::string> env_args = []() {
+        std::vector<std::string> result;
+        // grab compiler args from the nix wrapper variable
+        const char* envstr = getenv("NIX_CFLAGS_COMPILE");
+        if(envstr != nullptr)
+        {
+            std::string nixenv(envstr);
+            size_t last = 0;
+            size_t pos = 0;
+            while((pos = nixenv.find(" ", last)) != std::string::npos)
+            {
+                if(last != pos)
+                {
+                    result.push_back(nixenv.substr(last, pos - last));
+                }
+                last = pos + 1;
+            }
+            result.push_back(nixenv.substr(last));
+        }
+
+#ifdef SCOPES_WIN32
+        // Unfuck the windows stdio header
+        result.push_back("-D_NO_CRT_STDIO_INLINE=1");
+#endif
+
+#ifdef SCOPES_ADD_IMPORT_CFLAGS
+        {
+            std::string addflags = SCOPES_ADD_IMPORT_CFLAGS;
+            size_t last = 0;
+            size_t pos = 0;
+            //split by ! because defining a symbol to a string containing spaces through escaping and an environment variable was too painful
+            while((pos = addflags.find("!", last)) != std::string::npos)
+            {
+                if(last != pos)
+                {
+                    result.push_back(addflags.substr(last, pos - last));
+                }
+                last = pos + 1;
+            }
+            result.push_back(addflags.substr(last));
+        }
+#endif
+        return result;
+    }();
+    return env_args;
+}
+
+//------------------------------------------------------------------------------
+// PRECOMPILED HEADERS
+//------------------------------------------------------------------------------
+
+/* when an import misses the cache, the leading #include directives of its
+   source are compiled from a precompiled header in the cache directory, so
+   that imports which start with the same headers only parse what follows.
+
+   the longest run of leading directives for which a header exists is used.
+   if there is none, a header is built for the first directive alone, as
+   that is where the bulk of shared headers is usually pulled in. */
+
+struct CImportPCH {
+    // source with the precompiled directives blanked out
+    std::string source;
+    std::string path;
+    std::vector<CImportDependency> deps;
+};
+
+// returns the offsets just past each leading include directive
+static void find_c_import_prefixes(const char *source,
+    std::vector<size_t> &ends) {
+    const char *s = source;
+    while (*s) {
+        const char *line = s;
+        while (*s && (*s != '\n'))
+            s++;
+        const char *c = line;
+        while ((c < s) && isspace((unsigned char)*c))
+            c++;
+        if (c != s) {
+            if (*c != '#')
+                break;
+            c++;
+            while ((c < s) && isspace((unsigned char)*c))
+                c++;
+            if (((s - c) < 8) || strncmp(c, "include", 7) || !isspace((unsigned char)c[7]))
+                break;
+            ends.push_back(s - source);
+        }
+        if (*s)
+            s++;
+    }
+}
+
+static std::string c_import_dirname(const std::string &path) {
+    auto pos = path.find_last_of("/\\");
+    if (pos == std::string::npos)
+        return ".";
+    return path.substr(0, pos);
+}
+
+static const String *get_c_import_pch_key(
+    const std::vector<const char *> &aargs,
+    const std::string &path, const char *source, size_t size) {
+    std::string keydata;
+    for (size_t i = 0; i < aargs.size(); ++i) {
+        // the source path is replaced, but relative includes resolve
+        // against its directory
+        if (i == 1) {
+            keydata.append(c_import_dirname(path));
+        } else {
+            keydata.append(aargs[i]);
+        }
+        keydata.push_back(0);
+    }
+    keydata.append(source, size);
+    return get_cache_key(hash2(c_import_cache_seed(), 2),
+        keydata.data(), keydata.size());
+}
+
+static std::string get_c_import_pch_file(const String *key, const char *ext) {
+    std::string result = get_cache_dir();
+    result += "/";
+    result.append(key->data, key->count);
+    result += ext;
+    return result;
+}
+
+// the dependencies of a header are stored as an image without records
+static bool check_c_import_pch(const String *key, const std::string &pchpath,
+    std::vector<CImportDependency> &deps) {
+    struct stat s;
+    if (stat(pchpath.c_str(), &s) != 0)
+        return false;
+    size_t size = 0;
+    auto data = get_cache(key, size);
+    if (!data)
+        return false;
+    CImportImageReader reader(data, size);
+    return reader.read_header() && reader.check_dependencies(&deps);
+}
+
+static bool build_c_import_pch(const std::vector<const char *> &aargs,
+    const std::string &path, const String *key, const char *source, size_t size,
+    const std::string &pchpath, std::vector<CImportDependency> &deps) {
+    using namespace clang;
+    bool cxx = (path.size() >= 4) && !path.compare(path.size() - 4, 4, ".cpp");
+    std::string header = get_c_import_pch_file(key, cxx?".hpp":".h");
+    // the header is only written once, as rewriting it would invalidate
+    // headers that another process built from it
+    struct stat s;
+    if (stat(header.c_str(), &s) != 0) {
+        FILE *f = fopen(header.c_str(), "wb");
+        if (!f)
+            return false;
+        bool ok = (fwrite(source, 1, size, f) == size);
+        ok = (fputc('\n', f) != EOF) && ok;
+        if ((fclose(f) != 0) || !ok) {
+            remove(header.c_str());
+            return false;
+        }
+    }
+    std::string dirname = c_import_dirname(path);
+    std::vector<const char *> pchargs(aargs);
+    pchargs[1] = header.c_str();
+    pchargs.push_back("-iquote");
+    pchargs.push_back(dirname.c_str());
+
+    CompilerInstance compiler;
+    auto invocation = createInvocationFromCommandLine(pchargs);
+    if (!invocation)
+        return false;
+    compiler.setInvocation(std::move(invocation));
+    // errors are reported by the import that follows
+    compiler.createDiagnostics(new IgnoringDiagConsumer(), true);
+    // written to a temporary file and renamed on success
+    compiler.getFrontendOpts().OutputFile = pchpath;
+    GeneratePCHAction action;
+    if (!compiler.ExecuteAction(action)
+        || compiler.getDiagnostics().hasErrorOccurred())
+        return false;
+
+    CNamespaces ns;
+    CImportImageWriter writer(ns);
+    deps.clear();
+    collect_c_import_dependencies(compiler.getSourceManager(), nullptr, deps);
+    for (auto &&dep : deps) {
+        writer.add_dependency(dep);
+    }
+    std::vector<char> image;
+    writer.finalize(image);
+    set_cache(key, nullptr, 0, image.data(), image.size());
+    // lookups of the previous header may be cached
+    c_import_session.reset_file_manager();
+    return true;
+}
+
+// returns false if the import should be compiled without a precompiled
+// header
+static bool find_c_import_pch(const std::vector<const char *> &aargs,
+    const std::string &path, const char *buffer, CImportPCH &pch) {
+    std::vector<size_t> ends;
+    find_c_import_prefixes(buffer, ends);
+    if (ends.empty())
+        return false;
+    size_t end = 0;
+    for (size_t i = ends.size(); i-- > 0;) {
+        auto key = get_c_import_pch_key(aargs, path, buffer, ends[i]);
+        pch.path = get_c_import_pch_file(key, ".pch");
+        if (check_c_import_pch(key, pch.path, pch.deps)) {
+            end = ends[i];
+            break;
+        }
+    }
+    if (!end) {
+        auto key = get_c_import_pch_key(aargs, path, buffer, ends[0]);
+        pch.path = get_c_import_pch_file(key, ".pch");
+        if (!build_c_import_pch(aargs, path, key, buffer, ends[0],
+                pch.path, pch.deps))
+            return false;
+        end = ends[0];
+    }
+    // blanking out keeps the line numbers of what follows
+    pch.source = buffer;
+    for (size_t i = 0; i < end; ++i) {
+        if (pch.source[i] != '\n')
+            pch.source[i] = ' ';
+    }
+    return true;
+}
+
+static const Scope *build_c_import_scope(const CNamespaces &ns) {
+    const Scope *result = Scope::from(nullptr, nullptr);
+    merge_namespace_symbols(result, SYM_Struct, ns.structs);
+    merge_namespace_symbols(result, SYM_Union, ns.unions);
+    merge_namespace_symbols(result, SYM_Enum, ns.enums);
+    merge_namespace_symbols(result, KW_Define, ns.defines);
+    merge_namespace_symbols(result, SYM_Const, ns.constants);
+    merge_namespace_symbols(result, SYM_TypeDef, ns.typedefs);
+    merge_namespace_symbols(result, SYM_Extern, ns.externs);
+    result->table();
+    return result;
+}
+
+static void bind_lazy_namespace(const Scope *&scope, Symbol symbol,
+    CImportIndex *index, CImportNamespace kind) {
+    const Scope *sub = Scope::lazy_from(nullptr, nullptr,
+        new CImportResolver(index, kind));
+    scope = Scope::bind_from(ConstInt::symbol_from(symbol),
+        ConstPointer::scope_from(sub), nullptr, scope);
+}
+
+static const Scope *build_lazy_c_import_scope(CImportIndex *index) {
+    const Scope *result = Scope::from(nullptr, nullptr);
+    bind_lazy_namespace(result, SYM_Struct, index, CIN_Struct);
+    bind_lazy_namespace(result, SYM_Union, index, CIN_Union);
+    bind_lazy_namespace(result, SYM_Enum, index, CIN_Enum);
+    merge_namespace_symbols(result, KW_Define, index->ns.defines);
+    bind_lazy_namespace(result, SYM_Const, index, CIN_Const);
+    bind_lazy_namespace(result, SYM_TypeDef, index, CIN_TypeDef);
+    bind_lazy_namespace(result, SYM_Extern, index, CIN_Extern);
+    result->table();
+    return result;
+}
+
+//------------------------------------------------------------------------------
+// IMPORT TASKS
+//------------------------------------------------------------------------------
+
+/* an import is prepared, compiled and finished in three steps. compiling
+   only involves clang and LLVM, so the imports of a batch are compiled in
+   parallel, each on an LLVM context of its own; they then only collect the
+   declarations they parse. preparing and finishing involve types, scopes
+   and the JIT, and run in order on the importing thread. */
+
+struct CImportTask {
+    std::string path;
+    std::vector<std::string> args;
+    const char *buffer = nullptr;
+    const Scope *scope = nullptr;
+
+    std::vector<const char *> aargs;
+    std::string object_file;
+    bool lazy = false;
+    bool cache = false;
+    std::string keydata;
+    std::vector<CImportDependency> deps;
+    const char *remapped_path = nullptr;
+#if SCOPES_ALLOW_CACHE && SCOPES_C_IMPORT_PCH
+    CImportPCH pch;
+#endif
+    bool use_pch = false;
+    // set if the import was found in the cache
+    const Scope *result = nullptr;
+
+    CNamespaces local_ns;
+    CNamespaces *ns = &local_ns;
+    CVisitor visitor;
+    std::unique_ptr<CImportIndex> index;
+    std::unique_ptr<clang::CompilerInstance> compiler;
+    std::unique_ptr<EmitLLVMOnlyAction> action;
+    bool compiled = false;
+    // declarations to translate when the import is finished
+    bool deferred = false;
+    std::vector<clang::Decl *> decls;
+};
+
+static SCOPES_RESULT(void) prepare_c_import(CImportTask &task) {
+    SCOPES_RESULT_TYPE(void);
+    auto &aargs = task.aargs;
+    aargs.push_back("clang");
+    aargs.push_back(task.path.c_str());
+    aargs.push_back("-fno-common");
+    for (auto &&arg : c_import_env_args()) {
+        aargs.push_back(arg.c_str());
+    }
+
+    auto &args = task.args;
+    auto argcount = args.size();
+    for (size_t i = 0; i < argcount; ++i) {
+        if ((args[i] == "-c") && ((i + 1) < argcount)) {
+            task.object_file = args[i + 1];
+            i += 2;
+            continue;
+        }
+        if (args[i] == "--lazy") {
+            task.lazy = true;
+            continue;
+        }
+        aargs.push_back(args[i].c_str());
+    }
+
+    // imports that build on types of a scope, write an object file, or
+    // translate on demand are not cached
+#if SCOPES_ALLOW_CACHE && SCOPES_CACHE_C_IMPORTS
+    task.cache = !task.scope && task.object_file.empty() && !task.lazy;
+#endif
+    if (task.cache) {
+        auto &keydata = task.keydata;
+        for (auto arg : aargs) {
+            keydata.append(arg);
+            keydata.push_back(0);
+        }
+        if (task.buffer) {
+            keydata.push_back(1);
+            keydata.append(task.buffer);
+        }
+        task.result = SCOPES_GET_RESULT(get_cached_c_import(keydata));
+        if (task.result)
+            return {};
+    }
+
+    task.remapped_path = task.buffer?task.path.c_str():nullptr;
+#if SCOPES_ALLOW_CACHE && SCOPES_C_IMPORT_PCH
+    task.use_pch = task.buffer
+        && find_c_import_pch(aargs, task.path, task.buffer, task.pch);
+    if (task.use_pch) {
+        task.buffer = task.pch.source.c_str();
+        task.deps = task.pch.deps;
+    }
+#endif
+
+    if (task.lazy) {
+        task.index.reset(new CImportIndex());
+        task.ns = &task.index->ns;
+    }
+    if (task.scope) {
+        auto scope = task.scope;
+        auto &ns = *task.ns;
+        build_namespace_symbols(scope, SYM_Struct, ns.structs);
+        build_namespace_symbols(scope, SYM_Union, ns.unions);
+        build_namespace_symbols(scope, SYM_Enum, ns.enums);
+        build_namespace_symbols(scope, KW_Define, ns.defines);
+        build_namespace_symbols(scope, SYM_Const, ns.constants);
+        build_namespace_symbols(scope, SYM_TypeDef, ns.typedefs);
+        build_namespace_symbols(scope, SYM_Extern, ns.externs);
+    }
+    return {};
+}
+
+// may run on any thread if deferred is set; returns false if clang failed
+static bool compile_c_import(CImportTask &task, bool deferred) {
+    using namespace clang;
+    TraceScope import_trace("import-c",
+        [&]() { return "import_c_module " + task.path; });
+    task.compiler.reset(new CompilerInstance());
+    CompilerInstance &compiler = *task.compiler;
+    auto invocation = c_import_session.create_invocation(task.aargs, task.path);
+    if (!invocation)
+        return false;
+    compiler.setInvocation(invocation);
+    compiler.setFileManager(c_import_session.file_manager());
+    task.deferred = deferred;
+    if (task.index || deferred) {
+        // keeps the AST once the action ends
+        compiler.getFrontendOpts().DisableFree = true;
+    }
+#if SCOPES_ALLOW_CACHE && SCOPES_C_IMPORT_PCH
+    if (task.use_pch) {
+        compiler.getPreprocessorOpts().ImplicitPCHInclude = task.pch.path;
+    }
+#endif
+
+    if (task.buffer) {
+        auto &opts = compiler.getPreprocessorOpts();
+
+        llvm::MemoryBuffer * membuffer =
+            llvm::MemoryBuffer::getMemBuffer(task.buffer, "<buffer>").release();
+
+        opts.addRemappedFile(task.path, membuffer);
+    }
+
+    // Create the compilers actual diagnostics engine.
+    compiler.createDiagnostics();
+
+    // Infer the builtin include path if unspecified.
+    //~ if (compiler.getHeaderSearchOpts().UseBuiltinIncludes &&
+        //~ compiler.getHeaderSearchOpts().ResourceDir.empty())
+        //~ compiler.getHeaderSearchOpts().ResourceDir =
+            //~ CompilerInvocation::GetResourcesPath(scopes_argv[0], MainAddr);
+
+    // contexts are not thread safe, so parallel imports each own one, which
+    // is never freed
+    llvm::LLVMContext *context = deferred?(new llvm::LLVMContext())
+        :(llvm::LLVMContext *)LLVMGetGlobalContext();
+
+    // Create and execute the frontend to generate an LLVM bitcode module.
+    task.action.reset(new EmitLLVMOnlyAction(task.ns, context));
+    auto &Act = *task.action;
+    Act.use_pch = task.use_pch;
+    Act.index = task.index.get();
+    if (deferred) {
+        Act.deferred = &task.decls;
+    }
+    return compiler.ExecuteAction(Act);
+}
+
+// names of the ODR definitions that imports have added to the JIT so far
+static absl::flat_hash_set<std::string> c_import_definitions;
+
+// static functions that only refer to external symbols and local constants
+// are renamed after their content and given ODR linkage, so that imports
+// which emit the same header functions define the same symbols; callers that
+// only referred to these become eligible in turn. definitions that an earlier
+// import has added are then dropped, unless the module must stand alone.
+// returns false if nothing is left to add.
+static bool share_c_module_definitions(LLVMModuleRef module, bool standalone) {
+    auto &M = *llvm::unwrap(module);
+    std::vector<uint64_t> digest;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &F : M) {
+            if (F.isDeclaration() || !F.hasLocalLinkage())
+                continue;
+            if (!digest_function(llvm::wrap(&F), digest))
+                continue;
+            auto hash = hash_bytes((const char *)digest.data(),
+                digest.size() * sizeof(uint64_t));
+            char suffix[20];
+            snprintf(suffix, sizeof(suffix), ".%016" PRIx64, hash);
+            F.setName(F.getName() + suffix);
+            F.setLinkage(llvm::GlobalValue::WeakODRLinkage);
+            changed = true;
+        }
+    }
+
+    for (auto &F : M) {
+        if (F.isDeclaration())
+            continue;
+        if (!F.hasLinkOnceODRLinkage() && !F.hasWeakODRLinkage())
+            continue;
+        auto inserted = c_import_definitions.insert(F.getName().str());
+        if (!inserted.second && !standalone) {
+            F.deleteBody();
+        }
+    }
+
+    // drop what only the dropped definitions used
+    changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = M.begin(); it != M.end();) {
+            auto &F = *it++;
+            if (F.hasLocalLinkage() && F.use_empty()) {
+                F.eraseFromParent();
+                changed = true;
+            }
+        }
+        for (auto it = M.global_begin(); it != M.global_end();) {
+            auto &G = *it++;
+            if (G.hasLocalLinkage() && G.use_empty()) {
+                G.eraseFromParent();
+                changed = true;
+            }
+        }
+    }
+
+    for (auto &F : M) {
+        if (!F.isDeclaration())
+            return true;
+    }
+    for (auto &G : M.globals()) {
+        if (!G.isDeclaration())
+            return true;
+    }
+    return false;
+}
+
+static SCOPES_RESULT(const Scope *) finish_c_import(CImportTask &task) {
+    using namespace clang;
+    SCOPES_RESULT_TYPE(const Scope *);
+    if (task.result)
+        return task.result;
+    if (!task.compiled) {
         SCOPES_ERROR(CImportCompilationFailed);
     }
+    auto &Act = *task.action;
+    auto &ns = *task.ns;
+    auto index = task.index.get();
+    if (task.deferred) {
+        CVisitor &visitor = index?index->visitor:task.visitor;
+        visitor.SetContext(Act.ast_context, &ns);
+        for (auto D : task.decls) {
+            if (index) {
+                index->add_decl(D);
+            } else {
+                visitor.TraverseDecl(D);
+            }
+            SCOPES_CHECK_RESULT(visitor.ok);
+        }
+    }
+    SCOPES_CHECK_RESULT(Act.result);
+
+    CompilerInstance &compiler = *task.compiler;
+    clang::Preprocessor & PP = compiler.getPreprocessor();
+    PP.getDiagnostics().setClient(new IgnoringDiagConsumer(), true);
+
+    CMacroEvaluator macros(PP, ns, index);
+    // macros of a precompiled header are external
+    for(Preprocessor::macro_iterator it = PP.macro_begin(task.use_pch),
+        end = PP.macro_end(task.use_pch); it != end; ++it) {
+        const IdentifierInfo * II = it->first;
+        MacroDirective * MD = it->second.getLatest();
+
+        macros.add(II, MD);
+    }
+    macros.evaluate_all();
+
+    LLVMModuleRef M = (LLVMModuleRef)Act.takeModule().release();
+    assert(M);
+    if (!task.object_file.empty()) {
+        auto target_machine = get_object_target_machine();
+        assert(target_machine);
+
+        char *errormsg;
+        static char filename[PATH_MAX];
+        strncpy(filename, task.object_file.c_str(), PATH_MAX - 1);
+        if (LLVMTargetMachineEmitToFile(target_machine, M,
+            filename, LLVMObjectFile, &errormsg)) {
+            SCOPES_ERROR(CGenBackendFailed, errormsg);
+        }
+    }
+    // a cached object is loaded without the imports that preceded it
+    bool defines = share_c_module_definitions(M, task.cache);
+    if (task.cache) {
+        // the contents of a remapped main file are part of the key
+        collect_c_import_dependencies(PP.getSourceManager(),
+            task.remapped_path, task.deps);
+        SCOPES_CHECK_RESULT(set_cached_c_import(task.keydata, ns, task.deps,
+            defines?M:nullptr));
+    } else if (defines) {
+        SCOPES_CHECK_RESULT(add_module(M, PointerMap(), CF_Cache));
+    }
+    // the definitions are in the JIT or the cache, and declarations are
+    // looked up in the namespace
+    LLVMDisposeModule(M);
+
+    if (index) {
+        index->compiler = task.compiler.release();
+        return build_lazy_c_import_scope(task.index.release());
+    }
+    return build_c_import_scope(ns);
+}
+
+SCOPES_RESULT(const Scope *) import_c_module (
+    const std::string &path, const std::vector<std::string> &args,
+    const char *buffer,
+    const Scope *scope) {
+    SCOPES_RESULT_TYPE(const Scope *);
+    Timer sum_clang_time(TIMER_ImportC);
+
+    CImportTask task;
+    task.path = path;
+    task.args = args;
+    task.buffer = buffer;
+    task.scope = scope;
+    SCOPES_CHECK_RESULT(prepare_c_import(task));
+    if (!task.result) {
+        task.compiled = compile_c_import(task, false);
+    }
+    return finish_c_import(task);
+}
+
+SCOPES_RESULT(void) import_c_modules(const std::vector<CImportRequest> &requests,
+    std::vector<const Scope *> &scopes) {
+    SCOPES_RESULT_TYPE(void);
+    Timer sum_clang_time(TIMER_ImportC);
+
+    // never resized, as the arguments point into the tasks
+    std::vector<CImportTask> tasks(requests.size());
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        auto &task = tasks[i];
+        task.path = requests[i].path;
+        task.args = requests[i].args;
+        task.buffer = requests[i].buffer;
+        SCOPES_CHECK_RESULT(prepare_c_import(task));
+        if (!task.result)
+            pending.push_back(i);
+    }
+
+    if (pending.size() == 1) {
+        auto &task = tasks[pending[0]];
+        task.compiled = compile_c_import(task, false);
+    } else {
+        // workers pull the next pending import until none are left
+        std::atomic<size_t> next(0);
+        auto compile_pending = [&]() {
+            size_t i;
+            while ((i = next.fetch_add(1)) < pending.size()) {
+                auto &task = tasks[pending[i]];
+                task.compiled = compile_c_import(task, true);
+            }
+        };
+        size_t numworkers = std::min((size_t)std::thread::hardware_concurrency(),
+            pending.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < numworkers; ++i) {
+            workers.push_back(std::thread(compile_pending));
+        }
+        compile_pending();
+        // the sessions of workers are gone once they are joined, so the
+        // file managers they shared are only released from this thread
+        for (auto &&worker : workers) {
+            worker.join();
+        }
+    }
+
+    scopes.clear();
+    for (auto &&task : tasks) {
+        scopes.push_back(SCOPES_GET_RESULT(finish_c_import(task)));
+    }
+    return {};
 }
 
 } // namespace scopes
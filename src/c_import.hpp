@@ -25,6 +25,18 @@ SCOPES_RESULT(const Scope *) import_c_module (
     const char *buffer = nullptr,
     const Scope *scope = nullptr);
 
+struct CImportRequest {
+    std::string path;
+    std::vector<std::string> args;
+    const char *buffer;
+};
+
+// imports all requests, which must be independent of each other; clang runs
+// on as many threads as there are cores, and the results are translated in
+// order on the calling thread
+SCOPES_RESULT(void) import_c_modules(const std::vector<CImportRequest> &requests,
+    std::vector<const Scope *> &scopes);
+
 } // namespace scopes
 
 #endif // SCOPES_C_IMPORT_HPP
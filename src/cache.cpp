@@ -7,6 +7,8 @@
 #include "cache.hpp"
 #include "hash.hpp"
 #include "string.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
 #include "scopes/config.h"
 
 #include <inttypes.h>
@@ -19,125 +21,638 @@
 #include <wordexp.h>
 #endif
 
-#ifndef _MSC_VER
-#include <dirent.h>
-//#include <libgen.h>
-#else
+#ifdef _MSC_VER
 #include <direct.h>
 #endif
 
-#include <algorithm>
 #include <memory.h>
 #include <stdio.h>
 #include <string.h>
 
-#include <zlib.h>
+#ifdef SCOPES_WIN32
+#include "mman.h"
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+#include <fcntl.h>
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+#include <algorithm>
+#include <math.h>
+#include <time.h>
+
+#ifdef SCOPES_WIN32
+#ifdef _MSC_VER
+#define SCOPES_MKDIR(PATH, MODE) _mkdir((PATH))
+#else
+#define SCOPES_MKDIR(PATH, MODE) mkdir((PATH))
+#endif
+#else
+#define SCOPES_MKDIR(PATH, MODE) mkdir((PATH),(MODE))
+#endif
 
 #define SCOPES_CACHE_WRITE_KEY 0
-#define SCOPES_FILE_CACHE_EXT ".cache"
 #define SCOPES_FILE_CACHE_KEY_PATTERN "%s/%s.cache.key"
-#define SCOPES_FILE_CACHE_PATTERN "%s/%s.cache"
+#define SCOPES_FILE_CACHE_PACK_PATTERN "%s/objects.pack"
+#define SCOPES_FILE_CACHE_ACCESS_PATTERN "%s/objects.access"
+// seconds of age that every doubling of the use count of an entry makes up for
+#define SCOPES_CACHE_USE_WEIGHT (24 * 60 * 60)
+#define SCOPES_CACHE_PACK_MAGIC "SCOPESPK"
+#define SCOPES_CACHE_PACK_VERSION 2
+#define SCOPES_CACHE_RECORD_MAGIC "SCCR"
+// record contents are aligned so object files can be parsed in place
+#define SCOPES_CACHE_RECORD_ALIGN 16
 
 namespace scopes {
 
 static int cache_misses = 0;
 static bool cache_inited = false;
 static char cache_dir[PATH_MAX+1];
+// the cache is also read and written by threads that parse modules ahead
+static std::mutex cache_mutex;
 
 int get_cache_misses() {
     int val = cache_misses;
     cache_misses = 0;
     return val;
 }
-// delete half of all cache files to make space, and/or half of all inodes
-// to stay within filesystem limits.
-static void perform_thanos_finger_snap(size_t cache_size, size_t num_files) {
-    auto extsize = strlen(SCOPES_FILE_CACHE_EXT);
-    static char cachefile[PATH_MAX+1];
-    strcpy(cachefile, cache_dir);
-    auto cache_dir_len = strlen(cache_dir);
-    cachefile[cache_dir_len] = '/';
-    char *cachefile_fname = cachefile + cache_dir_len + 1;
-
-    struct CacheEntry {
-        std::string path;
-        ssize_t atime;
-        ssize_t size;
-
-        bool operator <(const CacheEntry &other) const {
-            return atime < other.atime;
+
+//------------------------------------------------------------------------------
+// STATISTICS
+//------------------------------------------------------------------------------
+
+// written under the cache mutex, except for the object loads
+static struct {
+#define T(NAME) std::atomic<uint64_t> NAME;
+    SCOPES_CACHE_STATS()
+#undef T
+} cache_stats;
+
+static inline void count_stat(std::atomic<uint64_t> &stat, uint64_t value) {
+    stat.fetch_add(value, std::memory_order_relaxed);
+}
+
+static uint64_t stats_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void get_cache_stats(CacheStats &stats) {
+#define T(NAME) stats.NAME = cache_stats.NAME.load(std::memory_order_relaxed);
+    SCOPES_CACHE_STATS()
+#undef T
+}
+
+void reset_cache_stats() {
+#define T(NAME) cache_stats.NAME.store(0, std::memory_order_relaxed);
+    SCOPES_CACHE_STATS()
+#undef T
+}
+
+void count_cache_object_load(uint64_t ns) {
+    count_stat(cache_stats.objects_loaded, 1);
+    count_stat(cache_stats.load_time, ns);
+}
+
+void print_cache_stats() {
+    CacheStats stats;
+    get_cache_stats(stats);
+    StyledStream ss;
+    ss << "cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+        << stats.bytes_read << " bytes read in " << (stats.read_time * 1e-6)
+        << "ms" << std::endl;
+    ss << "cache: " << stats.writes << " writes, " << stats.bytes_written
+        << " bytes written in " << (stats.write_time * 1e-6) << "ms" << std::endl;
+    ss << "cache: " << stats.evictions << " evictions, "
+        << stats.evicted_records << " records and "
+        << stats.evicted_bytes << " bytes evicted" << std::endl;
+    ss << "cache: " << stats.objects_loaded << " objects loaded in "
+        << (stats.load_time * 1e-6) << "ms" << std::endl;
+    ss << "cache: " << stats.backend_hits << " backend hits, "
+        << stats.backend_writes << " backend writes, "
+        << stats.corrupt << " corrupt entries" << std::endl;
+    ss << "cache: " << stats.image_hits << " image hits" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// PACK FILE
+//------------------------------------------------------------------------------
+
+/* all cache entries are stored in a single append-only pack file:
+
+   pack header: magic (8 bytes), version (u32), reserved (u32)
+   record: magic (4 bytes), write time (u32), content size (u64),
+        key (64 hex characters), content checksum (u64), reserved (u64),
+        content, padding to record alignment
+
+   the pack is mapped read-only, and lookups hand out pointers into the
+   mapping, which stays valid for the lifetime of the process. records are
+   appended under an advisory lock on the pack, and the pack is only ever
+   replaced as a whole by renaming a complete copy over it. the checksum of a
+   record is verified the first time a process reads it; a record that fails
+   is dropped from the index, and the entry is rebuilt.
+
+   uses of entries are appended to a separate access log, at most once per
+   entry and process; eviction ranks entries by their last use and their
+   number of uses. times are in seconds since the epoch, 0 if unknown. */
+
+struct CachePackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct CacheRecordHeader {
+    char magic[4];
+    uint32_t time;
+    uint64_t size;
+    char key[64];
+    uint64_t checksum;
+    uint64_t reserved;
+};
+
+struct CacheAccessRecord {
+    char key[64];
+    uint32_t time;
+    uint32_t count;
+};
+
+static_assert((sizeof(CachePackHeader) % SCOPES_CACHE_RECORD_ALIGN) == 0,
+    "pack header must preserve record alignment");
+static_assert((sizeof(CacheRecordHeader) % SCOPES_CACHE_RECORD_ALIGN) == 0,
+    "record header must preserve record alignment");
+
+struct CacheEntry {
+    // offset of the record content in the pack
+    size_t offset;
+    size_t size;
+    // set once the content has been verified and its use logged by this
+    // process
+    bool checked;
+};
+
+struct CacheUse {
+    uint32_t time;
+    uint32_t count;
+};
+
+static char cache_pack_path[PATH_MAX+1];
+static int cache_pack_fd = -1;
+// end of the last valid record
+static size_t cache_pack_size = 0;
+static const char *cache_pack_map = nullptr;
+static size_t cache_pack_map_size = 0;
+static absl::flat_hash_map<const String *, CacheEntry> cache_index;
+static char cache_access_path[PATH_MAX+1];
+static int cache_access_fd = -1;
+// the access log as read when the cache was opened
+static absl::flat_hash_map<const String *, CacheUse> cache_uses;
+// number of records in the access log
+static size_t cache_access_records = 0;
+static size_t cache_high_watermark = SCOPES_MAX_CACHE_SIZE;
+static size_t cache_low_watermark = SCOPES_MIN_CACHE_SIZE;
+
+static size_t cache_record_size(size_t size) {
+    size_t total = sizeof(CacheRecordHeader) + size;
+    return (total + SCOPES_CACHE_RECORD_ALIGN - 1)
+        & ~(size_t)(SCOPES_CACHE_RECORD_ALIGN - 1);
+}
+
+static bool write_all(int fd, const char *data, size_t size) {
+    while (size) {
+        auto w = write(fd, data, size);
+        if (w <= 0) return false;
+        data += w;
+        size -= w;
+    }
+    return true;
+}
+
+static bool write_pack_header(int fd) {
+    CachePackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCOPES_CACHE_PACK_MAGIC, sizeof(header.magic));
+    header.version = SCOPES_CACHE_PACK_VERSION;
+    return write_all(fd, (const char *)&header, sizeof(header));
+}
+
+// map the pack file up to at least the given size; previous mappings are
+// kept alive because buffers handed out earlier may still point into them
+static bool map_cache_pack(size_t size) {
+    if (cache_pack_map && (size <= cache_pack_map_size))
+        return true;
+    auto ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, cache_pack_fd, 0);
+    if (ptr == MAP_FAILED)
+        return false;
+    cache_pack_map = (const char *)ptr;
+    cache_pack_map_size = size;
+    return true;
+}
+
+// serializes changes to the pack with other processes that share the cache
+struct CachePackLock {
+    CachePackLock(int _fd) : fd(_fd) {
+#ifndef SCOPES_WIN32
+        while (flock(fd, LOCK_EX) && (errno == EINTR)) {}
+#endif
+    }
+
+    ~CachePackLock() {
+        unlock();
+    }
+
+    void unlock() {
+#ifndef SCOPES_WIN32
+        if (fd >= 0)
+            flock(fd, LOCK_UN);
+#endif
+        fd = -1;
+    }
+
+protected:
+    int fd;
+};
+
+// walk all records of a mapped pack and return the end of the last valid one
+template<typename F>
+static size_t scan_cache_pack(const char *map, size_t size, const F &f) {
+    size_t offset = sizeof(CachePackHeader);
+    while ((offset + sizeof(CacheRecordHeader)) <= size) {
+        auto header = (const CacheRecordHeader *)(map + offset);
+        if (memcmp(header->magic, SCOPES_CACHE_RECORD_MAGIC, 4))
+            break;
+        auto recsize = cache_record_size(header->size);
+        if ((header->size > size) || ((offset + recsize) > size))
+            break;
+        f(offset, *header);
+        offset += recsize;
+    }
+    return offset;
+}
+
+static bool is_valid_pack_header(const char *map, size_t size) {
+    if (size < sizeof(CachePackHeader))
+        return false;
+    auto header = (const CachePackHeader *)map;
+    return !memcmp(header->magic, SCOPES_CACHE_PACK_MAGIC, sizeof(header->magic))
+        && (header->version == SCOPES_CACHE_PACK_VERSION);
+}
+
+static uint32_t cache_now() {
+    return (uint32_t)time(nullptr);
+}
+
+static void read_cache_access_log() {
+    int fd = open(cache_access_path, O_RDONLY);
+    if (fd < 0)
+        return;
+    CacheAccessRecord records[256];
+    ssize_t r;
+    while ((r = read(fd, records, sizeof(records))) > 0) {
+        size_t count = (size_t)r / sizeof(CacheAccessRecord);
+        cache_access_records += count;
+        for (size_t i = 0; i < count; ++i) {
+            auto key = String::from(records[i].key, sizeof(records[i].key));
+            auto &use = cache_uses[key];
+            use.time = std::max(use.time, records[i].time);
+            use.count += records[i].count;
         }
+        // a torn record at the end of the log is skipped
+        if ((size_t)r % sizeof(CacheAccessRecord))
+            break;
+    }
+    close(fd);
+}
+
+// replaces the access log with one record per used key for which keep(key)
+// is true
+template<typename F>
+static void compact_cache_access_log(const F &keep) {
+    char tmppath[PATH_MAX+1];
+    snprintf(tmppath, PATH_MAX, "%s.tmp", cache_access_path);
+    int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return;
+    std::vector<CacheAccessRecord> records;
+    for (auto &&it : cache_uses) {
+        if (!keep(it.first))
+            continue;
+        CacheAccessRecord record;
+        memcpy(record.key, it.first->data, sizeof(record.key));
+        record.time = it.second.time;
+        record.count = it.second.count;
+        records.push_back(record);
+    }
+    bool ok = write_all(fd, (const char *)records.data(),
+        records.size() * sizeof(CacheAccessRecord));
+    close(fd);
+    if (!ok || rename(tmppath, cache_access_path)) {
+        remove(tmppath);
+        return;
+    }
+    cache_access_records = records.size();
+}
+
+static void log_cache_access(const String *key) {
+    if (cache_access_fd < 0)
+        return;
+    CacheAccessRecord record;
+    memcpy(record.key, key->data, sizeof(record.key));
+    record.time = cache_now();
+    record.count = 1;
+    // appends this small are not interleaved with those of other processes
+    if (!write_all(cache_access_fd, (const char *)&record, sizeof(record))) {
+        close(cache_access_fd);
+        cache_access_fd = -1;
+    }
+}
+
+// entries that have been used more often are kept as if they had been used
+// more recently
+static double cache_record_score(const CacheRecordHeader &header,
+    const String *key) {
+    double last = header.time;
+    double count = 0.0;
+    auto it = cache_uses.find(key);
+    if (it != cache_uses.end()) {
+        last = std::max(last, (double)it->second.time);
+        count = it->second.count;
+    }
+    return last + SCOPES_CACHE_USE_WEIGHT * log2(1.0 + count);
+}
+
+// drop the lowest ranked records until the pack is no larger than the low
+// watermark. older copies of a key have been replaced by the latest one and
+// go first; the survivors keep their order in the pack.
+static void evict_cold_records(const char *map, size_t size) {
+    struct Candidate {
+        size_t offset;
+        // 0 if superseded
+        size_t size;
+        const String *key;
+        double score;
     };
-    std::vector<CacheEntry> cache_entries;
-    cache_entries.reserve(1024);
-
-    struct dirent *dir;
-    DIR *d = opendir(cache_dir);
-    if (d) {
-        while ((dir = readdir(d)) != NULL) {
-            auto len = strlen(dir->d_name);
-            auto offset = dir->d_name + len - extsize;
-            if ((len >= extsize)
-                && !strcmp(offset, SCOPES_FILE_CACHE_EXT)) {
-                strcpy(cachefile_fname, dir->d_name);
-                struct stat s;
-                if( stat(cachefile,&s) == 0 ) {
-                    cache_entries.push_back(
-                        {cachefile, s.st_atime, s.st_size});
-                }
+    std::vector<Candidate> records;
+    absl::flat_hash_map<const String *, size_t> latest;
+    scan_cache_pack(map, size,
+        [&](size_t offset, const CacheRecordHeader &header) {
+        auto key = String::from(header.key, sizeof(header.key));
+        auto result = latest.insert({ key, records.size() });
+        if (!result.second) {
+            records[result.first->second].size = 0;
+            result.first->second = records.size();
+        }
+        records.push_back({ offset, cache_record_size(header.size), key,
+            cache_record_score(header, key) });
+    });
+    std::vector<size_t> order;
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (records[i].size)
+            order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (records[a].score != records[b].score)
+            return records[a].score > records[b].score;
+        return a > b;
+    });
+    std::vector<bool> keep(records.size(), false);
+    size_t total = sizeof(CachePackHeader);
+    for (auto i : order) {
+        if ((total + records[i].size) > cache_low_watermark)
+            continue;
+        keep[i] = true;
+        total += records[i].size;
+    }
+
+    char tmppath[PATH_MAX+1];
+    snprintf(tmppath, PATH_MAX, "%s.tmp", cache_pack_path);
+    int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return;
+    bool ok = write_pack_header(fd);
+    uint64_t evicted = 0;
+    uint64_t evicted_bytes = 0;
+    for (size_t i = 0; ok && (i < records.size()); ++i) {
+        auto &record = records[i];
+        if (keep[i]) {
+            ok = write_all(fd, map + record.offset, record.size);
+        } else {
+            evicted++;
+            evicted_bytes += cache_record_size(
+                ((const CacheRecordHeader *)(map + record.offset))->size);
+        }
+    }
+    close(fd);
+    if (!ok || rename(tmppath, cache_pack_path)) {
+        remove(tmppath);
+        return;
+    }
+    count_stat(cache_stats.evictions, 1);
+    count_stat(cache_stats.evicted_records, evicted);
+    count_stat(cache_stats.evicted_bytes, evicted_bytes);
+
+    absl::flat_hash_set<const String *> kept;
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (keep[i])
+            kept.insert(records[i].key);
+    }
+    for (auto it = cache_uses.begin(); it != cache_uses.end();) {
+        if (kept.count(it->first)) {
+            ++it;
+        } else {
+            cache_uses.erase(it++);
+        }
+    }
+    compact_cache_access_log([](const String *key) { return true; });
+}
+
+static void open_cache_pack() {
+    snprintf(cache_pack_path, PATH_MAX, SCOPES_FILE_CACHE_PACK_PATTERN, cache_dir);
+    snprintf(cache_access_path, PATH_MAX, SCOPES_FILE_CACHE_ACCESS_PATTERN, cache_dir);
+    read_cache_access_log();
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        cache_pack_fd = open(cache_pack_path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        if (cache_pack_fd < 0) {
+            auto e = errno;
+            StyledStream ss;
+            ss << "unable to open " << cache_pack_path << " ("
+                << strerror(e) << ")" << std::endl;
+            return;
+        }
+        CachePackLock pack_lock(cache_pack_fd);
+        size_t size = lseek(cache_pack_fd, 0, SEEK_END);
+        if (!size || !map_cache_pack(size)
+            || !is_valid_pack_header(cache_pack_map, size)) {
+            // empty, unreadable or from an incompatible version: start over
+            if (cache_pack_map) {
+                munmap((void *)cache_pack_map, cache_pack_map_size);
+                cache_pack_map = nullptr;
+                cache_pack_map_size = 0;
+            }
+            if (ftruncate(cache_pack_fd, 0)
+                || (lseek(cache_pack_fd, 0, SEEK_SET) != 0)
+                || !write_pack_header(cache_pack_fd)) {
+                pack_lock.unlock();
+                close(cache_pack_fd);
+                cache_pack_fd = -1;
+                return;
+            }
+            cache_pack_size = sizeof(CachePackHeader);
+            return;
+        }
+        if ((size >= cache_high_watermark) && !attempt) {
+            evict_cold_records(cache_pack_map, size);
+            munmap((void *)cache_pack_map, cache_pack_map_size);
+            cache_pack_map = nullptr;
+            cache_pack_map_size = 0;
+            pack_lock.unlock();
+            close(cache_pack_fd);
+            continue;
+        }
+        cache_pack_size = scan_cache_pack(cache_pack_map, size,
+            [](size_t offset, const CacheRecordHeader &header) {
+            auto key = String::from(header.key, sizeof(header.key));
+            cache_index[key] = { offset + sizeof(CacheRecordHeader),
+                (size_t)header.size, false };
+        });
+        if (cache_pack_size < size) {
+            // drop the remains of an interrupted write
+            if (ftruncate(cache_pack_fd, cache_pack_size)) {
+                pack_lock.unlock();
+                close(cache_pack_fd);
+                cache_pack_fd = -1;
             }
         }
-        closedir(d);
+        // the log grows by one record per use and process
+        if (cache_access_records > (2 * cache_index.size() + 1024)) {
+            compact_cache_access_log([](const String *key) {
+                return cache_index.count(key) != 0; });
+        }
+        return;
     }
+}
 
-    size_t target_size = SCOPES_MAX_CACHE_SIZE / 2;
-    size_t target_num = SCOPES_MAX_CACHE_INODES / 2;
-    // oldest entries first
-    std::sort(cache_entries.begin(), cache_entries.end());
-    for (auto &&entry : cache_entries) {
-        if ((cache_size <= target_size) && (num_files <= target_num))
-            break;
-        remove(entry.path.c_str());
-        cache_size -= entry.size;
-        num_files--;
-    }
-
-}
-
-// count cumulative size of cache files and clean up if too big
-static void check_cache_size() {
-    auto extsize = strlen(SCOPES_FILE_CACHE_EXT);
-    static char cachefile[PATH_MAX+1];
-    strcpy(cachefile, cache_dir);
-    auto cache_dir_len = strlen(cache_dir);
-    cachefile[cache_dir_len] = '/';
-    char *cachefile_fname = cachefile + cache_dir_len + 1;
-
-    size_t cache_size = 0;
-    size_t num_files = 0;
-    struct dirent *dir;
-    DIR *d = opendir(cache_dir);
-    if (d) {
-        while ((dir = readdir(d)) != NULL) {
-            auto len = strlen(dir->d_name);
-            auto offset = dir->d_name + len - extsize;
-            if ((len >= extsize)
-                && !strcmp(offset, SCOPES_FILE_CACHE_EXT)) {
-                strcpy(cachefile_fname, dir->d_name);
-                struct stat s;
-                if( stat(cachefile,&s) == 0 ) {
-                    cache_size += s.st_size;
-                    num_files++;
-                }
+//------------------------------------------------------------------------------
+// SHARED DIRECTORY BACKEND
+//------------------------------------------------------------------------------
+
+/* one file per entry in a directory that many machines may share, such as an
+   NFS mount: <root>/<first two key characters>/<key>. a file is written
+   under a name that is unique to the writing host and process, then renamed
+   into place, so readers see either no entry or a complete one. the file
+   starts with a magic word, the content size and a checksum of the content,
+   which guard against truncated or damaged copies. */
+
+struct CacheFileHeader {
+    char magic[4];
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t checksum;
+};
+
+#define SCOPES_CACHE_FILE_MAGIC "SCCF"
+
+struct DirectoryCacheBackend : CacheBackend {
+    DirectoryCacheBackend(const char *_root) : root(_root) {}
+
+    std::string entry_dir(const String *key) const {
+        return root + "/" + std::string(key->data, 2);
+    }
+
+    std::string entry_path(const String *key) const {
+        return entry_dir(key) + "/" + std::string(key->data, key->count);
+    }
+
+    bool read(const String *key, std::vector<char> &content) override {
+        auto path = entry_path(key);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        CacheFileHeader header;
+        bool ok = (::read(fd, &header, sizeof(header)) == sizeof(header))
+            && !memcmp(header.magic, SCOPES_CACHE_FILE_MAGIC, sizeof(header.magic));
+        if (ok) {
+            content.resize(header.size);
+            size_t offset = 0;
+            while (ok && (offset < content.size())) {
+                auto r = ::read(fd, content.data() + offset, content.size() - offset);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                ok = (r > 0);
+                if (ok)
+                    offset += r;
             }
         }
-        closedir(d);
+        close(fd);
+        return ok && (hash_bytes(content.data(), content.size()) == header.checksum);
     }
 
-    if ((cache_size >= SCOPES_MAX_CACHE_SIZE)
-        || (num_files >= SCOPES_MAX_CACHE_INODES)) {
-        perform_thanos_finger_snap(cache_size, num_files);
+    void write(const String *key, const char *content, size_t size) override {
+        auto path = entry_path(key);
+        struct stat st;
+        // entries are content addressed, so an existing one is up to date
+        if (!stat(path.c_str(), &st))
+            return;
+        auto dir = entry_dir(key);
+        SCOPES_MKDIR(root.c_str(), S_IRWXU | S_IRWXG);
+        SCOPES_MKDIR(dir.c_str(), S_IRWXU | S_IRWXG);
+        char host[256] = "";
+        gethostname(host, sizeof(host) - 1);
+        char suffix[512];
+        snprintf(suffix, sizeof(suffix), ".%s.%d.tmp", host, (int)getpid());
+        auto tmppath = path + suffix;
+        int fd = open(tmppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+            S_IRUSR | S_IWUSR | S_IRGRP);
+        if (fd < 0)
+            return;
+        CacheFileHeader header;
+        memcpy(header.magic, SCOPES_CACHE_FILE_MAGIC, sizeof(header.magic));
+        header.reserved = 0;
+        header.size = size;
+        header.checksum = hash_bytes(content, size);
+        bool ok = write_all(fd, (const char *)&header, sizeof(header))
+            && write_all(fd, content, size);
+        ok = !close(fd) && ok;
+        if (!ok || rename(tmppath.c_str(), path.c_str())) {
+            remove(tmppath.c_str());
+        }
+    }
+
+protected:
+    std::string root;
+};
+
+static CacheBackend *cache_backend = nullptr;
+
+void set_cache_backend(CacheBackend *backend) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    delete cache_backend;
+    cache_backend = backend;
+}
+
+// accepts a size in bytes with an optional K, M or G suffix
+static void read_cache_watermarks() {
+    const char *env = getenv("SCOPES_CACHE_HIGH_WATERMARK");
+    size_t size = 0;
+    if (env && parse_size(env, size)) {
+        cache_high_watermark = size;
+        cache_low_watermark = size / 4 * 3;
     }
+    env = getenv("SCOPES_CACHE_LOW_WATERMARK");
+    if (env && parse_size(env, size)) {
+        cache_low_watermark = size;
+    }
+    if (cache_low_watermark > cache_high_watermark)
+        cache_low_watermark = cache_high_watermark;
 }
 
 static void init_cache() {
@@ -148,14 +663,7 @@ static void init_cache() {
     char *ptr = getenv("LocalAppData");
     assert(ptr);
     strcpy(cache_dir, ptr);
-#ifdef _MSC_VER
-    
-#define SCOPES_MKDIR(PATH, MODE) _mkdir((PATH))
 #else
-#define SCOPES_MKDIR(PATH, MODE) mkdir((PATH))
-#endif
-#else
-#define SCOPES_MKDIR(PATH, MODE) mkdir((PATH),(MODE))
     char *ptr = getenv("SCOPES_CACHE");
     if (ptr == nullptr) {
         wordexp_t p;
@@ -186,10 +694,20 @@ static void init_cache() {
         }
     }
 
-    check_cache_size();
+    read_cache_watermarks();
+    open_cache_pack();
+    cache_access_fd = open(cache_access_path,
+        O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+
+    const char *shared = getenv("SCOPES_SHARED_CACHE");
+    if (shared && *shared && !cache_backend) {
+        cache_backend = new DirectoryCacheBackend(
+            (std::string(shared) + "/" SCOPES_CACHE_DIRNAME).c_str());
+    }
 }
 
 const char *get_cache_dir() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
     init_cache();
     return cache_dir;
 }
@@ -239,36 +757,167 @@ const char *get_cache_key_file(const String *key) {
     return nullptr;
 }
 
-const char *get_cache_file(const String *key) {
-    init_cache();
+// verifies the content of a mapped entry on first use; a corrupt entry is
+// removed from the index and reported as missing, so it is rebuilt
+static bool check_cache_entry(const String *key, CacheEntry &entry) {
+    auto header = (const CacheRecordHeader *)(cache_pack_map + entry.offset
+        - sizeof(CacheRecordHeader));
+    if (hash_bytes(cache_pack_map + entry.offset, entry.size) != header->checksum) {
+        count_stat(cache_stats.corrupt, 1);
+        StyledStream ss;
+        ss << "discarding corrupt cache entry " << key->data << std::endl;
+        cache_index.erase(key);
+        return false;
+    }
+    entry.checked = true;
+    log_cache_access(key);
+    return true;
+}
 
-    static char filepath[PATH_MAX];
-    snprintf(filepath, PATH_MAX, SCOPES_FILE_CACHE_PATTERN, cache_dir, key->data);
+// appends a record to the pack and indexes it; the caller holds the cache mutex
+static bool append_cache_record(const String *key,
+    const char *content, size_t size) {
+    if (cache_pack_fd < 0)
+        return false;
+    assert(key->count == sizeof(CacheRecordHeader::key));
+    auto t = stats_now();
+
+    // assemble the record so it goes out with a single write
+    std::vector<char> record(cache_record_size(size), 0);
+    auto header = (CacheRecordHeader *)record.data();
+    memcpy(header->magic, SCOPES_CACHE_RECORD_MAGIC, sizeof(header->magic));
+    header->time = cache_now();
+    header->size = size;
+    memcpy(header->key, key->data, sizeof(header->key));
+    header->checksum = hash_bytes(content, size);
+    memcpy(record.data() + sizeof(CacheRecordHeader), content, size);
+
+    CachePackLock pack_lock(cache_pack_fd);
+    // other processes may have appended records of their own since
+    auto end = lseek(cache_pack_fd, 0, SEEK_END);
+    if (end >= (off_t)cache_pack_size) {
+        cache_pack_size = end;
+    }
+    if ((lseek(cache_pack_fd, cache_pack_size, SEEK_SET) != (off_t)cache_pack_size)
+        || !write_all(cache_pack_fd, record.data(), record.size())) {
+        auto e = errno;
+        StyledStream ss;
+        ss << "unable to write cache to " << cache_pack_path << " ("
+            << strerror(e)
+            << ")" << std::endl;
+        if (ftruncate(cache_pack_fd, cache_pack_size)) {
+            pack_lock.unlock();
+            close(cache_pack_fd);
+            cache_pack_fd = -1;
+        }
+        return false;
+    }
+    // the record carries its write time, which counts as its last use
+    cache_index[key] = { cache_pack_size + sizeof(CacheRecordHeader), size, true };
+    cache_pack_size += record.size();
+    count_stat(cache_stats.writes, 1);
+    count_stat(cache_stats.bytes_written, record.size());
+    count_stat(cache_stats.write_time, stats_now() - t);
+    return true;
+}
 
-    struct stat s;
-    if( stat(filepath, &s) == 0 ) {
-        if( s.st_mode & S_IFDIR ) {
-        } else if ( s.st_mode & S_IFREG ) {
-            // exists
-            //StyledStream ss;
-            //std::cout << "reusing " << filepath << std::endl;
-            return filepath;
+//------------------------------------------------------------------------------
+// IMAGES
+//------------------------------------------------------------------------------
+
+struct CacheImageEntry {
+    const char *content;
+    size_t size;
+};
+
+static absl::flat_hash_map<const String *, CacheImageEntry> cache_image_index;
+
+static bool recording_cache_keys = false;
+static absl::flat_hash_set<const String *> recorded_cache_key_set;
+static std::vector<const String *> recorded_cache_keys;
+
+// the caller holds the cache mutex
+static void record_cache_key(const String *key) {
+    if (recording_cache_keys && recorded_cache_key_set.insert(key).second) {
+        recorded_cache_keys.push_back(key);
+    }
+}
+
+void record_cache_keys() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    recording_cache_keys = true;
+}
+
+std::vector<const String *> get_recorded_cache_keys() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return recorded_cache_keys;
+}
+
+void add_cache_image_entry(const String *key, const char *content, size_t size) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_image_index[key] = { content, size };
+}
+
+//------------------------------------------------------------------------------
+
+const char *get_cache(const String *key, size_t &size) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    record_cache_key(key);
+    {
+        auto it = cache_image_index.find(key);
+        if (it != cache_image_index.end()) {
+            size = it->second.size;
+            count_stat(cache_stats.hits, 1);
+            count_stat(cache_stats.image_hits, 1);
+            count_stat(cache_stats.bytes_read, size);
+            return it->second.content;
+        }
+    }
+    init_cache();
+
+    auto t = stats_now();
+    auto it = cache_index.find(key);
+    if (it == cache_index.end() && cache_backend) {
+        // read through: fetched entries are kept in the local pack
+        std::vector<char> content;
+        if (cache_backend->read(key, content)
+            && append_cache_record(key, content.data(), content.size())) {
+            count_stat(cache_stats.backend_hits, 1);
+            it = cache_index.find(key);
+        }
+    }
+    if (it != cache_index.end()) {
+        CacheEntry &entry = it->second;
+        if (map_cache_pack(entry.offset + entry.size)
+            && (entry.checked || check_cache_entry(key, entry))) {
+            size = entry.size;
+            count_stat(cache_stats.hits, 1);
+            count_stat(cache_stats.bytes_read, size);
+            count_stat(cache_stats.read_time, stats_now() - t);
+            if (trace_enabled())
+                trace_instant("cache", std::string("cache hit ") + key->data);
+            return cache_pack_map + entry.offset;
         }
     }
 
-    //StyledStream ss;
-    //std::cout << "generating " << filepath << std::endl;
     cache_misses++;
+    count_stat(cache_stats.misses, 1);
+    count_stat(cache_stats.read_time, stats_now() - t);
+    if (trace_enabled())
+        trace_instant("cache", std::string("cache miss ") + key->data);
     return nullptr;
 }
 
 void set_cache(const String *key,
     const char *key_content, size_t key_size,
     const char *content, size_t size) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    record_cache_key(key);
+    init_cache();
 
-    char filepath[PATH_MAX];
 #if SCOPES_CACHE_WRITE_KEY
     {
+        char filepath[PATH_MAX];
         snprintf(filepath, PATH_MAX, SCOPES_FILE_CACHE_KEY_PATTERN, cache_dir, key->data);
         FILE *f = fopen(filepath, "wb");
         fwrite(key_content, key_size, 1, f);
@@ -276,29 +925,12 @@ void set_cache(const String *key,
     }
 #endif
 
-    snprintf(filepath, PATH_MAX, SCOPES_FILE_CACHE_PATTERN, cache_dir, key->data);
-
-    auto f = gzopen(filepath, "wb9");
-    if (!f) {
-        auto e = errno;
-        StyledStream ss;
-        ss << "unable to open " << filepath << " for writing ("
-            << strerror(e)
-            << ")" << std::endl;
-        return;
-    }
-
-    bool failed = (gzfwrite(content, size, 1, f) != 1);
-    auto e = errno;
-
-    gzclose(f);
-
-    if (failed) {
-        StyledStream ss;
-        ss << "unable to write cache to " << filepath << " ("
-            << strerror(e)
-            << ")" << std::endl;
-        remove(filepath);
+    append_cache_record(key, content, size);
+    if (cache_backend) {
+        auto t = stats_now();
+        cache_backend->write(key, content, size);
+        count_stat(cache_stats.backend_writes, 1);
+        count_stat(cache_stats.write_time, stats_now() - t);
     }
 }
 
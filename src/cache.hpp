@@ -9,20 +9,73 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <vector>
 
 namespace scopes {
 
 struct String;
 
+/* evictions counts how often the pack was cut down, and objects_loaded how
+   many cached objects were added to the JIT, which took load_time. backend
+   hits are entries that were missing locally and fetched from the backend.
+   corrupt counts entries that failed their checksum and were discarded.
+   image hits are entries found in the image of an embedded core. */
+#define SCOPES_CACHE_STATS() \
+    T(hits) T(misses) T(bytes_read) T(writes) T(bytes_written) \
+    T(read_time) T(write_time) \
+    T(evictions) T(evicted_records) T(evicted_bytes) \
+    T(objects_loaded) T(load_time) \
+    T(backend_hits) T(backend_writes) T(corrupt) T(image_hits)
+
+// cumulative statistics since startup or the last reset; times are in
+// nanoseconds
+struct CacheStats {
+#define T(NAME) uint64_t NAME;
+    SCOPES_CACHE_STATS()
+#undef T
+};
+
+/* a shared store behind the local cache. entries missing locally are read
+   through from the backend and kept in the local pack, and every entry that
+   is written locally is also written to the backend. keys are 64 character
+   hex digests of the content they describe, so a stored entry never changes.
+   the methods are called under the cache lock and never concurrently. */
+struct CacheBackend {
+    virtual ~CacheBackend() {}
+    // returns false if the backend does not have an entry for key
+    virtual bool read(const String *key, std::vector<char> &content) = 0;
+    // failures are not reported; the entry is simply not shared
+    virtual void write(const String *key, const char *content, size_t size) = 0;
+};
+
+// takes ownership of backend; null removes the current backend. by default,
+// the directory in SCOPES_SHARED_CACHE is used if the variable is set.
+void set_cache_backend(CacheBackend *backend);
+
 const String *get_cache_key(uint64_t hash, const char *content, size_t size);
 int get_cache_misses();
+void get_cache_stats(CacheStats &stats);
+void reset_cache_stats();
+// to be called after a cached object was added to the JIT
+void count_cache_object_load(uint64_t ns);
+void print_cache_stats();
 const char *get_cache_dir();
-const char *get_cache_file(const String *key);
 const char *get_cache_key_file(const String *key);
+// returns the cached content for key, or null if it is not cached; the
+// content is mapped read-only and stays valid until the process exits
+const char *get_cache(const String *key, size_t &size);
 void set_cache(const String *key,
     const char *key_content, size_t key_size,
     const char *content, size_t size);
 
+// from now on, take note of the keys of all entries that are read or written
+void record_cache_keys();
+// the keys noted since record_cache_keys(), in the order of their first use
+std::vector<const String *> get_recorded_cache_keys();
+// add an entry of an image that is looked up before the pack, and neither
+// written nor evicted; the content stays valid until the process exits
+void add_cache_image_entry(const String *key, const char *content, size_t size);
+
 } // namespace scopes
 
 #endif // SCOPES_CACHE_HPP
@@ -21,6 +21,16 @@ namespace scopes {
     T(CF_O3, (CF_O1 | CF_O2), "compile-flag-O3") \
     T(CF_Cache, (1 << 7), "compile-flag-cache") \
     T(CF_Module, (1 << 8), "compile-flag-module") \
+    T(CF_Parallel, (1 << 9), "compile-flag-parallel") \
+    T(CF_Lazy, (1 << 10), "compile-flag-lazy") \
+    T(CF_Tiered, (1 << 11), "compile-flag-tiered") \
+    T(CF_Release, (1 << 12), "compile-flag-release") \
+    T(CF_ProfileGenerate, (1 << 13), "compile-flag-profile-generate") \
+    T(CF_ProfileUse, (1 << 14), "compile-flag-profile-use") \
+    T(CF_LineTablesOnly, (1 << 15), "compile-flag-line-tables-only") \
+    T(CF_Quick, (1 << 16), "compile-flag-quick") \
+    T(CF_CABI, (1 << 17), "compile-flag-c-abi") \
+    T(CF_Chunked, (1 << 18), "compile-flag-chunked") \
 
 enum {
 #define T(NAME, VALUE, SNAME) \
@@ -30,7 +40,25 @@ SCOPES_COMPILER_FLAGS()
 };
 
 // which flags are going to be effecting cache invalidation
-#define SCOPES_CACHE_COMPILER_FLAGS (CF_O3 | CF_NoDebugInfo)
+#define SCOPES_CACHE_COMPILER_FLAGS (CF_O3 | CF_NoDebugInfo | CF_LineTablesOnly)
+
+// floating point rules a function may relax for all its instructions
+#define SCOPES_FAST_MATH_FLAGS() \
+    T(FMF_Reassoc, (1 << 0), "fast-math-flag-reassoc") \
+    T(FMF_Contract, (1 << 1), "fast-math-flag-contract") \
+    T(FMF_Reciprocal, (1 << 2), "fast-math-flag-arcp") \
+    T(FMF_NoNaNs, (1 << 3), "fast-math-flag-nnan") \
+    T(FMF_NoInfs, (1 << 4), "fast-math-flag-ninf") \
+    T(FMF_NoSignedZeros, (1 << 5), "fast-math-flag-nsz") \
+    T(FMF_ApproxFunc, (1 << 6), "fast-math-flag-afn") \
+    T(FMF_Fast, ((1 << 7) - 1), "fast-math-flag-fast") \
+
+enum {
+#define T(NAME, VALUE, SNAME) \
+    NAME = VALUE,
+SCOPES_FAST_MATH_FLAGS()
+#undef T
+};
 
 } // namespace scopes
 
@@ -0,0 +1,201 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "core_image.hpp"
+#include "syntax_image.hpp"
+#include "cache.hpp"
+#include "error.hpp"
+#include "string.hpp"
+#include "file_map.hpp"
+
+#include "scopes/scopes.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// bump whenever the layout changes
+#define SCOPES_CORE_IMAGE_VERSION 1
+#define SCOPES_CORE_IMAGE_MAGIC "SCOPESCI"
+// entry contents are aligned so object files can be parsed in place
+#define SCOPES_CORE_IMAGE_ALIGN 16
+#define SCOPES_CORE_IMAGE_KEY_SIZE 64
+
+namespace scopes {
+
+/* layout, all sizes in bytes:
+
+   header
+   build date, padded to header.build_size
+   syntax image, padded to header.syntax_size, which is 0 for snapshots
+   per entry: entry header, content padded to the alignment
+
+   every part starts on the alignment.
+*/
+struct CoreImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint64_t build_size;
+    uint64_t syntax_size;
+};
+
+struct CoreImageEntry {
+    char key[SCOPES_CORE_IMAGE_KEY_SIZE];
+    uint64_t size;
+};
+
+static size_t align_image(size_t offset) {
+    return (offset + SCOPES_CORE_IMAGE_ALIGN - 1)
+        & ~(size_t)(SCOPES_CORE_IMAGE_ALIGN - 1);
+}
+
+static void append_image(std::vector<char> &dest, const void *data, size_t size) {
+    dest.insert(dest.end(), (const char *)data, (const char *)data + size);
+    dest.resize(align_image(dest.size()), 0);
+}
+
+static SCOPES_RESULT(void) write_image(const char *path,
+    const std::vector<char> &syntax) {
+    SCOPES_RESULT_TYPE(void);
+    auto keys = get_recorded_cache_keys();
+    const char *build = scopes_compile_time_date();
+
+    CoreImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCOPES_CORE_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = SCOPES_CORE_IMAGE_VERSION;
+    header.build_size = strlen(build);
+    header.syntax_size = syntax.size();
+
+    std::vector<char> image;
+    append_image(image, &header, sizeof(header));
+    append_image(image, build, header.build_size);
+    append_image(image, syntax.data(), syntax.size());
+    for (auto key : keys) {
+        size_t size = 0;
+        auto content = get_cache(key, size);
+        // entries that were evicted in the meantime are rebuilt when used
+        if (!content)
+            continue;
+        CoreImageEntry entry;
+        assert(key->count == sizeof(entry.key));
+        memcpy(entry.key, key->data, sizeof(entry.key));
+        entry.size = size;
+        append_image(image, &entry, sizeof(entry));
+        append_image(image, content, size);
+        header.entry_count++;
+    }
+    memcpy(image.data(), &header, sizeof(header));
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        SCOPES_ERROR(ImageUnwritable, path);
+    }
+    bool ok = (fwrite(image.data(), 1, image.size(), f) == image.size());
+    ok = !fclose(f) && ok;
+    if (!ok) {
+        SCOPES_ERROR(ImageUnwritable, path);
+    }
+    return {};
+}
+
+// base must be on the alignment and stay valid until the process exits;
+// returns the core, which is empty for snapshots
+static SCOPES_RESULT(ValueRef) read_image(const char *name,
+    const char *base, size_t size) {
+    SCOPES_RESULT_TYPE(ValueRef);
+    assert(((size_t)base % SCOPES_CORE_IMAGE_ALIGN) == 0);
+    const char *end = base + size;
+
+    CoreImageHeader header;
+    if (size < align_image(sizeof(header))) {
+        SCOPES_ERROR(InvalidImage, name);
+    }
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, SCOPES_CORE_IMAGE_MAGIC, sizeof(header.magic))
+        || (header.version != SCOPES_CORE_IMAGE_VERSION)) {
+        SCOPES_ERROR(InvalidImage, name);
+    }
+    const char *ptr = base + align_image(sizeof(header));
+    const char *build = scopes_compile_time_date();
+    if ((align_image(header.build_size) > (size_t)(end - ptr))
+        || (header.build_size != strlen(build))
+        || memcmp(ptr, build, header.build_size)) {
+        SCOPES_ERROR(ImageBuildMismatch, name);
+    }
+    ptr += align_image(header.build_size);
+    if (align_image(header.syntax_size) > (size_t)(end - ptr)) {
+        SCOPES_ERROR(InvalidImage, name);
+    }
+    ValueRef core;
+    if (header.syntax_size) {
+        core = read_syntax_image(ptr, header.syntax_size);
+        if (!core) {
+            SCOPES_ERROR(InvalidImage, name);
+        }
+    }
+    ptr += align_image(header.syntax_size);
+    for (uint32_t i = 0; i < header.entry_count; ++i) {
+        CoreImageEntry entry;
+        if (align_image(sizeof(entry)) > (size_t)(end - ptr)) {
+            SCOPES_ERROR(InvalidImage, name);
+        }
+        memcpy(&entry, ptr, sizeof(entry));
+        ptr += align_image(sizeof(entry));
+        if (align_image(entry.size) > (size_t)(end - ptr)) {
+            SCOPES_ERROR(InvalidImage, name);
+        }
+        add_cache_image_entry(String::from(entry.key, sizeof(entry.key)),
+            ptr, entry.size);
+        ptr += align_image(entry.size);
+    }
+    return core;
+}
+
+SCOPES_RESULT(void) write_core_image(const char *path, const ValueRef &core) {
+    SCOPES_RESULT_TYPE(void);
+    std::vector<char> syntax;
+    if (!write_syntax_image(syntax, core)) {
+        SCOPES_ERROR(ImageUnwritable, path);
+    }
+    return write_image(path, syntax);
+}
+
+SCOPES_RESULT(ValueRef) load_core_image(const char *data, size_t size) {
+    SCOPES_RESULT_TYPE(ValueRef);
+    // the payload sits at an arbitrary offset of the executable; a copy puts
+    // the contents on their alignment, and stays resident for the cache
+    char *buffer = (char *)malloc(size + SCOPES_CORE_IMAGE_ALIGN);
+    char *base = (char *)align_image((size_t)buffer);
+    memcpy(base, data, size);
+    auto core = SCOPES_GET_RESULT(read_image("of the core", base, size));
+    if (!core) {
+        SCOPES_ERROR(InvalidImage, "of the core");
+    }
+    return core;
+}
+
+SCOPES_RESULT(void) save_snapshot(const char *path) {
+    return write_image(path, std::vector<char>());
+}
+
+SCOPES_RESULT(void) load_snapshot(const char *path) {
+    SCOPES_RESULT_TYPE(void);
+    // mapped pages are on the alignment; the map is never closed, since the
+    // cache hands out pointers into it
+    auto map = FileMap::open(path, false, -1);
+    if (!map) {
+        SCOPES_ERROR(ImageUnreadable, path);
+    }
+    map->advise(0, map->size, FILE_MAP_WILLNEED);
+    SCOPES_CHECK_RESULT(read_image(path, (const char *)map->ptr, map->size));
+    return {};
+}
+
+} // namespace scopes
@@ -0,0 +1,50 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_CORE_IMAGE_HPP
+#define SCOPES_CORE_IMAGE_HPP
+
+#include "result.hpp"
+#include "valueref.inc"
+
+#include <stddef.h>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// CORE IMAGE
+//------------------------------------------------------------------------------
+
+/* a core image holds the syntax image of a core module along with the cache
+   entries that the process has read and written, which are mostly the
+   objects of the stages of the core. appended to the executable in place of
+   a core source, the core is proven as usual, but never lexed, and its
+   stages are loaded into the JIT without going through LLVM.
+
+   a snapshot is an image without a core, taken at any point after boot. it
+   holds the syntax images and objects of everything loaded so far, so that
+   a later process that loads it boots and imports the same modules without
+   lexing or compiling any of them, and without a cache directory.
+
+   images are only valid for the build that wrote them. */
+
+// write the image of core and the cache entries used so far to the file at
+// path
+SCOPES_RESULT(void) write_core_image(const char *path, const ValueRef &core);
+
+// returns the core stored in the image, and makes its cache entries
+// available to the cache
+SCOPES_RESULT(ValueRef) load_core_image(const char *data, size_t size);
+
+// write the cache entries used so far to the file at path
+SCOPES_RESULT(void) save_snapshot(const char *path);
+
+// map the snapshot at path and make its cache entries available to the cache
+SCOPES_RESULT(void) load_snapshot(const char *path);
+
+} // namespace scopes
+
+#endif // SCOPES_CORE_IMAGE_HPP
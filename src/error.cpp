@@ -273,7 +273,8 @@ ErrorKind Error::kind() const { return _kind; }
 Error::Error(ErrorKind kind) : _kind(kind) {}
 
 Error *Error::trace(const Backtrace &bt) {
-    if (bt.kind == BTK_Dummy)
+    // the speculative token is shared and carries no trace
+    if ((bt.kind == BTK_Dummy) || (_kind == EK_SpeculativeFailure))
         return this;
     auto ptr = new Backtrace(bt);
     ptr->next = _trace;
@@ -287,6 +288,28 @@ const Backtrace *Error::get_trace() const {
 
 //------------------------------------------------------------------------------
 
+static thread_local int speculation_depth = 0;
+
+void begin_speculation() {
+    speculation_depth++;
+}
+
+void end_speculation() {
+    assert(speculation_depth > 0);
+    speculation_depth--;
+}
+
+bool is_speculating() {
+    return speculation_depth > 0;
+}
+
+Error *speculative_failure() {
+    static ErrorSpeculativeFailure *token = ErrorSpeculativeFailure::from();
+    return token;
+}
+
+//------------------------------------------------------------------------------
+
 void stream_error_message(StyledStream &ss, const Error *err) {
     switch(err->kind()) {
 #define T(CLASS, STR, ...) \
@@ -360,7 +383,7 @@ void stream_backtrace(StyledStream &ss, const Backtrace *bt) {
         if (value.isa<Const>()
             && value.cast<Const>()->get_type() == TYPE_Closure) {
             auto fanchor = extract_closure_constant(value).assert_ok()->func.anchor();
-            if (fanchor != anchor) {
+            if (!fanchor->is_same(anchor)) {
                 ss << anchor;
                 ss << " defined here" << std::endl;
                 anchor->stream_source_line(ss);
@@ -428,7 +451,7 @@ void stream_backtrace(StyledStream &ss, const Backtrace *bt) {
 
 static bool good_delta(const Backtrace *older, const Backtrace *newer) {
     bool same_kind = (newer->kind == older->kind);
-    bool same_anchor = (newer->context.anchor() == older->context.anchor());
+    bool same_anchor = newer->context.anchor()->is_same(older->context.anchor());
 #if 0
     return true;
 #else
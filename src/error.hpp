@@ -218,6 +218,11 @@ formatters:
         "break can only be used within the scope of a loop") \
     T(RepeatOutsideLoop, \
         "repeat can only be used within the scope of a loop") \
+    T(LoopHintOutsideLoop, \
+        "loop-hint can only be used within the scope of a loop") \
+    T(UnsupportedLoopHint, \
+        "unsupported loop hint: %0", \
+        Symbol) \
     T(LabelExpected, \
         "label expected, got value of type %0", \
         PType) \
@@ -244,6 +249,12 @@ formatters:
     T(UnsupportedExecutionMode, \
         "unsupported execution mode: %0", \
         Symbol) \
+    T(UnsupportedPrefetchMode, \
+        "unsupported prefetch mode: %0 (try 'read or 'write)", \
+        Symbol) \
+    T(InvalidMemoryOrder, \
+        "memory order %0 is invalid for %1", \
+        Symbol, Builtin) \
     T(CastCategoryError, \
         "cannot cast value of type %0 to %1 because types are not of same storage category", \
         PType, PType) \
@@ -395,6 +406,12 @@ formatters:
     T(CGenUnsupportedTarget, \
         "codegen: unsupported target: %0", /* todo: list supported targets */ \
         Symbol) \
+    T(CGenFunctionReleased, \
+        "codegen: function %0 was compiled with compile-flag-release and can not be translated again", \
+        Symbol) \
+    T(FunctionNotInterpretable, \
+        "function %0 can not be interpreted", \
+        Symbol) \
     T(CGenInvalidCallee, \
         "codegen: cannot translate call to value of type %0", \
         PType) \
@@ -404,6 +421,9 @@ formatters:
     T(CGenFailedToResolveExtern, \
         "codegen: failed to resolve %0", \
         GlobalRef) \
+    T(CGenInvalidSpecConstant, \
+        "codegen: specialization constant %0 needs a constant id and a scalar constant initializer", \
+        GlobalRef) \
     T(CGenBackendFailed, \
         "codegen backend failed: %0", \
         Rawstring) \
@@ -440,6 +460,12 @@ formatters:
     T(CGenEntryFunctionSignatureMismatch, \
         "codegen: entry function must have type %0 but has type %1", \
         PType, PType) \
+    T(CGenCABIFunctionRaises, \
+        "codegen: function of type %0 raises and can't be compiled with compile-flag-c-abi", \
+        PType) \
+    T(CGenCABIPassedInMemory, \
+        "codegen: value of type %0 is passed through memory and can't be part of a function compiled with compile-flag-c-abi", \
+        PType) \
     T(CGenUnsupportedVectorSize, \
         "codegen: vector of type %0 and size %1 is unsupported", \
         PType, int) \
@@ -484,6 +510,12 @@ formatters:
     T(RTUnableToOpenFile, \
         "runtime: can't open file: %0", \
         PString) \
+    T(RTInvalidBlobElementType, \
+        "runtime: blob elements must be of plain type with a size, not %0", \
+        PType) \
+    T(RTBlobSizeMismatch, \
+        "runtime: blob of %1 bytes does not hold a whole number of elements of type %0", \
+        PType, int) \
     T(RTUncountableStorageType, \
         "runtime: storage type %0 has no count", \
         PType) \
@@ -499,19 +531,37 @@ formatters:
     T(RTTypeBitcountMismatch, \
         "runtime: provided word count (%1) does not match word count of type %0 (%2)", \
         PType, int, int) \
+    T(RTRunCommandsKeyCount, \
+        "runtime: %0 keys given for %1 commands", \
+        int, int) \
 
 // main
 #define SCOPES_MAIN_ERROR_KIND() \
     T(MainInaccessibleBinary, \
         "main: can't open executable file for reading") \
     T(InvalidFooter, \
-        "main: invalid footer. Footer must have the format (core-size <size of script in bytes>)") \
+        "main: invalid footer. Footer must have the format (core-size <size of script in bytes>) or (core-image <size of image in bytes>)") \
+    T(InvalidImage, \
+        "image %0 is truncated or malformed", \
+        Rawstring) \
+    T(ImageBuildMismatch, \
+        "image %0 was written by a different build of the compiler", \
+        Rawstring) \
+    T(ImageUnreadable, \
+        "can't read image %0", \
+        Rawstring) \
+    T(ImageUnwritable, \
+        "can't write image to %0", \
+        Rawstring) \
     T(CoreModuleFunctionTypeMismatch, \
         "main: core function has wrong type %0, must be of type %1", \
         PType, PType) \
     T(CoreMissing, \
         "main: no core module at tail of executable or at path %0", \
         Symbol) \
+    T(ServerUnavailable, \
+        "main: can't serve requests at %0: %1", \
+        Rawstring, Rawstring) \
 
 #define SCOPES_ERROR_KIND() \
     T(User, "%0", PString) \
@@ -520,6 +570,8 @@ formatters:
         Rawstring) \
     T(StackOverflow, \
         "stack overflow encountered") \
+    T(SpeculativeFailure, \
+        "operation failed while speculating") \
     SCOPES_C_IMPORT_ERROR_KIND() \
     SCOPES_SYNTAX_ERROR_KIND() \
     SCOPES_TYPECHECK_ERROR_KIND() \
@@ -637,16 +689,28 @@ void print_error(const Error *value);
 void stream_error_message(StyledStream &ss, const Error *value);
 void stream_error(StyledStream &ss, const Error *value);
 
+// while a thread speculates, errors are raised as a single preallocated
+// token without arguments or backtrace, for callers that discard whatever
+// they catch; a caller that has to report the error repeats the operation
+// after speculation ends. speculation nests.
+void begin_speculation();
+void end_speculation();
+bool is_speculating();
+Error *speculative_failure();
+
+#define SCOPES_NEW_ERROR(CLASS, ...) \
+    (is_speculating()?speculative_failure():Error ## CLASS::from(__VA_ARGS__))
+
 #define SCOPES_RETURN_TRACE_ERROR(ERR) \
     SCOPES_RETURN_ERROR((ERR)->trace(_backtrace))
 
 #if SCOPES_EARLY_ABORT
 #define SCOPES_ERROR(CLASS, ...) \
     assert(false); \
-    SCOPES_RETURN_TRACE_ERROR(Error ## CLASS::from(__VA_ARGS__));
+    SCOPES_RETURN_TRACE_ERROR(SCOPES_NEW_ERROR(CLASS, ##__VA_ARGS__));
 #else
 #define SCOPES_ERROR(CLASS, ...) \
-    SCOPES_RETURN_TRACE_ERROR(Error ## CLASS::from(__VA_ARGS__));
+    SCOPES_RETURN_TRACE_ERROR(SCOPES_NEW_ERROR(CLASS, ##__VA_ARGS__));
 #endif
 
 // if ok fails, return
@@ -9,8 +9,14 @@
 #include "error.hpp"
 #include "symbol.hpp"
 #include "cache.hpp"
+#include "prover.hpp"
+#include "profiler.hpp"
 #include "compiler_flags.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
+#include "module_digest.hpp"
+#include "gen_llvm.hpp"
+#include "thread_pool.hpp"
 
 #ifdef SCOPES_WIN32
 #include "dlfcn.h"
@@ -18,37 +24,75 @@
 #include <math.h>
 #else
 #include <dlfcn.h>
+#include <unistd.h>
 #endif
 
 #include <llvm-c/Core.h>
 #include <llvm-c/TargetMachine.h>
 #include <llvm-c/Support.h>
 #include <llvm-c/BitWriter.h>
+#include <llvm-c/BitReader.h>
 #include <llvm-c/LLJIT.h>
 #include <llvm-c/OrcEE.h>
 #include <llvm-c/Disassembler.h>
 
-#include <llvm-c/Transforms/PassManagerBuilder.h>
-#include <llvm-c/Transforms/InstCombine.h>
-#include <llvm-c/Transforms/IPO.h>
 
 #include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
 #include "llvm/Object/SymbolSize.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
 
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/PGOOptions.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/ADT/Triple.h"
+
+#include "lld/Common/Driver.h"
 
 #include <limits.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <iostream>
 
-#include <zlib.h>
 #include "absl/container/flat_hash_map.h"
 
 #define SCOPES_CACHE_KEY_BITCODE 1
 #define SCOPES_LLVM_SUPPORT_DISASSEMBLY 1
+// parallel codegen only splits modules that have at least this many defined
+// functions per partition
+#define SCOPES_PARALLEL_MIN_FUNCTIONS 8
+// content of the cache entry that lists a partitioned object
+#define SCOPES_CACHE_PARTS_MAGIC "SCOPESMP"
+// appended to the names of lazily compiled definitions; the original name
+// becomes a stub that compiles the definition on first call
+#define SCOPES_LAZY_IMPL_SUFFIX "$impl"
+// in tiered mode, functions are recompiled with optimizations in the
+// background after this many calls
+#define SCOPES_TIER_UP_THRESHOLD 1000
+// appended to the names of unoptimized definitions in tiered mode
+#define SCOPES_TIER0_SUFFIX "$t0"
 
 #if SCOPES_MACOS
 #define SCOPES_JIT_SYMBOL_PREFIX '_'
@@ -118,6 +162,8 @@ public:
     DisassemblyListener() {}
 
     absl::flat_hash_map<std::string, size_t> sizes;
+    // objects can also be loaded by the tier-up thread
+    std::mutex mutex;
 
     void InitializeDebugData(
         llvm::StringRef name,
@@ -133,6 +179,7 @@ public:
         const llvm::RuntimeDyld::LoadedObjectInfo &L) {
         if (!enabled)
             return;
+        std::lock_guard<std::mutex> lock(mutex);
         #if 0
         StyledStream ss;
         ss << "object emitted!" << std::endl;
@@ -153,9 +200,190 @@ public:
 static DisassemblyListener *disassembly_listener = nullptr;
 #endif
 
+#ifndef SCOPES_WIN32
+// writes /tmp/perf-<pid>.map so perf can symbolize jitted code; this covers
+// every object that passes through the object layer, including objects
+// loaded from the cache.
+class PerfMapListener : public llvm::JITEventListener {
+public:
+    FILE *file = nullptr;
+    std::mutex mutex;
+
+    PerfMapListener() {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+        file = fopen(path, "w");
+    }
+
+    virtual void notifyObjectLoaded(
+        ObjectKey K,
+        const llvm::object::ObjectFile &Obj,
+        const llvm::RuntimeDyld::LoadedObjectInfo &L) {
+        if (!file)
+            return;
+        // the debug object has its sections relocated to the load addresses
+        auto debug_obj = L.getObjectForDebug(Obj);
+        const llvm::object::ObjectFile *obj = debug_obj.getBinary();
+        if (!obj)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &&S : llvm::object::computeSymbolSizes(*obj)) {
+            llvm::object::SymbolRef sym = S.first;
+            auto type = sym.getType();
+            if (!type || (type.get() != llvm::object::SymbolRef::ST_Function)) {
+                llvm::consumeError(type.takeError());
+                continue;
+            }
+            auto name = sym.getName();
+            auto addr = sym.getAddress();
+            if (!name || !addr || !S.second) {
+                llvm::consumeError(name.takeError());
+                llvm::consumeError(addr.takeError());
+                continue;
+            }
+            fprintf(file, "%llx %llx %.*s\n",
+                (unsigned long long)addr.get(),
+                (unsigned long long)S.second,
+                (int)name.get().size(), name.get().data());
+        }
+        fflush(file);
+    }
+};
+#endif
+
+// adds the machine code size of every function in an object to the template
+// the function was proven from, while instance statistics are enabled
+class InstanceSizeListener : public llvm::JITEventListener {
+public:
+    virtual void notifyObjectLoaded(
+        ObjectKey K,
+        const llvm::object::ObjectFile &Obj,
+        const llvm::RuntimeDyld::LoadedObjectInfo &L) {
+        if (!is_instance_stats_enabled())
+            return;
+        for (auto &&S : llvm::object::computeSymbolSizes(Obj)) {
+            llvm::object::SymbolRef sym = S.first;
+            auto type = sym.getType();
+            if (!type || (type.get() != llvm::object::SymbolRef::ST_Function)) {
+                llvm::consumeError(type.takeError());
+                continue;
+            }
+            auto name = sym.getName();
+            if (!name) {
+                llvm::consumeError(name.takeError());
+                continue;
+            }
+            add_instance_code_size(name.get().str(), S.second);
+        }
+    }
+};
+
+// names the functions of every loaded object for the sampling profiler,
+// together with their line tables if the object carries debug info
+class ProfilerCodeListener : public llvm::JITEventListener {
+public:
+    virtual void notifyObjectLoaded(
+        ObjectKey K,
+        const llvm::object::ObjectFile &Obj,
+        const llvm::RuntimeDyld::LoadedObjectInfo &L) {
+        // the debug object has its sections relocated to the load addresses
+        auto debug_obj = L.getObjectForDebug(Obj);
+        const llvm::object::ObjectFile *obj = debug_obj.getBinary();
+        if (!obj)
+            return;
+        bool has_lines = false;
+        for (auto &&section : obj->sections()) {
+            auto name = section.getName();
+            if (!name) {
+                llvm::consumeError(name.takeError());
+                continue;
+            }
+            if (name.get().endswith("debug_line")) {
+                has_lines = true;
+                break;
+            }
+        }
+        std::unique_ptr<llvm::DWARFContext> dwarf;
+        if (has_lines) {
+            dwarf = llvm::DWARFContext::create(*obj);
+        }
+        for (auto &&S : llvm::object::computeSymbolSizes(*obj)) {
+            llvm::object::SymbolRef sym = S.first;
+            auto type = sym.getType();
+            if (!type || (type.get() != llvm::object::SymbolRef::ST_Function)) {
+                llvm::consumeError(type.takeError());
+                continue;
+            }
+            auto name = sym.getName();
+            auto addr = sym.getAddress();
+            if (!name || !addr || !S.second) {
+                llvm::consumeError(name.takeError());
+                llvm::consumeError(addr.takeError());
+                continue;
+            }
+            std::vector<ProfilerLine> lines;
+            if (dwarf) {
+                auto table = dwarf->getLineInfoForAddressRange(
+                    { addr.get(), llvm::object::SectionedAddress::UndefSection },
+                    S.second, llvm::DILineInfoSpecifier(
+                        llvm::DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath));
+                for (auto &&row : table) {
+                    if (!row.second.Line)
+                        continue;
+                    lines.push_back({ row.first, row.second.FileName,
+                        (int)row.second.Line, (int)row.second.Column });
+                }
+                std::stable_sort(lines.begin(), lines.end(),
+                    [](const ProfilerLine &a, const ProfilerLine &b) {
+                        return a.address < b.address;
+                    });
+            }
+            register_profiler_code(addr.get(), S.second, name.get().str(),
+                std::move(lines));
+        }
+    }
+};
+
+// SCOPES_JIT_PROFILE is a comma separated list of profiler interfaces to
+// register with the object layer:
+//   perf: write /tmp/perf-<pid>.map
+//   jitdump: write a jitdump file for perf inject (needs an LLVM built
+//     with LLVM_USE_PERF)
+//   intel: notify VTune (needs an LLVM built with LLVM_USE_INTEL_JITEVENTS)
+static bool jit_profile_enabled(const char *name) {
+    const char *env = getenv("SCOPES_JIT_PROFILE");
+    if (!env)
+        return false;
+    size_t len = strlen(name);
+    while (*env) {
+        const char *end = strchr(env, ',');
+        size_t count = end?(size_t)(end - env):strlen(env);
+        if ((count == len) && !strncmp(env, name, len))
+            return true;
+        if (!end)
+            break;
+        env = end + 1;
+    }
+    return false;
+}
+
+#if SCOPES_LLVM_SUPPORT_DISASSEMBLY
+// only disassembly needs the disassembler of the native target
+static std::once_flag disassembler_once;
+
+static void init_disassembler() {
+    std::call_once(disassembler_once, []{
+        LLVMInitializeNativeDisassembler();
+    });
+}
+#endif
+
 void enable_disassembly(bool enable) {
 #if SCOPES_LLVM_SUPPORT_DISASSEMBLY
     assert(disassembly_listener);
+    if (enable) {
+        init_disassembler();
+    }
     disassembly_listener->enabled = enable;
 #endif
 }
@@ -163,7 +391,9 @@ void enable_disassembly(bool enable) {
 void print_disassembly(std::string symbol, void *pfunc) {
 #if SCOPES_LLVM_SUPPORT_DISASSEMBLY
     assert(disassembly_listener);
+    init_disassembler();
     //auto td = LLVMGetExecutionEngineTargetData(ee);
+    std::lock_guard<std::mutex> lock(disassembly_listener->mutex);
     auto it = disassembly_listener->sizes.find(symbol);
     if (it != disassembly_listener->sizes.end()) {
         std::cout << "disassembly:\n";
@@ -179,61 +409,408 @@ void print_disassembly(std::string symbol, void *pfunc) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void build_and_run_opt_passes(LLVMModuleRef module, int opt_level) {
-    LLVMPassManagerBuilderRef passBuilder;
+// a pass pipeline together with the analysis managers it runs against; these
+// are built once and reused for every module that is optimized the same way.
+struct OptPipeline {
+    llvm::PassBuilder builder;
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+    llvm::ModulePassManager mpm;
+
+    OptPipeline(llvm::TargetMachine *tm, llvm::PipelineTuningOptions pto,
+        llvm::Optional<llvm::PGOOptions> pgo) :
+        builder(tm, pto, pgo) {
+        builder.registerModuleAnalyses(mam);
+        builder.registerCGSCCAnalyses(cgam);
+        builder.registerFunctionAnalyses(fam);
+        builder.registerLoopAnalyses(lam);
+        builder.crossRegisterProxies(lam, fam, cgam, mam);
+    }
 
-    passBuilder = LLVMPassManagerBuilderCreate();
-    LLVMPassManagerBuilderSetOptLevel(passBuilder, opt_level);
-    LLVMPassManagerBuilderSetSizeLevel(passBuilder, 2);
-    if (opt_level == 0) {
-        LLVMPassManagerBuilderSetDisableUnrollLoops(passBuilder, true);
+    void run(llvm::Module &module) {
+        mpm.run(module, mam);
+        // cached analyses point into the module, which is about to go away
+        lam.clear();
+        fam.clear();
+        cgam.clear();
+        mam.clear();
     }
-    //LLVMAddInstructionCombiningPass(passBuilder);
-    #if 1
-    if (opt_level >= 2) {
-        LLVMPassManagerBuilderUseInlinerWithThreshold(passBuilder, 225);
+};
+
+static std::mutex opt_pipeline_mutex;
+static std::string custom_opt_pipeline;
+static std::string profile_path;
+
+ProfileMode profile_mode_from_flags(uint64_t flags) {
+    if (flags & CF_ProfileUse)
+        return PM_Use;
+    if (flags & CF_ProfileGenerate)
+        return PM_Generate;
+    return PM_None;
+}
+
+static std::string get_profile_path(ProfileMode mode) {
+    {
+        std::lock_guard<std::mutex> lock(opt_pipeline_mutex);
+        if (!profile_path.empty())
+            return profile_path;
     }
-    #endif
+    // an empty path lets the profile runtime pick default.profraw
+    if (mode == PM_Use)
+        return "default.profdata";
+    return "";
+}
 
-    LLVMPassManagerRef functionPasses =
-      LLVMCreateFunctionPassManagerForModule(module);
-    LLVMPassManagerRef modulePasses =
-      LLVMCreatePassManager();
-    //LLVMAddAnalysisPasses(LLVMGetExecutionEngineTargetMachine(ee), functionPasses);
+void set_profile_path(const char *path) {
+    std::lock_guard<std::mutex> lock(opt_pipeline_mutex);
+    profile_path = path;
+}
 
-    LLVMPassManagerBuilderPopulateFunctionPassManager(passBuilder,
-                                                      functionPasses);
-    LLVMPassManagerBuilderPopulateModulePassManager(passBuilder, modulePasses);
+SCOPES_RESULT(void) verify_profile_mode(ProfileMode mode) {
+    SCOPES_RESULT_TYPE(void);
+    if (mode == PM_Use) {
+        auto path = get_profile_path(mode);
+        if (!llvm::sys::fs::exists(path)) {
+            SCOPES_ERROR(RTUnableToOpenFile,
+                String::from(path.c_str(), path.size()));
+        }
+    }
+    return {};
+}
 
-    LLVMPassManagerBuilderDispose(passBuilder);
+std::string get_opt_pipeline(int opt_level, bool merge_functions) {
+    {
+        std::lock_guard<std::mutex> lock(opt_pipeline_mutex);
+        if (!custom_opt_pipeline.empty())
+            return custom_opt_pipeline;
+    }
     if (opt_level == 0) {
-        LLVMAddDeadArgEliminationPass(modulePasses);
-        LLVMAddInstructionCombiningPass(modulePasses);
+        return "default<O0>,deadargelim,function(sroa,instcombine)";
+    }
+    auto text = "default<O" + std::to_string(opt_level) + ">";
+#if SCOPES_MERGE_FUNCTIONS
+    // merged functions share their address, which jitted code and the
+    // compiler compare, so only object files are merged
+    if (merge_functions && (opt_level >= 2)) {
+        text += ",mergefunc";
     }
+#endif
+    return text;
+}
 
-    LLVMInitializeFunctionPassManager(functionPasses);
-    for (LLVMValueRef value = LLVMGetFirstFunction(module);
-         value; value = LLVMGetNextFunction(value))
-      LLVMRunFunctionPassManager(functionPasses, value);
-    LLVMFinalizeFunctionPassManager(functionPasses);
+static OptPipeline *create_opt_pipeline(const std::string &text,
+    int opt_level, LLVMTargetMachineRef tm, std::string &errormsg,
+    ProfileMode profile = PM_None, const std::string &path = "") {
+    llvm::PipelineTuningOptions pto;
+    if (opt_level == 0) {
+        pto.LoopUnrolling = false;
+    }
+    llvm::Optional<llvm::PGOOptions> pgo;
+    switch(profile) {
+    case PM_Generate: {
+        pgo = llvm::PGOOptions(path, "", "", llvm::PGOOptions::IRInstr);
+    } break;
+    case PM_Use: {
+        pgo = llvm::PGOOptions(path, "", "", llvm::PGOOptions::IRUse);
+    } break;
+    default: break;
+    }
+    auto pipeline = new OptPipeline(
+        reinterpret_cast<llvm::TargetMachine *>(tm), pto, pgo);
+    if (auto err = pipeline->builder.parsePassPipeline(pipeline->mpm, text)) {
+        errormsg = llvm::toString(std::move(err));
+        delete pipeline;
+        return nullptr;
+    }
+    return pipeline;
+}
+
+SCOPES_RESULT(void) set_opt_pipeline(const char *text) {
+    SCOPES_RESULT_TYPE(void);
+    if (*text) {
+        // validate now, rather than on the next module that gets optimized
+        std::string errormsg;
+        auto pipeline = create_opt_pipeline(text, 2, nullptr, errormsg);
+        if (!pipeline) {
+            SCOPES_ERROR(ExecutionEngineFailed, strdup(errormsg.c_str()));
+        }
+        delete pipeline;
+    }
+    std::lock_guard<std::mutex> lock(opt_pipeline_mutex);
+    custom_opt_pipeline = text;
+    return {};
+}
+
+// tm must outlive the process, or be null; pipelines are cached per thread
+// because neither analysis managers nor target machines can be shared.
+static void run_opt_pipeline(LLVMModuleRef module, const std::string &text,
+    int opt_level, LLVMTargetMachineRef tm, ProfileMode profile) {
+    typedef std::tuple<int, LLVMTargetMachineRef, std::string,
+        ProfileMode, std::string> Key;
+    static thread_local std::map<Key, OptPipeline *> pipelines;
+
+    auto path = (profile == PM_None)?std::string():get_profile_path(profile);
+    Key key(opt_level, tm, text, profile, path);
+    auto it = pipelines.find(key);
+    OptPipeline *pipeline;
+    if (it != pipelines.end()) {
+        pipeline = it->second;
+    } else {
+        std::string errormsg;
+        pipeline = create_opt_pipeline(text, opt_level, tm, errormsg,
+            profile, path);
+        if (!pipeline) {
+            // custom pipelines are validated when set, so this is unexpected
+            std::cerr << "error: invalid optimization pipeline: "
+                << errormsg << std::endl;
+            return;
+        }
+        pipelines.insert({key, pipeline});
+    }
+    pipeline->run(*llvm::unwrap(module));
+}
 
-    LLVMRunPassManager(modulePasses, module);
+void build_and_run_opt_passes(LLVMModuleRef module, int opt_level,
+    LLVMTargetMachineRef tm, ProfileMode profile, bool merge_functions) {
+    run_opt_pipeline(module, get_opt_pipeline(opt_level, merge_functions),
+        opt_level, tm, profile);
+}
 
-    LLVMDisposePassManager(functionPasses);
-    LLVMDisposePassManager(modulePasses);
+// splits aggregates on the stack and promotes locals whose address doesn't
+// escape to registers, which takes a fraction of the time that generating
+// code for their loads and stores does
+static void promote_locals(LLVMModuleRef module, LLVMTargetMachineRef tm) {
+    run_opt_pipeline(module, "function(sroa)", 0, tm, PM_None);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void write_thin_bitcode(LLVMModuleRef module, llvm::raw_ostream &out) {
+    auto &M = *llvm::unwrap(module);
+    // without block frequencies, the summary falls back to static estimates
+    auto index = llvm::buildModuleSummaryIndex(M, nullptr, nullptr);
+    // the module hash keeps the names of promoted locals apart between units
+    llvm::WriteBitcodeToFile(M, out, false, &index, true);
+}
+
+static const char *format_llvm_error(llvm::Error err) {
+    return strdup(llvm::toString(std::move(err)).c_str());
+}
+
+SCOPES_RESULT(void) thin_link_objects(const char *triple,
+    const std::vector<std::string> &inputs, const char *output_prefix,
+    int opt_level) {
+    SCOPES_RESULT_TYPE(void);
+    init_llvm_target(triple);
+    llvm::lto::Config conf;
+    conf.DefaultTriple = triple;
+    conf.RelocModel = llvm::Reloc::PIC_;
+    conf.OptLevel = opt_level;
+    conf.CGOptLevel = llvm::CodeGenOpt::Default;
+    std::string features;
+    get_object_target_cpu(conf.CPU, features);
+    if (!features.empty()) {
+        llvm::SmallVector<llvm::StringRef, 16> attrs;
+        llvm::StringRef(features).split(attrs, ',', -1, false);
+        for (auto &attr : attrs) {
+            conf.MAttrs.push_back(attr.str());
+        }
+    }
+
+    // one backend job per hardware core
+    llvm::lto::LTO lto(std::move(conf),
+        llvm::lto::createInProcessThinBackend(
+            llvm::heavyweight_hardware_concurrency()));
+
+    // the buffers must outlive the link
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> buffers;
+    llvm::StringSet<> prevailing;
+    for (auto &input : inputs) {
+        auto buffer = llvm::MemoryBuffer::getFile(input);
+        if (!buffer) {
+            SCOPES_ERROR(RTUnableToOpenFile,
+                String::from(input.c_str(), input.size()));
+        }
+        buffers.push_back(std::move(*buffer));
+        auto ref = buffers.back()->getMemBufferRef();
+        auto info = llvm::getBitcodeLTOInfo(ref);
+        if (!info) {
+            SCOPES_ERROR(CGenBackendFailed, format_llvm_error(info.takeError()));
+        }
+        if (!info->HasSummary) {
+            SCOPES_ERROR(CGenBackendFailed,
+                strdup((input + ": bitcode has no summary").c_str()));
+        }
+        auto file = llvm::lto::InputFile::create(ref);
+        if (!file) {
+            SCOPES_ERROR(CGenBackendFailed, format_llvm_error(file.takeError()));
+        }
+        // the objects are handed to a regular linker afterwards, so every
+        // symbol must stay visible; the first definition of a name prevails
+        std::vector<llvm::lto::SymbolResolution> resolutions;
+        for (auto &sym : (*file)->symbols()) {
+            llvm::lto::SymbolResolution res;
+            res.VisibleToRegularObj = true;
+            if (!sym.isUndefined()) {
+                res.Prevailing = prevailing.insert(sym.getName()).second;
+            }
+            resolutions.push_back(res);
+        }
+        if (auto err = lto.add(std::move(*file), resolutions)) {
+            SCOPES_ERROR(CGenBackendFailed, format_llvm_error(std::move(err)));
+        }
+    }
+
+    // input i is compiled by task i + 1; task 0 is the regular LTO
+    // partition, which stays empty because all inputs carry summaries.
+    // streams are requested from the backend threads, and can't fail, so
+    // the first output that can't be opened is reported after the run.
+    std::mutex open_error_mutex;
+    std::string open_error;
+    auto add_stream = [&](unsigned task)
+        -> std::unique_ptr<llvm::lto::NativeObjectStream> {
+        std::string path = output_prefix;
+        if (task) {
+            path += "." + std::to_string(task - 1);
+        }
+        path += ".o";
+        std::error_code ec;
+        auto os = std::make_unique<llvm::raw_fd_ostream>(path, ec,
+            llvm::sys::fs::OF_None);
+        if (ec) {
+            std::lock_guard<std::mutex> lock(open_error_mutex);
+            if (open_error.empty()) {
+                open_error = path + ": " + ec.message();
+            }
+            return std::make_unique<llvm::lto::NativeObjectStream>(
+                std::make_unique<llvm::raw_null_ostream>());
+        }
+        return std::make_unique<llvm::lto::NativeObjectStream>(std::move(os));
+    };
+    if (auto err = lto.run(add_stream)) {
+        SCOPES_ERROR(CGenBackendFailed, format_llvm_error(std::move(err)));
+    }
+    if (!open_error.empty()) {
+        SCOPES_ERROR(CGenBackendFailed, strdup(open_error.c_str()));
+    }
+    return {};
+}
+
+// lld keeps the state of a link in globals, so only one link runs at a time;
+// code generation on other threads carries on meanwhile
+static std::mutex link_mutex;
+
+SCOPES_RESULT(void) link_objects(const char *triple,
+    const std::vector<std::string> &inputs, const char *path,
+    bool relocatable) {
+    SCOPES_RESULT_TYPE(void);
+    // inputs may be bitcode, which lld compiles for the target
+    init_llvm_target(triple);
+    llvm::Triple target(llvm::Triple::normalize(triple));
+    std::vector<std::string> args;
+    bool (*driver)(llvm::ArrayRef<const char *>, bool, llvm::raw_ostream &,
+        llvm::raw_ostream &) = nullptr;
+    if (relocatable) {
+        if (target.isOSBinFormatWasm()) {
+            driver = lld::wasm::link;
+            args = { "wasm-ld", "-r", "-o", path };
+        } else if (target.isOSBinFormatELF()) {
+            driver = lld::elf::link;
+            args = { "ld.lld", "-r", "-o", path };
+        } else {
+            SCOPES_ERROR(CGenBackendFailed,
+                strdup((std::string(triple)
+                    + ": objects can't be combined for target").c_str()));
+        }
+    } else if (target.isOSBinFormatWasm()) {
+        driver = lld::wasm::link;
+        args = { "wasm-ld", "--no-entry", "--export-dynamic",
+            "--allow-undefined", "-o", path };
+        // objects built with atomics can only be linked against a shared
+        // memory, whose maximum size is fixed; a later --max-memory wins
+        std::string cpu;
+        std::string features;
+        get_object_target_cpu(cpu, features);
+        if ((cpu == "bleeding-edge")
+            || (features.find("+atomics") != std::string::npos)) {
+            args.push_back("--shared-memory");
+            args.push_back("--max-memory=2147483648");
+        }
+    } else if (target.isOSBinFormatCOFF()) {
+        driver = lld::coff::link;
+        args = { "lld-link", "/dll", "/noentry", "/nodefaultlib",
+            std::string("/out:") + path };
+    } else if (target.isOSBinFormatMachO()) {
+        driver = lld::macho::link;
+        args = { "ld64.lld", "-dylib", "-arch", target.getArchName().str(),
+            "-platform_version", "macos", "10.14", "10.14",
+            "-undefined", "dynamic_lookup", "-o", path };
+    } else if (target.isOSBinFormatELF()) {
+        driver = lld::elf::link;
+        args = { "ld.lld", "-shared", "-o", path };
+    } else {
+        SCOPES_ERROR(CGenBackendFailed,
+            strdup((std::string(triple) + ": no linker for target").c_str()));
+    }
+    for (auto &input : inputs) {
+        args.push_back(input);
+    }
+    std::vector<const char *> argv;
+    for (auto &arg : args) {
+        argv.push_back(arg.c_str());
+    }
+
+    std::string output;
+    llvm::raw_string_ostream out(output);
+    bool ok;
+    {
+        std::unique_lock<std::mutex> lock(link_mutex);
+        // without an early exit, the driver resets its state on return
+        ok = driver(argv, false, out, out);
+    }
+    if (!ok) {
+        out.flush();
+        SCOPES_ERROR(CGenBackendFailed, strdup(output.c_str()));
+    }
+    return {};
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 static void *global_c_namespace = nullptr;
+#if SCOPES_USE_LIBMVEC
+static void *libmvec = nullptr;
+#endif
 //static LLVMOrcJITStackRef orc = nullptr;
 static LLVMOrcLLJITRef orc = nullptr;
 static LLVMOrcObjectLayerRef object_layer = nullptr;
 static LLVMOrcJITDylibRef jit_dylib = nullptr;
 static LLVMTargetMachineRef jit_target_machine = nullptr;
+static LLVMTargetMachineRef quick_target_machine = nullptr;
 static LLVMTargetMachineRef object_target_machine = nullptr;
 //static std::vector<void *> loaded_libs;
-static absl::flat_hash_map<Symbol, void *, Symbol::Hash> cached_dlsyms;
+// results of runtime symbol lookups, including failed ones (nullptr); failed
+// lookups are forgotten whenever a new library is loaded.
+static absl::flat_hash_map<std::string, void *> cached_dlsyms;
+// symbols can also be resolved by the tier-up thread
+static std::mutex cached_dlsyms_mutex;
+
+static std::atomic<uint64_t> jit_objects(0);
+static std::atomic<uint64_t> jit_object_bytes(0);
+
+static MemoryStat jit_memory("JIT objects", [](MemoryUsage &usage) {
+    usage.objects = jit_objects.load(std::memory_order_relaxed);
+    usage.bytes = jit_object_bytes.load(std::memory_order_relaxed);
+});
+
+// the size of an object file approximates the memory it takes once linked
+static LLVMErrorRef add_jit_object(LLVMMemoryBufferRef membuf) {
+    jit_objects.fetch_add(1, std::memory_order_relaxed);
+    jit_object_bytes.fetch_add(LLVMGetBufferSize(membuf), std::memory_order_relaxed);
+    return LLVMOrcLLJITAddObjectFile(orc, jit_dylib, membuf);
+}
 
 const String *get_default_target_triple() {
     auto str = LLVMGetDefaultTargetTriple();
@@ -259,26 +836,23 @@ SCOPES_RESULT(uint64_t) get_address(const char *name) {
     return addr;
 }
 
+// cached_dlsyms_mutex must be held
+static void *retrieve_symbol_locked(const char *name) {
+    auto it = cached_dlsyms.find(name);
+    if (it != cached_dlsyms.end())
+        return it->second;
+    void *ptr = LLVMSearchForAddressOfSymbol(name);
+    if (!ptr) {
+        ptr = dlsym(global_c_namespace, name);
+    }
+    cached_dlsyms.insert({name, ptr});
+    return ptr;
+}
+
 static void *retrieve_symbol(const char *name) {
 #if 1
-    //auto it = cached_dlsyms.find(name);
-    //if (it == cached_dlsyms.end()) {
-        void *ptr = LLVMSearchForAddressOfSymbol(name);
-        if (!ptr) {
-            ptr = dlsym(global_c_namespace, name);
-        }
-        #if 0
-        if (ptr) {
-            cached_dlsyms.insert({name, ptr});
-        }
-        #endif
-        return ptr;
-    //} else {
-    //    return it->second;
-    //}
-    //LLVMOrcTargetAddress addr = 0;
-    //auto err = LLVMOrcGetSymbolAddress(orc, &addr, name);
-    //if (addr) return (void *)addr;
+    std::lock_guard<std::mutex> lock(cached_dlsyms_mutex);
+    return retrieve_symbol_locked(name);
 #else
     size_t i = loaded_libs.size();
     while (i--) {
@@ -292,10 +866,31 @@ static void *retrieve_symbol(const char *name) {
 #endif
 }
 
+bool has_vector_math_function(const char *name) {
+#if SCOPES_USE_LIBMVEC
+    return libmvec && dlsym(libmvec, name);
+#else
+    return false;
+#endif
+}
+
 void *local_aware_dlsym(Symbol name) {
     return retrieve_symbol(name.name()->data);
 }
 
+void invalidate_symbol_cache() {
+    std::lock_guard<std::mutex> lock(cached_dlsyms_mutex);
+    // symbols that were found keep resolving to the same address, since
+    // libraries are searched in the order they were loaded
+    for (auto it = cached_dlsyms.begin(); it != cached_dlsyms.end();) {
+        if (!it->second) {
+            cached_dlsyms.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
 LLVMTargetMachineRef get_jit_target_machine() {
     return jit_target_machine;
 }
@@ -304,6 +899,12 @@ LLVMTargetMachineRef get_object_target_machine() {
     return object_target_machine;
 }
 
+std::string trace_emit_name(LLVMModuleRef module) {
+    size_t len = 0;
+    auto id = LLVMGetModuleIdentifier(module, &len);
+    return "emit " + std::string(id, len);
+}
+
 #if 0
 uint64_t lazy_compile_callback(LLVMOrcJITStackRef orc, void *ctx) {
     printf("lazy_compile_callback ???\n");
@@ -317,20 +918,27 @@ static LLVMErrorRef definition_generator(
     LLVMOrcJITDylibRef JD, LLVMOrcJITDylibLookupFlags JDLookupFlags,
     LLVMOrcCLookupSet LookupSet, size_t LookupSetSize) {
     std::vector<LLVMJITCSymbolMapPair> symbolpairs;
+    symbolpairs.reserve(LookupSetSize);
 
-    for (int i = 0; i < LookupSetSize; ++i) {
-        auto name = LookupSet[i].Name;
-        auto str = LLVMOrcSymbolStringPoolEntryStr(name);
-        auto ptr = retrieve_symbol(str);
-        //printf("request[%i] = \"%s\" : %p\n", i, str, ptr);
-        if (ptr) {
-            LLVMJITCSymbolMapPair pair;
-            memset(&pair, 0, sizeof(pair));
-            pair.Name = name;
-            pair.Sym.Address = (uint64_t)ptr;
-            symbolpairs.push_back(pair);
+    {
+        // resolve the entire lookup set in one pass
+        std::lock_guard<std::mutex> lock(cached_dlsyms_mutex);
+        for (int i = 0; i < LookupSetSize; ++i) {
+            auto name = LookupSet[i].Name;
+            auto str = LLVMOrcSymbolStringPoolEntryStr(name);
+            auto ptr = retrieve_symbol_locked(str);
+            //printf("request[%i] = \"%s\" : %p\n", i, str, ptr);
+            if (ptr) {
+                LLVMJITCSymbolMapPair pair;
+                memset(&pair, 0, sizeof(pair));
+                pair.Name = name;
+                pair.Sym.Address = (uint64_t)ptr;
+                symbolpairs.push_back(pair);
+            }
         }
     }
+    if (symbolpairs.empty())
+        return LLVMErrorSuccess;
 
     /*auto custom = LLVMOrcCreateCustomMaterializationUnit("Custom Materialization", nullptr, orcpairs.data(), orcpairs.size(), symbolpairs[0].Name,
       [](void* Ctx, LLVMOrcMaterializationResponsibilityRef MR) {
@@ -358,6 +966,37 @@ static LLVMOrcObjectLayerRef llvm_create_object_layer(
 
     object_layer = LLVMOrcCreateRTDyldObjectLinkingLayerWithSectionMemoryManager(ES);
     LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(object_layer, LLVMCreateGDBRegistrationListener());
+    {
+        llvm::JITEventListener *le = new InstanceSizeListener();
+        LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(object_layer,
+            llvm::wrap(le));
+    }
+    {
+        llvm::JITEventListener *le = new ProfilerCodeListener();
+        LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(object_layer,
+            llvm::wrap(le));
+    }
+
+#ifndef SCOPES_WIN32
+    if (jit_profile_enabled("perf")) {
+        llvm::JITEventListener *le = new PerfMapListener();
+        LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(object_layer,
+            llvm::wrap(le));
+    }
+#endif
+    if (jit_profile_enabled("jitdump")) {
+        // null when LLVM was built without support
+        auto le = LLVMCreatePerfJITEventListener();
+        if (le) {
+            LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(object_layer, le);
+        }
+    }
+    if (jit_profile_enabled("intel")) {
+        auto le = LLVMCreateIntelJITEventListener();
+        if (le) {
+            LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(object_layer, le);
+        }
+    }
 
 #if SCOPES_LLVM_SUPPORT_DISASSEMBLY
     if (!disassembly_listener) {
@@ -371,26 +1010,17 @@ static LLVMOrcObjectLayerRef llvm_create_object_layer(
 	return object_layer;
 }
 
-SCOPES_RESULT(void) init_execution() {
-    SCOPES_RESULT_TYPE(void);
-    if (orc) return {};
-    char *triple = LLVMGetDefaultTargetTriple();
-    //printf("triple: %s\n", triple);
-    char *error_message = nullptr;
-    LLVMTargetRef target = nullptr;
-    if (LLVMGetTargetFromTriple(triple, &target, &error_message)) {
-        SCOPES_ERROR(ExecutionEngineFailed, error_message);
-    }
-    assert(target);
-    assert(LLVMTargetHasJIT(target));
-    assert(LLVMTargetHasTargetMachine(target));
-
-    auto optlevel =
-        LLVMCodeGenLevelNone;
-        //LLVMCodeGenLevelLess;
-        //LLVMCodeGenLevelDefault;
-        //LLVMCodeGenLevelAggressive;
-
+static LLVMTargetRef jit_target = nullptr;
+static char *jit_triple = nullptr;
+
+static LLVMTargetMachineRef create_jit_target_machine(
+    LLVMCodeGenOptLevel optlevel =
+        LLVMCodeGenLevelNone
+        //LLVMCodeGenLevelLess
+        //LLVMCodeGenLevelDefault
+        //LLVMCodeGenLevelAggressive
+    ) {
+    assert(jit_target);
     auto reloc =
         LLVMRelocDefault;
         //LLVMRelocStatic;
@@ -405,25 +1035,73 @@ SCOPES_RESULT(void) init_execution() {
         //LLVMCodeModelMedium;
         //LLVMCodeModelLarge;
 
+    const char *CPU = nullptr;
+    const char *Features = nullptr;
+    auto tm = LLVMCreateTargetMachine(jit_target, jit_triple, CPU, Features,
+        optlevel, reloc, codemodel);
+    assert(tm);
+    return tm;
+}
+
+// for modules compiled with CF_Quick, which select instructions with FastISel
+// wherever it supports them
+static LLVMTargetMachineRef create_quick_target_machine() {
+    auto tm = create_jit_target_machine(LLVMCodeGenLevelNone);
+    auto TM = reinterpret_cast<llvm::TargetMachine *>(tm);
+    TM->setFastISel(true);
+    TM->setO0WantsFastISel(true);
+    TM->setGlobalISel(false);
+    return tm;
+}
+
+static bool concurrent_jit = SCOPES_JIT_CONCURRENT;
+
+void disable_concurrent_jit() {
+    assert(!orc);
+    concurrent_jit = false;
+}
+
+SCOPES_RESULT(void) init_execution() {
+    SCOPES_RESULT_TYPE(void);
+    if (orc) return {};
+    init_llvm_target();
+    char *triple = LLVMGetDefaultTargetTriple();
+    //printf("triple: %s\n", triple);
+    char *error_message = nullptr;
+    LLVMTargetRef target = nullptr;
+    if (LLVMGetTargetFromTriple(triple, &target, &error_message)) {
+        SCOPES_ERROR(ExecutionEngineFailed, error_message);
+    }
+    assert(target);
+    assert(LLVMTargetHasJIT(target));
+    assert(LLVMTargetHasTargetMachine(target));
+    jit_target = target;
+    jit_triple = triple;
+
     object_target_machine = LLVMCreateTargetMachine(target, triple,
         nullptr, nullptr,
         LLVMCodeGenLevelDefault, LLVMRelocStatic, LLVMCodeModelDefault);
     assert(object_target_machine);
 
-    const char *CPU = nullptr;
-    const char *Features = nullptr;
-    jit_target_machine = LLVMCreateTargetMachine(target, triple, CPU, Features,
-        optlevel, reloc, codemodel);
-    assert(jit_target_machine);
+    jit_target_machine = create_jit_target_machine();
+    quick_target_machine = create_quick_target_machine();
     // temporary, will be consumed by orc creation
-    auto jtm = LLVMCreateTargetMachine(target, triple, CPU, Features,
-        optlevel, reloc, codemodel);
-    assert(jtm);
+    auto jtm = create_jit_target_machine();
 
     auto builder = LLVMOrcCreateLLJITBuilder();
     auto tmb = LLVMOrcJITTargetMachineBuilderCreateFromTargetMachine(jtm);
     LLVMOrcLLJITBuilderSetJITTargetMachineBuilder(builder, tmb);
     LLVMOrcLLJITBuilderSetObjectLinkingLayerCreator(builder, llvm_create_object_layer, nullptr);
+    if (concurrent_jit) {
+        // materialization is dispatched to the compile threads, and IR
+        // modules are compiled with a target machine per thread. lookups
+        // are safe from any thread either way; they only wait for the
+        // definitions they need, rather than for whatever the thread that
+        // happens to run the materialization does next
+        reinterpret_cast<llvm::orc::LLJITBuilder *>(builder)
+            ->setNumCompileThreads(
+                std::max(1u, std::thread::hardware_concurrency()));
+    }
 
     auto err = LLVMOrcCreateLLJIT(&orc, builder);
     if (err) {
@@ -453,7 +1131,8 @@ SCOPES_RESULT(void) init_execution() {
     return {};
 }
 
-static std::vector<const PointerMap *> pointer_maps;
+// every pointer symbol that has been defined in the JIT so far
+static PointerMap defined_pointers;
 
 static LLVMMemoryBufferRef module_to_membuffer(LLVMModuleRef module) {
     LLVMMemoryBufferRef irbuf = nullptr;
@@ -468,28 +1147,527 @@ static LLVMMemoryBufferRef module_to_membuffer(LLVMModuleRef module) {
     return irbuf;
 }
 
+// split the module into partitions and generate their objects concurrently,
+// each in its own context. leaves objects empty if the module is too small to
+// be worth splitting.
+static SCOPES_RESULT(void) emit_objects_parallel(LLVMModuleRef module,
+    std::vector<LLVMMemoryBufferRef> &objects, bool quick) {
+    SCOPES_RESULT_TYPE(void);
+    int numfuncs = 0;
+    for (LLVMValueRef value = LLVMGetFirstFunction(module);
+        value; value = LLVMGetNextFunction(value)) {
+        if (!LLVMIsDeclaration(value))
+            numfuncs++;
+    }
+    int numparts = std::min(thread_pool_size(),
+        numfuncs / SCOPES_PARALLEL_MIN_FUNCTIONS);
+    if (numparts < 2)
+        return {};
+
+    Timer emit_timer(TIMER_EmitParallel);
+    // contexts are not thread safe, so every partition travels as bitcode.
+    // locals stay with their users, so partitions only link by public name.
+    std::vector<LLVMMemoryBufferRef> bitcodes;
+    llvm::SplitModule(*llvm::unwrap(module), numparts,
+        [&](std::unique_ptr<llvm::Module> part) {
+            bitcodes.push_back(
+                LLVMWriteBitcodeToMemoryBuffer(llvm::wrap(part.get())));
+        }, true);
+
+    auto count = bitcodes.size();
+    std::vector<LLVMMemoryBufferRef> results;
+    std::vector<char *> errors;
+    results.resize(count, nullptr);
+    errors.resize(count, nullptr);
+    auto emit_part = [&](size_t i) {
+        auto context = LLVMContextCreate();
+        LLVMModuleRef part = nullptr;
+        if (LLVMParseBitcodeInContext2(context, bitcodes[i], &part)) {
+            errors[i] = LLVMCreateMessage("failed to read module partition");
+        } else {
+            auto target_machine = quick?create_quick_target_machine()
+                :create_jit_target_machine();
+            TraceScope emit_trace("codegen",
+                [&]() { return trace_emit_name(part); });
+            if (LLVMTargetMachineEmitToMemoryBuffer(target_machine, part,
+                LLVMObjectFile, &errors[i], &results[i])) {
+                results[i] = nullptr;
+            }
+            LLVMDisposeTargetMachine(target_machine);
+            LLVMDisposeModule(part);
+        }
+        LLVMContextDispose(context);
+    };
+    parallel_for_each(count, emit_part);
+    for (auto bitcode : bitcodes) {
+        LLVMDisposeMemoryBuffer(bitcode);
+    }
+
+    // the error outlives the messages, which are released here
+    const char *error = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        if (!results[i] && !error) {
+            error = String::from_cstr(errors[i]?errors[i]:"")->data;
+        }
+        if (errors[i]) {
+            LLVMDisposeMessage(errors[i]);
+        }
+    }
+    if (error) {
+        for (auto result : results) {
+            if (result)
+                LLVMDisposeMemoryBuffer(result);
+        }
+        SCOPES_ERROR(CGenBackendFailed, error);
+    }
+    objects = results;
+    return {};
+}
+
+static LLVMOrcLazyCallThroughManagerRef lazy_call_through_manager = nullptr;
+static LLVMOrcIndirectStubsManagerRef lazy_stubs_manager = nullptr;
+
+static void lazy_compile_failed() {
+    fprintf(stderr, "error: lazy compilation of function failed\n");
+    fflush(stdout);
+    abort();
+}
+
+// split the module into one partition per cluster of functions that share
+// locals, and add them to the JIT uncompiled. every public function is
+// replaced by a stub that compiles its partition on first call. returns false
+// if lazy compilation is unavailable or the module is too small to split.
+static SCOPES_RESULT(bool) add_module_lazy(LLVMModuleRef module) {
+    SCOPES_RESULT_TYPE(bool);
+    int numfuncs = 0;
+    for (LLVMValueRef value = LLVMGetFirstFunction(module);
+        value; value = LLVMGetNextFunction(value)) {
+        if (!LLVMIsDeclaration(value))
+            numfuncs++;
+    }
+    if (numfuncs < 2)
+        return false;
+
+    if (!lazy_call_through_manager) {
+        auto triple = LLVMOrcLLJITGetTripleString(orc);
+        auto ES = LLVMOrcLLJITGetExecutionSession(orc);
+        auto err = LLVMOrcCreateLocalLazyCallThroughManager(triple, ES,
+            (LLVMOrcJITTargetAddress)&lazy_compile_failed,
+            &lazy_call_through_manager);
+        if (err) {
+            // no trampoline support for this target
+            LLVMConsumeError(err);
+            return false;
+        }
+        lazy_stubs_manager = LLVMOrcCreateLocalIndirectStubsManager(triple);
+    }
+
+    std::vector<LLVMMemoryBufferRef> bitcodes;
+    std::vector<std::string> names;
+    llvm::SplitModule(*llvm::unwrap(module), numfuncs,
+        [&](std::unique_ptr<llvm::Module> part) {
+            bool empty = true;
+            std::vector<llvm::Function *> funcs;
+            for (auto &F : *part) {
+                if (F.isDeclaration())
+                    continue;
+                empty = false;
+                if (!F.hasLocalLinkage())
+                    funcs.push_back(&F);
+            }
+            if (empty)
+                return;
+            for (auto F : funcs) {
+                std::string name = F->getName().str();
+                F->setName(name + SCOPES_LAZY_IMPL_SUFFIX);
+                // route local references through the stub as well, so that
+                // the function has the same address everywhere
+                auto decl = llvm::Function::Create(F->getFunctionType(),
+                    llvm::GlobalValue::ExternalLinkage, name, part.get());
+                decl->setCallingConv(F->getCallingConv());
+                decl->setAttributes(F->getAttributes());
+                F->replaceAllUsesWith(decl);
+                names.push_back(name);
+            }
+            bitcodes.push_back(
+                LLVMWriteBitcodeToMemoryBuffer(llvm::wrap(part.get())));
+        }, true);
+
+    LLVMErrorRef err = nullptr;
+    for (auto bitcode : bitcodes) {
+        if (!err) {
+            auto tsctx = LLVMOrcCreateNewThreadSafeContext();
+            LLVMModuleRef part = nullptr;
+            if (LLVMParseBitcodeInContext2(
+                LLVMOrcThreadSafeContextGetContext(tsctx), bitcode, &part)) {
+                LLVMOrcDisposeThreadSafeContext(tsctx);
+                SCOPES_ERROR(CGenBackendFailed, "failed to read module partition");
+            }
+            auto tsm = LLVMOrcCreateNewThreadSafeModule(part, tsctx);
+            LLVMOrcDisposeThreadSafeContext(tsctx);
+            err = LLVMOrcLLJITAddLLVMIRModule(orc, jit_dylib, tsm);
+        }
+        LLVMDisposeMemoryBuffer(bitcode);
+    }
+    if (err) {
+        SCOPES_ERROR(ExecutionEngineFailed, LLVMGetErrorMessage(err));
+    }
+
+    std::vector<LLVMOrcCSymbolAliasMapPair> aliases;
+    for (auto &&name : names) {
+        LLVMOrcCSymbolAliasMapPair pair;
+        memset(&pair, 0, sizeof(pair));
+        pair.Name = LLVMOrcLLJITMangleAndIntern(orc, name.c_str());
+        pair.Entry.Name = LLVMOrcLLJITMangleAndIntern(orc,
+            (name + SCOPES_LAZY_IMPL_SUFFIX).c_str());
+        pair.Entry.Flags.GenericFlags =
+            LLVMJITSymbolGenericFlagsExported | LLVMJITSymbolGenericFlagsCallable;
+        aliases.push_back(pair);
+    }
+    auto mu = LLVMOrcLazyReexports(lazy_call_through_manager,
+        lazy_stubs_manager, jit_dylib, aliases.data(), aliases.size());
+    err = LLVMOrcJITDylibDefine(jit_dylib, mu);
+    if (err) {
+        SCOPES_ERROR(ExecutionEngineFailed, LLVMGetErrorMessage(err));
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// TIERED COMPILATION
+//------------------------------------------------------------------------------
+
+/* in tiered mode, every function F is emitted unoptimized as F$t0, and F
+   becomes an entry that counts calls and jumps through the pointer in F$slot.
+   once F gets hot, a background thread recompiles F$t0 with optimizations
+   from a bitcode snapshot of its module, and swaps the pointer in F$slot. */
+
+struct TieredModule {
+    LLVMMemoryBufferRef bitcode;
+    int opt_level;
+};
+
+struct TieredFunction {
+    TieredModule *module;
+    std::string name;
+    std::atomic<bool> requested;
+};
+
+static std::mutex tier_up_mutex;
+static std::condition_variable tier_up_cond;
+static std::deque<TieredFunction *> tier_up_queue;
+static std::thread *tier_up_thread = nullptr;
+static bool tier_up_stop = false;
+static int tiered_module_count = 0;
+static std::atomic<int> tier_up_count(0);
+
+int get_tier_up_count() {
+    return tier_up_count.load(std::memory_order_acquire);
+}
+
+// returns an error message, or null on success
+static const char *tier_up_function(TieredFunction *tf) {
+    Timer tier_up_timer(TIMER_TierUp);
+    auto context = LLVMContextCreate();
+    LLVMModuleRef module = nullptr;
+    if (LLVMParseBitcodeInContext2(context, tf->module->bitcode, &module)) {
+        LLVMContextDispose(context);
+        return "failed to read module";
+    }
+    auto &M = *llvm::unwrap(module);
+    auto hot = M.getFunction(tf->name + SCOPES_TIER0_SUFFIX);
+    if (!hot) {
+        LLVMContextDispose(context);
+        return "function not found";
+    }
+    // everything else already exists in the JIT; keep bodies and constants
+    // around for inlining and folding only
+    for (auto &F : M) {
+        if ((&F == hot) || F.isDeclaration())
+            continue;
+        F.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+    }
+    std::vector<llvm::GlobalVariable *> appending;
+    for (auto &G : M.globals()) {
+        if (G.hasAppendingLinkage()) {
+            appending.push_back(&G);
+        } else if (G.isDeclaration()) {
+        } else if (G.isConstant()) {
+            G.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+        } else {
+            G.setInitializer(nullptr);
+            G.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+    }
+    for (auto G : appending) {
+        G->eraseFromParent();
+    }
+    auto level = tf->module->opt_level;
+    std::string hotname = tf->name + "$t" + std::to_string(level);
+    hot->setName(hotname);
+
+    // only ever used from the tier up thread, so it can be kept around
+    static LLVMTargetMachineRef target_machine = nullptr;
+    if (!target_machine) {
+        target_machine = create_jit_target_machine(LLVMCodeGenLevelDefault);
+    }
+    build_and_run_opt_passes(module, level, target_machine);
+
+    char *errormsg = nullptr;
+    LLVMMemoryBufferRef membuf = nullptr;
+    LLVMBool failed;
+    {
+        TraceScope emit_trace("codegen",
+            [&]() { return trace_emit_name(module); });
+        failed = LLVMTargetMachineEmitToMemoryBuffer(target_machine, module,
+            LLVMObjectFile, &errormsg, &membuf);
+    }
+    LLVMDisposeModule(module);
+    LLVMContextDispose(context);
+    if (failed)
+        return errormsg;
+
+    auto err = add_jit_object(membuf);
+    LLVMOrcExecutorAddress addr = 0;
+    LLVMOrcExecutorAddress slot = 0;
+    if (!err) {
+        err = LLVMOrcLLJITLookup(orc, &addr, hotname.c_str());
+    }
+    if (!err) {
+        err = LLVMOrcLLJITLookup(orc, &slot,
+            (tf->name + "$slot").c_str());
+    }
+    if (err)
+        return LLVMGetErrorMessage(err);
+    reinterpret_cast< std::atomic<uint64_t> * >(slot)->store(
+        addr, std::memory_order_release);
+    tier_up_count.fetch_add(1, std::memory_order_release);
+    return nullptr;
+}
+
+static void tier_up_worker() {
+    while (true) {
+        TieredFunction *tf = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(tier_up_mutex);
+            tier_up_cond.wait(lock, []{
+                return tier_up_stop || !tier_up_queue.empty(); });
+            if (tier_up_stop)
+                return;
+            tf = tier_up_queue.front();
+            tier_up_queue.pop_front();
+        }
+        auto error = tier_up_function(tf);
+        if (error) {
+            // the function keeps running unoptimized
+            fprintf(stderr, "warning: optimizing %s failed: %s\n",
+                tf->name.c_str(), error);
+        }
+    }
+}
+
+// a job that is still running must not see the JIT torn down
+static void stop_tier_up_thread() {
+    {
+        std::lock_guard<std::mutex> lock(tier_up_mutex);
+        tier_up_stop = true;
+    }
+    tier_up_cond.notify_one();
+    tier_up_thread->join();
+}
+
+// called by the entry of a function that just got hot
+static void tier_up_request(TieredFunction *tf) {
+    if (tf->requested.exchange(true))
+        return;
+    std::lock_guard<std::mutex> lock(tier_up_mutex);
+    if (!tier_up_thread) {
+        tier_up_thread = new std::thread(tier_up_worker);
+        atexit(stop_tier_up_thread);
+    }
+    tier_up_queue.push_back(tf);
+    tier_up_cond.notify_one();
+}
+
+static void prepare_tiered_module(LLVMModuleRef module, int opt_level) {
+    auto &M = *llvm::unwrap(module);
+    auto &C = M.getContext();
+    auto tm = new TieredModule();
+    tm->opt_level = opt_level;
+
+    // optimized code is compiled into separate objects, which can only
+    // refer to locals if they are public and unique
+    std::string prefix = "$tier" + std::to_string(tiered_module_count++) + ".";
+    for (auto &G : M.global_values()) {
+        if (!G.hasLocalLinkage())
+            continue;
+        G.setName(prefix + G.getName().str());
+        G.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        G.setVisibility(llvm::GlobalValue::DefaultVisibility);
+    }
+
+    std::vector<llvm::Function *> funcs;
+    for (auto &F : M) {
+        if (F.isDeclaration() || F.isVarArg() || F.isIntrinsic())
+            continue;
+        funcs.push_back(&F);
+    }
+
+    auto i8ptrT = llvm::Type::getInt8PtrTy(C);
+    auto i32T = llvm::Type::getInt32Ty(C);
+    auto i64T = llvm::Type::getInt64Ty(C);
+    auto requestT = llvm::FunctionType::get(llvm::Type::getVoidTy(C),
+        { i8ptrT }, false);
+    auto request = llvm::ConstantExpr::getIntToPtr(
+        llvm::ConstantInt::get(i64T, (uint64_t)&tier_up_request),
+        requestT->getPointerTo());
+    auto ptralign = M.getDataLayout().getPointerABIAlignment(0);
+    for (auto F : funcs) {
+        std::string name = F->getName().str();
+        auto tf = new TieredFunction();
+        tf->module = tm;
+        tf->name = name;
+        tf->requested = false;
+
+        F->setName(name + SCOPES_TIER0_SUFFIX);
+        auto entry = llvm::Function::Create(F->getFunctionType(),
+            llvm::GlobalValue::ExternalLinkage, name, &M);
+        entry->setCallingConv(F->getCallingConv());
+        entry->setAttributes(F->getAttributes());
+        F->replaceAllUsesWith(entry);
+        auto slot = new llvm::GlobalVariable(M, F->getType(), false,
+            llvm::GlobalValue::ExternalLinkage, F, name + "$slot");
+        slot->setAlignment(ptralign);
+        auto counter = new llvm::GlobalVariable(M, i32T, false,
+            llvm::GlobalValue::ExternalLinkage,
+            llvm::ConstantInt::get(i32T, 0),
+            name + "$count");
+
+        auto countbb = llvm::BasicBlock::Create(C, "", entry);
+        auto hotbb = llvm::BasicBlock::Create(C, "", entry);
+        auto callbb = llvm::BasicBlock::Create(C, "", entry);
+        llvm::IRBuilder<> builder(countbb);
+        // the counter is racy, but only has to be roughly right
+        auto count = builder.CreateAdd(builder.CreateLoad(i32T, counter),
+            llvm::ConstantInt::get(i32T, 1));
+        builder.CreateStore(count, counter);
+        builder.CreateCondBr(builder.CreateICmpEQ(count,
+            llvm::ConstantInt::get(i32T, SCOPES_TIER_UP_THRESHOLD)), hotbb, callbb);
+        builder.SetInsertPoint(hotbb);
+        builder.CreateCall(requestT, request, {
+            llvm::ConstantExpr::getIntToPtr(
+                llvm::ConstantInt::get(i64T, (uint64_t)tf), i8ptrT) });
+        builder.CreateBr(callbb);
+        builder.SetInsertPoint(callbb);
+        auto target = builder.CreateAlignedLoad(F->getType(), slot, ptralign);
+        target->setAtomic(llvm::AtomicOrdering::Monotonic);
+        std::vector<llvm::Value *> args;
+        for (auto &arg : entry->args()) {
+            args.push_back(&arg);
+        }
+        auto call = builder.CreateCall(F->getFunctionType(), target, args);
+        call->setCallingConv(F->getCallingConv());
+        call->setAttributes(F->getAttributes());
+        call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+        if (F->getReturnType()->isVoidTy()) {
+            builder.CreateRetVoid();
+        } else {
+            builder.CreateRet(call);
+        }
+    }
+
+    tm->bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+}
+
+static const String *get_cache_part_key(const String *key, size_t index) {
+    return get_cache_key(index + 1, key->data, key->count);
+}
+
+// a partitioned object is cached as one entry per partition, and an entry
+// under the module key which lists the number of partitions
+static bool get_cached_parts(const String *key, const char *cached,
+    size_t cached_size, std::vector< std::pair<const char *, size_t> > &parts) {
+    auto magicsize = strlen(SCOPES_CACHE_PARTS_MAGIC);
+    if ((cached_size != magicsize + sizeof(uint32_t))
+        || memcmp(cached, SCOPES_CACHE_PARTS_MAGIC, magicsize)) {
+        parts.push_back({ cached, cached_size });
+        return true;
+    }
+    uint32_t count;
+    memcpy(&count, cached + magicsize, sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; ++i) {
+        size_t size = 0;
+        auto part = get_cache(get_cache_part_key(key, i), size);
+        if (!part) {
+            parts.clear();
+            return false;
+        }
+        parts.push_back({ part, size });
+    }
+    return true;
+}
+
+static void set_cached_parts(const String *key,
+    const char *key_content, size_t key_size,
+    const std::vector<LLVMMemoryBufferRef> &objects) {
+    if (objects.size() == 1) {
+        set_cache(key, key_content, key_size,
+            LLVMGetBufferStart(objects[0]), LLVMGetBufferSize(objects[0]));
+        return;
+    }
+    for (size_t i = 0; i < objects.size(); ++i) {
+        set_cache(get_cache_part_key(key, i), nullptr, 0,
+            LLVMGetBufferStart(objects[i]), LLVMGetBufferSize(objects[i]));
+    }
+    auto magicsize = strlen(SCOPES_CACHE_PARTS_MAGIC);
+    char header[16];
+    uint32_t count = objects.size();
+    memcpy(header, SCOPES_CACHE_PARTS_MAGIC, magicsize);
+    memcpy(header + magicsize, &count, sizeof(uint32_t));
+    set_cache(key, key_content, key_size,
+        header, magicsize + sizeof(uint32_t));
+}
+
 SCOPES_RESULT(void) add_module(LLVMModuleRef module, const PointerMap &map,
     uint64_t compiler_flags) {
     SCOPES_RESULT_TYPE(void);
 #if SCOPES_ALLOW_CACHE
-    bool cache = ((compiler_flags & CF_Cache) == CF_Cache);
+    // tiered objects refer to state of this process, and the profile that
+    // shapes profiled objects is not part of the key
+    bool cache = ((compiler_flags & CF_Cache) == CF_Cache)
+        && !(compiler_flags & (CF_Tiered | CF_ProfileGenerate | CF_ProfileUse));
 #else
     const bool cache = false;
 #endif
+    SCOPES_CHECK_RESULT(verify_profile_mode(profile_mode_from_flags(compiler_flags)));
 
     LLVMMemoryBufferRef irbuf = nullptr;
     LLVMMemoryBufferRef membuf = nullptr;
+    std::vector<uint64_t> digest;
+    const char *keydata = nullptr;
+    size_t keysize = 0;
     if (cache) {
-        irbuf = module_to_membuffer(module);
+        // the digest is much cheaper to build than a printed module; fall
+        // back to the latter for modules that the digest can't describe
+        if (digest_module(module, digest)) {
+            keydata = (const char *)digest.data();
+            keysize = digest.size() * sizeof(uint64_t);
+        } else {
+            irbuf = module_to_membuffer(module);
+            keydata = LLVMGetBufferStart(irbuf);
+            keysize = LLVMGetBufferSize(irbuf);
+        }
     }
 
     const String *key = nullptr;
-    const char *filepath = nullptr;
+    const char *cached = nullptr;
+    size_t cached_size = 0;
+    std::vector< std::pair<const char *, size_t> > parts;
     if (cache) {
-        assert(irbuf);
+        assert(keydata);
         key = get_cache_key(compiler_flags & SCOPES_CACHE_COMPILER_FLAGS,
-            LLVMGetBufferStart(irbuf), LLVMGetBufferSize(irbuf));
-        filepath = get_cache_file(key);
+            keydata, keysize);
+        cached = get_cache(key, cached_size);
 
         const char *keyfilepath = get_cache_key_file(key);
         if (keyfilepath) {
@@ -498,10 +1676,10 @@ SCOPES_RESULT(void) add_module(LLVMModuleRef module, const PointerMap &map,
             if (LLVMCreateMemoryBufferWithContentsOfFile(keyfilepath, &cmpirbuf, &errormsg)) {
                 SCOPES_ERROR(CGenBackendFailed, errormsg);
             }
-            auto sz = LLVMGetBufferSize(irbuf);
+            auto sz = keysize;
             if ((sz != LLVMGetBufferSize(cmpirbuf))
-                || (memcmp(LLVMGetBufferStart(irbuf), LLVMGetBufferStart(cmpirbuf),sz) != 0)) {
-                auto a = LLVMGetBufferStart(irbuf);
+                || (memcmp(keydata, LLVMGetBufferStart(cmpirbuf),sz) != 0)) {
+                auto a = keydata;
                 auto b = LLVMGetBufferStart(cmpirbuf);
                 for (int i = 0; i < sz; ++i) {
                     if (*a != *b) {
@@ -516,7 +1694,7 @@ SCOPES_RESULT(void) add_module(LLVMModuleRef module, const PointerMap &map,
 
                 FILE *f = fopen(newkeyfilepath, "wb");
                 assert(f);
-                fwrite(LLVMGetBufferStart(irbuf), 1, LLVMGetBufferSize(irbuf), f);
+                fwrite(keydata, 1, keysize, f);
                 fclose(f);
 
                 assert(false);
@@ -526,72 +1704,73 @@ SCOPES_RESULT(void) add_module(LLVMModuleRef module, const PointerMap &map,
 
     LLVMErrorRef err = nullptr;
     //LLVMOrcModuleHandle newhandle = 0;
-    auto ptrmap = new PointerMap(map);
-    pointer_maps.push_back(ptrmap);
-    auto ES = LLVMOrcLLJITGetExecutionSession(orc);
-    std::vector<LLVMJITCSymbolMapPair> symbolpairs;
-    for (auto it = ptrmap->begin(); it != ptrmap->end(); ++it) {
-        const char *name = it->first.c_str();
-        void *ptr = const_cast< void *>(it->second);
-
-        LLVMJITCSymbolMapPair pair;
-        memset(&pair, 0, sizeof(pair));
-        pair.Name = LLVMOrcExecutionSessionIntern(ES, name);
-        pair.Sym.Address = (uint64_t)ptr;
-        symbolpairs.push_back(pair);
-    }
-    auto mu = LLVMOrcAbsoluteSymbols(symbolpairs.data(), symbolpairs.size());
-    err = LLVMOrcJITDylibDefine(jit_dylib, mu);
-    if (err) {
-        SCOPES_ERROR(ExecutionEngineFailed, LLVMGetErrorMessage(err));
-    }
+    {
+        // only define the pointers that earlier modules haven't defined yet
+        auto ES = LLVMOrcLLJITGetExecutionSession(orc);
+        std::vector<LLVMJITCSymbolMapPair> symbolpairs;
+        for (auto it = map.begin(); it != map.end(); ++it) {
+            auto inserted = defined_pointers.insert(*it);
+            if (!inserted.second) {
+                assert(inserted.first->second == it->second);
+                continue;
+            }
+            const char *name = it->first.c_str();
+            void *ptr = const_cast< void *>(it->second);
 
-    if (cache && filepath) {
-        #if 0
-        char *errormsg;
-        if (LLVMCreateMemoryBufferWithContentsOfFile(filepath, &membuf, &errormsg)) {
-            SCOPES_ERROR(CGenBackendFailed, errormsg);
+            LLVMJITCSymbolMapPair pair;
+            memset(&pair, 0, sizeof(pair));
+            pair.Name = LLVMOrcExecutionSessionIntern(ES, name);
+            pair.Sym.Address = (uint64_t)ptr;
+            symbolpairs.push_back(pair);
         }
-        #else
-
-        auto f = gzopen(filepath, "r");
-        if (!f) {
-            printf("failed to open cache file for reading (%s)\n", strerror(errno));
-            goto skip_cache;
+        if (!symbolpairs.empty()) {
+            auto mu = LLVMOrcAbsoluteSymbols(symbolpairs.data(), symbolpairs.size());
+            err = LLVMOrcJITDylibDefine(jit_dylib, mu);
+            if (err) {
+                SCOPES_ERROR(ExecutionEngineFailed, LLVMGetErrorMessage(err));
+            }
         }
+    }
 
-        std::vector<char> data;
-    repeat:
-        char buf[8192];
-        int r = gzread(f, buf, sizeof(buf));
-        if (r < 0) {
-            printf("failed to read from cache file (%s)\n", strerror(errno));
-            goto skip_cache;
-        }
-        if (r > 0) {
-            auto offset = data.size();
-            data.resize(offset + r);
-            memcpy(&data[offset], buf, r);
+    if (cache && cached && get_cached_parts(key, cached, cached_size, parts)) {
+        for (auto &&part : parts) {
+            // the cache mapping outlives the JIT, so no copy is necessary
+            membuf = LLVMCreateMemoryBufferWithMemoryRange(
+                part.first, part.second, "", false);
+
+            auto t = std::chrono::steady_clock::now();
+            err = add_jit_object(membuf);
+            count_cache_object_load(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - t).count());
+            //err = LLVMOrcAddObjectFile(orc, &newhandle, membuf, orc_symbol_resolver, ptrmap);
+            if (err) break;
         }
-        if (r == sizeof(buf))
-            goto repeat;
-
-        gzclose(f);
-
-        membuf = LLVMCreateMemoryBufferWithMemoryRangeCopy(
-            data.data(), data.size(), "");
-
-        #endif
-
-        err = LLVMOrcLLJITAddObjectFile(orc, jit_dylib, membuf);
-        //err = LLVMOrcAddObjectFile(orc, &newhandle, membuf, orc_symbol_resolver, ptrmap);
         goto done;
     } else {
         goto skip_cache;
     }
 skip_cache:
     {
-        if (compiler_flags & CF_O3) {
+        bool tiered = (compiler_flags & CF_Tiered);
+        bool quick = (compiler_flags & CF_Quick);
+        if (quick) {
+            // emitted as generated
+        } else if (tiered) {
+            // start unoptimized, the requested level applies to hot functions
+            int level = 2;
+            if ((compiler_flags & CF_O3) == CF_O1)
+                level = 1;
+            else if ((compiler_flags & CF_O3) == CF_O3)
+                level = 3;
+            {
+                Timer optimize_timer(TIMER_Optimize);
+                promote_locals(module, jit_target_machine);
+            }
+            prepare_tiered_module(module, level);
+        } else if ((compiler_flags & CF_O3)
+            || profile_mode_from_flags(compiler_flags)) {
+            // profiles are applied by the optimizer, even at O0
             Timer optimize_timer(TIMER_Optimize);
             int level = 0;
             if ((compiler_flags & CF_O3) == CF_O1)
@@ -600,27 +1779,50 @@ skip_cache:
                 level = 2;
             else if ((compiler_flags & CF_O3) == CF_O3)
                 level = 3;
-            build_and_run_opt_passes(module, level);
+            build_and_run_opt_passes(module, level, jit_target_machine,
+                profile_mode_from_flags(compiler_flags));
+        } else {
+            // unoptimized code still keeps plain locals in registers
+            Timer optimize_timer(TIMER_Optimize);
+            promote_locals(module, jit_target_machine);
         }
 
-        auto target_machine = get_jit_target_machine();
-        assert(target_machine);
+        if ((compiler_flags & CF_Lazy) && !tiered) {
+            // nothing is compiled yet, so there is nothing to cache either
+            if (SCOPES_GET_RESULT(add_module_lazy(module)))
+                goto done;
+        }
+
+        std::vector<LLVMMemoryBufferRef> objects;
+        if (compiler_flags & CF_Parallel) {
+            SCOPES_CHECK_RESULT(emit_objects_parallel(module, objects, quick));
+        }
+        if (objects.empty()) {
+            auto target_machine = quick?quick_target_machine
+                :get_jit_target_machine();
+            assert(target_machine);
 
-        char *errormsg;
-        if (LLVMTargetMachineEmitToMemoryBuffer(target_machine, module,
-            LLVMObjectFile, &errormsg, &membuf)) {
-            SCOPES_ERROR(CGenBackendFailed, errormsg);
+            char *errormsg;
+            TraceScope emit_trace("codegen",
+                [&]() { return trace_emit_name(module); });
+            if (LLVMTargetMachineEmitToMemoryBuffer(target_machine, module,
+                LLVMObjectFile, &errormsg, &membuf)) {
+                SCOPES_ERROR(CGenBackendFailed, errormsg);
+            }
+            objects.push_back(membuf);
         }
 
         if (cache) {
-            assert(key && irbuf && membuf);
-            set_cache(key, LLVMGetBufferStart(irbuf), LLVMGetBufferSize(irbuf),
-                LLVMGetBufferStart(membuf), LLVMGetBufferSize(membuf));
+            assert(key && keydata && !objects.empty());
+            set_cached_parts(key, keydata, keysize, objects);
         }
 
         #if 1
-        err = LLVMOrcLLJITAddObjectFile(orc, jit_dylib, membuf);
-        //err = LLVMOrcAddObjectFile(orc, &newhandle, membuf, orc_symbol_resolver, ptrmap);
+        for (auto obj : objects) {
+            err = add_jit_object(obj);
+            //err = LLVMOrcAddObjectFile(orc, &newhandle, membuf, orc_symbol_resolver, ptrmap);
+            if (err) break;
+        }
         #else
         LLVMDisposeMemoryBuffer(membuf);
         err = LLVMOrcAddEagerlyCompiledIR(orc, &newhandle, module,
@@ -646,14 +1848,19 @@ done:
 
 SCOPES_RESULT(void) add_object(const char *path) {
     SCOPES_RESULT_TYPE(void);
-    LLVMErrorRef err = nullptr;
-    //LLVMOrcModuleHandle newhandle = 0;
     LLVMMemoryBufferRef membuf = nullptr;
     char *errormsg;
     if (LLVMCreateMemoryBufferWithContentsOfFile(path, &membuf, &errormsg)) {
         SCOPES_ERROR(CGenBackendFailed, errormsg);
     }
-    err = LLVMOrcLLJITAddObjectFile(orc, jit_dylib, membuf);
+    return add_object(membuf);
+}
+
+SCOPES_RESULT(void) add_object(LLVMMemoryBufferRef membuf) {
+    SCOPES_RESULT_TYPE(void);
+    LLVMErrorRef err = nullptr;
+    //LLVMOrcModuleHandle newhandle = 0;
+    err = add_jit_object(membuf);
     //err = LLVMOrcAddObjectFile(orc, &newhandle, membuf, orc_symbol_resolver, nullptr);
     if (!err) {
         //module_handles.push_back(newhandle);
@@ -664,43 +1871,74 @@ SCOPES_RESULT(void) add_object(const char *path) {
     return {};
 }
 
-void init_llvm() {
-    global_c_namespace = dlopen(NULL, RTLD_LAZY);
-
-    // remove crash message
-    //LLVMEnablePrettyStackTrace();
+static std::once_flag native_target_once;
+#ifdef SCOPES_TARGET_WEBASSEMBLY
+static std::once_flag webassembly_target_once;
+#endif
+#ifdef SCOPES_TARGET_AARCH64
+static std::once_flag aarch64_target_once;
+#endif
+#ifdef SCOPES_TARGET_RISCV
+static std::once_flag riscv_target_once;
+#endif
 
+void init_llvm_target(const char *triple) {
+    std::call_once(native_target_once, []{
+        LLVMInitializeNativeTarget();
+        LLVMInitializeNativeAsmPrinter();
+        LLVMInitializeNativeAsmParser();
+    });
+    if (!triple)
+        return;
     // new known targets must also be handled elsewhere; grep SCOPES_KNOWN_TARGETS to find them
-    LLVMInitializeNativeTarget();
-    LLVMInitializeNativeAsmPrinter();
-    LLVMInitializeNativeAsmParser();
-    LLVMInitializeNativeDisassembler();
+    llvm::Triple target(llvm::Triple::normalize(triple));
 #ifdef SCOPES_TARGET_WEBASSEMBLY
-    LLVMInitializeWebAssemblyTargetInfo();
-    LLVMInitializeWebAssemblyTarget();
-    LLVMInitializeWebAssemblyTargetMC();
-    LLVMInitializeWebAssemblyAsmPrinter();
-    LLVMInitializeWebAssemblyAsmParser();
-    LLVMInitializeWebAssemblyDisassembler();
+    if (target.isWasm()) {
+        std::call_once(webassembly_target_once, []{
+            LLVMInitializeWebAssemblyTargetInfo();
+            LLVMInitializeWebAssemblyTarget();
+            LLVMInitializeWebAssemblyTargetMC();
+            LLVMInitializeWebAssemblyAsmPrinter();
+            LLVMInitializeWebAssemblyAsmParser();
+        });
+    }
 #endif
 #ifdef SCOPES_TARGET_AARCH64
-    LLVMInitializeAArch64Target();
-    LLVMInitializeAArch64TargetMC();
-    LLVMInitializeAArch64TargetInfo();
-    LLVMInitializeAArch64AsmPrinter();
-    LLVMInitializeAArch64AsmParser();
-    LLVMInitializeAArch64Disassembler();
+    if (target.isAArch64()) {
+        std::call_once(aarch64_target_once, []{
+            LLVMInitializeAArch64Target();
+            LLVMInitializeAArch64TargetMC();
+            LLVMInitializeAArch64TargetInfo();
+            LLVMInitializeAArch64AsmPrinter();
+            LLVMInitializeAArch64AsmParser();
+        });
+    }
 #endif
 #ifdef SCOPES_TARGET_RISCV
-    LLVMInitializeRISCVTarget();
-    LLVMInitializeRISCVTargetMC();
-    LLVMInitializeRISCVTargetInfo();
-    LLVMInitializeRISCVAsmPrinter();
-    LLVMInitializeRISCVAsmParser();
-    LLVMInitializeRISCVDisassembler();
+    if (target.isRISCV()) {
+        std::call_once(riscv_target_once, []{
+            LLVMInitializeRISCVTarget();
+            LLVMInitializeRISCVTargetMC();
+            LLVMInitializeRISCVTargetInfo();
+            LLVMInitializeRISCVAsmPrinter();
+            LLVMInitializeRISCVAsmParser();
+        });
+    }
+#endif
+    (void)target;
+}
+
+void init_llvm() {
+    global_c_namespace = dlopen(NULL, RTLD_LAZY);
+#if SCOPES_USE_LIBMVEC
+    // older versions of glibc lack some variants, or libmvec altogether
+    libmvec = dlopen("libmvec.so.1", RTLD_NOW | RTLD_GLOBAL);
 #endif
 
+    // remove crash message
+    //LLVMEnablePrettyStackTrace();
 
+    // targets are initialized by init_llvm_target() on first use
 
 #ifdef SCOPES_WIN32
     // from mingwex.a
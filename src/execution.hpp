@@ -14,9 +14,14 @@
 #include <stdint.h>
 #include "absl/container/flat_hash_map.h"
 #include <string>
+#include <vector>
 
 #include "result.hpp"
 
+namespace llvm {
+class raw_ostream;
+}
+
 namespace scopes {
 
 struct Symbol;
@@ -29,19 +34,69 @@ typedef absl::flat_hash_map<std::string, const void *> PointerMap;
 
 const String *get_default_target_triple();
 SCOPES_RESULT(void) init_execution();
+// before the JIT is set up, makes it materialize code on the thread that looks
+// it up rather than on threads of its own, which a process that forks later
+// on doesn't inherit
+void disable_concurrent_jit();
 SCOPES_RESULT(void) add_module(LLVMModuleRef module,
     const PointerMap &map, uint64_t compiler_flags);
 SCOPES_RESULT(uint64_t) get_address(const char *name);
+// the number of tiered functions whose optimized code has been swapped in
+int get_tier_up_count();
 //SCOPES_RESULT(void *) get_pointer_to_global(LLVMValueRef g);
 void *local_aware_dlsym(Symbol name);
+// true if the runtime has loaded the vector math function name
+bool has_vector_math_function(const char *name);
+// must be called after loading a library so failed lookups are retried
+void invalidate_symbol_cache();
 LLVMTargetMachineRef get_jit_target_machine();
 LLVMTargetMachineRef get_object_target_machine();
+// names the trace event of emitting an object file for module
+std::string trace_emit_name(LLVMModuleRef module);
 SCOPES_RESULT(void) add_object(const char *path);
-void build_and_run_opt_passes(LLVMModuleRef module, int opt_level);
+// takes ownership of membuf
+SCOPES_RESULT(void) add_object(LLVMMemoryBufferRef membuf);
+// how the optimizer works with execution profiles
+enum ProfileMode {
+    PM_None,
+    // insert counters that write a raw profile to the profile path
+    PM_Generate,
+    // optimize with the indexed profile found at the profile path
+    PM_Use,
+};
+
+ProfileMode profile_mode_from_flags(uint64_t flags);
+void set_profile_path(const char *path);
+SCOPES_RESULT(void) verify_profile_mode(ProfileMode mode);
+
+void build_and_run_opt_passes(LLVMModuleRef module, int opt_level,
+    LLVMTargetMachineRef tm = nullptr, ProfileMode profile = PM_None,
+    bool merge_functions = false);
+SCOPES_RESULT(void) set_opt_pipeline(const char *text);
+// the text of the pipeline that modules are optimized with at opt_level;
+// merge_functions folds identical functions of an object file
+std::string get_opt_pipeline(int opt_level, bool merge_functions = false);
+// writes module as bitcode with a ThinLTO summary
+void write_thin_bitcode(LLVMModuleRef module, llvm::raw_ostream &out);
+// runs ThinLTO over bitcode files written by write_thin_bitcode, in parallel,
+// and writes the object for input i to <output_prefix>.<i>.o
+SCOPES_RESULT(void) thin_link_objects(const char *triple,
+    const std::vector<std::string> &inputs, const char *output_prefix,
+    int opt_level);
+// links the objects and libraries in inputs into a shared library at path,
+// with the lld driver that matches the object format of triple; inputs that
+// begin with a dash are passed to the linker as options. a relocatable link
+// combines the objects into one object instead, for ELF and wasm targets.
+SCOPES_RESULT(void) link_objects(const char *triple,
+    const std::vector<std::string> &inputs, const char *path,
+    bool relocatable = false);
 void print_disassembly(std::string symbol, void *pfunc);
 void enable_disassembly(bool enable);
 
 void init_llvm();
+// registers the native target, and the target of triple if it is one of the
+// others that are compiled in; each target is only registered once
+void init_llvm_target(const char *triple = nullptr);
 
 } // namespace scopes
 
@@ -17,12 +17,17 @@
 #include "value.hpp"
 #include "prover.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
 #include "stream_expr.hpp"
 #include "gc.hpp"
 #include "dyn_cast.inc"
 #include "scopes/scopes.h"
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
 #include <assert.h>
+#include <tuple>
 
 namespace scopes {
 
@@ -50,6 +55,50 @@ static SCOPES_RESULT(void) verify_list_parameter_count(const char *context, cons
     return {};
 }
 
+//------------------------------------------------------------------------------
+// PURE SUGAR MACROS
+//------------------------------------------------------------------------------
+
+/* the result of a pure sugar macro depends only on the list and scope it is
+   invoked with, and scopes are persistent. parsed lists are unique cells, so
+   the key only matches when the very same list object is expanded again in
+   the same scope, as with syntax that is quoted once and expanded many
+   times; textually equal forms elsewhere in the source don't share results.
+   keying on content would hand them results that carry the anchors of
+   another occurrence. */
+
+typedef std::tuple<const void *, const List *, const Scope *> SugarMemoKey;
+
+static absl::flat_hash_set<const void *> pure_sugar_macros;
+static absl::flat_hash_map<SugarMemoKey, sc_list_scope_tuple_t> sugar_memo;
+
+void set_sugar_macro_pure(sc_syntax_wildcard_func_t f) {
+    pure_sugar_macros.insert((const void *)f);
+}
+
+SCOPES_RESULT(sc_list_scope_tuple_t) call_sugar_macro(
+    sc_syntax_wildcard_func_t f, const List *topexpr, const Scope *env) {
+    SCOPES_RESULT_TYPE(sc_list_scope_tuple_t);
+    bool pure = pure_sugar_macros.count((const void *)f);
+    SugarMemoKey key((const void *)f, topexpr, env);
+    if (pure) {
+        auto it = sugar_memo.find(key);
+        if (it != sugar_memo.end())
+            return it->second;
+    }
+    auto ok_result = f(topexpr, env);
+    if (!ok_result.ok) {
+        SCOPES_RETURN_ERROR(ok_result.except);
+    }
+    if (pure) {
+        if (sugar_memo.size() >= SCOPES_MAX_SUGAR_MEMO) {
+            sugar_memo.clear();
+        }
+        sugar_memo.insert({key, ok_result._0});
+    }
+    return ok_result._0;
+}
+
 //------------------------------------------------------------------------------
 
 static Symbol try_extract_symbol(const ValueRef &node) {
@@ -188,7 +237,7 @@ struct Expander {
             auto sym = SCOPES_GET_RESULT(extract_symbol_constant(it->at));
             // named self-binding
             // see if we can find a forward declaration in the local scope
-            if (env->lookup_local(ConstInt::symbol_from(sym), result)
+            if (env->lookup_local(sym, result)
                 && result.isa<Template>()
                 && result.cast<Template>()->is_forward_decl()) {
                 func = result.cast<Template>();
@@ -1117,7 +1166,7 @@ struct Expander {
         SCOPES_RESULT_TYPE(sc_list_scope_tuple_t);
         ValueRef symbol_handler_node;
         const String *doc;
-        if (env->lookup(ConstInt::symbol_from(SYM_SymbolWildcard), symbol_handler_node, doc)) {
+        if (env->lookup(Symbol(SYM_SymbolWildcard), symbol_handler_node, doc)) {
             auto T = try_get_const_type(symbol_handler_node);
             if (T != list_expander_func_type) {
                 SCOPES_TRACE_HOOK(symbol_handler_node);
@@ -1226,7 +1275,7 @@ struct Expander {
 
             ValueRef list_handler_node;
             const String *doc;
-            if (env->lookup(ConstInt::symbol_from(Symbol(SYM_ListWildcard)), list_handler_node, doc)) {
+            if (env->lookup(Symbol(SYM_ListWildcard), list_handler_node, doc)) {
                 auto T = try_get_const_type(list_handler_node);
                 if (T != list_expander_func_type) {
                     SCOPES_TRACE_HOOK(list_handler_node);
@@ -1327,6 +1376,8 @@ SCOPES_RESULT(TemplateRef) expand_module(const Anchor *anchor, const List *expr,
     StyledString ss = StyledString::plain();
     ss.out << anchor->path.name()->data << ":" << anchor->lineno;
     TemplateRef mainfunc = ref(anchor, Template::from(Symbol(ss.str())));
+    TraceScope expand_trace("expand",
+        [&]() { return "expand_module " + std::string(mainfunc->name.name()->data); });
 
     const Scope *subenv = scope?scope:sc_get_globals();
     const String *doc = nullptr;
@@ -1351,6 +1402,8 @@ SCOPES_RESULT(TemplateRef) expand_module_stage(const Anchor *anchor, const List
     StyledString ss = StyledString::plain();
     ss.out << anchor->path.name()->data << ":" << anchor->lineno;
     TemplateRef mainfunc = ref(anchor, Template::from(Symbol(ss.str())));
+    TraceScope expand_trace("expand",
+        [&]() { return "expand_module " + std::string(mainfunc->name.name()->data); });
 
     const Scope *subenv = scope?scope:sc_get_globals();
     subenv = Scope::from(nullptr, subenv);
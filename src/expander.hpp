@@ -25,6 +25,10 @@ SCOPES_RESULT(TemplateRef) expand_module(const Anchor *anchor, const List *expr,
 SCOPES_RESULT(TemplateRef) expand_module_stage(const Anchor *anchor, const List *expr, const Scope *scope = nullptr);
 SCOPES_RESULT(TemplateRef) expand_inline(const Anchor *anchor, const TemplateRef &astscope, const List *expr, const Scope *scope = nullptr);
 
+void set_sugar_macro_pure(sc_syntax_wildcard_func_t f);
+SCOPES_RESULT(sc_list_scope_tuple_t) call_sugar_macro(
+    sc_syntax_wildcard_func_t f, const List *topexpr, const Scope *env);
+
 } // namespace scopes
 
 #endif // SCOPES_EXPANDER_HPP
\ No newline at end of file
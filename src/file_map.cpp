@@ -0,0 +1,140 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifdef SCOPES_WIN32
+#include "mman.h"
+#include <io.h>
+#include <sys/stat.h>
+
+#define OPEN_FD _open
+#define CLOSE_FD _close
+#define O_RDONLY _O_RDONLY
+#define O_RDWR _O_RDWR
+#define O_CREAT _O_CREAT
+#define LSEEK _lseeki64
+#define TRUNCATE_FD _chsize_s
+#define CREATE_MODE (_S_IREAD | _S_IWRITE)
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define OPEN_FD open
+#define CLOSE_FD close
+#define LSEEK lseek
+#define TRUNCATE_FD ftruncate
+#define CREATE_MODE 0644
+#endif
+
+#include "file_map.hpp"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// FILE MAP
+//------------------------------------------------------------------------------
+
+FileMap *FileMap::open(const char *path, bool writable, int64_t size) {
+    int flags = writable?O_RDWR:O_RDONLY;
+    if (writable && (size >= 0))
+        flags |= O_CREAT;
+    int fd = ::OPEN_FD(path, flags, CREATE_MODE);
+    if (fd < 0)
+        return nullptr;
+    if (size >= 0) {
+        if (!writable || (TRUNCATE_FD(fd, size) != 0)) {
+            int err = writable?errno:EINVAL;
+            ::CLOSE_FD(fd);
+            errno = err;
+            return nullptr;
+        }
+    } else {
+        size = LSEEK(fd, 0, SEEK_END);
+        if (size < 0) {
+            int err = errno;
+            ::CLOSE_FD(fd);
+            errno = err;
+            return nullptr;
+        }
+    }
+    void *ptr = nullptr;
+    // empty files can't be mapped, and don't need to be
+    if (size > 0) {
+        ptr = mmap(nullptr, (size_t)size,
+            writable?(PROT_READ | PROT_WRITE):PROT_READ,
+            writable?MAP_SHARED:MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            int err = errno;
+            ::CLOSE_FD(fd);
+            errno = err;
+            return nullptr;
+        }
+    }
+    auto map = new FileMap();
+    map->fd = fd;
+    map->writable = writable;
+    map->size = (uint64_t)size;
+    map->ptr = ptr;
+    return map;
+}
+
+// ranges are widened to whole pages, as the system calls require
+static bool page_range(const FileMap *map, uint64_t offset, uint64_t count,
+    void *&start, size_t &length) {
+    if (!map->ptr || (offset >= map->size))
+        return false;
+    count = (count > (map->size - offset))?(map->size - offset):count;
+#ifdef SCOPES_WIN32
+    const uint64_t page = 4096;
+#else
+    const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+    uint64_t begin = offset & ~(page - 1);
+    start = (char *)map->ptr + begin;
+    length = (size_t)(offset + count - begin);
+    return true;
+}
+
+int FileMap::advise(uint64_t offset, uint64_t count, FileMapAdvice advice) {
+#ifdef SCOPES_WIN32
+    return 0;
+#else
+    void *start;
+    size_t length;
+    if (!page_range(this, offset, count, start, length))
+        return 0;
+    int flag = MADV_NORMAL;
+    switch(advice) {
+    case FILE_MAP_NORMAL: flag = MADV_NORMAL; break;
+    case FILE_MAP_SEQUENTIAL: flag = MADV_SEQUENTIAL; break;
+    case FILE_MAP_RANDOM: flag = MADV_RANDOM; break;
+    case FILE_MAP_WILLNEED: flag = MADV_WILLNEED; break;
+    case FILE_MAP_DONTNEED: flag = MADV_DONTNEED; break;
+    default: errno = EINVAL; return -1;
+    }
+    return madvise(start, length, flag);
+#endif
+}
+
+int FileMap::sync(uint64_t offset, uint64_t count) {
+    void *start;
+    size_t length;
+    if (!writable || !page_range(this, offset, count, start, length))
+        return 0;
+    return msync(start, length, MS_SYNC);
+}
+
+FileMap::~FileMap() {
+    if (ptr) {
+        munmap(ptr, (size_t)size);
+    }
+    ::CLOSE_FD(fd);
+}
+
+} // namespace scopes
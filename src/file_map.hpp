@@ -0,0 +1,51 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_FILE_MAP_HPP
+#define SCOPES_FILE_MAP_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// FILE MAP
+//------------------------------------------------------------------------------
+
+enum FileMapAdvice {
+    FILE_MAP_NORMAL = 0,
+    FILE_MAP_SEQUENTIAL = 1,
+    FILE_MAP_RANDOM = 2,
+    FILE_MAP_WILLNEED = 3,
+    FILE_MAP_DONTNEED = 4,
+};
+
+// a file mapped into memory as a whole; writable maps are shared with the
+// file, so that writes go back to it
+struct FileMap {
+    int fd;
+    bool writable;
+    uint64_t size;
+    void *ptr;
+
+    // maps the file at path; when size is not negative, the file is resized
+    // to size bytes first, and created if it is writable. returns null and
+    // sets errno on failure.
+    static FileMap *open(const char *path, bool writable, int64_t size);
+
+    // hints at how the range will be accessed; does nothing where the
+    // system has no such hints
+    int advise(uint64_t offset, uint64_t count, FileMapAdvice advice);
+    // writes changes of the range back to the file
+    int sync(uint64_t offset, uint64_t count);
+
+    ~FileMap();
+};
+
+} // namespace scopes
+
+#endif // SCOPES_FILE_MAP_HPP
@@ -9,15 +9,48 @@
 #include "scopes/config.h"
 
 #include <algorithm>
-#include <map>
+#include <vector>
+#include <mutex>
+
+#include "absl/container/flat_hash_map.h"
+
+#define SCOPES_TRACK_PAGE_SHIFT 12
 
 namespace scopes {
 
-// for allocated pointers, register the size of the range
-static std::map<void *, size_t> tracked_allocations;
+struct TrackedRange {
+    uintptr_t start;
+    size_t size;
+};
+
+// tracked allocations never overlap, so for any address within a page, the
+// allocation it belongs to is either the last one starting before it in the
+// same page, or the one reaching into the page from below it.
+struct TrackedPage {
+    TrackedRange carry = { 0, 0 };
+    std::vector<TrackedRange> starts;
+};
+
+// for allocated pointers, register the size of the range, indexed by page
+static absl::flat_hash_map<uintptr_t, TrackedPage> tracked_pages;
+static std::mutex tracked_pages_mutex;
 
 void track(void *ptr, size_t size) {
-    tracked_allocations.insert({ptr,size});
+    if (!size)
+        return;
+    TrackedRange range = { (uintptr_t)ptr, size };
+    auto first = range.start >> SCOPES_TRACK_PAGE_SHIFT;
+    auto last = (range.start + size - 1) >> SCOPES_TRACK_PAGE_SHIFT;
+    std::lock_guard<std::mutex> lock(tracked_pages_mutex);
+    auto &starts = tracked_pages[first].starts;
+    auto it = std::lower_bound(starts.begin(), starts.end(), range.start,
+        [](const TrackedRange &r, uintptr_t start) { return r.start < start; });
+    if ((it != starts.end()) && (it->start == range.start))
+        return;
+    starts.insert(it, range);
+    for (auto page = first + 1; page <= last; ++page) {
+        tracked_pages[page].carry = range;
+    }
 }
 
 void *tracked_malloc(size_t size) {
@@ -27,13 +60,23 @@ void *tracked_malloc(size_t size) {
 }
 
 bool find_allocation(void *srcptr,  void *&start, size_t &size) {
-    auto it = tracked_allocations.upper_bound(srcptr);
-    if (it == tracked_allocations.begin())
+    auto addr = (uintptr_t)srcptr;
+    std::lock_guard<std::mutex> lock(tracked_pages_mutex);
+    auto pit = tracked_pages.find(addr >> SCOPES_TRACK_PAGE_SHIFT);
+    if (pit == tracked_pages.end())
+        return false;
+    auto &page = pit->second;
+    auto it = std::upper_bound(page.starts.begin(), page.starts.end(), addr,
+        [](uintptr_t addr, const TrackedRange &r) { return addr < r.start; });
+    const TrackedRange *range = &page.carry;
+    if (it != page.starts.begin()) {
+        range = &*(it - 1);
+    } else if (!range->size) {
         return false;
-    it--;
-    start = it->first;
-    size = it->second;
-    return (srcptr >= start)&&((uint8_t*)srcptr < ((uint8_t*)start + size));
+    }
+    start = (void *)range->start;
+    size = range->size;
+    return (addr - range->start) < range->size;
 }
 
-} // namespace scopes
\ No newline at end of file
+} // namespace scopes
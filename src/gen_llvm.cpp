@@ -14,12 +14,16 @@
 #include "gc.hpp"
 #include "scope.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
 #include "value.hpp"
 #include "stream_expr.hpp"
 #include "compiler_flags.hpp"
 #include "prover.hpp"
 #include "hash.hpp"
+#include "cache.hpp"
+#include "module_digest.hpp"
 #include "qualifiers.hpp"
+#include "list.hpp"
 #include "qualifier.inc"
 #include "verify_tools.inc"
 
@@ -32,7 +36,13 @@
 #include <libgen.h>
 #endif
 
+#include <errno.h>
+#include <string.h>
 #include <deque>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_set>
 
 // cleaner template specialization
 #include <type_traits>
@@ -47,16 +57,23 @@
 #include <llvm-c/DebugInfo.h>
 
 #include "llvm/IR/Module.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/CFG.h"
 //#include "llvm/IR/DebugInfoMetadata.h"
 //#include "llvm/IR/DIBuilder.h"
 //#include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 //#include "llvm/Support/Timer.h"
 //#include "llvm/Support/raw_os_ostream.h"
 
 #include "dyn_cast.inc"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 
 #pragma GCC diagnostic ignored "-Wvla-extension"
 
@@ -86,21 +103,34 @@ LLVMAttributeRef LLVMCreateTypeAttribute(LLVMContextRef C, unsigned KindID,
 const double deg2rad = 0.017453292519943295;
 const double rad2deg = 57.29577951308232;
 
+// switches with fewer cases are left to the backend
+const size_t SwitchTableMinCases = 4;
+// the largest jump table or hash table built for a switch
+const uint64_t SwitchTableMaxSize = 1 << 12;
+// the number of multipliers tried per hash table size
+const int SwitchHashAttempts = 64;
+
+// names the pointers that modules refer to by symbol. ids are derived from
+// keys that are the same in every process, so that a module compiled again
+// is named the same and hits the cache; pointers that share a key are told
+// apart by the order in which they are first named.
 struct PointerNamespace {
 
-    size_t name = 0;
-    size_t next_pointer_id = 1;
     char kind = '?';
     absl::flat_hash_map<const void *, std::string> ptr2id;
+    absl::flat_hash_map<uint64_t, size_t> key2count;
 
-    std::string get_pointer_id(const void *ptr) {
+    std::string get_pointer_id(const void *ptr, uint64_t key) {
         auto it = ptr2id.find(ptr);
         if (it != ptr2id.end()) {
             return it->second;
         }
-        auto id = next_pointer_id++;
+        auto index = key2count[key]++;
         StyledString ss = StyledString::plain();
-        ss.out << "$" << kind << std::hex << name << "_" << id << std::dec;
+        ss.out << "$" << kind << std::hex << key;
+        if (index)
+            ss.out << "_" << index;
+        ss.out << std::dec;
         auto result = ss.cppstr();
         ptr2id.insert({ptr, result});
         return result;
@@ -108,17 +138,51 @@ struct PointerNamespace {
 };
 
 struct PointerNamespaces {
+    PointerNamespaces() {
+        local.kind = 'l';
+        global.kind = 'g';
+        func.kind = 'f';
+    }
+
     PointerNamespace local;
     PointerNamespace global;
     PointerNamespace func;
 };
 
+static uint64_t stable_anchor_key(const Anchor *anchor) {
+    if (!anchor)
+        return 0;
+    return hash2(hash2(anchor->path.hash(), anchor->lineno),
+        hash2(anchor->column, anchor->offset));
+}
+
+// a key for the object at ptr that doesn't depend on its address, or 0
+static uint64_t stable_pointer_key(const Type *T, const void *ptr) {
+    if (T == TYPE_String) {
+        auto str = (const String *)ptr;
+        return hash2(1, str->hash());
+    } else if (T == TYPE_Anchor) {
+        return hash2(2, stable_anchor_key((const Anchor *)ptr));
+    } else if (T == TYPE_Type) {
+        StyledString ss = StyledString::plain();
+        stream_type_name(ss.out, (const Type *)ptr);
+        auto name = ss.cppstr();
+        return hash2(3, hash_bytes(name.data(), name.size()));
+    } else if (T == TYPE_List) {
+        // quoted lists are identified by where they begin in the source
+        auto l = (const List *)ptr;
+        return hash2(4, hash2(List::count(l), stable_anchor_key(l->at.anchor())));
+    }
+    return 0;
+}
+
 struct LLVMIRGenerator {
     enum PMIntrinsic {
         llvm_bitreverse,
         llvm_ctpop,
         llvm_ctlz,
         llvm_cttz,
+        llvm_expect,
     };
 
     enum Intrinsic {
@@ -144,13 +208,8 @@ struct LLVMIRGenerator {
         llvm_exp2_f64,
         llvm_log2_f32,
         llvm_log2_f64,
-
-        custom_fsign_f32,
-        custom_fsign_f64,
-        custom_radians_f32,
-        custom_radians_f64,
-        custom_degrees_f32,
-        custom_degrees_f64,
+        llvm_assume,
+        llvm_prefetch,
 
         libc_tan_f32,
         libc_tan_f64,
@@ -215,8 +274,15 @@ struct LLVMIRGenerator {
     absl::flat_hash_map<Symbol, LLVMMetadataRef, Symbol::Hash> file2value;
     absl::flat_hash_map<void *, LLVMValueRef> ptr2global;
     absl::flat_hash_map<ValueIndex, LLVMValueRef, ValueIndex::Hash> ref2value;
+    // first values of the function being generated, by value id
+    std::vector<LLVMValueRef> function_values;
     absl::flat_hash_map<Function *, LLVMMetadataRef> func2md;
     absl::flat_hash_map<Function *, Symbol> func_export_table;
+    // when a scope is compiled in chunks, the exports of other chunks are
+    // only declared, and every global is defined by the first chunk using it
+    bool chunked = false;
+    absl::flat_hash_set<Function *> chunk_exports;
+    absl::flat_hash_set<Global *> *defined_globals = nullptr;
     absl::flat_hash_map<Global *, LLVMValueRef> global2global;
     std::vector<LLVMValueRef> constructors;
     LLVMValueRef constructor_function = nullptr;
@@ -224,35 +290,13 @@ struct LLVMIRGenerator {
     static Types type_todo;
     static absl::flat_hash_map<const Type *, LLVMTypeRef> type_cache;
     static absl::flat_hash_map<Function *, std::string> func_cache;
+    // addresses of the functions that the JIT has compiled, which modules
+    // that aren't cached call directly instead of declaring them
+    static absl::flat_hash_map<Function *, void *> func_addresses;
     static absl::flat_hash_map<Global *, std::string> global_cache;
 
-    static absl::flat_hash_map<size_t, PointerNamespaces *> pointer_namespaces;
-
-    PointerNamespaces *_ns;
-
-    void set_pointer_namespace(size_t name) {
-        _ns = get_pointer_namespaces(name);
-    }
-
-    static PointerNamespaces *get_pointer_namespaces(size_t name) {
-    repeat:
-        auto it = pointer_namespaces.find(name);
-        if (it != pointer_namespaces.end()) {
-            if (!name) return it->second;
-            //printf("namespace taken, retrying...\n");
-            name = hash2(name, name);
-            goto repeat;
-        }
-        PointerNamespaces *ns = new PointerNamespaces();
-        ns->local.name = name;
-        ns->local.kind = 'l';
-        ns->global.name = name;
-        ns->global.kind = 'g';
-        ns->func.name = name;
-        ns->func.kind = 'f';
-        pointer_namespaces.insert({name, ns});
-        return ns;
-    }
+    // shared by all modules, so that every id names one pointer
+    static PointerNamespaces pointer_namespaces;
 
     LLVMModuleRef module;
     LLVMBuilderRef builder;
@@ -268,6 +312,7 @@ struct LLVMIRGenerator {
     static LLVMTypeRef i128T;
     static LLVMTypeRef f32T;
     static LLVMTypeRef f32x2T;
+    static LLVMTypeRef f32x4T;
     static LLVMTypeRef f32x2AT;
     static LLVMTypeRef f32x3AT;
     static LLVMTypeRef f32x4AT;
@@ -285,6 +330,9 @@ struct LLVMIRGenerator {
     static LLVMAttributeRef attr_nonnull;
     static unsigned attr_kind_sret;
     static unsigned attr_kind_byval;
+    static unsigned attr_kind_noalias;
+    static unsigned attr_kind_dereferenceable;
+    static unsigned attr_kind_align;
     LLVMValueRef intrinsics[NumIntrinsics];
 
     // polymorphic intrinsics
@@ -298,6 +346,8 @@ struct LLVMIRGenerator {
     };
 
     absl::flat_hash_map< PMIntrinsicKey, LLVMValueRef, HashPMIntrinsicKey > pm_intrinsics;
+    // overloaded intrinsics and vector math functions, by name
+    absl::flat_hash_map< std::string, LLVMValueRef > vector_functions;
 
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
     LLVMMetadataRef debug_voidT;
@@ -321,26 +371,39 @@ struct LLVMIRGenerator {
 #endif
 
     bool use_debug_info = true;
+    // only emit line tables and subprograms, no debug types or variables
+    bool line_tables_only = false;
     bool generate_object = false;
     bool serialize_pointers = false;
+    bool verify_module = true;
+    // dispatch switches with many cases through tables; the jit target
+    // machine doesn't optimize, and would compare every case in turn
+    bool lower_switches = false;
+    // the entry and exported functions must have register-only C signatures
+    bool c_abi = false;
     FunctionRef active_function;
+    // the local that the active function returns from every exit; it lives
+    // in the caller's sret slot instead of the callee's frame
+    AllocaRef return_slot;
     FunctionRef entry_function;
     std::vector<LLVMValueRef> generated_symbols;
+    // the function that every generated symbol was generated for
+    std::vector<Function *> generated_functions;
 
     PointerMap pointer_map;
 
-    std::string get_local_pointer_id(const void *ptr) {
-        assert(_ns);
-        return _ns->local.get_pointer_id(ptr);
+    std::string get_local_pointer_id(const ConstPointerRef &node) {
+        return pointer_namespaces.local.get_pointer_id(node->value,
+            stable_pointer_key(node->get_type(), node->value));
     }
 
-    std::string get_global_pointer_id(const void *ptr) {
-        assert(_ns);
-        return _ns->global.get_pointer_id(ptr);
+    std::string get_global_pointer_id(const GlobalRef &node) {
+        return pointer_namespaces.global.get_pointer_id(node.unref(),
+            stable_anchor_key(node.anchor()));
     }
-    std::string get_func_pointer_id(const void *ptr) {
-        assert(_ns);
-        return _ns->func.get_pointer_id(ptr);
+    std::string get_func_pointer_id(const FunctionRef &node) {
+        return pointer_namespaces.func.get_pointer_id(node.unref(),
+            stable_anchor_key(node.anchor()));
     }
 
     static const Type *arguments_to_tuple(const Type *T) {
@@ -391,6 +454,8 @@ struct LLVMIRGenerator {
         LoopLabelRef loop;
         LLVMBasicBlockRef bb_loop;
         LLVMValueRefs repeat_values;
+        // the branches of every repeat
+        LLVMValueRefs back_edges;
 
         LoopInfo() :
             bb_loop(nullptr)
@@ -518,6 +583,7 @@ struct LLVMIRGenerator {
         LLVM_PM_INTRINSIC(ctpop, 1)
         LLVM_PM_INTRINSIC(ctlz, 2)
         LLVM_PM_INTRINSIC(cttz, 2)
+        LLVM_PM_INTRINSIC(expect, 2)
 #undef LLVM_PM_INTRINSIC
         default: assert(false); break;
         }
@@ -533,13 +599,135 @@ struct LLVMIRGenerator {
             int width = LLVMGetIntTypeWidth(T);
             snprintf(strname, 255, "llvm.%s.i%i", prefix, width);
         }
-        LLVMTypeRef argtypes[] = { T, i1T };
+        LLVMTypeRef argtypes[] = { T, (op == llvm_expect)?T:i1T };
         LLVMValueRef result = LLVMAddFunction(module, strname,
             LLVMFunctionType(T, argtypes, argcount, false));
         pm_intrinsics.insert({key, result});
         return result;
     }
 
+    // the name of the overloaded LLVM intrinsic, for those that lower to
+    // instructions on vector registers
+    static const char *vector_intrinsic_name(Intrinsic op) {
+        switch(op) {
+#define T(NAME) case llvm_ ## NAME ## _f32: case llvm_ ## NAME ## _f64: return "llvm." #NAME;
+        T(sqrt) T(fabs) T(trunc) T(floor)
+#undef T
+        default: return nullptr;
+        }
+    }
+
+    // the name of the libm function that the intrinsic ends up calling
+    static const char *math_function_name(Intrinsic op) {
+        switch(op) {
+#define T(NAME) case llvm_ ## NAME ## _f32: case llvm_ ## NAME ## _f64: return #NAME;
+        T(sin) T(cos) T(pow) T(exp) T(log) T(exp2) T(log2)
+#undef T
+#define T(NAME) case libc_ ## NAME ## _f32: case libc_ ## NAME ## _f64: return #NAME;
+        T(tan) T(asin) T(acos) T(atan) T(atan2) T(sinh) T(cosh) T(tanh)
+        T(asinh) T(acosh) T(atanh)
+#undef T
+        default: return nullptr;
+        }
+    }
+
+    LLVMValueRef get_vector_function(const char *name, LLVMTypeRef T, int argcount) {
+        auto it = vector_functions.find(name);
+        if (it != vector_functions.end())
+            return it->second;
+        LLVMTypeRef argtypes[] = { T, T };
+        LLVMValueRef result = LLVMAddFunction(module, name,
+            LLVMFunctionType(T, argtypes, argcount, false));
+        vector_functions.insert({name, result});
+        return result;
+    }
+
+    // returns the number of lanes of the vector math variant of op that
+    // the runtime provides and writes its name, or 0 if there is none;
+    // objects are linked elsewhere and only get scalar calls
+    unsigned get_vector_math_variant(Intrinsic op, LLVMTypeRef ET, int argcount,
+        char *name, size_t size) {
+#if SCOPES_USE_LIBMVEC
+        if (generate_object)
+            return 0;
+        const char *libm = math_function_name(op);
+        if (!libm)
+            return 0;
+        // the 128-bit variants, which every x86-64 cpu supports
+        unsigned width = (ET == f64T)?2:4;
+        snprintf(name, size, "_ZGVbN%u%s_%s%s", width, (argcount == 2)?"vv":"v",
+            libm, (ET == f64T)?"":"f");
+        if (!has_vector_math_function(name))
+            return 0;
+        return width;
+#else
+        return 0;
+#endif
+    }
+
+    // calls op with one or two arguments, lane by lane for vectors
+    LLVMValueRef build_intrinsic_call(Intrinsic op, LLVMValueRef *args, int argcount) {
+        auto T = LLVMTypeOf(args[0]);
+        if (LLVMGetTypeKind(T) != LLVMVectorTypeKind) {
+            LLVMValueRef func = get_intrinsic(op);
+            assert(func);
+            return LLVMBuildCall(builder, func, args, argcount, "");
+        }
+        unsigned count = LLVMGetVectorSize(T);
+        auto ET = LLVMGetElementType(T);
+        char name[64];
+        const char *intrinsic = vector_intrinsic_name(op);
+        if (intrinsic) {
+            snprintf(name, sizeof(name), "%s.v%u%s", intrinsic, count,
+                (ET == f64T)?"f64":"f32");
+            return LLVMBuildCall(builder,
+                get_vector_function(name, T, argcount), args, argcount, "");
+        }
+        unsigned width = get_vector_math_variant(op, ET, argcount, name, sizeof(name));
+        if (width) {
+            LLVMValueRef func = get_vector_function(name,
+                LLVMVectorType(ET, width), argcount);
+            if (count == width)
+                return LLVMBuildCall(builder, func, args, argcount, "");
+            // split into chunks of the width of the variant, the last one
+            // padded with undefined lanes
+            LLVMValueRef retvalue = LLVMGetUndef(T);
+            for (unsigned offset = 0; offset < count; offset += width) {
+                LLVMValueRef mask[width];
+                for (unsigned i = 0; i < width; ++i) {
+                    mask[i] = ((offset + i) < count)?
+                        LLVMConstInt(i32T, offset + i, false):LLVMGetUndef(i32T);
+                }
+                LLVMValueRef chunkargs[2];
+                for (int k = 0; k < argcount; ++k) {
+                    chunkargs[k] = LLVMBuildShuffleVector(builder, args[k],
+                        LLVMGetUndef(T), LLVMConstVector(mask, width), "");
+                }
+                LLVMValueRef chunk = LLVMBuildCall(builder, func, chunkargs, argcount, "");
+                for (unsigned i = 0; (i < width) && ((offset + i) < count); ++i) {
+                    LLVMValueRef eltval = LLVMBuildExtractElement(builder, chunk,
+                        LLVMConstInt(i32T, i, false), "");
+                    retvalue = LLVMBuildInsertElement(builder, retvalue, eltval,
+                        LLVMConstInt(i32T, offset + i, false), "");
+                }
+            }
+            return retvalue;
+        }
+        LLVMValueRef func = get_intrinsic(op);
+        assert(func);
+        LLVMValueRef retvalue = LLVMGetUndef(T);
+        for (unsigned i = 0; i < count; ++i) {
+            LLVMValueRef idx = LLVMConstInt(i32T, i, false);
+            LLVMValueRef values[2];
+            for (int k = 0; k < argcount; ++k) {
+                values[k] = LLVMBuildExtractElement(builder, args[k], idx, "");
+            }
+            LLVMValueRef eltval = LLVMBuildCall(builder, func, values, argcount, "");
+            retvalue = LLVMBuildInsertElement(builder, retvalue, eltval, idx, "");
+        }
+        return retvalue;
+    }
+
     LLVMValueRef get_intrinsic(Intrinsic op) {
         if (!intrinsics[op]) {
             LLVMValueRef result = nullptr;
@@ -550,20 +738,6 @@ struct LLVMIRGenerator {
         result = LLVMAddFunction(module, STRNAME, LLVMFunctionType(RETTYPE, argtypes, sizeof(argtypes) / sizeof(LLVMTypeRef), false)); \
     } break;
 
-#define LLVM_INTRINSIC_IMPL_BEGIN(ENUMVAL, RETTYPE, STRNAME, ...) \
-    case ENUMVAL: { \
-        LLVMTypeRef argtypes[] = { __VA_ARGS__ }; \
-        result = LLVMAddFunction(module, STRNAME, \
-            LLVMFunctionType(f32T, argtypes, sizeof(argtypes) / sizeof(LLVMTypeRef), false)); \
-        LLVMSetLinkage(result, LLVMPrivateLinkage); \
-        auto bb = LLVMAppendBasicBlock(result, ""); \
-        auto oldbb = LLVMGetInsertBlock(builder); \
-        position_builder_at_end(bb);
-
-#define LLVM_INTRINSIC_IMPL_END() \
-        position_builder_at_end(oldbb); \
-    } break;
-
             LLVM_INTRINSIC_IMPL(llvm_sin_f32, f32T, "llvm.sin.f32", f32T)
             LLVM_INTRINSIC_IMPL(llvm_sin_f64, f64T, "llvm.sin.f64", f64T)
             LLVM_INTRINSIC_IMPL(llvm_cos_f32, f32T, "llvm.cos.f32", f32T)
@@ -587,6 +761,9 @@ struct LLVMIRGenerator {
             LLVM_INTRINSIC_IMPL(llvm_exp2_f64, f64T, "llvm.exp2.f64", f64T)
             LLVM_INTRINSIC_IMPL(llvm_log2_f32, f32T, "llvm.log2.f32", f32T)
             LLVM_INTRINSIC_IMPL(llvm_log2_f64, f64T, "llvm.log2.f64", f64T)
+            LLVM_INTRINSIC_IMPL(llvm_assume, voidT, "llvm.assume", i1T)
+            LLVM_INTRINSIC_IMPL(llvm_prefetch, voidT, "llvm.prefetch.p0i8",
+                rawstringT, i32T, i32T, i32T)
 
             LLVM_INTRINSIC_IMPL(libc_tan_f32, f32T, "tanf", f32T)
             LLVM_INTRINSIC_IMPL(libc_tan_f64, f64T, "tan", f64T)
@@ -611,45 +788,7 @@ struct LLVMIRGenerator {
             LLVM_INTRINSIC_IMPL(libc_atanh_f32, f32T, "atanhf", f32T)
             LLVM_INTRINSIC_IMPL(libc_atanh_f64, f64T, "atanh", f64T)
 
-            LLVM_INTRINSIC_IMPL_BEGIN(custom_fsign_f32, f32T, "custom.fsign.f32", f32T)
-                // (0 < val) - (val < 0)
-                LLVMValueRef val = LLVMGetParam(result, 0);
-                LLVMValueRef zero = LLVMConstReal(f32T, 0.0);
-                LLVMValueRef a = LLVMBuildZExt(builder, LLVMBuildFCmp(builder, LLVMRealOLT, zero, val, ""), i8T, "");
-                LLVMValueRef b = LLVMBuildZExt(builder, LLVMBuildFCmp(builder, LLVMRealOLT, val, zero, ""), i8T, "");
-                val = LLVMBuildSub(builder, a, b, "");
-                val = LLVMBuildSIToFP(builder, val, f32T, "");
-                LLVMBuildRet(builder, val);
-            LLVM_INTRINSIC_IMPL_END()
-            LLVM_INTRINSIC_IMPL_BEGIN(custom_fsign_f64, f64T, "custom.fsign.f64", f64T)
-                // (0 < val) - (val < 0)
-                LLVMValueRef val = LLVMGetParam(result, 0);
-                LLVMValueRef zero = LLVMConstReal(f64T, 0.0);
-                LLVMValueRef a = LLVMBuildZExt(builder, LLVMBuildFCmp(builder, LLVMRealOLT, zero, val, ""), i8T, "");
-                LLVMValueRef b = LLVMBuildZExt(builder, LLVMBuildFCmp(builder, LLVMRealOLT, val, zero, ""), i8T, "");
-                val = LLVMBuildSub(builder, a, b, "");
-                val = LLVMBuildSIToFP(builder, val, f64T, "");
-                LLVMBuildRet(builder, val);
-            LLVM_INTRINSIC_IMPL_END()
-            LLVM_INTRINSIC_IMPL_BEGIN(custom_radians_f32, f32T, "custom.radians.f32", f32T)
-                LLVMBuildRet(builder, LLVMBuildFMul(builder,
-                    LLVMGetParam(result, 0), LLVMConstReal(f32T, deg2rad), ""));
-            LLVM_INTRINSIC_IMPL_END()
-            LLVM_INTRINSIC_IMPL_BEGIN(custom_radians_f64, f64T, "custom.radians.f64", f64T)
-                LLVMBuildRet(builder, LLVMBuildFMul(builder,
-                    LLVMGetParam(result, 0), LLVMConstReal(f64T, deg2rad), ""));
-            LLVM_INTRINSIC_IMPL_END()
-            LLVM_INTRINSIC_IMPL_BEGIN(custom_degrees_f32, f32T, "custom.degrees.f32", f32T)
-                LLVMBuildRet(builder, LLVMBuildFMul(builder,
-                    LLVMGetParam(result, 0), LLVMConstReal(f32T, rad2deg), ""));
-            LLVM_INTRINSIC_IMPL_END()
-            LLVM_INTRINSIC_IMPL_BEGIN(custom_degrees_f64, f64T, "custom.degrees.f64", f64T)
-                LLVMBuildRet(builder, LLVMBuildFMul(builder,
-                    LLVMGetParam(result, 0), LLVMConstReal(f64T, rad2deg), ""));
-            LLVM_INTRINSIC_IMPL_END()
 #undef LLVM_INTRINSIC_IMPL
-#undef LLVM_INTRINSIC_IMPL_BEGIN
-#undef LLVM_INTRINSIC_IMPL_END
             default: assert(false); break;
             }
             intrinsics[op] = result;
@@ -676,6 +815,7 @@ struct LLVMIRGenerator {
         i128T = LLVMInt128Type();
         f32T = LLVMFloatType();
         f32x2T = LLVMVectorType(f32T, 2);
+        f32x4T = LLVMVectorType(f32T, 4);
         f32x2AT = LLVMArrayType(f32T, 2);
         f32x3AT = LLVMArrayType(f32T, 3);
         f32x4AT = LLVMArrayType(f32T, 4);
@@ -693,6 +833,9 @@ struct LLVMIRGenerator {
         attr_nonnull = get_attribute(get_attribute_kind("nonnull"));
         attr_kind_sret = get_attribute_kind("sret");
         attr_kind_byval = get_attribute_kind("byval");
+        attr_kind_noalias = get_attribute_kind("noalias");
+        attr_kind_dereferenceable = get_attribute_kind("dereferenceable");
+        attr_kind_align = get_attribute_kind("align");
 
         LLVMContextSetDiagnosticHandler(LLVMGetGlobalContext(),
             diag_handler,
@@ -709,47 +852,53 @@ struct LLVMIRGenerator {
     static LLVMTypeRef abi_struct_type(const ABIClass *classes, size_t sz) {
         LLVMTypeRef types[sz];
         size_t k = 0;
+        size_t n = 0;
         for (size_t i = 0; i < sz; ++i) {
             ABIClass cls = classes[i];
             switch(cls) {
             case ABI_CLASS_SSE: {
-                types[i] = f32x2T; k++;
+                if (((i + 1) < sz) && (classes[i + 1] == ABI_CLASS_SSEUP)) {
+                    // both words go into a single vector register
+                    types[n] = f32x4T; k += 2; i++;
+                } else {
+                    types[n] = f32x2T; k++;
+                }
             } break;
             case ABI_CLASS_SSESF: {
-                types[i] = f32T; k++;
+                types[n] = f32T; k++;
             } break;
             case ABI_CLASS_SSEDF: {
-                types[i] = f64T; k++;
+                types[n] = f64T; k++;
             } break;
             case ABI_CLASS_FLOATx2: {
-                types[i] = f32x2AT; k++;
+                types[n] = f32x2AT; k++;
             } break;
             case ABI_CLASS_FLOATx3: {
-                types[i] = f32x3AT; k++;
+                types[n] = f32x3AT; k++;
             } break;
             case ABI_CLASS_FLOATx4: {
-                types[i] = f32x4AT; k++;
+                types[n] = f32x4AT; k++;
             } break;
             case ABI_CLASS_DOUBLEx2: {
-                types[i] = f64x2AT; k++;
+                types[n] = f64x2AT; k++;
             } break;
             case ABI_CLASS_INTEGER: {
-                types[i] = i64T; k++;
+                types[n] = i64T; k++;
             } break;
             case ABI_CLASS_INTEGERx2: {
-                types[i] = i64x2AT; k++;
+                types[n] = i64x2AT; k++;
             } break;
             case ABI_CLASS_INTEGERSI: {
-                types[i] = i32T; k++;
+                types[n] = i32T; k++;
             } break;
             case ABI_CLASS_INTEGERSI16: {
-                types[i] = i16T; k++;
+                types[n] = i16T; k++;
             } break;
             case ABI_CLASS_INTEGERSI8: {
-                types[i] = i8T; k++;
+                types[n] = i8T; k++;
             } break;
             case ABI_CLASS_INTEGER128: {
-                types[i] = i128T; k++;
+                types[n] = i128T; k++;
             } break;
             default: {
                 // do nothing
@@ -760,9 +909,94 @@ struct LLVMIRGenerator {
 #endif
             } break;
             }
+            n++;
         }
         if (k != sz) return nullptr;
-        return LLVMStructType(types, sz, false);
+        return LLVMStructType(types, n, false);
+    }
+
+    struct ArgumentABI {
+        // number of classes; zero if passed in memory
+        size_t count;
+        ABIClass classes[MAX_ABI_CLASSES];
+        // argument-sized parts that a struct is passed in, if any; a struct
+        // of parts is passed as separate arguments, an array as a single one
+        LLVMTypeRef parts;
+    };
+
+    // the first scalar or vector of an aggregate
+    static LLVMTypeRef first_member_type(LLVMTypeRef T) {
+        while (true) {
+            switch(LLVMGetTypeKind(T)) {
+            case LLVMStructTypeKind: T = LLVMStructGetTypeAtIndex(T, 0); break;
+            case LLVMArrayTypeKind: T = LLVMGetElementType(T); break;
+            default: return T;
+            }
+        }
+    }
+
+    static absl::flat_hash_map<const Type *, ArgumentABI> argument_abi_cache;
+
+    // T is the LLVM type of AT
+    static ArgumentABI argument_abi(const Type *AT, LLVMTypeRef T) {
+        auto it = argument_abi_cache.find(AT);
+        if (it != argument_abi_cache.end())
+            return it->second;
+        ArgumentABI abi;
+        abi.count = abi_classify(AT, abi.classes);
+        abi.parts = nullptr;
+        if (abi.count && (LLVMGetTypeKind(T) == LLVMStructTypeKind)) {
+            if (abi.classes[0] == ABI_CLASS_VECTOR) {
+                // the backend assigns the vectors of an array to consecutive
+                // vector registers, or the whole array to the stack
+                abi.parts = LLVMArrayType(first_member_type(T), abi.count);
+            } else {
+                abi.parts = abi_struct_type(abi.classes, abi.count);
+            }
+        }
+        argument_abi_cache.insert({AT, abi});
+        return abi;
+    }
+
+    struct FunctionABI {
+        // what the function returns at the ABI level
+        const Type *rtype;
+        // if set, the result is returned through a pointer in the first
+        // argument
+        bool use_sret;
+    };
+
+    static absl::flat_hash_map<const FunctionType *, FunctionABI> function_abi_cache;
+
+    // computed once per function type rather than at every call site
+    static FunctionABI function_abi(const FunctionType *fi) {
+        auto it = function_abi_cache.find(fi);
+        if (it != function_abi_cache.end())
+            return it->second;
+        FunctionABI abi;
+        abi.rtype = abi_return_type(fi);
+        abi.use_sret = is_memory_class(abi.rtype);
+        function_abi_cache.insert({fi, abi});
+        return abi;
+    }
+
+    // callers from C pass every argument and receive the result in
+    // registers, and see no error flag wrapped around the result
+    static SCOPES_RESULT(void) verify_c_abi(const FunctionType *fi) {
+        SCOPES_RESULT_TYPE(void);
+        if (fi->has_exception()) {
+            SCOPES_ERROR(CGenCABIFunctionRaises, fi);
+        }
+        auto fabi = function_abi(fi);
+        if (fabi.use_sret) {
+            SCOPES_ERROR(CGenCABIPassedInMemory, fabi.rtype);
+        }
+        for (auto AT : fi->argument_types) {
+            if (is_memory_class(AT)) {
+                SCOPES_ERROR(CGenCABIPassedInMemory, AT);
+            }
+        }
+        return {};
     }
 
 //     LLVMMetadataRef abi_struct_debug_type(const ABIClass *classes, size_t sz) {
@@ -826,8 +1060,9 @@ struct LLVMIRGenerator {
 
     SCOPES_RESULT(LLVMValueRef) abi_import_argument(const Type *param_type, LLVMValueRef func, size_t &k) {
         SCOPES_RESULT_TYPE(LLVMValueRef);
-        ABIClass classes[MAX_ABI_CLASSES];
-        size_t sz = abi_classify(param_type, classes);
+        LLVMTypeRef T = SCOPES_GET_RESULT(type_to_llvm_type(param_type));
+        auto abi = argument_abi(param_type, T);
+        size_t sz = abi.count;
         if (!sz) {
             LLVMValueRef val = LLVMGetParam(func, k);
 #if defined(__aarch64__)
@@ -840,21 +1075,24 @@ struct LLVMIRGenerator {
             k++;
             return LLVMBuildLoad(builder, val, "");
         }
-        LLVMTypeRef T = SCOPES_GET_RESULT(type_to_llvm_type(param_type));
-        auto tk = LLVMGetTypeKind(T);
-        if (tk == LLVMStructTypeKind) {
-            auto ST = abi_struct_type(classes, sz);
+        {
+            auto ST = abi.parts;
             if (ST) {
                 // reassemble from argument-sized bits
                 auto ptr = safe_alloca(ST);
-                auto zero = LLVMConstInt(i32T,0,false);
-                for (size_t i = 0; i < sz; ++i) {
-                    LLVMValueRef indices[] = {
-                        zero, LLVMConstInt(i32T,i,false),
-                    };
-                    auto dest = LLVMBuildGEP(builder, ptr, indices, 2, "");
-                    auto param = LLVMGetParam(func, k++);
-                    build_store(param, dest);
+                if (LLVMGetTypeKind(ST) == LLVMStructTypeKind) {
+                    auto zero = LLVMConstInt(i32T,0,false);
+                    size_t count = LLVMCountStructElementTypes(ST);
+                    for (size_t i = 0; i < count; ++i) {
+                        LLVMValueRef indices[] = {
+                            zero, LLVMConstInt(i32T,i,false),
+                        };
+                        auto dest = LLVMBuildGEP(builder, ptr, indices, 2, "");
+                        auto param = LLVMGetParam(func, k++);
+                        build_store(param, dest);
+                    }
+                } else {
+                    build_store(LLVMGetParam(func, k++), ptr);
                 }
                 ptr = LLVMBuildBitCast(builder, ptr, ScopesPointerType(T, 0), "");
                 return LLVMBuildLoad(builder, ptr, "");
@@ -865,11 +1103,40 @@ struct LLVMIRGenerator {
         return val;
     }
 
+    // a reference always points to a live value of its type; a unique
+    // reference is, for as long as the call lasts, the only way to that value
+    SCOPES_RESULT(void) add_reference_attributes(LLVMValueRef func,
+        unsigned index, const Type *param_type) {
+        SCOPES_RESULT_TYPE(void);
+        auto rq = try_qualifier<ReferQualifier>(param_type);
+        if (!rq)
+            return {};
+        auto ET = strip_qualifiers(param_type);
+        if (is_opaque(ET))
+            return {};
+        auto size = SCOPES_GET_RESULT(size_of(ET));
+        if (!size)
+            return {};
+        auto align = SCOPES_GET_RESULT(align_of(ET));
+        LLVMAddAttributeAtIndex(func, index, attr_nonnull);
+        LLVMAddAttributeAtIndex(func, index,
+            get_attribute(attr_kind_dereferenceable, size));
+        LLVMAddAttributeAtIndex(func, index,
+            get_attribute(attr_kind_align, align));
+#if SCOPES_NOALIAS_UNIQUE_REFERENCES
+        if (try_unique(param_type)) {
+            LLVMAddAttributeAtIndex(func, index,
+                get_attribute(attr_kind_noalias));
+        }
+#endif
+        return {};
+    }
+
     SCOPES_RESULT(void) abi_export_argument(LLVMValueRef val, const Type *AT,
         LLVMValueRefs &values, std::vector<size_t> &memptrs) {
         SCOPES_RESULT_TYPE(void);
-        ABIClass classes[MAX_ABI_CLASSES];
-        size_t sz = abi_classify(AT, classes);
+        auto abi = argument_abi(AT, LLVMTypeOf(val));
+        size_t sz = abi.count;
         if (!sz) {
             LLVMValueRef ptrval = safe_alloca(SCOPES_GET_RESULT(type_to_llvm_type(AT)));
             build_store(val, fix_named_struct_store(val, ptrval));
@@ -879,16 +1146,20 @@ struct LLVMIRGenerator {
             values.push_back(val);
             return {};
         }
-        auto tk = LLVMGetTypeKind(LLVMTypeOf(val));
-        if (tk == LLVMStructTypeKind) {
-            auto ST = abi_struct_type(classes, sz);
+        {
+            auto ST = abi.parts;
             if (ST) {
                 // break into argument-sized bits
                 auto ptr = safe_alloca(LLVMTypeOf(val));
-                auto zero = LLVMConstInt(i32T,0,false);
                 build_store(val, ptr);
                 ptr = LLVMBuildBitCast(builder, ptr, ScopesPointerType(ST, 0), "");
-                for (size_t i = 0; i < sz; ++i) {
+                if (LLVMGetTypeKind(ST) != LLVMStructTypeKind) {
+                    values.push_back(LLVMBuildLoad(builder, ptr, ""));
+                    return {};
+                }
+                auto zero = LLVMConstInt(i32T,0,false);
+                size_t count = LLVMCountStructElementTypes(ST);
+                for (size_t i = 0; i < count; ++i) {
                     LLVMValueRef indices[] = {
                         zero, LLVMConstInt(i32T,i,false),
                     };
@@ -908,20 +1179,23 @@ struct LLVMIRGenerator {
     static SCOPES_RESULT(void) abi_transform_parameter(const Type *AT,
         LLVMTypeRefs &params) {
         SCOPES_RESULT_TYPE(void);
-        ABIClass classes[MAX_ABI_CLASSES];
-        size_t sz = abi_classify(AT, classes);
         auto T = SCOPES_GET_RESULT(type_to_llvm_type(AT));
+        auto abi = argument_abi(AT, T);
+        size_t sz = abi.count;
         if (!sz) {
             auto val = ScopesPointerType(T, 0);
             assert(val);
             params.push_back(val);
             return {};
         }
-        auto tk = LLVMGetTypeKind(T);
-        if (tk == LLVMStructTypeKind) {
-            auto ST = abi_struct_type(classes, sz);
-            if (ST) {
-                for (size_t i = 0; i < sz; ++i) {
+        {
+            auto ST = abi.parts;
+            if (ST && (LLVMGetTypeKind(ST) != LLVMStructTypeKind)) {
+                params.push_back(ST);
+                return {};
+            } else if (ST) {
+                size_t count = LLVMCountStructElementTypes(ST);
+                for (size_t i = 0; i < count; ++i) {
                     auto val = LLVMStructGetTypeAtIndex(ST, i);
                     assert(val);
                     params.push_back(val);
@@ -1007,8 +1281,9 @@ struct LLVMIRGenerator {
         case TK_Function: {
             auto fi = cast<FunctionType>(type);
             size_t count = fi->argument_types.size();
-            auto rtype = abi_return_type(fi);
-            bool use_sret = is_memory_class(rtype);
+            auto fabi = function_abi(fi);
+            auto rtype = fabi.rtype;
+            bool use_sret = fabi.use_sret;
 
             LLVMTypeRefs elements;
             elements.reserve(count);
@@ -1018,17 +1293,9 @@ struct LLVMIRGenerator {
                     ScopesPointerType(SCOPES_GET_RESULT(_type_to_llvm_type(rtype)), 0));
                 rettype = voidT;
             } else {
-                ABIClass classes[MAX_ABI_CLASSES];
-                size_t sz = abi_classify(rtype, classes);
                 LLVMTypeRef T = SCOPES_GET_RESULT(_type_to_llvm_type(rtype));
-                rettype = T;
-                if (sz) {
-                    auto tk = LLVMGetTypeKind(T);
-                    if (tk == LLVMStructTypeKind) {
-                        auto ST = abi_struct_type(classes, sz);
-                        if (ST) { rettype = ST; }
-                    }
-                }
+                auto abi = argument_abi(rtype, T);
+                rettype = abi.parts?abi.parts:T;
             }
             for (size_t i = 0; i < count; ++i) {
                 auto AT = fi->argument_types[i];
@@ -1288,14 +1555,21 @@ struct LLVMIRGenerator {
 
     void bind(const ValueIndex &node, LLVMValueRef value) {
         assert(value);
-        ref2value.insert({node, value});
+        int id = node.value->value_id;
+        if ((id >= 0) && !node.index) {
+            assert(id < function_values.size());
+            function_values[id] = value;
+        } else {
+            ref2value.insert({node, value});
+        }
     }
 
     SCOPES_RESULT(LLVMValueRef) write_return(const LLVMValueRefs &values, bool is_except = false) {
         SCOPES_RESULT_TYPE(LLVMValueRef);
         assert(active_function);
         auto fi = extract_function_type(active_function->get_type());
-        auto rtype = abi_return_type(fi);
+        auto fabi = function_abi(fi);
+        auto rtype = fabi.rtype;
         auto abiretT = SCOPES_GET_RESULT(type_to_llvm_type(rtype));
         LLVMValueRef value = nullptr;
         if (fi->has_exception()) {
@@ -1335,7 +1609,7 @@ struct LLVMIRGenerator {
             }
         }
         LLVMValueRef parentfunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-        bool use_sret = is_memory_class(rtype);
+        bool use_sret = fabi.use_sret;
         if (use_sret) {
             auto ptr = LLVMGetParam(parentfunc, 0);
             ptr = fix_named_struct_store(value, ptr);
@@ -1358,8 +1632,43 @@ struct LLVMIRGenerator {
         }
     }
 
+    // the local that every return of the function loads its value from, if
+    // the local can be constructed in place in the sret slot
+    static AllocaRef find_return_slot(const FunctionRef &node) {
+        AllocaRef slot;
+        for (auto _return : node->returns) {
+            if (!_return->block || (_return->values.size() != 1))
+                return AllocaRef();
+            auto load = _return->values[0].dyn_cast<Load>();
+            if (!load || load->is_volatile || load->is_atomic())
+                return AllocaRef();
+            // the local must not change between the load and the return
+            auto &&body = _return->block->body;
+            if (body.empty() || (body.back() != InstructionRef(load)))
+                return AllocaRef();
+            auto alloca = load->value.dyn_cast<Alloca>();
+            if (!alloca || alloca->is_array())
+                return AllocaRef();
+            if (slot && (slot != alloca))
+                return AllocaRef();
+            slot = alloca;
+        }
+        return slot;
+    }
+
+    bool returns_from_slot(const TypedValues &values) {
+        if (!return_slot || (values.size() != 1))
+            return false;
+        auto load = values[0].dyn_cast<Load>();
+        return load && (load->value == TypedValueRef(return_slot));
+    }
+
     SCOPES_RESULT(LLVMValueRef) write_return(const TypedValues &values, bool is_except = false) {
         SCOPES_RESULT_TYPE(LLVMValueRef);
+        if (!is_except && returns_from_slot(values)) {
+            // the value has been constructed in the sret slot already
+            return LLVMBuildRetVoid(builder);
+        }
         LLVMValueRefs refs;
         for (auto val : values) {
             auto newval = SCOPES_GET_RESULT(ref_to_value(val));
@@ -1382,20 +1691,43 @@ struct LLVMIRGenerator {
         return {};
     }
 
+    static llvm::FastMathFlags fast_math_flags(uint32_t flags) {
+        llvm::FastMathFlags fmf;
+        fmf.setAllowReassoc(flags & FMF_Reassoc);
+        fmf.setAllowContract(flags & FMF_Contract);
+        fmf.setAllowReciprocal(flags & FMF_Reciprocal);
+        fmf.setNoNaNs(flags & FMF_NoNaNs);
+        fmf.setNoInfs(flags & FMF_NoInfs);
+        fmf.setNoSignedZeros(flags & FMF_NoSignedZeros);
+        fmf.setApproxFunc(flags & FMF_ApproxFunc);
+        return fmf;
+    }
+
     SCOPES_RESULT(void) Function_finalize(const FunctionRef &node) {
         SCOPES_RESULT_TYPE(void);
 
+        if (node->released) {
+            SCOPES_ERROR(CGenFunctionReleased, node->name);
+        }
         active_function = node;
+        return_slot = AllocaRef();
+        function_values.assign(node->value_count, nullptr);
         auto it = ref2value.find(ValueIndex(node));
         assert(it != ref2value.end());
         LLVMValueRef func = it->second;
         assert(func);
         auto ilfunctype = node->get_type();
         auto fi = extract_function_type(ilfunctype);
-        auto rtype = abi_return_type(fi);
-        bool use_sret = is_memory_class(rtype);
+        auto fabi = function_abi(fi);
+        auto rtype = fabi.rtype;
+        bool use_sret = fabi.use_sret;
         auto bb = LLVMAppendBasicBlock(func, "");
 
+        // IRBuilder tags every floating point instruction and call it
+        // creates with these
+        llvm::unwrap(builder)->setFastMathFlags(
+            fast_math_flags(node->fast_math));
+
         try_info.clear();
 
         if (!node->raises.empty()) {
@@ -1417,7 +1749,12 @@ struct LLVMIRGenerator {
         if (use_sret) {
             LLVMAddAttributeAtIndex(func, 1,
                 get_type_attribute(attr_kind_sret, SCOPES_GET_RESULT(_type_to_llvm_type(rtype))));
+            // callers always return into a temporary of their own
+            LLVMAddAttributeAtIndex(func, 1, get_attribute(attr_kind_noalias));
             offset++;
+            if (!fi->has_exception()) {
+                return_slot = find_return_slot(node);
+            }
             //Parameter *param = params[0];
             //bind(param, LLVMGetParam(func, 0));
         }
@@ -1429,9 +1766,15 @@ struct LLVMIRGenerator {
         size_t k = offset;
         for (size_t i = 0; i < paramcount; ++i) {
             ParameterRef param = params[i];
+            size_t argk = k;
             LLVMValueRef val = SCOPES_GET_RESULT(abi_import_argument(param->get_type(), func, k));
+            if ((k == argk + 1) && (LLVMGetTypeKind(
+                LLVMTypeOf(LLVMGetParam(func, argk))) == LLVMPointerTypeKind)) {
+                SCOPES_CHECK_RESULT(add_reference_attributes(func, argk + 1,
+                    param->get_type()));
+            }
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
-            if (use_debug_info) {
+            if (use_debug_types()) {
                 auto subprogram = LLVMGetSubprogram(func);
                 current_debug_block = subprogram;
                 auto ty = LLVMTypeOf(val);
@@ -1452,8 +1795,9 @@ struct LLVMIRGenerator {
             bind(ValueIndex(param), val);
         }
         SCOPES_CHECK_RESULT(translate_block(node->body));
+        llvm::unwrap(builder)->clearFastMathFlags();
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
-        if (use_debug_info) {
+        if (use_debug_types()) {
             current_debug_block = nullptr;
         }
 #endif
@@ -1496,7 +1840,7 @@ struct LLVMIRGenerator {
                     index++;
                 }
                 ss.out << ">";
-                ss.out << get_func_pointer_id(node.unref());
+                ss.out << get_func_pointer_id(node);
                 name = ss.cppstr();
 
                 func_cache.insert({node.unref(), name});
@@ -1506,15 +1850,32 @@ struct LLVMIRGenerator {
             }
         }
 
+        if (c_abi && (is_export || (node == entry_function))) {
+            SCOPES_CHECK_RESULT(verify_c_abi(ilfunctype));
+        }
+
         auto functype = SCOPES_GET_RESULT(type_to_llvm_type(ilfunctype));
 
+        if (is_external && !serialize_pointers && (node != entry_function)) {
+            auto it = func_addresses.find(node.unref());
+            if (it != func_addresses.end()) {
+                return LLVMConstIntToPtr(
+                    LLVMConstInt(i64T, (uint64_t)it->second, false),
+                    LLVMPointerType(functype, 0));
+            }
+        }
+
         auto func = LLVMAddFunction(module, name.c_str(), functype);
 
         if (is_external)
             return func;
+        if (is_export && chunked && !chunk_exports.count(node.unref()))
+            return func;
 
         assert(func);
         generated_symbols.push_back(func);
+        generated_functions.push_back(node.unref());
+        register_instance_symbol(name, node.unref());
 
         if (use_debug_info) {
             LLVMSetSubprogram(func, function_to_subprogram(node));
@@ -1527,6 +1888,14 @@ struct LLVMIRGenerator {
             LLVMSetLinkage(func, LLVMPrivateLinkage);
             LLVMSetVisibility(func, LLVMHiddenVisibility);
         }
+#if SCOPES_MERGE_FUNCTIONS
+        if (generate_object && !is_export) {
+            // lets mergefunc replace every use of a duplicate, including
+            // uses of its address, and delete it instead of keeping a thunk
+            // that calls the other
+            LLVMSetUnnamedAddress(func, LLVMGlobalUnnamedAddr);
+        }
+#endif
         function_todo.push_back(node);
         return func;
     }
@@ -1550,7 +1919,7 @@ struct LLVMIRGenerator {
         SCOPES_RESULT_TYPE(void);
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
         LLVMMetadataRef parent_block = nullptr;
-        if (use_debug_info) {
+        if (use_debug_types()) {
             parent_block = current_debug_block;
             if (!node.body.empty()) {
                 auto anchor = node.body[0].anchor();
@@ -1566,7 +1935,7 @@ struct LLVMIRGenerator {
             SCOPES_CHECK_RESULT(translate_instruction(node.terminator));
         }
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
-        if (use_debug_info) {
+        if (use_debug_types()) {
             current_debug_block = parent_block;
         }
 #endif
@@ -1633,7 +2002,7 @@ struct LLVMIRGenerator {
     SCOPES_RESULT(void) translate_Repeat(const RepeatRef &node) {
         SCOPES_RESULT_TYPE(void);
         SCOPES_CHECK_RESULT(build_merge_phi(loop_info.repeat_values, node->values));
-        LLVMBuildBr(builder, loop_info.bb_loop);
+        loop_info.back_edges.push_back(LLVMBuildBr(builder, loop_info.bb_loop));
         return {};
     }
 
@@ -1701,6 +2070,7 @@ struct LLVMIRGenerator {
         LLVMValueRef func = LLVMGetBasicBlockParent(bb);
         loop_info.bb_loop = LLVMAppendBasicBlock(func, "loop");
         loop_info.repeat_values.clear();
+        loop_info.back_edges.clear();
         position_builder_at_end(loop_info.bb_loop);
         SCOPES_CHECK_RESULT(build_phi(loop_info.repeat_values, node->args));
         position_builder_at_end(bb);
@@ -1708,10 +2078,112 @@ struct LLVMIRGenerator {
         LLVMBuildBr(builder, loop_info.bb_loop);
         position_builder_at_end(loop_info.bb_loop);
         SCOPES_CHECK_RESULT(translate_block(node->body));
+        build_loop_hints(node->hints);
         loop_info = old_loop_info;
         return {};
     }
 
+    // the blocks of the current loop, which are all blocks that reach one of
+    // its back edges without passing through its header
+    void collect_loop_blocks(std::vector<llvm::BasicBlock *> &blocks) {
+        auto header = llvm::unwrap(loop_info.bb_loop);
+        std::unordered_set<llvm::BasicBlock *> visited = { header };
+        blocks.push_back(header);
+        for (auto edge : loop_info.back_edges) {
+            auto bb = llvm::unwrap<llvm::Instruction>(edge)->getParent();
+            if (visited.insert(bb).second)
+                blocks.push_back(bb);
+        }
+        for (size_t i = 1; i < blocks.size(); ++i) {
+            for (auto pred : llvm::predecessors(blocks[i])) {
+                if (visited.insert(pred).second)
+                    blocks.push_back(pred);
+            }
+        }
+    }
+
+    // adds the access group to every memory access of the current loop,
+    // including the ones already in the groups of nested loops
+    void build_access_group(llvm::MDNode *group) {
+        auto &C = *llvm::unwrap(LLVMGetGlobalContext());
+        std::vector<llvm::BasicBlock *> blocks;
+        collect_loop_blocks(blocks);
+        for (auto bb : blocks) {
+            for (auto &inst : *bb) {
+                if (!inst.mayReadOrWriteMemory())
+                    continue;
+                auto groups = inst.getMetadata(llvm::LLVMContext::MD_access_group);
+                if (!groups) {
+                    groups = group;
+                } else if (!groups->getNumOperands()) {
+                    groups = llvm::MDNode::get(C, { groups, group });
+                } else {
+                    llvm::SmallVector<llvm::Metadata *, 4> ops(
+                        groups->op_begin(), groups->op_end());
+                    ops.push_back(group);
+                    groups = llvm::MDNode::get(C, ops);
+                }
+                inst.setMetadata(llvm::LLVMContext::MD_access_group, groups);
+            }
+        }
+    }
+
+    // attaches the loop-hint annotations of a loop as llvm.loop metadata to
+    // its back edges
+    void build_loop_hints(const LoopHints &hints) {
+        if (loop_info.back_edges.empty())
+            return;
+        auto &C = *llvm::unwrap(LLVMGetGlobalContext());
+        auto i1T = llvm::Type::getInt1Ty(C);
+        auto i32T = llvm::Type::getInt32Ty(C);
+        llvm::SmallVector<llvm::Metadata *, 8> ops;
+        // replaced by the loop id itself
+        ops.push_back(nullptr);
+        auto hint = [&](const char *name, llvm::Metadata *value = nullptr) {
+            llvm::SmallVector<llvm::Metadata *, 2> entry;
+            entry.push_back(llvm::MDString::get(C, name));
+            if (value)
+                entry.push_back(value);
+            ops.push_back(llvm::MDNode::get(C, entry));
+        };
+        auto constant = [&](llvm::Type *T, uint64_t value) {
+            return llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(T, value));
+        };
+        if (hints.vectorize) {
+            hint("llvm.loop.vectorize.enable",
+                constant(i1T, hints.vectorize > 0));
+        }
+        if (hints.vectorize_width) {
+            hint("llvm.loop.vectorize.width",
+                constant(i32T, hints.vectorize_width));
+        }
+        if (hints.interleave_count) {
+            hint("llvm.loop.interleave.count",
+                constant(i32T, hints.interleave_count));
+        }
+        if (hints.unroll < 0) {
+            hint("llvm.loop.unroll.disable");
+        } else if (hints.unroll_count) {
+            hint("llvm.loop.unroll.count",
+                constant(i32T, hints.unroll_count));
+        } else if (hints.unroll > 0) {
+            hint("llvm.loop.unroll.enable");
+        }
+        if (hints.independent) {
+            auto group = llvm::MDNode::getDistinct(C, {});
+            build_access_group(group);
+            hint("llvm.loop.parallel_accesses", group);
+        }
+        if (ops.size() == 1)
+            return;
+        auto loopid = llvm::MDNode::getDistinct(C, ops);
+        loopid->replaceOperandWith(0, loopid);
+        for (auto edge : loop_info.back_edges) {
+            llvm::unwrap<llvm::Instruction>(edge)->setMetadata(
+                llvm::LLVMContext::MD_loop, loopid);
+        }
+    }
+
     LLVMValueRef values_to_struct(LLVMTypeRef T, const LLVMValueRefs &values) {
         int count = (int)values.size();
         if (count == 1) {
@@ -1924,14 +2396,21 @@ struct LLVMIRGenerator {
         SCOPES_RESULT_TYPE(void);
         auto ty = SCOPES_GET_RESULT(type_to_llvm_type(node->type));
         LLVMValueRef val;
-        if (node->is_array()) {
+        if (return_slot && (node == return_slot)) {
+            LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+            val = LLVMGetParam(func, 0);
+            auto ptrT = ScopesPointerType(ty, 0);
+            if (LLVMTypeOf(val) != ptrT) {
+                val = LLVMBuildBitCast(builder, val, ptrT, "");
+            }
+        } else if (node->is_array()) {
             auto count = SCOPES_GET_RESULT(ref_to_value(node->count));
             val = safe_alloca(ty, count);
         } else {
             val = safe_alloca(ty);
         }
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
-        if (use_debug_info) {
+        if (use_debug_types()) {
             LLVMBasicBlockRef bb = LLVMGetInsertBlock(builder);
             LLVMValueRef func = LLVMGetBasicBlockParent(bb);
             auto subprogram = LLVMGetSubprogram(func);
@@ -1970,12 +2449,26 @@ struct LLVMIRGenerator {
         return {};
     }
 
+    static LLVMAtomicOrdering atomic_ordering(MemoryOrder order) {
+        switch(order) {
+        case MemoryOrderRelaxed: return LLVMAtomicOrderingMonotonic;
+        case MemoryOrderAcquire: return LLVMAtomicOrderingAcquire;
+        case MemoryOrderRelease: return LLVMAtomicOrderingRelease;
+        case MemoryOrderAcqRel: return LLVMAtomicOrderingAcquireRelease;
+        case MemoryOrderSeqCst: return LLVMAtomicOrderingSequentiallyConsistent;
+        default: return LLVMAtomicOrderingNotAtomic;
+        }
+    }
+
     SCOPES_RESULT(void) translate_Load(const LoadRef &node) {
         SCOPES_RESULT_TYPE(void);
         auto val = LLVMBuildLoad(builder, SCOPES_GET_RESULT(ref_to_value(node->value)), "");
         if (node->is_volatile) {
             LLVMSetVolatile(val, true);
         }
+        if (node->is_atomic()) {
+            LLVMSetOrdering(val, atomic_ordering(node->order));
+        }
         map_phi({ val }, node);
         return {};
     }
@@ -1989,6 +2482,9 @@ struct LLVMIRGenerator {
         if (node->is_volatile) {
             LLVMSetVolatile(val, true);
         }
+        if (node->is_atomic()) {
+            LLVMSetOrdering(val, atomic_ordering(node->order));
+        }
         return {};
     }
 
@@ -2015,7 +2511,7 @@ struct LLVMIRGenerator {
         }
         auto val = LLVMBuildAtomicRMW(builder, op,
             ptr, value,
-            LLVMAtomicOrderingSequentiallyConsistent,
+            atomic_ordering(node->order),
             false);
         map_phi({ val }, node);
         return {};
@@ -2028,8 +2524,8 @@ struct LLVMIRGenerator {
         auto value = SCOPES_GET_RESULT(ref_to_value(node->value));
         auto val = LLVMBuildAtomicCmpXchg(builder,
             ptr, cmp, value,
-            LLVMAtomicOrderingSequentiallyConsistent,
-            LLVMAtomicOrderingSequentiallyConsistent,
+            atomic_ordering(node->success_order),
+            atomic_ordering(node->failure_order),
             false);
         auto val0 = LLVMBuildExtractValue(builder, val, 0, "");
         auto val1 = LLVMBuildExtractValue(builder, val, 1, "");
@@ -2043,6 +2539,11 @@ struct LLVMIRGenerator {
         return {};
     }
 
+    SCOPES_RESULT(void) translate_Fence(const FenceRef &node) {
+        LLVMBuildFence(builder, atomic_ordering(node->order), false, "");
+        return {};
+    }
+
     SCOPES_RESULT(void) translate_Annotate(const AnnotateRef &node) {
         return {};
     }
@@ -2186,6 +2687,21 @@ struct LLVMIRGenerator {
                 val = LLVMBuildCall(builder, func_fabs, values, 1, "");
             }
         } break;
+        case UnOpAssume: {
+            LLVMBuildCall(builder, get_intrinsic(llvm_assume), &x, 1, "");
+            val = x;
+        } break;
+        case UnOpPrefetch:
+        case UnOpPrefetchWrite: {
+            // keep the line in all cache levels
+            LLVMValueRef values[] = {
+                LLVMBuildPointerCast(builder, x, rawstringT, ""),
+                LLVMConstInt(i32T, (node->op == UnOpPrefetchWrite)?1:0, false),
+                LLVMConstInt(i32T, 3, false),
+                LLVMConstInt(i32T, 1, false) };
+            LLVMBuildCall(builder, get_intrinsic(llvm_prefetch), values, 4, "");
+            val = x;
+        } break;
         case UnOpNormalize: {
             auto T = LLVMTypeOf(x);
             if (LLVMGetTypeKind(T) == LLVMVectorTypeKind) {
@@ -2217,13 +2733,30 @@ struct LLVMIRGenerator {
         case UnOpFNeg: {
             val = LLVMBuildFNeg(builder, x, "");
         } break;
+        case UnOpFSign: {
+            // (0 < x)?1:((x < 0)?-1:0)
+            LLVMValueRef zero = build_matching_constant_real_vector(x, 0.0);
+            LLVMValueRef neg = LLVMBuildSelect(builder,
+                LLVMBuildFCmp(builder, LLVMRealOLT, x, zero, ""),
+                build_matching_constant_real_vector(x, -1.0), zero, "");
+            val = LLVMBuildSelect(builder,
+                LLVMBuildFCmp(builder, LLVMRealOLT, zero, x, ""),
+                build_matching_constant_real_vector(x, 1.0), neg, "");
+        } break;
+        case UnOpRadians: {
+            val = LLVMBuildFMul(builder, x,
+                build_matching_constant_real_vector(x, deg2rad), "");
+        } break;
+        case UnOpDegrees: {
+            val = LLVMBuildFMul(builder, x,
+                build_matching_constant_real_vector(x, rad2deg), "");
+        } break;
         default: {
             auto T = LLVMTypeOf(x);
             auto ET = T;
             if (LLVMGetTypeKind(T) == LLVMVectorTypeKind) {
                 ET = LLVMGetElementType(T);
             }
-            LLVMValueRef func = nullptr;
             Intrinsic op = NumIntrinsics;
             switch(node->op) {
 #define UNOP(SRC, FUNC) \
@@ -2248,29 +2781,12 @@ struct LLVMIRGenerator {
             UNOP(UnOpLog, llvm_log)
             UNOP(UnOpExp2, llvm_exp2)
             UNOP(UnOpLog2, llvm_log2)
-            UNOP(UnOpFSign, custom_fsign)
-            UNOP(UnOpRadians, custom_radians)
-            UNOP(UnOpDegrees, custom_degrees)
 #undef UNOP
             default:
                 SCOPES_ERROR(CGenUnsupportedUnOp);
             }
-            func = get_intrinsic(op);
-            assert(func);
-            if (LLVMGetTypeKind(T) == LLVMVectorTypeKind) {
-                auto count = LLVMGetVectorSize(T);
-                LLVMValueRef retvalue = LLVMGetUndef(T);
-                for (unsigned i = 0; i < count; ++i) {
-                    LLVMValueRef idx = LLVMConstInt(i32T, i, false);
-                    LLVMValueRef values[] = { LLVMBuildExtractElement(builder, x, idx, "") };
-                    LLVMValueRef eltval = LLVMBuildCall(builder, func, values, 1, "");
-                    retvalue = LLVMBuildInsertElement(builder, retvalue, eltval, idx, "");
-                }
-                val = retvalue;
-            } else {
-                LLVMValueRef values[] = { x };
-                val = LLVMBuildCall(builder, func, values, 1, "");
-            }
+            LLVMValueRef values[] = { x };
+            val = build_intrinsic_call(op, values, 1);
         } break;
         }
         map_phi({ val }, node);
@@ -2278,27 +2794,8 @@ struct LLVMIRGenerator {
     }
 
     LLVMValueRef build_intrinsic_binop(Intrinsic op, LLVMValueRef a, LLVMValueRef b) {
-        auto T = LLVMTypeOf(a);
-        LLVMValueRef func = nullptr;
-        func = get_intrinsic(op);
-        assert(func);
-        if (LLVMGetTypeKind(T) == LLVMVectorTypeKind) {
-            auto count = LLVMGetVectorSize(T);
-            LLVMValueRef retvalue = LLVMGetUndef(T);
-            for (unsigned i = 0; i < count; ++i) {
-                LLVMValueRef idx = LLVMConstInt(i32T, i, false);
-                LLVMValueRef values[] = {
-                    LLVMBuildExtractElement(builder, a, idx, ""),
-                    LLVMBuildExtractElement(builder, b, idx, "")
-                };
-                LLVMValueRef eltval = LLVMBuildCall(builder, func, values, 2, "");
-                retvalue = LLVMBuildInsertElement(builder, retvalue, eltval, idx, "");
-            }
-            return retvalue;
-        } else {
-            LLVMValueRef values[] = { a, b };
-            return LLVMBuildCall(builder, func, values, 2, "");
-        }
+        LLVMValueRef values[] = { a, b };
+        return build_intrinsic_call(op, values, 2);
     }
 
     SCOPES_RESULT(void) translate_BinOp(const BinOpRef &node) {
@@ -2341,6 +2838,11 @@ struct LLVMIRGenerator {
         BINOP(BinOpFRem, LLVMBuildFRem)
         INTRINSIC_BINOP(BinOpAtan2, libc_atan2)
         INTRINSIC_BINOP(BinOpPow, llvm_pow)
+        case BinOpExpect: {
+            LLVMValueRef values[] = { a, b };
+            val = LLVMBuildCall(builder, get_intrinsic(llvm_expect, T),
+                values, 2, "");
+        } break;
         case BinOpCross: {
             auto T = LLVMTypeOf(a);
             assert (LLVMGetTypeKind(T) == LLVMVectorTypeKind);
@@ -2435,16 +2937,149 @@ struct LLVMIRGenerator {
         return {};
     }
 
+    typedef std::vector< std::pair<LLVMValueRef, LLVMBasicBlockRef> > SwitchCases;
+
+    LLVMValueRef build_switch_table(LLVMTypeRef ET, std::vector<LLVMValueRef> &values) {
+        LLVMValueRef result = LLVMAddGlobal(module,
+            LLVMArrayType(ET, values.size()), "switch.table");
+        LLVMSetInitializer(result, LLVMConstArray(ET, values.data(), values.size()));
+        LLVMSetGlobalConstant(result, true);
+        LLVMSetLinkage(result, LLVMPrivateLinkage);
+        return result;
+    }
+
+    LLVMValueRef build_switch_table_load(LLVMValueRef table, LLVMValueRef index) {
+        LLVMValueRef indices[] = { LLVMConstInt(i64T, 0, false), index };
+        return LLVMBuildLoad(builder,
+            LLVMBuildInBoundsGEP(builder, table, indices, 2, ""), "");
+    }
+
+    // the hash of a case literal; the top bits of the product depend on all
+    // bits of the literal
+    static uint64_t switch_hash(uint64_t key, uint64_t mul, int bits) {
+        return (key * mul) >> (64 - bits);
+    }
+
+    // finds a multiplier for which switch_hash maps every key to a slot of
+    // its own, and returns the number of bits of the slot index, or 0
+    static int find_switch_hash(const std::vector<uint64_t> &keys, uint64_t &mul) {
+        int bits = 1;
+        while ((1ull << bits) < (keys.size() * 2))
+            bits++;
+        std::vector<bool> used;
+        for (; (1ull << bits) <= SwitchTableMaxSize; ++bits) {
+            mul = 0x9e3779b97f4a7c15ull;
+            for (int i = 0; i < SwitchHashAttempts; ++i) {
+                used.assign(1ull << bits, false);
+                bool collision = false;
+                for (auto key : keys) {
+                    auto slot = switch_hash(key, mul, bits);
+                    if (used[slot]) {
+                        collision = true;
+                        break;
+                    }
+                    used[slot] = true;
+                }
+                if (!collision)
+                    return bits;
+                mul = (mul * 6364136223846793005ull + 1442695040888963407ull) | 1;
+            }
+        }
+        return 0;
+    }
+
+    // jumps to the block of the case matching expr through a jump table if
+    // the literals are dense, or else through a perfect hash table of the
+    // literals; returns false if the switch is better left to the backend
+    bool build_switch_dispatch(LLVMValueRef expr, LLVMBasicBlockRef bbdefault,
+        const SwitchCases &cases) {
+        size_t count = cases.size();
+        auto T = LLVMTypeOf(expr);
+        if ((count < SwitchTableMinCases)
+            || (LLVMGetTypeKind(T) != LLVMIntegerTypeKind)
+            || (LLVMGetIntTypeWidth(T) > 64))
+            return false;
+        std::vector<uint64_t> keys;
+        keys.reserve(count);
+        uint64_t lo = ~0ull;
+        uint64_t hi = 0;
+        for (auto &&_case : cases) {
+            uint64_t key = LLVMConstIntGetZExtValue(_case.first);
+            keys.push_back(key);
+            lo = std::min(lo, key);
+            hi = std::max(hi, key);
+        }
+        LLVMValueRef func = LLVMGetBasicBlockParent(bbdefault);
+        auto defaultaddr = LLVMBlockAddress(func, bbdefault);
+        std::vector<LLVMValueRef> targets;
+        LLVMValueRef target = nullptr;
+        if (((hi - lo) < (count * 2)) && ((hi - lo) < SwitchTableMaxSize)) {
+            // dense literals index the jump table, offset by the smallest one
+            size_t size = (size_t)(hi - lo) + 1;
+            targets.assign(size, defaultaddr);
+            for (size_t i = 0; i < count; ++i) {
+                targets[keys[i] - lo] = LLVMBlockAddress(func, cases[i].second);
+            }
+            auto table = build_switch_table(rawstringT, targets);
+            auto offset = LLVMBuildSub(builder, expr, LLVMConstInt(T, lo, false), "");
+            auto inrange = LLVMBuildICmp(builder, LLVMIntULT, offset,
+                LLVMConstInt(T, size, false), "");
+            LLVMBasicBlockRef bbtable = LLVMAppendBasicBlock(func, "table");
+            LLVMBuildCondBr(builder, inrange, bbtable, bbdefault);
+            position_builder_at_end(bbtable);
+            offset = LLVMBuildZExt(builder, offset, i64T, "");
+            target = build_switch_table_load(table, offset);
+        } else {
+            uint64_t mul = 0;
+            int bits = find_switch_hash(keys, mul);
+            if (!bits)
+                return false;
+            // empty slots hold a literal that can't hash to them
+            size_t size = 1ull << bits;
+            targets.assign(size, defaultaddr);
+            std::vector<LLVMValueRef> slotkeys;
+            slotkeys.assign(size, LLVMConstInt(i64T, keys[0], false));
+            for (size_t i = 0; i < count; ++i) {
+                auto slot = switch_hash(keys[i], mul, bits);
+                targets[slot] = LLVMBlockAddress(func, cases[i].second);
+                slotkeys[slot] = LLVMConstInt(i64T, keys[i], false);
+            }
+            auto table = build_switch_table(rawstringT, targets);
+            auto keytable = build_switch_table(i64T, slotkeys);
+            auto key = LLVMBuildZExt(builder, expr, i64T, "");
+            auto slot = LLVMBuildLShr(builder,
+                LLVMBuildMul(builder, key, LLVMConstInt(i64T, mul, false), ""),
+                LLVMConstInt(i64T, 64 - bits, false), "");
+            auto found = LLVMBuildICmp(builder, LLVMIntEQ,
+                build_switch_table_load(keytable, slot), key, "");
+            target = LLVMBuildSelect(builder, found,
+                build_switch_table_load(table, slot), defaultaddr, "");
+        }
+        std::vector<LLVMBasicBlockRef> dests;
+        std::unordered_set<LLVMBasicBlockRef> seen;
+        dests.push_back(bbdefault);
+        seen.insert(bbdefault);
+        for (auto &&_case : cases) {
+            if (seen.insert(_case.second).second)
+                dests.push_back(_case.second);
+        }
+        auto br = LLVMBuildIndirectBr(builder, target, dests.size());
+        for (auto dest : dests) {
+            LLVMAddDestination(br, dest);
+        }
+        return true;
+    }
+
     SCOPES_RESULT(void) translate_Switch(const SwitchRef &node) {
         SCOPES_RESULT_TYPE(void);
         auto expr = SCOPES_GET_RESULT(ref_to_value(node->expr));
         LLVMBasicBlockRef bb = LLVMGetInsertBlock(builder);
         LLVMValueRef func = LLVMGetBasicBlockParent(bb);
         LLVMBasicBlockRef bbdefault = LLVMAppendBasicBlock(func, "default");
-        position_builder_at_end(bb);
         int count = (int)node->cases.size();
         assert(count);
-        auto _sw = LLVMBuildSwitch(builder, expr, bbdefault, count - 1);
+        SwitchCases cases;
+        cases.reserve(count - 1);
         int i = count;
         LLVMBasicBlockRef lastbb = nullptr;
         while (i-- > 0) {
@@ -2455,13 +3090,13 @@ struct LLVMIRGenerator {
                 bbcase = bbdefault;
             } else if (_case.body.empty()) {
                 auto lit = SCOPES_GET_RESULT(ref_to_value(ValueIndex(_case.literal)));
-                LLVMAddCase(_sw, lit, lastbb);
+                cases.push_back({ lit, lastbb });
                 continue;
             } else {
                 auto lit = SCOPES_GET_RESULT(ref_to_value(ValueIndex(_case.literal)));
                 bbcase = LLVMAppendBasicBlock(func, "case");
                 position_builder_at_end(bbcase);
-                LLVMAddCase(_sw, lit, bbcase);
+                cases.push_back({ lit, bbcase });
             }
             SCOPES_CHECK_RESULT(translate_block(_case.body));
             if (!_case.body.terminator) {
@@ -2469,6 +3104,13 @@ struct LLVMIRGenerator {
             }
             lastbb = bbcase;
         }
+        position_builder_at_end(bb);
+        if (lower_switches && build_switch_dispatch(expr, bbdefault, cases))
+            return {};
+        auto _sw = LLVMBuildSwitch(builder, expr, bbdefault, cases.size());
+        for (auto &&_case : cases) {
+            LLVMAddCase(_sw, _case.first, _case.second);
+        }
         return {};
     }
 
@@ -2514,6 +3156,12 @@ struct LLVMIRGenerator {
 
     SCOPES_RESULT(LLVMValueRef) ref_to_value(const ValueIndex &ref) {
         SCOPES_RESULT_TYPE(LLVMValueRef);
+        int id = ref.value->value_id;
+        if ((id >= 0) && !ref.index) {
+            assert(id < function_values.size());
+            if (function_values[id])
+                return function_values[id];
+        }
         auto it = ref2value.find(ref);
         LLVMValueRef value = nullptr;
         if (it != ref2value.end()) {
@@ -2559,6 +3207,14 @@ struct LLVMIRGenerator {
         LLVMSetGlobalConstant(result, true);
         LLVMSetLinkage(result, LLVMPrivateLinkage);
         //LLVMSetVisibility(result, LLVMHiddenVisibility); // This doesn't make sense on private linkage
+        // the bytes of blobs are read as their element type
+        auto ST = SCOPES_GET_RESULT(storage_type(strip_qualifiers(node->get_type())));
+        if (auto AT = dyn_cast<ArrayType>(ST)) {
+            auto align = SCOPES_GET_RESULT(align_of(AT->element_type));
+            if (align > 1) {
+                LLVMSetAlignment(result, align);
+            }
+        }
         result = LLVMConstBitCast(result, LLT);
         return result;
     }
@@ -2589,6 +3245,10 @@ struct LLVMIRGenerator {
                     ss.out << ">";
                     stream_address(ss.out, node.unref());
                     name = ss.cppstr();
+                    if (defined_globals
+                        && !defined_globals->insert(node.unref()).second) {
+                        is_external = true;
+                    }
                 } else {
                     auto it = global_cache.find(node.unref());
                     if (it == global_cache.end()) {
@@ -2602,7 +3262,7 @@ struct LLVMIRGenerator {
                         ss.out << "<";
                         stream_type_name(ss.out, pi->element_type);
                         ss.out << ">";
-                        ss.out << get_global_pointer_id(node.unref());
+                        ss.out << get_global_pointer_id(node);
                         name = ss.cppstr();
                         global_cache.insert({node.unref(), name});
                     } else {
@@ -2682,8 +3342,9 @@ struct LLVMIRGenerator {
 
                             auto ilfunctype = node->get_type();
                             auto fi = extract_function_type(ilfunctype);
-                            auto rtype = abi_return_type(fi);
-                            bool use_sret = is_memory_class(rtype);
+                            auto fabi = function_abi(fi);
+                            auto rtype = fabi.rtype;
+                            bool use_sret = fabi.use_sret;
 
                             if (use_sret) {
                                 LLVMAddAttributeAtIndex(result, 1,
@@ -2738,7 +3399,7 @@ struct LLVMIRGenerator {
 #else
             if (serialize_pointers) {
 #endif
-                auto name = get_local_pointer_id(node->value);
+                auto name = get_local_pointer_id(node);
                 auto ET = LLVMGetElementType(LLT);
                 auto glob = LLVMAddGlobal(module, ET, name.c_str());
                 pointer_map.insert({name, node->value});
@@ -2830,8 +3491,9 @@ struct LLVMIRGenerator {
 
         auto fi = cast<FunctionType>(functype);
 
-        auto rtype = abi_return_type(fi);
-        bool use_sret = is_memory_class(rtype);
+        auto fabi = function_abi(fi);
+        auto rtype = fabi.rtype;
+        bool use_sret = fabi.use_sret;
 
         LLVMValueRefs values;
         values.reserve(argcount + 1);
@@ -2896,7 +3558,19 @@ struct LLVMIRGenerator {
             }
         }
 
-        if (fi->has_exception()) {
+        if (fi->has_exception() && !call->except) {
+            // the callee never raises; skip the ok flag
+            if (!is_returning(fi->return_type)) {
+                LLVMBuildUnreachable(builder);
+            } else if (is_returning_value(fi->return_type)) {
+                int retvalue_index =
+                    (is_returning_value(fi->except_type)?2:1);
+                ret = LLVMBuildExtractValue(builder, ret, retvalue_index, "");
+                LLVMValueRefs values;
+                struct_to_values(values, fi->return_type, ret);
+                map_phi(values, call);
+            }
+        } else if (fi->has_exception()) {
             bool has_except_value = is_returning_value(fi->except_type);
             bool has_return_value = is_returning_value(fi->return_type);
             if (has_except_value) {
@@ -2941,6 +3615,12 @@ struct LLVMIRGenerator {
         return {};
     }
 
+#if SCOPES_LLVM_EXTENDED_DEBUG_INFO
+    bool use_debug_types() const {
+        return use_debug_info && !line_tables_only;
+    }
+#endif
+
     LLVMMetadataRef anchor_to_location(const Anchor *anchor) {
         assert(use_debug_info);
 
@@ -3061,8 +3741,9 @@ struct LLVMIRGenerator {
     void setup_generate(const char *module_name) {
         module = LLVMModuleCreateWithName(module_name);
         builder = LLVMCreateBuilder();
-        di_builder = LLVMCreateDIBuilder(module);
+        di_builder = nullptr;
         if (use_debug_info) {
+            di_builder = LLVMCreateDIBuilder(module);
             const char *DebugStr = "Debug Info Version";
             LLVMValueRef DbgVer[3];
             DbgVer[0] = LLVMConstInt(i32T, 1, 0);
@@ -3087,7 +3768,8 @@ struct LLVMIRGenerator {
                 /*Flags*/ "", 0,
                 /*RuntimeVer*/ 0,
                 /*SplitName*/ "", 0,
-                /*Kind*/ LLVMDWARFEmissionFull,
+                /*Kind*/ line_tables_only?LLVMDWARFEmissionLineTablesOnly
+                    :LLVMDWARFEmissionFull,
                 /*DWOId*/ 0,
                 /*SplitDebugInlining*/ true,
                 /*DebugInfoForProfiling*/ false,
@@ -3099,7 +3781,8 @@ struct LLVMIRGenerator {
             //LLVMAddNamedMetadataOperand(module, "llvm.dbg.cu", dicu);
 
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
-            init_debug_types();
+            if (!line_tables_only)
+                init_debug_types();
 #endif
         }
     }
@@ -3126,15 +3809,17 @@ struct LLVMIRGenerator {
 #endif
 
         LLVMDisposeBuilder(builder);
-        LLVMDIBuilderFinalize(di_builder);
-        LLVMDisposeDIBuilder(di_builder);
+        if (di_builder) {
+            LLVMDIBuilderFinalize(di_builder);
+            LLVMDisposeDIBuilder(di_builder);
+        }
 
 #if SCOPES_DEBUG_CODEGEN
         LLVMDumpModule(module);
 #endif
 #ifndef SCOPES_WIN32
         char *errmsg = NULL;
-        if (LLVMVerifyModule(module,
+        if (verify_module && LLVMVerifyModule(module,
             LLVMReturnStatusAction, &errmsg)) {
             LLVMDumpModule(module);
             SCOPES_ERROR(CGenBackendFailed, errmsg);
@@ -3179,14 +3864,13 @@ struct LLVMIRGenerator {
         LLVMSetLinkage(glob, LLVMAppendingLinkage);
     }
 
-    // for generating object files
-    SCOPES_RESULT(LLVMModuleRef) generate(const String *name, const Scope *table) {
-        SCOPES_RESULT_TYPE(LLVMModuleRef);
-
-        setup_generate(name->data);
-
-        std::vector<LLVMValueRef> exported_globals;
+    typedef std::vector<std::pair<Symbol, FunctionRef>> Exports;
 
+    // every function of table and its parents, under the first name it has
+    static SCOPES_RESULT(void) collect_exports(const Scope *table,
+        Exports &exports) {
+        SCOPES_RESULT_TYPE(void);
+        absl::flat_hash_set<Function *> seen;
         const Scope *t = table;
         while (t) {
             auto it = sc_scope_next(t, -1);
@@ -3196,15 +3880,47 @@ struct LLVMIRGenerator {
                 if (key->get_type() == TYPE_Symbol) {
                     Symbol name = Symbol::wrap(key.cast<ConstInt>()->value());
                     FunctionRef fn = SCOPES_GET_RESULT(extract_function_constant(val));
-                    func_export_table.insert({fn.unref(), name});
-                    LLVMValueRef func = SCOPES_GET_RESULT(ref_to_value(ValueIndex(fn)));
-                    assert(func);
-                    exported_globals.push_back(func);
+                    if (seen.insert(fn.unref()).second) {
+                        exports.push_back({name, fn});
+                    }
                 }
                 it = sc_scope_next(t, it._2);
             }
             t = t->parent();
         }
+        return {};
+    }
+
+    // for generating object files
+    SCOPES_RESULT(LLVMModuleRef) generate(const String *name, const Scope *table) {
+        SCOPES_RESULT_TYPE(LLVMModuleRef);
+        Exports exports;
+        SCOPES_CHECK_RESULT(collect_exports(table, exports));
+        return generate(name, exports, 0, exports.size());
+    }
+
+    // generates the exports in [begin, end); the others are only declared
+    SCOPES_RESULT(LLVMModuleRef) generate(const String *name,
+        const Exports &exports, size_t begin, size_t end) {
+        SCOPES_RESULT_TYPE(LLVMModuleRef);
+
+        setup_generate(name->data);
+
+        std::vector<LLVMValueRef> exported_globals;
+
+        chunked = (begin > 0) || (end < exports.size());
+        for (auto &&entry : exports) {
+            func_export_table.insert({entry.second.unref(), entry.first});
+        }
+        for (size_t i = begin; i < end; ++i) {
+            chunk_exports.insert(exports[i].second.unref());
+        }
+        for (size_t i = begin; i < end; ++i) {
+            LLVMValueRef func = SCOPES_GET_RESULT(
+                ref_to_value(ValueIndex(exports[i].second)));
+            assert(func);
+            exported_globals.push_back(func);
+        }
 
         SCOPES_CHECK_RESULT(process_functions());
 
@@ -3256,9 +3972,37 @@ struct LLVMIRGenerator {
 
 Error *LLVMIRGenerator::last_llvm_error = nullptr;
 absl::flat_hash_map<const Type *, LLVMTypeRef> LLVMIRGenerator::type_cache;
+absl::flat_hash_map<const Type *, LLVMIRGenerator::ArgumentABI> LLVMIRGenerator::argument_abi_cache;
+absl::flat_hash_map<const FunctionType *, LLVMIRGenerator::FunctionABI> LLVMIRGenerator::function_abi_cache;
 absl::flat_hash_map<Function *, std::string> LLVMIRGenerator::func_cache;
+absl::flat_hash_map<Function *, void *> LLVMIRGenerator::func_addresses;
 absl::flat_hash_map<Global *, std::string> LLVMIRGenerator::global_cache;
-absl::flat_hash_map<size_t, PointerNamespaces *> LLVMIRGenerator::pointer_namespaces;
+PointerNamespaces LLVMIRGenerator::pointer_namespaces;
+
+static MemoryStat codegen_memory("LLVM codegen caches", [](MemoryUsage &usage) {
+    usage.objects = LLVMIRGenerator::type_cache.size()
+        + LLVMIRGenerator::argument_abi_cache.size()
+        + LLVMIRGenerator::function_abi_cache.size()
+        + LLVMIRGenerator::func_cache.size()
+        + LLVMIRGenerator::func_addresses.size()
+        + LLVMIRGenerator::global_cache.size()
+        + LLVMIRGenerator::pointer_namespaces.local.ptr2id.size()
+        + LLVMIRGenerator::pointer_namespaces.global.ptr2id.size()
+        + LLVMIRGenerator::pointer_namespaces.func.ptr2id.size();
+    usage.bytes = hash_table_bytes(LLVMIRGenerator::type_cache)
+        + hash_table_bytes(LLVMIRGenerator::argument_abi_cache)
+        + hash_table_bytes(LLVMIRGenerator::function_abi_cache)
+        + hash_table_bytes(LLVMIRGenerator::func_cache)
+        + hash_table_bytes(LLVMIRGenerator::func_addresses)
+        + hash_table_bytes(LLVMIRGenerator::global_cache)
+        + hash_table_bytes(LLVMIRGenerator::pointer_namespaces.local.ptr2id)
+        + hash_table_bytes(LLVMIRGenerator::pointer_namespaces.global.ptr2id)
+        + hash_table_bytes(LLVMIRGenerator::pointer_namespaces.func.ptr2id);
+    for (auto &&it : LLVMIRGenerator::func_cache)
+        usage.bytes += it.second.capacity();
+    for (auto &&it : LLVMIRGenerator::global_cache)
+        usage.bytes += it.second.capacity();
+});
 Types LLVMIRGenerator::type_todo;
 LLVMTypeRef LLVMIRGenerator::voidT = nullptr;
 LLVMTypeRef LLVMIRGenerator::i1T = nullptr;
@@ -3270,6 +4014,7 @@ LLVMTypeRef LLVMIRGenerator::i64x2AT = nullptr;
 LLVMTypeRef LLVMIRGenerator::i128T = nullptr;
 LLVMTypeRef LLVMIRGenerator::f32T = nullptr;
 LLVMTypeRef LLVMIRGenerator::f32x2T = nullptr;
+LLVMTypeRef LLVMIRGenerator::f32x4T = nullptr;
 LLVMTypeRef LLVMIRGenerator::f32x2AT = nullptr;
 LLVMTypeRef LLVMIRGenerator::f32x3AT = nullptr;
 LLVMTypeRef LLVMIRGenerator::f32x4AT = nullptr;
@@ -3287,59 +4032,316 @@ LLVMAttributeRef LLVMIRGenerator::attr_sret = nullptr;
 LLVMAttributeRef LLVMIRGenerator::attr_nonnull = nullptr;
 unsigned LLVMIRGenerator::attr_kind_sret = 0;
 unsigned LLVMIRGenerator::attr_kind_byval = 0;
+unsigned LLVMIRGenerator::attr_kind_noalias = 0;
+unsigned LLVMIRGenerator::attr_kind_dereferenceable = 0;
+unsigned LLVMIRGenerator::attr_kind_align = 0;
 
 //------------------------------------------------------------------------------
 // IL COMPILER
 //------------------------------------------------------------------------------
 
-template <typename T> 
-SCOPES_RESULT(T) compile_object(const String *triple, CompilerFileKind kind, const String *path, const Scope *scope, uint64_t flags) {
-    SCOPES_RESULT_TYPE(T);
-    Timer sum_compile_time(TIMER_Compile);
+static std::mutex object_target_mutex;
+static std::string object_target_cpu;
+static std::string object_target_features;
+// the host cpu and its features don't apply to other architectures
+static bool object_target_native = false;
+
+void set_object_target_cpu(const char *cpu, const char *features) {
+    std::string newcpu = cpu;
+    std::string newfeatures = features;
+    bool native = (newcpu == "native");
+    if (native) {
+        auto name = LLVMGetHostCPUName();
+        newcpu = name;
+        LLVMDisposeMessage(name);
+        if (newfeatures.empty()) {
+            auto hostfeatures = LLVMGetHostCPUFeatures();
+            newfeatures = hostfeatures;
+            LLVMDisposeMessage(hostfeatures);
+        }
+    }
+    std::lock_guard<std::mutex> lock(object_target_mutex);
+    object_target_cpu = newcpu;
+    object_target_features = newfeatures;
+    object_target_native = native;
+}
 
-    LLVMIRGenerator ctx;
+void get_object_target_cpu(std::string &cpu, std::string &features) {
+    std::lock_guard<std::mutex> lock(object_target_mutex);
+    cpu = object_target_cpu;
+    features = object_target_features;
+}
+
+// target machines can't be shared between threads, so every thread keeps one
+// per normalized triple, cpu and features; they live until the process exits
+static SCOPES_RESULT(LLVMTargetMachineRef) get_triple_target_machine(
+    const String *triple, std::string &normalized) {
+    SCOPES_RESULT_TYPE(LLVMTargetMachineRef);
+    typedef std::tuple<std::string, std::string, std::string> Key;
+    static thread_local std::map<Key, LLVMTargetMachineRef> machines;
+
+    auto tt = LLVMNormalizeTargetTriple(triple->data);
+    normalized = tt;
+    LLVMDisposeMessage(tt);
+    init_llvm_target(normalized.c_str());
+
+    std::string cpu;
+    std::string features;
+    bool native;
+    {
+        std::lock_guard<std::mutex> lock(object_target_mutex);
+        cpu = object_target_cpu;
+        features = object_target_features;
+        native = object_target_native;
+    }
+    if (native) {
+        auto host = LLVMGetDefaultTargetTriple();
+        std::string hostarch(host, strcspn(host, "-"));
+        LLVMDisposeMessage(host);
+        if (normalized.compare(0, normalized.find('-'), hostarch)) {
+            cpu.clear();
+            features.clear();
+        }
+    }
+
+    Key key(normalized, cpu, features);
+    auto it = machines.find(key);
+    if (it != machines.end())
+        return it->second;
+
+    char *error_message = nullptr;
+    LLVMTargetRef target = nullptr;
+    if (LLVMGetTargetFromTriple(normalized.c_str(), &target, &error_message)) {
+        SCOPES_ERROR(CGenBackendFailed, error_message);
+    }
+    // code model must be JIT default for reasons beyond my comprehension
+    LLVMTargetMachineRef tm = LLVMCreateTargetMachine(target, normalized.c_str(),
+        cpu.c_str(), features.c_str(), LLVMCodeGenLevelDefault, LLVMRelocPIC,
+        LLVMCodeModelJITDefault);
+    assert(tm);
+    machines.insert({key, tm});
+    return tm;
+}
+
+static void setup_object_generator(LLVMIRGenerator &ctx, uint64_t flags) {
     ctx.generate_object = true;
+    ctx.c_abi = (flags & CF_CABI);
     if (flags & CF_NoDebugInfo) {
         ctx.use_debug_info = false;
+    } else if (flags & CF_LineTablesOnly) {
+        ctx.line_tables_only = true;
     }
+}
 
-    LLVMModuleRef module;
+static int object_opt_level(uint64_t flags) {
+    if ((flags & CF_O3) == CF_O1)
+        return 1;
+    else if ((flags & CF_O3) == CF_O2)
+        return 2;
+    else if ((flags & CF_O3) == CF_O3)
+        return 3;
+    return 0;
+}
+
+// the key that the output of compile_object for module is cached under. it
+// covers the module as generated, and the target, optimization and file kind
+// that it is translated with; null if the output can't be cached.
+static const String *object_cache_key(LLVMModuleRef module,
+    LLVMTargetMachineRef tm, const std::string &triplestr,
+    CompilerFileKind kind, uint64_t flags) {
+#if SCOPES_ALLOW_CACHE
+    // the profile that shapes profiled objects is not part of the key
+    if (flags & (CF_ProfileGenerate | CF_ProfileUse))
+        return nullptr;
+    std::vector<uint64_t> digest;
+    if (!digest_module(module, digest))
+        return nullptr;
+    char *cpu = LLVMGetTargetMachineCPU(tm);
+    char *features = LLVMGetTargetMachineFeatureString(tm);
+    std::string target = triplestr + "\n" + cpu + "\n" + features + "\n";
+    LLVMDisposeMessage(cpu);
+    LLVMDisposeMessage(features);
+    if (flags & CF_O3) {
+        target += get_opt_pipeline(object_opt_level(flags), true);
+    }
+    digest.push_back(hash_bytes(target.data(), target.size()));
+    digest.push_back((uint64_t)kind);
+    return get_cache_key(flags & (SCOPES_CACHE_COMPILER_FLAGS | CF_CABI),
+        (const char *)digest.data(), digest.size() * sizeof(uint64_t));
+#else
+    return nullptr;
+#endif
+}
+
+static SCOPES_RESULT(void) write_object_file(const char *path,
+    const char *content, size_t size) {
+    SCOPES_RESULT_TYPE(void);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        SCOPES_ERROR(RTUnableToOpenFile, String::from_cstr(path));
+    }
+    bool ok = (fwrite(content, 1, size, f) == size);
+    ok = !fclose(f) && ok;
+    if (!ok) {
+        SCOPES_ERROR(CGenBackendFailed, strdup(strerror(errno)));
+    }
+    return {};
+}
+
+// stores the file that was just written at path under key
+static void cache_object_file(const String *key, const char *path) {
+    if (!key)
+        return;
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer)
+        return;
+    set_cache(key, nullptr, 0,
+        (*buffer)->getBufferStart(), (*buffer)->getBufferSize());
+}
+
+static SCOPES_RESULT(void) optimize_object_module(LLVMModuleRef module,
+    LLVMTargetMachineRef tm, const std::string &triplestr, uint64_t flags) {
+    SCOPES_RESULT_TYPE(void);
+    // the optimizer vectorizes for the registers and features of the target,
+    // such as simd128 on wasm32, and the thin link reads the target from
+    // the units
+    LLVMSetTarget(module, triplestr.c_str());
     {
-        Timer generate_timer(TIMER_Generate);
-        module = SCOPES_GET_RESULT(ctx.generate(path, scope));
+        auto layout = LLVMCreateTargetDataLayout(tm);
+        LLVMSetModuleDataLayout(module, layout);
+        LLVMDisposeTargetData(layout);
     }
 
-    if (flags & CF_O3) {
+    auto profile = profile_mode_from_flags(flags);
+    SCOPES_CHECK_RESULT(verify_profile_mode(profile));
+    if ((flags & CF_O3) || profile) {
+        // profiles are applied by the optimizer, even at O0
         Timer optimize_timer(TIMER_Optimize);
-        int level = 0;
-        if ((flags & CF_O3) == CF_O1)
-            level = 1;
-        else if ((flags & CF_O3) == CF_O2)
-            level = 2;
-        else if ((flags & CF_O3) == CF_O3)
-            level = 3;
-        build_and_run_opt_passes(module, level);
+        build_and_run_opt_passes(module, object_opt_level(flags), tm, profile,
+            true);
     }
 
     if (flags & CF_DumpModule) {
         LLVMDumpModule(module);
     }
+    return {};
+}
 
-    auto tt = LLVMNormalizeTargetTriple(triple->data);
-    static char triplestr[1024];
-    strncpy(triplestr, tt, 1024 - 1);
-    LLVMDisposeMessage(tt);
+// every chunk of exports is generated, optimized and emitted to an object of
+// its own, and its module disposed of before the next one starts, so that
+// memory use doesn't grow with the size of the scope; the integrated linker
+// then combines the objects into one
+static SCOPES_RESULT(void) compile_object_chunked(const String *triple,
+    const String *path, const Scope *scope, uint64_t flags) {
+    SCOPES_RESULT_TYPE(void);
+    LLVMIRGenerator::Exports exports;
+    SCOPES_CHECK_RESULT(LLVMIRGenerator::collect_exports(scope, exports));
+
+    std::string triplestr;
+    LLVMTargetMachineRef tm = SCOPES_GET_RESULT(
+        get_triple_target_machine(triple, triplestr));
+
+    // only ELF and wasm objects can be combined again; other targets get
+    // a single chunk
+    llvm::Triple target(triplestr);
+    size_t chunk_size = SCOPES_COMPILE_OBJECT_CHUNK_SIZE;
+    if (!target.isOSBinFormatELF() && !target.isOSBinFormatWasm()) {
+        chunk_size = std::max(exports.size(), (size_t)1);
+    }
+    size_t count = (exports.size() + chunk_size - 1) / chunk_size;
+    absl::flat_hash_set<Global *> defined_globals;
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < std::max(count, (size_t)1); ++i) {
+        size_t begin = i * chunk_size;
+        size_t end = std::min(begin + chunk_size, exports.size());
+        LLVMModuleRef module;
+        {
+            Timer generate_timer(TIMER_Generate);
+            LLVMIRGenerator ctx;
+            setup_object_generator(ctx, flags);
+            ctx.defined_globals = &defined_globals;
+            module = SCOPES_GET_RESULT(ctx.generate(path, exports, begin, end));
+        }
+
+        std::string chunkpath = path->data;
+        if (count > 1) {
+            chunkpath += "." + std::to_string(i) + ".o";
+        }
+        inputs.push_back(chunkpath);
+        // only the chunks whose exports changed are translated again
+        auto key = object_cache_key(module, tm, triplestr, CFK_Object, flags);
+        if (key) {
+            size_t size = 0;
+            auto cached = get_cache(key, size);
+            if (cached) {
+                LLVMDisposeModule(module);
+                SCOPES_CHECK_RESULT(
+                    write_object_file(chunkpath.c_str(), cached, size));
+                continue;
+            }
+        }
+        SCOPES_CHECK_RESULT(optimize_object_module(module, tm, triplestr, flags));
+
+        char *error_message = nullptr;
+        LLVMBool failed = LLVMTargetMachineEmitToFile(tm, module,
+            (char *)chunkpath.c_str(), LLVMObjectFile, &error_message);
+        LLVMDisposeModule(module);
+        if (failed) {
+            SCOPES_ERROR(CGenBackendFailed, error_message);
+        }
+        cache_object_file(key, chunkpath.c_str());
+    }
+    if (count > 1) {
+        auto result = link_objects(triplestr.c_str(), inputs, path->data, true);
+        for (auto &input : inputs) {
+            llvm::sys::fs::remove(input);
+        }
+        SCOPES_CHECK_RESULT(result);
+    }
+    return {};
+}
+
+template <typename T> 
+SCOPES_RESULT(T) compile_object(const String *triple, CompilerFileKind kind, const String *path, const Scope *scope, uint64_t flags) {
+    SCOPES_RESULT_TYPE(T);
+    Timer sum_compile_time(TIMER_Compile);
+
+    if constexpr (std::is_void_v<T>) {
+        if ((flags & CF_Chunked) && (kind == CFK_Object)) {
+            return compile_object_chunked(triple, path, scope, flags);
+        }
+    }
+
+    LLVMIRGenerator ctx;
+    setup_object_generator(ctx, flags);
+
+    LLVMModuleRef module;
+    {
+        Timer generate_timer(TIMER_Generate);
+        module = SCOPES_GET_RESULT(ctx.generate(path, scope));
+    }
 
+    std::string triplestr;
+    LLVMTargetMachineRef tm = SCOPES_GET_RESULT(
+        get_triple_target_machine(triple, triplestr));
     char *error_message = nullptr;
-    LLVMTargetRef target = nullptr;
 
-    if (LLVMGetTargetFromTriple(triplestr, &target, &error_message)) {
-        SCOPES_ERROR(CGenBackendFailed, error_message);
+    auto key = object_cache_key(module, tm, triplestr, kind, flags);
+    if (key) {
+        size_t size = 0;
+        auto cached = get_cache(key, size);
+        if (cached) {
+            LLVMDisposeModule(module);
+            if constexpr (std::is_void_v<T>) {
+                SCOPES_CHECK_RESULT(write_object_file(path->data, cached, size));
+                return {};
+            } else {
+                return String::from(cached, size);
+            }
+        }
     }
-    // code model must be JIT default for reasons beyond my comprehension
-    LLVMTargetMachineRef tm = LLVMCreateTargetMachine(target, triplestr, nullptr, nullptr,
-        LLVMCodeGenLevelDefault, LLVMRelocPIC, LLVMCodeModelJITDefault);
-    assert(tm);
+
+    SCOPES_CHECK_RESULT(optimize_object_module(module, tm, triplestr, flags));
 
     char *path_cstr = strdup(path->data);
     LLVMBool failed = false;
@@ -3360,17 +4362,30 @@ SCOPES_RESULT(T) compile_object(const String *triple, CompilerFileKind kind, con
             case CFK_LLVM: {
                 failed = LLVMPrintModuleToFile(module, path_cstr, &error_message);
             } break;
+            case CFK_ThinBC: {
+                std::error_code ec;
+                llvm::raw_fd_ostream out(path_cstr, ec, llvm::sys::fs::OF_None);
+                if (ec) {
+                    failed = true;
+                    error_message = strdup(ec.message().c_str());
+                } else {
+                    write_thin_bitcode(module, out);
+                }
+            } break;
             default: {
                 free(path_cstr);
                 SCOPES_ERROR(CGenBackendFailed, "unknown file kind");
             } break;
         }
         
-        free(path_cstr);
+        LLVMDisposeModule(module);
         
         if (failed) {
+            free(path_cstr);
             SCOPES_ERROR(CGenBackendFailed, error_message);
         }
+        cache_object_file(key, path_cstr);
+        free(path_cstr);
         
         return {};
 
@@ -3378,6 +4393,8 @@ SCOPES_RESULT(T) compile_object(const String *triple, CompilerFileKind kind, con
         LLVMMemoryBufferRef buffer = nullptr;
         LLVMBool failed = false;
 
+        TraceScope emit_trace("codegen",
+            [&]() { return trace_emit_name(module); });
         switch(kind) {
             case CFK_Object: {
                 failed = LLVMTargetMachineEmitToMemoryBuffer(tm, module, LLVMObjectFile, &error_message, &buffer);
@@ -3385,11 +4402,23 @@ SCOPES_RESULT(T) compile_object(const String *triple, CompilerFileKind kind, con
             case CFK_ASM: {
                 failed = LLVMTargetMachineEmitToMemoryBuffer(tm, module, LLVMAssemblyFile, &error_message, &buffer);
             } break;
+            case CFK_ThinBC: {
+                std::string data;
+                llvm::raw_string_ostream out(data);
+                write_thin_bitcode(module, out);
+                out.flush();
+                LLVMDisposeModule(module);
+                if (key) {
+                    set_cache(key, nullptr, 0, data.c_str(), data.size());
+                }
+                return String::from(data.c_str(), data.size());
+            } break;
             default: {
                 SCOPES_ERROR(CGenBackendFailed, "unknown file kind");
             } break;
         }
 
+        LLVMDisposeModule(module);
         if (failed) {
             SCOPES_ERROR(CGenBackendFailed, error_message);
         }
@@ -3397,7 +4426,12 @@ SCOPES_RESULT(T) compile_object(const String *triple, CompilerFileKind kind, con
         const char* buffer_data = LLVMGetBufferStart(buffer);
         const size_t buffer_size = LLVMGetBufferSize(buffer);
 
-        return String::from(buffer_data, buffer_size);
+        auto result = String::from(buffer_data, buffer_size);
+        if (key) {
+            set_cache(key, nullptr, 0, buffer_data, buffer_size);
+        }
+        LLVMDisposeMemoryBuffer(buffer);
+        return result;
     } else {
         static_assert(std::is_void_v<T>, "unimplemented template type");
 
@@ -3419,6 +4453,16 @@ SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
         //flags |= CF_O0;
         flags |= CF_Cache;
     }
+    if (flags & CF_Quick) {
+        // latency over code quality: no debug info, no optimization
+        flags |= CF_NoDebugInfo;
+        flags &= ~(CF_O3 | CF_Tiered | CF_LineTablesOnly
+            | CF_ProfileGenerate | CF_ProfileUse);
+    }
+    if (flags & CF_CABI) {
+        // tiered functions count their calls on entry
+        flags &= ~CF_Tiered;
+    }
 
     /*
     const Type *functype = pointer_type(
@@ -3427,14 +4471,20 @@ SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
    const Type *functype = fn->get_type();
 
     LLVMIRGenerator ctx;
+    // the optimized code of tiered modules is generated by a target machine
+    // that builds jump tables by itself
+    ctx.lower_switches = !(flags & CF_Tiered);
+    ctx.c_abi = (flags & CF_CABI);
+#ifdef NDEBUG
+    ctx.verify_module = !(flags & CF_Quick);
+#endif
     if (flags & CF_Cache) {
         ctx.serialize_pointers = true;
-        ctx.set_pointer_namespace(fn->name.hash());
-    } else {
-        ctx.set_pointer_namespace(0);
     }
     if (flags & CF_NoDebugInfo) {
         ctx.use_debug_info = false;
+    } else if (flags & CF_LineTablesOnly) {
+        ctx.line_tables_only = true;
     }
 
     LLVMIRGenerator::ModuleValuePair result;
@@ -3488,11 +4538,16 @@ SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
     } else if (flags & CF_DumpFunction) {
         LLVMDumpValue(func);
     }
+    // the code is in the JIT now; later modules only need the names and
+    // types that the generator caches
+    LLVMDisposeModule(module);
 
 #if 1
-    for (auto sym : bindsyms) {
+    for (size_t i = 0; i < bindsyms.size(); ++i) {
+        auto &&sym = bindsyms[i];
         void *ptr = (void *)SCOPES_GET_RESULT(get_address(sym.c_str()));
         set_address_name(ptr, String::from(sym.c_str(), sym.size()));
+        LLVMIRGenerator::func_addresses.insert({ctx.generated_functions[i], ptr});
     }
 #endif
 
@@ -3502,7 +4557,17 @@ SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
         print_disassembly(funcname, pfunc);
     }
 
-    return ref(fn.anchor(), ConstPointer::from(functype, pfunc).cast<ConstPointer>());
+    auto result_ptr = ref(fn.anchor(), ConstPointer::from(functype, pfunc).cast<ConstPointer>());
+    if (flags & CF_Release) {
+        // the function is now only ever referenced by its symbol
+        release_function(fn);
+    }
+    sweep_functions_on_threshold();
+    return result_ptr;
+}
+
+bool is_function_compiled(Function *fn) {
+    return LLVMIRGenerator::func_cache.count(fn) != 0;
 }
 
 } // namespace scopes
@@ -11,6 +11,7 @@
 #include "valueref.inc"
 
 #include <stdint.h>
+#include <string>
 
 namespace scopes {
 
@@ -24,6 +25,7 @@ struct Scope;
     T(CFK_ASM, "compiler-file-kind-asm") \
     T(CFK_BC, "compiler-file-kind-bc") \
     T(CFK_LLVM, "compiler-file-kind-llvm") \
+    T(CFK_ThinBC, "compiler-file-kind-thin-bc") \
 
 enum CompilerFileKind {
 #define T(NAME, KNAME) NAME,
@@ -35,7 +37,15 @@ template <typename T>
 SCOPES_RESULT(T) compile_object(const String *triple, CompilerFileKind kind,
     const String *path, const Scope *scope, uint64_t flags);
 
+// cpu and features of the target machines used by compile_object; a cpu
+// of "native" selects the host cpu and, if features are empty, its features
+void set_object_target_cpu(const char *cpu, const char *features);
+void get_object_target_cpu(std::string &cpu, std::string &features);
+
 SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags);
+// true if the function has been generated for the JIT, so that further
+// modules only refer to it by symbol
+bool is_function_compiled(Function *fn);
 
 } // namespace scopes
 
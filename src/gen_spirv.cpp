@@ -18,7 +18,9 @@
 #include "compiler_flags.hpp"
 #include "prover.hpp"
 #include "hash.hpp"
+#include "cache.hpp"
 #include "qualifiers.hpp"
+#include "thread_pool.hpp"
 #include "qualifier.inc"
 #include "verify_tools.inc"
 #include "symbol_enum.inc"
@@ -37,6 +39,9 @@
 #include "dyn_cast.inc"
 #include "absl/container/flat_hash_map.h"
 
+#include <map>
+#include <mutex>
+
 #pragma GCC diagnostic ignored "-Wvla-extension"
 
 namespace scopes {
@@ -52,6 +57,52 @@ namespace scopes {
     T(OpFwidth) \
     T(OpSampledImage) \
 
+// prefix: spirv; each takes the subgroup scope as its first operand and needs
+// the GroupNonUniform capability as well as its own
+#define SCOPES_INTR_SPIRV_GROUP_OPS() \
+    T(OpGroupNonUniformElect, GroupNonUniform) \
+    T(OpGroupNonUniformAll, GroupNonUniformVote) \
+    T(OpGroupNonUniformAny, GroupNonUniformVote) \
+    T(OpGroupNonUniformAllEqual, GroupNonUniformVote) \
+    T(OpGroupNonUniformBroadcast, GroupNonUniformBallot) \
+    T(OpGroupNonUniformBroadcastFirst, GroupNonUniformBallot) \
+    T(OpGroupNonUniformBallot, GroupNonUniformBallot) \
+    T(OpGroupNonUniformInverseBallot, GroupNonUniformBallot) \
+    T(OpGroupNonUniformBallotBitExtract, GroupNonUniformBallot) \
+    T(OpGroupNonUniformBallotFindLSB, GroupNonUniformBallot) \
+    T(OpGroupNonUniformBallotFindMSB, GroupNonUniformBallot) \
+    T(OpGroupNonUniformShuffle, GroupNonUniformShuffle) \
+    T(OpGroupNonUniformShuffleXor, GroupNonUniformShuffle) \
+    T(OpGroupNonUniformShuffleUp, GroupNonUniformShuffleRelative) \
+    T(OpGroupNonUniformShuffleDown, GroupNonUniformShuffleRelative) \
+    T(OpGroupNonUniformQuadBroadcast, GroupNonUniformQuad) \
+    T(OpGroupNonUniformQuadSwap, GroupNonUniformQuad) \
+
+// prefix: spirv; like the group ops, but also take a group operation, which
+// is Reduce for the plain name, or selected by the suffixes
+// .InclusiveScan, .ExclusiveScan and .ClusteredReduce. the clustered
+// reduction takes the cluster size as a last argument.
+#define SCOPES_INTR_SPIRV_GROUP_ARITH_OPS() \
+    T(OpGroupNonUniformBallotBitCount, GroupNonUniformBallot) \
+    T(OpGroupNonUniformIAdd, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformFAdd, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformIMul, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformFMul, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformSMin, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformUMin, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformFMin, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformSMax, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformUMax, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformFMax, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformBitwiseAnd, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformBitwiseOr, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformBitwiseXor, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformLogicalAnd, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformLogicalOr, GroupNonUniformArithmetic) \
+    T(OpGroupNonUniformLogicalXor, GroupNonUniformArithmetic) \
+
+// subgroup instructions were added to the core in this version
+#define SCOPES_SPIRV_GROUP_OPS_VERSION 0x10300
 
 // prefix: GLSLstd450
 #define SCOPES_GLSL_STD_450_FUNCS() \
@@ -183,15 +234,21 @@ static void format_spv_location(StyledStream &ss, const char* source,
     ss << ":" << Style_None << " ";
 }
 
-static SCOPES_RESULT(void) verify_spirv(spv_target_env env, std::vector<unsigned int> &contents) {
-    SCOPES_RESULT_TYPE(void);
-    //spvtools::ValidatorOptions options;
-
-    StyledString ss;
-    spvtools::SpirvTools tools(env);
-    tools.SetMessageConsumer([&ss](spv_message_level_t level, const char* source,
+// messages of the validation running on this thread
+static thread_local StyledString *validation_messages = nullptr;
+
+// every thread keeps one validator per environment
+static spvtools::SpirvTools &get_spirv_validator(spv_target_env env) {
+    static thread_local std::map<spv_target_env, spvtools::SpirvTools *> validators;
+    auto it = validators.find(env);
+    if (it != validators.end())
+        return *it->second;
+    auto tools = new spvtools::SpirvTools(env);
+    tools->SetMessageConsumer([](spv_message_level_t level, const char* source,
                                 const spv_position_t& position,
                                 const char* message) {
+        assert(validation_messages);
+        auto &ss = *validation_messages;
         switch (level) {
         case SPV_MSG_FATAL:
         case SPV_MSG_INTERNAL_ERROR:
@@ -214,11 +271,22 @@ static SCOPES_RESULT(void) verify_spirv(spv_target_env env, std::vector<unsigned
             break;
         }
     });
+    validators.insert({env, tools});
+    return *tools;
+}
+
+static SCOPES_RESULT(void) verify_spirv(spv_target_env env, std::vector<unsigned int> &contents) {
+    SCOPES_RESULT_TYPE(void);
+    //spvtools::ValidatorOptions options;
 
+    StyledString ss;
+    auto &tools = get_spirv_validator(env);
+    validation_messages = &ss;
     bool succeed = tools.Validate(contents);
+    validation_messages = nullptr;
     if (!succeed) {
         disassemble_spirv(contents, true);
-        SCOPES_CERR << ss._ss.str();
+        SCOPES_CERR << ss.cppstr();
         SCOPES_ERROR(CGenBackendValidationFailed);
     }
     return {};
@@ -237,14 +305,26 @@ struct SPIRVGenerator {
     typedef std::vector<spv::Id> Ids;
 
     absl::flat_hash_map<ValueIndex, spv::Id, ValueIndex::Hash> ref2value;
+    // first values of the function being generated, by value id
+    std::vector<spv::Id> function_values;
     absl::flat_hash_map<Function *, spv::Function *> func2func;
     std::deque<FunctionRef> function_todo;
     absl::flat_hash_map<TypeFlagPair, spv::Id, HashTypeFlagsPair> type_cache;
 
     absl::flat_hash_map<int, ExecutionMode *> execution_modes;
 
-    absl::flat_hash_map<Symbol, spv::Id, Symbol::Hash> intrinsics;
-    absl::flat_hash_map<Symbol, spv::Id, Symbol::Hash> intrinsic_ops;
+    struct GroupOp {
+        spv::Op op;
+        spv::Capability capability;
+        // -1 if the instruction takes no group operation
+        int group_operation;
+    };
+
+    // the GLSL.std.450 and spirv intrinsics by name, built once
+    static absl::flat_hash_map<Symbol, spv::Id, Symbol::Hash> intrinsics;
+    static absl::flat_hash_map<Symbol, spv::Id, Symbol::Hash> intrinsic_ops;
+    static absl::flat_hash_map<Symbol, GroupOp, Symbol::Hash> group_ops;
+    static std::once_flag intrinsics_once;
 
     spv::SpvBuildLogger logger;
     spv::Builder builder;
@@ -257,45 +337,35 @@ struct SPIRVGenerator {
     spv_target_env env;
     int version;
     bool use_combined_image_samplers = false;
+    // set once a subgroup instruction or builtin is used, which raises the
+    // SPIR-V version of the module
+    bool uses_group_ops = false;
 
     spv::Id get_op_ex(Symbol name) {
         auto it = intrinsic_ops.find(name);
         if (it != intrinsic_ops.end())
             return it->second;
-        auto str = name.name();
-        spv::Id result = 0;
-        // prefix: spirv
-        #define T(NAME) \
-            if (!strncmp(str->data, "spirv." #NAME, sizeof("spirv." #NAME))) { \
-                result = spv::NAME; \
-            } else
-        SCOPES_INTR_SPIRV_OPS()
-        #undef T
-        /* else */ {}
-        if (result) {
-            intrinsic_ops.insert({name, result});
-        }
-        return result;
+        return 0;
+    }
+
+    const GroupOp *get_group_op(Symbol name) {
+        auto it = group_ops.find(name);
+        if (it != group_ops.end())
+            return &it->second;
+        return nullptr;
+    }
+
+    void add_group_capability(spv::Capability capability) {
+        builder.addCapability(spv::CapabilityGroupNonUniform);
+        builder.addCapability(capability);
+        uses_group_ops = true;
     }
 
     spv::Id get_intrinsic(Symbol name) {
         auto it = intrinsics.find(name);
         if (it != intrinsics.end())
             return it->second;
-        auto str = name.name();
-        spv::Id result = 0;
-        // prefix: GLSLstd450
-        #define T(NAME) \
-            if (!strncmp(str->data, "GLSL.std.450." #NAME, sizeof("GLSL.std.450." #NAME))) { \
-                result = GLSLstd450 ## NAME; \
-            } else
-        SCOPES_GLSL_STD_450_FUNCS()
-        #undef T
-        /* else */ {}
-        if (result) {
-            intrinsics.insert({name, result});
-        }
-        return result;
+        return 0;
     }
 
     static const Type *arguments_to_tuple(const Type *T) {
@@ -449,6 +519,39 @@ struct SPIRVGenerator {
     }
 
     static void static_init() {
+        // shaders may be generated on several threads at once
+        std::call_once(intrinsics_once, []{
+            // prefix: spirv
+            #define T(NAME) \
+                intrinsic_ops.insert({ Symbol("spirv." #NAME), spv::NAME });
+            SCOPES_INTR_SPIRV_OPS()
+            #undef T
+            #define T(NAME, CAPABILITY) \
+                group_ops.insert({ Symbol("spirv." #NAME), \
+                    { spv::NAME, spv::Capability ## CAPABILITY, -1 } });
+            SCOPES_INTR_SPIRV_GROUP_OPS()
+            #undef T
+            #define T(NAME, CAPABILITY) \
+                group_ops.insert({ Symbol("spirv." #NAME), \
+                    { spv::NAME, spv::Capability ## CAPABILITY, \
+                        spv::GroupOperationReduce } }); \
+                group_ops.insert({ Symbol("spirv." #NAME ".InclusiveScan"), \
+                    { spv::NAME, spv::Capability ## CAPABILITY, \
+                        spv::GroupOperationInclusiveScan } }); \
+                group_ops.insert({ Symbol("spirv." #NAME ".ExclusiveScan"), \
+                    { spv::NAME, spv::Capability ## CAPABILITY, \
+                        spv::GroupOperationExclusiveScan } }); \
+                group_ops.insert({ Symbol("spirv." #NAME ".ClusteredReduce"), \
+                    { spv::NAME, spv::Capability ## CAPABILITY, \
+                        spv::GroupOperationClusteredReduce } });
+            SCOPES_INTR_SPIRV_GROUP_ARITH_OPS()
+            #undef T
+            // prefix: GLSLstd450
+            #define T(NAME) \
+                intrinsics.insert({ Symbol("GLSL.std.450." #NAME), GLSLstd450 ## NAME });
+            SCOPES_GLSL_STD_450_FUNCS()
+            #undef T
+        });
     }
 
     SCOPES_RESULT(spv::Id) create_struct_type(const Type *type, uint64_t flags,
@@ -659,7 +762,13 @@ struct SPIRVGenerator {
 
     void bind(const ValueIndex &node, spv::Id value) {
         assert(value);
-        ref2value.insert({node, value});
+        int id = node.value->value_id;
+        if ((id >= 0) && !node.index) {
+            assert(id < function_values.size());
+            function_values[id] = value;
+        } else {
+            ref2value.insert({node, value});
+        }
     }
 
     SCOPES_RESULT(void) write_return(const Ids &values, bool is_except = false) {
@@ -750,9 +859,13 @@ struct SPIRVGenerator {
     SCOPES_RESULT(void) Function_finalize(const FunctionRef &node) {
         SCOPES_RESULT_TYPE(void);
 
+        if (node->released) {
+            SCOPES_ERROR(CGenFunctionReleased, node->name);
+        }
         functions_generated++;
 
         active_function = node;
+        function_values.assign(node->value_count, 0);
         auto it = func2func.find(node.unref());
         assert(it != func2func.end());
         spv::Function *func = it->second;
@@ -1027,6 +1140,20 @@ struct SPIRVGenerator {
         return {};
     }
 
+    // counts and vectorization hints have no equivalent in core SPIR-V
+    static unsigned int loop_control(const LoopHints &hints) {
+        unsigned int control = spv::LoopControlMaskNone;
+        if (hints.unroll > 0) {
+            control |= spv::LoopControlUnrollMask;
+        } else if (hints.unroll < 0) {
+            control |= spv::LoopControlDontUnrollMask;
+        }
+        if (hints.independent) {
+            control |= spv::LoopControlDependencyInfiniteMask;
+        }
+        return control;
+    }
+
     SCOPES_RESULT(void) translate_LoopLabel(const LoopLabelRef &node) {
         SCOPES_RESULT_TYPE(void);
         LabelInfo *li_break = find_label_info_by_kind(LK_Break);
@@ -1046,7 +1173,7 @@ struct SPIRVGenerator {
         SCOPES_CHECK_RESULT(build_phi(headerphi, node->args));
         if (li_break) {
             builder.createLoopMerge(li_break->bb_merge,
-                loop_info.bb_loop, spv::LoopControlMaskNone);
+                loop_info.bb_loop, loop_control(node->hints));
         }
         auto bb_subheader = &builder.makeNewBlock();
         builder.createBranch(bb_subheader);
@@ -1135,6 +1262,27 @@ struct SPIRVGenerator {
         }
         if (callee.isa<Global>()) {
             auto name = callee.cast<Global>()->name;
+            const GroupOp *group_op = get_group_op(name);
+            if (group_op) {
+                add_group_capability(group_op->capability);
+                if (group_op->group_operation == spv::GroupOperationClusteredReduce) {
+                    builder.addCapability(spv::CapabilityGroupNonUniformClustered);
+                }
+                auto ty = SCOPES_GET_RESULT(type_to_spirv_type(call->get_type()));
+                auto op = new spv::Instruction(
+                    builder.getUniqueId(), ty, group_op->op);
+                op->addIdOperand(builder.makeUintConstant(spv::ScopeSubgroup));
+                if (group_op->group_operation >= 0) {
+                    op->addImmediateOperand(group_op->group_operation);
+                }
+                for (auto &&arg : args) {
+                    op->addIdOperand(SCOPES_GET_RESULT(ref_to_value(arg)));
+                }
+                builder.getBuildPoint()->addInstruction(
+                    std::unique_ptr<spv::Instruction>(op));
+                map_phi({ op->getResultId() }, call);
+                return {};
+            }
             spv::Id ep = get_op_ex(name);
             if (ep) {
                 auto T = call->get_type();
@@ -1449,9 +1597,45 @@ struct SPIRVGenerator {
         return {};
     }
 
+    // the semantics of an atomic operation with the given order, covering
+    // every kind of memory that it can access
+    static unsigned memory_semantics(MemoryOrder order) {
+        unsigned semantics = 0;
+        switch(order) {
+        case MemoryOrderAcquire:
+            semantics = spv::MemorySemanticsAcquireMask; break;
+        case MemoryOrderRelease:
+            semantics = spv::MemorySemanticsReleaseMask; break;
+        case MemoryOrderAcqRel:
+            semantics = spv::MemorySemanticsAcquireReleaseMask; break;
+        case MemoryOrderSeqCst:
+            semantics = spv::MemorySemanticsSequentiallyConsistentMask; break;
+        default:
+            // relaxed operations order no other memory accesses
+            return spv::MemorySemanticsMaskNone;
+        }
+        return semantics
+            | spv::MemorySemanticsSubgroupMemoryMask
+            | spv::MemorySemanticsWorkgroupMemoryMask
+            | spv::MemorySemanticsCrossWorkgroupMemoryMask;
+    }
+
     SCOPES_RESULT(void) translate_Load(const LoadRef &node) {
         SCOPES_RESULT_TYPE(void);
         auto ptr = SCOPES_GET_RESULT(ref_to_value(node->value));
+        if (node->is_atomic()) {
+            auto ty = SCOPES_GET_RESULT(type_to_spirv_type(node->get_type()));
+            auto instr = new spv::Instruction(builder.getUniqueId(), ty,
+                spv::OpAtomicLoad);
+            instr->addIdOperand(ptr);
+            instr->addIdOperand(builder.makeUintConstant(spv::ScopeCrossDevice));
+            instr->addIdOperand(builder.makeUintConstant(
+                memory_semantics(node->order)));
+            builder.getBuildPoint()->addInstruction(
+                std::unique_ptr<spv::Instruction>(instr));
+            map_phi({ instr->getResultId() }, node);
+            return {};
+        }
         auto val = builder.createLoad(ptr);
         if (node->is_volatile) {
             builder.getInstruction(val)->addImmediateOperand(
@@ -1465,6 +1649,17 @@ struct SPIRVGenerator {
         SCOPES_RESULT_TYPE(void);
         auto value = SCOPES_GET_RESULT(ref_to_value(node->value));
         auto ptr = SCOPES_GET_RESULT(ref_to_value(node->target));
+        if (node->is_atomic()) {
+            auto instr = new spv::Instruction(spv::OpAtomicStore);
+            instr->addIdOperand(ptr);
+            instr->addIdOperand(builder.makeUintConstant(spv::ScopeCrossDevice));
+            instr->addIdOperand(builder.makeUintConstant(
+                memory_semantics(node->order)));
+            instr->addIdOperand(value);
+            builder.getBuildPoint()->addInstruction(
+                std::unique_ptr<spv::Instruction>(instr));
+            return {};
+        }
         builder.createStore(value, ptr);
         return {};
     }
@@ -1493,13 +1688,9 @@ struct SPIRVGenerator {
         auto instr = new spv::Instruction(builder.getUniqueId(), ty, op);
         instr->addIdOperand(ptr);
         auto scope = spv::ScopeCrossDevice;
-        auto memory_access =
-            (1 << spv::MemorySemanticsSequentiallyConsistentShift)
-            | (1 << spv::MemorySemanticsSubgroupMemoryShift)
-            | (1 << spv::MemorySemanticsWorkgroupMemoryShift)
-            | (1 << spv::MemorySemanticsCrossWorkgroupMemoryShift);
         instr->addIdOperand(builder.makeUintConstant(scope));
-        instr->addIdOperand(builder.makeUintConstant(memory_access));
+        instr->addIdOperand(builder.makeUintConstant(
+            memory_semantics(node->order)));
         instr->addIdOperand(value);
         builder.getBuildPoint()->addInstruction(
             std::unique_ptr<spv::Instruction>(instr));
@@ -1519,14 +1710,12 @@ struct SPIRVGenerator {
             spv::OpAtomicCompareExchange);
         instr->addIdOperand(ptr);
         auto scope = spv::ScopeCrossDevice;
-        auto memory_access =
-            (1 << spv::MemorySemanticsSequentiallyConsistentShift)
-            | (1 << spv::MemorySemanticsSubgroupMemoryShift)
-            | (1 << spv::MemorySemanticsWorkgroupMemoryShift)
-            | (1 << spv::MemorySemanticsCrossWorkgroupMemoryShift);
         instr->addIdOperand(builder.makeUintConstant(scope));
-        instr->addIdOperand(builder.makeUintConstant(memory_access));
-        instr->addIdOperand(builder.makeUintConstant(memory_access));
+        // semantics when the values are equal, then when they are not
+        instr->addIdOperand(builder.makeUintConstant(
+            memory_semantics(node->success_order)));
+        instr->addIdOperand(builder.makeUintConstant(
+            memory_semantics(node->failure_order)));
         instr->addIdOperand(value);
         instr->addIdOperand(cmp);
         builder.getBuildPoint()->addInstruction(
@@ -1599,6 +1788,12 @@ struct SPIRVGenerator {
         return {};
     }
 
+    SCOPES_RESULT(void) translate_Fence(const FenceRef &node) {
+        builder.createMemoryBarrier(spv::ScopeDevice,
+            memory_semantics(node->order));
+        return {};
+    }
+
     SCOPES_RESULT(void) translate_Annotate(const AnnotateRef &node) {
         return {};
     }
@@ -1700,6 +1895,12 @@ struct SPIRVGenerator {
             auto val = builder.createUnaryOp(spv::OpFNegate, rtype, x);
             map_phi({ val }, node); return {};
         } break;
+        // hints without an equivalent in core SPIR-V
+        case UnOpAssume:
+        case UnOpPrefetch:
+        case UnOpPrefetchWrite: {
+            map_phi({ x }, node); return {};
+        } break;
         case UnOpBitReverse: {
             auto val = builder.createUnaryOp(spv::OpBitReverse, rtype, x);
             map_phi({ val }, node); return {};
@@ -1787,6 +1988,8 @@ struct SPIRVGenerator {
         case BinOpStep: _builtin = GLSLstd450Step; goto defbuiltin;
         case BinOpPow: _builtin = GLSLstd450Pow; goto defbuiltin;
         case BinOpCross: _builtin = GLSLstd450Cross; goto defbuiltin;
+        // branch hints need SPV_KHR_expect_assume
+        case BinOpExpect: val = a; goto done;
         default: {
             SCOPES_ERROR(CGenUnsupportedBinOp);
         } break;
@@ -1980,6 +2183,12 @@ struct SPIRVGenerator {
 
     SCOPES_RESULT(spv::Id) ref_to_value(const ValueIndex &ref) {
         SCOPES_RESULT_TYPE(spv::Id);
+        int id = ref.value->value_id;
+        if ((id >= 0) && !ref.index) {
+            assert(id < function_values.size());
+            if (function_values[id])
+                return function_values[id];
+        }
         auto it = ref2value.find(ref);
         if (it != ref2value.end())
             return it->second;
@@ -2023,8 +2232,55 @@ struct SPIRVGenerator {
         SCOPES_ERROR(CGenFailedToTranslateValue, node->kind());
     }
 
+    SCOPES_RESULT(spv::Id) spec_constant_to_value(const GlobalRef &node) {
+        SCOPES_RESULT_TYPE(spv::Id);
+        auto init = node->initializer;
+        if ((node->location < 0) || !init) {
+            SCOPES_ERROR(CGenInvalidSpecConstant, node);
+        }
+        auto ty = SCOPES_GET_RESULT(type_to_spirv_type(node->element_type));
+        auto TT = SCOPES_GET_RESULT(storage_type(node->element_type));
+        spv::Id value = 0;
+        if (init.isa<ConstInt>() && (TT->kind() == TK_Integer)) {
+            auto it = cast<IntegerType>(TT);
+            uint64_t x = init.cast<ConstInt>()->msw();
+            switch(it->width) {
+            case 1: value = builder.makeBoolConstant(x != 0, true); break;
+            case 8:
+            case 16:
+            case 32:
+                value = builder.makeIntConstant(ty, (unsigned)x, true); break;
+            case 64:
+                value = it->issigned?
+                    builder.makeInt64Constant((long long)x, true)
+                    :builder.makeUint64Constant(x, true);
+                break;
+            default: break;
+            }
+        } else if (init.isa<ConstReal>() && (TT->kind() == TK_Real)) {
+            auto rt = cast<RealType>(TT);
+            auto x = init.cast<ConstReal>()->value;
+            switch(rt->width) {
+            case 32: value = builder.makeFloatConstant(x, true); break;
+            case 64: value = builder.makeDoubleConstant(x, true); break;
+            default: break;
+            }
+        }
+        if (!value) {
+            SCOPES_ERROR(CGenInvalidSpecConstant, node);
+        }
+        builder.addDecoration(value, spv::DecorationSpecId, node->location);
+        // loads from the variable read the specialized value
+        auto id = builder.createVariable(spv::StorageClassPrivate, ty,
+            node->name.name()->data);
+        builder.getInstruction(id)->addIdOperand(value);
+        return id;
+    }
+
     SCOPES_RESULT(spv::Id) Global_to_value(const GlobalRef &node) {
         SCOPES_RESULT_TYPE(spv::Id);
+        if (node->flags & GF_SpecConstant)
+            return spec_constant_to_value(node);
         spv::StorageClass sc = SCOPES_GET_RESULT(storage_class_from_extern_class(
             node->storage_class));
         const char *name = nullptr;
@@ -2058,6 +2314,19 @@ struct SPIRVGenerator {
         case spv::BuiltInSamplePosition:
             builder.addCapability(spv::CapabilitySampleRateShading);
             break;
+        case spv::BuiltInSubgroupSize:
+        case spv::BuiltInSubgroupLocalInvocationId:
+        case spv::BuiltInNumSubgroups:
+        case spv::BuiltInSubgroupId:
+            add_group_capability(spv::CapabilityGroupNonUniform);
+            break;
+        case spv::BuiltInSubgroupEqMaskKHR:
+        case spv::BuiltInSubgroupGeMaskKHR:
+        case spv::BuiltInSubgroupGtMaskKHR:
+        case spv::BuiltInSubgroupLeMaskKHR:
+        case spv::BuiltInSubgroupLtMaskKHR:
+            add_group_capability(spv::CapabilityGroupNonUniformBallot);
+            break;
         default: break;
         }
         auto ty = SCOPES_GET_RESULT(type_to_spirv_type(node->element_type, node->flags));
@@ -2237,7 +2506,21 @@ struct SPIRVGenerator {
 
         auto ret = builder.createFunctionCall(func, values);
 
-        if (fi->has_exception()) {
+        if (fi->has_exception() && !call->except) {
+            // the callee never raises; skip the ok flag
+            if (!is_returning(fi->return_type)) {
+                builder.makeUnreachable();
+            } else if (is_returning_value(fi->return_type)) {
+                int retvalue_index =
+                    (is_returning_value(fi->except_type)?2:1);
+                ret = builder.createCompositeExtract(ret,
+                    builder.getContainedTypeId(builder.getTypeId(ret), retvalue_index),
+                    retvalue_index);
+                Ids values;
+                struct_to_values(values, fi->return_type, ret);
+                map_phi(values, call);
+            }
+        } else if (fi->has_exception()) {
             bool has_except_value = is_returning_value(fi->except_type);
             bool has_return_value = is_returning_value(fi->return_type);
             if (has_except_value) {
@@ -2367,23 +2650,36 @@ struct SPIRVGenerator {
         default: break;
         }
 
+        if (uses_group_ops && (version < SCOPES_SPIRV_GROUP_OPS_VERSION)) {
+            version = SCOPES_SPIRV_GROUP_OPS_VERSION;
+        }
         if (this->version != 0) {
             version = this->version;
         }
         builder.dump(version, result);
-
-        SCOPES_CHECK_RESULT(verify_spirv(env, result));
-
         return {};
     }
 
 };
 
+absl::flat_hash_map<Symbol, spv::Id, Symbol::Hash> SPIRVGenerator::intrinsics;
+absl::flat_hash_map<Symbol, spv::Id, Symbol::Hash> SPIRVGenerator::intrinsic_ops;
+absl::flat_hash_map<Symbol, SPIRVGenerator::GroupOp, Symbol::Hash> SPIRVGenerator::group_ops;
+std::once_flag SPIRVGenerator::intrinsics_once;
+
 //------------------------------------------------------------------------------
 
-SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int> &result, int opt_level) {
-    SCOPES_RESULT_TYPE(void);
-    spvtools::Optimizer optimizer(env);
+// pass lists are the same for every run in an environment, so every thread
+// keeps one optimizer per environment and level
+static spvtools::Optimizer &get_spirv_optimizer(spv_target_env env, int opt_level) {
+    static thread_local std::map<std::pair<spv_target_env, int>,
+        spvtools::Optimizer *> optimizers;
+    auto key = std::make_pair(env, opt_level);
+    auto it = optimizers.find(key);
+    if (it != optimizers.end())
+        return *it->second;
+    auto optimizer_ptr = new spvtools::Optimizer(env);
+    auto &optimizer = *optimizer_ptr;
     /*
     optimizer.SetMessageConsumer([](spv_message_level_t level, const char* source,
         const spv_position_t& position,
@@ -2391,10 +2687,10 @@ SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int>
     SCOPES_CERR << StringifyMessage(level, source, position, message)
     << std::endl;
     });*/
-    StyledStream ss(SCOPES_CERR);
-    optimizer.SetMessageConsumer([&ss](spv_message_level_t level, const char*,
+    optimizer.SetMessageConsumer([](spv_message_level_t level, const char*,
         const spv_position_t& position,
         const char* message) {
+        StyledStream ss(SCOPES_CERR);
         switch (level) {
         case SPV_MSG_FATAL:
         case SPV_MSG_INTERNAL_ERROR:
@@ -2442,8 +2738,18 @@ SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int>
     optimizer.RegisterPass(spvtools::CreateFlattenDecorationPass());
     //optimizer.RegisterPass(spvtools::CreateCompactIdsPass());
 
-    std::vector<unsigned int> oldresult = result;
-    result.clear();
+    optimizers.insert({key, optimizer_ptr});
+    return optimizer;
+}
+
+SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int> &result, int opt_level) {
+    SCOPES_RESULT_TYPE(void);
+    auto &optimizer = get_spirv_optimizer(env, opt_level);
+
+    // the optimizer needs separate buffers for input and output; take the
+    // input over instead of copying it
+    std::vector<unsigned int> oldresult;
+    oldresult.swap(result);
     if (!optimizer.Run(oldresult.data(), oldresult.size(), &result)) {
         SCOPES_ERROR(CGenBackendOptimizationFailed);
     }
@@ -2452,26 +2758,102 @@ SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int>
     return {};
 }
 
-SCOPES_RESULT(const String *) compile_spirv(int version, Symbol target, const FunctionRef &fn, uint64_t flags) {
-    SCOPES_RESULT_TYPE(const String *);
-    Timer sum_compile_time(TIMER_CompileSPIRV);
+// shaders are cached under the generated module, which is quick to build;
+// optimizing and translating it is what makes up most of the compile time
+static const String *get_shader_cache_key(const char *kind, int version,
+    Symbol target, uint64_t flags, const std::vector<unsigned int> &module) {
+#if SCOPES_ALLOW_CACHE
+    // dumps are written while compiling, so they must bypass the cache
+    if (flags & (CF_DumpDisassembly | CF_DumpModule | CF_DumpFunction))
+        return nullptr;
+    uint64_t h = hash2(hash_bytes(kind, strlen(kind)),
+        hash2(target.hash(), (uint64_t)version));
+    h = hash2(h, flags & SCOPES_CACHE_COMPILER_FLAGS);
+    return get_cache_key(h, (const char *)module.data(),
+        module.size() * sizeof(unsigned int));
+#else
+    return nullptr;
+#endif
+}
+
+static const String *get_cached_shader(const String *key) {
+    if (!key)
+        return nullptr;
+    size_t size = 0;
+    auto cached = get_cache(key, size);
+    if (!cached)
+        return nullptr;
+    return String::from(cached, size);
+}
+
+static void set_cached_shader(const String *key, const String *shader) {
+    if (key) {
+        set_cache(key, nullptr, 0, shader->data, shader->count);
+    }
+}
+
+static spv_target_env get_glsl_target_env(int version) {
+    switch (version) {
+    case 400: return SPV_ENV_OPENGL_4_0;
+    case 410: return SPV_ENV_OPENGL_4_1;
+    case 420: return SPV_ENV_OPENGL_4_2;
+    case 430: return SPV_ENV_OPENGL_4_3;
+    case 450: return SPV_ENV_OPENGL_4_5;
+    default: return SPV_ENV_OPENGL_4_5;
+    }
+}
 
+// a shader is generated on the calling thread, as generating it looks into
+// the compiler's state, while finishing it only works on the module
+struct ShaderBuild {
+    bool glsl;
+    int version;
+    Symbol target;
+    uint64_t flags;
+    spv_target_env env;
+    std::vector<unsigned int> module;
+    const String *key;
+    // set once the shader is cached or finished
+    const String *shader;
+
+    ShaderBuild(bool _glsl, int _version, Symbol _target, uint64_t _flags) :
+        glsl(_glsl), version(_version), target(_target), flags(_flags),
+        env(_glsl?get_glsl_target_env(_version):SPV_ENV_VULKAN_1_1_SPIRV_1_4),
+        key(nullptr), shader(nullptr) {}
+};
+
+static SCOPES_RESULT(void) generate_shader(ShaderBuild &build, const FunctionRef &fn) {
+    SCOPES_RESULT_TYPE(void);
     //SCOPES_CHECK_RESULT(fn->verify_compilable());
 
-    const spv_target_env env = SPV_ENV_VULKAN_1_1_SPIRV_1_4;
-    SPIRVGenerator ctx(env, version);
-    if (flags & CF_NoDebugInfo) {
+    SPIRVGenerator ctx(build.env, build.glsl?0:build.version);
+    if (build.flags & CF_NoDebugInfo) {
         ctx.use_debug_info = false;
     }
 
-    std::vector<unsigned int> result;
     {
         Timer generate_timer(TIMER_GenerateSPIRV);
         SCOPES_CHECK_RESULT(
-            ctx.generate(result, target, fn));
+            ctx.generate(build.module, build.target, fn));
+    }
+    // OpenGL environments only accept SPIR-V 1.0, which lacks subgroup
+    // instructions; SPIRV-Cross translates them to GL_KHR_shader_subgroup
+    if (build.glsl && ctx.uses_group_ops) {
+        build.env = SPV_ENV_UNIVERSAL_1_3;
     }
 
+    build.key = get_shader_cache_key(build.glsl?"glsl":"spirv",
+        build.version, build.target, build.flags, build.module);
+    build.shader = get_cached_shader(build.key);
+    return {};
+}
 
+static SCOPES_RESULT(const String *) finish_shader(ShaderBuild &build) {
+    SCOPES_RESULT_TYPE(const String *);
+    // the generated module is only validated when it isn't cached yet, and
+    // then off the generating thread
+    SCOPES_CHECK_RESULT(verify_spirv(build.env, build.module));
+    auto flags = build.flags;
     if (flags & CF_O3) {
         int level = 0;
         if ((flags & CF_O3) == CF_O1)
@@ -2480,117 +2862,133 @@ SCOPES_RESULT(const String *) compile_spirv(int version, Symbol target, const Fu
             level = 2;
         else if ((flags & CF_O3) == CF_O3)
             level = 3;
-        SCOPES_CHECK_RESULT(optimize_spirv(env, result, level));
+        SCOPES_CHECK_RESULT(optimize_spirv(build.env, build.module, level));
     }
 
-    if (flags & CF_DumpModule) {
-    } else if (flags & CF_DumpFunction) {
-    }
     if (flags & CF_DumpDisassembly) {
-        disassemble_spirv(result);
+        disassemble_spirv(build.module);
     }
 
-    size_t bytesize = sizeof(unsigned int) * result.size();
+    const String *shader = nullptr;
+    if (build.glsl) {
+        spirv_cross::CompilerGLSL glsl(std::move(build.module));
 
-    return String::from((char *)result.data(), bytesize);
-}
+        /*
+        // The SPIR-V is now parsed, and we can perform reflection on it.
+        spirv_cross::ShaderResources resources = glsl.get_shader_resources();
+        // Get all sampled images in the shader.
+        for (auto &resource : resources.sampled_images)
+        {
+            unsigned set = glsl.get_decoration(resource.id, spv::DecorationDescriptorSet);
+            unsigned binding = glsl.get_decoration(resource.id, spv::DecorationBinding);
+            printf("Image %s at set = %u, binding = %u\n", resource.name.c_str(), set, binding);
 
-const String *spirv_to_glsl(const String *binary) {
-    std::vector<unsigned int> bytes;
-    unsigned int sz = binary->count / sizeof(unsigned int);
-    bytes.resize(sz);
-    memcpy(bytes.data(), binary->data, binary->count);
+            // Modify the decoration to prepare it for GLSL.
+            glsl.unset_decoration(resource.id, spv::DecorationDescriptorSet);
 
-	spirv_cross::CompilerGLSL glsl(std::move(bytes));
+            // Some arbitrary remapping if we want.
+            glsl.set_decoration(resource.id, spv::DecorationBinding, set * 16 + binding);
+        }
+        */
 
-    // Set some options.
-    spirv_cross::CompilerGLSL::Options options;
-    options.version = 450;
-    options.vulkan_semantics = true;
-    glsl.build_combined_image_samplers();
-    glsl.set_common_options(options);
+        // Set some options.
+        spirv_cross::CompilerGLSL::Options options;
+        options.version = (build.version <= 0)?450:build.version;
+        glsl.set_common_options(options);
 
-    // Compile to GLSL, ready to give to GL driver.
-    std::string source = glsl.compile();
+        // Compile to GLSL, ready to give to GL driver.
+        std::string source = glsl.compile();
 
-    return String::from_stdstring(source);
+        if (flags & (CF_DumpModule|CF_DumpFunction)) {
+            std::cout << source << std::endl;
+        }
+
+        shader = String::from_stdstring(source);
+    } else {
+        size_t bytesize = sizeof(unsigned int) * build.module.size();
+        shader = String::from((char *)build.module.data(), bytesize);
+    }
+
+    set_cached_shader(build.key, shader);
+    return shader;
 }
 
-SCOPES_RESULT(const String *) compile_glsl(int version, Symbol target, const FunctionRef &fn, uint64_t flags) {
+static SCOPES_RESULT(const String *) compile_shader(bool glsl, int version,
+    Symbol target, const FunctionRef &fn, uint64_t flags) {
     SCOPES_RESULT_TYPE(const String *);
     Timer sum_compile_time(TIMER_CompileSPIRV);
 
-    //SCOPES_CHECK_RESULT(fn->verify_compilable());
+    ShaderBuild build(glsl, version, target, flags);
+    SCOPES_CHECK_RESULT(generate_shader(build, fn));
+    if (build.shader)
+        return build.shader;
+    return finish_shader(build);
+}
 
-    spv_target_env env = SPV_ENV_OPENGL_4_5;
-    switch (version) {
-    case 400: env = SPV_ENV_OPENGL_4_0; break;
-    case 410: env = SPV_ENV_OPENGL_4_1; break;
-    case 420: env = SPV_ENV_OPENGL_4_2; break;
-    case 430: env = SPV_ENV_OPENGL_4_3; break;
-    case 450: env = SPV_ENV_OPENGL_4_5; break;
-    default: break;
-    }
+SCOPES_RESULT(const String *) compile_spirv(int version, Symbol target, const FunctionRef &fn, uint64_t flags) {
+    return compile_shader(false, version, target, fn, flags);
+}
 
-    SPIRVGenerator ctx(env, 0);
-    if (flags & CF_NoDebugInfo) {
-        ctx.use_debug_info = false;
-    }
+SCOPES_RESULT(const String *) compile_glsl(int version, Symbol target, const FunctionRef &fn, uint64_t flags) {
+    return compile_shader(true, version, target, fn, flags);
+}
 
-    std::vector<unsigned int> result;
-    {
-        Timer generate_timer(TIMER_GenerateSPIRV);
-        SCOPES_CHECK_RESULT(
-            ctx.generate(result, target, fn));
-    }
+SCOPES_RESULT(void) compile_shaders(bool glsl, const std::vector<ShaderJob> &jobs,
+    std::vector<const String *> &shaders) {
+    SCOPES_RESULT_TYPE(void);
+    Timer sum_compile_time(TIMER_CompileSPIRV);
 
-    if (flags & CF_O3) {
-        int level = 0;
-        if ((flags & CF_O3) == CF_O1)
-            level = 1;
-        else if ((flags & CF_O3) == CF_O2)
-            level = 2;
-        else if ((flags & CF_O3) == CF_O3)
-            level = 3;
-        SCOPES_CHECK_RESULT(optimize_spirv(env, result, level));
-    }
+    std::vector<ShaderBuild> builds;
+    builds.reserve(jobs.size());
+    std::vector<size_t> pending;
+    for (auto &&job : jobs) {
+        builds.push_back(ShaderBuild(glsl, job.version, job.target, job.flags));
+        SCOPES_CHECK_RESULT(generate_shader(builds.back(), job.fn));
+        if (!builds.back().shader)
+            pending.push_back(builds.size() - 1);
+    }
+
+    // pending shaders are finished on the thread pool
+    std::vector<Error *> errors;
+    errors.resize(builds.size(), nullptr);
+    parallel_for_each(pending.size(), [&](size_t i) {
+        auto &build = builds[pending[i]];
+        auto result = finish_shader(build);
+        if (result.ok()) {
+            build.shader = result.assert_ok();
+        } else {
+            errors[pending[i]] = result.assert_error();
+        }
+    });
 
-    if (flags & CF_DumpDisassembly) {
-        disassemble_spirv(result);
+    shaders.clear();
+    for (size_t i = 0; i < builds.size(); ++i) {
+        if (errors[i]) {
+            SCOPES_RETURN_ERROR(errors[i]);
+        }
+        shaders.push_back(builds[i].shader);
     }
+    return {};
+}
 
-	spirv_cross::CompilerGLSL glsl(std::move(result));
-
-    /*
-    // The SPIR-V is now parsed, and we can perform reflection on it.
-    spirv_cross::ShaderResources resources = glsl.get_shader_resources();
-    // Get all sampled images in the shader.
-    for (auto &resource : resources.sampled_images)
-    {
-        unsigned set = glsl.get_decoration(resource.id, spv::DecorationDescriptorSet);
-        unsigned binding = glsl.get_decoration(resource.id, spv::DecorationBinding);
-        printf("Image %s at set = %u, binding = %u\n", resource.name.c_str(), set, binding);
-
-        // Modify the decoration to prepare it for GLSL.
-        glsl.unset_decoration(resource.id, spv::DecorationDescriptorSet);
+const String *spirv_to_glsl(const String *binary) {
+    std::vector<unsigned int> bytes;
+    unsigned int sz = binary->count / sizeof(unsigned int);
+    bytes.resize(sz);
+    memcpy(bytes.data(), binary->data, binary->count);
 
-        // Some arbitrary remapping if we want.
-        glsl.set_decoration(resource.id, spv::DecorationBinding, set * 16 + binding);
-    }
-    */
+	spirv_cross::CompilerGLSL glsl(std::move(bytes));
 
     // Set some options.
     spirv_cross::CompilerGLSL::Options options;
-    options.version = (version <= 0)?450:version;
+    options.version = 450;
+    options.vulkan_semantics = true;
+    glsl.build_combined_image_samplers();
     glsl.set_common_options(options);
 
     // Compile to GLSL, ready to give to GL driver.
     std::string source = glsl.compile();
 
-    if (flags & (CF_DumpModule|CF_DumpFunction)) {
-        std::cout << source << std::endl;
-    }
-
     return String::from_stdstring(source);
 }
 
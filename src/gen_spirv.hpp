@@ -21,6 +21,18 @@ struct Function;
 SCOPES_RESULT(const String *) compile_spirv(int version, Symbol target, const FunctionRef &fn, uint64_t flags);
 SCOPES_RESULT(const String *) compile_glsl(int version, Symbol target, const FunctionRef &fn, uint64_t flags);
 
+struct ShaderJob {
+    int version;
+    Symbol target;
+    FunctionRef fn;
+    uint64_t flags;
+};
+
+// compiles all jobs as SPIR-V, or GLSL if glsl is set; the shaders are
+// generated in order and then optimized on as many threads as there are cores
+SCOPES_RESULT(void) compile_shaders(bool glsl, const std::vector<ShaderJob> &jobs,
+    std::vector<const String *> &shaders);
+
 const String *spirv_to_glsl(const String *binary);
 
 } // namespace scopes
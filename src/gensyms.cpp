@@ -10,16 +10,31 @@
 #include "hash.hpp"
 
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <iostream>
 #include <unordered_set>
+#include <vector>
 
 #define NEWMODE
 
+// must be a power of two, and at least twice the number of known symbols
+#define KNOWN_SYMBOL_SLOTS 4096
+
 using namespace std;
 
 static std::unordered_set<uint64_t> seen_hashes;
 
+struct Entry {
+    const char *symbol;
+    const char *str;
+    uint64_t id;
+};
+
+static std::vector<Entry> entries;
+
 void write_entry(const char *symbol, const char *str) {
     using namespace scopes;
     auto len = strlen(str);
@@ -30,9 +45,74 @@ void write_entry(const char *symbol, const char *str) {
     cout << "    " << symbol << ", /*" << str << "*/" << endl;
 #endif
     if (seen_hashes.count(id)) {
-        assert(false && "duplicate hash");
+        cerr << "gensyms: " << symbol << " has the hash of another symbol" << endl;
+        exit(1);
     }
     seen_hashes.insert(id);
+    entries.push_back({symbol, str, id});
+}
+
+static void write_string_literal(const char *str) {
+    cout << "\"";
+    for (const char *c = str; *c; ++c) {
+        if ((*c == '"') || (*c == '\\')) {
+            cout << '\\' << *c;
+        } else if ((unsigned char)*c < 32) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", (unsigned char)*c);
+            cout << buf;
+        } else {
+            cout << *c;
+        }
+    }
+    cout << "\"";
+}
+
+// the same open addressing as the table in symbol.cpp, so that it can be
+// filled without probing at startup
+static void write_slot_table() {
+    std::vector<bool> used(KNOWN_SYMBOL_SLOTS, false);
+    size_t count = 0;
+    cout << "#if defined(SCOPES_KNOWN_SYMBOL_TABLE) && !defined(SCOPES_KNOWN_SYMBOL_TABLE_DEFINED)" << endl;
+    cout << "#define SCOPES_KNOWN_SYMBOL_TABLE_DEFINED" << endl;
+    cout << endl;
+    cout << "#define SCOPES_KNOWN_SYMBOL_SLOTS " << KNOWN_SYMBOL_SLOTS << endl;
+    cout << endl;
+    cout << "namespace scopes {" << endl;
+    cout << endl;
+    cout << "struct KnownSymbolEntry {" << endl;
+    cout << "    unsigned long long id;" << endl;
+    cout << "    unsigned slot;" << endl;
+    cout << "    unsigned count;" << endl;
+    cout << "    const char *name;" << endl;
+    cout << "};" << endl;
+    cout << endl;
+    cout << "static const KnownSymbolEntry known_symbol_table[] = {" << endl;
+    for (auto &&entry : entries) {
+        // the unnamed symbol has no slot
+        if (!entry.id)
+            continue;
+        count++;
+        if ((count * 2) > KNOWN_SYMBOL_SLOTS) {
+            cerr << "gensyms: too many known symbols for "
+                << KNOWN_SYMBOL_SLOTS << " slots" << endl;
+            exit(1);
+        }
+        size_t i = (size_t)entry.id;
+        while (used[i & (KNOWN_SYMBOL_SLOTS - 1)])
+            i++;
+        i &= (KNOWN_SYMBOL_SLOTS - 1);
+        used[i] = true;
+        cout << "    { " << entry.id << "ull, " << i << "u, "
+            << strlen(entry.str) << "u, ";
+        write_string_literal(entry.str);
+        cout << " }," << endl;
+    }
+    cout << "};" << endl;
+    cout << endl;
+    cout << "} // namespace scopes" << endl;
+    cout << endl;
+    cout << "#endif // SCOPES_KNOWN_SYMBOL_TABLE" << endl;
 }
 
 int main(int argc, char *argv[]) {
@@ -83,5 +163,7 @@ int main(int argc, char *argv[]) {
     cout << "} // namespace scopes" << endl;
     cout << endl;
     cout << "#endif // SCOPES_SYMBOL_ENUM_HPP" << endl;
+    cout << endl;
+    write_slot_table();
     return 0;
 }
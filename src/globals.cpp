@@ -23,6 +23,7 @@
 #include "gen_spirv.hpp"
 #include "anchor.hpp"
 #include "boot.hpp"
+#include "core_image.hpp"
 #include "gc.hpp"
 #include "compiler_flags.hpp"
 #include "hash.hpp"
@@ -32,6 +33,17 @@
 #include "boot.hpp"
 #include "execution.hpp"
 #include "cache.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "profiler.hpp"
+#include "syntax_image.hpp"
+#include "regex.hpp"
+#include "thread_pool.hpp"
+#include "io_loop.hpp"
+#include "file_map.hpp"
+#include "process.hpp"
+#include "memo.hpp"
+#include "interpreter.hpp"
 #include "symbol_enum.inc"
 
 #include "scopes/scopes.h"
@@ -46,16 +58,20 @@
 #else
 #define SCOPES_DLL_EXPORT
 #include <dlfcn.h>
+#include <dirent.h>
 #endif
 
 #ifndef _MSC_VER
 #include <libgen.h>
+#else
+#include <intrin.h>
 #endif
 
+#include <algorithm>
+#include <mutex>
 #include <vector>
 
 #include "linenoise-ng/include/linenoise.h"
-#include "minilibs/regexp.cpp"
 
 #include <llvm-c/Support.h>
 #include "llvm/Support/TargetRegistry.h"
@@ -110,6 +126,20 @@ static void init_values_arrayT(std::vector< T * > &dest, int numvalues, const sc
 static const Scope *globals = nullptr;
 static const Scope *original_globals = Scope::from(nullptr, nullptr);
 
+// the globals of a compilation of an embedder, which are current while the
+// context is entered. the compiler isn't thread safe, so contexts are entered
+// by one thread at a time; interned symbols, strings and types, loaded
+// modules and compiled code are shared by all of them
+struct Context {
+    const Scope *globals;
+    // the globals that were current when the context was entered
+    const Scope *outer_globals;
+    bool entered;
+};
+
+// recursive, so that a thread can enter further contexts from within one
+static std::recursive_mutex context_mutex;
+
 //------------------------------------------------------------------------------
 
 #define CRESULT { return {_result.ok(), (_result.ok()?nullptr:_result.unsafe_error()), _result.unsafe_extract()}; }
@@ -118,6 +148,7 @@ static const Scope *original_globals = Scope::from(nullptr, nullptr);
 sc_void_raises_t convert_result(const Result<void> &_result) VOID_CRESULT;
 
 sc_valueref_list_scope_raises_t convert_result(const Result<sc_valueref_list_scope_tuple_t> &_result) CRESULT;
+sc_list_scope_raises_t convert_result(const Result<sc_list_scope_tuple_t> &_result) CRESULT;
 sc_bool_i32_i32_raises_t convert_result(const Result<sc_bool_i32_i32_tuple_t> &_result) CRESULT;
 
 sc_valueref_raises_t convert_result(const Result<ValueRef> &_result) CRESULT;
@@ -127,9 +158,11 @@ sc_valueref_raises_t convert_result(const Result<TemplateRef> &_result) CRESULT;
 sc_valueref_raises_t convert_result(const Result<ConstPointerRef> &_result) CRESULT;
 sc_valueref_raises_t convert_result(const Result<ConstRef> &_result) CRESULT;
 sc_valueref_raises_t convert_result(const Result<ConstAggregateRef> &_result) CRESULT;
+sc_valueref_raises_t convert_result(const Result<ConstStringRef> &_result) CRESULT;
 
 sc_type_raises_t convert_result(const Result<const Type *> &_result) CRESULT;
 sc_string_raises_t convert_result(const Result<const String *> &_result) CRESULT;
+sc_list_raises_t convert_result(const Result<const List *> &_result) CRESULT;
 
 sc_scope_raises_t convert_result(const Result<const Scope *> &_result) CRESULT;
 
@@ -150,7 +183,7 @@ sc_symbol_raises_t convert_result(const Result<Symbol> &_result) {
     return convert_result(Result<_result_type>((EXPR)));
 
 #define SCOPES_C_ERROR(CLASS, ...) \
-    return convert_result(Result<_result_type>::raise(Error ## CLASS::from(__VA_ARGS__)));
+    return convert_result(Result<_result_type>::raise(SCOPES_NEW_ERROR(CLASS, ##__VA_ARGS__)));
 
 #define SCOPES_C_RETURN_ERROR(ERR) return convert_result(Result<_result_type>::raise(ERR));
 // if ok fails, return
@@ -192,6 +225,16 @@ int sc_main() {
     return run_main();
 }
 
+sc_void_raises_t sc_snapshot_save(const sc_string_t *path) {
+    using namespace scopes;
+    return convert_result(save_snapshot(path->data));
+}
+
+sc_void_raises_t sc_snapshot_load(const sc_string_t *path) {
+    using namespace scopes;
+    return convert_result(load_snapshot(path->data));
+}
+
 // Compiler
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -208,21 +251,209 @@ int sc_cache_misses() {
     return get_cache_misses();
 }
 
+const sc_list_t *sc_cache_stats() {
+    using namespace scopes;
+    CacheStats stats;
+    get_cache_stats(stats);
+    const List *result = EOL;
+    auto add = [&](Symbol name, ValueRef value) {
+        ValueRef values[] = { ConstInt::symbol_from(name), value };
+        result = List::from(ConstPointer::list_from(List::from(values)), result);
+    };
+    // in reverse, so the list comes out in declaration order
+    add(Symbol("image_hits"), ConstInt::from(TYPE_U64, stats.image_hits));
+    add(Symbol("corrupt"), ConstInt::from(TYPE_U64, stats.corrupt));
+    add(Symbol("backend_writes"), ConstInt::from(TYPE_U64, stats.backend_writes));
+    add(Symbol("backend_hits"), ConstInt::from(TYPE_U64, stats.backend_hits));
+    add(Symbol("load_time"), ConstReal::from(TYPE_F64, stats.load_time * 1e-6));
+    add(Symbol("objects_loaded"), ConstInt::from(TYPE_U64, stats.objects_loaded));
+    add(Symbol("evicted_bytes"), ConstInt::from(TYPE_U64, stats.evicted_bytes));
+    add(Symbol("evicted_records"), ConstInt::from(TYPE_U64, stats.evicted_records));
+    add(Symbol("evictions"), ConstInt::from(TYPE_U64, stats.evictions));
+    add(Symbol("write_time"), ConstReal::from(TYPE_F64, stats.write_time * 1e-6));
+    add(Symbol("read_time"), ConstReal::from(TYPE_F64, stats.read_time * 1e-6));
+    add(Symbol("bytes_written"), ConstInt::from(TYPE_U64, stats.bytes_written));
+    add(Symbol("writes"), ConstInt::from(TYPE_U64, stats.writes));
+    add(Symbol("bytes_read"), ConstInt::from(TYPE_U64, stats.bytes_read));
+    add(Symbol("misses"), ConstInt::from(TYPE_U64, stats.misses));
+    add(Symbol("hits"), ConstInt::from(TYPE_U64, stats.hits));
+    return result;
+}
+
+void sc_cache_stats_reset() {
+    using namespace scopes;
+    reset_cache_stats();
+}
+
+int sc_tier_up_count() {
+    using namespace scopes;
+    return get_tier_up_count();
+}
+
+void sc_set_timers_enabled(bool enable) {
+    using namespace scopes;
+    Timer::set_enabled(enable);
+}
+
+const sc_list_t *sc_timers_snapshot() {
+    using namespace scopes;
+    std::vector<TimerStats> stats;
+    Timer::snapshot(stats);
+    const List *result = EOL;
+    for (auto it = stats.rbegin(); it != stats.rend(); ++it) {
+        ValueRef values[] = {
+            ConstInt::symbol_from(it->name),
+            ConstInt::from(TYPE_U64, it->count),
+            ConstReal::from(TYPE_F64, it->inclusive),
+            ConstReal::from(TYPE_F64, it->exclusive),
+            ConstReal::from(TYPE_F64, it->max) };
+        result = List::from(ConstPointer::list_from(List::from(values)), result);
+    }
+    return result;
+}
+
+void sc_timers_reset() {
+    using namespace scopes;
+    Timer::reset_timers();
+}
+
+const sc_list_t *sc_memory_stats() {
+    using namespace scopes;
+    std::vector<std::pair<const char *, MemoryUsage>> stats;
+    MemoryStat::snapshot(stats);
+    const List *result = EOL;
+    for (auto it = stats.rbegin(); it != stats.rend(); ++it) {
+        ValueRef values[] = {
+            ConstInt::symbol_from(Symbol(String::from_cstr(it->first))),
+            ConstInt::from(TYPE_U64, it->second.objects),
+            ConstInt::from(TYPE_U64, it->second.bytes) };
+        result = List::from(ConstPointer::list_from(List::from(values)), result);
+    }
+    return result;
+}
+
+void sc_set_trace_enabled(bool enable) {
+    using namespace scopes;
+    set_trace_enabled(enable);
+}
+
+bool sc_write_trace(const sc_string_t *path) {
+    using namespace scopes;
+    return write_trace(path->data);
+}
+
+bool sc_profiler_start(int hz) {
+    using namespace scopes;
+    return start_profiler(hz);
+}
+
+void sc_profiler_stop() {
+    using namespace scopes;
+    stop_profiler();
+}
+
+bool sc_profiler_running() {
+    using namespace scopes;
+    return is_profiler_running();
+}
+
+uint64_t sc_profiler_sample_count() {
+    using namespace scopes;
+    return profiler_sample_count();
+}
+
+uint64_t sc_profiler_dropped_count() {
+    using namespace scopes;
+    return profiler_dropped_count();
+}
+
+bool sc_profiler_write(const sc_string_t *path) {
+    using namespace scopes;
+    return write_profile(path->data);
+}
+
+void *sc_alloc_profile_malloc(const sc_type_t *T, size_t size) {
+    using namespace scopes;
+#ifdef _MSC_VER
+    uint64_t site = (uint64_t)_ReturnAddress();
+#else
+    uint64_t site = (uint64_t)__builtin_return_address(0);
+#endif
+    return alloc_profile_malloc(size, T, site);
+}
+
+void sc_alloc_profile_free(void *ptr) {
+    using namespace scopes;
+    alloc_profile_free(ptr);
+}
+
+const sc_list_t *sc_alloc_profile_stats() {
+    using namespace scopes;
+    std::vector<AllocSiteStats> stats;
+    get_alloc_profile(stats);
+    const List *result = EOL;
+    for (auto it = stats.rbegin(); it != stats.rend(); ++it) {
+        ValueRef values[] = {
+            ConstString::from(String::from_stdstring(it->site)),
+            ConstPointer::type_from(it->type),
+            ConstInt::from(TYPE_U64, it->allocations),
+            ConstInt::from(TYPE_U64, it->bytes),
+            ConstInt::from(TYPE_U64, it->live_bytes) };
+        result = List::from(ConstPointer::list_from(List::from(values)), result);
+    }
+    return result;
+}
+
+void sc_alloc_profile_print() {
+    using namespace scopes;
+    print_alloc_profile();
+}
+
 sc_rawstring_i32_array_tuple_t sc_launch_args() {
     using namespace scopes;
     return {(int)scopes_argc, scopes_argv};
 }
 
+const sc_string_t *sc_working_dir() {
+    using namespace scopes;
+    return String::from_cstr(scopes_working_dir);
+}
+
 void sc_set_typecast_handler(sc_typecast_func_t func) {
     using namespace scopes;
     set_typecast_handler(func);
 }
 
+int sc_sweep_functions() {
+    using namespace scopes;
+    return sweep_functions();
+}
+
+void sc_set_sweep_threshold(uint64_t bytes) {
+    using namespace scopes;
+    set_sweep_threshold(bytes);
+}
+
+void sc_advance_fingerprint_epoch() {
+    using namespace scopes;
+    advance_fingerprint_epoch();
+}
+
 sc_valueref_list_scope_raises_t sc_expand(sc_valueref_t expr, const sc_list_t *next, const sc_scope_t *scope) {
     using namespace scopes;
     return convert_result(expand(expr, next, scope));
 }
 
+void sc_sugar_macro_set_pure(sc_syntax_wildcard_func_t f) {
+    using namespace scopes;
+    set_sugar_macro_pure(f);
+}
+
+sc_list_scope_raises_t sc_sugar_macro_call(sc_syntax_wildcard_func_t f, const sc_list_t *topexpr, const sc_scope_t *scope) {
+    using namespace scopes;
+    return convert_result(call_sugar_macro(f, topexpr, scope));
+}
+
 sc_valueref_raises_t sc_eval(const sc_anchor_t *anchor, const sc_list_t *expr, const sc_scope_t *scope) {
     using namespace scopes;
     SCOPES_RESULT_TYPE(TypedValueRef);
@@ -293,6 +524,22 @@ sc_valueref_raises_t sc_compile(sc_valueref_t srcl, uint64_t flags) {
     return convert_result(compile(result, flags));
 }
 
+bool sc_function_is_interpretable(sc_valueref_t func) {
+    using namespace scopes;
+    auto fn = func.dyn_cast<Function>();
+    return fn && can_interpret(fn);
+}
+
+sc_valueref_raises_t sc_interpret(sc_valueref_t func) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(ValueRef);
+    auto fn = SCOPES_C_GET_RESULT(extract_function_constant(func));
+    if (!can_interpret(fn)) {
+        SCOPES_C_ERROR(FunctionNotInterpretable, fn->name);
+    }
+    return convert_result(interpret(fn));
+}
+
 sc_string_raises_t sc_compile_spirv(int version, sc_symbol_t target, sc_valueref_t srcl, uint64_t flags) {
     using namespace scopes;
     SCOPES_RESULT_TYPE(const String *);
@@ -307,6 +554,51 @@ sc_string_raises_t sc_compile_glsl(int version, sc_symbol_t target, sc_valueref_
     return convert_result(compile_glsl(version, Symbol::wrap(target), result, flags));
 }
 
+namespace scopes {
+
+// every job is a list of version, target, function and flags
+static SCOPES_RESULT(const List *) compile_shader_list(bool glsl, const List *jobs) {
+    SCOPES_RESULT_TYPE(const List *);
+    std::vector<ShaderJob> shaderjobs;
+    while (jobs) {
+        auto job = SCOPES_GET_RESULT(extract_list_constant(jobs->at));
+        int count = (int)List::count(job);
+        if (count < 4) {
+            SCOPES_ERROR(NotEnoughArguments, 4, count);
+        } else if (count > 4) {
+            SCOPES_ERROR(TooManyArguments, 4, count);
+        }
+        auto version = SCOPES_GET_RESULT(extract_integer_constant(job->at));
+        job = job->next;
+        auto target = SCOPES_GET_RESULT(extract_symbol_constant(job->at));
+        job = job->next;
+        auto fn = SCOPES_GET_RESULT(extract_function_constant(job->at));
+        job = job->next;
+        auto flags = SCOPES_GET_RESULT(extract_integer_constant(job->at));
+        shaderjobs.push_back({ (int)version, target, fn, flags });
+        jobs = jobs->next;
+    }
+    std::vector<const String *> shaders;
+    SCOPES_CHECK_RESULT(compile_shaders(glsl, shaderjobs, shaders));
+    const List *result = nullptr;
+    for (auto it = shaders.rbegin(); it != shaders.rend(); ++it) {
+        result = List::from(ConstString::from(*it), result);
+    }
+    return result;
+}
+
+}
+
+sc_list_raises_t sc_compile_spirv_batch(const sc_list_t *jobs) {
+    using namespace scopes;
+    return convert_result(compile_shader_list(false, jobs));
+}
+
+sc_list_raises_t sc_compile_glsl_batch(const sc_list_t *jobs) {
+    using namespace scopes;
+    return convert_result(compile_shader_list(true, jobs));
+}
+
 const sc_string_t *sc_spirv_to_glsl(const sc_string_t *binary) {
     using namespace scopes;
     return spirv_to_glsl(binary);
@@ -327,7 +619,68 @@ sc_string_raises_t sc_compile_object_to_buffer(const sc_string_t *target_triple,
     return convert_result(compile_object<const String*>(target_triple, (CompilerFileKind)file_kind, module_name, table, flags));
 }
 
+void sc_set_object_target_cpu(const sc_string_t *cpu, const sc_string_t *features) {
+    using namespace scopes;
+    set_object_target_cpu(cpu->data, features->data);
+}
+
+sc_void_raises_t sc_thin_link_objects(const sc_string_t *target_triple, const sc_list_t *inputs, const sc_string_t *output_prefix, uint64_t flags) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(void);
+    std::vector<std::string> paths;
+    while (inputs) {
+        auto value = SCOPES_C_GET_RESULT(extract_string_constant(inputs->at));
+        paths.push_back(value->data);
+        inputs = inputs->next;
+    }
+    int level = 0;
+    if ((flags & CF_O3) == CF_O1)
+        level = 1;
+    else if ((flags & CF_O3) == CF_O2)
+        level = 2;
+    else if ((flags & CF_O3) == CF_O3)
+        level = 3;
+    SCOPES_C_CHECK_RESULT(thin_link_objects(target_triple->data, paths,
+        output_prefix->data, level));
+    return convert_result({});
+}
+
+sc_void_raises_t sc_link_objects(const sc_string_t *target_triple, const sc_list_t *inputs, const sc_string_t *path) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(void);
+    std::vector<std::string> paths;
+    while (inputs) {
+        auto value = SCOPES_C_GET_RESULT(extract_string_constant(inputs->at));
+        paths.push_back(value->data);
+        inputs = inputs->next;
+    }
+    SCOPES_C_CHECK_RESULT(link_objects(target_triple->data, paths, path->data));
+    return convert_result({});
+}
+
+sc_void_raises_t sc_set_optimization_pipeline(const sc_string_t *pipeline) {
+    using namespace scopes;
+    return convert_result(set_opt_pipeline(pipeline->data));
+}
+
+void sc_set_profile_path(const sc_string_t *path) {
+    using namespace scopes;
+    set_profile_path(path->data);
+}
+
 void sc_show_targets() {
+    using namespace scopes;
+    // targets are otherwise only registered when they are first used
+    init_llvm_target();
+#ifdef SCOPES_TARGET_WEBASSEMBLY
+    init_llvm_target("wasm32");
+#endif
+#ifdef SCOPES_TARGET_AARCH64
+    init_llvm_target("aarch64");
+#endif
+#ifdef SCOPES_TARGET_RISCV
+    init_llvm_target("riscv64");
+#endif
     llvm::TargetRegistry::printRegisteredTargetsForVersion(llvm::outs());
 }
 
@@ -432,10 +785,18 @@ void sc_write(const sc_string_t *value) {
     StyledStream ss(SCOPES_COUT);
     ss << value->data;
 #else
-    fputs(value->data, stdout);
+    fwrite(value->data, 1, value->count, stdout);
 #endif
 }
 
+void sc_flush() {
+    using namespace scopes;
+#if SCOPES_USE_WCHAR
+    SCOPES_COUT.flush();
+#endif
+    fflush(stdout);
+}
+
 // file i/o
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -489,6 +850,212 @@ bool sc_is_directory(const sc_string_t *path) {
     return false;
 }
 
+// modification time in nanoseconds, or 0 if the path does not exist
+uint64_t sc_file_mtime(const sc_string_t *path) {
+    using namespace scopes;
+    struct stat s;
+    if (stat(path->data, &s) != 0)
+        return 0;
+#ifdef SCOPES_WIN32
+    return (uint64_t)s.st_mtime * 1000000000ull;
+#elif defined(SCOPES_MACOS)
+    return (uint64_t)s.st_mtimespec.tv_sec * 1000000000ull
+        + (uint64_t)s.st_mtimespec.tv_nsec;
+#else
+    return (uint64_t)s.st_mtim.tv_sec * 1000000000ull
+        + (uint64_t)s.st_mtim.tv_nsec;
+#endif
+}
+
+const sc_list_t *sc_list_directory(const sc_string_t *path) {
+    using namespace scopes;
+    std::vector<std::string> names;
+    DIR *dir = opendir(path->data);
+    if (dir) {
+        while (struct dirent *entry = readdir(dir)) {
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+                continue;
+            names.push_back(entry->d_name);
+        }
+        closedir(dir);
+    }
+    std::sort(names.begin(), names.end());
+    const List *result = EOL;
+    for (auto it = names.rbegin(); it != names.rend(); ++it) {
+        result = List::from(
+            ConstString::from(String::from_stdstring(*it)), result);
+    }
+    return result;
+}
+
+void *sc_file_map_open(const sc_string_t *path, bool writable, int64_t size) {
+    using namespace scopes;
+    return FileMap::open(path->data, writable, size);
+}
+
+void *sc_file_map_data(void *map) {
+    using namespace scopes;
+    return ((FileMap *)map)->ptr;
+}
+
+uint64_t sc_file_map_size(void *map) {
+    using namespace scopes;
+    return ((FileMap *)map)->size;
+}
+
+int sc_file_map_advise(void *map, uint64_t offset, uint64_t count, int advice) {
+    using namespace scopes;
+    return ((FileMap *)map)->advise(offset, count, (FileMapAdvice)advice);
+}
+
+int sc_file_map_sync(void *map, uint64_t offset, uint64_t count) {
+    using namespace scopes;
+    return ((FileMap *)map)->sync(offset, count);
+}
+
+void sc_file_map_close(void *map) {
+    using namespace scopes;
+    delete (FileMap *)map;
+}
+
+sc_list_raises_t sc_run_commands(const sc_list_t *commands, const sc_list_t *keys, int jobs, const sc_string_t *history_path) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(const List *);
+    std::vector<std::string> lines;
+    while (commands) {
+        auto value = SCOPES_C_GET_RESULT(extract_string_constant(commands->at));
+        lines.push_back(std::string(value->data, value->count));
+        commands = commands->next;
+    }
+    std::vector<std::string> names;
+    while (keys) {
+        auto value = SCOPES_C_GET_RESULT(extract_string_constant(keys->at));
+        names.push_back(std::string(value->data, value->count));
+        keys = keys->next;
+    }
+    if (!names.empty() && (names.size() != lines.size())) {
+        SCOPES_C_ERROR(RTRunCommandsKeyCount,
+            (int)names.size(), (int)lines.size());
+    }
+    std::vector<CommandResult> results;
+    run_commands(lines, names, jobs,
+        history_path->count?history_path->data:nullptr, results);
+    const List *result = EOL;
+    for (auto it = results.rbegin(); it != results.rend(); ++it) {
+        ValueRef values[] = {
+            ConstInt::from(TYPE_I32, it->status),
+            ConstReal::from(TYPE_F64, it->seconds),
+            ConstString::from(String::from_stdstring(it->output)) };
+        result = List::from(ConstPointer::list_from(List::from(values)), result);
+    }
+    SCOPES_C_RETURN(result);
+}
+
+int sc_thread_count() {
+    using namespace scopes;
+    return thread_pool_size();
+}
+
+void sc_parallel_for(int64_t begin, int64_t end, int64_t chunk_size,
+    sc_parallel_chunk_func_t func, void *ctx) {
+    using namespace scopes;
+    parallel_for(begin, end, std::max(chunk_size, (int64_t)1), func, ctx);
+}
+
+void *sc_task_spawn(sc_task_func_t func, void *ctx, bool coroutine) {
+    using namespace scopes;
+    return task_spawn(func, ctx, coroutine);
+}
+
+void sc_task_join(void *task) {
+    using namespace scopes;
+    task_join((Task *)task);
+}
+
+void sc_task_detach(void *task) {
+    using namespace scopes;
+    task_detach((Task *)task);
+}
+
+void sc_task_yield() {
+    using namespace scopes;
+    task_yield();
+}
+
+void *sc_waitgroup_new() {
+    using namespace scopes;
+    return waitgroup_new();
+}
+
+void sc_waitgroup_add(void *wg, int64_t count) {
+    using namespace scopes;
+    waitgroup_add((WaitGroup *)wg, count);
+}
+
+void sc_waitgroup_done(void *wg) {
+    using namespace scopes;
+    waitgroup_done((WaitGroup *)wg);
+}
+
+void sc_waitgroup_wait(void *wg) {
+    using namespace scopes;
+    waitgroup_wait((WaitGroup *)wg);
+}
+
+void sc_waitgroup_free(void *wg) {
+    using namespace scopes;
+    waitgroup_free((WaitGroup *)wg);
+}
+
+int sc_io_wait(int fd, bool write) {
+    using namespace scopes;
+    return io_wait(fd, write);
+}
+
+int sc_io_set_nonblocking(int fd) {
+    using namespace scopes;
+    return io_set_nonblocking(fd);
+}
+
+int64_t sc_io_read(int fd, void *buf, int64_t size) {
+    using namespace scopes;
+    return io_read(fd, buf, size);
+}
+
+int64_t sc_io_write(int fd, const void *buf, int64_t size) {
+    using namespace scopes;
+    return io_write(fd, buf, size);
+}
+
+int sc_io_accept(int fd) {
+    using namespace scopes;
+    return io_accept(fd);
+}
+
+int sc_io_connect(int fd, const void *addr, int addrlen) {
+    using namespace scopes;
+    return io_connect(fd, addr, addrlen);
+}
+
+int64_t sc_io_writev(int fd, const void *slices, int count) {
+    using namespace scopes;
+    return io_writev(fd, slices, count);
+}
+
+int sc_io_open(const sc_string_t *path, int mode) {
+    using namespace scopes;
+    return io_open(path->data, mode);
+}
+
+int sc_io_advise(int fd, int64_t offset, int64_t count, int advice) {
+    using namespace scopes;
+    return io_advise(fd, offset, count, advice);
+}
+
+int sc_io_errno() {
+    return errno;
+}
+
 // globals
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -507,6 +1074,45 @@ void sc_set_globals(const sc_scope_t *s) {
     globals = s;
 }
 
+// contexts
+////////////////////////////////////////////////////////////////////////////////
+
+sc_context_t *sc_context_new() {
+    using namespace scopes;
+    std::lock_guard<std::recursive_mutex> lock(context_mutex);
+    auto ctx = new Context();
+    ctx->globals = globals;
+    ctx->outer_globals = nullptr;
+    ctx->entered = false;
+    return ctx;
+}
+
+void sc_context_free(sc_context_t *ctx) {
+    using namespace scopes;
+    assert(!ctx->entered);
+    delete ctx;
+}
+
+void sc_context_enter(sc_context_t *ctx) {
+    using namespace scopes;
+    context_mutex.lock();
+    assert(!ctx->entered);
+    ctx->entered = true;
+    ctx->outer_globals = globals;
+    globals = ctx->globals;
+}
+
+void sc_context_leave(sc_context_t *ctx) {
+    using namespace scopes;
+    assert(ctx->entered);
+    assert(ctx->outer_globals);
+    ctx->globals = globals;
+    globals = ctx->outer_globals;
+    ctx->outer_globals = nullptr;
+    ctx->entered = false;
+    context_mutex.unlock();
+}
+
 // Error Handling
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -524,6 +1130,17 @@ sc_error_t *sc_error_new(const sc_string_t *msg) {
 #endif
     return ErrorUser::from(msg);
 }
+
+void sc_speculation_begin() {
+    using namespace scopes;
+    begin_speculation();
+}
+
+void sc_speculation_end() {
+    using namespace scopes;
+    end_speculation();
+}
+
 const sc_string_t *sc_format_error(const sc_error_t *err) {
     using namespace scopes;
     StyledString ss;
@@ -554,114 +1171,12 @@ void sc_exit(int c) {
 // Memoization
 ////////////////////////////////////////////////////////////////////////////////
 
-namespace scopes {
-
-struct MemoKeyEqual {
-    bool operator()( Value *lhs, Value *rhs ) const {
-        if (lhs == rhs) return true;
-        if (lhs->kind() != rhs->kind())
-            return false;
-        if (isa<ArgumentList>(lhs)) {
-            auto a = cast<ArgumentList>(lhs);
-            auto b = cast<ArgumentList>(rhs);
-            if (a->get_type() != b->get_type())
-                return false;
-            for (int i = 0; i < a->values.size(); ++i) {
-                auto u = a->values[i];
-                auto v = b->values[i];
-                if (u == v) continue;
-                if (u->kind() != v->kind())
-                    return false;
-                if (u.isa<Pure>()) {
-                    if (!u.cast<Pure>()->key_equal(v.cast<Pure>().unref()))
-                        return false;
-                } else {
-                    if (u != v)
-                        return false;
-                }
-            }
-            return true;
-        } else if (isa<ArgumentListTemplate>(lhs)) {
-            auto a = cast<ArgumentListTemplate>(lhs);
-            auto b = cast<ArgumentListTemplate>(rhs);
-            auto &&a_values = a->values();
-            auto &&b_values = b->values();
-            for (int i = 0; i < a_values.size(); ++i) {
-                auto u = a_values[i];
-                auto v = b_values[i];
-                if (u == v) continue;
-                if (u->kind() != v->kind())
-                    return false;
-                if (u.isa<Pure>()) {
-                    if (!u.cast<Pure>()->key_equal(v.cast<Pure>().unref()))
-                        return false;
-                } else {
-                    if (u != v)
-                        return false;
-                }
-            }
-            return true;
-        } else if (isa<Pure>(lhs)) {
-            if (isa<ConstPointer>(lhs)
-                && cast<ConstPointer>(lhs)->get_type() == TYPE_List
-                && cast<ConstPointer>(rhs)->get_type() == TYPE_List) {
-                return sc_list_compare(
-                    (const List *)cast<ConstPointer>(lhs)->value,
-                    (const List *)cast<ConstPointer>(rhs)->value);
-            }
-            return cast<Pure>(lhs)->key_equal(cast<Pure>(rhs));
-        } else {
-            return false;
-        }
-    }
-};
-
-struct MemoHash {
-    std::size_t operator()(Value *l) const {
-        if (isa<ArgumentList>(l)) {
-            auto alist = cast<ArgumentList>(l);
-            uint64_t h = std::hash<const Type *>{}(alist->get_type());
-            for (int i = 0; i < alist->values.size(); ++i) {
-                auto x = alist->values[i];
-                if (x.isa<Pure>()) {
-                    h = hash2(h, x.cast<Pure>()->hash());
-                } else {
-                    h = hash2(h, std::hash<const TypedValue *>{}(x.unref()));
-                }
-            }
-            return h;
-        } else if (isa<ArgumentListTemplate>(l)) {
-            auto alist = cast<ArgumentListTemplate>(l);
-            uint64_t h = 0;
-            auto &&values = alist->values();
-            for (int i = 0; i < values.size(); ++i) {
-                auto x = values[i];
-                if (x.isa<Pure>()) {
-                    h = hash2(h, x.cast<Pure>()->hash());
-                } else {
-                    h = hash2(h, std::hash<const Value *>{}(x.unref()));
-                }
-            }
-            return h;
-        } else if (isa<Pure>(l)) {
-            return cast<Pure>(l)->hash();
-        } else {
-            return std::hash<const Value *>{}(l);
-        }
-    }
-};
-
-typedef absl::flat_hash_map<Value *, ValueRef, MemoHash, MemoKeyEqual> MemoMap;
-static MemoMap memo_map;
-
-}
-
 sc_valueref_raises_t sc_map_get(sc_valueref_t key) {
     using namespace scopes;
     SCOPES_RESULT_TYPE(ValueRef);
-    auto it = memo_map.find(key.unref());
-    if (it != memo_map.end()) {
-        return convert_result(it->second);
+    ValueRef value;
+    if (memo_get(key.unref(), value)) {
+        return convert_result(value);
     } else {
         SCOPES_C_ERROR(RTMissingKey);
     }
@@ -669,17 +1184,62 @@ sc_valueref_raises_t sc_map_get(sc_valueref_t key) {
 
 void sc_map_set(sc_valueref_t key, sc_valueref_t value) {
     using namespace scopes;
-    if (!value) {
-        auto it = memo_map.find(key.unref());
-        if (it != memo_map.end()) {
-            memo_map.erase(it);
-        }
-    } else {
-        auto ret = memo_map.insert({key.unref(), value});
-        if (!ret.second) {
-            ret.first->second = value;
+    memo_set(key.unref(), value);
+}
+
+void sc_memo_set_capacity(sc_valueref_t ns, int capacity) {
+    using namespace scopes;
+    memo_set_capacity(ns.unref(), (size_t)std::max(capacity, 0));
+}
+
+void sc_memo_clear(sc_valueref_t ns) {
+    using namespace scopes;
+    memo_clear(ns.unref());
+}
+
+const sc_list_t *sc_memo_stats() {
+    using namespace scopes;
+    std::vector<MemoStats> stats;
+    get_memo_stats(stats);
+    const List *result = EOL;
+    for (auto it = stats.rbegin(); it != stats.rend(); ++it) {
+        // the shared table is listed as none
+        ValueRef ns = ConstAggregate::none_from();
+        if (it->ns) {
+            ns = ref(unknown_anchor(), it->ns);
         }
+        ValueRef values[] = {
+            ns,
+            ConstInt::from(TYPE_U64, it->hits),
+            ConstInt::from(TYPE_U64, it->misses),
+            ConstInt::from(TYPE_U64, it->evictions),
+            ConstInt::from(TYPE_U64, it->size),
+            ConstInt::from(TYPE_U64, it->capacity) };
+        result = List::from(ConstPointer::list_from(List::from(values)), result);
     }
+    return result;
+}
+
+void sc_set_instance_stats_enabled(bool enable) {
+    using namespace scopes;
+    set_instance_stats_enabled(enable);
+}
+
+const sc_list_t *sc_instance_stats() {
+    using namespace scopes;
+    std::vector<InstanceStats> stats;
+    get_instance_stats(stats);
+    const List *result = EOL;
+    for (auto it = stats.rbegin(); it != stats.rend(); ++it) {
+        ValueRef values[] = {
+            ConstInt::symbol_from(it->name),
+            ConstInt::from(TYPE_U64, it->instances),
+            ConstInt::from(TYPE_U64, it->signatures),
+            ConstReal::from(TYPE_F64, it->prove_time),
+            ConstInt::from(TYPE_U64, it->code_size) };
+        result = List::from(ConstPointer::list_from(List::from(values)), result);
+    }
+    return result;
 }
 
 // Hashing
@@ -703,24 +1263,71 @@ uint64_t sc_hashbytes (const char *data, size_t size) {
 // C Bridge
 ////////////////////////////////////////////////////////////////////////////////
 
-sc_scope_raises_t sc_import_c(const sc_string_t *path,
-    const sc_string_t *content, const sc_list_t *arglist, const sc_scope_t *scope) {
-    using namespace scopes;
-    SCOPES_RESULT_TYPE(const Scope *);
-    std::vector<std::string> args;
+namespace scopes {
+
+static SCOPES_RESULT(void) extract_import_c_args(const List *arglist,
+    std::vector<std::string> &args) {
+    SCOPES_RESULT_TYPE(void);
     while (arglist) {
         if (arglist->at.isa<ConstString>()) {
-            auto value = SCOPES_C_GET_RESULT(extract_string_constant(arglist->at));
+            auto value = SCOPES_GET_RESULT(extract_string_constant(arglist->at));
             args.push_back(value->data);
         } else {
-            auto value = SCOPES_C_GET_RESULT(extract_symbol_constant(arglist->at));
+            auto value = SCOPES_GET_RESULT(extract_symbol_constant(arglist->at));
             args.push_back(value.name()->data);
         }
         arglist = arglist->next;
     }
+    return {};
+}
+
+// every job is a list of path, content and options
+static SCOPES_RESULT(const List *) import_c_list(const List *jobs) {
+    SCOPES_RESULT_TYPE(const List *);
+    std::vector<CImportRequest> requests;
+    while (jobs) {
+        auto job = SCOPES_GET_RESULT(extract_list_constant(jobs->at));
+        int count = (int)List::count(job);
+        if (count < 3) {
+            SCOPES_ERROR(NotEnoughArguments, 3, count);
+        } else if (count > 3) {
+            SCOPES_ERROR(TooManyArguments, 3, count);
+        }
+        CImportRequest request;
+        request.path = SCOPES_GET_RESULT(extract_string_constant(job->at))->data;
+        job = job->next;
+        request.buffer = SCOPES_GET_RESULT(extract_string_constant(job->at))->data;
+        job = job->next;
+        auto arglist = SCOPES_GET_RESULT(extract_list_constant(job->at));
+        SCOPES_CHECK_RESULT(extract_import_c_args(arglist, request.args));
+        requests.push_back(request);
+        jobs = jobs->next;
+    }
+    std::vector<const Scope *> scopes;
+    SCOPES_CHECK_RESULT(import_c_modules(requests, scopes));
+    const List *result = nullptr;
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+        result = List::from(ConstPointer::scope_from(*it), result);
+    }
+    return result;
+}
+
+}
+
+sc_scope_raises_t sc_import_c(const sc_string_t *path,
+    const sc_string_t *content, const sc_list_t *arglist, const sc_scope_t *scope) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(const Scope *);
+    std::vector<std::string> args;
+    SCOPES_C_CHECK_RESULT(extract_import_c_args(arglist, args));
     SCOPES_C_RETURN(import_c_module(path->data, args, content->data, scope));
 }
 
+sc_list_raises_t sc_import_c_batch(const sc_list_t *jobs) {
+    using namespace scopes;
+    return convert_result(import_c_list(jobs));
+}
+
 sc_void_raises_t sc_load_library(const sc_string_t *name) {
     using namespace scopes;
     SCOPES_RESULT_TYPE(void);
@@ -737,6 +1344,7 @@ sc_void_raises_t sc_load_library(const sc_string_t *name) {
     if (LLVMLoadLibraryPermanently(name->data)) {
         SCOPES_C_ERROR(RTLoadLibraryFailed, name, "reason unknown");
     }
+    invalidate_symbol_cache();
     return convert_result({});
 }
 
@@ -962,30 +1570,27 @@ const sc_string_t *sc_string_join(const sc_string_t *a, const sc_string_t *b) {
     return String::join(a,b);
 }
 
-namespace scopes {
-    static absl::flat_hash_map<const String *, regexp::Reprog *> pattern_cache;
+const sc_string_t *sc_string_join_many(int count, const sc_string_t **strings) {
+    using namespace scopes;
+    return String::join_many(strings, count);
 }
-sc_bool_i32_i32_raises_t sc_string_match(const sc_string_t *pattern, const sc_string_t *text) {
+
+sc_bool_i32_i32_raises_t sc_string_match_from(const sc_string_t *pattern, const sc_string_t *text, int offset) {
     using namespace scopes;
     SCOPES_RESULT_TYPE(sc_bool_i32_i32_tuple_t);
-    auto it = pattern_cache.find(pattern);
-    regexp::Reprog *m = nullptr;
-    if (it == pattern_cache.end()) {
-        const char *error = nullptr;
-        m = regexp::regcomp(pattern->data, 0, &error);
-        if (error) {
-            const String *err = String::from_cstr(error);
-            regexp::regfree(m);
-            SCOPES_C_ERROR(RTRegExError, err);
-        }
-        pattern_cache.insert({ pattern, m });
-    } else {
-        m = it->second;
-    }
-    regexp::Resub sub;
-    bool ok = regexp::regexec(m, text->data, &sub, 0) == 0;
-    sc_bool_i32_i32_tuple_t result = {ok, (int)(sub.sub[0].sp - text->data), (int)(sub.sub[0].ep - text->data)};
-   SCOPES_C_RETURN(result);
+    bool ok = false;
+    int start = -1;
+    int end = -1;
+    const String *err = nullptr;
+    if (!regex_search(pattern, text, (size_t)std::max(offset, 0), ok, start, end, err)) {
+        SCOPES_C_ERROR(RTRegExError, err);
+    }
+    sc_bool_i32_i32_tuple_t result = {ok, start, end};
+    SCOPES_C_RETURN(result);
+}
+
+sc_bool_i32_i32_raises_t sc_string_match(const sc_string_t *pattern, const sc_string_t *text) {
+    return sc_string_match_from(pattern, text, 0);
 }
 
 size_t sc_string_count(const sc_string_t *str) {
@@ -993,6 +1598,11 @@ size_t sc_string_count(const sc_string_t *str) {
     return str->count;
 }
 
+size_t sc_format_real(char *dest, size_t size, double value, bool single) {
+    using namespace scopes;
+    return format_real(dest, size, value, single);
+}
+
 int sc_string_compare(const sc_string_t *a, const sc_string_t *b) {
     using namespace scopes;
     auto c = memcmp(a->data, b->data, std::min(a->count, b->count));
@@ -1192,6 +1802,13 @@ const sc_string_t *sc_value_ast_repr (sc_valueref_t value) {
     return ss.str();
 }
 
+const sc_string_t *sc_value_ast_image (sc_valueref_t value) {
+    using namespace scopes;
+    std::vector<char> image;
+    write_ast_image(image, value);
+    return String::from(image.data(), image.size());
+}
+
 const sc_string_t *sc_value_tostring (sc_valueref_t value) {
     using namespace scopes;
     StyledString ss = StyledString::plain();
@@ -1238,7 +1855,7 @@ bool sc_value_compare (sc_valueref_t a, sc_valueref_t b) {
     using namespace scopes;
     if (a == b) return true;
     if (!a || !b) return false;
-    return MemoKeyEqual{}(a.unref(),b.unref());
+    return memo_key_equal(a.unref(),b.unref());
 }
 
 int sc_value_kind (sc_valueref_t value) {
@@ -1403,6 +2020,16 @@ bool sc_template_is_inline(sc_valueref_t fn) {
     return fn.cast<Template>()->is_inline();
 }
 
+void sc_template_set_fast_math(sc_valueref_t fn, uint32_t flags) {
+    using namespace scopes;
+    fn.cast<Template>()->set_fast_math(flags & FMF_Fast);
+}
+
+uint32_t sc_template_get_fast_math(sc_valueref_t fn) {
+    using namespace scopes;
+    return fn.cast<Template>()->fast_math;
+}
+
 int sc_template_parameter_count(sc_valueref_t fn) {
     using namespace scopes;
     return fn.cast<Template>()->params.size();
@@ -1704,6 +2331,23 @@ sc_valueref_t sc_const_string_new(const sc_string_t *str) {
     return ConstString::from(str);
 }
 
+sc_valueref_raises_t sc_const_blob_new(const sc_type_t *element_type, const sc_string_t *data) {
+    using namespace scopes;
+    return convert_result(ConstString::blob_from(element_type, data));
+}
+
+sc_valueref_raises_t sc_const_blob_from_path(const sc_type_t *element_type, const sc_string_t *path) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(ValueRef);
+    auto file = SourceFile::from_file(path);
+    if (!file) {
+        SCOPES_C_ERROR(RTUnableToOpenFile, path);
+    }
+    // the mapped contents are copied and hashed once when interned
+    auto data = String::from(file->strptr(), file->size());
+    return convert_result(ConstString::blob_from(element_type, data));
+}
+
 const sc_string_t *sc_const_string_extract(sc_valueref_t value) {
     using namespace scopes;
     if (value.isa<ConstString>()) {
@@ -1742,12 +2386,37 @@ sc_valueref_t sc_merge_new(sc_valueref_t label, sc_valueref_t value) {
 sc_valueref_raises_t sc_parse_from_path(const sc_string_t *path) {
     using namespace scopes;
     SCOPES_RESULT_TYPE(ValueRef);
-    auto sf = SourceFile::from_file(path);
-    if (!sf) {
+    auto value = SCOPES_C_GET_RESULT(parse_source_path(path));
+    if (!value) {
         SCOPES_C_ERROR(RTUnableToOpenFile, path);
     }
-    LexerParser parser(std::move(sf));
-    return convert_result(parser.parse());
+    return convert_result(value);
+}
+
+sc_void_raises_t sc_parse_each_from_path(const sc_string_t *path,
+    sc_parse_each_func_t func, void *ctx) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(void);
+    auto file = SourceFile::from_file(path);
+    if (!file) {
+        SCOPES_C_ERROR(RTUnableToOpenFile, path);
+    }
+    LexerParser parser(std::move(file));
+    while (true) {
+        auto value = SCOPES_C_GET_RESULT(parser.parse_next());
+        if (!value)
+            break;
+        auto result = func(value, ctx);
+        if (!result.ok) {
+            SCOPES_C_RETURN_ERROR(result.except);
+        }
+    }
+    return convert_result({});
+}
+
+void sc_prefetch_module(const sc_string_t *path) {
+    using namespace scopes;
+    prefetch_source_path(path);
 }
 
 sc_valueref_raises_t sc_parse_from_string(const sc_string_t *str) {
@@ -1758,6 +2427,23 @@ sc_valueref_raises_t sc_parse_from_string(const sc_string_t *str) {
     return convert_result(parser.parse());
 }
 
+sc_valueref_raises_t sc_parse_incremental(sc_valueref_t previous,
+    const sc_string_t *str, int offset, int removed, int inserted) {
+    using namespace scopes;
+    return convert_result(
+        parse_incremental(previous, str, offset, removed, inserted));
+}
+
+sc_valueref_raises_t sc_parse_ast_image(const sc_string_t *image) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(ValueRef);
+    auto value = read_syntax_image(image->data, image->count);
+    if (!value) {
+        SCOPES_C_ERROR(InvalidImage, "of the AST");
+    }
+    SCOPES_C_RETURN(value);
+}
+
 // Types
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -1998,7 +2684,7 @@ sc_symbol_valueref_tuple_t sc_type_next(const sc_type_t *type, sc_symbol_t key)
     }
     while (index != count) {
         auto &&value = map.entries[index].second;
-        if (value.expr) {
+        if (!map.is_discarded(index) && value.expr) {
             return { map.entries[index].first.value(), value.expr };
         }
         index++;
@@ -2013,12 +2699,14 @@ void sc_type_set_symbol(const sc_type_t *T, sc_symbol_t sym, sc_valueref_t value
     using namespace scopes;
     T = strip_qualifiers(T);
     const_cast<Type *>(T)->bind(Symbol::wrap(sym), value);
+    invalidate_typecast_cache(T);
 }
 
 void sc_type_del_symbol(const sc_type_t *T, sc_symbol_t sym) {
     using namespace scopes;
     T = strip_qualifiers(T);
     const_cast<Type *>(T)->unbind(Symbol::wrap(sym));
+    invalidate_typecast_cache(T);
 }
 
 // Qualifier
@@ -2463,6 +3151,7 @@ void init_globals(int argc, char *argv[]) {
     const Type *rawstring = native_ro_pointer_type(TYPE_Char);
     const Type *TYPE_ValuePP = native_ro_pointer_type(TYPE_ValueRef);
     const Type *TYPE_U64PP = native_ro_pointer_type(TYPE_U64);
+    const Type *TYPE_StringPP = native_ro_pointer_type(TYPE_String);
     const Type *_void = empty_arguments_type();
     const Type *voidstar = native_ro_pointer_type(_void);
 
@@ -2472,9 +3161,43 @@ void init_globals(int argc, char *argv[]) {
     const Type *TYPE_autocomplete_func = native_ro_pointer_type(
         function_type(_void, { rawstring, voidstar }));
 
+    const Type *TYPE_parse_each_func = native_ro_pointer_type(
+        raising_function_type(_void, { TYPE_ValueRef, voidstar }));
+
+    const Type *TYPE_parallel_chunk_func = native_ro_pointer_type(
+        function_type(_void, { voidstar, TYPE_I64, TYPE_I64, TYPE_I64 }));
+
+    const Type *TYPE_task_func = native_ro_pointer_type(
+        function_type(_void, { voidstar }));
+
+    const Type *TYPE_sugar_macro_func = native_ro_pointer_type(
+        raising_function_type(arguments_type({TYPE_List, TYPE_Scope}),
+            { TYPE_List, TYPE_Scope }));
+
     DEFINE_EXTERN_C_FUNCTION(sc_compiler_version, arguments_type({TYPE_I32, TYPE_I32, TYPE_I32}));
     DEFINE_EXTERN_C_FUNCTION(sc_cache_misses, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_cache_stats, TYPE_List);
+    DEFINE_EXTERN_C_FUNCTION(sc_cache_stats_reset, _void);
+    DEFINE_EXTERN_C_FUNCTION(sc_tier_up_count, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_set_timers_enabled, _void, TYPE_Bool);
+    DEFINE_EXTERN_C_FUNCTION(sc_timers_snapshot, TYPE_List);
+    DEFINE_EXTERN_C_FUNCTION(sc_timers_reset, _void);
+    DEFINE_EXTERN_C_FUNCTION(sc_memory_stats, TYPE_List);
+    DEFINE_EXTERN_C_FUNCTION(sc_set_trace_enabled, _void, TYPE_Bool);
+    DEFINE_EXTERN_C_FUNCTION(sc_write_trace, TYPE_Bool, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_profiler_start, TYPE_Bool, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_profiler_stop, _void);
+    DEFINE_EXTERN_C_FUNCTION(sc_profiler_running, TYPE_Bool);
+    DEFINE_EXTERN_C_FUNCTION(sc_profiler_sample_count, TYPE_U64);
+    DEFINE_EXTERN_C_FUNCTION(sc_profiler_dropped_count, TYPE_U64);
+    DEFINE_EXTERN_C_FUNCTION(sc_profiler_write, TYPE_Bool, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_alloc_profile_malloc, native_pointer_type(_void), TYPE_Type, TYPE_USize);
+    DEFINE_EXTERN_C_FUNCTION(sc_alloc_profile_free, _void, native_pointer_type(_void));
+    DEFINE_EXTERN_C_FUNCTION(sc_alloc_profile_stats, TYPE_List);
+    DEFINE_EXTERN_C_FUNCTION(sc_alloc_profile_print, _void);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_expand, arguments_type({TYPE_ValueRef, TYPE_List, TYPE_Scope}), TYPE_ValueRef, TYPE_List, TYPE_Scope);
+    DEFINE_EXTERN_C_FUNCTION(sc_sugar_macro_set_pure, _void, TYPE_sugar_macro_func);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_sugar_macro_call, arguments_type({TYPE_List, TYPE_Scope}), TYPE_sugar_macro_func, TYPE_List, TYPE_Scope);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_eval, TYPE_ValueRef, TYPE_Anchor, TYPE_List, TYPE_Scope);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_eval_stage, TYPE_ValueRef, TYPE_Anchor, TYPE_List, TYPE_Scope);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_prove, TYPE_ValueRef, TYPE_ValueRef);
@@ -2482,16 +3205,29 @@ void init_globals(int argc, char *argv[]) {
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_typify_template, TYPE_ValueRef, TYPE_ValueRef, TYPE_I32, native_ro_pointer_type(TYPE_Type));
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_typify, TYPE_ValueRef, TYPE_Closure, TYPE_I32, native_ro_pointer_type(TYPE_Type));
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile, TYPE_ValueRef, TYPE_ValueRef, TYPE_U64);
+    DEFINE_EXTERN_C_FUNCTION(sc_function_is_interpretable, TYPE_Bool, TYPE_ValueRef);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_interpret, TYPE_ValueRef, TYPE_ValueRef);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_spirv, TYPE_String, TYPE_I32, TYPE_Symbol, TYPE_ValueRef, TYPE_U64);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_glsl, TYPE_String, TYPE_I32, TYPE_Symbol, TYPE_ValueRef, TYPE_U64);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_spirv_batch, TYPE_List, TYPE_List);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_glsl_batch, TYPE_List, TYPE_List);
     DEFINE_EXTERN_C_FUNCTION(sc_spirv_to_glsl, TYPE_String, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_default_target_triple, TYPE_String);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_object, _void, TYPE_String, TYPE_I32, TYPE_String, TYPE_Scope, TYPE_U64);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_object_to_buffer, TYPE_String, TYPE_String, TYPE_I32, TYPE_String, TYPE_Scope, TYPE_U64);
+    DEFINE_EXTERN_C_FUNCTION(sc_set_object_target_cpu, _void, TYPE_String, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_thin_link_objects, _void, TYPE_String, TYPE_List, TYPE_String, TYPE_U64);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_link_objects, _void, TYPE_String, TYPE_List, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_set_optimization_pipeline, _void, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_set_profile_path, _void, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_show_targets, _void);
     DEFINE_EXTERN_C_FUNCTION(sc_enter_solver_cli, _void);
     DEFINE_EXTERN_C_FUNCTION(sc_launch_args, arguments_type({TYPE_I32,native_ro_pointer_type(rawstring)}));
+    DEFINE_EXTERN_C_FUNCTION(sc_working_dir, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_set_typecast_handler, _void, TYPE_typecast_func);
+    DEFINE_EXTERN_C_FUNCTION(sc_sweep_functions, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_set_sweep_threshold, _void, TYPE_U64);
+    DEFINE_EXTERN_C_FUNCTION(sc_advance_fingerprint_epoch, _void);
     DEFINE_EXTERN_C_FUNCTION(sc_prompt_set_autocomplete_handler, _void, TYPE_autocomplete_func);
 
     DEFINE_EXTERN_C_FUNCTION(sc_prompt, arguments_type({TYPE_Bool, TYPE_String}), TYPE_String, TYPE_String);
@@ -2503,10 +3239,12 @@ void init_globals(int argc, char *argv[]) {
     DEFINE_EXTERN_C_FUNCTION(sc_default_styler, TYPE_String, TYPE_Symbol, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_format_message, TYPE_String, TYPE_Anchor, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_write, _void, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_flush, _void);
 
     DEFINE_EXTERN_C_FUNCTION(sc_value_repr, TYPE_String, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_value_content_repr, TYPE_String, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_value_ast_repr, TYPE_String, TYPE_ValueRef);
+    DEFINE_EXTERN_C_FUNCTION(sc_value_ast_image, TYPE_String, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_value_tostring, TYPE_String, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_value_type, TYPE_Type, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_value_qualified_type, TYPE_Type, TYPE_ValueRef);
@@ -2537,6 +3275,8 @@ void init_globals(int argc, char *argv[]) {
     DEFINE_EXTERN_C_FUNCTION(sc_template_set_body, _void, TYPE_ValueRef, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_template_set_inline, _void, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_template_is_inline, TYPE_Bool, TYPE_ValueRef);
+    DEFINE_EXTERN_C_FUNCTION(sc_template_set_fast_math, _void, TYPE_ValueRef, TYPE_U32);
+    DEFINE_EXTERN_C_FUNCTION(sc_template_get_fast_math, TYPE_U32, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_template_parameter_count, TYPE_I32, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_template_parameter, TYPE_ValueRef, TYPE_ValueRef, TYPE_I32);
     DEFINE_EXTERN_C_FUNCTION(sc_expression_new, TYPE_ValueRef);
@@ -2589,6 +3329,8 @@ void init_globals(int argc, char *argv[]) {
     DEFINE_EXTERN_C_FUNCTION(sc_const_pointer_extract, voidstar, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_const_string_new, TYPE_ValueRef, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_const_string_extract, TYPE_String, TYPE_ValueRef);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_const_blob_new, TYPE_ValueRef, TYPE_Type, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_const_blob_from_path, TYPE_ValueRef, TYPE_Type, TYPE_String);
 
     DEFINE_EXTERN_C_FUNCTION(sc_quote_new, TYPE_ValueRef, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_unquote_new, TYPE_ValueRef, TYPE_ValueRef);
@@ -2599,6 +3341,38 @@ void init_globals(int argc, char *argv[]) {
 
     DEFINE_EXTERN_C_FUNCTION(sc_is_file, TYPE_Bool, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_is_directory, TYPE_Bool, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_file_mtime, TYPE_U64, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_list_directory, TYPE_List, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_file_map_open, voidstar, TYPE_String, TYPE_Bool, TYPE_I64);
+    DEFINE_EXTERN_C_FUNCTION(sc_file_map_data, voidstar, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_file_map_size, TYPE_U64, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_file_map_advise, TYPE_I32, voidstar, TYPE_U64, TYPE_U64, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_file_map_sync, TYPE_I32, voidstar, TYPE_U64, TYPE_U64);
+    DEFINE_EXTERN_C_FUNCTION(sc_file_map_close, _void, voidstar);
+
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_run_commands, TYPE_List, TYPE_List, TYPE_List, TYPE_I32, TYPE_String);
+
+    DEFINE_EXTERN_C_FUNCTION(sc_thread_count, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_parallel_for, _void, TYPE_I64, TYPE_I64, TYPE_I64, TYPE_parallel_chunk_func, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_task_spawn, voidstar, TYPE_task_func, voidstar, TYPE_Bool);
+    DEFINE_EXTERN_C_FUNCTION(sc_task_join, _void, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_task_detach, _void, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_task_yield, _void);
+    DEFINE_EXTERN_C_FUNCTION(sc_waitgroup_new, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_waitgroup_add, _void, voidstar, TYPE_I64);
+    DEFINE_EXTERN_C_FUNCTION(sc_waitgroup_done, _void, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_waitgroup_wait, _void, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_waitgroup_free, _void, voidstar);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_wait, TYPE_I32, TYPE_I32, TYPE_Bool);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_set_nonblocking, TYPE_I32, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_read, TYPE_I64, TYPE_I32, voidstar, TYPE_I64);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_write, TYPE_I64, TYPE_I32, voidstar, TYPE_I64);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_accept, TYPE_I32, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_connect, TYPE_I32, TYPE_I32, voidstar, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_writev, TYPE_I64, TYPE_I32, voidstar, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_open, TYPE_I32, TYPE_String, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_advise, TYPE_I32, TYPE_I32, TYPE_I64, TYPE_I64, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_io_errno, TYPE_I32);
     DEFINE_EXTERN_C_FUNCTION(sc_realpath, TYPE_String, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_dirname, TYPE_String, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_basename, TYPE_String, TYPE_String);
@@ -2609,6 +3383,8 @@ void init_globals(int argc, char *argv[]) {
 
     DEFINE_EXTERN_C_FUNCTION(sc_error_append_calltrace, _void, TYPE_Error, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_error_new, TYPE_Error, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_speculation_begin, _void);
+    DEFINE_EXTERN_C_FUNCTION(sc_speculation_end, _void);
     DEFINE_EXTERN_C_FUNCTION(sc_format_error, TYPE_String, TYPE_Error);
     DEFINE_EXTERN_C_FUNCTION(sc_dump_error, _void, TYPE_Error);
 
@@ -2620,14 +3396,22 @@ void init_globals(int argc, char *argv[]) {
 
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_map_get, TYPE_ValueRef, TYPE_ValueRef);
     DEFINE_EXTERN_C_FUNCTION(sc_map_set, _void, TYPE_ValueRef, TYPE_ValueRef);
+    DEFINE_EXTERN_C_FUNCTION(sc_memo_set_capacity, _void, TYPE_ValueRef, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_memo_clear, _void, TYPE_ValueRef);
+    DEFINE_EXTERN_C_FUNCTION(sc_memo_stats, TYPE_List);
+    DEFINE_EXTERN_C_FUNCTION(sc_set_instance_stats_enabled, _void, TYPE_Bool);
+    DEFINE_EXTERN_C_FUNCTION(sc_instance_stats, TYPE_List);
 
     DEFINE_EXTERN_C_FUNCTION(sc_hash, TYPE_U64, TYPE_U64, TYPE_USize);
     DEFINE_EXTERN_C_FUNCTION(sc_hash2x64, TYPE_U64, TYPE_U64, TYPE_U64);
     DEFINE_EXTERN_C_FUNCTION(sc_hashbytes, TYPE_U64, rawstring, TYPE_USize);
 
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_import_c, TYPE_Scope, TYPE_String, TYPE_String, TYPE_List, TYPE_Scope);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_import_c_batch, TYPE_List, TYPE_List);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_load_library, _void, TYPE_String);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_load_object, _void, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_snapshot_save, _void, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_snapshot_load, _void, TYPE_String);
 
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_scope_at, TYPE_ValueRef, TYPE_Scope, TYPE_ValueRef);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_scope_local_at, TYPE_ValueRef, TYPE_Scope, TYPE_ValueRef);
@@ -2657,13 +3441,16 @@ void init_globals(int argc, char *argv[]) {
     DEFINE_EXTERN_C_FUNCTION(sc_string_new, TYPE_String, rawstring, TYPE_USize);
     DEFINE_EXTERN_C_FUNCTION(sc_string_new_from_cstr, TYPE_String, rawstring);
     DEFINE_EXTERN_C_FUNCTION(sc_string_join, TYPE_String, TYPE_String, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_string_join_many, TYPE_String, TYPE_I32, TYPE_StringPP);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_string_match, arguments_type({TYPE_Bool, TYPE_I32, TYPE_I32}), TYPE_String, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_string_match_from, arguments_type({TYPE_Bool, TYPE_I32, TYPE_I32}), TYPE_String, TYPE_String, TYPE_I32);
     DEFINE_EXTERN_C_FUNCTION(sc_string_count, TYPE_USize, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_string_compare, TYPE_I32, TYPE_String, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_string_buffer, arguments_type({rawstring, TYPE_USize}), TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_string_lslice, TYPE_String, TYPE_String, TYPE_USize);
     DEFINE_EXTERN_C_FUNCTION(sc_string_rslice, TYPE_String, TYPE_String, TYPE_USize);
     DEFINE_EXTERN_C_FUNCTION(sc_string_unescape, TYPE_String, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_format_real, TYPE_USize, native_pointer_type(TYPE_Char), TYPE_USize, TYPE_F64, TYPE_Bool);
 
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_type_at, TYPE_ValueRef, TYPE_Type, TYPE_Symbol);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_type_local_at, TYPE_ValueRef, TYPE_Type, TYPE_Symbol);
@@ -2772,7 +3559,11 @@ void init_globals(int argc, char *argv[]) {
     DEFINE_EXTERN_C_FUNCTION(sc_closure_get_context, TYPE_ValueRef, TYPE_Closure);
 
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_parse_from_path, TYPE_ValueRef, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_parse_each_from_path, _void, TYPE_String, TYPE_parse_each_func, voidstar);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_parse_from_string, TYPE_ValueRef, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_parse_incremental, TYPE_ValueRef, TYPE_ValueRef, TYPE_String, TYPE_I32, TYPE_I32, TYPE_I32);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_parse_ast_image, TYPE_ValueRef, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_prefetch_module, _void, TYPE_String);
 
     DEFINE_EXTERN_C_FUNCTION(sc_getenv, TYPE_String, TYPE_String);
 
@@ -2864,6 +3655,12 @@ SCOPES_GLOBAL_FLAGS()
 SCOPES_COMPILER_FLAGS()
 #undef T
 
+#define T(NAME, VALUE, SNAME) \
+    bind_new_value(Symbol(SNAME), \
+        ConstInt::from(TYPE_U32, (uint32_t)NAME));
+SCOPES_FAST_MATH_FLAGS()
+#undef T
+
 #define T(NAME, SNAME) \
     bind_new_value(Symbol(SNAME), \
         ConstInt::from(TYPE_I32, NAME));
@@ -2875,6 +3672,12 @@ SCOPES_COMPILER_FILE_KIND()
         ConstInt::from(TYPE_I32, NAME));
 SCOPES_BARRIER_KIND()
 #undef T
+
+#define T(NAME, SNAME) \
+    bind_new_value(Symbol(SNAME), \
+        ConstInt::from(TYPE_I32, NAME));
+SCOPES_MEMORY_ORDER()
+#undef T
 #define T(NAME, STR) bind_new_value(NAME, ConstInt::builtin_from(Builtin(NAME)));
 #define T0(NAME, STR) bind_new_value(NAME, ConstInt::builtin_from(Builtin(NAME)));
 #define T1 T2
@@ -45,6 +45,7 @@ namespace scopes {
     T(g_alloca_array, "alloca-array") \
     T(g_sc_scope_new, "sc_scope_new") \
     T(g_sc_scope_new_subscope, "sc_scope_new_subscope") \
+    T(g_sc_scope_new_subscope_with_docstring, "sc_scope_new_subscope_with_docstring") \
     T(g_sc_scope_bind, "sc_scope_bind") \
     T(g_sc_scope_bind_with_docstring, "sc_scope_bind_with_docstring") \
     T(g_sc_scope_unbind, "sc_scope_unbind") \
@@ -67,6 +68,7 @@ namespace scopes {
     T(g_sc_template_append_parameter, "sc_template_append_parameter") \
     T(g_sc_template_set_body, "sc_template_set_body") \
     T(g_sc_template_set_inline, "sc_template_set_inline") \
+    T(g_sc_template_set_fast_math, "sc_template_set_fast_math") \
     T(g_sc_parameter_new, "sc_parameter_new") \
     T(g_sc_keyed_new, "sc_keyed_new") \
     T(g_sc_expression_new, "sc_expression_new") \
@@ -0,0 +1,156 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_INTERN_HPP
+#define SCOPES_INTERN_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+// must be a power of two
+#define SCOPES_INTERN_SHARDS 64
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// INTERN TABLES
+//------------------------------------------------------------------------------
+
+/* lock striped tables for interned objects. a key always hashes to the same
+   shard, so looking up and inserting a key is atomic with respect to any
+   other thread interning an equal key, while threads working on unrelated
+   keys rarely wait on each other. */
+
+inline size_t intern_shard_index(size_t hash) {
+    // the low bits are what the shard tables themselves are indexed by
+    return (size_t)(((uint64_t)hash >> 32) ^ ((uint64_t)hash >> 57))
+        & (SCOPES_INTERN_SHARDS - 1);
+}
+
+template<typename T, typename HashT, typename EqualT>
+struct InternSet {
+    // returns the element equal to key, or interns and returns the result of
+    // create() if there is none yet. create() runs under the shard lock.
+    template<typename F>
+    T intern(const T &key, F &&create) {
+        auto &shard = shards[intern_shard_index(HashT()(key))];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.set.find(key);
+        if (it != shard.set.end())
+            return *it;
+        T value = create();
+        shard.set.insert(value);
+        return value;
+    }
+
+    // adds the number of elements and the bytes held by the tables
+    void measure(uint64_t &count, uint64_t &bytes) {
+        for (auto &&shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            count += shard.set.size();
+            bytes += shard.set.capacity() * (sizeof(T) + 1);
+        }
+    }
+
+protected:
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        absl::flat_hash_set<T, HashT, EqualT> set;
+    };
+
+    Shard shards[SCOPES_INTERN_SHARDS];
+};
+
+/* a small direct mapped cache of recently interned pointers, kept per thread
+   in front of an intern table; a hit costs one compare and avoids probing,
+   or locking, the table. entries are only ever replaced, which is safe as
+   interned objects are never freed. N must be a power of two. */
+
+template<typename T, size_t N = 256>
+struct InternCache {
+    // equal(value) compares a cached value with the key being looked up
+    template<typename F>
+    bool find(size_t hash, T &value, F &&equal) const {
+        auto &entry = entries[hash & (N - 1)];
+        if (entry.value && (entry.hash == hash) && equal(entry.value)) {
+            value = entry.value;
+            return true;
+        }
+        return false;
+    }
+
+    void insert(size_t hash, T value) {
+        auto &entry = entries[hash & (N - 1)];
+        entry.hash = hash;
+        entry.value = value;
+    }
+
+protected:
+    struct Entry {
+        size_t hash = 0;
+        T value = nullptr;
+    };
+
+    Entry entries[N];
+};
+
+template<typename K, typename V, typename HashT = absl::Hash<K>>
+struct InternMap {
+    bool find(const K &key, V &value) {
+        auto &shard = shards[intern_shard_index(HashT()(key))];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end())
+            return false;
+        value = it->second;
+        return true;
+    }
+
+    void set(const K &key, const V &value) {
+        auto &shard = shards[intern_shard_index(HashT()(key))];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.map[key] = value;
+    }
+
+    // as InternSet::intern; found tells whether the key was already mapped
+    template<typename F>
+    V intern(const K &key, bool &found, F &&create) {
+        auto &shard = shards[intern_shard_index(HashT()(key))];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        found = (it != shard.map.end());
+        if (found)
+            return it->second;
+        V value = create();
+        shard.map.insert({key, value});
+        return value;
+    }
+
+    // adds the number of elements and the bytes held by the tables
+    void measure(uint64_t &count, uint64_t &bytes) {
+        for (auto &&shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            count += shard.map.size();
+            bytes += shard.map.capacity() * (sizeof(std::pair<K, V>) + 1);
+        }
+    }
+
+protected:
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        absl::flat_hash_map<K, V, HashT> map;
+    };
+
+    Shard shards[SCOPES_INTERN_SHARDS];
+};
+
+} // namespace scopes
+
+#endif // SCOPES_INTERN_HPP
@@ -0,0 +1,487 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "interpreter.hpp"
+#include "value.hpp"
+#include "types.hpp"
+#include "error.hpp"
+#include "globals.hpp"
+#include "timer.hpp"
+#include "dyn_cast.inc"
+
+#include "scopes/scopes.h"
+#include "scopes/config.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+namespace scopes {
+
+static Counter interpreted_functions(COUNTER_Interpreted);
+
+namespace {
+
+typedef absl::flat_hash_map<Value *, ConstantPtrs> Frame;
+
+//------------------------------------------------------------------------------
+// RUNTIME FUNCTIONS
+//------------------------------------------------------------------------------
+
+// the runtime functions that module stages call to build their scope and
+// advance to the next stage; none of them has any other effect
+enum RuntimeFunction {
+    RF_None,
+    RF_ScopeNewSubscope,
+    RF_ScopeNewSubscopeWithDocstring,
+    RF_ScopeBind,
+    RF_ScopeBindWithDocstring,
+    RF_ConstStringExtract,
+    RF_ConstPointerNew,
+    RF_ValueRefTag,
+    RF_ErrorAppendCalltrace,
+    RF_EvalStage,
+};
+
+static RuntimeFunction runtime_function(const TypedValueRef &callee) {
+    auto ptr = callee.unref();
+#define T(GLOBAL, FUNC) if (ptr == GLOBAL.unref()) return FUNC;
+    T(g_sc_scope_new_subscope, RF_ScopeNewSubscope)
+    T(g_sc_scope_new_subscope_with_docstring, RF_ScopeNewSubscopeWithDocstring)
+    T(g_sc_scope_bind, RF_ScopeBind)
+    T(g_sc_scope_bind_with_docstring, RF_ScopeBindWithDocstring)
+    T(g_sc_const_string_extract, RF_ConstStringExtract)
+    T(g_sc_const_pointer_new, RF_ConstPointerNew)
+    T(g_sc_valueref_tag, RF_ValueRefTag)
+    T(g_sc_error_append_calltrace, RF_ErrorAppendCalltrace)
+    T(g_sc_eval_stage, RF_EvalStage)
+#undef T
+    return RF_None;
+}
+
+static bool is_valueref_type(const Type *T) {
+    return storage_type(strip_qualifiers(T)).assert_ok()
+        == storage_type(TYPE_ValueRef).assert_ok();
+}
+
+static const void *pointer_arg(const ConstantPtrs &args, int i) {
+    return cast<ConstPointer>(args[i])->value;
+}
+
+static ValueRef valueref_arg(const ConstantPtrs &args, int i) {
+    return cast<ConstAggregate>(args[i])->ast_value();
+}
+
+static Const *valueref_const(const ValueRef &value) {
+    return ConstAggregate::ast_from(value).unref();
+}
+
+static Const *pointer_const(const Type *T, const void *ptr) {
+    return ConstPointer::from(T, ptr).unref();
+}
+
+static SCOPES_RESULT(void) call_runtime(RuntimeFunction func,
+    const ConstantPtrs &args, ConstantPtrs &results) {
+    SCOPES_RESULT_TYPE(void);
+    switch(func) {
+    case RF_ScopeNewSubscope: {
+        results.push_back(pointer_const(TYPE_Scope, sc_scope_new_subscope(
+            (const Scope *)pointer_arg(args, 0))));
+    } break;
+    case RF_ScopeNewSubscopeWithDocstring: {
+        results.push_back(pointer_const(TYPE_Scope,
+            sc_scope_new_subscope_with_docstring(
+                (const Scope *)pointer_arg(args, 0),
+                (const String *)pointer_arg(args, 1))));
+    } break;
+    case RF_ScopeBind: {
+        results.push_back(pointer_const(TYPE_Scope, sc_scope_bind(
+            (const Scope *)pointer_arg(args, 0),
+            valueref_arg(args, 1), valueref_arg(args, 2))));
+    } break;
+    case RF_ScopeBindWithDocstring: {
+        results.push_back(pointer_const(TYPE_Scope,
+            sc_scope_bind_with_docstring(
+                (const Scope *)pointer_arg(args, 0),
+                valueref_arg(args, 1), valueref_arg(args, 2),
+                (const String *)pointer_arg(args, 3))));
+    } break;
+    case RF_ConstStringExtract: {
+        results.push_back(pointer_const(TYPE_String,
+            sc_const_string_extract(valueref_arg(args, 0))));
+    } break;
+    case RF_ConstPointerNew: {
+        results.push_back(valueref_const(sc_const_pointer_new(
+            (const Type *)pointer_arg(args, 0), pointer_arg(args, 1))));
+    } break;
+    case RF_ValueRefTag: {
+        results.push_back(valueref_const(sc_valueref_tag(
+            (Anchor *)pointer_arg(args, 0), valueref_arg(args, 1))));
+    } break;
+    case RF_ErrorAppendCalltrace: {
+        sc_error_append_calltrace(
+            (Error *)pointer_arg(args, 0), valueref_arg(args, 1));
+    } break;
+    case RF_EvalStage: {
+        auto result = sc_eval_stage(
+            (const Anchor *)pointer_arg(args, 0),
+            (const List *)pointer_arg(args, 1),
+            (const Scope *)pointer_arg(args, 2));
+        if (!result.ok) {
+            SCOPES_RETURN_ERROR(result.except);
+        }
+        results.push_back(valueref_const(result._0));
+    } break;
+    default: assert(false); break;
+    }
+    return {};
+}
+
+//------------------------------------------------------------------------------
+// VALIDATION
+//------------------------------------------------------------------------------
+
+// checks that a function only consists of what the interpreter runs, and
+// counts its instructions, including those of the functions it calls
+struct Validator {
+    int cost = 0;
+    absl::flat_hash_set<Function *> visiting;
+    absl::flat_hash_set<Function *> valid;
+
+    bool operand(const TypedValueRef &value) {
+        switch(value->kind()) {
+        case VK_ConstInt:
+        case VK_ConstReal:
+        case VK_ConstPointer:
+        case VK_ConstAggregate:
+        case VK_Parameter:
+        case VK_Exception:
+        case VK_Call:
+        case VK_Cast:
+        case VK_Label:
+            return true;
+        case VK_PureCast:
+            return operand(value.cast<PureCast>()->value);
+        case VK_ExtractArgument:
+            return operand(value.cast<ExtractArgument>()->value);
+        default: return false;
+        }
+    }
+
+    bool operands(const TypedValues &values) {
+        for (auto &&value : values) {
+            if (!operand(value))
+                return false;
+        }
+        return true;
+    }
+
+    // constants passed to runtime functions must be of the form that the
+    // interpreter unpacks
+    bool runtime_operand(const TypedValueRef &value) {
+        if (!value.isa<Const>())
+            return operand(value);
+        if (is_valueref_type(value->get_type())) {
+            auto agg = value.dyn_cast<ConstAggregate>();
+            if (!agg || agg->values.empty())
+                return false;
+            for (auto &&field : agg->values) {
+                if (!isa<ConstPointer>(field))
+                    return false;
+            }
+            return true;
+        }
+        return value.isa<ConstPointer>();
+    }
+
+    bool call(const CallRef &call) {
+        auto &&callee = call->callee;
+        if (callee.isa<Function>()) {
+            if (!function(callee.cast<Function>()))
+                return false;
+            return operands(call->args);
+        }
+        if (runtime_function(callee) == RF_None)
+            return false;
+        for (auto &&arg : call->args) {
+            if (!runtime_operand(arg))
+                return false;
+        }
+        return true;
+    }
+
+    bool instruction(const InstructionRef &node) {
+        if (++cost > SCOPES_INTERPRETER_MAX_COST)
+            return false;
+        switch(node->kind()) {
+        case VK_Call: {
+            auto call = node.cast<Call>();
+            return this->call(call)
+                && block(call->except_body, call->except_body.empty());
+        } break;
+        case VK_Cast: {
+            auto cast = node.cast<Cast>();
+            if (cast->op != CastBitcast)
+                return false;
+            auto ST = storage_type(strip_qualifiers(cast->value->get_type())).assert_ok();
+            auto DT = storage_type(strip_qualifiers(cast->get_type())).assert_ok();
+            if ((ST != DT)
+                && !((ST->kind() == TK_Pointer) && (DT->kind() == TK_Pointer)))
+                return false;
+            return operand(cast->value);
+        } break;
+        case VK_Label: {
+            return block(node.cast<Label>()->body);
+        } break;
+        case VK_Merge:
+        case VK_Return:
+        case VK_Raise:
+            return operands(node.cast<Terminator>()->values);
+        default: return false;
+        }
+    }
+
+    bool block(const Block &node, bool empty_ok = false) {
+        if (node.empty() && empty_ok)
+            return true;
+        if (!node.terminator)
+            return false;
+        for (auto &&entry : node.body) {
+            if (!instruction(entry))
+                return false;
+        }
+        return instruction(node.terminator);
+    }
+
+    bool function(const FunctionRef &fn) {
+        auto ptr = fn.unref();
+        if (valid.count(ptr))
+            return true;
+        // no recursion, so that every interpreted call ends
+        if (!fn->complete || fn->released || visiting.count(ptr))
+            return false;
+        visiting.insert(ptr);
+        bool ok = block(fn->body);
+        visiting.erase(ptr);
+        if (ok)
+            valid.insert(ptr);
+        return ok;
+    }
+};
+
+//------------------------------------------------------------------------------
+// EXECUTION
+//------------------------------------------------------------------------------
+
+struct Flow {
+    enum Kind {
+        Return,
+        Raise,
+        Merge,
+    };
+
+    Kind kind;
+    Label *label;
+    ConstantPtrs values;
+};
+
+struct Interpreter {
+    Frame *frame = nullptr;
+
+    static Const *retype(Const *value, const Type *T) {
+        if (value->get_type() == T)
+            return value;
+        switch(value->kind()) {
+        case VK_ConstPointer:
+            return pointer_const(T, cast<ConstPointer>(value)->value);
+        case VK_ConstInt: {
+            auto ci = cast<ConstInt>(value);
+            return ConstInt::from(T, ci->words.data(), ci->words.size()).unref();
+        }
+        case VK_ConstReal:
+            return ConstReal::from(T, cast<ConstReal>(value)->value).unref();
+        case VK_ConstAggregate:
+            return ConstAggregate::from(T, cast<ConstAggregate>(value)->values).unref();
+        default: assert(false); return value;
+        }
+    }
+
+    void get(const TypedValueRef &value, ConstantPtrs &out) {
+        switch(value->kind()) {
+        case VK_ConstInt:
+        case VK_ConstReal:
+        case VK_ConstPointer:
+        case VK_ConstAggregate:
+            out.push_back(value.cast<Const>().unref());
+            break;
+        case VK_PureCast: {
+            auto pc = value.cast<PureCast>();
+            ConstantPtrs values;
+            get(pc->value, values);
+            assert(values.size() == 1);
+            out.push_back(retype(values[0], pc->get_type()));
+        } break;
+        case VK_ExtractArgument: {
+            auto ea = value.cast<ExtractArgument>();
+            ConstantPtrs values;
+            get(ea->value, values);
+            assert((ea->index >= 0) && ((size_t)ea->index < values.size()));
+            out.push_back(values[ea->index]);
+        } break;
+        default: {
+            auto it = frame->find(value.unref());
+            assert(it != frame->end());
+            for (auto &&entry : it->second) {
+                out.push_back(entry);
+            }
+        } break;
+        }
+    }
+
+    ConstantPtrs get_all(const TypedValues &values) {
+        ConstantPtrs out;
+        for (auto &&value : values) {
+            get(value, out);
+        }
+        return out;
+    }
+
+    SCOPES_RESULT(Flow) call(const FunctionRef &fn, const ConstantPtrs &args) {
+        SCOPES_RESULT_TYPE(Flow);
+        Frame newframe;
+        assert(args.size() == fn->params.size());
+        for (size_t i = 0; i < args.size(); ++i) {
+            newframe[fn->params[i].unref()] = { args[i] };
+        }
+        auto oldframe = frame;
+        frame = &newframe;
+        auto result = block(fn->body);
+        frame = oldframe;
+        return result;
+    }
+
+    // returns true if the instruction ended the block
+    SCOPES_RESULT(bool) instruction(const InstructionRef &node, Flow &flow) {
+        SCOPES_RESULT_TYPE(bool);
+        switch(node->kind()) {
+        case VK_Call: {
+            auto call = node.cast<Call>();
+            auto args = get_all(call->args);
+            ConstantPtrs results;
+            ConstantPtrs except;
+            bool ok = true;
+            if (call->callee.isa<Function>()) {
+                auto result = SCOPES_GET_RESULT(
+                    this->call(call->callee.cast<Function>(), args));
+                if (result.kind == Flow::Raise) {
+                    ok = false;
+                    except = result.values;
+                } else {
+                    assert(result.kind == Flow::Return);
+                    results = result.values;
+                }
+            } else {
+                auto result = call_runtime(
+                    runtime_function(call->callee), args, results);
+                if (!result.ok()) {
+                    ok = false;
+                    except.push_back(pointer_const(TYPE_Error,
+                        result.unsafe_error()));
+                }
+            }
+            if (!ok) {
+                if (call->except) {
+                    (*frame)[call->except.unref()] = except;
+                }
+                flow = SCOPES_GET_RESULT(block(call->except_body));
+                return true;
+            }
+            (*frame)[call.unref()] = results;
+        } break;
+        case VK_Cast: {
+            auto cast = node.cast<Cast>();
+            ConstantPtrs values;
+            get(cast->value, values);
+            assert(values.size() == 1);
+            (*frame)[cast.unref()] = { retype(values[0], cast->get_type()) };
+        } break;
+        case VK_Label: {
+            auto label = node.cast<Label>();
+            auto result = SCOPES_GET_RESULT(block(label->body));
+            if ((result.kind == Flow::Merge) && (result.label == label.unref())) {
+                (*frame)[label.unref()] = result.values;
+            } else {
+                flow = result;
+                return true;
+            }
+        } break;
+        case VK_Merge: {
+            auto merge = node.cast<Merge>();
+            flow.kind = Flow::Merge;
+            flow.label = merge->label.unref();
+            flow.values = get_all(merge->values);
+            return true;
+        } break;
+        case VK_Return: {
+            flow.kind = Flow::Return;
+            flow.label = nullptr;
+            flow.values = get_all(node.cast<Return>()->values);
+            return true;
+        } break;
+        case VK_Raise: {
+            flow.kind = Flow::Raise;
+            flow.label = nullptr;
+            flow.values = get_all(node.cast<Raise>()->values);
+            return true;
+        } break;
+        default: assert(false); break;
+        }
+        return false;
+    }
+
+    SCOPES_RESULT(Flow) block(const Block &node) {
+        SCOPES_RESULT_TYPE(Flow);
+        Flow flow;
+        for (auto &&entry : node.body) {
+            if (SCOPES_GET_RESULT(instruction(entry, flow)))
+                return flow;
+        }
+        bool done = SCOPES_GET_RESULT(instruction(node.terminator, flow));
+        assert(done);
+        return flow;
+    }
+};
+
+} // namespace
+
+bool can_interpret(const FunctionRef &fn) {
+    if (!fn->params.empty())
+        return false;
+    auto fi = extract_function_type(strip_qualifiers(fn->get_type()));
+    if (fi->has_exception() && (fi->except_type != TYPE_Error))
+        return false;
+    auto rt = fi->return_type;
+    if ((get_argument_count(rt) != 1) || !is_valueref_type(get_argument(rt, 0)))
+        return false;
+    Validator validator;
+    return validator.function(fn);
+}
+
+SCOPES_RESULT(ValueRef) interpret(const FunctionRef &fn) {
+    SCOPES_RESULT_TYPE(ValueRef);
+    assert(can_interpret(fn));
+    interpreted_functions.increment();
+    Interpreter interpreter;
+    auto flow = SCOPES_GET_RESULT(interpreter.call(fn, {}));
+    if (flow.kind == Flow::Raise) {
+        assert(flow.values.size() == 1);
+        SCOPES_RETURN_ERROR((Error *)cast<ConstPointer>(flow.values[0])->value);
+    }
+    assert(flow.kind == Flow::Return);
+    assert(flow.values.size() == 1);
+    return valueref_arg(flow.values, 0);
+}
+
+} // namespace scopes
@@ -0,0 +1,36 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_INTERPRETER_HPP
+#define SCOPES_INTERPRETER_HPP
+
+#include "result.hpp"
+#include "valueref.inc"
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// INTERPRETER
+//------------------------------------------------------------------------------
+
+/* runs proven functions that are executed once at compile time, such as the
+   stages of a module, without generating code for them.
+
+   only functions whose result is a Value and who are small and straight-line
+   are interpreted: their instructions are calls to other such functions and
+   to a fixed set of runtime functions that build scopes and values, bitcasts,
+   labels and merges. there are no loops, and no memory is read or written.
+   everything else is left to compile(). */
+
+// whether fn can be interpreted; cheap enough to be checked before every
+// compile() of a function that would run only once
+bool can_interpret(const FunctionRef &fn);
+// runs fn, which must be interpretable, and returns the Value it returns
+SCOPES_RESULT(ValueRef) interpret(const FunctionRef &fn);
+
+} // namespace scopes
+
+#endif // SCOPES_INTERPRETER_HPP
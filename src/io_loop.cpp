@@ -0,0 +1,323 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "io_loop.hpp"
+#include "thread_pool.hpp"
+#include "scopes/config.h"
+
+#include <errno.h>
+
+#ifndef SCOPES_WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
+#if defined(SCOPES_MACOS) || defined(__APPLE__)
+#include <sys/event.h>
+#define SCOPES_IO_KQUEUE
+#else
+#include <sys/epoll.h>
+#endif
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <mutex>
+#include <thread>
+
+namespace scopes {
+
+#ifdef SCOPES_WIN32
+
+// windows sockets aren't descriptors; not supported yet
+
+int io_wait(int fd, bool write) { return -ENOSYS; }
+int io_set_nonblocking(int fd) { return -ENOSYS; }
+int64_t io_read(int fd, void *buf, int64_t size) { return -ENOSYS; }
+int64_t io_write(int fd, const void *buf, int64_t size) { return -ENOSYS; }
+int io_accept(int fd) { return -ENOSYS; }
+int io_connect(int fd, const void *addr, int addrlen) { return -ENOSYS; }
+int64_t io_writev(int fd, const void *slices, int count) { return -ENOSYS; }
+int io_open(const char *path, int mode) { return -ENOSYS; }
+int io_advise(int fd, int64_t offset, int64_t count, int advice) { return 0; }
+
+#else
+
+namespace {
+
+// a coroutine or thread waiting for a descriptor; lives on the stack of the
+// waiting side, which doesn't continue until the waiter is done with
+struct Waiter {
+    int fd;
+    bool write;
+    int result;
+    // the parked coroutine, or else the wait group a thread waits on
+    Task *task;
+    WaitGroup *wg;
+};
+
+static int poller_fd = -1;
+static std::once_flag poller_once;
+
+// every registration fires only once, so that no event ever refers to a
+// waiter that has already been resumed
+static int register_waiter(Waiter *w) {
+#ifdef SCOPES_IO_KQUEUE
+    struct kevent change;
+    EV_SET(&change, w->fd, w->write?EVFILT_WRITE:EVFILT_READ,
+        EV_ADD | EV_ONESHOT, 0, 0, w);
+    if (kevent(poller_fd, &change, 1, nullptr, 0, nullptr) < 0)
+        return -errno;
+#else
+    struct epoll_event event;
+    event.events = (w->write?EPOLLOUT:EPOLLIN) | EPOLLONESHOT;
+    event.data.ptr = w;
+    // a descriptor stays registered, disabled, after its event has fired
+    if (epoll_ctl(poller_fd, EPOLL_CTL_MOD, w->fd, &event) < 0) {
+        if ((errno != ENOENT)
+            || (epoll_ctl(poller_fd, EPOLL_CTL_ADD, w->fd, &event) < 0))
+            return -errno;
+    }
+#endif
+    return 0;
+}
+
+static void poller_main() {
+    const int MAX_EVENTS = 256;
+    while (true) {
+#ifdef SCOPES_IO_KQUEUE
+        struct kevent events[MAX_EVENTS];
+        int count = kevent(poller_fd, nullptr, 0, events, MAX_EVENTS, nullptr);
+#else
+        struct epoll_event events[MAX_EVENTS];
+        int count = epoll_wait(poller_fd, events, MAX_EVENTS, -1);
+#endif
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("event loop");
+            fflush(stdout);
+            abort();
+        }
+        for (int i = 0; i < count; ++i) {
+#ifdef SCOPES_IO_KQUEUE
+            Waiter *w = (Waiter *)events[i].udata;
+#else
+            Waiter *w = (Waiter *)events[i].data.ptr;
+#endif
+            // errors and hang ups are reported by the retried operation
+            w->result = 0;
+            // the waiter is gone once the waiting side continues
+            if (w->task) {
+                task_resume(w->task);
+            } else {
+                waitgroup_done(w->wg);
+            }
+        }
+    }
+}
+
+// the event loop thread is never stopped; it only ever waits
+static void start_poller() {
+    std::call_once(poller_once, []{
+#ifdef SCOPES_IO_KQUEUE
+        poller_fd = kqueue();
+#else
+        poller_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+        if (poller_fd < 0) {
+            perror("event loop");
+            fflush(stdout);
+            abort();
+        }
+        std::thread(poller_main).detach();
+    });
+}
+
+static void park_waiter(Task *task, void *ctx) {
+    Waiter *w = (Waiter *)ctx;
+    w->task = task;
+    int result = register_waiter(w);
+    if (result < 0) {
+        w->result = result;
+        task_resume(task);
+    }
+}
+
+static bool would_block(int err) {
+    return (err == EAGAIN) || (err == EWOULDBLOCK);
+}
+
+} // namespace
+
+int io_wait(int fd, bool write) {
+    start_poller();
+    Waiter w;
+    w.fd = fd;
+    w.write = write;
+    w.result = 0;
+    w.task = nullptr;
+    w.wg = nullptr;
+    if (task_current_coroutine()) {
+        task_park(park_waiter, &w);
+        return w.result;
+    }
+    // threads run queued tasks while they wait, which the descriptor may
+    // well be waiting for
+    w.wg = waitgroup_new();
+    waitgroup_add(w.wg, 1);
+    int result = register_waiter(&w);
+    if (result == 0) {
+        waitgroup_wait(w.wg);
+        result = w.result;
+    }
+    waitgroup_free(w.wg);
+    return result;
+}
+
+int io_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+        return -errno;
+    return 0;
+}
+
+int64_t io_read(int fd, void *buf, int64_t size) {
+    while (true) {
+        auto result = read(fd, buf, (size_t)size);
+        if (result >= 0)
+            return result;
+        int err = errno;
+        if (err == EINTR)
+            continue;
+        if (!would_block(err))
+            return -err;
+        int ready = io_wait(fd, false);
+        if (ready < 0)
+            return ready;
+    }
+}
+
+int64_t io_write(int fd, const void *buf, int64_t size) {
+    while (true) {
+        auto result = write(fd, buf, (size_t)size);
+        if (result >= 0)
+            return result;
+        int err = errno;
+        if (err == EINTR)
+            continue;
+        if (!would_block(err))
+            return -err;
+        int ready = io_wait(fd, true);
+        if (ready < 0)
+            return ready;
+    }
+}
+
+int io_accept(int fd) {
+    while (true) {
+        int result = accept(fd, nullptr, nullptr);
+        if (result >= 0) {
+            int nb = io_set_nonblocking(result);
+            if (nb < 0) {
+                close(result);
+                return nb;
+            }
+            return result;
+        }
+        int err = errno;
+        if ((err == EINTR) || (err == ECONNABORTED))
+            continue;
+        if (!would_block(err))
+            return -err;
+        int ready = io_wait(fd, false);
+        if (ready < 0)
+            return ready;
+    }
+}
+
+int io_connect(int fd, const void *addr, int addrlen) {
+    if (connect(fd, (const struct sockaddr *)addr, (socklen_t)addrlen) == 0)
+        return 0;
+    if ((errno != EINPROGRESS) && (errno != EINTR))
+        return -errno;
+    // the connection completes in the background
+    int ready = io_wait(fd, true);
+    if (ready < 0)
+        return ready;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+        return -errno;
+    return -err;
+}
+
+int64_t io_writev(int fd, const void *slices, int count) {
+#ifdef IOV_MAX
+    // the rest is written by the next call
+    if (count > IOV_MAX)
+        count = IOV_MAX;
+#endif
+    while (true) {
+        auto result = writev(fd, (const struct iovec *)slices, count);
+        if (result >= 0)
+            return result;
+        int err = errno;
+        if (err == EINTR)
+            continue;
+        if (!would_block(err))
+            return -err;
+        int ready = io_wait(fd, true);
+        if (ready < 0)
+            return ready;
+    }
+}
+
+int io_open(const char *path, int mode) {
+    int flags = O_CLOEXEC;
+    switch(mode) {
+    case 0: flags |= O_RDONLY; break;
+    case 1: flags |= O_WRONLY | O_CREAT | O_TRUNC; break;
+    case 2: flags |= O_WRONLY | O_CREAT | O_APPEND; break;
+    default: return -EINVAL;
+    }
+    while (true) {
+        int fd = open(path, flags, 0644);
+        if (fd >= 0)
+            return fd;
+        if (errno != EINTR)
+            return -errno;
+    }
+}
+
+int io_advise(int fd, int64_t offset, int64_t count, int advice) {
+#ifdef SCOPES_IO_KQUEUE
+    // macOS only knows whether to read ahead
+    switch(advice) {
+    case 1: return (fcntl(fd, F_RDAHEAD, 1) < 0)?-errno:0;
+    case 2: return (fcntl(fd, F_RDAHEAD, 0) < 0)?-errno:0;
+    default: return 0;
+    }
+#else
+    int flag = POSIX_FADV_NORMAL;
+    switch(advice) {
+    case 0: flag = POSIX_FADV_NORMAL; break;
+    case 1: flag = POSIX_FADV_SEQUENTIAL; break;
+    case 2: flag = POSIX_FADV_RANDOM; break;
+    case 3: flag = POSIX_FADV_WILLNEED; break;
+    case 4: flag = POSIX_FADV_DONTNEED; break;
+    default: return -EINVAL;
+    }
+    // returns the error rather than setting errno
+    return -posix_fadvise(fd, (off_t)offset, (off_t)count, flag);
+#endif
+}
+
+#endif
+
+} // namespace scopes
@@ -0,0 +1,47 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_IO_LOOP_HPP
+#define SCOPES_IO_LOOP_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace scopes {
+
+/* non-blocking file and socket operations. a coroutine task that has to wait
+   for a descriptor is parked with the event loop of the runtime, which runs on
+   a thread of its own and resumes the coroutine when the descriptor is ready,
+   so that a few threads can serve many connections. outside of a coroutine,
+   the calling thread blocks instead.
+
+   all functions return -errno on failure. */
+
+// waits until fd is ready for writing when write is set, or else for reading
+int io_wait(int fd, bool write);
+int io_set_nonblocking(int fd);
+// returns the number of bytes read, or 0 at the end of the stream
+int64_t io_read(int fd, void *buf, int64_t size);
+// returns the number of bytes written, which can be less than size
+int64_t io_write(int fd, const void *buf, int64_t size);
+// returns a new non-blocking descriptor for the next connection
+int io_accept(int fd);
+int io_connect(int fd, const void *addr, int addrlen);
+// writes the count buffers described by slices, pairs of pointer and size
+// laid out like struct iovec, with a single call, and returns the number of
+// bytes written, which can be less than their total size
+int64_t io_writev(int fd, const void *slices, int count);
+// opens the file at path for reading when mode is 0, for writing when mode is
+// 1, which creates or truncates it, or for appending when mode is 2; files
+// always block, so reads and writes on them never wait on the event loop
+int io_open(const char *path, int mode);
+// hints at how the range of the file will be read, with advice as for file
+// maps; does nothing where the system has no such hints
+int io_advise(int fd, int64_t offset, int64_t count, int advice);
+
+} // namespace scopes
+
+#endif // SCOPES_IO_LOOP_HPP
@@ -13,6 +13,7 @@
 #include "value.hpp"
 #include "dyn_cast.inc"
 #include "globals.hpp"
+#include "pow10.inc"
 
 #include "scopes/scopes.h"
 
@@ -20,12 +21,74 @@
 #include <assert.h>
 #include <cmath>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define SCOPES_LEXER_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define SCOPES_LEXER_NEON 1
+#include <arm_neon.h>
+#endif
+
 #pragma GCC diagnostic ignored "-Wvla-extension"
 
 namespace scopes {
 
 //------------------------------------------------------------------------------
 
+static const double EXACT_POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// the Eisel-Lemire algorithm as described in "Number Parsing at a Gigabyte
+// per Second" (Lemire 2021); computes the correctly rounded double closest to
+// man * 10^exp10, or fails in the rare cases where the 128-bit product is
+// not precise enough to decide, or the result is subnormal or infinite.
+static bool eisel_lemire(uint64_t man, int exp10, double &result) {
+    if ((exp10 < SCOPES_POW10_MIN_EXP10) || (exp10 > SCOPES_POW10_MAX_EXP10))
+        return false;
+    auto &&pow10 = POW10_128[exp10 - SCOPES_POW10_MIN_EXP10];
+    int clz = __builtin_clzll(man);
+    man <<= clz;
+    uint64_t exp2 = (uint64_t)(((217706 * exp10) >> 16) + 64 + 1023) - clz;
+    unsigned __int128 x = (unsigned __int128)man * pow10[0];
+    uint64_t xhi = (uint64_t)(x >> 64);
+    uint64_t xlo = (uint64_t)x;
+    if (((xhi & 0x1FF) == 0x1FF) && ((xlo + man) < man)) {
+        // the truncated low word of the power may carry into the result
+        unsigned __int128 y = (unsigned __int128)man * pow10[1];
+        uint64_t yhi = (uint64_t)(y >> 64);
+        uint64_t ylo = (uint64_t)y;
+        uint64_t mergedhi = xhi;
+        uint64_t mergedlo = xlo + yhi;
+        if (mergedlo < xlo)
+            mergedhi++;
+        if (((mergedhi & 0x1FF) == 0x1FF) && ((mergedlo + 1) == 0)
+            && ((ylo + man) < man))
+            return false;
+        xhi = mergedhi;
+        xlo = mergedlo;
+    }
+    uint64_t msb = xhi >> 63;
+    uint64_t mantissa = xhi >> (msb + 9);
+    exp2 -= 1 ^ msb;
+    // exactly halfway between two doubles, which is only possible for small
+    // powers of ten; round to even
+    if ((xlo == 0) && (exp10 >= -4) && (exp10 <= 23) && ((mantissa & 3) == 1)
+        && ((mantissa << (msb + 9)) == xhi))
+        mantissa &= ~(uint64_t)1;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >> 53) {
+        mantissa >>= 1;
+        exp2 += 1;
+    }
+    if ((exp2 - 1) >= (0x7FF - 1))
+        return false;
+    uint64_t bits = (exp2 << 52) | (mantissa & 0x000FFFFFFFFFFFFFull);
+    memcpy(&result, &bits, sizeof(result));
+    return true;
+}
+
 struct NumberParser {
     enum {
         NPF_Sign             = (1 << 0),
@@ -44,6 +107,10 @@ struct NumberParser {
     int dot = 0;
     std::vector<uint8_t> digits;
     std::vector<uint8_t> exponent_digits;
+    // set by parse_decimal, which leaves digits empty
+    bool decimal = false;
+    uint64_t decimal_integer = 0;
+    double decimal_real = 0.0;
 
     bool is_real() const {
         return (flags & NPF_Real) != 0;
@@ -86,6 +153,9 @@ struct NumberParser {
     }
 
     double as_double() const {
+        if (decimal) {
+            return is_negative()?-decimal_real:decimal_real;
+        }
         double result = 0.0;
         if (is_nan()) {
             result = nan("");
@@ -111,6 +181,9 @@ struct NumberParser {
 
     template<typename T>
     T as_integer() const {
+        if (decimal) {
+            return is_negative()?-(T)decimal_integer:(T)decimal_integer;
+        }
         int i = dot;
         assert(i <= digits.size());
         T exp = 1;
@@ -129,6 +202,120 @@ struct NumberParser {
         return as_integer<uint64_t>();
     }
 
+    // the common case of a decimal integer of at most 19 digits or a decimal
+    // real in [str, end); fails without changing anything on all other
+    // input, which parse() must handle instead.
+    // of reals with more than 19 significant digits, only the first 19 are
+    // read. the value is then between man and man + 1 times the power, so
+    // if both round to the same double, that double is the result.
+    bool parse_decimal(const char *&str, const char *end) {
+        const char *s = str;
+        uint16_t f = 0;
+        if (s == end)
+            return false;
+        if (*s == '+') {
+            f |= NPF_Sign;
+            s++;
+        } else if (*s == '-') {
+            f |= NPF_Sign | NPF_Negative;
+            s++;
+        }
+        const char *start = s;
+        uint64_t man = 0;
+        // significant digits, and whether nonzero digits were dropped
+        int count = 0;
+        bool truncated = false;
+        int exp10 = 0;
+        while ((s != end) && (*s >= '0') && (*s <= '9')) {
+            if (count < 19) {
+                man = man * 10 + (*s - '0');
+                if (man)
+                    count++;
+            } else {
+                truncated |= (*s != '0');
+                count++;
+                exp10++;
+            }
+            s++;
+        }
+        if (s == start)
+            return false;
+        if ((*start == '0') && ((start + 1) != end)
+            && ((start[1] == 'x') || (start[1] == 'b') || (start[1] == 'o')))
+            return false;
+        if ((s != end) && (*s == '.')) {
+            f |= NPF_Dot;
+            s++;
+            while ((s != end) && (*s >= '0') && (*s <= '9')) {
+                if (count < 19) {
+                    man = man * 10 + (*s - '0');
+                    if (man)
+                        count++;
+                    exp10--;
+                } else {
+                    truncated |= (*s != '0');
+                    count++;
+                }
+                s++;
+            }
+        }
+        if ((s != end) && (*s == 'e')) {
+            f |= NPF_Exponent;
+            s++;
+            bool negative = false;
+            if ((s != end) && ((*s == '+') || (*s == '-'))) {
+                negative = (*s == '-');
+                s++;
+            }
+            const char *exp_start = s;
+            int exp = 0;
+            while ((s != end) && (*s >= '0') && (*s <= '9')
+                && ((s - exp_start) < 4)) {
+                exp = exp * 10 + (*s - '0');
+                s++;
+            }
+            if (s == exp_start)
+                return false;
+            exp10 += negative?-exp:exp;
+        }
+        // parse() reads beyond the end and past characters that continue
+        // a number in ways we don't handle
+        if ((s == end) || (*s == '.') || (*s == 'e')
+            || ((*s >= '0') && (*s <= '9')))
+            return false;
+        if (f & (NPF_Dot | NPF_Exponent)) {
+            double value;
+            if (!man) {
+                value = 0.0;
+            } else if (truncated) {
+                double upper;
+                if (!eisel_lemire(man, exp10, value)
+                    || !eisel_lemire(man + 1, exp10, upper)
+                    || (value != upper))
+                    return false;
+            } else if ((man <= (1ull << 53)) && (exp10 >= -22) && (exp10 <= 22)) {
+                // both operands are exact, so the result is correctly rounded
+                value = (double)man;
+                if (exp10 < 0) {
+                    value /= EXACT_POW10[-exp10];
+                } else {
+                    value *= EXACT_POW10[exp10];
+                }
+            } else if (!eisel_lemire(man, exp10, value)) {
+                return false;
+            }
+            decimal_real = value;
+        } else if (count > 19) {
+            return false;
+        } else {
+            decimal_integer = man;
+        }
+        flags = f;
+        decimal = true;
+        str = s;
+        return true;
+    }
+
     bool parse(const char *&str) {
         enum State {
             State_UnknownSign = 0,
@@ -303,6 +490,143 @@ enum {
     RN_Typed = 2,
 };
 
+//------------------------------------------------------------------------------
+// SCANNING KERNELS
+//------------------------------------------------------------------------------
+
+/* each kernel returns the first position in [p, end) that the state machine
+   has to look at, skipping 16 bytes at a time where the target supports it.
+   the vector paths may stop early at characters that turn out to be
+   harmless; they never skip past one that matters. tabs always stop a scan
+   so that next() can reject them. */
+
+#if SCOPES_LEXER_SSE2
+typedef __m128i LexerVec;
+static inline LexerVec lexer_load(const char *p) {
+    return _mm_loadu_si128((const __m128i *)p); }
+static inline LexerVec lexer_eq(LexerVec x, char c) {
+    return _mm_cmpeq_epi8(x, _mm_set1_epi8(c)); }
+// unsigned x <= c
+static inline LexerVec lexer_le(LexerVec x, char c) {
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(c)), x); }
+// unsigned lo <= x <= hi
+static inline LexerVec lexer_range(LexerVec x, char lo, char hi) {
+    return lexer_le(_mm_sub_epi8(x, _mm_set1_epi8(lo)), (char)(hi - lo)); }
+static inline LexerVec lexer_or(LexerVec a, LexerVec b) {
+    return _mm_or_si128(a, b); }
+static inline LexerVec lexer_not(LexerVec m) {
+    return _mm_xor_si128(m, _mm_set1_epi8(-1)); }
+// index of the first lane set, or 16
+static inline int lexer_first(LexerVec m) {
+    int mask = _mm_movemask_epi8(m);
+    return mask?__builtin_ctz(mask):16; }
+#elif SCOPES_LEXER_NEON
+typedef uint8x16_t LexerVec;
+static inline LexerVec lexer_load(const char *p) {
+    return vld1q_u8((const uint8_t *)p); }
+static inline LexerVec lexer_eq(LexerVec x, char c) {
+    return vceqq_u8(x, vdupq_n_u8((uint8_t)c)); }
+static inline LexerVec lexer_le(LexerVec x, char c) {
+    return vcleq_u8(x, vdupq_n_u8((uint8_t)c)); }
+static inline LexerVec lexer_range(LexerVec x, char lo, char hi) {
+    return lexer_le(vsubq_u8(x, vdupq_n_u8((uint8_t)lo)), (char)(hi - lo)); }
+static inline LexerVec lexer_or(LexerVec a, LexerVec b) {
+    return vorrq_u8(a, b); }
+static inline LexerVec lexer_not(LexerVec m) {
+    return vmvnq_u8(m); }
+static inline int lexer_first(LexerVec m) {
+    // narrow to four bits per lane
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+        vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    return mask?(__builtin_ctzll(mask) >> 2):16; }
+#endif
+
+// characters that end or escape a symbol, including the zero that
+// strchr(TOKEN_TERMINATORS, c) also matches
+static bool lexer_is_symbol_stop(char c) {
+    return isspace(c) || (c == '\\') || strchr(TOKEN_TERMINATORS, c);
+}
+
+static const char *scan_symbol(const char *p, const char *end) {
+#if SCOPES_LEXER_SSE2 || SCOPES_LEXER_NEON
+    while ((end - p) >= 16) {
+        LexerVec x = lexer_load(p);
+        // controls and space; ( ); " #; [ \ ]; { | }; ' , ;
+        LexerVec m = lexer_le(x, ' ');
+        m = lexer_or(m, lexer_range(x, '(', ')'));
+        m = lexer_or(m, lexer_range(x, '"', '#'));
+        m = lexer_or(m, lexer_range(x, '[', ']'));
+        m = lexer_or(m, lexer_range(x, '{', '}'));
+        m = lexer_or(m, lexer_eq(x, '\''));
+        m = lexer_or(m, lexer_eq(x, ','));
+        m = lexer_or(m, lexer_eq(x, ';'));
+        int i = lexer_first(m);
+        if (i < 16) {
+            p += i;
+            if (lexer_is_symbol_stop(*p) || (*p == '\t'))
+                return p;
+            p++;
+            continue;
+        }
+        p += 16;
+    }
+#endif
+    while ((p != end) && !lexer_is_symbol_stop(*p) && (*p != '\t'))
+        p++;
+    return p;
+}
+
+static const char *scan_string(const char *p, const char *end, char terminator) {
+#if SCOPES_LEXER_SSE2 || SCOPES_LEXER_NEON
+    while ((end - p) >= 16) {
+        LexerVec x = lexer_load(p);
+        LexerVec m = lexer_eq(x, terminator);
+        m = lexer_or(m, lexer_eq(x, '\\'));
+        m = lexer_or(m, lexer_eq(x, '\n'));
+        m = lexer_or(m, lexer_eq(x, '\t'));
+        int i = lexer_first(m);
+        if (i < 16)
+            return p + i;
+        p += 16;
+    }
+#endif
+    while ((p != end) && (*p != terminator) && (*p != '\\')
+        && (*p != '\n') && (*p != '\t'))
+        p++;
+    return p;
+}
+
+// skips to the end of the line
+static const char *scan_line(const char *p, const char *end) {
+#if SCOPES_LEXER_SSE2 || SCOPES_LEXER_NEON
+    while ((end - p) >= 16) {
+        LexerVec x = lexer_load(p);
+        int i = lexer_first(lexer_or(lexer_eq(x, '\n'), lexer_eq(x, '\t')));
+        if (i < 16)
+            return p + i;
+        p += 16;
+    }
+#endif
+    while ((p != end) && (*p != '\n') && (*p != '\t'))
+        p++;
+    return p;
+}
+
+static const char *scan_spaces(const char *p, const char *end) {
+#if SCOPES_LEXER_SSE2 || SCOPES_LEXER_NEON
+    while ((end - p) >= 16) {
+        LexerVec x = lexer_load(p);
+        int i = lexer_first(lexer_not(lexer_eq(x, ' ')));
+        if (i < 16)
+            return p + i;
+        p += 16;
+    }
+#endif
+    while ((p != end) && (*p == ' '))
+        p++;
+    return p;
+}
+
 //------------------------------------------------------------------------------
 // S-EXPR LEXER & PARSER
 //------------------------------------------------------------------------------
@@ -362,7 +686,12 @@ int LexerParser::next_column() {
 }
 
 const Anchor *LexerParser::anchor() {
-    return Anchor::from(file, lineno, column(), offset());
+    // the same token is usually asked for its anchor more than once
+    int offset = this->offset();
+    if (!last_anchor || (last_anchor->offset != offset)) {
+        last_anchor = Anchor::from_unique(file, lineno, column(), offset);
+    }
+    return last_anchor;
 }
 
 SCOPES_RESULT(char) LexerParser::next() {
@@ -399,6 +728,9 @@ SCOPES_RESULT(void) LexerParser::read_symbol() {
     SCOPES_RESULT_TYPE(void);
     bool escape = false;
     while (true) {
+        if (!escape) {
+            next_cursor = scan_symbol(next_cursor, eof);
+        }
         if (is_eof()) {
             break;
         }
@@ -424,6 +756,9 @@ SCOPES_RESULT(void) LexerParser::read_symbol_or_prefix() {
     token = tok_symbol;
     bool escape = false;
     while (true) {
+        if (!escape) {
+            next_cursor = scan_symbol(next_cursor, eof);
+        }
         if (is_eof()) {
             break;
         }
@@ -451,6 +786,9 @@ SCOPES_RESULT(void) LexerParser::read_string(char terminator) {
     SCOPES_RESULT_TYPE(void);
     bool escape = false;
     while (true) {
+        if (!escape) {
+            next_cursor = scan_string(next_cursor, eof, terminator);
+        }
         if (is_eof()) {
             SCOPES_TRACE_PARSER(this->anchor());
             SCOPES_ERROR(ParserUnterminatedSequence);
@@ -483,6 +821,14 @@ SCOPES_RESULT(void) LexerParser::read_block(int indent) {
             break;
         }
         int next_col = next_column();
+        if (next_col > col) {
+            // the rest of the line is part of the block
+            next_cursor = scan_line(next_cursor, eof);
+            if (is_eof()) {
+                break;
+            }
+            next_col = next_column();
+        }
         char c = SCOPES_GET_RESULT(next());
         if (c == '\n') {
             newline();
@@ -572,10 +918,12 @@ SCOPES_RESULT(bool) LexerParser::read_number() {
 
     NumberParser number;
     const char *cend = cursor;
-    if (!number.parse(cend)
-        || (cend == cursor)
-        || (cend > eof))
-        return false;
+    if (!number.parse_decimal(cend, eof)) {
+        if (!number.parse(cend)
+            || (cend == cursor)
+            || (cend > eof))
+            return false;
+    }
     next_cursor = cend;
     if (number.is_real()) {
         value = ref(anchor(), ConstReal::from(TYPE_F32, number.as_double()));
@@ -639,6 +987,7 @@ skip:
     if (is_eof()) { token = tok_eof; goto done; }
     c = SCOPES_GET_RESULT(next());
     if (c == '\n') { newline(); }
+    if (c == ' ') { next_cursor = scan_spaces(next_cursor, eof); goto skip; }
     if (isspace(c)) { goto skip; }
     if (c == '#') { SCOPES_CHECK_RESULT(read_comment()); goto skip; }
     else if (c == '(') { token = tok_open; }
@@ -675,7 +1024,7 @@ Symbol LexerParser::get_symbol() {
     memcpy(dest, string, string_len);
     dest[string_len] = 0;
     auto size = unescape_string(dest);
-    return Symbol(String::from(dest, size));
+    return Symbol::from_bytes(dest, size);
 }
 const String *LexerParser::get_string() {
     auto len = string_len - 2;
@@ -752,8 +1101,10 @@ LexerParser::ListBuilder::ListBuilder(LexerParser &_lexer) :
     prev(EOL),
     eol(EOL) {}
 
+// the builder only ever creates the cells of parsed source, which are never
+// shared, so none of them are interned
 void LexerParser::ListBuilder::append(ValueRef value) {
-    prev = List::from(value, prev);
+    prev = List::from_unique(value, prev);
 }
 
 bool LexerParser::ListBuilder::is_empty() const {
@@ -771,13 +1122,13 @@ void LexerParser::ListBuilder::reset_start() {
 void LexerParser::ListBuilder::split(const Anchor *anchor) {
     // reverse what we have, up to last split point and wrap result
     // in cell
-    prev = List::from(ref(anchor,
-        ConstPointer::list_from(reverse_list(prev, eol))), eol);
+    prev = List::from_unique(ref(anchor,
+        ConstPointer::list_from(reverse_list_unique(prev, eol))), eol);
     reset_start();
 }
 
 const List *LexerParser::ListBuilder::get_result() {
-    return reverse_list(prev);
+    return reverse_list_unique(prev);
 }
 
 //////////////////////////////
@@ -986,50 +1337,185 @@ SCOPES_RESULT(ValueRef) LexerParser::parse_naked(int column, Token end_token) {
     }
 }
 
+SCOPES_RESULT(bool) LexerParser::parse_top_level_item(ListBuilder &builder, int &lineno) {
+    SCOPES_RESULT_TYPE(bool);
+    //bool escape = false;
+
+    if ((this->token == tok_eof) || (this->token == tok_none)) {
+        return false;
+    } else if (this->token == tok_escape) {
+        //escape = true;
+        SCOPES_CHECK_RESULT(this->read_token());
+        if (this->lineno <= lineno) {
+            SCOPES_TRACE_PARSER(this->anchor());
+            SCOPES_ERROR(ParserStrayEscapeToken);
+        }
+        lineno = this->lineno;
+    } else if (this->lineno > lineno) {
+        if (this->column() != 1) {
+            SCOPES_TRACE_PARSER(this->anchor());
+            SCOPES_ERROR(ParserIndentationMismatch);
+        }
+
+        //escape = false;
+        lineno = this->lineno;
+        // keep adding elements while we're in the same line
+        while ((this->token != tok_eof)
+                && (this->token != tok_none)
+                && (this->lineno == lineno)) {
+            builder.append(SCOPES_GET_RESULT(parse_naked(1, tok_none)));
+        }
+    } else if (this->token == tok_statement) {
+        SCOPES_TRACE_PARSER(this->anchor());
+        SCOPES_ERROR(ParserStrayStatementToken);
+    } else {
+        builder.append(SCOPES_GET_RESULT(parse_any()));
+        lineno = this->next_lineno;
+        SCOPES_CHECK_RESULT(this->read_token());
+    }
+    return true;
+}
+
+SCOPES_RESULT(bool) LexerParser::parse_top_level(ListBuilder &builder,
+    const std::function<bool (int)> &stop_at) {
+    SCOPES_RESULT_TYPE(bool);
+    int lineno = 0;
+    while (true) {
+        if (stop_at
+            && (this->token != tok_eof)
+            && (this->token != tok_none)
+            && (this->token != tok_escape)
+            && (this->lineno > lineno)
+            && (this->column() == 1)
+            && stop_at(this->offset())) {
+            return true;
+        }
+        if (!SCOPES_GET_RESULT(parse_top_level_item(builder, lineno)))
+            return false;
+    }
+}
+
 SCOPES_RESULT(ValueRef) LexerParser::parse() {
     SCOPES_RESULT_TYPE(ValueRef);
     SCOPES_CHECK_RESULT(this->read_token());
-    int lineno = 0;
-    //bool escape = false;
-
     const Anchor *anchor = this->anchor();
     ListBuilder builder(*this);
+    SCOPES_CHECK_RESULT(parse_top_level(builder, nullptr));
+    return ValueRef(anchor, ConstPointer::list_from(builder.get_result()));
+}
 
-    while (this->token != tok_eof) {
-        if (this->token == tok_none) {
-            break;
-        } else if (this->token == tok_escape) {
-            //escape = true;
-            SCOPES_CHECK_RESULT(this->read_token());
-            if (this->lineno <= lineno) {
-                SCOPES_TRACE_PARSER(this->anchor());
-                SCOPES_ERROR(ParserStrayEscapeToken);
-            }
-            lineno = this->lineno;
-        } else if (this->lineno > lineno) {
-            if (this->column() != 1) {
-                SCOPES_TRACE_PARSER(this->anchor());
-                SCOPES_ERROR(ParserIndentationMismatch);
-            }
+SCOPES_RESULT(ValueRef) LexerParser::parse_next() {
+    SCOPES_RESULT_TYPE(ValueRef);
+    if (!streaming) {
+        SCOPES_CHECK_RESULT(this->read_token());
+        streaming = true;
+    }
+    // a line can hold more than one expression
+    while (!stream_pending) {
+        ListBuilder builder(*this);
+        if (!SCOPES_GET_RESULT(parse_top_level_item(builder, stream_lineno)))
+            return ValueRef();
+        stream_pending = builder.get_result();
+    }
+    auto value = stream_pending->at;
+    stream_pending = stream_pending->next;
+    return value;
+}
 
-            //escape = false;
-            lineno = this->lineno;
-            // keep adding elements while we're in the same line
-            while ((this->token != tok_eof)
-                    && (this->token != tok_none)
-                    && (this->lineno == lineno)) {
-                builder.append(SCOPES_GET_RESULT(parse_naked(1, tok_none)));
-            }
-        } else if (this->token == tok_statement) {
-            SCOPES_TRACE_PARSER(this->anchor());
-            SCOPES_ERROR(ParserStrayStatementToken);
-        } else {
-            builder.append(SCOPES_GET_RESULT(parse_any()));
-            lineno = this->next_lineno;
-            SCOPES_CHECK_RESULT(this->read_token());
+//------------------------------------------------------------------------------
+// INCREMENTAL PARSING
+//------------------------------------------------------------------------------
+
+static const List *shift_anchors(const List *l,
+    const std::unique_ptr<SourceFile> &file, int lines, int offset);
+
+// moves all anchors of value by lines and offset into file
+static ValueRef shift_anchors(const ValueRef &value,
+    const std::unique_ptr<SourceFile> &file, int lines, int offset) {
+    auto a = value.anchor();
+    auto anchor = Anchor::from_unique(file,
+        a->lineno + lines, a->column, a->offset + offset);
+    auto ptr = value.dyn_cast<ConstPointer>();
+    if (ptr && (ptr->get_type() == TYPE_List)) {
+        return ValueRef(anchor, ConstPointer::list_from(
+            shift_anchors((const List *)ptr->value, file, lines, offset)));
+    }
+    return ValueRef(anchor, value);
+}
+
+static const List *shift_anchors(const List *l,
+    const std::unique_ptr<SourceFile> &file, int lines, int offset) {
+    std::vector<ValueRef> values;
+    while (l) {
+        values.push_back(shift_anchors(l->at, file, lines, offset));
+        l = l->next;
+    }
+    return List::from(values.data(), values.size());
+}
+
+SCOPES_RESULT(ValueRef) parse_incremental(const ValueRef &previous,
+    const String *text, int offset, int removed, int inserted) {
+    SCOPES_RESULT_TYPE(ValueRef);
+    auto root = previous.anchor();
+    auto file = SourceFile::from_string(root->path, text);
+    assert(file);
+    auto ptr = previous.dyn_cast<ConstPointer>();
+    if (!ptr || (ptr->get_type() != TYPE_List)) {
+        LexerParser parser(std::move(file));
+        return parser.parse();
+    }
+    auto elements = (const List *)ptr->value;
+    // expressions that begin a line are the points where parsing can resume
+    const List *resume = nullptr;
+    absl::flat_hash_map<int, const List *> tails;
+    for (auto l = elements; l; l = l->next) {
+        auto anchor = l->at.anchor();
+        if (anchor->column != 1)
+            continue;
+        if (anchor->offset < offset) {
+            resume = l;
+        } else if (anchor->offset >= (offset + removed)) {
+            tails.insert({ anchor->offset, l });
         }
     }
-    return ValueRef(anchor, ConstPointer::list_from(builder.get_result()));
+    const Anchor *anchor = root;
+    std::unique_ptr<LexerParser> parser;
+    if (resume) {
+        // nothing before the line of the first change can parse differently
+        auto at = resume->at.anchor();
+        parser.reset(new LexerParser(std::move(file), at->offset));
+        parser->lineno = parser->next_lineno = at->lineno;
+    } else {
+        parser.reset(new LexerParser(std::move(file)));
+    }
+    LexerParser::ListBuilder builder(*parser);
+    for (auto l = elements; l != resume; l = l->next) {
+        builder.append(l->at);
+    }
+    SCOPES_CHECK_RESULT(parser->read_token());
+    if (!resume) {
+        anchor = parser->anchor();
+    }
+    // from a line start past the edit that an old line started at, the
+    // rest of the text is unchanged
+    int delta = inserted - removed;
+    const List *tail = nullptr;
+    int lines = 0;
+    SCOPES_CHECK_RESULT(parser->parse_top_level(builder, [&](int at) {
+        if (at < (offset + inserted))
+            return false;
+        auto it = tails.find(at - delta);
+        if (it == tails.end())
+            return false;
+        tail = it->second;
+        lines = parser->lineno - tail->at.anchor()->lineno;
+        return true;
+    }));
+    if (tail && (lines || delta)) {
+        tail = shift_anchors(tail, parser->file, lines, delta);
+    }
+    auto result = reverse_list_unique(builder.prev, EOL, tail);
+    return ValueRef(anchor, ConstPointer::list_from(result));
 }
 
 
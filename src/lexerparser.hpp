@@ -12,6 +12,7 @@
 #include "symbol.hpp"
 
 #include <stddef.h>
+#include <functional>
 #include "absl/container/flat_hash_map.h"
 
 namespace scopes {
@@ -148,8 +149,23 @@ struct LexerParser {
 
     SCOPES_RESULT(ValueRef) parse_naked(int column, Token end_token);
 
+    // parses the next line or escaped item of the top level into builder;
+    // returns false at the end of input
+    SCOPES_RESULT(bool) parse_top_level_item(ListBuilder &builder, int &lineno);
+
+    // parses top-level expressions into builder; stops before the first
+    // line at column 1 for whose offset stop_at returns true, if given.
+    // returns true if stopped early.
+    SCOPES_RESULT(bool) parse_top_level(ListBuilder &builder,
+        const std::function<bool (int)> &stop_at);
+
     SCOPES_RESULT(ValueRef) parse();
 
+    // returns the top-level expressions of the input one at a time, without
+    // building the list of all of them; returns an empty value after the
+    // last one. don't mix with parse().
+    SCOPES_RESULT(ValueRef) parse_next();
+
     Token token;
     int base_offset;
     std::unique_ptr<SourceFile> file;
@@ -167,8 +183,21 @@ struct LexerParser {
 
     ValueRef value;
     absl::flat_hash_map<Symbol, ConstIntRef, Symbol::Hash> prefix_symbol_map;
+    const Anchor *last_anchor = nullptr;
+
+    // state of parse_next
+    bool streaming = false;
+    int stream_lineno = 0;
+    const List *stream_pending = nullptr;
 };
 
+// parses text, which is the text that produced previous with the removed
+// characters at offset replaced by inserted new ones. top-level expressions
+// that begin before the line of the edit, or at a line after it that lines
+// up with a line of the old text, are taken from previous instead of being
+// parsed again.
+SCOPES_RESULT(ValueRef) parse_incremental(const ValueRef &previous,
+    const String *text, int offset, int removed, int inserted);
 
 } // namespace scopes
 
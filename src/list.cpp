@@ -5,12 +5,15 @@
 */
 
 #include "list.hpp"
+#include "timer.hpp"
 #include "hash.hpp"
 #include "value.hpp"
 #include "error.hpp"
 #include "globals.hpp"
+#include "intern.hpp"
+#include "alloc.hpp"
 
-#include "absl/container/flat_hash_set.h"
+#include <atomic>
 
 namespace scopes {
 
@@ -32,7 +35,20 @@ std::size_t List::Hash::operator()(const List *l) const {
         ), std::hash<const List *>{}(l->next));
 }
 
-static absl::flat_hash_set<const List *, List::Hash, List::KeyEqual> list_map;
+static InternSet<const List *, List::Hash, List::KeyEqual> list_map;
+
+// one pool per thread, as parsing runs on several threads; pools are never
+// freed, since parsed lists live as long as the process
+static thread_local GreedyAlloc<&no_tracking> *unique_list_pool = nullptr;
+static std::atomic<uint64_t> unique_list_count(0);
+
+static MemoryStat list_map_memory("lists", [](MemoryUsage &usage) {
+    list_map.measure(usage.objects, usage.bytes);
+    usage.bytes += usage.objects * sizeof(List);
+    auto unique = unique_list_count.load(std::memory_order_relaxed);
+    usage.objects += unique;
+    usage.bytes += unique * sizeof(List);
+});
 
 List::List(const ValueRef &_at, const List *_next, size_t count) :
     at(_at),
@@ -49,13 +65,28 @@ ValueRef List::first() const {
 
 const List *List::from(const ValueRef &_at, const List *_next) {
     List list(_at, _next, 0);
-    auto it = list_map.find(&list);
-    if (it != list_map.end()) {
-        return *it;
+    return list_map.intern(&list, [&]() {
+        return (const List *)new List(_at, _next,
+            (_next != EOL)?(List::count(_next) + 1):1);
+    });
+}
+
+const List *List::from_unique(const ValueRef &_at, const List *_next) {
+    if (!unique_list_pool) {
+        unique_list_pool = new GreedyAlloc<&no_tracking>();
+    }
+    unique_list_count.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = unique_list_pool->alloc(sizeof(List));
+    return new (ptr) List(_at, _next,
+        (_next != EOL)?(List::count(_next) + 1):1);
+}
+
+const List *List::from_unique(ValueRef const *values, int N) {
+    const List *list = EOL;
+    for (int i = N - 1; i >= 0; --i) {
+        list = from_unique(values[i], list);
     }
-    const List *l = new List(_at, _next, (_next != EOL)?(List::count(_next) + 1):1);
-    list_map.insert(l);
-    return l;
+    return list;
 }
 
 size_t List::count(const List *l) {
@@ -114,4 +145,14 @@ const List *reverse_list(
     return next;
 }
 
+const List *reverse_list_unique(
+    const List *l, const List *eol, const List *cat_to) {
+    const List *next = cat_to;
+    while (l != eol) {
+        next = List::from_unique(l->at, next);
+        l = l->next;
+    }
+    return next;
+}
+
 } // namespace scopes
@@ -57,6 +57,13 @@ public:
 
     static const List *join(const List *a, const List *b);
 
+    // a cell that isn't interned, so building it costs no hashing. for
+    // parsed source, whose elements carry anchors of their own and are
+    // therefore never shared anyway. lists compare by content, so unique
+    // cells only differ from interned ones in identity.
+    static const List *from_unique(const ValueRef &_at, const List *_next);
+    static const List *from_unique(ValueRef const *values, int N);
+
     // these only work with lists that aren't EOL
 
     struct KeyEqual {
@@ -84,6 +91,9 @@ const List *reverse_list_inplace(
 #endif
 const List *reverse_list(
     const List *l, const List *eol = EOL, const List *cat_to = EOL);
+// as reverse_list, building unique cells
+const List *reverse_list_unique(
+    const List *l, const List *eol = EOL, const List *cat_to = EOL);
 
 } // namespace scopes
 
@@ -0,0 +1,306 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "memo.hpp"
+#include "value.hpp"
+#include "hash.hpp"
+#include "timer.hpp"
+#include "dyn_cast.inc"
+
+#include "scopes/scopes.h"
+
+#include <algorithm>
+#include "absl/container/flat_hash_map.h"
+
+namespace scopes {
+
+struct MemoKeyEqual {
+    bool operator()( Value *lhs, Value *rhs ) const {
+        if (lhs == rhs) return true;
+        if (lhs->kind() != rhs->kind())
+            return false;
+        if (isa<ArgumentList>(lhs)) {
+            auto a = cast<ArgumentList>(lhs);
+            auto b = cast<ArgumentList>(rhs);
+            if (a->get_type() != b->get_type())
+                return false;
+            for (size_t i = 0; i < a->values.size(); ++i) {
+                auto u = a->values[i];
+                auto v = b->values[i];
+                if (u == v) continue;
+                if (u->kind() != v->kind())
+                    return false;
+                if (u.isa<Pure>()) {
+                    if (!u.cast<Pure>()->key_equal(v.cast<Pure>().unref()))
+                        return false;
+                } else {
+                    if (u != v)
+                        return false;
+                }
+            }
+            return true;
+        } else if (isa<ArgumentListTemplate>(lhs)) {
+            auto a = cast<ArgumentListTemplate>(lhs);
+            auto b = cast<ArgumentListTemplate>(rhs);
+            auto &&a_values = a->values();
+            auto &&b_values = b->values();
+            for (size_t i = 0; i < a_values.size(); ++i) {
+                auto u = a_values[i];
+                auto v = b_values[i];
+                if (u == v) continue;
+                if (u->kind() != v->kind())
+                    return false;
+                if (u.isa<Pure>()) {
+                    if (!u.cast<Pure>()->key_equal(v.cast<Pure>().unref()))
+                        return false;
+                } else {
+                    if (u != v)
+                        return false;
+                }
+            }
+            return true;
+        } else if (isa<Pure>(lhs)) {
+            if (isa<ConstPointer>(lhs)
+                && cast<ConstPointer>(lhs)->get_type() == TYPE_List
+                && cast<ConstPointer>(rhs)->get_type() == TYPE_List) {
+                return sc_list_compare(
+                    (const List *)cast<ConstPointer>(lhs)->value,
+                    (const List *)cast<ConstPointer>(rhs)->value);
+            }
+            return cast<Pure>(lhs)->key_equal(cast<Pure>(rhs));
+        } else {
+            return false;
+        }
+    }
+};
+
+struct MemoHash {
+    std::size_t operator()(Value *l) const {
+        if (isa<ArgumentList>(l)) {
+            auto alist = cast<ArgumentList>(l);
+            uint64_t h = std::hash<const Type *>{}(alist->get_type());
+            for (size_t i = 0; i < alist->values.size(); ++i) {
+                auto x = alist->values[i];
+                if (x.isa<Pure>()) {
+                    h = hash2(h, x.cast<Pure>()->hash());
+                } else {
+                    h = hash2(h, std::hash<const TypedValue *>{}(x.unref()));
+                }
+            }
+            return h;
+        } else if (isa<ArgumentListTemplate>(l)) {
+            auto alist = cast<ArgumentListTemplate>(l);
+            uint64_t h = 0;
+            auto &&values = alist->values();
+            for (size_t i = 0; i < values.size(); ++i) {
+                auto x = values[i];
+                if (x.isa<Pure>()) {
+                    h = hash2(h, x.cast<Pure>()->hash());
+                } else {
+                    h = hash2(h, std::hash<const Value *>{}(x.unref()));
+                }
+            }
+            return h;
+        } else if (isa<Pure>(l)) {
+            return cast<Pure>(l)->hash();
+        } else {
+            return std::hash<const Value *>{}(l);
+        }
+    }
+};
+
+namespace {
+
+struct MemoEntry {
+    ValueRef value;
+    // the tick of the table at the last use
+    uint64_t used;
+};
+
+typedef absl::flat_hash_map<Value *, MemoEntry, MemoHash, MemoKeyEqual> MemoMap;
+
+struct MemoTable {
+    MemoMap map;
+    size_t capacity = 0;
+    uint64_t tick = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+
+    // evicts the least recently used entries until count entries are left
+    void shrink(size_t count) {
+        if (map.size() <= count)
+            return;
+        std::vector<uint64_t> ticks;
+        ticks.reserve(map.size());
+        for (auto &&entry : map) {
+            ticks.push_back(entry.second.used);
+        }
+        auto excess = map.size() - count;
+        std::nth_element(ticks.begin(), ticks.begin() + (excess - 1), ticks.end());
+        // ticks are unique, so exactly the excess entries are this old
+        auto oldest = ticks[excess - 1];
+        for (auto it = map.begin(); it != map.end();) {
+            if (it->second.used <= oldest) {
+                map.erase(it++);
+                evictions++;
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+typedef absl::flat_hash_map<Value *, MemoTable *, MemoHash, MemoKeyEqual> MemoTables;
+
+// memoization only happens on the thread that proves
+static MemoTables memo_tables;
+static MemoTable shared_memo_table;
+
+static Value *memo_namespace(Value *key) {
+    if (isa<ArgumentList>(key)) {
+        auto &&values = cast<ArgumentList>(key)->values;
+        if (!values.empty())
+            return values[0].unref();
+    } else if (isa<ArgumentListTemplate>(key)) {
+        auto &&values = cast<ArgumentListTemplate>(key)->values();
+        if (!values.empty())
+            return values[0].unref();
+    }
+    return nullptr;
+}
+
+static MemoTable *find_memo_table(Value *ns) {
+    if (!ns)
+        return &shared_memo_table;
+    auto it = memo_tables.find(ns);
+    if (it == memo_tables.end())
+        return nullptr;
+    return it->second;
+}
+
+static MemoTable *get_memo_table(Value *ns) {
+    if (!ns)
+        return &shared_memo_table;
+    auto ret = memo_tables.insert({ns, nullptr});
+    if (ret.second) {
+        ret.first->second = new MemoTable();
+    }
+    return ret.first->second;
+}
+
+static bool refers_to_released(Value *value) {
+    if (isa<Function>(value)) {
+        return cast<Function>(value)->released;
+    } else if (isa<ArgumentList>(value)) {
+        for (auto &&x : cast<ArgumentList>(value)->values) {
+            if (refers_to_released(x.unref()))
+                return true;
+        }
+    } else if (isa<ArgumentListTemplate>(value)) {
+        for (auto &&x : cast<ArgumentListTemplate>(value)->values()) {
+            if (refers_to_released(x.unref()))
+                return true;
+        }
+    }
+    return false;
+}
+
+static MemoryStat memo_memory("memo map", [](MemoryUsage &usage) {
+    usage.objects = shared_memo_table.map.size();
+    usage.bytes = hash_table_bytes(shared_memo_table.map)
+        + hash_table_bytes(memo_tables);
+    for (auto &&entry : memo_tables) {
+        usage.objects += entry.second->map.size();
+        usage.bytes += sizeof(MemoTable) + hash_table_bytes(entry.second->map);
+    }
+});
+
+} // namespace
+
+bool memo_key_equal(Value *a, Value *b) {
+    return MemoKeyEqual{}(a, b);
+}
+
+bool memo_get(Value *key, ValueRef &value) {
+    auto table = get_memo_table(memo_namespace(key));
+    auto it = table->map.find(key);
+    if (it == table->map.end()) {
+        table->misses++;
+        return false;
+    }
+    table->hits++;
+    it->second.used = ++table->tick;
+    value = it->second.value;
+    return true;
+}
+
+void memo_set(Value *key, const ValueRef &value) {
+    if (!value) {
+        auto table = find_memo_table(memo_namespace(key));
+        if (table) {
+            table->map.erase(key);
+        }
+        return;
+    }
+    auto table = get_memo_table(memo_namespace(key));
+    auto ret = table->map.insert({key, { value, ++table->tick }});
+    if (!ret.second) {
+        ret.first->second = { value, table->tick };
+    } else if (table->capacity && (table->map.size() > table->capacity)) {
+        // make room for a quarter of the capacity at once, so that a full
+        // table doesn't scan its entries on every insertion
+        table->shrink(table->capacity - table->capacity / 4);
+    }
+}
+
+void memo_set_capacity(Value *ns, size_t capacity) {
+    auto table = get_memo_table(ns);
+    table->capacity = capacity;
+    if (capacity) {
+        table->shrink(capacity);
+    }
+}
+
+void memo_clear(Value *ns) {
+    auto table = find_memo_table(ns);
+    if (table) {
+        table->map.clear();
+    }
+}
+
+void get_memo_stats(std::vector<MemoStats> &stats) {
+    auto add = [&](Value *ns, const MemoTable &table) {
+        stats.push_back({ ns, table.hits, table.misses, table.evictions,
+            table.map.size(), table.capacity });
+    };
+    add(nullptr, shared_memo_table);
+    for (auto &&entry : memo_tables) {
+        add(entry.first, *entry.second);
+    }
+}
+
+int prune_memo() {
+    int count = 0;
+    auto prune = [&](MemoTable &table) {
+        for (auto it = table.map.begin(); it != table.map.end();) {
+            if (refers_to_released(it->first)
+                || refers_to_released(it->second.value.unref())) {
+                table.map.erase(it++);
+                count++;
+            } else {
+                ++it;
+            }
+        }
+    };
+    prune(shared_memo_table);
+    for (auto &&entry : memo_tables) {
+        prune(*entry.second);
+    }
+    return count;
+}
+
+} // namespace scopes
@@ -0,0 +1,63 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_MEMO_HPP
+#define SCOPES_MEMO_HPP
+
+#include "valueref.inc"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// MEMOIZATION
+//------------------------------------------------------------------------------
+
+/* the table behind sc_map_get and sc_map_set. keys are argument lists whose
+   first value, usually the memoized function or the type being dispatched
+   on, picks the namespace of the key; every namespace has a table of its
+   own, with statistics and an optional capacity. keys that aren't argument
+   lists share one table.
+
+   when a table with a capacity is full, the entries that were used least
+   recently are evicted. evicted results are recomputed on their next use,
+   so a capacity only suits namespaces whose results can be rebuilt without
+   changing their meaning; type generators return a new, distinct type each
+   time they run. */
+
+struct MemoStats {
+    // the first value of the keys, or null for the shared table
+    Value *ns;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t size;
+    // 0 if the table is unbounded
+    size_t capacity;
+};
+
+// whether two keys are the same key; pure values compare by content
+bool memo_key_equal(Value *a, Value *b);
+// returns false if no value is memoized for key
+bool memo_get(Value *key, ValueRef &value);
+// memoizes value for key, or forgets key if value is null
+void memo_set(Value *key, const ValueRef &value);
+// bounds the table of ns to capacity entries, evicting entries if it holds
+// more; a capacity of 0 lifts the bound
+void memo_set_capacity(Value *ns, size_t capacity);
+// forgets all values memoized in the table of ns
+void memo_clear(Value *ns);
+void get_memo_stats(std::vector<MemoStats> &stats);
+// forgets the values that refer to released functions; called by the sweep
+// of compiled functions. returns the number of entries removed.
+int prune_memo();
+
+} // namespace scopes
+
+#endif // SCOPES_MEMO_HPP
@@ -0,0 +1,687 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "module_digest.hpp"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Attributes.h"
+#include "llvm/Config/llvm-config.h"
+
+#include <string.h>
+
+#include "absl/container/flat_hash_map.h"
+
+// bump whenever the encoding changes
+#define SCOPES_MODULE_DIGEST_VERSION 1
+
+namespace scopes {
+
+using namespace llvm;
+
+//------------------------------------------------------------------------------
+// MODULE DIGEST
+//------------------------------------------------------------------------------
+
+enum ModuleDigestTag {
+    MDT_Null = 1,
+    MDT_Global,
+    MDT_Local,
+    MDT_Block,
+    MDT_Constant,
+    MDT_InlineAsm,
+    MDT_MDString,
+    MDT_MDValue,
+    MDT_MDNode,
+};
+
+struct ModuleDigestWriter {
+    std::vector<uint64_t> &words;
+    bool failed = false;
+    // set when digesting a single function; other globals are then described
+    // by name, or by content if they are local constants
+    bool detached = false;
+    SmallVector<StringRef, 32> md_kind_names;
+
+    // entities are described on first use and referenced by index afterwards
+    absl::flat_hash_map<const Type *, uint64_t> types;
+    absl::flat_hash_map<const GlobalValue *, uint64_t> globals;
+    absl::flat_hash_map<const Constant *, uint64_t> constants;
+    absl::flat_hash_map<const Metadata *, uint64_t> mdnodes;
+    absl::flat_hash_map<const void *, uint64_t> attrlists;
+    absl::flat_hash_map<const Value *, uint64_t> locals;
+
+    ModuleDigestWriter(std::vector<uint64_t> &_words) : words(_words) {}
+
+    void write(uint64_t value) {
+        words.push_back(value);
+    }
+
+    void write_string(StringRef str) {
+        auto size = str.size();
+        write(size);
+        auto offset = words.size();
+        words.resize(offset + (size + 7) / 8, 0);
+        memcpy(words.data() + offset, str.data(), size);
+    }
+
+    // returns true if the entity has been written before, otherwise assigns
+    // the next index to it and returns false
+    template<typename T>
+    bool write_ref(absl::flat_hash_map<const T *, uint64_t> &map, const T *key) {
+        auto it = map.find(key);
+        if (it != map.end()) {
+            write(it->second);
+            return true;
+        }
+        write(0);
+        uint64_t id = map.size() + 1;
+        map.insert({key, id});
+        return false;
+    }
+
+    void write_type(const Type *T) {
+        if (write_ref(types, T))
+            return;
+        write(T->getTypeID());
+        switch(T->getTypeID()) {
+        case Type::IntegerTyID: {
+            write(cast<IntegerType>(T)->getBitWidth());
+        } break;
+        case Type::PointerTyID: {
+            auto PT = cast<PointerType>(T);
+            write(PT->getAddressSpace());
+            write(PT->isOpaque());
+            if (!PT->isOpaque()) {
+                write_type(PT->getPointerElementType());
+            }
+        } break;
+        case Type::StructTyID: {
+            auto ST = cast<StructType>(T);
+            write(ST->isPacked());
+            write(ST->isOpaque());
+            write_string(ST->hasName()?ST->getName():StringRef());
+        } break;
+        case Type::ArrayTyID: {
+            write(cast<ArrayType>(T)->getNumElements());
+        } break;
+        case Type::FixedVectorTyID:
+        case Type::ScalableVectorTyID: {
+            write(cast<VectorType>(T)->getElementCount().getKnownMinValue());
+        } break;
+        case Type::FunctionTyID: {
+            write(cast<FunctionType>(T)->isVarArg());
+        } break;
+        default: break;
+        }
+        // pointer element types are written above
+        if (!T->isPointerTy()) {
+            write(T->getNumContainedTypes());
+            for (auto ET : T->subtypes()) {
+                write_type(ET);
+            }
+        }
+    }
+
+    void write_attribute_set(LLVMValueRef value, bool callsite,
+        LLVMAttributeIndex index) {
+        unsigned count = callsite
+            ?LLVMGetCallSiteAttributeCount(value, index)
+            :LLVMGetAttributeCountAtIndex(value, index);
+        write(count);
+        if (!count)
+            return;
+        std::vector<LLVMAttributeRef> attrs;
+        attrs.resize(count);
+        if (callsite) {
+            LLVMGetCallSiteAttributes(value, index, attrs.data());
+        } else {
+            LLVMGetAttributesAtIndex(value, index, attrs.data());
+        }
+        for (auto attr : attrs) {
+            auto A = unwrap(attr);
+            write_string(A.getAsString());
+            if (A.isTypeAttribute()) {
+                write_type(A.getValueAsType());
+            }
+        }
+    }
+
+    void write_attributes(const Value *V, AttributeList AL) {
+        if (write_ref(attrlists, (const void *)AL.getRawPointer()))
+            return;
+        bool callsite = !isa<Function>(V);
+        auto value = wrap(V);
+        write_attribute_set(value, callsite, LLVMAttributeFunctionIndex);
+        write_attribute_set(value, callsite, LLVMAttributeReturnIndex);
+        unsigned count = AL.getNumAttrSets();
+        count = (count > 2)?(count - 2):0;
+        write(count);
+        for (unsigned i = 0; i < count; ++i) {
+            write_attribute_set(value, callsite, i + 1);
+        }
+    }
+
+    void write_global_ref(const GlobalValue *G) {
+        if (detached) {
+            write_detached_global_ref(G);
+            return;
+        }
+        auto it = globals.find(G);
+        if (it == globals.end()) {
+            failed = true;
+            return;
+        }
+        write(MDT_Global);
+        write(it->second);
+    }
+
+    void write_detached_global_ref(const GlobalValue *G) {
+        write(MDT_Global);
+        if (write_ref(globals, G))
+            return;
+        if (!G->hasLocalLinkage()) {
+            write_string(G->getName());
+            write_type(G->getValueType());
+            return;
+        }
+        // names of local constants are made unique per module, so only
+        // their content counts
+        auto GV = dyn_cast<GlobalVariable>(G);
+        if (!GV || !GV->isConstant() || !GV->hasInitializer()) {
+            failed = true;
+            return;
+        }
+        write_type(GV->getValueType());
+        auto align = GV->getAlign();
+        write(align?align->value():0);
+        write((uint64_t)GV->getUnnamedAddr());
+        write_value(GV->getInitializer());
+    }
+
+    void write_block_ref(const BasicBlock *BB) {
+        auto it = locals.find(BB);
+        if (it != locals.end()) {
+            write(MDT_Local);
+            write(it->second);
+            return;
+        }
+        // a block address that points into another function
+        write(MDT_Block);
+        write_global_ref(BB->getParent());
+        uint64_t index = 0;
+        for (auto &B : *BB->getParent()) {
+            if (&B == BB)
+                break;
+            index++;
+        }
+        write(index);
+    }
+
+    void write_apint(const APInt &value) {
+        write(value.getBitWidth());
+        auto count = value.getNumWords();
+        auto data = value.getRawData();
+        for (unsigned i = 0; i < count; ++i) {
+            write(data[i]);
+        }
+    }
+
+    void write_constant(const Constant *C) {
+        write(MDT_Constant);
+        if (write_ref(constants, C))
+            return;
+        write(C->getValueID());
+        write_type(C->getType());
+        write(C->getRawSubclassOptionalData());
+        if (auto CI = dyn_cast<ConstantInt>(C)) {
+            write_apint(CI->getValue());
+        } else if (auto CF = dyn_cast<ConstantFP>(C)) {
+            write_apint(CF->getValueAPF().bitcastToAPInt());
+        } else if (auto CDS = dyn_cast<ConstantDataSequential>(C)) {
+            write_string(CDS->getRawDataValues());
+        } else if (auto CE = dyn_cast<ConstantExpr>(C)) {
+            write(CE->getOpcode());
+            if (CE->isCompare()) {
+                write(CE->getPredicate());
+            }
+            if (CE->hasIndices()) {
+                auto indices = CE->getIndices();
+                write(indices.size());
+                for (auto index : indices) {
+                    write(index);
+                }
+            }
+            if (CE->getOpcode() == Instruction::ShuffleVector) {
+                auto mask = CE->getShuffleMask();
+                write(mask.size());
+                for (auto index : mask) {
+                    write((uint64_t)(int64_t)index);
+                }
+            }
+            if (auto GEP = dyn_cast<GEPOperator>(CE)) {
+                write_type(GEP->getSourceElementType());
+                auto inrange = GEP->getInRangeIndex();
+                write(inrange?((uint64_t)*inrange + 1):0);
+            }
+        } else if (auto BA = dyn_cast<BlockAddress>(C)) {
+            write_global_ref(BA->getFunction());
+            write_block_ref(BA->getBasicBlock());
+            return;
+        }
+        auto count = C->getNumOperands();
+        write(count);
+        for (unsigned i = 0; i < count; ++i) {
+            write_value(C->getOperand(i));
+        }
+    }
+
+    void write_value(const Value *V) {
+        if (!V) {
+            write(MDT_Null);
+        } else if (auto G = dyn_cast<GlobalValue>(V)) {
+            write_global_ref(G);
+        } else if (auto C = dyn_cast<Constant>(V)) {
+            write_constant(C);
+        } else if (auto BB = dyn_cast<BasicBlock>(V)) {
+            write_block_ref(BB);
+        } else if (isa<Argument>(V) || isa<Instruction>(V)) {
+            auto it = locals.find(V);
+            if (it == locals.end()) {
+                failed = true;
+                return;
+            }
+            write(MDT_Local);
+            write(it->second);
+        } else if (auto IA = dyn_cast<InlineAsm>(V)) {
+            write(MDT_InlineAsm);
+            write_type(IA->getFunctionType());
+            write_string(IA->getAsmString());
+            write_string(IA->getConstraintString());
+            write(IA->hasSideEffects());
+            write(IA->isAlignStack());
+            write(IA->getDialect());
+            write(IA->canThrow());
+        } else if (auto MV = dyn_cast<MetadataAsValue>(V)) {
+            write_metadata(MV->getMetadata());
+        } else {
+            failed = true;
+        }
+    }
+
+    void write_metadata(const Metadata *MD) {
+        if (!MD) {
+            write(MDT_Null);
+            return;
+        }
+        if (auto S = dyn_cast<MDString>(MD)) {
+            write(MDT_MDString);
+            write_string(S->getString());
+            return;
+        }
+        if (auto VM = dyn_cast<ValueAsMetadata>(MD)) {
+            write(MDT_MDValue);
+            write_value(VM->getValue());
+            return;
+        }
+        auto N = dyn_cast<MDNode>(MD);
+        if (!N || N->isTemporary()) {
+            failed = true;
+            return;
+        }
+        write(MDT_MDNode);
+        if (write_ref(mdnodes, MD))
+            return;
+        write(N->getMetadataID());
+        write(N->isDistinct());
+        // fields that are not stored as operands
+        switch(N->getMetadataID()) {
+        case Metadata::MDTupleKind:
+        case Metadata::DISubrangeKind:
+            break;
+        case Metadata::DILocationKind: {
+            auto L = cast<DILocation>(N);
+            write(L->getLine());
+            write(L->getColumn());
+            write(L->isImplicitCode());
+        } break;
+        case Metadata::DIFileKind: {
+            // the checksum kind is not an operand
+            if (cast<DIFile>(N)->getRawChecksum()) {
+                failed = true;
+                return;
+            }
+        } break;
+        case Metadata::DICompileUnitKind: {
+            auto CU = cast<DICompileUnit>(N);
+            write(CU->getSourceLanguage());
+            write(CU->isOptimized());
+            write(CU->getRuntimeVersion());
+            write(CU->getEmissionKind());
+            write(CU->getDWOId());
+            write(CU->getSplitDebugInlining());
+            write(CU->getDebugInfoForProfiling());
+            write((uint64_t)CU->getNameTableKind());
+            write(CU->getRangesBaseAddress());
+        } break;
+        case Metadata::DISubprogramKind: {
+            auto SP = cast<DISubprogram>(N);
+            write(SP->getLine());
+            write(SP->getScopeLine());
+            write(SP->getVirtualIndex());
+            write((uint64_t)(int64_t)SP->getThisAdjustment());
+            write(SP->getFlags());
+            write(SP->getSPFlags());
+        } break;
+        case Metadata::DISubroutineTypeKind: {
+            auto ST = cast<DISubroutineType>(N);
+            write(ST->getFlags());
+            write(ST->getCC());
+        } break;
+        case Metadata::DIBasicTypeKind: {
+            auto BT = cast<DIBasicType>(N);
+            write(BT->getTag());
+            write(BT->getSizeInBits());
+            write(BT->getAlignInBits());
+            write(BT->getEncoding());
+            write(BT->getFlags());
+        } break;
+        case Metadata::DIDerivedTypeKind: {
+            auto DT = cast<DIDerivedType>(N);
+            write(DT->getTag());
+            write(DT->getLine());
+            write(DT->getSizeInBits());
+            write(DT->getAlignInBits());
+            write(DT->getOffsetInBits());
+            write(DT->getFlags());
+            auto AS = DT->getDWARFAddressSpace();
+            write(AS?((uint64_t)*AS + 1):0);
+        } break;
+        case Metadata::DICompositeTypeKind: {
+            auto CT = cast<DICompositeType>(N);
+            write(CT->getTag());
+            write(CT->getLine());
+            write(CT->getSizeInBits());
+            write(CT->getAlignInBits());
+            write(CT->getOffsetInBits());
+            write(CT->getFlags());
+            write(CT->getRuntimeLang());
+        } break;
+        case Metadata::DILexicalBlockKind: {
+            auto LB = cast<DILexicalBlock>(N);
+            write(LB->getLine());
+            write(LB->getColumn());
+        } break;
+        case Metadata::DILocalVariableKind: {
+            auto LV = cast<DILocalVariable>(N);
+            write(LV->getLine());
+            write(LV->getArg());
+            write(LV->getFlags());
+            write(LV->getAlignInBits());
+        } break;
+        case Metadata::DIExpressionKind: {
+            auto elements = cast<DIExpression>(N)->getElements();
+            write(elements.size());
+            for (auto element : elements) {
+                write(element);
+            }
+        } break;
+        default: {
+            // the digest does not know which fields this node has
+            failed = true;
+            return;
+        } break;
+        }
+        auto count = N->getNumOperands();
+        write(count);
+        for (unsigned i = 0; i < count; ++i) {
+            write_metadata(N->getOperand(i).get());
+        }
+    }
+
+    template<typename T>
+    void write_attachments(const T &O) {
+        SmallVector<std::pair<unsigned, MDNode *>, 4> mds;
+        O.getAllMetadata(mds);
+        write(mds.size());
+        for (auto &&entry : mds) {
+            // custom kind ids depend on registration order, so use the name
+            if (entry.first < md_kind_names.size()) {
+                write_string(md_kind_names[entry.first]);
+            } else {
+                failed = true;
+            }
+            write_metadata(entry.second);
+        }
+    }
+
+    void write_global_value(const GlobalValue &G) {
+        write_string(G.getName());
+        write_type(G.getValueType());
+        write(G.getLinkage());
+        write(G.getVisibility());
+        write(G.getDLLStorageClass());
+        write(G.getThreadLocalMode());
+        write((uint64_t)G.getUnnamedAddr());
+        write(G.isDSOLocal());
+        write(G.getAddressSpace());
+    }
+
+    void write_global_object(const GlobalObject &G) {
+        write_global_value(G);
+        auto align = G.getAlign();
+        write(align?align->value():0);
+        write_string(G.hasSection()?G.getSection():StringRef());
+        if (G.hasComdat()) {
+            failed = true;
+        }
+        write_attachments(G);
+    }
+
+    void write_instruction(const Instruction &I) {
+        write(I.getOpcode());
+        write_type(I.getType());
+        // nsw, nuw, exact, inbounds and fast-math flags
+        write(I.getRawSubclassOptionalData());
+        if (auto AI = dyn_cast<AllocaInst>(&I)) {
+            write_type(AI->getAllocatedType());
+            write(AI->getAlign().value());
+            write(AI->isUsedWithInAlloca());
+            write(AI->isSwiftError());
+        } else if (auto LI = dyn_cast<LoadInst>(&I)) {
+            write(LI->isVolatile());
+            write(LI->getAlign().value());
+            write((uint64_t)LI->getOrdering());
+            write(LI->getSyncScopeID());
+        } else if (auto SI = dyn_cast<StoreInst>(&I)) {
+            write(SI->isVolatile());
+            write(SI->getAlign().value());
+            write((uint64_t)SI->getOrdering());
+            write(SI->getSyncScopeID());
+        } else if (auto RMW = dyn_cast<AtomicRMWInst>(&I)) {
+            write(RMW->getOperation());
+            write(RMW->isVolatile());
+            write(RMW->getAlign().value());
+            write((uint64_t)RMW->getOrdering());
+            write(RMW->getSyncScopeID());
+        } else if (auto CX = dyn_cast<AtomicCmpXchgInst>(&I)) {
+            write(CX->isVolatile());
+            write(CX->isWeak());
+            write(CX->getAlign().value());
+            write((uint64_t)CX->getSuccessOrdering());
+            write((uint64_t)CX->getFailureOrdering());
+            write(CX->getSyncScopeID());
+        } else if (auto FI = dyn_cast<FenceInst>(&I)) {
+            write((uint64_t)FI->getOrdering());
+            write(FI->getSyncScopeID());
+        } else if (auto CI = dyn_cast<CmpInst>(&I)) {
+            write(CI->getPredicate());
+        } else if (auto GEP = dyn_cast<GetElementPtrInst>(&I)) {
+            write_type(GEP->getSourceElementType());
+        } else if (auto EV = dyn_cast<ExtractValueInst>(&I)) {
+            write(EV->getNumIndices());
+            for (auto index : EV->indices()) {
+                write(index);
+            }
+        } else if (auto IV = dyn_cast<InsertValueInst>(&I)) {
+            write(IV->getNumIndices());
+            for (auto index : IV->indices()) {
+                write(index);
+            }
+        } else if (auto SV = dyn_cast<ShuffleVectorInst>(&I)) {
+            auto mask = SV->getShuffleMask();
+            write(mask.size());
+            for (auto index : mask) {
+                write((uint64_t)(int64_t)index);
+            }
+        } else if (auto PN = dyn_cast<PHINode>(&I)) {
+            for (auto BB : PN->blocks()) {
+                write_block_ref(BB);
+            }
+        } else if (auto CB = dyn_cast<CallBase>(&I)) {
+            if (CB->hasOperandBundles() || isa<CallBrInst>(CB)) {
+                failed = true;
+                return;
+            }
+            write(CB->getCallingConv());
+            write_type(CB->getFunctionType());
+            write_attributes(CB, CB->getAttributes());
+            if (auto CI = dyn_cast<CallInst>(CB)) {
+                write(CI->getTailCallKind());
+            }
+        } else if (I.isEHPad()) {
+            failed = true;
+            return;
+        }
+        auto count = I.getNumOperands();
+        write(count);
+        for (unsigned i = 0; i < count; ++i) {
+            write_value(I.getOperand(i));
+        }
+        write_attachments(I);
+    }
+
+    void write_function(const Function &F) {
+        write_global_object(F);
+        write(F.getCallingConv());
+        write_attributes(&F, F.getAttributes());
+        write_string(F.hasGC()?StringRef(F.getGC()):StringRef());
+        if (F.hasPrefixData() || F.hasPrologueData()) {
+            failed = true;
+            return;
+        }
+        write_value(F.hasPersonalityFn()?F.getPersonalityFn():nullptr);
+        write(F.isDeclaration());
+        if (F.isDeclaration())
+            return;
+        // number all local values up front, so that forward references from
+        // phi nodes and branches can be resolved
+        locals.clear();
+        for (auto &A : F.args()) {
+            locals.insert({&A, locals.size()});
+        }
+        for (auto &BB : F) {
+            locals.insert({&BB, locals.size()});
+            for (auto &I : BB) {
+                locals.insert({&I, locals.size()});
+            }
+        }
+        write(F.arg_size());
+        write(F.size());
+        for (auto &BB : F) {
+            write(BB.size());
+            for (auto &I : BB) {
+                write_instruction(I);
+                if (failed)
+                    return;
+            }
+        }
+        locals.clear();
+    }
+
+    void write_detached_function(const Function &F) {
+        auto &M = *F.getParent();
+        write(SCOPES_MODULE_DIGEST_VERSION);
+        write_string(LLVM_VERSION_STRING);
+        write_string(M.getTargetTriple());
+        write_string(M.getDataLayoutStr());
+        M.getMDKindNames(md_kind_names);
+        detached = true;
+        globals.insert({&F, globals.size() + 1});
+        write_function(F);
+    }
+
+    void write_module(const Module &M) {
+        write(SCOPES_MODULE_DIGEST_VERSION);
+        write_string(LLVM_VERSION_STRING);
+        write_string(M.getTargetTriple());
+        write_string(M.getDataLayoutStr());
+        write_string(M.getSourceFileName());
+        write_string(M.getModuleInlineAsm());
+        if (M.alias_size() || M.ifunc_size()) {
+            failed = true;
+            return;
+        }
+        M.getMDKindNames(md_kind_names);
+        // number all globals up front, so that initializers can refer to
+        // globals that are defined later
+        for (auto &G : M.globals()) {
+            globals.insert({&G, globals.size()});
+        }
+        for (auto &F : M) {
+            globals.insert({&F, globals.size()});
+        }
+        write(M.global_size());
+        for (auto &G : M.globals()) {
+            write_global_object(G);
+            write(G.isConstant());
+            write(G.isExternallyInitialized());
+            if (G.hasAttributes()) {
+                failed = true;
+            }
+            write_value(G.hasInitializer()?G.getInitializer():nullptr);
+            if (failed)
+                return;
+        }
+        write(M.size());
+        for (auto &F : M) {
+            write_function(F);
+            if (failed)
+                return;
+        }
+        write(M.named_metadata_size());
+        for (auto &NMD : M.named_metadata()) {
+            write_string(NMD.getName());
+            write(NMD.getNumOperands());
+            for (auto N : NMD.operands()) {
+                write_metadata(N);
+            }
+        }
+    }
+};
+
+bool digest_module(LLVMModuleRef module, std::vector<uint64_t> &dest) {
+    dest.clear();
+    ModuleDigestWriter writer(dest);
+    writer.write_module(*unwrap(module));
+    return !writer.failed;
+}
+
+bool digest_function(LLVMValueRef function, std::vector<uint64_t> &dest) {
+    dest.clear();
+    ModuleDigestWriter writer(dest);
+    writer.write_detached_function(*cast<Function>(unwrap(function)));
+    return !writer.failed;
+}
+
+} // namespace scopes
@@ -0,0 +1,39 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_MODULE_DIGEST_HPP
+#define SCOPES_MODULE_DIGEST_HPP
+
+#include <llvm-c/Core.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// MODULE DIGEST
+//------------------------------------------------------------------------------
+
+/* a module digest is a flat word stream that describes everything in a module
+   which influences the object file generated from it: globals, functions,
+   instructions, constants, attributes and metadata. building it is a single
+   walk over the module, which is much cheaper than printing or writing
+   bitcode, and two modules with equal digests produce the same object. */
+
+// returns false if the module contains constructs that the digest does not
+// cover, in which case the contents of dest are undefined.
+bool digest_module(LLVMModuleRef module, std::vector<uint64_t> &dest);
+
+// describes a single function definition independently of the module it is
+// in: other globals are referenced by name, except for local constants,
+// which are described by content. fails if the function refers to any other
+// local global.
+bool digest_function(LLVMValueRef function, std::vector<uint64_t> &dest);
+
+} // namespace scopes
+
+#endif // SCOPES_MODULE_DIGEST_HPP
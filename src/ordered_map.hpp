@@ -13,6 +13,10 @@
 
 namespace scopes {
 
+// compact once at least this many entries have been discarded, and they
+// make up more than half of all entries
+#define SCOPES_ORDERED_MAP_MIN_COMPACT 16
+
 template<typename KeyType, typename ValueType, typename KeyHash = std::hash<KeyType> >
 struct OrderedMap {
     // fails if value has already been inserted
@@ -20,9 +24,7 @@ struct OrderedMap {
         auto it = _key_index.find(key);
         if (it == _key_index.end()) {
             // new insertion
-            int index = entries.size();
-            entries.push_back({ key, value});
-            _key_index.insert({ key, index });
+            append(key, value);
             return true;
         }
         return false;
@@ -32,9 +34,7 @@ struct OrderedMap {
         auto it = _key_index.find(key);
         if (it == _key_index.end()) {
             // new insertion
-            int index = entries.size();
-            entries.push_back({ key, value});
-            _key_index.insert({ key, index });
+            append(key, value);
         } else {
             // update
             int index = it->second;
@@ -42,16 +42,19 @@ struct OrderedMap {
         }
     }
 
+    // the entry is only marked as discarded, so the indices of all other
+    // entries stay valid until enough discards have piled up to compact
     void discard(const KeyType &key) {
         auto it = _key_index.find(key);
         if (it != _key_index.end()) {
-            // update
             int index = it->second;
             _key_index.erase(it);
-            entries.erase(entries.begin() + index);
-            for (auto &&it : _key_index) {
-                if (it.second > index)
-                    it.second -= 1;
+            entries[index].second = ValueType();
+            _discarded[index] = true;
+            _discarded_count++;
+            if ((_discarded_count >= SCOPES_ORDERED_MAP_MIN_COMPACT)
+                && ((_discarded_count * 2) > entries.size())) {
+                compact();
             }
         }
     }
@@ -63,17 +66,45 @@ struct OrderedMap {
         return it->second;
     }
 
-    // reverse order in-place
-    void flip() {
-        std::reverse(entries.begin(), entries.end());
-        int lastindex = entries.size() - 1;
-        for (auto &&it : _key_index) {
-            it.second = lastindex - it.second;
-        }
+    // entries holds discarded entries with an empty value; skip these
+    bool is_discarded(int index) const {
+        return _discarded[index];
+    }
+
+    // number of entries that have not been discarded
+    size_t count() const {
+        return entries.size() - _discarded_count;
     }
 
     std::vector< std::pair<KeyType, ValueType> > entries;
     absl::flat_hash_map<KeyType, int, KeyHash> _key_index;
+
+protected:
+    void append(const KeyType &key, const ValueType &value) {
+        int index = entries.size();
+        entries.push_back({ key, value});
+        _discarded.push_back(false);
+        _key_index.insert({ key, index });
+    }
+
+    void compact() {
+        size_t count = 0;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (_discarded[i])
+                continue;
+            if (count != i) {
+                entries[count] = std::move(entries[i]);
+                _key_index[entries[count].first] = count;
+            }
+            count++;
+        }
+        entries.resize(count);
+        _discarded.assign(count, false);
+        _discarded_count = 0;
+    }
+
+    std::vector<bool> _discarded;
+    size_t _discarded_count = 0;
 };
 
 } // namespace scopes
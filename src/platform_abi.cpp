@@ -15,6 +15,9 @@
 #include "abi_aarch64.cpp"
 
 #include <assert.h>
+#include <string.h>
+
+#include "absl/container/flat_hash_map.h"
 
 #pragma GCC diagnostic ignored "-Wvla-extension"
 
@@ -79,6 +82,19 @@ size_t abi_classify(const Type *T, ABIClass *classes) {
         T = cast<ArgumentsType>(T)->to_tuple_type();
     }
     T = qualified_storage_type(T).assert_ok();
+
+    // storage types never change, so each is classified once
+    struct Classes {
+        size_t count;
+        ABIClass classes[MAX_ABI_CLASSES];
+    };
+    static thread_local absl::flat_hash_map<const Type *, Classes> cache;
+    auto it = cache.find(T);
+    if (it != cache.end()) {
+        memcpy(classes, it->second.classes, it->second.count * sizeof(ABIClass));
+        return it->second.count;
+    }
+
     size_t sz;
 #if defined(SCOPES_WIN32)
     sz = abi_windows_x64::classify(T, classes);
@@ -100,6 +116,11 @@ size_t abi_classify(const Type *T, ABIClass *classes) {
         ss << std::endl;
     }
 #endif
+    assert(sz <= MAX_ABI_CLASSES);
+    Classes entry;
+    entry.count = sz;
+    memcpy(entry.classes, classes, sz * sizeof(ABIClass));
+    cache.insert({T, entry});
     return sz;
 }
 
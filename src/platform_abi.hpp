@@ -32,6 +32,9 @@ struct Type;
     T(FLOATx4) \
     T(DOUBLEx2) \
     T(INTEGERx2) \
+    /* A short vector member of a homogeneous aggregate of up to four short */ \
+    /* vectors, which is passed in consecutive vector registers. */ \
+    T(VECTOR) \
     /* The class consists of types that fit into a vector register. */ \
     T(SSE) \
     T(SSESF) \
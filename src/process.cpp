@@ -0,0 +1,150 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "process.hpp"
+#include "scopes/config.h"
+
+#ifndef SCOPES_WIN32
+#include <sys/wait.h>
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+
+namespace scopes {
+
+namespace {
+
+typedef std::map<std::string, double> History;
+
+static void read_history(const char *path, History &history) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return;
+    // one "<seconds> <key>" entry per line
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        char *end;
+        double seconds = strtod(line, &end);
+        if ((end == line) || (*end != ' '))
+            continue;
+        std::string key(end + 1);
+        while (!key.empty()
+            && ((key.back() == '\n') || (key.back() == '\r')))
+            key.pop_back();
+        history[key] = seconds;
+    }
+    fclose(f);
+}
+
+// replaces the file in one step, so that concurrent runs never read half of it
+static void write_history(const char *path, const History &history) {
+    std::string tmppath = std::string(path) + ".tmp";
+    FILE *f = fopen(tmppath.c_str(), "wb");
+    if (!f)
+        return;
+    for (auto &&entry : history) {
+        fprintf(f, "%.3f %s\n", entry.second, entry.first.c_str());
+    }
+    fclose(f);
+    remove(path);
+    rename(tmppath.c_str(), path);
+}
+
+static void run_command(const std::string &command, CommandResult &result) {
+    auto start = std::chrono::steady_clock::now();
+    std::string line = command + " 2>&1";
+#ifdef SCOPES_WIN32
+    FILE *f = _popen(line.c_str(), "r");
+#else
+    FILE *f = popen(line.c_str(), "r");
+#endif
+    result.status = -1;
+    if (f) {
+        char buf[4096];
+        size_t count;
+        while ((count = fread(buf, 1, sizeof(buf), f)) > 0) {
+            result.output.append(buf, count);
+        }
+#ifdef SCOPES_WIN32
+        result.status = _pclose(f);
+#else
+        int status = pclose(f);
+        if ((status >= 0) && WIFEXITED(status)) {
+            result.status = WEXITSTATUS(status);
+        } else if ((status >= 0) && WIFSIGNALED(status)) {
+            // as shells report it
+            result.status = 128 + WTERMSIG(status);
+        }
+#endif
+    }
+    result.seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+void run_commands(const std::vector<std::string> &commands,
+    const std::vector<std::string> &keys, int jobs,
+    const char *history_path, std::vector<CommandResult> &results) {
+    size_t count = commands.size();
+    results.assign(count, CommandResult());
+    assert(keys.empty() || (keys.size() == count));
+    auto &&key = [&](size_t i) -> const std::string & {
+        return keys.empty()?commands[i]:keys[i];
+    };
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < count; ++i) {
+        order.push_back(i);
+    }
+    History history;
+    if (history_path) {
+        read_history(history_path, history);
+        // longest first, so that no long command starts last
+        auto duration = [&](size_t i) {
+            auto it = history.find(key(i));
+            return (it == history.end())?HUGE_VAL:it->second;
+        };
+        std::stable_sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return duration(a) > duration(b); });
+    }
+
+    if (jobs < 1) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    jobs = (int)std::min((size_t)jobs, count);
+    // the commands block their threads, which mustn't be those of the pool
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (int k = 0; k < jobs; ++k) {
+        workers.emplace_back([&]() {
+            size_t i;
+            while ((i = next.fetch_add(1)) < count) {
+                run_command(commands[order[i]], results[order[i]]);
+            }
+        });
+    }
+    for (auto &&worker : workers) {
+        worker.join();
+    }
+
+    if (history_path) {
+        for (size_t i = 0; i < count; ++i) {
+            history[key(i)] = results[i].seconds;
+        }
+        write_history(history_path, history);
+    }
+}
+
+} // namespace scopes
@@ -0,0 +1,41 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_PROCESS_HPP
+#define SCOPES_PROCESS_HPP
+
+#include <string>
+#include <vector>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// PROCESSES
+//------------------------------------------------------------------------------
+
+struct CommandResult {
+    // the exit status of the command, or -1 if it couldn't be run
+    int status;
+    // wall time in seconds
+    double seconds;
+    // everything the command wrote to stdout and stderr
+    std::string output;
+};
+
+// runs the shell commands, at most jobs at a time, or one per core if jobs
+// is less than 1. if history_path is set, the commands that took longest
+// according to the durations recorded in that file under their keys start
+// first, commands without a record before all others, and the new durations
+// are recorded; otherwise they start in order. keys holds one entry per
+// command, or none, in which case the commands are their own keys. results
+// are stored in order of commands.
+void run_commands(const std::vector<std::string> &commands,
+    const std::vector<std::string> &keys, int jobs,
+    const char *history_path, std::vector<CommandResult> &results);
+
+} // namespace scopes
+
+#endif // SCOPES_PROCESS_HPP
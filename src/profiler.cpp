@@ -0,0 +1,426 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "profiler.hpp"
+#include "styled_stream.hpp"
+#include "type.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdlib.h>
+#include <unordered_map>
+#include "absl/container/flat_hash_map.h"
+
+#ifndef SCOPES_WIN32
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// SAMPLING PROFILER
+//------------------------------------------------------------------------------
+
+struct ProfilerCode {
+    uint64_t size;
+    std::string name;
+    std::vector<ProfilerLine> lines;
+};
+
+// jitted functions by start address; only touched outside of the signal
+// handler, from the threads that load objects and the one writing a profile
+static std::mutex profiler_code_mutex;
+static std::map<uint64_t, ProfilerCode> profiler_code;
+
+void register_profiler_code(uint64_t address, uint64_t size,
+    std::string name, std::vector<ProfilerLine> lines) {
+    if (!size)
+        return;
+    std::lock_guard<std::mutex> lock(profiler_code_mutex);
+    // code that was released and whose memory is now reused
+    auto it = profiler_code.lower_bound(address);
+    if (it != profiler_code.begin()) {
+        auto prev = std::prev(it);
+        if ((prev->first + prev->second.size) > address)
+            it = prev;
+    }
+    while ((it != profiler_code.end()) && (it->first < (address + size))) {
+        it = profiler_code.erase(it);
+    }
+    profiler_code.insert({ address, { size, std::move(name), std::move(lines) } });
+}
+
+static void append_frame_name(std::string &out, const char *s, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        char c = s[i];
+        // separators of the folded format
+        if ((c == ';') || (c == '\n'))
+            c = ':';
+        out.push_back(c);
+    }
+}
+
+// lock profiler_code_mutex before calling
+static std::string symbolize_profiler_frame(uintptr_t pc) {
+    std::string result;
+    auto it = profiler_code.upper_bound(pc);
+    if (it != profiler_code.begin()) {
+        --it;
+        if (pc < (it->first + it->second.size)) {
+            auto &&code = it->second;
+            append_frame_name(result, code.name.data(), code.name.size());
+            auto &&lines = code.lines;
+            auto line = std::upper_bound(lines.begin(), lines.end(), pc,
+                [](uint64_t addr, const ProfilerLine &l) {
+                    return addr < l.address;
+                });
+            if (line != lines.begin()) {
+                --line;
+                char loc[32];
+                snprintf(loc, sizeof(loc), ":%i:%i)", line->line, line->column);
+                result += " (";
+                append_frame_name(result, line->path.data(), line->path.size());
+                result += loc;
+            }
+            return result;
+        }
+    }
+#ifndef SCOPES_WIN32
+    Dl_info dlinfo;
+    if (dladdr((void *)pc, &dlinfo)) {
+        if (dlinfo.dli_sname) {
+            append_frame_name(result, dlinfo.dli_sname, strlen(dlinfo.dli_sname));
+            return result;
+        }
+        if (dlinfo.dli_fname) {
+            const char *name = strrchr(dlinfo.dli_fname, '/');
+            name = name?(name + 1):dlinfo.dli_fname;
+            result += "[";
+            append_frame_name(result, name, strlen(name));
+            result += "]";
+            return result;
+        }
+    }
+#endif
+    char addr[32];
+    snprintf(addr, sizeof(addr), "0x%llx", (unsigned long long)pc);
+    result = addr;
+    return result;
+}
+
+std::string describe_code_address(uint64_t address) {
+    std::lock_guard<std::mutex> lock(profiler_code_mutex);
+    return symbolize_profiler_frame((uintptr_t)address);
+}
+
+#ifdef SCOPES_WIN32
+
+bool start_profiler(int hz) { return false; }
+void stop_profiler() {}
+bool is_profiler_running() { return false; }
+uint64_t profiler_sample_count() { return 0; }
+uint64_t profiler_dropped_count() { return 0; }
+
+bool write_profile(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+    return fclose(f) == 0;
+}
+
+#else
+
+enum {
+    PROFILER_MAX_DEPTH = 64,
+    PROFILER_MAX_SAMPLES = 1 << 14,
+    // the signal handler and the trampoline that invoked it
+    PROFILER_SKIP_FRAMES = 2,
+};
+
+struct ProfilerSample {
+    // set once the stack has been written
+    std::atomic<bool> ready;
+    int depth;
+    void *frames[PROFILER_MAX_DEPTH];
+};
+
+// the handler only claims a slot with an atomic increment and fills it, so
+// that it neither allocates nor locks
+static ProfilerSample *profiler_samples = nullptr;
+static std::atomic<uint32_t> profiler_next_sample(0);
+static std::atomic<uint64_t> profiler_dropped(0);
+static std::atomic<bool> profiler_running(false);
+static struct sigaction profiler_old_action;
+
+static void profiler_signal_handler(int sig, siginfo_t *info, void *ucontext) {
+    if (!profiler_running.load(std::memory_order_relaxed))
+        return;
+    int saved_errno = errno;
+    uint32_t index = profiler_next_sample.fetch_add(1, std::memory_order_relaxed);
+    if (index >= PROFILER_MAX_SAMPLES) {
+        profiler_next_sample.store(PROFILER_MAX_SAMPLES, std::memory_order_relaxed);
+        profiler_dropped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        auto &&sample = profiler_samples[index];
+        sample.depth = backtrace(sample.frames, PROFILER_MAX_DEPTH);
+        sample.ready.store(true, std::memory_order_release);
+    }
+    errno = saved_errno;
+}
+
+static void set_profiler_timer(int hz) {
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = hz?(1000000 / hz):0;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+bool start_profiler(int hz) {
+    if (profiler_running)
+        return false;
+    if (hz <= 0)
+        hz = 1000;
+    if (hz > 1000000)
+        hz = 1000000;
+    if (!profiler_samples) {
+        profiler_samples = new ProfilerSample[PROFILER_MAX_SAMPLES];
+    }
+    for (int i = 0; i < PROFILER_MAX_SAMPLES; ++i) {
+        profiler_samples[i].ready.store(false, std::memory_order_relaxed);
+    }
+    profiler_next_sample = 0;
+    profiler_dropped = 0;
+    // the first call may load the unwinder, which must not happen inside
+    // the signal handler
+    void *frames[1];
+    backtrace(frames, 1);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = profiler_signal_handler;
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &profiler_old_action))
+        return false;
+    profiler_running = true;
+    set_profiler_timer(hz);
+    return true;
+}
+
+void stop_profiler() {
+    if (!profiler_running)
+        return;
+    set_profiler_timer(0);
+    profiler_running = false;
+    sigaction(SIGPROF, &profiler_old_action, nullptr);
+}
+
+bool is_profiler_running() {
+    return profiler_running;
+}
+
+uint64_t profiler_sample_count() {
+    uint32_t count = profiler_next_sample.load(std::memory_order_relaxed);
+    return (count > PROFILER_MAX_SAMPLES)?PROFILER_MAX_SAMPLES:count;
+}
+
+uint64_t profiler_dropped_count() {
+    return profiler_dropped;
+}
+
+bool write_profile(const char *path) {
+    std::map<std::string, uint64_t> stacks;
+    {
+        std::unordered_map<uintptr_t, std::string> names;
+        std::lock_guard<std::mutex> lock(profiler_code_mutex);
+        uint64_t count = profiler_sample_count();
+        std::string stack;
+        for (uint64_t i = 0; i < count; ++i) {
+            auto &&sample = profiler_samples[i];
+            if (!sample.ready.load(std::memory_order_acquire))
+                continue;
+            stack.clear();
+            for (int k = sample.depth - 1; k >= PROFILER_SKIP_FRAMES; --k) {
+                uintptr_t pc = (uintptr_t)sample.frames[k];
+                // return addresses point past the call
+                if ((k != PROFILER_SKIP_FRAMES) && pc)
+                    pc--;
+                auto it = names.find(pc);
+                if (it == names.end()) {
+                    it = names.insert({ pc, symbolize_profiler_frame(pc) }).first;
+                }
+                if (!stack.empty())
+                    stack.push_back(';');
+                stack += it->second;
+            }
+            if (!stack.empty())
+                stacks[stack]++;
+        }
+    }
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+    for (auto &&it : stacks) {
+        fprintf(f, "%s %llu\n", it.first.c_str(), (unsigned long long)it.second);
+    }
+    bool ok = !ferror(f);
+    return (fclose(f) == 0) && ok;
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+// ALLOCATION PROFILER
+//------------------------------------------------------------------------------
+
+struct AllocSiteKey {
+    uint64_t site;
+    const Type *type;
+
+    bool operator ==(const AllocSiteKey &other) const {
+        return (site == other.site) && (type == other.type);
+    }
+
+    template <typename H>
+    friend H AbslHashValue(H h, const AllocSiteKey &key) {
+        return H::combine(std::move(h), key.site, key.type);
+    }
+};
+
+struct AllocSiteCounts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t live_bytes = 0;
+};
+
+struct AllocRecord {
+    size_t size;
+    AllocSiteCounts *counts;
+};
+
+// allocations come from every thread that runs program code
+static std::mutex alloc_profile_mutex;
+// node map, so records can point at the counts
+static std::unordered_map<uint64_t, std::unordered_map<const Type *, AllocSiteCounts>>
+    alloc_sites;
+static absl::flat_hash_map<void *, AllocRecord> alloc_records;
+
+void *alloc_profile_malloc(size_t size, const Type *T, uint64_t site) {
+    void *ptr = malloc(size);
+    if (!ptr)
+        return ptr;
+    std::lock_guard<std::mutex> lock(alloc_profile_mutex);
+    auto &&counts = alloc_sites[site][T];
+    counts.allocations++;
+    counts.bytes += size;
+    counts.live_bytes += size;
+    alloc_records[ptr] = { size, &counts };
+    return ptr;
+}
+
+void alloc_profile_free(void *ptr) {
+    if (!ptr)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(alloc_profile_mutex);
+        auto it = alloc_records.find(ptr);
+        // memory that was allocated elsewhere is freed all the same
+        if (it != alloc_records.end()) {
+            it->second.counts->live_bytes -= it->second.size;
+            alloc_records.erase(it);
+        }
+    }
+    free(ptr);
+}
+
+void get_alloc_profile(std::vector<AllocSiteStats> &stats) {
+    std::vector<std::pair<AllocSiteKey, AllocSiteCounts>> entries;
+    {
+        std::lock_guard<std::mutex> lock(alloc_profile_mutex);
+        for (auto &&site : alloc_sites) {
+            for (auto &&it : site.second) {
+                entries.push_back({ { site.first, it.first }, it.second });
+            }
+        }
+    }
+    stats.clear();
+    absl::flat_hash_map<uint64_t, std::string> names;
+    for (auto &&entry : entries) {
+        auto it = names.find(entry.first.site);
+        if (it == names.end()) {
+            // the return address points past the call
+            it = names.insert({ entry.first.site,
+                describe_code_address(entry.first.site - 1) }).first;
+        }
+        stats.push_back({ it->second, entry.first.type,
+            entry.second.allocations, entry.second.bytes,
+            entry.second.live_bytes });
+    }
+    std::sort(stats.begin(), stats.end(),
+        [](const AllocSiteStats &a, const AllocSiteStats &b) {
+            return a.bytes > b.bytes;
+        });
+}
+
+void print_alloc_profile(int limit) {
+    std::vector<AllocSiteStats> stats;
+    get_alloc_profile(stats);
+    struct TypeTotals {
+        const Type *type;
+        AllocSiteCounts counts;
+    };
+    std::vector<TypeTotals> types;
+    {
+        absl::flat_hash_map<const Type *, size_t> index;
+        for (auto &&entry : stats) {
+            auto it = index.find(entry.type);
+            if (it == index.end()) {
+                it = index.insert({ entry.type, types.size() }).first;
+                types.push_back({ entry.type, {} });
+            }
+            auto &&counts = types[it->second].counts;
+            counts.allocations += entry.allocations;
+            counts.bytes += entry.bytes;
+            counts.live_bytes += entry.live_bytes;
+        }
+    }
+    std::sort(types.begin(), types.end(),
+        [](const TypeTotals &a, const TypeTotals &b) {
+            return a.counts.bytes > b.counts.bytes;
+        });
+    StyledStream ss;
+    ss << "allocations: " << stats.size() << " sites" << std::endl;
+    int count = 0;
+    for (auto &&entry : stats) {
+        if (count++ == limit)
+            break;
+        ss << "allocations: " << entry.bytes << " bytes, "
+            << entry.allocations << " allocations, "
+            << entry.live_bytes << " live bytes: " << entry.type
+            << " at " << entry.site << std::endl;
+    }
+    count = 0;
+    for (auto &&entry : types) {
+        if (count++ == limit)
+            break;
+        ss << "allocations: " << entry.counts.bytes << " bytes, "
+            << entry.counts.allocations << " allocations, "
+            << entry.counts.live_bytes << " live bytes: " << entry.type
+            << std::endl;
+    }
+}
+
+} // namespace scopes
@@ -0,0 +1,85 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_PROFILER_HPP
+#define SCOPES_PROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// SAMPLING PROFILER
+//------------------------------------------------------------------------------
+
+/* samples the call stack of whichever thread is running when the profiling
+   timer fires, and writes the samples as folded stacks that flame graph tools
+   read. jitted frames are named after the symbols of the objects the JIT
+   loaded and, where the objects carry line tables, the source location of
+   the sampled instruction. not available on Windows. */
+
+// a row of the line table of a jitted function
+struct ProfilerLine {
+    uint64_t address;
+    std::string path;
+    int line;
+    int column;
+};
+
+// starts sampling hz times per second of CPU time and discards the samples
+// of earlier runs; returns false if the profiler is already running or the
+// platform has no profiling timer
+bool start_profiler(int hz);
+void stop_profiler();
+bool is_profiler_running();
+// the number of samples recorded and the number dropped because the sample
+// buffer was full
+uint64_t profiler_sample_count();
+uint64_t profiler_dropped_count();
+// names the machine code at [address, address + size); lines are sorted by
+// address. replaces the functions whose code overlaps the range.
+void register_profiler_code(uint64_t address, uint64_t size,
+    std::string name, std::vector<ProfilerLine> lines);
+// writes the samples recorded so far as folded stacks to path; returns
+// false if the file could not be written
+bool write_profile(const char *path);
+// the name of the function that contains address, and its source location
+// if the function has a line table
+std::string describe_code_address(uint64_t address);
+
+//------------------------------------------------------------------------------
+// ALLOCATION PROFILER
+//------------------------------------------------------------------------------
+
+/* when the compiler starts with SCOPES_ALLOC_PROFILE set, DefaultAllocator
+   allocates through these functions, which count the allocations of every
+   site and element type. the site is the code that called the allocator,
+   which is the function that a container operation was inlined into. */
+
+struct Type;
+
+// the allocations of one element type at one site
+struct AllocSiteStats {
+    std::string site;
+    const Type *type;
+    uint64_t allocations;
+    uint64_t bytes;
+    // bytes that have not been freed yet
+    uint64_t live_bytes;
+};
+
+// site is the return address of the caller of the allocator
+void *alloc_profile_malloc(size_t size, const Type *T, uint64_t site);
+void alloc_profile_free(void *ptr);
+// lists the sites, ordered by bytes allocated
+void get_alloc_profile(std::vector<AllocSiteStats> &stats);
+void print_alloc_profile(int limit = 50);
+
+} // namespace scopes
+
+#endif // SCOPES_PROFILER_HPP
@@ -12,6 +12,7 @@
 #include "stream_expr.hpp"
 #include "hash.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
 #include "gc.hpp"
 #include "builtin.hpp"
 #include "verify_tools.inc"
@@ -27,9 +28,13 @@
 #include "qualifier.inc"
 #include "symbol_enum.inc"
 #include "lifetime.hpp"
+#include "memo.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <deque>
+#include <mutex>
+#include <tuple>
 #include "absl/container/flat_hash_set.h"
 #include "absl/container/flat_hash_map.h"
 
@@ -89,14 +94,19 @@ namespace scopes {
 //------------------------------------------------------------------------------
 
 namespace FunctionSet {
+    // hash of the instance arguments of a function, excluding its template
+    static std::size_t instance_hash(const Function *frame, const Types &types) {
+        std::size_t h = std::hash<const Function *>{}(frame);
+        for (auto arg : types) {
+            h = hash2(h, std::hash<const Type *>{}(arg));
+        }
+        return h;
+    }
+
     struct Hash {
         std::size_t operator()(const Function *s) const {
-            std::size_t h = std::hash<Function *>{}(s->frame.unref());
-            h = hash2(h, std::hash<Template *>{}(s->original.unref()));
-            for (auto arg : s->instance_args) {
-                h = hash2(h, std::hash<const Type *>{}(arg));
-            }
-            return h;
+            return hash2(instance_hash(s->frame.unref(), s->instance_args),
+                std::hash<Template *>{}(s->original.unref()));
         }
     };
 
@@ -117,11 +127,332 @@ namespace FunctionSet {
 
 static absl::flat_hash_set<Function *, FunctionSet::Hash, FunctionSet::KeyEqual> functions;
 
+// bytes held by the arenas of completed, unreleased functions
+static size_t live_arena_size = 0;
+
+static MemoryStat functions_memory("functions", [](MemoryUsage &usage) {
+    usage.objects = functions.size();
+    usage.bytes = hash_table_bytes(functions) + live_arena_size;
+});
+static size_t sweep_threshold = 0;
+
+static Counter specialize_cache_hits(COUNTER_SpecializeCacheHit);
+static Counter specialize_cache_misses(COUNTER_SpecializeCacheMiss);
+static Counter specialize_fingerprint_hits(COUNTER_SpecializeFingerprintHit);
+static Counter inline_memo_hits(COUNTER_InlineMemoHit);
+
+// incremented whenever proving has an effect outside of the instructions it
+// appends: spices run, or builtins that print or change the block
+static thread_local uint64_t prove_effects = 0;
+
+static Template::InstanceCacheEntry &instance_cache_entry(
+    const TemplateRef &func, std::size_t hash) {
+    return func->instance_cache[hash & (Template::InstanceCacheSize - 1)];
+}
+
+static Function *find_cached_instance(const TemplateRef &func,
+    std::size_t hash, const FunctionRef &frame, const Types &types) {
+    auto &&entry = instance_cache_entry(func, hash);
+    auto fn = entry.fn;
+    if (fn && !fn->released && (entry.hash == hash) && (fn->frame == frame)
+        && (fn->instance_args == types))
+        return fn;
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+/* a template fingerprint describes a template by its contents instead of its
+   identity, so that reexpanding unchanged source, e.g. when a module is
+   reloaded, yields templates whose earlier specializations can be reused.
+   the digest numbers the nodes of the template in the order they are first
+   visited and refers back to them by number; nested templates and closures
+   contribute their own fingerprint. interned constants are described by
+   their identity, anchors by their location. */
+
+struct TemplateDigest {
+    enum {
+        BackRef = 1ull << 63,
+    };
+
+    TemplateDigest(std::vector<uint64_t> &_dest) : dest(_dest) {}
+
+    void word(uint64_t w) {
+        dest.push_back(w);
+    }
+
+    void pointer(const void *ptr) {
+        word((uint64_t)(uintptr_t)ptr);
+    }
+
+    void values(const Values &nodes) {
+        word(nodes.size());
+        for (auto &&node : nodes) {
+            value(node);
+        }
+    }
+
+    void anchor(const Anchor *anchor) {
+        word(anchor->path.value());
+        word(((uint64_t)anchor->lineno << 32) | (uint32_t)anchor->column);
+    }
+
+    void constant(const Const *node) {
+        if (node->kind() == VK_ConstPointer) {
+            auto T = node->get_type();
+            auto ptr = cast<ConstPointer>(node)->value;
+            if (T == TYPE_Closure) {
+                auto cl = (const Closure *)ptr;
+                word(template_fingerprint(cl->func.unref()));
+                pointer(cl->frame.unref());
+                return;
+            } else if (T == TYPE_Anchor) {
+                anchor((const Anchor *)ptr);
+                return;
+            }
+        }
+        pointer(node);
+    }
+
+    void params(const ParameterTemplates &params) {
+        word(params.size());
+        for (auto &&param : params) {
+            value(param);
+        }
+    }
+
+    void value(const ValueRef &node) {
+        if (!node) {
+            word(0);
+            return;
+        }
+        auto ptr = node.unref();
+        auto it = ids.find(ptr);
+        if (it != ids.end()) {
+            word(BackRef | it->second);
+            return;
+        }
+        ids.insert({ptr, ids.size()});
+        word(ptr->kind() + 1);
+        switch(ptr->kind()) {
+        case VK_Template: {
+            word(template_fingerprint(cast<Template>(ptr)));
+        } break;
+        case VK_LabelTemplate: {
+            auto x = cast<LabelTemplate>(ptr);
+            word(x->label_kind); word(x->name.value()); value(x->value);
+        } break;
+        case VK_Loop: {
+            auto x = cast<Loop>(ptr);
+            value(x->init); value(x->value);
+        } break;
+        case VK_LoopArguments: {
+            value(cast<LoopArguments>(ptr)->loop);
+        } break;
+        case VK_KeyedTemplate: {
+            auto x = cast<KeyedTemplate>(ptr);
+            word(x->key.value()); value(x->value);
+        } break;
+        case VK_Expression: {
+            auto x = cast<Expression>(ptr);
+            word(x->scoped); values(x->body); value(x->value);
+        } break;
+        case VK_Quote: {
+            value(cast<Quote>(ptr)->value);
+        } break;
+        case VK_Unquote: {
+            value(cast<Unquote>(ptr)->value);
+        } break;
+        case VK_CompileStage: {
+            auto x = cast<CompileStage>(ptr);
+            pointer(x->next); pointer(x->env);
+        } break;
+        case VK_CondTemplate: {
+            auto x = cast<CondTemplate>(ptr);
+            value(x->cond); value(x->then_value); value(x->else_value);
+        } break;
+        case VK_SwitchTemplate: {
+            auto x = cast<SwitchTemplate>(ptr);
+            value(x->expr); values(x->cases);
+        } break;
+        case VK_CaseTemplate: {
+            auto x = cast<CaseTemplate>(ptr);
+            word(x->case_kind); value(x->literal); value(x->value);
+        } break;
+        case VK_MergeTemplate: {
+            auto x = cast<MergeTemplate>(ptr);
+            value(x->label); value(x->value);
+        } break;
+        case VK_CallTemplate: {
+            auto x = cast<CallTemplate>(ptr);
+            word(x->flags); value(x->callee); values(x->args);
+        } break;
+        case VK_ArgumentListTemplate: {
+            values(cast<ArgumentListTemplate>(ptr)->values());
+        } break;
+        case VK_ExtractArgumentTemplate: {
+            auto x = cast<ExtractArgumentTemplate>(ptr);
+            word(x->index); word(x->vararg); value(x->value);
+        } break;
+        case VK_ParameterTemplate: {
+            auto x = cast<ParameterTemplate>(ptr);
+            word(x->name.value()); word(x->variadic); word(x->index);
+        } break;
+        default: {
+            if (isa<Const>(ptr)) {
+                constant(cast<Const>(ptr));
+            } else {
+                // typed values of functions that are being proven
+                pointer(ptr);
+            }
+        } break;
+        }
+    }
+
+    void digest(const Template *func) {
+        word(func->name.value());
+        word(func->_is_inline);
+        word(func->fast_math);
+        params(func->params);
+        value(func->value);
+    }
+
+    static uint64_t template_fingerprint(const Template *func);
+
+    std::vector<uint64_t> &dest;
+    absl::flat_hash_map<const Value *, uint64_t> ids;
+};
+
+uint64_t TemplateDigest::template_fingerprint(const Template *func) {
+    // (re)entered while the fingerprint is being built; recursion is
+    // described by the name alone
+    static thread_local absl::flat_hash_set<const Template *> building;
+    auto T = const_cast<Template *>(func);
+    if (T->fingerprint && (T->fingerprint_value == T->value.unref()))
+        return T->fingerprint;
+    if (!building.insert(func).second)
+        return func->name.value();
+    std::vector<uint64_t> words;
+    TemplateDigest digest(words);
+    digest.digest(func);
+    building.erase(func);
+    uint64_t h = hash_bytes((const char *)words.data(),
+        words.size() * sizeof(uint64_t));
+    if (!h) h = 1;
+    T->fingerprint = h;
+    T->fingerprint_value = T->value.unref();
+    return h;
+}
+
+/* specializations by the digest of their template and their instance
+   arguments. equal templates can also come from expanding the same macro
+   twice, and must then be proven separately, as their proofs may have
+   effects, e.g. creating globals. therefore a specialization is only handed
+   out for an equal template of a later epoch, and at most once per epoch.
+   the epoch advances whenever modules are invalidated for reloading. */
+
+namespace FunctionSet {
+    typedef std::tuple<std::vector<uint64_t>, const Function *, Types> FingerprintKey;
+
+    struct FingerprintEntry {
+        Function *fn;
+        // the epoch in which fn was last proven or handed out
+        uint64_t epoch;
+    };
+}
+
+static uint64_t fingerprint_epoch = 1;
+static absl::flat_hash_map<FunctionSet::FingerprintKey,
+    std::vector<FunctionSet::FingerprintEntry>> fingerprinted;
+
+void advance_fingerprint_epoch() {
+    fingerprint_epoch++;
+}
+
+static Function *claim_fingerprinted(const FunctionSet::FingerprintKey &key) {
+    auto it = fingerprinted.find(key);
+    if (it == fingerprinted.end())
+        return nullptr;
+    auto &&entries = it->second;
+    for (size_t i = 0; i < entries.size();) {
+        auto &&entry = entries[i];
+        if (entry.fn->released || !entry.fn->deps.valid()) {
+            entries.erase(entries.begin() + i);
+            continue;
+        }
+        if (entry.epoch < fingerprint_epoch) {
+            entry.epoch = fingerprint_epoch;
+            return entry.fn;
+        }
+        ++i;
+    }
+    return nullptr;
+}
+
+static FunctionSet::FingerprintKey fingerprint_key(
+    const TemplateRef &func, const FunctionRef &frame, const Types &types) {
+    std::vector<uint64_t> words;
+    TemplateDigest digest(words);
+    digest.digest(func.unref());
+    return FunctionSet::FingerprintKey(std::move(words), frame.unref(), types);
+}
+
+// what the caller proves depends on everything fn depends on
+static void depend_on(const Function *fn) {
+    auto deps = get_type_dependencies();
+    if (deps)
+        deps->merge(fn->deps);
+}
+
 //------------------------------------------------------------------------------
 
 static sc_typecast_func_t g_typecast_handler = nullptr;
+
+/* the handler decides how to convert a value based on its qualified type,
+   the target type and whether it is constant, and answers with a call to a
+   converter that takes the value as its only argument. such decisions are
+   kept so that later casts with the same signature can build the call
+   themselves. a decision is dropped when the symbols of either type or of
+   one of their supertypes change. */
+
+typedef std::tuple<const Type *, const Type *, bool> TypecastKey;
+
+struct TypecastEntry {
+    const Anchor *anchor;
+    ValueRef callee;
+    uint32_t flags;
+};
+
+static absl::flat_hash_map<TypecastKey, TypecastEntry> typecast_cache;
+
 void set_typecast_handler(sc_typecast_func_t func) {
     g_typecast_handler = func;
+    typecast_cache.clear();
+}
+
+static bool type_inherits(const Type *T, const Type *super) {
+    T = strip_qualifiers(T);
+    do {
+        if (T == super)
+            return true;
+        if (T == TYPE_Typename)
+            break;
+        T = superof(T);
+    } while (T);
+    return false;
+}
+
+void invalidate_typecast_cache(const Type *T) {
+    auto it = typecast_cache.begin();
+    while (it != typecast_cache.end()) {
+        auto &&key = it->first;
+        if (type_inherits(std::get<0>(key), T)
+            || type_inherits(std::get<1>(key), T)) {
+            typecast_cache.erase(it++);
+        } else {
+            ++it;
+        }
+    }
 }
 
 static bool has_typecast_handler() {
@@ -133,11 +464,25 @@ static SCOPES_RESULT(TypedValueRef) run_typecast_handler(
     SCOPES_RESULT_TYPE(TypedValueRef);
     assert(g_typecast_handler);
     T = strip_qualifiers(T);
+    TypecastKey key(value->get_type(), T, value.isa<Const>());
+    auto it = typecast_cache.find(key);
+    if (it != typecast_cache.end()) {
+        auto &&entry = it->second;
+        auto call = CallTemplate::from(entry.callee, { value });
+        call->flags = entry.flags;
+        return SCOPES_GET_RESULT(prove(ctx, ref(entry.anchor, call)));
+    }
     auto result = g_typecast_handler(value, T);
     if (!result.ok) {
         SCOPES_RETURN_ERROR(result.except);
     } else {
         auto expr = result._0;
+        auto call = expr.dyn_cast<CallTemplate>();
+        if (call && (call->args.size() == 1)
+            && (call->args[0].unref() == value.unref())) {
+            typecast_cache.insert({key,
+                { expr.anchor(), call->callee, call->flags }});
+        }
         return SCOPES_GET_RESULT(prove(ctx, expr));
     }
 }
@@ -321,6 +666,7 @@ SCOPES_RESULT(void) ASTContext::append(const InstructionRef &value) const {
     //SCOPES_RESULT_TYPE(void);
     assert(block);
     block->append(value);
+    function->number_value(value.unref());
     //SCOPES_CHECK_RESULT(tag_instruction(*this, value));
     function->try_bind_unique(value);
     return {};
@@ -330,6 +676,7 @@ SCOPES_RESULT(void) ASTContext::unchecked_append(const InstructionRef &value) co
     //SCOPES_RESULT_TYPE(void);
     assert(block);
     block->append(value);
+    function->number_value(value.unref());
     //SCOPES_CHECK_RESULT(tag_instruction(*this, value));
     return {};
 }
@@ -1287,6 +1634,7 @@ static SCOPES_RESULT(TypedValueRef) prove_Loop(const ASTContext &ctx, const Loop
 
     auto loopargs = ref(loop.anchor(), LoopLabelArguments::from(
         arguments_type(loop_types)));
+    ctx.function->number_value(loopargs.unref());
 
     LoopLabelRef newloop = ref(loop.anchor(),
         LoopLabel::from(init_values, loopargs));
@@ -1868,6 +2216,27 @@ static SCOPES_RESULT(void) build_deref_automove(
         auto &&_ ## NAME = values[argn++]; \
         auto NAME = SCOPES_GET_RESULT(extract_symbol_constant(_ ## NAME));
 
+// the memory order passed to builtin b, which must be one of the orders
+// in allowed; a zero mask allows any atomic order
+static SCOPES_RESULT(MemoryOrder) extract_memory_order(const ValueRef &value,
+    Builtin b, unsigned allowed) {
+    SCOPES_RESULT_TYPE(MemoryOrder);
+    auto order = (MemoryOrder)SCOPES_GET_RESULT(extract_integer_constant(value));
+    bool valid = (order > MemoryOrderNotAtomic) && (order <= MemoryOrderSeqCst);
+    if (valid && allowed) {
+        valid = ((allowed >> order) & 1);
+    }
+    if (!valid) {
+        SCOPES_ERROR(InvalidMemoryOrder, memory_order_name(order), b);
+    }
+    return order;
+}
+
+#define MEMORY_ORDER_BIT(NAME) (1u << NAME)
+#define READ_MEMORY_ORDER(NAME, ALLOWED) \
+        assert(argn < argcount); \
+        auto NAME = SCOPES_GET_RESULT(extract_memory_order(values[argn++], b, ALLOWED));
+
 static const Type *canonical_return_type(const FunctionRef &fn, const Type *rettype,
     bool is_except = false) {
     if (!is_returning_value(rettype))
@@ -1946,6 +2315,16 @@ static SCOPES_RESULT(const Type *) get_function_type(const FunctionRef &fn) {
     return native_opaque_pointer_type(raising_function_type(raisetype, rettype, params));
 }
 
+// a completed function with no raises in its body can't raise, even if a
+// hint typed it as raising; calls to it need no except path, and don't make
+// the caller raise in turn
+static bool never_raises(const TypedValueRef &callee) {
+    if (!callee.isa<Function>())
+        return false;
+    auto fn = callee.cast<Function>();
+    return fn->complete && fn->raises.empty();
+}
+
 static SCOPES_RESULT(const Type *) ensure_function_type(const FunctionRef &fn) {
     SCOPES_RESULT_TYPE(const Type *);
     const Type *fT = SCOPES_GET_RESULT(get_function_type(fn));
@@ -2159,6 +2538,7 @@ repeat:
     } else if (T == TYPE_ASTMacro) {
         auto fptr = SCOPES_GET_RESULT(extract_astmacro_constant(callee));
         assert(fptr);
+        prove_effects++;
         SCOPES_ASTCONTEXT(ctx);
         auto result = fptr(ref(call.anchor(), ArgumentList::from(values)));
         if (result.ok) {
@@ -2185,6 +2565,17 @@ repeat:
             SCOPES_CHECK_RESULT(verify_valid(ctx, values, "builtin call"));
         }
         switch(b.value()) {
+        case FN_DumpUniques:
+        case FN_Dump:
+        case FN_DumpDebug:
+        case FN_DumpAST:
+        case FN_DumpTemplate:
+        case FN_HideTraceback:
+            prove_effects++;
+            break;
+        default: break;
+        }
+        switch(b.value()) {
         /*** DEBUGGING ***/
         case FN_DumpUniques: {
             StyledStream ss(SCOPES_CERR);
@@ -2357,6 +2748,41 @@ repeat:
             fn->raising_anchor = call.anchor();
             return ref(call.anchor(), ArgumentList::from({}));
         } break;
+        case FN_LoopHint: {
+            if (!ctx.loop) {
+                SCOPES_ERROR(LoopHintOutsideLoop);
+            }
+            LoopHints &hints = ctx.loop->hints;
+            while (argn < argcount) {
+                READ_SYMBOL_CONST(sym);
+                int *count = nullptr;
+                switch(sym.value()) {
+                case SYM_Vectorize: {
+                    hints.vectorize = 1;
+                    count = &hints.vectorize_width;
+                } break;
+                case SYM_NoVectorize: hints.vectorize = -1; break;
+                case SYM_Interleave: count = &hints.interleave_count; break;
+                case SYM_Unroll: {
+                    hints.unroll = 1;
+                    count = &hints.unroll_count;
+                } break;
+                case SYM_NoUnroll: hints.unroll = -1; break;
+                case SYM_Independent: hints.independent = true; break;
+                default:
+                    SCOPES_ERROR(UnsupportedLoopHint, sym);
+                    break;
+                }
+                // the hint may be followed by a count
+                if (count && (argn < argcount)
+                    && values[argn].isa<ConstInt>()
+                    && (values[argn]->get_type() != TYPE_Symbol)) {
+                    READ_INT_CONST(x);
+                    *count = (int)x;
+                }
+            }
+            return ref(call.anchor(), ArgumentList::from({}));
+        } break;
         /*** ARGUMENTS ***/
         case FN_VaCountOf: {
             return TypedValueRef(call.anchor(), ConstInt::from(TYPE_I32, argcount));
@@ -2822,6 +3248,43 @@ repeat:
             op->hack_change_value(VIEWTYPE1(op->get_type(), _A));
             return TypedValueRef(call.anchor(), op);
         } break;
+        case FN_Expect: {
+            CHECKARGS(2, 2);
+            READ_TYPEOF(A); READ_TYPEOF(B);
+            SCOPES_CHECK_RESULT(verify_integer_ops(A, B));
+            // the expected value must be known at compile time
+            SCOPES_CHECK_RESULT(extract_integer_constant(_B));
+            auto op = BinOp::from(BinOpExpect, _A, _B);
+            op->hack_change_value(VIEWTYPE1(op->get_type(), _A));
+            return TypedValueRef(call.anchor(), op);
+        } break;
+        case FN_Assume: {
+            CHECKARGS(1, 1);
+            READ_TYPEOF(A);
+            SCOPES_CHECK_RESULT(verify(TYPE_Bool, A));
+            SCOPES_CHECK_RESULT(ctx.append(
+                ref(call.anchor(), UnOp::from(UnOpAssume, _A))));
+            return ref(call.anchor(), ArgumentList::from({}));
+        } break;
+        case FN_Prefetch: {
+            CHECKARGS(1, 2);
+            READ_STORAGETYPEOF(T);
+            SCOPES_CHECK_RESULT(verify_kind<TK_Pointer>(T));
+            UnOpKind kind = UnOpPrefetch;
+            if (argn < argcount) {
+                READ_SYMBOL_CONST(mode);
+                switch(mode.value()) {
+                case SYM_Read: break;
+                case SYM_Write: kind = UnOpPrefetchWrite; break;
+                default:
+                    SCOPES_ERROR(UnsupportedPrefetchMode, mode);
+                    break;
+                }
+            }
+            SCOPES_CHECK_RESULT(ctx.append(
+                ref(call.anchor(), UnOp::from(kind, _T))));
+            return ref(call.anchor(), ArgumentList::from({}));
+        } break;
         case FN_Cross: {
             CHECKARGS(2, 2);
             READ_STORAGETYPEOF(A);
@@ -3068,6 +3531,23 @@ repeat:
                 return TypedValueRef(call.anchor(), op);
             }
         } break;
+        case FN_AtomicLoad: {
+            CHECKARGS(1, 2);
+            READ_STORAGETYPEOF(T);
+            SCOPES_CHECK_RESULT(verify_kind<TK_Pointer>(T));
+            SCOPES_CHECK_RESULT(verify_readable(T));
+            MemoryOrder order = MemoryOrderAcquire;
+            if (argn < argcount) {
+                READ_MEMORY_ORDER(_order,
+                    MEMORY_ORDER_BIT(MemoryOrderRelaxed)
+                    | MEMORY_ORDER_BIT(MemoryOrderAcquire)
+                    | MEMORY_ORDER_BIT(MemoryOrderSeqCst));
+                order = _order;
+            }
+            auto op = Load::from(_T, false, order);
+            op->hack_change_value(VIEWTYPE1(op->get_type(), _T));
+            return TypedValueRef(call.anchor(), op);
+        } break;
         case FN_VolatileLoad:
         case FN_Load: {
             CHECKARGS(1, 1);
@@ -3078,9 +3558,15 @@ repeat:
             op->hack_change_value(VIEWTYPE1(op->get_type(), _T));
             return TypedValueRef(call.anchor(), op);
         } break;
+        case FN_AtomicStore:
         case FN_VolatileStore:
         case FN_Store: {
-            CHECKARGS(2, 2);
+            bool is_atomic = (b.value() == FN_AtomicStore);
+            if (is_atomic) {
+                CHECKARGS(2, 3);
+            } else {
+                CHECKARGS(2, 2);
+            }
             READ_STORAGETYPEOF(ElemT);
             READ_STORAGETYPEOF(DestT);
             SCOPES_CHECK_RESULT(verify_kind<TK_Pointer>(DestT));
@@ -3095,11 +3581,23 @@ repeat:
                 }
                 ctx.move(uq->id, call);
             }
-            auto op = Store::from(_ElemT, _DestT, b.value() == FN_VolatileStore);
+            MemoryOrder order = MemoryOrderNotAtomic;
+            if (is_atomic) {
+                order = MemoryOrderRelease;
+                if (argn < argcount) {
+                    READ_MEMORY_ORDER(_order,
+                        MEMORY_ORDER_BIT(MemoryOrderRelaxed)
+                        | MEMORY_ORDER_BIT(MemoryOrderRelease)
+                        | MEMORY_ORDER_BIT(MemoryOrderSeqCst));
+                    order = _order;
+                }
+            }
+            auto op = Store::from(_ElemT, _DestT, b.value() == FN_VolatileStore,
+                order);
             return TypedValueRef(call.anchor(), op);
         } break;
         case OP_CmpXchg: {
-            CHECKARGS(3, 3);
+            CHECKARGS(3, 5);
             READ_STORAGETYPEOF(DestT);
             READ_STORAGETYPEOF(Cmp);
             READ_STORAGETYPEOF(ElemT);
@@ -3117,13 +3615,34 @@ repeat:
                 }
                 ctx.move(uq->id, call);
             }
-            auto op = CmpXchg::from(_DestT, _Cmp, _ElemT);
+            MemoryOrder success_order = MemoryOrderSeqCst;
+            MemoryOrder failure_order = MemoryOrderSeqCst;
+            if (argn < argcount) {
+                READ_MEMORY_ORDER(_order, 0);
+                success_order = _order;
+                // the failure order defaults to the load part of the
+                // success order
+                switch(success_order) {
+                case MemoryOrderRelease: failure_order = MemoryOrderRelaxed; break;
+                case MemoryOrderAcqRel: failure_order = MemoryOrderAcquire; break;
+                default: failure_order = success_order; break;
+                }
+            }
+            if (argn < argcount) {
+                READ_MEMORY_ORDER(_order,
+                    MEMORY_ORDER_BIT(MemoryOrderRelaxed)
+                    | MEMORY_ORDER_BIT(MemoryOrderAcquire)
+                    | MEMORY_ORDER_BIT(MemoryOrderSeqCst));
+                failure_order = _order;
+            }
+            auto op = CmpXchg::from(_DestT, _Cmp, _ElemT,
+                success_order, failure_order);
             auto T = op->get_type();
             op->hack_change_value(UNIQUETYPE2(get_argument(T, 0), get_argument(T, 1)));
             return TypedValueRef(call.anchor(), op);
         } break;
         case OP_AtomicRMW: {
-            CHECKARGS(3, 3);
+            CHECKARGS(3, 4);
             READ_BUILTIN_CONST(Op);
             READ_STORAGETYPEOF(DestT);
             READ_STORAGETYPEOF(ElemT);
@@ -3150,7 +3669,12 @@ repeat:
                     SCOPES_ERROR(UnsupportedBuiltin, Op);
                 } break;
             }
-            auto op = AtomicRMW::from(opkind, _DestT, _ElemT);
+            MemoryOrder order = MemoryOrderSeqCst;
+            if (argn < argcount) {
+                READ_MEMORY_ORDER(_order, 0);
+                order = _order;
+            }
+            auto op = AtomicRMW::from(opkind, _DestT, _ElemT, order);
             op->hack_change_value(UNIQUETYPE1(op->get_type()));
             return TypedValueRef(call.anchor(), op);
         } break;
@@ -3160,6 +3684,16 @@ repeat:
             auto op = Barrier::from((BarrierKind)kind);
             return TypedValueRef(call.anchor(), op);
         } break;
+        case OP_Fence: {
+            CHECKARGS(1, 1);
+            READ_MEMORY_ORDER(order,
+                MEMORY_ORDER_BIT(MemoryOrderAcquire)
+                | MEMORY_ORDER_BIT(MemoryOrderRelease)
+                | MEMORY_ORDER_BIT(MemoryOrderAcqRel)
+                | MEMORY_ORDER_BIT(MemoryOrderSeqCst));
+            auto op = Fence::from(order);
+            return TypedValueRef(call.anchor(), op);
+        } break;
         case FN_Alloca: {
             CHECKARGS(1, 1);
             READ_TYPE_CONST(T);
@@ -3464,12 +3998,13 @@ repeat:
     const Type *rt = remap_unique_return_arguments(ctx, idmap, ft->return_type);
     CallRef newcall = ref(call.anchor(), Call::from(rt, callee, values));
     //newcall->set_def_anchor(call->def_anchor());
-    if (ft->has_exception()) {
+    if (ft->has_exception() && !never_raises(callee)) {
         // todo: remap exception type
         newcall->except_body.set_parent(ctx.block);
         auto exceptctx = ctx.with_block(newcall->except_body);
         const Type *et = remap_unique_return_arguments(exceptctx, idmap, ft->except_type);
         auto exc = ref(call.anchor(), Exception::from(et));
+        ctx.function->number_value(exc.unref());
 
         map_arguments_to_block(exceptctx, exc);
         newcall->except = exc;
@@ -3900,6 +4435,7 @@ static SCOPES_RESULT(TypedValueRef) prove_inline_body(const ASTContext &ctx,
         fn->label = label;
     }
     fn->boundary = ctx.function;
+    ctx.function->inlines.push_back(fn);
 
     // inlines may escape caller loops
     ASTContext subctx = ctx.with_frame(fn);
@@ -3943,6 +4479,73 @@ static SCOPES_RESULT(TypedValueRef) prove_inline_body(const ASTContext &ctx,
     }
 }
 
+/* expansions of inlines whose arguments are all constant, and which came
+   out as constants without appending instructions or having any other
+   effect, are handed out again for the same closure and arguments, for as
+   long as none of the types whose symbols they read has changed. chains of
+   helpers that compute types and other constants are then only proven
+   once. */
+
+struct InlineKey {
+    const Closure *closure;
+    TypedValues args;
+    std::size_t prehash;
+
+    bool operator==(const InlineKey &other) const {
+        if (closure != other.closure) return false;
+        if (args.size() != other.args.size()) return false;
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (args[i]->get_type() != other.args[i]->get_type())
+                return false;
+            if (!args[i].cast<Pure>()->key_equal(other.args[i].cast<Pure>().unref()))
+                return false;
+        }
+        return true;
+    }
+
+    struct Hash {
+        std::size_t operator()(const InlineKey &s) const {
+            return s.prehash;
+        }
+    };
+};
+
+struct InlineExpansion {
+    TypedValueRef result;
+    TypeDependencies deps;
+};
+
+// the table is cleared rather than grown past this size
+static const size_t InlineMemoMaxEntries = 1 << 16;
+
+static thread_local absl::flat_hash_map<InlineKey, InlineExpansion,
+    InlineKey::Hash> inline_expansions;
+
+static bool is_const_result(const TypedValueRef &value) {
+    if (value.isa<ArgumentList>()) {
+        for (auto &&arg : value.cast<ArgumentList>()->values) {
+            if (!arg.isa<Const>())
+                return false;
+        }
+        return true;
+    }
+    return value.isa<Const>();
+}
+
+static bool inline_key(const Closure *cl, const TypedValues &nodes,
+    InlineKey &key) {
+    std::size_t h = std::hash<const Closure *>{}(cl);
+    for (auto &&node : nodes) {
+        if (!node.isa<Const>())
+            return false;
+        h = hash2(h, node.cast<Pure>()->hash());
+    }
+    key.closure = cl;
+    key.args = nodes;
+    key.prehash = h;
+    return true;
+}
+
 SCOPES_RESULT(TypedValueRef) prove_inline(const ASTContext &ctx,
     const Closure *cl, const TypedValues &nodes) {
     SCOPES_RESULT_TYPE(TypedValueRef);
@@ -3950,35 +4553,222 @@ SCOPES_RESULT(TypedValueRef) prove_inline(const ASTContext &ctx,
     if (func->recursion >= SCOPES_MAX_RECURSIONS) {
         SCOPES_ERROR(RecursionOverflow, func->recursion);
     }
+    InlineKey key;
+    if (!inline_key(cl, nodes, key)) {
+        func->recursion++;
+        auto result = prove_inline_body(ctx, cl, nodes);
+        func->recursion--;
+        return result;
+    }
+    auto it = inline_expansions.find(key);
+    if (it != inline_expansions.end()) {
+        if (it->second.deps.valid()) {
+            inline_memo_hits.increment();
+            auto deps = get_type_dependencies();
+            if (deps)
+                deps->merge(it->second.deps);
+            return it->second.result;
+        }
+        inline_expansions.erase(it);
+    }
+    auto effects = prove_effects;
+    auto count = ctx.block->body.size();
+    auto terminator = ctx.block->terminator;
+    InlineExpansion expansion;
     func->recursion++;
-    auto result = prove_inline_body(ctx, cl, nodes);
+    auto result = [&]() {
+        TypeDependencyScope deps_scope(&expansion.deps);
+        return prove_inline_body(ctx, cl, nodes);
+    }();
     func->recursion--;
+    auto deps = get_type_dependencies();
+    if (deps)
+        deps->merge(expansion.deps);
+    if (result.ok()
+        && (effects == prove_effects)
+        && (count == ctx.block->body.size())
+        && (terminator == ctx.block->terminator)
+        && is_const_result(result.assert_ok())) {
+        if (inline_expansions.size() >= InlineMemoMaxEntries)
+            inline_expansions.clear();
+        expansion.result = result.assert_ok();
+        inline_expansions.insert({key, expansion});
+    }
     return result;
 }
 
+//------------------------------------------------------------------------------
+
+struct TemplateInstances {
+    Symbol name;
+    const Anchor *anchor = nullptr;
+    uint64_t instances = 0;
+    absl::flat_hash_set<std::size_t> signatures;
+    std::chrono::high_resolution_clock::duration prove_time{};
+    uint64_t code_size = 0;
+};
+
+static std::atomic<bool> instance_stats_enabled(false);
+// code sizes are reported from the threads that link objects
+static std::mutex instance_stats_mutex;
+static absl::flat_hash_map<const Template *, TemplateInstances> template_instances;
+static absl::flat_hash_map<std::string, const Template *> instance_symbols;
+
+void set_instance_stats_enabled(bool enable) {
+    instance_stats_enabled = enable;
+}
+
+bool is_instance_stats_enabled() {
+    return instance_stats_enabled;
+}
+
+void register_instance_symbol(const std::string &symbol, const Function *fn) {
+    if (!instance_stats_enabled || !fn->original)
+        return;
+    std::lock_guard<std::mutex> lock(instance_stats_mutex);
+    instance_symbols[symbol] = fn->original.unref();
+}
+
+void add_instance_code_size(const std::string &symbol, uint64_t size) {
+    if (!instance_stats_enabled)
+        return;
+    std::lock_guard<std::mutex> lock(instance_stats_mutex);
+    auto it = instance_symbols.find(symbol);
+    if (it == instance_symbols.end())
+        return;
+    template_instances[it->second].code_size += size;
+}
+
+// records the proof of an instance from its start to the end of the scope
+struct InstanceProofScope {
+    const TemplateRef &func;
+    std::chrono::high_resolution_clock::time_point start;
+
+    InstanceProofScope(const TemplateRef &_func, const Types &types)
+        : func(_func), start(std::chrono::high_resolution_clock::now()) {
+        std::size_t h = 0;
+        for (auto T : types) {
+            h = hash2(h, std::hash<const Type *>{}(T));
+        }
+        std::lock_guard<std::mutex> lock(instance_stats_mutex);
+        auto &&entry = template_instances[func.unref()];
+        entry.name = func->name;
+        entry.anchor = func.anchor();
+        entry.instances++;
+        entry.signatures.insert(h);
+    }
+
+    ~InstanceProofScope() {
+        auto elapsed = std::chrono::high_resolution_clock::now() - start;
+        std::lock_guard<std::mutex> lock(instance_stats_mutex);
+        template_instances[func.unref()].prove_time += elapsed;
+    }
+};
+
+void get_instance_stats(std::vector<InstanceStats> &stats) {
+    std::lock_guard<std::mutex> lock(instance_stats_mutex);
+    stats.clear();
+    for (auto &&it : template_instances) {
+        auto &&entry = it.second;
+        stats.push_back({ entry.name, entry.anchor, entry.instances,
+            (uint64_t)entry.signatures.size(),
+            std::chrono::duration<double, std::milli>(entry.prove_time).count(),
+            entry.code_size });
+    }
+    std::sort(stats.begin(), stats.end(),
+        [](const InstanceStats &a, const InstanceStats &b) {
+            if (a.code_size != b.code_size)
+                return a.code_size > b.code_size;
+            return a.prove_time > b.prove_time;
+        });
+}
+
+void print_instance_stats(int limit) {
+    std::vector<InstanceStats> stats;
+    get_instance_stats(stats);
+    StyledStream ss;
+    ss << "instances: " << stats.size() << " templates" << std::endl;
+    int count = 0;
+    for (auto &&entry : stats) {
+        if (count++ == limit)
+            break;
+        ss << "instances: " << entry.code_size << " bytes, "
+            << entry.instances << " instances, "
+            << entry.signatures << " signatures, "
+            << entry.prove_time << "ms: " << entry.name.name()->data;
+        if (entry.anchor) {
+            ss << " at " << entry.anchor;
+        }
+        ss << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+
 static SCOPES_RESULT(FunctionRef) prove_body(
     const FunctionRef &frame, const TemplateRef &func, Types types) {
     SCOPES_RESULT_TYPE(FunctionRef);
     Timer sum_prove_time(TIMER_Specialize);
     assert(func);
     canonicalize_argument_types(types);
+    std::size_t hash = FunctionSet::instance_hash(frame.unref(), types);
+    {
+        auto fn = find_cached_instance(func, hash, frame, types);
+        if (fn) {
+            specialize_cache_hits.increment();
+            depend_on(fn);
+            return ref(func.anchor(), fn);
+        }
+    }
+    specialize_cache_misses.increment();
     Function key(func->name, {});
     key.original = func;
     key.frame = frame;
     key.instance_args = types;
     auto it = functions.find(&key);
-    if (it != functions.end())
+    if (it != functions.end()) {
+        instance_cache_entry(func, hash) = { hash, *it };
+        depend_on(*it);
         return ref(func.anchor(), *it);
+    }
+    auto fpkey = fingerprint_key(func, frame, types);
+    {
+        auto fn = claim_fingerprinted(fpkey);
+        if (fn) {
+            // an equal template was proven in an earlier epoch
+            specialize_fingerprint_hits.increment();
+            instance_cache_entry(func, hash) = { hash, fn };
+            depend_on(fn);
+            return ref(func.anchor(), fn);
+        }
+    }
     SCOPES_TRACE_PROVE_TEMPLATE(func);
+    TraceScope prove_trace("prove", [&]() {
+        StyledString ss = StyledString::plain();
+        ss.out << "prove_body " << func->name.name()->data << "(";
+        for (size_t i = 0; i < types.size(); ++i) {
+            if (i) ss.out << " ";
+            ss.out << types[i];
+        }
+        ss.out << ")";
+        return ss.cppstr();
+    });
     if (func->is_forward_decl()) {
         SCOPES_ERROR(CannotProveForwardDeclaration);
     }
+    std::unique_ptr<InstanceProofScope> instance_scope;
+    if (instance_stats_enabled) {
+        instance_scope.reset(new InstanceProofScope(func, types));
+    }
     int count = (int)func->params.size();
     FunctionRef fn = ref(func.anchor(), Function::from(func->name, {}));
     fn->original = func;
+    fn->fast_math = func->fast_math;
     fn->frame = frame;
     fn->instance_args = types;
     fn->boundary = fn;
+    ValueArenaScope arena_scope(&fn->arena);
+    TypeDependencyScope deps_scope(&fn->deps);
     for (int i = 0; i < count; ++i) {
         auto oldparam = func->params[i];
         if (oldparam->is_variadic()) {
@@ -4022,6 +4812,7 @@ static SCOPES_RESULT(FunctionRef) prove_body(
     }
     fn->build_valids();
     functions.insert(fn.unref());
+    instance_cache_entry(func, hash) = { hash, fn.unref() };
 
     ASTContext fnctx = ASTContext::from_function(fn);
     ASTContext bodyctx = fnctx.with_block(fn->body);
@@ -4032,6 +4823,10 @@ static SCOPES_RESULT(FunctionRef) prove_body(
     SCOPES_CHECK_RESULT(finalize_returns_raises(bodyctx));
     //SCOPES_CHECK_RESULT(track(fnctx));
     fn->complete = true;
+    live_arena_size += fn->arena.size();
+    fingerprinted[std::move(fpkey)].push_back({ fn.unref(), fingerprint_epoch });
+    if (deps_scope.old_deps)
+        deps_scope.old_deps->merge(fn->deps);
     return fn;
 }
 
@@ -4046,6 +4841,60 @@ SCOPES_RESULT(FunctionRef) prove(const FunctionRef &frame, const TemplateRef &fu
     return result;
 }
 
+void release_function(const FunctionRef &fn) {
+    if (!fn->complete || fn->released)
+        return;
+    auto it = functions.find(fn.unref());
+    if ((it != functions.end()) && (*it == fn.unref())) {
+        functions.erase(it);
+    }
+    if (fn->original) {
+        for (auto &&entry : fn->original->instance_cache) {
+            if (entry.fn == fn.unref()) {
+                entry.fn = nullptr;
+            }
+        }
+    }
+    live_arena_size -= std::min(live_arena_size, fn->arena.size());
+    fn->release();
+}
+
+int sweep_functions() {
+    Timer sweep_time(TIMER_Sweep);
+    std::vector<Function *> compiled;
+    for (auto fn : functions) {
+        if (fn->complete && is_function_compiled(fn))
+            compiled.push_back(fn);
+    }
+    for (auto fn : compiled) {
+        release_function(ref(unknown_anchor(), fn));
+    }
+    for (auto it = fingerprinted.begin(); it != fingerprinted.end();) {
+        auto &&entries = it->second;
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+            [](const FunctionSet::FingerprintEntry &entry) {
+                return entry.fn->released; }), entries.end());
+        if (entries.empty()) {
+            fingerprinted.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    // memoized results must not hand out what was just released
+    prune_memo();
+    return (int)compiled.size();
+}
+
+void set_sweep_threshold(size_t bytes) {
+    sweep_threshold = bytes;
+}
+
+void sweep_functions_on_threshold() {
+    if (sweep_threshold && (live_arena_size > sweep_threshold)) {
+        sweep_functions();
+    }
+}
+
 SCOPES_RESULT(TypedValueRef) prove(const ValueRef &node) {
     SCOPES_RESULT_TYPE(TypedValueRef);
     if (!ast_context) {
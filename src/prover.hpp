@@ -13,6 +13,8 @@
 #include "scopes/scopes.h"
 
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 namespace scopes {
 
@@ -85,6 +87,42 @@ SCOPES_RESULT(const Type *) bool_op_return_type(const Type *T);
 SCOPES_RESULT(FunctionRef) prove(const FunctionRef &frame, const TemplateRef &func, const Types &types);
 SCOPES_RESULT(TypedValueRef) prove(const ASTContext &ctx, const ValueRef &node);
 SCOPES_RESULT(TypedValueRef) prove(const ValueRef &node);
+// drop a completed function from the cache and destroy its instructions
+void release_function(const FunctionRef &fn);
+// release all JIT compiled functions; returns the number of functions released
+int sweep_functions();
+// sweep when the instructions of live functions exceed the given number of
+// bytes; 0 disables
+void set_sweep_threshold(size_t bytes);
+void sweep_functions_on_threshold();
+// allow templates to reuse the specializations of equal templates proven
+// before now
+void advance_fingerprint_epoch();
+
+// the specializations of one template, collected while instance statistics
+// are enabled
+struct InstanceStats {
+    Symbol name;
+    const Anchor *anchor;
+    // functions proven from the template
+    uint64_t instances;
+    // distinct argument type lists among them
+    uint64_t signatures;
+    // milliseconds spent proving them, including the functions they proved
+    double prove_time;
+    // bytes of machine code of the instances that have been compiled
+    uint64_t code_size;
+};
+
+void set_instance_stats_enabled(bool enable);
+bool is_instance_stats_enabled();
+// associates the symbol that fn is compiled to with its template
+void register_instance_symbol(const std::string &symbol, const Function *fn);
+// adds the size of a compiled function to the template it was proven from
+void add_instance_code_size(const std::string &symbol, uint64_t size);
+// lists the templates, ordered by code size, then by prove time
+void get_instance_stats(std::vector<InstanceStats> &stats);
+void print_instance_stats(int limit = 50);
 
 SCOPES_RESULT(const Type *) ptr_to_ref(const Type *T);
 SCOPES_RESULT(const Type *) ref_to_ptr(const Type *T);
@@ -92,6 +130,7 @@ SCOPES_RESULT(const Type *) ref_to_ptr(const Type *T);
 SCOPES_RESULT(ConstRef) nullof(const Type *T);
 
 void set_typecast_handler(sc_typecast_func_t func);
+void invalidate_typecast_cache(const Type *T);
 
 
 } // namespace scopes
@@ -5,6 +5,7 @@
 */
 
 #include "key_qualifier.hpp"
+#include "../timer.hpp"
 #include "../error.hpp"
 #include "../utils.hpp"
 #include "../hash.hpp"
@@ -34,6 +35,11 @@ namespace KeyedSet {
 
 static absl::flat_hash_set<const KeyQualifier *, KeyedSet::Hash, KeyedSet::KeyEqual> keyeds;
 
+static MemoryStat keyeds_memory("key qualifiers", [](MemoryUsage &usage) {
+    usage.objects = keyeds.size();
+    usage.bytes = hash_table_bytes(keyeds) + keyeds.size() * sizeof(KeyQualifier);
+});
+
 //------------------------------------------------------------------------------
 // KEY QUALIFIER
 //------------------------------------------------------------------------------
@@ -5,13 +5,14 @@
 */
 
 #include "refer_qualifier.hpp"
+#include "../timer.hpp"
 #include "../type/pointer_type.hpp"
 #include "../hash.hpp"
 #include "../qualifier.inc"
 
-#include <assert.h>
+#include "../intern.hpp"
 
-#include "absl/container/flat_hash_set.h"
+#include <assert.h>
 
 namespace scopes {
 
@@ -33,7 +34,12 @@ namespace ReferSet {
     };
 } // namespace ReferSet
 
-static absl::flat_hash_set<const ReferQualifier *, ReferSet::Hash, ReferSet::KeyEqual> refers;
+static InternSet<const ReferQualifier *, ReferSet::Hash, ReferSet::KeyEqual> refers;
+
+static MemoryStat refers_memory("refer qualifiers", [](MemoryUsage &usage) {
+    refers.measure(usage.objects, usage.bytes);
+    usage.bytes += usage.objects * sizeof(ReferQualifier);
+});
 
 //------------------------------------------------------------------------------
 // REFER QUALIFIER
@@ -75,15 +81,10 @@ const Type *refer_type(const Type *type, uint64_t flags,
     Symbol storage_class) {
     flags |= required_flags_for_storage_class(storage_class);
     flags |= required_flags_for_element_type(type);
-    const ReferQualifier *result = nullptr;
     ReferQualifier key(flags, storage_class);
-    auto it = refers.find(&key);
-    if (it != refers.end()) {
-        result = *it;
-    } else {
-        result = new ReferQualifier(flags, storage_class);
-        refers.insert(result);
-    }
+    auto result = refers.intern(&key, [&]() {
+        return (const ReferQualifier *)new ReferQualifier(flags, storage_class);
+    });
     return qualify(type, { result });
 }
 
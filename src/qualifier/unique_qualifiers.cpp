@@ -5,18 +5,25 @@
 */
 
 #include "unique_qualifiers.hpp"
+#include "../timer.hpp"
 #include "../error.hpp"
 #include "../dyn_cast.inc"
 #include "../hash.hpp"
 #include "../qualifier.inc"
-#include "absl/container/flat_hash_set.h"
-
-#include <algorithm>
+#include "../intern.hpp"
 
 namespace scopes {
 
 //------------------------------------------------------------------------------
 
+static std::size_t hash_idset(const IDSet &ids) {
+    std::size_t h = std::hash<int>{}(ids.first);
+    for (auto w : ids.words) {
+        h = hash2(h, std::hash<uint64_t>{}(w));
+    }
+    return h;
+}
+
 namespace ViewSet {
 struct Hash {
     std::size_t operator()(const ViewQualifier *s) const {
@@ -31,7 +38,12 @@ struct KeyEqual {
 };
 } // namespace ViewSet
 
-static absl::flat_hash_set<const ViewQualifier *, ViewSet::Hash, ViewSet::KeyEqual> views;
+static InternSet<const ViewQualifier *, ViewSet::Hash, ViewSet::KeyEqual> views;
+
+static MemoryStat views_memory("view qualifiers", [](MemoryUsage &usage) {
+    views.measure(usage.objects, usage.bytes);
+    usage.bytes += usage.objects * sizeof(ViewQualifier);
+});
 
 //------------------------------------------------------------------------------
 
@@ -49,7 +61,12 @@ struct KeyEqual {
 };
 } // namespace ViewSet
 
-static absl::flat_hash_set<const UniqueQualifier *, UniqueSet::Hash, UniqueSet::KeyEqual> uniques;
+static InternSet<const UniqueQualifier *, UniqueSet::Hash, UniqueSet::KeyEqual> uniques;
+
+static MemoryStat uniques_memory("unique qualifiers", [](MemoryUsage &usage) {
+    uniques.measure(usage.objects, usage.bytes);
+    usage.bytes += usage.objects * sizeof(UniqueQualifier);
+});
 
 //------------------------------------------------------------------------------
 
@@ -97,37 +114,48 @@ void dump_idmap(const ID2SetMap &idmap) {
 }
 
 IDSet difference_idset(const IDSet &a, const IDSet &b) {
+    assert(!a.count(UnknownUnique));
     IDSet c;
-    c.reserve(a.size());
-    for (auto id : a) {
-        assert(id);
-        if (!b.count(id))
-            c.insert(id);
+    c.first = a.first;
+    c.words.reserve(a.words.size());
+    for (int i = 0; i < (int)a.words.size(); ++i) {
+        c.words.push_back(a.words[i] & ~b.word(a.first + i));
     }
+    c.trim();
     return c;
 }
 
 IDSet intersect_idset(const IDSet &a, const IDSet &b) {
+    assert(!a.count(UnknownUnique));
     IDSet c;
-    c.reserve(std::min(a.size(), b.size()));
-    for (auto id : a) {
-        assert(id);
-        if (b.count(id))
-            c.insert(id);
+    int lo = std::max(a.first, b.first);
+    int hi = std::min(a.first + (int)a.words.size(),
+        b.first + (int)b.words.size());
+    if (lo >= hi)
+        return c;
+    c.first = lo;
+    c.words.reserve(hi - lo);
+    for (int w = lo; w < hi; ++w) {
+        c.words.push_back(a.word(w) & b.word(w));
     }
+    c.trim();
     return c;
 }
 
 IDSet union_idset(const IDSet &a, const IDSet &b) {
+    assert(!a.count(UnknownUnique) && !b.count(UnknownUnique));
+    if (a.empty())
+        return b;
+    if (b.empty())
+        return a;
     IDSet c;
-    c.reserve(std::max(a.size(), b.size()));
-    for (auto id : a) {
-        assert(id);
-        c.insert(id);
-    }
-    for (auto id : b) {
-        assert(id);
-        c.insert(id);
+    int lo = std::min(a.first, b.first);
+    int hi = std::max(a.first + (int)a.words.size(),
+        b.first + (int)b.words.size());
+    c.first = lo;
+    c.words.reserve(hi - lo);
+    for (int w = lo; w < hi; ++w) {
+        c.words.push_back(a.word(w) | b.word(w));
     }
     return c;
 }
@@ -141,16 +169,12 @@ void dump_idset(const IDSet &a) {
 }
 
 ViewQualifier::ViewQualifier(const IDSet &_ids)
-    : Qualifier((QualifierKind)Kind), ids(_ids) {
+    : Qualifier((QualifierKind)Kind), ids(_ids), prehash(hash_idset(_ids)) {
+    // the bitmap is iterated in ascending order
+    sorted_ids.reserve(ids.size());
     for (auto entry : ids) {
         sorted_ids.push_back(entry);
     }
-    std::sort(sorted_ids.begin(), sorted_ids.end());
-    std::size_t h = 0;
-    for (auto &&entry : sorted_ids) {
-        h = hash2(h, std::hash<int>{}(entry));
-    }
-    prehash = h;
 }
 
 void ViewQualifier::stream_prefix(StyledStream &ss) const {
@@ -241,7 +265,51 @@ const Type *mutate_type(const Type *type) {
     return qualify(type, { _mutate_qualifier });
 }
 
+/* the views most recently built on each thread, keyed on the type and the
+   ids they were requested with. the prover views the same values over and
+   over, and a hit spares merging the lifetime qualifiers of the type and
+   looking the qualifier up in the shared table. */
+struct ViewTypeCache {
+    enum { N = 256 };
+
+    struct Entry {
+        std::size_t hash = 0;
+        const Type *type = nullptr;
+        IDSet ids;
+        const Type *result = nullptr;
+    };
+
+    Entry entries[N];
+};
+
+static thread_local ViewTypeCache view_type_cache;
+
+static const ViewQualifier *view_qualifier(const IDSet &ids) {
+    static thread_local InternCache<const ViewQualifier *> cache;
+    std::size_t h = hash_idset(ids);
+    const ViewQualifier *result;
+    if (cache.find(h, result, [&](const ViewQualifier *vq) {
+            return vq->ids == ids;
+        }))
+        return result;
+    ViewQualifier key(ids);
+    result = views.intern(&key, [&]() {
+        return (const ViewQualifier *)new ViewQualifier(ids);
+    });
+    cache.insert(h, result);
+    return result;
+}
+
 const Type * view_type(const Type *type, IDSet ids) {
+    std::size_t h = hash2(std::hash<const Type *>{}(type), hash_idset(ids));
+    auto &cached = view_type_cache.entries[h & (ViewTypeCache::N - 1)];
+    if (cached.result && (cached.hash == h) && (cached.type == type)
+        && (cached.ids == ids))
+        return cached.result;
+    cached.hash = h;
+    cached.type = type;
+    cached.ids = ids;
+    cached.result = nullptr;
     auto ut = try_qualifier<UniqueQualifier>(type);
     if (ut) {
         ids.insert(ut->id);
@@ -253,29 +321,16 @@ const Type * view_type(const Type *type, IDSet ids) {
             ids.insert(entry);
         }
     }
-    const ViewQualifier *result = nullptr;
-    ViewQualifier key(ids);
-    auto it = views.find(&key);
-    if (it != views.end()) {
-        result = *it;
-    } else {
-        result = new ViewQualifier(ids);
-        views.insert(result);
-    }
-    return qualify(type, { result });
+    cached.result = qualify(type, { view_qualifier(ids) });
+    return cached.result;
 }
 
 const Type * unique_type(const Type *type, int id) {
     type = strip_qualifier<ViewQualifier>(type);
-    const UniqueQualifier *result = nullptr;
     UniqueQualifier key(id);
-    auto it = uniques.find(&key);
-    if (it != uniques.end()) {
-        result = *it;
-    } else {
-        result = new UniqueQualifier(id);
-        uniques.insert(result);
-    }
+    auto result = uniques.intern(&key, [&]() {
+        return (const UniqueQualifier *)new UniqueQualifier(id);
+    });
     return qualify(type, { result });
 }
 
@@ -11,7 +11,10 @@
 #include "../type/qualify_type.hpp"
 
 #include <vector>
+#include <initializer_list>
+#include <iterator>
 #include "absl/container/flat_hash_set.h"
+#include "llvm/ADT/SmallVector.h"
 
 namespace scopes {
 
@@ -42,7 +45,143 @@ struct MutateQualifier : Qualifier {
 
 //------------------------------------------------------------------------------
 
-typedef absl::flat_hash_set<int> IDSet;
+/* a set of unique ids, stored as a bitmap over the words between its
+   smallest and its largest member. the ids of a function are handed out
+   densely, so sets stay a few words long, copying them is cheap and set
+   operations work on 64 ids at a time. */
+struct IDSet {
+    typedef llvm::SmallVector<uint64_t, 4> Words;
+
+    struct const_iterator {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef int value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const int *pointer;
+        typedef int reference;
+
+        const IDSet *set;
+        int index;
+        uint64_t bits;
+
+        int operator*() const {
+            return ((set->first + index) << 6) + __builtin_ctzll(bits);
+        }
+        const_iterator &operator++() {
+            bits &= bits - 1;
+            while (!bits && (++index < (int)set->words.size())) {
+                bits = set->words[index];
+            }
+            return *this;
+        }
+        bool operator==(const const_iterator &other) const {
+            return (index == other.index) && (bits == other.bits);
+        }
+        bool operator!=(const const_iterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    IDSet() : first(0) {}
+    IDSet(std::initializer_list<int> ids) : first(0) {
+        for (int id : ids) {
+            insert(id);
+        }
+    }
+
+    // the first and the last word are never zero
+    bool empty() const { return words.empty(); }
+    size_t size() const {
+        size_t count = 0;
+        for (auto w : words) {
+            count += __builtin_popcountll(w);
+        }
+        return count;
+    }
+    void reserve(size_t) {}
+    void clear() {
+        words.clear();
+        first = 0;
+    }
+
+    size_t count(int id) const {
+        return (word(id >> 6) >> (id & 63)) & 1;
+    }
+
+    // returns true if id was not in the set yet
+    bool insert(int id) {
+        int w = id >> 6;
+        if (words.empty()) {
+            first = w;
+            words.push_back(0);
+        } else if (w < first) {
+            words.insert(words.begin(), first - w, 0);
+            first = w;
+        } else if (w >= (first + (int)words.size())) {
+            words.resize(w - first + 1, 0);
+        }
+        uint64_t &bits = words[w - first];
+        uint64_t bit = 1ull << (id & 63);
+        if (bits & bit)
+            return false;
+        bits |= bit;
+        return true;
+    }
+
+    void erase(int id) {
+        int w = id >> 6;
+        if ((w < first) || (w >= (first + (int)words.size())))
+            return;
+        words[w - first] &= ~(1ull << (id & 63));
+        trim();
+    }
+
+    const_iterator begin() const {
+        if (words.empty())
+            return end();
+        const_iterator it = { this, 0, words[0] };
+        return it;
+    }
+    const_iterator end() const {
+        const_iterator it = { this, (int)words.size(), 0 };
+        return it;
+    }
+
+    bool operator==(const IDSet &other) const {
+        return (first == other.first) && (words == other.words);
+    }
+    bool operator!=(const IDSet &other) const {
+        return !(*this == other);
+    }
+
+    // word at absolute index w
+    uint64_t word(int w) const {
+        w -= first;
+        return ((w >= 0) && (w < (int)words.size()))?words[w]:0;
+    }
+
+    // drop zero words from both ends
+    void trim() {
+        while (!words.empty() && !words.back()) {
+            words.pop_back();
+        }
+        int lead = 0;
+        while ((lead < (int)words.size()) && !words[lead]) {
+            lead++;
+        }
+        if (lead) {
+            words.erase(words.begin(), words.begin() + lead);
+            first += lead;
+        }
+        if (words.empty()) {
+            first = 0;
+        }
+    }
+
+    // absolute index of the first word
+    int first;
+    Words words;
+};
+
 typedef std::vector<int> IDs;
 typedef absl::flat_hash_map<int, IDSet > ID2SetMap;
 
@@ -35,16 +35,37 @@ namespace scopes {
 
 #define REF(X) ref(_anchor, (X))
 
-#define LOCALREF(X) \
-    ref(Anchor::from(Symbol(String::from(__FILE__)), __LINE__, 1), (X))
-
 static ValueRef canonicalize(const ExpressionRef &expr) {
     if (expr->body.empty())
         return expr->value;
     return expr;
 }
 
+// returns the node that a quoted value refers to, if it is already known
+static ValueRef quoted_node(const ValueRef &value) {
+    auto agg = value.dyn_cast<ConstAggregate>();
+    if (!agg || (agg->get_type() != TYPE_ValueRef))
+        return ValueRef();
+    return agg->ast_value();
+}
+
 ValueRef build_quoted_argument_list(const Anchor *_anchor, const Values &values) {
+    {
+        // a list of typed values is immutable, so if all values are known,
+        // the list is built once here rather than every time the quote runs
+        Values nodes;
+        nodes.reserve(values.size());
+        for (auto &&value : values) {
+            auto node = quoted_node(value);
+            if (!node || !node.isa<TypedValue>())
+                break;
+            nodes.push_back(node);
+        }
+        if (nodes.size() == values.size()) {
+            return ConstAggregate::ast_from(
+                REF(ArgumentListTemplate::from(nodes)));
+        }
+    }
     auto result = REF(Expression::unscoped_from());
     auto numvals = (int)values.size();
     auto numelems = REF(ConstInt::from(TYPE_I32, numvals));
@@ -264,6 +285,10 @@ struct Quoter {
         if (node->is_inline()) {
             expr->append(REF(CallTemplate::from(g_sc_template_set_inline, { value })));
         }
+        if (node->fast_math) {
+            expr->append(REF(CallTemplate::from(g_sc_template_set_fast_math, { value,
+                REF(ConstInt::from(TYPE_U32, node->fast_math)) })));
+        }
         for (auto &&param : node->params) {
             expr->append(REF(CallTemplate::from(g_sc_template_append_parameter, {
                 value, SCOPES_GET_RESULT(quote_param(param))
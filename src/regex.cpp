@@ -0,0 +1,502 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "regex.hpp"
+#include "string.hpp"
+#include "scopes/config.h"
+
+#include "minilibs/regexp.cpp"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace scopes {
+
+using regexp::Reprog;
+using regexp::Reinst;
+using regexp::Rune;
+
+//------------------------------------------------------------------------------
+// REGULAR EXPRESSIONS
+//------------------------------------------------------------------------------
+
+namespace {
+
+struct DFAState {
+    // forward states list the instructions of all live threads in priority
+    // order; reverse states hold the set of instructions reached so far.
+    std::vector<int> insts;
+    bool match = false;
+    // transitions by byte, built on first use
+    DFAState *next[256] = {};
+};
+
+struct DFA {
+    typedef std::vector<int> Key;
+
+    // returns nullptr if the state limit has been reached
+    DFAState *intern(const Key &key, bool match) {
+        auto it = states.find(key);
+        if (it != states.end())
+            return it->second.get();
+        if (states.size() >= SCOPES_REGEX_MAX_DFA_STATES)
+            return nullptr;
+        auto state = std::make_unique<DFAState>();
+        state->insts = key;
+        state->match = match;
+        DFAState *result = state.get();
+        states.insert({ key, std::move(state) });
+        return result;
+    }
+
+    void clear() {
+        states.clear();
+    }
+
+    absl::flat_hash_map<Key, std::unique_ptr<DFAState>> states;
+};
+
+// the instructions regcomp emits in front of every pattern: a lazy loop
+// that skips ahead for unanchored searches, followed by the LPAR of group 0
+enum {
+    PC_SearchStart = 0,
+    PC_SearchSkip = 1,
+    PC_GroupStart = 3,
+};
+
+static bool consumes(const Reinst &inst) {
+    switch(inst.opcode) {
+    case regexp::I_ANYNL:
+    case regexp::I_ANY:
+    case regexp::I_CHAR:
+    case regexp::I_CCLASS:
+    case regexp::I_NCCLASS: return true;
+    default: return false;
+    }
+}
+
+struct Regex {
+    explicit Regex(Reprog *_prog) : prog(_prog) {
+        count = (int)(prog->end - prog->start);
+        group_end = count - 2;
+        use_dfa = !(prog->flags & regexp::REG_NEWLINE);
+        preds.resize(count);
+        for (int pc = 0; pc < count; ++pc) {
+            const Reinst &inst = prog->start[pc];
+            switch(inst.opcode) {
+            case regexp::I_PLA:
+            case regexp::I_NLA:
+            case regexp::I_REF:
+            case regexp::I_WORD:
+            case regexp::I_NWORD:
+                use_dfa = false;
+                break;
+            case regexp::I_JUMP:
+                preds[inst.x - prog->start].push_back(pc);
+                break;
+            case regexp::I_SPLIT:
+                preds[inst.x - prog->start].push_back(pc);
+                preds[inst.y - prog->start].push_back(pc);
+                break;
+            case regexp::I_LPAR:
+            case regexp::I_RPAR:
+            case regexp::I_BOL:
+            case regexp::I_EOL:
+                preds[pc + 1].push_back(pc);
+                break;
+            default: break;
+            }
+        }
+        // every match starts with the characters on the straight path into
+        // the pattern
+        if (!(prog->flags & regexp::REG_ICASE)) {
+            int pc = PC_GroupStart + 1;
+            for (;;) {
+                const Reinst &inst = prog->start[pc];
+                if ((inst.opcode == regexp::I_LPAR)
+                    || (inst.opcode == regexp::I_RPAR)) {
+                    pc++;
+                } else if ((inst.opcode == regexp::I_CHAR) && inst.c) {
+                    prefix.push_back((char)inst.c);
+                    pc++;
+                } else break;
+            }
+        }
+    }
+
+    ~Regex() {
+        regexp::regfree(prog);
+    }
+
+    bool accepts(const Reinst &inst, int byte) const {
+        // the text is read as regexec reads it, which ends at a zero byte
+        char ch = (char)byte;
+        Rune c;
+        regexp::chartorune(&c, &ch);
+        if (c == 0)
+            return false;
+        bool icase = (prog->flags & regexp::REG_ICASE);
+        switch(inst.opcode) {
+        case regexp::I_ANYNL: return true;
+        case regexp::I_ANY: return !regexp::isnewline(c);
+        case regexp::I_CHAR:
+            return (icase ? regexp::canon(c) : c) == inst.c;
+        case regexp::I_CCLASS:
+            return icase ? regexp::incclasscanon(inst.cc, regexp::canon(c))
+                : regexp::incclass(inst.cc, c);
+        case regexp::I_NCCLASS:
+            return !(icase ? regexp::incclasscanon(inst.cc, regexp::canon(c))
+                : regexp::incclass(inst.cc, c));
+        default: return false;
+        }
+    }
+
+    int target(const Reinst *inst) const {
+        return (int)(inst - prog->start);
+    }
+
+    // adds the threads reachable from pc in priority order; nothing is added
+    // after a thread reaches the end of the pattern, as no later match can be
+    // preferred over it. EOL threads wait for the end of the text.
+    void forward_add(int pc, bool at_begin, bool at_end, DFA::Key &out) {
+        if (cut || seen[pc])
+            return;
+        seen[pc] = 1;
+        const Reinst &inst = prog->start[pc];
+        switch(inst.opcode) {
+        case regexp::I_JUMP:
+            forward_add(target(inst.x), at_begin, at_end, out);
+            break;
+        case regexp::I_SPLIT:
+            forward_add(target(inst.x), at_begin, at_end, out);
+            forward_add(target(inst.y), at_begin, at_end, out);
+            break;
+        case regexp::I_LPAR:
+        case regexp::I_RPAR:
+            forward_add(pc + 1, at_begin, at_end, out);
+            break;
+        case regexp::I_BOL:
+            if (at_begin)
+                forward_add(pc + 1, at_begin, at_end, out);
+            break;
+        case regexp::I_EOL:
+            if (at_end)
+                forward_add(pc + 1, at_begin, at_end, out);
+            else
+                out.push_back(pc);
+            break;
+        case regexp::I_END:
+            out.push_back(pc);
+            cut = true;
+            break;
+        default:
+            out.push_back(pc);
+            break;
+        }
+    }
+
+    void begin_closure() {
+        seen.assign(count, 0);
+        cut = false;
+    }
+
+    bool forward_match(const DFA::Key &key) const {
+        return !key.empty()
+            && (prog->start[key.back()].opcode == regexp::I_END);
+    }
+
+    DFAState *forward_start(bool at_begin) {
+        DFAState *&state = at_begin?forward_begin:forward_rest;
+        if (!state) {
+            DFA::Key key;
+            begin_closure();
+            forward_add(PC_SearchStart, at_begin, false, key);
+            state = forward.intern(key, forward_match(key));
+        }
+        return state;
+    }
+
+    DFAState *forward_step(DFAState *state, int byte) {
+        DFAState *next = state->next[byte];
+        if (next)
+            return next;
+        DFA::Key key;
+        begin_closure();
+        for (int pc : state->insts) {
+            if (cut)
+                break;
+            const Reinst &inst = prog->start[pc];
+            if (consumes(inst) && accepts(inst, byte))
+                forward_add(pc + 1, false, false, key);
+        }
+        next = forward.intern(key, forward_match(key));
+        state->next[byte] = next;
+        return next;
+    }
+
+    // whether state matches once the end of the text is reached
+    bool forward_end(DFAState *state, bool at_begin) {
+        if (state->match)
+            return true;
+        DFA::Key key;
+        begin_closure();
+        for (int pc : state->insts) {
+            if (prog->start[pc].opcode == regexp::I_EOL)
+                forward_add(pc, at_begin, true, key);
+        }
+        return forward_match(key);
+    }
+
+    // adds all instructions from which v is reachable without consuming
+    // input, up to the start of the pattern
+    void reverse_add(int v, bool at_begin, bool at_end, DFA::Key &out) {
+        if (seen[v])
+            return;
+        seen[v] = 1;
+        out.push_back(v);
+        if (v == PC_GroupStart)
+            return;
+        for (int u : preds[v]) {
+            auto op = prog->start[u].opcode;
+            if ((op == regexp::I_BOL) && !at_begin)
+                continue;
+            if ((op == regexp::I_EOL) && !at_end)
+                continue;
+            reverse_add(u, at_begin, at_end, out);
+        }
+    }
+
+    DFAState *reverse_intern(DFA::Key &key) {
+        std::sort(key.begin(), key.end());
+        bool match = std::binary_search(key.begin(), key.end(), (int)PC_GroupStart);
+        return reverse.intern(key, match);
+    }
+
+    DFAState *reverse_start(bool at_begin, bool at_end) {
+        DFA::Key key;
+        begin_closure();
+        reverse_add(group_end, at_begin, at_end, key);
+        return reverse_intern(key);
+    }
+
+    void reverse_step_key(DFAState *state, int byte, bool at_begin, DFA::Key &key) {
+        begin_closure();
+        for (int v : state->insts) {
+            // v is reached through the instruction in front of it if that
+            // one consumes the byte
+            int pc = v - 1;
+            if (pc <= PC_GroupStart)
+                continue;
+            const Reinst &inst = prog->start[pc];
+            if (consumes(inst) && accepts(inst, byte))
+                reverse_add(pc, at_begin, false, key);
+        }
+    }
+
+    DFAState *reverse_step(DFAState *state, int byte) {
+        DFAState *next = state->next[byte];
+        if (next)
+            return next;
+        DFA::Key key;
+        reverse_step_key(state, byte, false, key);
+        next = reverse_intern(key);
+        state->next[byte] = next;
+        return next;
+    }
+
+    // returns the offset at which the pattern occurs next, or n
+    size_t find_prefix(const char *text, size_t p, size_t n) const {
+        size_t len = prefix.size();
+        while ((p + len) <= n) {
+            const char *s = (const char *)memchr(text + p, prefix[0], n - p - len + 1);
+            if (!s)
+                break;
+            p = s - text;
+            if (!memcmp(s, prefix.data(), len))
+                return p;
+            p++;
+        }
+        return n;
+    }
+
+    // returns the end of the leftmost match after offset, -1 if there is
+    // none, or -2 if the DFA ran out of states
+    long forward_search(const char *text, size_t offset, size_t n) {
+        DFAState *idle = forward_start(false);
+        DFAState *state = forward_start(offset == 0);
+        if (!idle || !state)
+            return -2;
+        // in the idle state, no thread is inside the pattern yet
+        bool idle_dead = (idle->insts.size() == 1)
+            && (idle->insts[0] == PC_SearchSkip);
+        long last = state->match ? (long)offset : -1;
+        size_t p = offset;
+        while (p < n) {
+            if (state == idle) {
+                if (idle_dead)
+                    return last;
+                if (!prefix.empty()) {
+                    p = find_prefix(text, p, n);
+                    if (p == n)
+                        return last;
+                }
+            }
+            state = forward_step(state, (uint8_t)text[p]);
+            if (!state)
+                return -2;
+            p++;
+            if (state->insts.empty())
+                return last;
+            if (state->match)
+                last = (long)p;
+        }
+        if (forward_end(state, p == 0))
+            last = (long)n;
+        return last;
+    }
+
+    // returns the start of the longest match that ends at end, or -2 if
+    // the DFA ran out of states
+    long reverse_search(const char *text, size_t offset, size_t end, size_t n) {
+        DFAState *state = reverse_start(end == 0, end == n);
+        if (!state)
+            return -2;
+        long best = state->match ? (long)end : -1;
+        size_t p = end;
+        while (p > offset) {
+            int byte = (uint8_t)text[p - 1];
+            p--;
+            if (p == 0) {
+                // BOL can only be passed here, so this step is not cached
+                DFA::Key key;
+                reverse_step_key(state, byte, true, key);
+                if (std::find(key.begin(), key.end(), (int)PC_GroupStart) != key.end())
+                    best = 0;
+                break;
+            }
+            state = reverse_step(state, byte);
+            if (!state)
+                return -2;
+            if (state->insts.empty())
+                break;
+            if (state->match)
+                best = (long)p;
+        }
+        return best;
+    }
+
+    bool backtrack(const char *text, size_t offset, int &start, int &end) {
+        regexp::Resub sub;
+        sub.nsub = prog->nsub;
+        for (int i = 0; i < regexp::REG_MAXSUB; ++i)
+            sub.sub[i].sp = sub.sub[i].ep = nullptr;
+        if (!regexp::match(prog->start, text + offset, text, prog->flags, &sub))
+            return false;
+        start = (int)(sub.sub[0].sp - text);
+        end = (int)(sub.sub[0].ep - text);
+        return true;
+    }
+
+    bool search(const char *text, size_t offset, size_t n, int &start, int &end) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (use_dfa) {
+            long e = forward_search(text, offset, n);
+            long s = (e >= 0)?reverse_search(text, offset, e, n):-1;
+            if ((e != -2) && (s != -2)) {
+                if (e < 0)
+                    return false;
+                assert(s >= 0);
+                start = (int)s;
+                end = (int)e;
+                return true;
+            }
+            // start over with empty caches next time
+            forward.clear();
+            reverse.clear();
+            forward_begin = forward_rest = nullptr;
+        }
+        if (offset > n)
+            return false;
+        return backtrack(text, offset, start, end);
+    }
+
+    Reprog *prog;
+    int count;
+    // the RPAR that closes group 0
+    int group_end;
+    bool use_dfa;
+    std::string prefix;
+    // the instructions that continue into each one without consuming input
+    std::vector<std::vector<int>> preds;
+
+    std::mutex mutex;
+    DFA forward;
+    DFA reverse;
+    DFAState *forward_begin = nullptr;
+    DFAState *forward_rest = nullptr;
+    // scratch state of the closure functions
+    std::vector<char> seen;
+    bool cut = false;
+};
+
+struct RegexCache {
+    typedef std::pair<const String *, std::shared_ptr<Regex>> Entry;
+
+    std::shared_ptr<Regex> get(const String *pattern, const String *&error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = map.find(pattern);
+        if (it != map.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+        // regcomp keeps its state in a global
+        const char *msg = nullptr;
+        Reprog *prog = regexp::regcomp(pattern->data, 0, &msg);
+        if (msg) {
+            error = String::from_cstr(msg);
+            regexp::regfree(prog);
+            return nullptr;
+        }
+        if (lru.size() >= SCOPES_REGEX_CACHE_SIZE) {
+            map.erase(lru.back().first);
+            lru.pop_back();
+        }
+        lru.push_front({ pattern, std::make_shared<Regex>(prog) });
+        map.insert({ pattern, lru.begin() });
+        return lru.front().second;
+    }
+
+    std::mutex mutex;
+    // most recently used first
+    std::list<Entry> lru;
+    absl::flat_hash_map<const String *, std::list<Entry>::iterator> map;
+};
+
+static RegexCache regex_cache;
+
+} // namespace
+
+bool regex_search(const String *pattern, const String *text, size_t offset,
+    bool &matched, int &start, int &end, const String *&error) {
+    auto re = regex_cache.get(pattern, error);
+    if (!re)
+        return false;
+    start = end = -1;
+    size_t n = strnlen(text->data, text->count);
+    matched = (offset <= n) && re->search(text->data, offset, n, start, end);
+    return true;
+}
+
+} // namespace scopes
@@ -0,0 +1,35 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_REGEX_HPP
+#define SCOPES_REGEX_HPP
+
+#include <stddef.h>
+
+namespace scopes {
+
+struct String;
+
+//------------------------------------------------------------------------------
+// REGULAR EXPRESSIONS
+//------------------------------------------------------------------------------
+
+/* patterns are parsed and compiled by the bundled minilibs matcher. patterns
+   without backreferences, lookaheads and word boundaries are then matched by
+   two lazily built DFAs in time linear in the length of the text: a forward
+   one finds where the leftmost match ends, and a reverse one where it starts.
+   all other patterns fall back to the backtracking matcher. compiled patterns
+   are kept in a bounded LRU cache keyed by the interned pattern string. */
+
+// searches text for the leftmost match of pattern that starts at or after
+// offset, and returns its bounds in start and end, where `^` only matches at
+// the start of text. returns false and sets error if pattern is malformed.
+bool regex_search(const String *pattern, const String *text, size_t offset,
+    bool &matched, int &start, int &end, const String *&error);
+
+} // namespace scopes
+
+#endif // SCOPES_REGEX_HPP
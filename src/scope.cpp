@@ -11,59 +11,390 @@
 #include <algorithm>
 #include "absl/container/flat_hash_set.h"
 #include <cstring>
+#include <stdlib.h>
 
 namespace scopes {
 
 //------------------------------------------------------------------------------
-// SCOPE
+// SCOPE TRIE
 //------------------------------------------------------------------------------
 
-Scope::Scope(const String *_doc, const Scope *_parent) :
-    map(nullptr),
-    index(0),
-    name(ConstRef()),
-    value(ValueRef()),
-    doc(_doc),
-    next(_parent),
-    start(this) {
-    if (!doc && next) {
-        doc = next->header_doc();
+/* each level of a scope keeps its bindings in a persistent hash array mapped
+   trie. binding a name copies only the path from the root to the affected
+   slot, so every scope derived by bind_from shares all other nodes with the
+   scope it was derived from. */
+
+#define SCOPES_TRIE_BITS 5
+#define SCOPES_TRIE_MASK ((1u << SCOPES_TRIE_BITS) - 1)
+
+struct ScopeBinding {
+    ConstRef name;
+    ScopeMapEntry entry;
+    // order in which the binding was made, for iteration
+    size_t stamp;
+    uint64_t hash;
+    // another binding in this slot with the same hash
+    const ScopeBinding *collision;
+};
+
+struct ScopeTrie {
+    // slots that point to a subtrie
+    uint32_t nodemap;
+    // slots that point to a binding
+    uint32_t leafmap;
+
+    int size() const {
+        return __builtin_popcount(nodemap | leafmap);
+    }
+
+    int slot_index(uint32_t bit) const {
+        return __builtin_popcount((nodemap | leafmap) & (bit - 1));
+    }
+
+    const void *const *slots() const {
+        return reinterpret_cast<const void *const *>(this + 1);
+    }
+
+    const void **slots() {
+        return reinterpret_cast<const void **>(this + 1);
+    }
+
+    static ScopeTrie *create(int size) {
+        auto node = (ScopeTrie *)malloc(
+            sizeof(ScopeTrie) + sizeof(const void *) * size);
+        node->nodemap = 0;
+        node->leafmap = 0;
+        return node;
+    }
+
+    // copy of node with the slot for bit pointing to ptr
+    static ScopeTrie *copy_set(const ScopeTrie *node, uint32_t bit,
+        bool leaf, const void *ptr) {
+        bool exists = ((node->nodemap | node->leafmap) & bit);
+        int size = node->size();
+        int index = node->slot_index(bit);
+        auto result = create(size + (exists?0:1));
+        result->nodemap = node->nodemap & ~bit;
+        result->leafmap = node->leafmap & ~bit;
+        if (leaf) {
+            result->leafmap |= bit;
+        } else {
+            result->nodemap |= bit;
+        }
+        auto src = node->slots();
+        auto dst = result->slots();
+        memcpy(dst, src, sizeof(const void *) * index);
+        dst[index] = ptr;
+        int rest = exists?(index + 1):index;
+        memcpy(dst + index + 1, src + rest, sizeof(const void *) * (size - rest));
+        return result;
+    }
+};
+
+static uint64_t scope_mix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool is_symbol_key(const ConstRef &name) {
+    return name.isa<ConstInt>() && (name->get_type() == TYPE_Symbol);
+}
+
+// symbol keys hash by their symbol, so that they can be looked up without
+// their constant
+static uint64_t scope_symbol_hash(Symbol name) {
+    return scope_mix_hash(name.value());
+}
+
+static uint64_t scope_name_hash(const ConstRef &name) {
+    if (is_symbol_key(name))
+        return scope_symbol_hash(Symbol::wrap(name.cast<ConstInt>()->value()));
+    // other keys are interned constants, so their address is their identity
+    return scope_mix_hash((uint64_t)name.unref());
+}
+
+struct ScopeConstKey {
+    const ConstRef &name;
+    bool matches(const ScopeBinding *binding) const {
+        return binding->name == name;
+    }
+};
+
+struct ScopeSymbolKey {
+    Symbol name;
+    bool matches(const ScopeBinding *binding) const {
+        return is_symbol_key(binding->name)
+            && (binding->name.cast<ConstInt>()->value() == name.value());
+    }
+};
+
+template<typename KeyT>
+static const ScopeBinding *trie_find_key(const ScopeTrie *node,
+    const KeyT &key, uint64_t hash) {
+    int shift = 0;
+    while (node) {
+        uint32_t bit = 1u << ((hash >> shift) & SCOPES_TRIE_MASK);
+        if (node->leafmap & bit) {
+            auto binding = (const ScopeBinding *)node->slots()[node->slot_index(bit)];
+            while (binding) {
+                if ((binding->hash == hash) && key.matches(binding))
+                    return binding;
+                binding = binding->collision;
+            }
+            return nullptr;
+        } else if (node->nodemap & bit) {
+            node = (const ScopeTrie *)node->slots()[node->slot_index(bit)];
+            shift += SCOPES_TRIE_BITS;
+        } else {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+static const ScopeBinding *trie_find(const ScopeTrie *node,
+    const ConstRef &name, uint64_t hash) {
+    return trie_find_key(node, ScopeConstKey{name}, hash);
+}
+
+// build a subtrie holding two bindings with different hashes
+static const ScopeTrie *trie_pair(const ScopeBinding *a,
+    const ScopeBinding *b, int shift) {
+    uint32_t ia = (a->hash >> shift) & SCOPES_TRIE_MASK;
+    uint32_t ib = (b->hash >> shift) & SCOPES_TRIE_MASK;
+    if (ia == ib) {
+        auto node = ScopeTrie::create(1);
+        node->nodemap = 1u << ia;
+        node->slots()[0] = trie_pair(a, b, shift + SCOPES_TRIE_BITS);
+        return node;
+    }
+    auto node = ScopeTrie::create(2);
+    node->leafmap = (1u << ia) | (1u << ib);
+    node->slots()[0] = (ia < ib)?a:b;
+    node->slots()[1] = (ia < ib)?b:a;
+    return node;
+}
+
+// returns a new trie with binding added or replacing the binding of the same
+// name; added is set if the name was not bound before.
+static const ScopeTrie *trie_insert(const ScopeTrie *node,
+    ScopeBinding *binding, int shift, bool &added) {
+    if (!node) {
+        added = true;
+        auto result = ScopeTrie::create(1);
+        result->leafmap = 1u << ((binding->hash >> shift) & SCOPES_TRIE_MASK);
+        result->slots()[0] = binding;
+        return result;
+    }
+    uint32_t bit = 1u << ((binding->hash >> shift) & SCOPES_TRIE_MASK);
+    auto slot = node->slots()[node->slot_index(bit)];
+    if (node->leafmap & bit) {
+        auto other = (const ScopeBinding *)slot;
+        if (other->hash != binding->hash) {
+            added = true;
+            return ScopeTrie::copy_set(node, bit, false,
+                trie_pair(other, binding, shift + SCOPES_TRIE_BITS));
+        }
+        // same hash: rebuild the collision chain without the old binding
+        added = true;
+        const ScopeBinding *chain = nullptr;
+        while (other) {
+            if (other->name == binding->name) {
+                added = false;
+            } else {
+                auto copy = new ScopeBinding(*other);
+                copy->collision = chain;
+                chain = copy;
+            }
+            other = other->collision;
+        }
+        binding->collision = chain;
+        return ScopeTrie::copy_set(node, bit, true, binding);
+    } else if (node->nodemap & bit) {
+        return ScopeTrie::copy_set(node, bit, false,
+            trie_insert((const ScopeTrie *)slot, binding,
+                shift + SCOPES_TRIE_BITS, added));
+    }
+    added = true;
+    return ScopeTrie::copy_set(node, bit, true, binding);
+}
+
+template<typename F>
+static void trie_each(const ScopeTrie *node, const F &f) {
+    if (!node)
+        return;
+    int size = node->size();
+    auto slots = node->slots();
+    int index = 0;
+    for (uint32_t i = 0; index < size; ++i) {
+        uint32_t bit = 1u << i;
+        if (node->leafmap & bit) {
+            auto binding = (const ScopeBinding *)slots[index++];
+            while (binding) {
+                f(binding);
+                binding = binding->collision;
+            }
+        } else if (node->nodemap & bit) {
+            trie_each((const ScopeTrie *)slots[index++], f);
+        }
     }
 }
 
-Scope::Scope(const ConstRef &_name, const ValueRef &_value, const String *_doc, const Scope *_next) :
+//------------------------------------------------------------------------------
+// SCOPE NAME INDEX
+//------------------------------------------------------------------------------
+
+/* scopes never change once built, so the set of names visible from a scope
+   is collected once, on the first query for suggestions or completions, and
+   kept for the lifetime of the scope. binding creates a new scope with no
+   index of its own, which merges the names of its level into the index of
+   its parent, so that only the names of the level itself are sorted again.
+   the tree for suggestions is only built once a suggestion is asked for. */
+
+static bool name_less(Symbol a, Symbol b) {
+    auto sa = a.name();
+    auto sb = b.name();
+    int c = memcmp(sa->data, sb->data, std::min(sa->count, sb->count));
+    if (c)
+        return c < 0;
+    return sa->count < sb->count;
+}
+
+struct ScopeNameIndex {
+    // a BK-tree over the levenshtein distance: every child of a node is at
+    // the distance of its edge from the node, so by the triangle inequality
+    // a query at distance d from the node need only visit edges within
+    // d - best and d + best.
+    struct Node {
+        Symbol name;
+        std::vector< std::pair<size_t, int> > children;
+    };
+
+    void insert_node(Symbol name) const {
+        int index = nodes.size();
+        nodes.push_back({ name, {} });
+        if (!index)
+            return;
+        DistanceQuery query(name.name());
+        int node = 0;
+        while (true) {
+            size_t dist = query(nodes[node].name.name());
+            int next = -1;
+            for (auto &&child : nodes[node].children) {
+                if (child.first == dist) {
+                    next = child.second;
+                    break;
+                }
+            }
+            if (next < 0) {
+                nodes[node].children.push_back({ dist, index });
+                break;
+            }
+            node = next;
+        }
+    }
+
+    // all names at the smallest distance from s
+    std::vector<Symbol> closest(const String *s) const {
+        std::vector<Symbol> best_syms;
+        if (nodes.empty()) {
+            for (auto &&name : sorted) {
+                insert_node(name);
+            }
+        }
+        if (nodes.empty())
+            return best_syms;
+        size_t best_dist = (size_t)-1;
+        DistanceQuery query(s);
+        std::vector<int> stack = { 0 };
+        while (!stack.empty()) {
+            auto &&node = nodes[stack.back()];
+            stack.pop_back();
+            size_t dist = query(node.name.name());
+            if (dist == best_dist) {
+                best_syms.push_back(node.name);
+            } else if (dist < best_dist) {
+                best_dist = dist;
+                best_syms = { node.name };
+            }
+            for (auto &&child : node.children) {
+                if ((child.first + best_dist >= dist)
+                    && (child.first <= dist + best_dist)) {
+                    stack.push_back(child.second);
+                }
+            }
+        }
+        return best_syms;
+    }
+
+    // all names that begin with s
+    std::vector<Symbol> with_prefix(const String *s) const {
+        std::vector<Symbol> found;
+        auto it = std::lower_bound(sorted.begin(), sorted.end(), s,
+            [](Symbol sym, const String *s) {
+                auto name = sym.name();
+                int c = memcmp(name->data, s->data,
+                    std::min(name->count, s->count));
+                if (c)
+                    return c < 0;
+                return name->count < s->count;
+            });
+        while (it != sorted.end()) {
+            auto name = it->name();
+            if ((name->count < s->count)
+                || memcmp(name->data, s->data, s->count))
+                break;
+            found.push_back(*it);
+            ++it;
+        }
+        return found;
+    }
+
+    // built from sorted on the first query
+    mutable std::vector<Node> nodes;
+    // all names in lexicographic order
+    std::vector<Symbol> sorted;
+};
+
+//------------------------------------------------------------------------------
+// SCOPE
+//------------------------------------------------------------------------------
+
+Scope::Scope(const String *_doc, const Scope *_parent,
+    const ScopeTrie *_trie, size_t count, size_t _stamp) :
+    trie(_trie),
+    _count(count),
+    stamp(_stamp),
     map(nullptr),
-    name(_name),
-    value(_value),
-    doc(_doc),
-    next(_next) {
-    assert(_name);
-    assert(_next && _next->start);
-    start = _next->start;
-    index = _next->index + 1;
+    name_index(nullptr),
+    _parent(_parent),
+    resolver(nullptr),
+    doc(_doc) {
 }
 
 const Scope *Scope::parent() const {
-    return start->next;
+    return _parent;
 }
 
 const String *Scope::header_doc() const {
-    return start->doc;
-}
-
-bool Scope::is_header() const {
-    return start == this;
+    return doc;
 }
 
 size_t Scope::count() const {
-    return index;
+    if (resolver)
+        return table().count();
+    return _count;
 }
 
 size_t Scope::totalcount() const {
     size_t count = 0;
     const Scope *self = this;
     while (self) {
-        count += self->index;
+        count += self->count();
         self = self->parent();
     }
     return count;
@@ -81,34 +412,35 @@ size_t Scope::levelcount() const {
 
 const Scope::Map &Scope::table() const {
     if (!map) {
+        std::vector<const ScopeBinding *> bindings;
+        bindings.reserve(_count);
+        trie_each(trie, [&](const ScopeBinding *binding) {
+            bindings.push_back(binding);
+        });
+        std::sort(bindings.begin(), bindings.end(),
+            [](const ScopeBinding *a, const ScopeBinding *b) {
+                return a->stamp < b->stamp;
+            });
         auto map = new Map();
-        const Scope *self = this;
-        while (true) {
-            if (self->map) {
-                // copy all elements from map
-                size_t i = self->map->entries.size();
-                while (i-- > 0) {
-                    auto &&entry = self->map->entries[i];
-                    auto &&key = entry.first;
-                    auto &&value = entry.second;
-                    map->insert(key, value);
-                }
-                break;
-            } else if (!self->is_header()) {
-                map->insert(self->name, { self->value, self->doc });
-                self = self->next;
-            } else {
-                break;
+        if (resolver) {
+            // resolved names come first, as if bound when the scope was
+            // created
+            std::vector< std::pair<ConstRef, ScopeMapEntry> > entries;
+            resolver->resolve_all(entries);
+            for (auto &&entry : entries) {
+                if (!trie_find(trie, entry.first, scope_name_hash(entry.first)))
+                    map->insert(entry.first, entry.second);
             }
         }
-        map->flip();
+        for (auto binding : bindings) {
+            map->insert(binding->name, binding->entry);
+        }
         this->map = map;
     }
     return *map;
 }
 
 const Scope *Scope::reparent_from(const Scope *content, const Scope *parent) {
-    auto &&map = content->table();
     // we lose our scopes docstring and instead reuse the parents docstring
     const String *doc = nullptr;
     if (parent) {
@@ -116,133 +448,121 @@ const Scope *Scope::reparent_from(const Scope *content, const Scope *parent) {
     } else {
         doc = content->header_doc();
     }
-    auto self = from(doc, parent);
-    #if 0
-    auto count = map.keys.size();
-    for (size_t i = 0; i < count; ++i) {
-        auto &&key = map.keys[i];
-        auto &&entry = map.values[i];
-        self = bind_from(key, entry.value, entry.doc, self);
-    }
-    #endif
-    // can reuse the map because the content is the same
-    self->map = &map;
-    self->index = map.entries.size();
+    // can share the trie because the content is the same
+    auto self = new Scope(doc, parent,
+        content->trie, content->_count, content->stamp);
+    self->map = content->map;
+    self->resolver = content->resolver;
+    return self;
+}
+
+const Scope *Scope::bind_entry(const ConstRef &name, const ValueRef &value,
+    const String *doc, const Scope *next) {
+    assert(name);
+    auto binding = new ScopeBinding();
+    binding->name = name;
+    binding->entry = { value, doc };
+    binding->stamp = next->stamp;
+    binding->hash = scope_name_hash(name);
+    binding->collision = nullptr;
+    bool added = false;
+    auto trie = trie_insert(next->trie, binding, 0, added);
+    auto self = new Scope(next->doc, next->_parent,
+        trie, next->_count + (added?1:0), next->stamp + 1);
+    self->resolver = next->resolver;
     return self;
 }
 
 const Scope *Scope::bind_from(const ConstRef &name, const ValueRef &value, const String *doc, const Scope *next) {
     assert(value);
-    return new Scope(name, value, doc, next);
+    return bind_entry(name, value, doc, next);
 }
 
 const Scope *Scope::unbind_from(const ConstRef &name, const Scope *next) {
     // check if value is contained
     ValueRef dest;
     if (next->lookup(name, dest)) {
-        return new Scope(name, ValueRef(), nullptr, next);
+        return bind_entry(name, ValueRef(), nullptr, next);
     }
     return next;
 }
 
 const Scope *Scope::from(const String *doc, const Scope *parent) {
-    return new Scope(doc, parent);
+    if (!doc && parent) {
+        doc = parent->header_doc();
+    }
+    return new Scope(doc, parent, nullptr, 0, 0);
 }
 
-std::vector<Symbol> Scope::find_closest_match(Symbol name) const {
-    const String *s = name.name();
-    absl::flat_hash_set<Symbol, Symbol::Hash> done;
-    std::vector<Symbol> best_syms;
-    size_t best_dist = (size_t)-1;
-    const Scope *self = this;
-    do {
-        if (self->map) {
-            size_t count = self->map->entries.size();
-            for (size_t i = 0; i < count; ++i) {
-                auto &&key = self->map->entries[i].first;
-                if (key->get_type() == TYPE_Symbol) {
-                    Symbol sym = Symbol::wrap(key.cast<ConstInt>()->value());
-                    if (!done.count(sym)) {
-                        auto &&value = self->map->entries[i].second;
-                        if (value.value) {
-                            size_t dist = distance(s, sym.name());
-                            if (dist == best_dist) {
-                                best_syms.push_back(sym);
-                            } else if (dist < best_dist) {
-                                best_dist = dist;
-                                best_syms = { sym };
-                            }
-                        }
-                        done.insert(sym);
-                    }
-                }
-            }
-            self = self->start;
-        } else if (!self->is_header()) {
-            auto &&key = self->name;
+const Scope *Scope::lazy_from(const String *doc, const Scope *parent,
+    const ScopeResolver *resolver) {
+    assert(resolver);
+    auto self = const_cast<Scope *>(from(doc, parent));
+    self->resolver = resolver;
+    return self;
+}
+
+const ScopeNameIndex &Scope::names() const {
+    if (!name_index) {
+        auto index = new ScopeNameIndex();
+        // names of the same level are unique
+        std::vector<Symbol> level;
+        absl::flat_hash_set<Symbol, Symbol::Hash> deleted;
+        auto add = [&](const ConstRef &key, const ScopeMapEntry &entry) {
             if (key->get_type() == TYPE_Symbol) {
                 Symbol sym = Symbol::wrap(key.cast<ConstInt>()->value());
-                if (!done.count(sym)) {
-                    if (self->value) {
-                        size_t dist = distance(s, sym.name());
-                        if (dist == best_dist) {
-                            best_syms.push_back(sym);
-                        } else if (dist < best_dist) {
-                            best_dist = dist;
-                            best_syms = { sym };
-                        }
-                    }
-                    done.insert(sym);
+                if (entry.value) {
+                    level.push_back(sym);
+                } else {
+                    deleted.insert(sym);
                 }
             }
+        };
+        if (resolver) {
+            auto &&map = table();
+            for (size_t i = 0; i < map.entries.size(); ++i) {
+                add(map.entries[i].first, map.entries[i].second);
+            }
+        } else {
+            trie_each(trie, [&](const ScopeBinding *binding) {
+                add(binding->name, binding->entry);
+            });
         }
-        self = self->next;
-    } while (self);
+        std::sort(level.begin(), level.end(), name_less);
+        if (_parent) {
+            // deletions hide the name in all parent levels, and names that
+            // the level binds again are only listed once
+            auto &&inherited = _parent->names().sorted;
+            auto &&sorted = index->sorted;
+            sorted.reserve(level.size() + inherited.size());
+            size_t i = 0;
+            for (auto &&name : inherited) {
+                while ((i < level.size()) && name_less(level[i], name)) {
+                    sorted.push_back(level[i++]);
+                }
+                if ((i < level.size()) && (level[i] == name))
+                    continue;
+                if (deleted.count(name))
+                    continue;
+                sorted.push_back(name);
+            }
+            sorted.insert(sorted.end(), level.begin() + i, level.end());
+        } else {
+            index->sorted = std::move(level);
+        }
+        name_index = index;
+    }
+    return *name_index;
+}
+
+std::vector<Symbol> Scope::find_closest_match(Symbol name) const {
+    auto best_syms = names().closest(name.name());
     std::sort(best_syms.begin(), best_syms.end());
     return best_syms;
 }
 
 std::vector<Symbol> Scope::find_elongations(Symbol name) const {
-    const String *s = name.name();
-
-    absl::flat_hash_set<Symbol, Symbol::Hash> done;
-    std::vector<Symbol> found;
-    const Scope *self = this;
-    do {
-        if (self->map) {
-            size_t count = self->map->entries.size();
-            for (size_t i = 0; i < count; ++i) {
-                auto &&key = self->map->entries[i].first;
-                if (key->get_type() == TYPE_Symbol) {
-                    Symbol sym = Symbol::wrap(key.cast<ConstInt>()->value());
-                    if (!done.count(sym)) {
-                        auto &&value = self->map->entries[i].second;
-                        if (value.value) {
-                            if (sym.name()->count >= s->count &&
-                                    (sym.name()->substr(0, s->count) == s))
-                                found.push_back(sym);
-                        }
-                        done.insert(sym);
-                    }
-                }
-            }
-            self = self->start;
-        } else if (!self->is_header()) {
-            auto &&key = self->name;
-            if (key->get_type() == TYPE_Symbol) {
-                Symbol sym = Symbol::wrap(key.cast<ConstInt>()->value());
-                if (!done.count(sym)) {
-                    if (self->value) {
-                        if (sym.name()->count >= s->count &&
-                                (sym.name()->substr(0, s->count) == s))
-                            found.push_back(sym);
-                    }
-                    done.insert(sym);
-                }
-            }
-        }
-        self = self->next;
-    } while (self);
+    auto found = names().with_prefix(name.name());
     std::sort(found.begin(), found.end(),
         [](Symbol a, Symbol b){
             auto a_count = a.name()->count;
@@ -256,54 +576,59 @@ std::vector<Symbol> Scope::find_elongations(Symbol name) const {
     return found;
 }
 
-bool Scope::lookup(const ConstRef &name, ValueRef &dest, const String *&doc, size_t depth) const {
+template<typename KeyT, typename F>
+bool Scope::lookup_key(const KeyT &key, uint64_t hash, ValueRef &dest,
+    const String *&doc, size_t depth, F &&resolve) const {
     const Scope *self = this;
-    const Scope *last_end = this;
-    int iterations = 0;
     do {
-        // compact when we searched too long and retry
-        if (iterations == 16) {
-            self = last_end;
-            self->table();
-            iterations = 0;
+        auto binding = trie_find_key(self->trie, key, hash);
+        if (binding) {
+            // a deletion hides the bindings of all parents
+            if (!binding->entry.value)
+                return false;
+            dest = binding->entry.value;
+            doc = binding->entry.doc;
+            return true;
         }
-        if (self->map) {
-            int i = self->map->find_index(name);
-            if (i != -1) {
-                auto &&value = self->map->entries[i].second;
-                if (value.value) {
-                    dest = value.value;
-                    doc = value.doc;
-                    return true;
-                } else {
-                    return false;
-                }
-            }
-            self = self->start;
-            last_end = self->next;
-            //if (self->parent()) self->parent()->table();
+        ScopeMapEntry entry;
+        if (resolve(self, entry)) {
+            dest = entry.value;
+            doc = entry.doc;
+            return true;
         }
-        if (self->is_header()) {
-            if (!depth)
-                break;
-            depth = depth - 1;
-        } else {
-            iterations++;
-            if (self->name == name) {
-                if (self->value) {
-                    dest = self->value;
-                    doc = self->doc;
-                    return true;
-                } else {
-                    return false;
-                }
-            }
-        }
-        self = self->next;
+        if (!depth)
+            break;
+        depth = depth - 1;
+        self = self->parent();
     } while (self);
     return false;
 }
 
+bool Scope::lookup(const ConstRef &name, ValueRef &dest, const String *&doc, size_t depth) const {
+    return lookup_key(ScopeConstKey{name}, scope_name_hash(name),
+        dest, doc, depth, [&](const Scope *self, ScopeMapEntry &entry) {
+            return self->resolver && self->resolver->resolve(name, entry);
+        });
+}
+
+bool Scope::lookup(Symbol name, ValueRef &dest, const String *&doc, size_t depth) const {
+    return lookup_key(ScopeSymbolKey{name}, scope_symbol_hash(name),
+        dest, doc, depth, [&](const Scope *self, ScopeMapEntry &entry) {
+            // resolvers take constants; lazy scopes are rare
+            return self->resolver
+                && self->resolver->resolve(ConstInt::symbol_from(name), entry);
+        });
+}
+
+bool Scope::lookup(Symbol name, ValueRef &dest, size_t depth) const {
+    const String *doc;
+    return lookup(name, dest, doc, depth);
+}
+
+bool Scope::lookup_local(Symbol name, ValueRef &dest) const {
+    return lookup(name, dest, 0);
+}
+
 bool Scope::lookup(const ConstRef &name, ValueRef &dest, size_t depth) const {
     const String *doc;
     return lookup(name, dest, doc, depth);
@@ -27,26 +27,63 @@ struct ScopeMapEntry {
     const String *doc;
 };
 
+// a node of the persistent hash array mapped trie that holds the bindings of
+// one scope level; defined in scope.cpp
+struct ScopeTrie;
+// all symbols visible from a scope, for suggestions and completion; defined
+// in scope.cpp
+struct ScopeNameIndex;
+
+// supplies the bindings of a scope level on demand. names bound on the level
+// itself take precedence over resolved ones.
+struct ScopeResolver {
+    // looks up a name that the level does not bind; repeated calls must
+    // return the same entry
+    virtual bool resolve(const ConstRef &name, ScopeMapEntry &dest) const = 0;
+    // appends every entry that resolve can return, in iteration order
+    virtual void resolve_all(
+        std::vector< std::pair<ConstRef, ScopeMapEntry> > &dest) const = 0;
+};
+
 struct Scope {
 public:
     typedef OrderedMap<ConstRef, ScopeMapEntry, ConstRef::Hash> Map;
 
 protected:
-    Scope(const ConstRef &name, const ValueRef &value, const String *doc, const Scope *next);
-    Scope(const String *doc, const Scope *parent);
-
+    Scope(const String *doc, const Scope *parent,
+        const ScopeTrie *trie, size_t count, size_t stamp);
+
+    // bindings and deletions of this level, shared with the scope this one
+    // was derived from
+    const ScopeTrie *trie;
+    // number of names in trie
+    size_t _count;
+    // order of the next binding
+    size_t stamp;
+    // iteration table, built on demand
     mutable const Map *map;
-    mutable size_t index;
+    // name index, built on demand
+    mutable const ScopeNameIndex *name_index;
+    const Scope *_parent;
+    // supplies names that the trie does not bind, if any
+    const ScopeResolver *resolver;
+
+    // a null value records a deletion
+    static const Scope *bind_entry(const ConstRef &name, const ValueRef &value,
+        const String *doc, const Scope *next);
+
+    const ScopeNameIndex &names() const;
+
+    // lookup with the key type of the trie search; resolve asks the
+    // resolver of a level, if it has one
+    template<typename KeyT, typename F>
+    bool lookup_key(const KeyT &key, uint64_t hash, ValueRef &dest,
+        const String *&doc, size_t depth, F &&resolve) const;
 public:
-    ConstRef name;
-    ValueRef value;
     const String *doc;
-    const Scope *next;
-    const Scope *start;
 
     const Scope *parent() const;
     const String *header_doc() const;
-    bool is_header() const;
 
     size_t count() const;
 
@@ -66,12 +103,20 @@ public:
 
     bool lookup_local(const ConstRef &name, ValueRef &dest) const;
 
+    // as above, for symbol keys; doesn't need the constant of name
+    bool lookup(Symbol name, ValueRef &dest, const String *&doc, size_t depth = -1) const;
+    bool lookup(Symbol name, ValueRef &dest, size_t depth = -1) const;
+    bool lookup_local(Symbol name, ValueRef &dest) const;
+
     StyledStream &stream(StyledStream &ss) const;
 
     static const Scope *reparent_from(const Scope *content, const Scope *parent);
     static const Scope *bind_from(const ConstRef &name, const ValueRef &value, const String *doc, const Scope *next);
     static const Scope *unbind_from(const ConstRef &name, const Scope *next);
     static const Scope *from(const String *doc, const Scope *parent);
+    // an empty scope whose names are supplied by resolver
+    static const Scope *lazy_from(const String *doc, const Scope *parent,
+        const ScopeResolver *resolver);
 };
 
 } // namespace scopes
@@ -0,0 +1,521 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "server.hpp"
+#include "thread_pool.hpp"
+#include "error.hpp"
+#include "scopes/config.h"
+
+#include "scopes/scopes.h"
+
+#ifndef SCOPES_WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef SCOPES_WIN32
+extern char **environ;
+#endif
+
+#define SCOPES_SERVER_MAGIC 0x53435352 // "SCSR"
+// the status a server answers with when the client must run locally
+#define SCOPES_SERVER_REFUSED -1
+
+namespace scopes {
+
+#ifdef SCOPES_WIN32
+
+bool forward_to_server(int argc, char *argv[], int &status) {
+    return false;
+}
+
+SCOPES_RESULT(void) serve_requests(const char *path) {
+    SCOPES_RESULT_TYPE(void);
+    SCOPES_ERROR(ServerUnavailable, path, "not supported on windows");
+}
+
+#else
+
+namespace {
+
+/* a request consists of the header, sent along with the descriptors of
+   stdin, stdout and stderr, and the strings it counts, each terminated by a
+   zero: the build date, the working directory, the arguments and the
+   environment. the server answers with a single int32, which is either the
+   exit status of the child or SCOPES_SERVER_REFUSED. until the answer
+   arrives, the client sends the numbers of the signals it receives, one
+   byte each. */
+struct RequestHeader {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t size;
+};
+
+static const int forwarded_signals[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT };
+static const int num_forwarded_signals =
+    sizeof(forwarded_signals) / sizeof(forwarded_signals[0]);
+
+static bool is_forwarded_signal(int sig) {
+    for (int i = 0; i < num_forwarded_signals; ++i) {
+        if (forwarded_signals[i] == sig)
+            return true;
+    }
+    return false;
+}
+
+static void set_cloexec(int fd) {
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+// whether the process at the other end of conn runs as this user
+static bool is_same_user(int conn) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t size = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &size) < 0)
+        return false;
+    return cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(conn, &uid, &gid) < 0)
+        return false;
+    return uid == getuid();
+#endif
+}
+
+static bool write_all(int fd, const void *data, size_t size) {
+    auto ptr = (const char *)data;
+    while (size) {
+        auto result = write(fd, ptr, size);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        ptr += result;
+        size -= result;
+    }
+    return true;
+}
+
+// returns false at the end of the stream
+static bool read_all(int fd, void *data, size_t size) {
+    auto ptr = (char *)data;
+    while (size) {
+        auto result = read(fd, ptr, size);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (result == 0)
+            return false;
+        ptr += result;
+        size -= result;
+    }
+    return true;
+}
+
+static bool init_address(sockaddr_un &addr, const char *path) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// CLIENT
+//------------------------------------------------------------------------------
+
+static int server_conn = -1;
+
+static void forward_signal(int sig) {
+    char c = (char)sig;
+    // nothing can be done about a failed write from a handler
+    if (write(server_conn, &c, 1) < 0) {}
+}
+
+static int connect_server(const char *path) {
+    sockaddr_un addr;
+    if (!init_address(addr, path))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    set_cloexec(fd);
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_request(int fd, int argc, char *argv[]) {
+    std::string payload;
+    auto append = [&](const char *s) {
+        payload.append(s);
+        payload.push_back(0);
+    };
+    append(scopes_compile_time_date());
+    char *cwd = get_current_dir_name();
+    if (!cwd)
+        return false;
+    append(cwd);
+    free(cwd);
+    for (int i = 0; i < argc; ++i) {
+        append(argv[i]);
+    }
+    uint32_t envc = 0;
+    for (char **env = environ; *env; ++env) {
+        append(*env);
+        envc++;
+    }
+    if (payload.size() > SCOPES_SERVER_MAX_REQUEST_SIZE)
+        return false;
+
+    RequestHeader header;
+    header.magic = SCOPES_SERVER_MAGIC;
+    header.argc = argc;
+    header.envc = envc;
+    header.size = payload.size();
+
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    while (true) {
+        auto result = sendmsg(fd, &msg, 0);
+        if (result == (ssize_t)sizeof(header))
+            break;
+        if ((result < 0) && (errno == EINTR))
+            continue;
+        return false;
+    }
+    return write_all(fd, payload.data(), payload.size());
+}
+
+//------------------------------------------------------------------------------
+// SERVER
+//------------------------------------------------------------------------------
+
+struct Request {
+    // argv and env point into the payload
+    std::vector<char> payload;
+    const char *build;
+    const char *cwd;
+    std::vector<char *> argv;
+    std::vector<char *> env;
+    int fds[3];
+
+    Request() {
+        fds[0] = fds[1] = fds[2] = -1;
+    }
+
+    void close_fds() {
+        for (int i = 0; i < 3; ++i) {
+            if (fds[i] >= 0)
+                close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+};
+
+static bool receive_request(int conn, Request &req) {
+    RequestHeader header;
+    int fds[3];
+    char control[CMSG_SPACE(sizeof(fds))];
+    iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t result;
+    do {
+        result = recvmsg(conn, &msg, 0);
+    } while ((result < 0) && (errno == EINTR));
+    cmsghdr *cmsg = (result > 0)?CMSG_FIRSTHDR(&msg):nullptr;
+    if (cmsg && (cmsg->cmsg_level == SOL_SOCKET)
+        && (cmsg->cmsg_type == SCM_RIGHTS)) {
+        int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int received[3];
+        memcpy(received, CMSG_DATA(cmsg), std::min(count, 3) * sizeof(int));
+        for (int i = 0; i < std::min(count, 3); ++i) {
+            req.fds[i] = received[i];
+            set_cloexec(received[i]);
+        }
+        if (count != 3)
+            return false;
+    } else {
+        return false;
+    }
+    if ((result != (ssize_t)sizeof(header))
+        || (header.magic != SCOPES_SERVER_MAGIC)
+        || (header.size > SCOPES_SERVER_MAX_REQUEST_SIZE))
+        return false;
+
+    req.payload.resize(header.size);
+    if (!read_all(conn, req.payload.data(), header.size))
+        return false;
+    std::vector<char *> strings;
+    size_t start = 0;
+    for (size_t i = 0; i < req.payload.size(); ++i) {
+        if (req.payload[i] == 0) {
+            strings.push_back(req.payload.data() + start);
+            start = i + 1;
+        }
+    }
+    if (strings.size() != (size_t)header.argc + header.envc + 2)
+        return false;
+    req.build = strings[0];
+    req.cwd = strings[1];
+    auto args = strings.begin() + 2;
+    req.argv.assign(args, args + header.argc);
+    req.argv.push_back(nullptr);
+    req.env.assign(args + header.argc, strings.end());
+    req.env.push_back(nullptr);
+    return true;
+}
+
+static void send_status(int conn, int32_t status) {
+    write_all(conn, &status, sizeof(status));
+}
+
+// the child can't be reaped before a signal for it is sent, or the signal
+// could reach another process that reuses its id
+struct Worker {
+    pid_t pid;
+    int conn;
+    std::mutex mutex;
+    bool exited = false;
+};
+
+static void forward_signals(Worker *w) {
+    while (true) {
+        unsigned char sig;
+        auto result = read(w->conn, &sig, 1);
+        if ((result < 0) && (errno == EINTR))
+            continue;
+        std::lock_guard<std::mutex> lock(w->mutex);
+        if (w->exited)
+            return;
+        if (result <= 0) {
+            // nobody is left to answer to
+            kill(w->pid, SIGKILL);
+            return;
+        }
+        if (is_forwarded_signal(sig)) {
+            kill(w->pid, sig);
+        }
+    }
+}
+
+static void supervise(pid_t pid, int conn) {
+    Worker w;
+    w.pid = pid;
+    w.conn = conn;
+    std::thread forwarder(forward_signals, &w);
+    siginfo_t info;
+    while ((waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0)
+        && (errno == EINTR)) {}
+    {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.exited = true;
+    }
+    int status = 0;
+    while ((waitpid(pid, &status, 0) < 0) && (errno == EINTR)) {}
+    int32_t code = 1;
+    if (WIFEXITED(status)) {
+        code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        code = 128 + WTERMSIG(status);
+    }
+    send_status(conn, code);
+    // ends the forwarder
+    shutdown(conn, SHUT_RDWR);
+    forwarder.join();
+    close(conn);
+}
+
+// called in the child
+static void take_over(Request &req) {
+    signal(SIGPIPE, SIG_DFL);
+    for (int i = 0; i < 3; ++i) {
+        dup2(req.fds[i], i);
+        close(req.fds[i]);
+    }
+    if (chdir(req.cwd) < 0) {
+        fprintf(stderr, "compile server: can't enter %s: %s\n",
+            req.cwd, strerror(errno));
+        exit(1);
+    }
+    scopes_working_dir = req.cwd;
+    environ = req.env.data();
+    scopes_argc = req.argv.size() - 1;
+    scopes_argv = req.argv.data();
+    thread_pool_restart();
+}
+
+} // namespace
+
+bool forward_to_server(int argc, char *argv[], int &status) {
+    const char *path = getenv("SCOPES_SERVER");
+    if (!path || !*path)
+        return false;
+    if ((argc > 1) && !strcmp(argv[1], "--server"))
+        return false;
+    int fd = connect_server(path);
+    if (fd < 0)
+        return false;
+    if (!send_request(fd, argc, argv)) {
+        close(fd);
+        return false;
+    }
+    server_conn = fd;
+    struct sigaction action, previous[num_forwarded_signals];
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = forward_signal;
+    sigemptyset(&action.sa_mask);
+    for (int i = 0; i < num_forwarded_signals; ++i) {
+        sigaction(forwarded_signals[i], &action, &previous[i]);
+    }
+    int32_t code;
+    bool answered = read_all(fd, &code, sizeof(code));
+    for (int i = 0; i < num_forwarded_signals; ++i) {
+        sigaction(forwarded_signals[i], &previous[i], nullptr);
+    }
+    close(fd);
+    server_conn = -1;
+    if (!answered) {
+        // the command may have done part of its work already
+        fprintf(stderr, "lost connection to compile server at %s\n", path);
+        status = 1;
+        return true;
+    }
+    if (code == SCOPES_SERVER_REFUSED)
+        return false;
+    status = code;
+    return true;
+}
+
+SCOPES_RESULT(void) serve_requests(const char *path) {
+    SCOPES_RESULT_TYPE(void);
+    sockaddr_un addr;
+    if (!init_address(addr, path)) {
+        SCOPES_ERROR(ServerUnavailable, path, strerror(ENAMETOOLONG));
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        SCOPES_ERROR(ServerUnavailable, path, strerror(errno));
+    }
+    set_cloexec(listener);
+    // a socket left behind by a server that is gone
+    unlink(path);
+    // whoever can connect runs code as this user, so the socket is created
+    // accessible to this user only, rather than changed after the fact
+    mode_t mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    int bound = bind(listener, (const sockaddr *)&addr, sizeof(addr));
+    int bind_err = errno;
+    umask(mask);
+    errno = bind_err;
+    if ((bound < 0)
+        || (listen(listener, SCOPES_SERVER_BACKLOG) < 0)) {
+        int err = errno;
+        close(listener);
+        SCOPES_ERROR(ServerUnavailable, path, strerror(err));
+    }
+    // clients that hang up must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+    while (true) {
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED))
+                continue;
+            int err = errno;
+            close(listener);
+            SCOPES_ERROR(ServerUnavailable, path, strerror(err));
+        }
+        set_cloexec(conn);
+        // the permissions of the socket may have been changed since
+        if (!is_same_user(conn)) {
+            close(conn);
+            continue;
+        }
+        auto req = new Request();
+        if (!receive_request(conn, *req)) {
+            req->close_fds();
+            delete req;
+            close(conn);
+            continue;
+        }
+        if (strcmp(req->build, scopes_compile_time_date())) {
+            send_status(conn, SCOPES_SERVER_REFUSED);
+            req->close_fds();
+            delete req;
+            close(conn);
+            continue;
+        }
+        // or buffered output would be written by both processes
+        fflush(nullptr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            close(conn);
+            // the request stays alive, as the arguments and the environment
+            // point into it
+            take_over(*req);
+            return {};
+        }
+        req->close_fds();
+        delete req;
+        if (pid < 0) {
+            send_status(conn, SCOPES_SERVER_REFUSED);
+            close(conn);
+            continue;
+        }
+        std::thread(supervise, pid, conn).detach();
+    }
+}
+
+#endif
+
+} // namespace scopes
@@ -0,0 +1,37 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_SERVER_HPP
+#define SCOPES_SERVER_HPP
+
+#include "result.hpp"
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// COMPILE SERVER
+//------------------------------------------------------------------------------
+
+/* a compile server keeps a booted compiler resident and answers every
+   request from a child process forked off the booted state, which runs the
+   command line of the client as if the client had booted itself. the client
+   passes its arguments, environment, working directory and standard streams
+   along, forwards the signals it is sent, and exits with the status of the
+   child. requests are only answered for clients of the same build. */
+
+// if the environment variable SCOPES_SERVER names the socket of a running
+// compile server, runs the command line there, stores the exit status and
+// returns true; returns false if the command line must run locally
+bool forward_to_server(int argc, char *argv[], int &status);
+
+// listens at the unix socket path and forks a child for every request; never
+// returns in the server, but returns in every child once it has taken over
+// the command line, environment and streams of its client
+SCOPES_RESULT(void) serve_requests(const char *path);
+
+} // namespace scopes
+
+#endif // SCOPES_SERVER_HPP
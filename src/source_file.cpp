@@ -22,10 +22,16 @@
 #endif
 
 #include "source_file.hpp"
+#include "hash.hpp"
+#include "scopes/config.h"
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <assert.h>
 #include <memory.h>
+#include <algorithm>
+#include <list>
+#include <mutex>
 
 #pragma GCC diagnostic ignored "-Wvla-extension"
 
@@ -36,8 +42,8 @@ namespace scopes {
 //------------------------------------------------------------------------------
 
 SourceFile::SourceFile(Symbol _path) :
+    stamp(0),
     path(_path),
-    fd(-1),
     length(0),
     ptr(MAP_FAILED),
     _str(nullptr) {
@@ -54,15 +60,11 @@ void SourceFile::close() {
             ptr = MAP_FAILED;
             length = 0;
         }
-        if (fd >= 0) {
-            ::CLOSE_FD(fd);
-            fd = -1;
-        }
     }
 }
 
 bool SourceFile::is_open() {
-    return fd != -1;
+    return ptr != MAP_FAILED;
 }
 
 const char *SourceFile::strptr() {
@@ -72,23 +74,24 @@ const char *SourceFile::strptr() {
 
 std::unique_ptr<SourceFile> SourceFile::from_file(Symbol _path) {
     auto file = std::unique_ptr<SourceFile>(new SourceFile(_path));
-    file->fd = ::OPEN_FD(_path.name()->data, O_RDONLY);
-    if (file->fd >= 0) {
-        file->length = LSEEK(file->fd, 0, SEEK_END);
-        if (file->length) {
-            file->ptr = mmap(nullptr,
-                file->length, PROT_READ, MAP_PRIVATE, file->fd, 0);
-            if (file->ptr != MAP_FAILED) {
-                return file;
-            }
-        } else {
-            file->ptr = nullptr;
-            file->_str = Symbol(SYM_Unnamed).name();
-            return file;
-        }
+    int fd = ::OPEN_FD(_path.name()->data, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    file->length = LSEEK(fd, 0, SEEK_END);
+    if (file->length) {
+        file->ptr = mmap(nullptr,
+            file->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    } else {
+        file->ptr = nullptr;
+        file->_str = Symbol(SYM_Unnamed).name();
+    }
+    // the mapping stays valid without the descriptor
+    ::CLOSE_FD(fd);
+    if (file->ptr == MAP_FAILED) {
+        file->length = 0;
+        return nullptr;
     }
-    file->close();
-    return nullptr;
+    return file;
 }
 
 std::unique_ptr<SourceFile> SourceFile::from_string(Symbol _path, const String *str) {
@@ -104,6 +107,18 @@ size_t SourceFile::size() const {
     return length;
 }
 
+const std::vector<int> &SourceFile::line_starts() {
+    if (lines.empty()) {
+        auto str = strptr();
+        lines.push_back(0);
+        for (int i = 0; i < length; ++i) {
+            if (str[i] == '\n')
+                lines.push_back(i + 1);
+        }
+    }
+    return lines;
+}
+
 StyledStream &SourceFile::stream_buffer(StyledStream &ost, int offset,
     const char *str, int length, const char *indent) {
     if (offset >= length) {
@@ -121,18 +136,23 @@ StyledStream &SourceFile::stream_buffer(StyledStream &ost, int offset,
         }
         start = start - 1;
     }
-    while (start < offset) {
-        if (!isspace(str[start])) {
-            break;
-        }
-        start = start + 1;
-    }
     while (send < length) {
         if (str[send] == '\n') {
             break;
         }
         send = send + 1;
     }
+    return stream_line(ost, offset, str, start, send, indent);
+}
+
+StyledStream &SourceFile::stream_line(StyledStream &ost, int offset,
+    const char *str, int start, int send, const char *indent) {
+    while (start < offset) {
+        if (!isspace(str[start])) {
+            break;
+        }
+        start = start + 1;
+    }
     auto linelen = send - start;
     char line[linelen + 1];
     memcpy(line, str + start, linelen);
@@ -151,7 +171,75 @@ StyledStream &SourceFile::stream_buffer(StyledStream &ost, int offset,
 
 StyledStream &SourceFile::stream(StyledStream &ost, int offset,
     const char *indent) {
-    return stream_buffer(ost, offset, strptr(), length, indent);
+    if (offset >= length)
+        return ost;
+    auto &&starts = line_starts();
+    auto it = std::upper_bound(starts.begin(), starts.end(), offset);
+    int start = *(it - 1);
+    int send = (it == starts.end())?length:(*it - 1);
+    return stream_line(ost, offset, strptr(), start, send, indent);
+}
+
+static uint64_t file_stamp(Symbol path) {
+    struct stat s;
+    if (stat(path.name()->data, &s) != 0)
+        return 0;
+    return hash2((uint64_t)s.st_mtime, (uint64_t)s.st_size);
+}
+
+// keyed by the buffer, or by the name of the path for files
+typedef std::pair<const String *, std::unique_ptr<SourceFile>> SourceCacheEntry;
+static std::mutex source_cache_mutex;
+// most recently used first
+static std::list<SourceCacheEntry> source_cache_lru;
+static absl::flat_hash_map<const String *, std::list<SourceCacheEntry>::iterator>
+    source_cache;
+
+// the caller holds the source cache mutex
+static SourceFile *cache_source(const String *key,
+    std::unique_ptr<SourceFile> file) {
+    if (source_cache_lru.size() >= SCOPES_SOURCE_CACHE_SIZE) {
+        source_cache.erase(source_cache_lru.back().first);
+        source_cache_lru.pop_back();
+    }
+    source_cache_lru.push_front({ key, std::move(file) });
+    source_cache.insert({ key, source_cache_lru.begin() });
+    return source_cache_lru.front().second.get();
+}
+
+StyledStream &SourceFile::stream_source(StyledStream &ost, Symbol path,
+    const String *buffer, int offset, const char *indent) {
+    std::lock_guard<std::mutex> lock(source_cache_mutex);
+    auto key = buffer?buffer:path.name();
+    auto it = source_cache.find(key);
+    if (it != source_cache.end()) {
+        source_cache_lru.splice(source_cache_lru.begin(), source_cache_lru,
+            it->second);
+    }
+    SourceFile *file = nullptr;
+    if (buffer) {
+        if (it != source_cache.end()) {
+            file = it->second->second.get();
+        } else {
+            file = cache_source(key, from_string(path, buffer));
+        }
+    } else {
+        uint64_t stamp = file_stamp(path);
+        if ((it != source_cache.end()) && (it->second->second->stamp == stamp)) {
+            file = it->second->second.get();
+        } else {
+            if (it != source_cache.end()) {
+                source_cache_lru.erase(it->second);
+                source_cache.erase(it);
+            }
+            auto newfile = from_file(path);
+            if (!newfile)
+                return ost;
+            newfile->stamp = stamp;
+            file = cache_source(key, std::move(newfile));
+        }
+    }
+    return file->stream(ost, offset, indent);
 }
 
 } // namespace scopes
@@ -11,6 +11,8 @@
 
 #include "absl/container/flat_hash_map.h"
 
+#include <vector>
+
 namespace scopes {
 
 //------------------------------------------------------------------------------
@@ -23,10 +25,19 @@ protected:
 
     void close();
 
+    // offsets at which lines begin, collected on first use
+    std::vector<int> lines;
+    // hash of the modification time and size of the file when it was opened
+    uint64_t stamp;
+
+    const std::vector<int> &line_starts();
+
+    static StyledStream &stream_line(StyledStream &ost, int offset,
+        const char *str, int start, int end, const char *indent);
+
 public:
     ~SourceFile();
     Symbol path;
-    int fd;
     int length;
     void *ptr;
     const String *_str;
@@ -45,6 +56,12 @@ public:
         const char *str, int length, const char *indent = "    ");
     StyledStream &stream(StyledStream &ost, int offset,
         const char *indent = "    ");
+
+    // streams the line at offset of the file at path, or of buffer if it
+    // isn't null; files and buffers are opened and indexed once, and files
+    // again once they have changed
+    static StyledStream &stream_source(StyledStream &ost, Symbol path,
+        const String *buffer, int offset, const char *indent = "    ");
 };
 
 } // namespace scopes
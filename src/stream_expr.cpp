@@ -465,10 +465,9 @@ HANDLER(ConstAggregate) {
         }
         return ValueRef(_anchor, ConstPointer::list_from(l));
     } else if (T == TYPE_ValueRef) {
-        auto val = (Value *)cast<ConstPointer>(node->values[0])->value;
+        auto val = node->ast_value();
         if (val) {
-            auto loc = (const Anchor *)cast<ConstPointer>(node->values[1])->value;
-            return LIST(SYMBOL(KW_ASTQuote), ref(loc, val));
+            return LIST(SYMBOL(KW_ASTQuote), val);
         }
     }
     return node;
@@ -836,7 +835,15 @@ void walk(const ValueRef &_e, const StreamExprFormat &fmt) {
         } break;
         case VK_ConstString: {
             auto val = e.cast<ConstString>();
-            ss << val->value;
+            auto AT = dyn_cast<ArrayType>(strip_qualifiers(val->get_type()));
+            if (AT && (AT->element_type != TYPE_Char)) {
+                // blobs are too large to print
+                ss << Style_Operator << "<" << Style_None << "blob "
+                    << Style_Number << val->value->count << Style_None
+                    << " bytes" << Style_Operator << ">" << Style_None;
+            } else {
+                ss << val->value;
+            }
         } break;
         case VK_ConstPointer: {
             auto val = e.cast<ConstPointer>();
@@ -890,6 +897,22 @@ void stream(const ValueRef &node) {
     walk(e, fmt);
 }
 
+// the tree of lists that walk() goes through for node, fully converted
+ValueRef expand(const ValueRef &node) {
+    ValueRef e = convert(node);
+    if (!e || !is_list(e))
+        return e;
+    visited.insert(e.unref());
+    auto it = extract_list_constant(e.cast<TypedValue>()).assert_ok();
+    std::vector<ValueRef> values;
+    while (it != EOL) {
+        values.push_back(expand(it->at));
+        it = it->next;
+    }
+    return ref(e.anchor(), ConstPointer::list_from(
+        List::from(values.data(), values.size())));
+}
+
 }; // struct StreamExpr
 
 //------------------------------------------------------------------------------
@@ -920,6 +943,16 @@ void stream_value(StyledStream &_ss, const ValueRef &value, const StreamValueFor
     _refcount--;
 }
 
+ValueRef convert_expr(const ValueRef &value) {
+    assert(!_refcount);
+    _refcount++;
+    StyledString ss = StyledString::plain();
+    StreamExpr converter(ss.out, StreamExprFormat());
+    auto result = converter.expand(value);
+    _refcount--;
+    return result;
+}
+
 //------------------------------------------------------------------------------
 
 bool is_default_suffix(const Type *T) {
@@ -68,6 +68,8 @@ void stream_list(
     StyledStream &_ss, const List *l, const StreamListFormat &_fmt = StreamListFormat());
 void stream_value(
     StyledStream &_ss, const ValueRef &value, const StreamValueFormat &_fmt = StreamValueFormat());
+// returns the tree of constant lists that stream_value() prints for value
+ValueRef convert_expr(const ValueRef &value);
 bool is_default_suffix(const Type *T);
 
 } // namespace scopes
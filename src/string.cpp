@@ -9,6 +9,8 @@
 #include "utils.hpp"
 #include "hash.hpp"
 #include "alloc.hpp"
+#include "intern.hpp"
+#include "timer.hpp"
 
 #define STB_SPRINTF_DECORATE(name) stb_##name
 #define STB_SPRINTF_NOUNALIGNED
@@ -20,7 +22,6 @@
 
 #include <locale>
 #include <codecvt>
-#include "absl/container/flat_hash_set.h"
 
 #pragma GCC diagnostic ignored "-Wvla-extension"
 
@@ -217,7 +218,7 @@ int escape_string(char *buf, const char *str, int strcount, const char *quote_ch
 // STRING
 //------------------------------------------------------------------------------
 
-static absl::flat_hash_set<const String *, String::Hash, String::KeyEqual> string_map;
+static InternSet<const String *, String::Hash, String::KeyEqual> string_map;
 
 //------------------------------------------------------------------------------
 
@@ -234,29 +235,43 @@ bool String::KeyEqual::operator()( const String *lhs, const String *rhs ) const
 
 //------------------------------------------------------------------------------
 
-static GreedyAlloc<&track> string_pool;
+// one pool per thread; pools are never freed, as other threads may be
+// holding strings from it
+static thread_local GreedyAlloc<&track> *string_pool = nullptr;
+// bytes taken from all string pools
+static std::atomic<uint64_t> string_pool_bytes(0);
+
+static MemoryStat strings_memory("strings", [](MemoryUsage &usage) {
+    string_map.measure(usage.objects, usage.bytes);
+    usage.bytes += usage.objects * sizeof(String)
+        + string_pool_bytes.load(std::memory_order_relaxed);
+});
 
 std::size_t String::hash() const {
-    return hash_bytes(data, count);
+    return _hash;
 }
 
-String::String(const char *_data, size_t _count)
-    : data(_data), count(_count) {}
+String::String(const char *_data, size_t _count, std::size_t hash)
+    : data(_data), count(_count), _hash(hash) {}
 
 const String *String::from(const char *buf, size_t count) {
-    String key(buf, count);
-    auto it = string_map.find(&key);
-    if (it != string_map.end()) {
-        return *it;
-    }
-    //char *s = (char *)tracked_malloc(sizeof(char) * (count + 1));
-    char* s = (char *)string_pool.alloc(sizeof(char) * (count + 1));
-
-    memcpy(s, buf, count * sizeof(char));
-    s[count] = 0;
-    const String *str = new String(s, count);
-    string_map.insert(str);
-    return str;
+    return from(buf, count, hash_bytes(buf, count));
+}
+
+const String *String::from(const char *buf, size_t count, std::size_t hash) {
+    String key(buf, count, hash);
+    return string_map.intern(&key, [&]() {
+        if (!string_pool) {
+            string_pool = new GreedyAlloc<&track>();
+        }
+        //char *s = (char *)tracked_malloc(sizeof(char) * (count + 1));
+        char* s = (char *)string_pool->alloc(sizeof(char) * (count + 1));
+        string_pool_bytes.fetch_add(count + 1, std::memory_order_relaxed);
+
+        memcpy(s, buf, count * sizeof(char));
+        s[count] = 0;
+        return (const String *)new String(s, count, hash);
+    });
 }
 
 const String *String::from_cstr(const char *s) {
@@ -284,6 +299,22 @@ const String *String::join(const String *a, const String *b) {
     return result;
 }
 
+const String *String::join_many(const String *const *strings, size_t count) {
+    size_t cc = 0;
+    for (size_t i = 0; i < count; ++i) {
+        cc += strings[i]->count;
+    }
+    SCOPES_BEGIN_TEMP_STRING(tmp, cc);
+    char *dest = tmp;
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(dest, strings[i]->data, sizeof(char) * strings[i]->count);
+        dest += strings[i]->count;
+    }
+    const String *result = String::from(tmp, cc);
+    SCOPES_END_TEMP_STRING(tmp);
+    return result;
+}
+
 const String *String::from_stdstring(const std::string &s) {
     return from(s.c_str(), s.size());
 }
@@ -319,11 +350,13 @@ StyledStream& operator<<(StyledStream& ost, const String *s) {
 //------------------------------------------------------------------------------
 
 StyledString::StyledString() :
-    out(_ss) {
+    _os(&_buf),
+    out(_os) {
 }
 
 StyledString::StyledString(StreamStyleFunction ssf) :
-    out(_ss, ssf) {
+    _os(&_buf),
+    out(_os, ssf) {
 }
 
 StyledString StyledString::plain() {
@@ -331,11 +364,15 @@ StyledString StyledString::plain() {
 }
 
 const String *StyledString::str() const {
-    return String::from_stdstring(_ss.str());
+#if SCOPES_USE_WCHAR
+    return String::from_stdstring(cppstr());
+#else
+    return String::from(_buf.data(), _buf.size());
+#endif
 }
 
 CppString StyledString::cppstr() const {
-    return _ss.str();
+    return CppString(_buf.data(), _buf.size());
 }
 
 //------------------------------------------------------------------------------
@@ -360,8 +397,71 @@ const String *format( const char *fmt, ...) {
     return result;
 }
 
+// Myers' bit-vector algorithm in Hyyrö's formulation for the levenshtein
+// distance; bit i of the vertical delta vectors covers row i + 1 of the
+// dynamic programming matrix, so the whole column of a pattern of up to 64
+// characters is advanced at once.
+static size_t distance_bitparallel(const uint64_t *peq, size_t m,
+    const char *t, size_t n) {
+    const uint64_t high = 1ull << (m - 1);
+    uint64_t pv = ~0ull;
+    uint64_t mv = 0;
+    size_t score = m;
+    for (size_t j = 0; j < n; ++j) {
+        uint64_t eq = peq[(unsigned char)t[j]];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & high) {
+            score++;
+        } else if (mh & high) {
+            score--;
+        }
+        // the top row of the matrix grows by one with every column
+        ph = (ph << 1) | 1;
+        mh = mh << 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+    }
+    return score;
+}
+
+DistanceQuery::DistanceQuery(const String *_s) : s(_s) {
+    memset(peq, 0, sizeof(peq));
+    if (s->count <= 64) {
+        for (size_t i = 0; i < s->count; ++i) {
+            peq[(unsigned char)s->data[i]] |= 1ull << i;
+        }
+    }
+}
+
+size_t DistanceQuery::operator()(const String *t) const {
+    if (!s->count) return t->count;
+    if (!t->count) return s->count;
+    if (s->count > 64)
+        return distance(s, t);
+    return distance_bitparallel(peq, s->count, t->data, t->count);
+}
+
 // computes the levenshtein distance between two strings
 size_t distance(const String *_s, const String *_t) {
+    if (_t->count < _s->count) {
+        std::swap(_s, _t);
+    }
+    if (_s->count && (_s->count <= 64)) {
+        uint64_t peq[256];
+        for (size_t i = 0; i < _s->count; ++i) {
+            peq[(unsigned char)_s->data[i]] = 0;
+        }
+        for (size_t i = 0; i < _t->count; ++i) {
+            peq[(unsigned char)_t->data[i]] = 0;
+        }
+        for (size_t i = 0; i < _s->count; ++i) {
+            peq[(unsigned char)_s->data[i]] |= 1ull << i;
+        }
+        return distance_bitparallel(peq, _s->count, _t->data, _t->count);
+    }
     const char *s = _s->data;
     const char *t = _t->data;
     const size_t n = _s->count;
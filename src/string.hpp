@@ -8,6 +8,7 @@
 #define SCOPES_STRING_HPP
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "styled_stream.hpp"
 #include "scopes/config.h"
@@ -31,12 +32,17 @@ typedef std::stringstream StringStream;
 
 struct String {
 protected:
-    String(const char *_data, size_t _count);
+    String(const char *_data, size_t _count, std::size_t _hash);
 
 public:
     static const String *from(const char *s, size_t count);
+    // as from, with hash being hash_bytes(s, count), computed by the caller
+    static const String *from(const char *s, size_t count, std::size_t hash);
     static const String *from_cstr(const char *s);
     static const String *join(const String *a, const String *b);
+    // joins count strings in a temporary buffer, so that only the result
+    // is interned
+    static const String *join_many(const String *const *strings, size_t count);
 
     template<unsigned N>
     static const String *from(const char (&s)[N]) {
@@ -60,10 +66,15 @@ public:
 
     const char *data;
     size_t count;
+    // hash_bytes of the contents, computed once when the string is interned
+    std::size_t _hash;
 };
 
+// formats into memory without going through a string stream; the object
+// must stay where it was constructed.
 struct StyledString {
-    StringStream _ss;
+    MemoryStreamBuffer _buf;
+    OStream _os;
     StyledStream out;
 
     StyledString();
@@ -83,6 +94,18 @@ const String *format( const char *fmt, ...);
 // computes the levenshtein distance between two strings
 size_t distance(const String *_s, const String *_t);
 
+// computes the levenshtein distance between one string and many others;
+// strings of up to 64 characters use a bit-parallel kernel
+struct DistanceQuery {
+    DistanceQuery(const String *s);
+
+    size_t operator()(const String *t) const;
+
+    const String *s;
+    // per character, the positions at which it occurs in s
+    uint64_t peq[256];
+};
+
 int unescape_string(char *buf);
 int unescape_string_light(char *buf);
 int escape_string(char *buf, const char *str, int strcount, const char *quote_chars);
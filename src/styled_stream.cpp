@@ -19,7 +19,9 @@
 #endif
 
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <vector>
 #include "absl/container/flat_hash_map.h"
 
 #pragma GCC diagnostic ignored "-Wunused-function"
@@ -126,6 +128,118 @@ void stream_plain_style(OStream &ost, Style style) {
 
 StreamStyleFunction stream_default_style = stream_plain_style;
 
+//------------------------------------------------------------------------------
+// STREAM BUFFERS
+//------------------------------------------------------------------------------
+
+MemoryStreamBuffer::MemoryStreamBuffer() : heap(nullptr) {
+    setp(inline_data, inline_data + SCOPES_STREAM_INLINE_SIZE);
+}
+
+MemoryStreamBuffer::~MemoryStreamBuffer() {
+    free(heap);
+}
+
+void MemoryStreamBuffer::clear() {
+    setp(pbase(), epptr());
+}
+
+void MemoryStreamBuffer::grow(size_t required) {
+    size_t count = size();
+    size_t capacity = epptr() - pbase();
+    while (capacity < required)
+        capacity *= 2;
+    auto newdata = (StreamChar *)malloc(capacity * sizeof(StreamChar));
+    memcpy(newdata, pbase(), count * sizeof(StreamChar));
+    free(heap);
+    heap = newdata;
+    setp(heap, heap + capacity);
+    pbump(count);
+}
+
+MemoryStreamBuffer::int_type MemoryStreamBuffer::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+    grow(size() + 1);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+std::streamsize MemoryStreamBuffer::xsputn(const StreamChar *s, std::streamsize n) {
+    if ((size_t)(epptr() - pptr()) < (size_t)n)
+        grow(size() + n);
+    memcpy(pptr(), s, n * sizeof(StreamChar));
+    pbump(n);
+    return n;
+}
+
+FileStreamBuffer::FileStreamBuffer(FILE *_file) : file(_file) {
+    setp(buffer, buffer + sizeof(buffer) / sizeof(StreamChar));
+}
+
+FileStreamBuffer::~FileStreamBuffer() {
+    sync();
+}
+
+int FileStreamBuffer::sync() {
+    size_t count = pptr() - pbase();
+    if (count) {
+        fwrite(pbase(), sizeof(StreamChar), count, file);
+        setp(pbase(), epptr());
+    }
+    return 0;
+}
+
+FileStreamBuffer::int_type FileStreamBuffer::overflow(int_type c) {
+    sync();
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    if (traits_type::to_char_type(c) == '\n')
+        sync();
+    return c;
+}
+
+std::streamsize FileStreamBuffer::xsputn(const StreamChar *s, std::streamsize n) {
+    size_t capacity = epptr() - pbase();
+    if ((size_t)n >= capacity) {
+        // too large to be worth buffering
+        sync();
+        fwrite(s, sizeof(StreamChar), n, file);
+        return n;
+    }
+    if ((size_t)(epptr() - pptr()) < (size_t)n)
+        sync();
+    memcpy(pptr(), s, n * sizeof(StreamChar));
+    pbump(n);
+    // write out complete lines
+    for (std::streamsize i = 0; i < n; ++i) {
+        if (s[i] == '\n') {
+            sync();
+            break;
+        }
+    }
+    return n;
+}
+
+OStream &error_stream() {
+#if SCOPES_USE_WCHAR
+    return SCOPES_CERR;
+#else
+    struct ErrorStream {
+        ErrorStream() : buffer(stderr), stream(&buffer) {}
+        FileStreamBuffer buffer;
+        OStream stream;
+    };
+    static thread_local ErrorStream error;
+    return error.stream;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
 StyledStream::StyledStream(OStream &ost, StreamStyleFunction ssf) :
     _ssf(ssf),
     _ost(ost)
@@ -138,9 +252,26 @@ StyledStream::StyledStream(OStream &ost) :
 
 StyledStream::StyledStream() :
     _ssf(stream_default_style),
-    _ost(SCOPES_CERR)
+    _ost(error_stream())
 {}
 
+StyledStream::~StyledStream() {
+    flush();
+}
+
+void StyledStream::flush() {
+    _ost.flush();
+}
+
+void StyledStream::write_ascii(const char *s, size_t count) {
+#if SCOPES_USE_WCHAR
+    for (size_t i = 0; i < count; ++i)
+        _ost.put(s[i]);
+#else
+    _ost.write(s, count);
+#endif
+}
+
 StyledStream StyledStream::plain(OStream &ost) {
     return StyledStream(ost, stream_plain_style);
 }
@@ -153,45 +284,98 @@ StyledStream& StyledStream::operator<<(OStream &(*o)(OStream&)) {
     _ost << o; return *this; }
 
 StyledStream& StyledStream::operator<<(Style s) {
-    _ssf(_ost, s);
+    if (_ssf != stream_plain_style)
+        _ssf(_ost, s);
     return *this;
 }
 
 StyledStream& StyledStream::operator<<(bool s) {
-    _ssf(_ost, Style_Keyword);
-    _ost << (s?"true":"false");
-    _ssf(_ost, Style_None);
+    *this << Style_Keyword;
+    if (s)
+        write_ascii("true", 4);
+    else
+        write_ascii("false", 5);
+    *this << Style_None;
     return *this;
 }
 
 StyledStream& StyledStream::stream_number(int8_t x) {
-    _ssf(_ost, Style_Number); _ost << (int)x; _ssf(_ost, Style_None);
-    return *this;
+    return stream_number((int64_t)x);
 }
 
 StyledStream& StyledStream::stream_number(uint8_t x) {
-    _ssf(_ost, Style_Number); _ost << (int)x; _ssf(_ost, Style_None);
+    return stream_number((uint64_t)x);
+}
+
+StyledStream& StyledStream::stream_number(int64_t x) {
+    char dest[24];
+    char *s = dest + sizeof(dest);
+    // negate as unsigned so that INT64_MIN does not overflow
+    uint64_t u = (x < 0)?(0ull - (uint64_t)x):(uint64_t)x;
+    do {
+        *--s = '0' + (u % 10);
+        u /= 10;
+    } while (u);
+    if (x < 0)
+        *--s = '-';
+    *this << Style_Number;
+    write_ascii(s, dest + sizeof(dest) - s);
+    *this << Style_None;
     return *this;
 }
 
+StyledStream& StyledStream::stream_number(uint64_t x) {
+    char dest[24];
+    char *s = dest + sizeof(dest);
+    do {
+        *--s = '0' + (x % 10);
+        x /= 10;
+    } while (x);
+    *this << Style_Number;
+    write_ascii(s, dest + sizeof(dest) - s);
+    *this << Style_None;
+    return *this;
+}
 
-StyledStream& StyledStream::stream_number(double x, const char *fmt) {
-    size_t size = stb_snprintf( nullptr, 0, fmt, x );
-    char dest[size+1];
-    stb_snprintf( dest, size + 1, fmt, x );
-    // count exact characters
-    size = strlen(dest);
+static size_t format_number(char *dest, size_t size, double x, const char *fmt) {
+    size_t count = stb_snprintf( dest, size, fmt, x );
+    if (count + 1 >= size) {
+        // output may have been clamped to the buffer; measure
+        count = stb_snprintf( nullptr, 0, fmt, x );
+        if (count >= size)
+            return count;
+    }
     // truncate trailing zeroes up to one zero after the dot
-    size_t i = size;
+    size_t i = count;
     while (i-- > 0) {
         char c = dest[i];
         if ((c == '0') && (i > 0) && (dest[i-1] != '.')) {
-            dest[i] = '\0';
+            count = i;
         } else {
             break;
         }
     }
-    _ssf(_ost, Style_Number); _ost << dest; _ssf(_ost, Style_None);
+    return count;
+}
+
+size_t format_real(char *dest, size_t size, double x, bool single) {
+    return format_number(dest, size, x, single?"%f":"%.11f");
+}
+
+StyledStream& StyledStream::stream_number(double x, const char *fmt) {
+    // most numbers fit the stack buffer, which saves a sizing pass
+    char buf[64];
+    char *dest = buf;
+    std::vector<char> large;
+    size_t size = format_number(buf, sizeof(buf), x, fmt);
+    if (size >= sizeof(buf)) {
+        large.resize(size + 1);
+        dest = large.data();
+        size = format_number(dest, size + 1, x, fmt);
+    }
+    *this << Style_Number;
+    write_ascii(dest, size);
+    *this << Style_None;
     return *this;
 }
 
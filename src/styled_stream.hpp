@@ -12,6 +12,8 @@
 #include "valueref.inc"
 
 #include <iostream>
+#include <type_traits>
+#include <stdio.h>
 
 namespace scopes {
 
@@ -44,6 +46,55 @@ void stream_plain_style(OStream &ost, Style style);
 
 extern StreamStyleFunction stream_default_style;
 
+//------------------------------------------------------------------------------
+// STREAM BUFFERS
+//------------------------------------------------------------------------------
+
+typedef OStream::char_type StreamChar;
+
+/* collects output in memory. the first SCOPES_STREAM_INLINE_SIZE characters
+   are stored in the buffer itself, so formatting short strings does not
+   allocate, and the contents can be read without copying them. the buffer
+   must not be moved once output has been written to it. */
+#define SCOPES_STREAM_INLINE_SIZE 256
+
+struct MemoryStreamBuffer : std::basic_streambuf<StreamChar> {
+    MemoryStreamBuffer();
+    ~MemoryStreamBuffer();
+
+    const StreamChar *data() const { return pbase(); }
+    size_t size() const { return pptr() - pbase(); }
+    void clear();
+
+protected:
+    void grow(size_t required);
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const StreamChar *s, std::streamsize n) override;
+
+    StreamChar *heap;
+    StreamChar inline_data[SCOPES_STREAM_INLINE_SIZE];
+};
+
+/* line buffered output to a C file; stderr is not buffered by the C library,
+   which would otherwise cost a write for every formatted value. */
+struct FileStreamBuffer : std::basic_streambuf<StreamChar> {
+    FileStreamBuffer(FILE *file);
+    ~FileStreamBuffer();
+
+protected:
+    int sync() override;
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const StreamChar *s, std::streamsize n) override;
+
+    FILE *file;
+    StreamChar buffer[4096];
+};
+
+// the stream that default constructed styled streams write to; buffered and
+// per thread, so diagnostics of concurrent threads do not interleave within
+// a line.
+OStream &error_stream();
+
 struct StyledStream {
     StreamStyleFunction _ssf;
     OStream &_ost;
@@ -52,6 +103,10 @@ struct StyledStream {
     StyledStream(OStream &ost);
 
     StyledStream();
+    // buffered output is written out when the stream goes away
+    ~StyledStream();
+
+    void flush();
 
     static StyledStream plain(OStream &ost);
     static StyledStream plain(StyledStream &ost);
@@ -79,17 +134,23 @@ struct StyledStream {
     StyledStream& stream_number(int8_t x);
     StyledStream& stream_number(uint8_t x);
 
+    StyledStream& stream_number(int64_t x);
+    StyledStream& stream_number(uint64_t x);
     StyledStream& stream_number(double x, const char *fmt);
     StyledStream& stream_number(double x);
     StyledStream& stream_number(float x);
 
     template<typename T>
     StyledStream& stream_number(T x) {
-        _ssf(_ost, Style_Number);
-        _ost << x;
-        _ssf(_ost, Style_None);
-        return *this;
+        if (std::is_signed<T>::value)
+            return stream_number((int64_t)x);
+        else
+            return stream_number((uint64_t)x);
     }
+
+    // writes characters that are known to be ASCII, bypassing the formatting
+    // machinery of the underlying stream
+    void write_ascii(const char *s, size_t count);
 };
 
 #define STREAM_STYLED_NUMBER(T) \
@@ -158,6 +219,9 @@ StyledStream& operator<<(StyledStream& ost, TValueRef<T> value) {
 }
 
 void stream_uid(StyledStream &ss, uint64_t uid);
+// formats x into dest as a stream does, without trailing zeroes, and returns
+// the length of the text, which was only written if it is less than size
+size_t format_real(char *dest, size_t size, double x, bool single);
 void stream_address(StyledStream &ss, const void *ptr);
 void set_address_name(const void *ptr, const String *name);
 
@@ -8,20 +8,64 @@
 #include "hash.hpp"
 #include "styled_stream.hpp"
 #include "symbol_enum.inc"
+#include "intern.hpp"
+#include "timer.hpp"
 
 #include <memory.h>
 #include <string.h>
 #include <assert.h>
+#include <atomic>
 
-#include "absl/container/flat_hash_map.h"
-#include "absl/container/flat_hash_set.h"
+// the slots of all known symbols, computed by gensyms
+#define SCOPES_KNOWN_SYMBOL_TABLE
+#include "known_symbols.hpp"
 
 namespace scopes {
 
-static absl::flat_hash_map<Symbol, const String *, Symbol::Hash> map_symbol_name;
-static absl::flat_hash_map<const String *, Symbol> map_name_symbol;
+static InternMap<Symbol, const String *, Symbol::Hash> map_symbol_name;
+static InternMap<const String *, Symbol> map_name_symbol;
 
-static uint64_t num_symbols = 0;
+static std::atomic<uint64_t> num_symbols(0);
+
+/* known symbols are named by the hash of their name like any other symbol,
+   so their ids are spread over the whole range. they are kept in a fixed
+   open addressed table instead of the maps, which answers all lookups for
+   them without locking. gensyms lays out the table at build time, so that
+   startup only has to intern the names. */
+
+namespace {
+struct KnownSymbolSlot {
+    // 0 marks a free slot; the id of SYM_Unnamed is 0 too, and is special
+    // cased
+    uint64_t id;
+    const String *name;
+};
+}
+
+static KnownSymbolSlot known_symbol_slots[SCOPES_KNOWN_SYMBOL_SLOTS];
+static const String *unnamed_symbol_name = nullptr;
+
+static const KnownSymbolSlot *find_known_symbol_slot(uint64_t id) {
+    size_t i = (size_t)id;
+    while (true) {
+        auto &slot = known_symbol_slots[i & (SCOPES_KNOWN_SYMBOL_SLOTS - 1)];
+        if (slot.id == id)
+            return &slot;
+        if (!slot.id)
+            return nullptr;
+        i++;
+    }
+}
+
+// names of recently used symbols that aren't known
+static thread_local InternCache<const String *> symbol_name_cache;
+
+static MemoryStat symbols_memory("symbols", [](MemoryUsage &usage) {
+    // both tables hold the same symbols
+    uint64_t count = 0;
+    map_symbol_name.measure(count, usage.bytes);
+    map_name_symbol.measure(usage.objects, usage.bytes);
+});
 
 //------------------------------------------------------------------------------
 // SYMBOL TYPE
@@ -37,51 +81,55 @@ size_t Symbol::symbol_count() {
     return num_symbols;
 }
 
-void Symbol::verify_unmapped(Symbol id, const String *name) {
-    auto it = map_name_symbol.find({ name });
-    if (it != map_name_symbol.end()) {
-        StyledStream ss(SCOPES_CERR);
-        ss << "known symbols "
-            << get_known_symbol_name(id.known_value()) << " and "
-            << get_known_symbol_name(it->second.known_value())
-            << " mapped to same string ("
-            << name
-            << ")" << std::endl;
-    }
-}
-
-void Symbol::map_symbol(Symbol id, const String *name) {
-    map_name_symbol[name] = id;
-    map_symbol_name[id] = name;
-}
-
-void Symbol::map_known_symbol(Symbol id, const String *name) {
-    verify_unmapped(id, name);
-    map_symbol(id, name);
+static void report_collision(const String *name, const String *oldname) {
+    StyledStream ss(SCOPES_CERR);
+    ss << "internal error: symbol hash collision between "
+       << name << " and " << oldname << std::endl;
 }
 
 Symbol Symbol::get_symbol(const String *name) {
-    auto it = map_name_symbol.find(name);
-    if (it != map_name_symbol.end()) {
-        auto oldname = get_symbol_name(it->second);
+    if (name == unnamed_symbol_name)
+        return Symbol();
+    auto slot = find_known_symbol_slot(name->hash());
+    if (slot) {
+        if (slot->name != name) {
+            report_collision(name, slot->name);
+        }
+        return Symbol::wrap(slot->id);
+    }
+    bool found;
+    Symbol id = map_name_symbol.intern(name, found, [&]() {
+        num_symbols++;
+        Symbol id = Symbol::wrap(name->hash());
+        map_symbol_name.set(id, name);
+        return id;
+    });
+    if (found) {
+        auto oldname = get_symbol_name(id);
         if (oldname != name) {
-            StyledStream ss(SCOPES_CERR);
-            ss << "internal error: symbol hash collision between "
-               << name << " and " << oldname << std::endl;
+            report_collision(name, oldname);
         }
-        return it->second;
     }
-    num_symbols++;
-    Symbol id = Symbol::wrap(name->hash());
-    map_symbol(id, name);
     return id;
 }
 
 const String *Symbol::get_symbol_name(Symbol id) {
-    auto it = map_symbol_name.find(id);
-    if (it == map_symbol_name.end())
-        it = map_symbol_name.find(SYM_Corrupted);
-    return it->second;
+    if (!id._value)
+        return unnamed_symbol_name;
+    auto slot = find_known_symbol_slot(id._value);
+    if (slot)
+        return slot->name;
+    const String *name = nullptr;
+    if (symbol_name_cache.find(id._value, name,
+        [](const String *) { return true; }))
+        return name;
+    if (!map_symbol_name.find(id, name)) {
+        // not cached, so a symbol created later under this id is found
+        map_symbol_name.find(SYM_Corrupted, name);
+        return name;
+    }
+    symbol_name_cache.insert(id._value, name);
+    return name;
 }
 
 Symbol::Symbol(uint64_t tid) :
@@ -99,35 +147,33 @@ Symbol::Symbol(Symbol::EnumT id) :
     _value(id) {
 }
 
+Symbol Symbol::from_bytes(const char *s, size_t count) {
+    // ids are the hashes of their names, so the hash finds existing symbols
+    // without a string to look them up by
+    uint64_t h = hash_bytes(s, count);
+    auto same_name = [&](const String *name) {
+        return (name->count == count) && !memcmp(name->data, s, count);
+    };
+    auto slot = find_known_symbol_slot(h);
+    if (slot && same_name(slot->name))
+        return Symbol::wrap(h);
+    const String *name = nullptr;
+    if (symbol_name_cache.find(h, name, same_name))
+        return Symbol::wrap(h);
+    name = String::from(s, count, h);
+    Symbol id = get_symbol(name);
+    if (id._value == h) {
+        symbol_name_cache.insert(h, name);
+    }
+    return id;
+}
+
 Symbol::Symbol(const String *str) :
     _value(get_symbol(str)._value) {
 }
 
 bool Symbol::is_known() const {
-    switch(_value) {
-#define T(sym, name) case sym: return true;
-    SCOPES_SYMBOLS()
-#undef T
-#define T(NAME) case SYM_SPIRV_StorageClass ## NAME: return true;
-    B_SPIRV_STORAGE_CLASS()
-#undef T
-#define T(NAME) case SYM_SPIRV_BuiltIn ## NAME: return true;
-    B_SPIRV_BUILTINS()
-#undef T
-#define T(NAME) case SYM_SPIRV_ExecutionMode ## NAME: return true;
-    B_SPIRV_EXECUTION_MODE()
-#undef T
-#define T(NAME) case SYM_SPIRV_Dim ## NAME: return true;
-    B_SPIRV_DIM()
-#undef T
-#define T(NAME) case SYM_SPIRV_ImageFormat ## NAME: return true;
-    B_SPIRV_IMAGE_FORMAT()
-#undef T
-#define T(NAME) case SYM_SPIRV_ImageOperand ## NAME: return true;
-    B_SPIRV_IMAGE_OPERAND()
-#undef T
-    default: return false;
-    }
+    return !_value || find_known_symbol_slot(_value);
 }
 
 Symbol::EnumT Symbol::known_value() const {
@@ -169,33 +215,13 @@ const String *Symbol::name() const {
 }
 
 void Symbol::_init_symbols() {
-#define T(sym, name) map_known_symbol(sym, String::from(name));
-    SCOPES_SYMBOLS()
-#undef T
-#define T(NAME) \
-    map_known_symbol(SYM_SPIRV_StorageClass ## NAME, String::from(#NAME));
-    B_SPIRV_STORAGE_CLASS()
-#undef T
-#define T(NAME) \
-    map_known_symbol(SYM_SPIRV_BuiltIn ## NAME, String::from("spirv." #NAME));
-    B_SPIRV_BUILTINS()
-#undef T
-#define T(NAME) \
-    map_known_symbol(SYM_SPIRV_ExecutionMode ## NAME, String::from(#NAME));
-    B_SPIRV_EXECUTION_MODE()
-#undef T
-#define T(NAME) \
-    map_known_symbol(SYM_SPIRV_Dim ## NAME, String::from(#NAME));
-    B_SPIRV_DIM()
-#undef T
-#define T(NAME) \
-    map_known_symbol(SYM_SPIRV_ImageFormat ## NAME, String::from(#NAME));
-    B_SPIRV_IMAGE_FORMAT()
-#undef T
-#define T(NAME) \
-    map_known_symbol(SYM_SPIRV_ImageOperand ## NAME, String::from(#NAME));
-    B_SPIRV_IMAGE_OPERAND()
-#undef T
+    unnamed_symbol_name = String::from("", 0);
+    // ids are the hashes of the names, which gensyms checked to be unique
+    for (auto &&entry : known_symbol_table) {
+        auto &slot = known_symbol_slots[entry.slot];
+        slot.id = entry.id;
+        slot.name = String::from(entry.name, entry.count, entry.id);
+    }
 
 #if 0
     absl::flat_hash_set<Symbol, Symbol::Hash> defined;
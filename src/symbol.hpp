@@ -35,12 +35,6 @@ struct Symbol {
     };
 
 protected:
-    static void verify_unmapped(Symbol id, const String *name);
-
-    static void map_symbol(Symbol id, const String *name);
-
-    static void map_known_symbol(Symbol id, const String *name);
-
     static Symbol get_symbol(const String *name);
 
     static const String *get_symbol_name(Symbol id);
@@ -58,11 +52,15 @@ public:
 
     template<unsigned N>
     Symbol(const char (&str)[N]) :
-        _value(get_symbol(String::from(str))._value) {
+        _value(from_bytes(str, N - 1)._value) {
     }
 
     Symbol(const String *str);
 
+    // hashes the bytes once, and only interns a string for them when no
+    // symbol with that name exists yet
+    static Symbol from_bytes(const char *s, size_t count);
+
     bool is_known() const;
     EnumT known_value() const;
 
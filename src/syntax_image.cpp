@@ -0,0 +1,567 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "syntax_image.hpp"
+#include "lexerparser.hpp"
+#include "error.hpp"
+#include "source_file.hpp"
+#include "stream_expr.hpp"
+#include "anchor.hpp"
+#include "list.hpp"
+#include "value.hpp"
+#include "type.hpp"
+#include "cache.hpp"
+#include "hash.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "dyn_cast.inc"
+
+#include "scopes/scopes.h"
+
+#include <string.h>
+#include <assert.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#include "absl/container/flat_hash_map.h"
+
+// bump whenever the encoding changes
+#define SCOPES_SYNTAX_IMAGE_VERSION 2
+// upper bound for the number of threads parsing prefetched modules
+#define SCOPES_PREFETCH_MAX_THREADS 4
+#define SCOPES_SYNTAX_IMAGE_MAGIC "SCSI"
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// SYNTAX IMAGE
+//------------------------------------------------------------------------------
+
+enum SyntaxImageTag {
+    SIT_List = 1,
+    SIT_Symbol,
+    SIT_Integer,
+    SIT_Real,
+    SIT_String,
+    // the printed form of a value of an AST image, read back as symbol
+    SIT_Text,
+};
+
+// all types that the lexer is able to produce for numbers and symbols
+static const Type *syntax_image_type(int index) {
+    switch(index) {
+    case 0: return TYPE_Symbol;
+    case 1: return TYPE_I8;
+    case 2: return TYPE_I16;
+    case 3: return TYPE_I32;
+    case 4: return TYPE_I64;
+    case 5: return TYPE_U8;
+    case 6: return TYPE_U16;
+    case 7: return TYPE_U32;
+    case 8: return TYPE_U64;
+    case 9: return TYPE_Char;
+    case 10: return TYPE_USize;
+    case 11: return TYPE_F32;
+    case 12: return TYPE_F64;
+    default: return nullptr;
+    }
+}
+
+static int syntax_image_type_index(const Type *T) {
+    for (int i = 0; ; ++i) {
+        auto ST = syntax_image_type(i);
+        if (!ST) break;
+        if (ST == T) return i;
+    }
+    return -1;
+}
+
+struct SyntaxImageWriter {
+    std::vector<char> body;
+    std::vector<const String *> strings;
+    absl::flat_hash_map<const String *, uint32_t> string_ids;
+    Symbol path;
+    int lineno = 0;
+    int offset = 0;
+    // AST images accept every value and anchor
+    bool ast = false;
+
+    static void write_varint(std::vector<char> &dest, uint64_t value) {
+        while (value >= 0x80) {
+            dest.push_back((char)((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        dest.push_back((char)value);
+    }
+
+    void write_varint(uint64_t value) {
+        write_varint(body, value);
+    }
+
+    // zigzag encoding, so that small negative deltas stay small
+    void write_delta(int64_t value) {
+        write_varint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+
+    uint32_t string_id(const String *str) {
+        auto it = string_ids.find(str);
+        if (it != string_ids.end())
+            return it->second;
+        uint32_t id = strings.size();
+        strings.push_back(str);
+        string_ids.insert({str, id});
+        return id;
+    }
+
+    // the lowest bit of the column marks a change of path, whose string
+    // follows; anchors into buffers lose their buffer
+    bool write_anchor(const Anchor *anchor) {
+        bool newpath = (anchor->path != path);
+        if ((newpath || anchor->buffer) && !ast)
+            return false;
+        write_delta((int64_t)anchor->lineno - lineno);
+        write_varint(((uint64_t)anchor->column << 1) | newpath);
+        if (newpath) {
+            path = anchor->path;
+            write_varint(string_id(path.name()));
+        }
+        write_delta((int64_t)anchor->offset - offset);
+        lineno = anchor->lineno;
+        offset = anchor->offset;
+        return true;
+    }
+
+    bool write_text(const ValueRef &value) {
+        if (!ast)
+            return false;
+        body.push_back(SIT_Text);
+        if (!write_anchor(value.anchor())) return false;
+        StyledString ss = StyledString::plain();
+        stream_value(ss.out, value, StreamValueFormat::singleline());
+        // symbols intern the text, so that repeated values share a string
+        write_varint(string_id(Symbol(ss.str()).name()));
+        return true;
+    }
+
+    bool write_value(const ValueRef &value) {
+        auto anchor = value.anchor();
+        switch(value->kind()) {
+        case VK_ConstPointer: {
+            auto cp = value.cast<ConstPointer>();
+            if (cp->get_type() != TYPE_List)
+                return write_text(value);
+            auto l = (const List *)cp->value;
+            body.push_back(SIT_List);
+            if (!write_anchor(anchor)) return false;
+            write_varint(List::count(l));
+            while (l != EOL) {
+                if (!write_value(l->at)) return false;
+                l = l->next;
+            }
+        } break;
+        case VK_ConstInt: {
+            auto ci = value.cast<ConstInt>();
+            auto T = ci->get_type();
+            if (ci->words.size() != 1)
+                return write_text(value);
+            int index = syntax_image_type_index(T);
+            if (index < 0)
+                return write_text(value);
+            if (T == TYPE_Symbol) {
+                body.push_back(SIT_Symbol);
+                if (!write_anchor(anchor)) return false;
+                write_varint(string_id(Symbol::wrap(ci->value()).name()));
+            } else {
+                body.push_back(SIT_Integer);
+                if (!write_anchor(anchor)) return false;
+                write_varint(index);
+                write_varint(ci->value());
+            }
+        } break;
+        case VK_ConstReal: {
+            auto cr = value.cast<ConstReal>();
+            int index = syntax_image_type_index(cr->get_type());
+            if (index < 0)
+                return write_text(value);
+            body.push_back(SIT_Real);
+            if (!write_anchor(anchor)) return false;
+            write_varint(index);
+            char buf[sizeof(double)];
+            memcpy(buf, &cr->value, sizeof(double));
+            body.insert(body.end(), buf, buf + sizeof(double));
+        } break;
+        case VK_ConstString: {
+            auto cs = value.cast<ConstString>();
+            body.push_back(SIT_String);
+            if (!write_anchor(anchor)) return false;
+            write_varint(string_id(cs->value));
+        } break;
+        default: return write_text(value);
+        }
+        return true;
+    }
+
+    void finalize(std::vector<char> &dest) {
+        dest.clear();
+        dest.reserve(body.size() + strings.size() * 16 + 16);
+        dest.insert(dest.end(), SCOPES_SYNTAX_IMAGE_MAGIC,
+            SCOPES_SYNTAX_IMAGE_MAGIC + 4);
+        write_varint(dest, SCOPES_SYNTAX_IMAGE_VERSION);
+        write_varint(dest, strings.size());
+        for (auto str : strings) {
+            write_varint(dest, str->count);
+            dest.insert(dest.end(), str->data, str->data + str->count);
+        }
+        dest.insert(dest.end(), body.begin(), body.end());
+    }
+};
+
+bool write_syntax_image(std::vector<char> &dest, const ValueRef &value) {
+    SyntaxImageWriter writer;
+    writer.path = value.anchor()->path;
+    // the path is always the first string
+    writer.string_id(writer.path.name());
+    if (!writer.write_value(value))
+        return false;
+    writer.finalize(dest);
+    return true;
+}
+
+void write_ast_image(std::vector<char> &dest, const ValueRef &value) {
+    auto tree = convert_expr(value);
+    SyntaxImageWriter writer;
+    writer.ast = true;
+    writer.path = tree.anchor()->path;
+    writer.string_id(writer.path.name());
+    bool ok = writer.write_value(tree);
+    assert(ok);
+    (void)ok;
+    writer.finalize(dest);
+}
+
+struct SyntaxImageReader {
+    const char *ptr;
+    const char *end;
+    bool failed = false;
+    std::vector<const String *> strings;
+    Symbol path;
+    int lineno = 0;
+    int offset = 0;
+
+    SyntaxImageReader(const char *data, size_t size) :
+        ptr(data), end(data + size) {}
+
+    uint64_t read_varint() {
+        uint64_t value = 0;
+        int shift = 0;
+        while (true) {
+            if ((ptr == end) || (shift > 63)) {
+                failed = true;
+                return 0;
+            }
+            uint8_t c = (uint8_t)*ptr++;
+            value |= (uint64_t)(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                break;
+            shift += 7;
+        }
+        return value;
+    }
+
+    int64_t read_delta() {
+        uint64_t value = read_varint();
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    const String *read_string_id() {
+        auto id = read_varint();
+        if (failed || (id >= strings.size())) {
+            failed = true;
+            return nullptr;
+        }
+        return strings[id];
+    }
+
+    const Anchor *read_anchor() {
+        lineno += read_delta();
+        auto column = read_varint();
+        if (column & 1) {
+            auto str = read_string_id();
+            if (failed)
+                return nullptr;
+            path = Symbol(str);
+        }
+        offset += read_delta();
+        if (failed)
+            return nullptr;
+        return Anchor::from_unique(path, lineno, column >> 1, offset);
+    }
+
+    bool read_header() {
+        if (((end - ptr) < 4) || memcmp(ptr, SCOPES_SYNTAX_IMAGE_MAGIC, 4))
+            return false;
+        ptr += 4;
+        if (read_varint() != SCOPES_SYNTAX_IMAGE_VERSION)
+            return false;
+        auto count = read_varint();
+        if (failed || !count || (count > (uint64_t)(end - ptr)))
+            return false;
+        strings.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            auto size = read_varint();
+            if (failed || (size > (uint64_t)(end - ptr)))
+                return false;
+            strings.push_back(String::from(ptr, size));
+            ptr += size;
+        }
+        path = Symbol(strings[0]);
+        return true;
+    }
+
+    ValueRef read_value() {
+        if (ptr == end) {
+            failed = true;
+            return ValueRef();
+        }
+        int tag = *ptr++;
+        auto anchor = read_anchor();
+        if (failed)
+            return ValueRef();
+        switch(tag) {
+        case SIT_List: {
+            auto count = read_varint();
+            if (failed || (count > (uint64_t)(end - ptr))) {
+                failed = true;
+                return ValueRef();
+            }
+            std::vector<ValueRef> values;
+            values.reserve(count);
+            for (uint64_t i = 0; i < count; ++i) {
+                auto value = read_value();
+                if (failed)
+                    return ValueRef();
+                values.push_back(value);
+            }
+            return ValueRef(anchor, ConstPointer::list_from(
+                List::from_unique(values.data(), values.size())));
+        } break;
+        case SIT_Symbol: {
+            auto str = read_string_id();
+            if (failed)
+                return ValueRef();
+            return ValueRef(anchor, ConstInt::symbol_from(Symbol(str)));
+        } break;
+        case SIT_Integer: {
+            auto T = syntax_image_type(read_varint());
+            auto value = read_varint();
+            if (failed || !T || (T == TYPE_Symbol)
+                || (T == TYPE_F32) || (T == TYPE_F64)) {
+                failed = true;
+                return ValueRef();
+            }
+            return ValueRef(anchor, ConstInt::from(T, value));
+        } break;
+        case SIT_Real: {
+            auto T = syntax_image_type(read_varint());
+            if (failed || ((T != TYPE_F32) && (T != TYPE_F64))
+                || ((size_t)(end - ptr) < sizeof(double))) {
+                failed = true;
+                return ValueRef();
+            }
+            double value;
+            memcpy(&value, ptr, sizeof(double));
+            ptr += sizeof(double);
+            return ValueRef(anchor, ConstReal::from(T, value));
+        } break;
+        case SIT_String: {
+            auto str = read_string_id();
+            if (failed)
+                return ValueRef();
+            return ValueRef(anchor, ConstString::from(str));
+        } break;
+        case SIT_Text: {
+            auto str = read_string_id();
+            if (failed)
+                return ValueRef();
+            return ValueRef(anchor, ConstInt::symbol_from(Symbol(str)));
+        } break;
+        default: break;
+        }
+        failed = true;
+        return ValueRef();
+    }
+};
+
+ValueRef read_syntax_image(const char *data, size_t size) {
+    SyntaxImageReader reader(data, size);
+    if (!reader.read_header())
+        return ValueRef();
+    auto value = reader.read_value();
+    if (reader.failed || (reader.ptr != reader.end))
+        return ValueRef();
+    return value;
+}
+
+//------------------------------------------------------------------------------
+
+SCOPES_RESULT(ValueRef) parse_source_file(std::unique_ptr<SourceFile> file) {
+    SCOPES_RESULT_TYPE(ValueRef);
+    Timer parse_timer(TIMER_Parse);
+    TraceScope parse_trace("parse",
+        [&]() { return std::string(file->path.name()->data); });
+#if SCOPES_ALLOW_CACHE && SCOPES_CACHE_SYNTAX_IMAGES
+    // only files are cached; anchors of string sources point into the string
+    if (!file->_str && file->size()) {
+        auto pathstr = file->path.name();
+        uint64_t seed = hash2(
+            hash_bytes(pathstr->data, pathstr->count),
+            hash2(SCOPES_SYNTAX_IMAGE_VERSION,
+                hash_bytes(scopes_compile_time_date(),
+                    strlen(scopes_compile_time_date()))));
+        auto key = get_cache_key(seed, file->strptr(), file->size());
+        size_t size = 0;
+        auto data = get_cache(key, size);
+        if (data) {
+            auto value = read_syntax_image(data, size);
+            if (value)
+                return value;
+        }
+        LexerParser parser(std::move(file));
+        auto value = SCOPES_GET_RESULT(parser.parse());
+        std::vector<char> image;
+        if (write_syntax_image(image, value)) {
+            set_cache(key, nullptr, 0, image.data(), image.size());
+        }
+        return value;
+    }
+#endif
+    LexerParser parser(std::move(file));
+    return parser.parse();
+}
+
+//------------------------------------------------------------------------------
+// PREFETCH
+//------------------------------------------------------------------------------
+
+enum PrefetchState {
+    PS_Queued,
+    PS_Running,
+    PS_Done,
+};
+
+struct PrefetchEntry {
+    PrefetchState state = PS_Queued;
+    // null if the file could not be opened
+    Result<ValueRef> *result = nullptr;
+};
+
+static std::mutex prefetch_mutex;
+static std::condition_variable prefetch_queued;
+static std::condition_variable prefetch_done;
+static std::deque<Symbol> prefetch_queue;
+static absl::flat_hash_map<Symbol, PrefetchEntry *, Symbol::Hash> prefetch_entries;
+static std::vector<std::thread *> prefetch_threads;
+static bool prefetch_stop = false;
+
+static Result<ValueRef> *parse_source_path_result(Symbol path) {
+    auto file = SourceFile::from_file(path);
+    if (!file)
+        return nullptr;
+    return new Result<ValueRef>(parse_source_file(std::move(file)));
+}
+
+static void prefetch_worker() {
+    std::unique_lock<std::mutex> lock(prefetch_mutex);
+    while (true) {
+        prefetch_queued.wait(lock, []{
+            return prefetch_stop || !prefetch_queue.empty(); });
+        if (prefetch_stop)
+            return;
+        auto path = prefetch_queue.front();
+        prefetch_queue.pop_front();
+        auto it = prefetch_entries.find(path);
+        // was taken over by the thread that needed it
+        if ((it == prefetch_entries.end()) || (it->second->state != PS_Queued))
+            continue;
+        auto entry = it->second;
+        entry->state = PS_Running;
+        lock.unlock();
+        auto result = parse_source_path_result(path);
+        lock.lock();
+        entry->result = result;
+        entry->state = PS_Done;
+        prefetch_done.notify_all();
+    }
+}
+
+// a parse that is still running must not see the globals torn down
+static void stop_prefetch_threads() {
+    {
+        std::lock_guard<std::mutex> lock(prefetch_mutex);
+        prefetch_stop = true;
+    }
+    prefetch_queued.notify_all();
+    for (auto thread : prefetch_threads) {
+        thread->join();
+    }
+}
+
+void prefetch_source_path(Symbol path) {
+    std::lock_guard<std::mutex> lock(prefetch_mutex);
+    if (prefetch_stop || prefetch_entries.count(path))
+        return;
+    if (prefetch_threads.empty()) {
+        int count = std::thread::hardware_concurrency() - 1;
+        if (count > SCOPES_PREFETCH_MAX_THREADS)
+            count = SCOPES_PREFETCH_MAX_THREADS;
+        if (count < 1)
+            count = 1;
+        for (int i = 0; i < count; ++i) {
+            prefetch_threads.push_back(new std::thread(prefetch_worker));
+        }
+        atexit(stop_prefetch_threads);
+    }
+    prefetch_entries.insert({path, new PrefetchEntry()});
+    prefetch_queue.push_back(path);
+    prefetch_queued.notify_one();
+}
+
+SCOPES_RESULT(ValueRef) parse_source_path(Symbol path) {
+    Result<ValueRef> *result = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(prefetch_mutex);
+        auto it = prefetch_entries.find(path);
+        if (it != prefetch_entries.end()) {
+            auto entry = it->second;
+            prefetch_entries.erase(it);
+            if (entry->state == PS_Queued) {
+                // no worker got to it yet; parsing it here is quicker
+                lock.unlock();
+            } else {
+                prefetch_done.wait(lock, [entry]{
+                    return entry->state == PS_Done; });
+                result = entry->result;
+                if (!result) {
+                    // the file may have appeared since, so try again
+                    lock.unlock();
+                }
+            }
+            delete entry;
+        }
+    }
+    if (!result) {
+        result = parse_source_path_result(path);
+        if (!result)
+            return ValueRef();
+    }
+    auto value = *result;
+    delete result;
+    return value;
+}
+
+} // namespace scopes
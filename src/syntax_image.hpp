@@ -0,0 +1,59 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_SYNTAX_IMAGE_HPP
+#define SCOPES_SYNTAX_IMAGE_HPP
+
+#include "result.hpp"
+#include "valueref.inc"
+#include "symbol.hpp"
+
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
+namespace scopes {
+
+struct SourceFile;
+
+//------------------------------------------------------------------------------
+// SYNTAX IMAGE
+//------------------------------------------------------------------------------
+
+/* a syntax image is a compact binary encoding of the constant tree that
+   LexerParser::parse() produces: lists, symbols, numbers and strings, each
+   with their anchor. reading an image rebuilds the exact same tree without
+   going through the lexer. the same encoding stores dumps of proven ASTs,
+   which are much smaller and faster to write than their printed form. */
+
+// returns false if the tree contains values that can't be encoded, in which
+// case the contents of dest are undefined.
+bool write_syntax_image(std::vector<char> &dest, const ValueRef &value);
+
+// write the tree that stream_value() prints for value, which can be any
+// Template or Function graph. values that the encoding has no tag for, such as
+// types, are written in their printed form and read back as symbols; reading
+// an AST image gives a tree that stream_value() prints like the original.
+void write_ast_image(std::vector<char> &dest, const ValueRef &value);
+
+// returns an empty reference if the image is truncated or malformed.
+ValueRef read_syntax_image(const char *data, size_t size);
+
+// parse a source file, reusing a cached syntax image when the file contents
+// have not changed since the image was written.
+SCOPES_RESULT(ValueRef) parse_source_file(std::unique_ptr<SourceFile> file);
+
+// start parsing the file at path on a worker thread, so that a later
+// parse_source_path() of the same path only has to wait for the result.
+void prefetch_source_path(Symbol path);
+
+// parse the file at path, or take over its prefetched result; returns an
+// empty reference if the file can't be opened.
+SCOPES_RESULT(ValueRef) parse_source_path(Symbol path);
+
+} // namespace scopes
+
+#endif // SCOPES_SYNTAX_IMAGE_HPP
@@ -0,0 +1,529 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "thread_pool.hpp"
+#include "scopes/config.h"
+
+#include "coro/coro.c"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#define SCOPES_NOINLINE __declspec(noinline)
+#else
+#define SCOPES_NOINLINE __attribute__((noinline))
+#endif
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// TASKS
+//------------------------------------------------------------------------------
+
+struct Task {
+    TaskFunc func;
+    void *ctx;
+    std::atomic<bool> done;
+    // held by the handle and by the scheduler
+    std::atomic<int> refs;
+    bool coroutine;
+    bool started;
+    // set when the body of a coroutine has returned
+    bool returned;
+    coro_context context;
+    coro_stack stack;
+    // the context of the thread that currently runs the coroutine
+    coro_context *resumer;
+    // called once the suspended coroutine has been switched out
+    TaskParkFunc park;
+    void *park_ctx;
+};
+
+struct WaitGroup {
+    std::atomic<int64_t> count;
+};
+
+namespace {
+
+struct TaskQueue {
+    std::mutex mutex;
+    std::deque<Task *> tasks;
+};
+
+// pool threads have a queue each; queue 0 is shared by all other threads
+struct Scheduler {
+    std::vector<std::thread> threads;
+    std::unique_ptr<TaskQueue[]> queues;
+    int numqueues = 0;
+    std::atomic<int64_t> queued;
+    std::atomic<int> sleepers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    Scheduler() : queued(0), sleepers(0) {}
+};
+
+static Scheduler *scheduler = nullptr;
+static std::once_flag scheduler_once;
+static thread_local int queue_index = 0;
+static thread_local Task *current_task = nullptr;
+
+// a coroutine can continue on another thread after it yields, so it must not
+// keep the address of a thread local across the switch
+static SCOPES_NOINLINE Task *get_current_task() {
+    return current_task;
+}
+
+static SCOPES_NOINLINE void set_current_task(Task *task) {
+    current_task = task;
+}
+
+static void release_task(Task *task) {
+    if (task->refs.fetch_sub(1) == 1) {
+        delete task;
+    }
+}
+
+// wakes threads that sleep because there was nothing to run or wait for
+static void notify_sleepers(Scheduler &s, bool all) {
+    if (s.sleepers.load() == 0)
+        return;
+    {
+        // orders the wake up after the check of a thread going to sleep
+        std::lock_guard<std::mutex> lock(s.mutex);
+    }
+    if (all) {
+        s.wake.notify_all();
+    } else {
+        s.wake.notify_one();
+    }
+}
+
+// a task pushed to the front is taken last by the owner, and first by thieves
+static void push_task(Scheduler &s, Task *task, bool front = false) {
+    auto &queue = s.queues[queue_index];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (front) {
+            queue.tasks.push_front(task);
+        } else {
+            queue.tasks.push_back(task);
+        }
+    }
+    s.queued.fetch_add(1);
+    notify_sleepers(s, false);
+}
+
+// the own queue is taken from the back, queues of others from the front
+static Task *pop_task(Scheduler &s) {
+    if (s.queued.load() == 0)
+        return nullptr;
+    int own = queue_index;
+    for (int k = 0; k < s.numqueues; ++k) {
+        auto &queue = s.queues[(own + k) % s.numqueues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        Task *task;
+        if (k == 0) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        } else {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        s.queued.fetch_sub(1);
+        return task;
+    }
+    return nullptr;
+}
+
+static void finish_task(Scheduler &s, Task *task) {
+    task->done.store(true);
+    notify_sleepers(s, true);
+    release_task(task);
+}
+
+static void coroutine_entry(void *arg) {
+    Task *task = (Task *)arg;
+    task->func(task->ctx);
+    task->returned = true;
+    coro_transfer(&task->context, task->resumer);
+    // never resumed
+    abort();
+}
+
+static std::mutex coro_create_mutex;
+
+static void run_task(Scheduler &s, Task *task) {
+    Task *outer = get_current_task();
+    if (!task->coroutine) {
+        set_current_task(task);
+        task->func(task->ctx);
+        set_current_task(outer);
+        finish_task(s, task);
+        return;
+    }
+    if (!task->started) {
+        task->started = true;
+        if (!coro_stack_alloc(&task->stack,
+            SCOPES_TASK_STACK_SIZE / sizeof(void *))) {
+            fprintf(stderr, "error: unable to allocate coroutine stack\n");
+            fflush(stdout);
+            abort();
+        }
+        std::lock_guard<std::mutex> lock(coro_create_mutex);
+        coro_create(&task->context, coroutine_entry, task,
+            task->stack.sptr, task->stack.ssze);
+    }
+    coro_context here;
+    task->resumer = &here;
+    set_current_task(task);
+    coro_transfer(&here, &task->context);
+    set_current_task(outer);
+    if (task->returned) {
+        coro_stack_free(&task->stack);
+        finish_task(s, task);
+    } else if (task->park) {
+        auto park = task->park;
+        task->park = nullptr;
+        park(task, task->park_ctx);
+    } else {
+        // it yielded; the context is saved, so any thread may resume it now,
+        // but the tasks it waits for should run first
+        push_task(s, task, true);
+    }
+}
+
+static bool run_one(Scheduler &s) {
+    Task *task = pop_task(s);
+    if (!task)
+        return false;
+    run_task(s, task);
+    return true;
+}
+
+static void worker_main(Scheduler &s, int index) {
+    queue_index = index;
+    while (true) {
+        if (run_one(s))
+            continue;
+        std::unique_lock<std::mutex> lock(s.mutex);
+        s.sleepers.fetch_add(1);
+        s.wake.wait(lock, [&]{
+            return s.stopping || (s.queued.load() > 0); });
+        s.sleepers.fetch_sub(1);
+        if (s.stopping)
+            return;
+    }
+}
+
+// tasks still queued at exit are dropped
+static void stop_scheduler() {
+    auto &s = *scheduler;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.stopping = true;
+    }
+    s.wake.notify_all();
+    for (auto &&thread : s.threads) {
+        thread.join();
+    }
+}
+
+static Scheduler *new_scheduler() {
+    auto s = new Scheduler();
+    int count = std::max(1, (int)std::thread::hardware_concurrency());
+    s->numqueues = count;
+    s->queues.reset(new TaskQueue[count]);
+    for (int i = 1; i < count; ++i) {
+        s->threads.push_back(std::thread(worker_main, std::ref(*s), i));
+    }
+    return s;
+}
+
+static Scheduler &get_scheduler() {
+    std::call_once(scheduler_once, []{
+        scheduler = new_scheduler();
+        atexit(stop_scheduler);
+    });
+    return *scheduler;
+}
+
+static void yield_coroutine(Task *task) {
+    coro_transfer(&task->context, task->resumer);
+}
+
+// a coroutine yields while it waits, any other thread runs queued tasks, and
+// sleeps only when there are none
+template<typename F>
+static void wait_until(Scheduler &s, F &&ready) {
+    while (!ready()) {
+        Task *task = get_current_task();
+        if (task && task->coroutine) {
+            yield_coroutine(task);
+            continue;
+        }
+        if (run_one(s))
+            continue;
+        std::unique_lock<std::mutex> lock(s.mutex);
+        s.sleepers.fetch_add(1);
+        s.wake.wait(lock, [&]{
+            return ready() || (s.queued.load() > 0); });
+        s.sleepers.fetch_sub(1);
+    }
+}
+
+static Task *new_task(TaskFunc func, void *ctx, bool coroutine, int refs) {
+    Task *task = new Task();
+    task->func = func;
+    task->ctx = ctx;
+    task->done.store(false);
+    task->refs.store(refs);
+    task->coroutine = coroutine;
+    task->started = false;
+    task->returned = false;
+    task->stack.sptr = nullptr;
+    task->resumer = nullptr;
+    task->park = nullptr;
+    task->park_ctx = nullptr;
+    return task;
+}
+
+} // namespace
+
+int thread_pool_size() {
+    return get_scheduler().numqueues;
+}
+
+void thread_pool_restart() {
+    if (!scheduler)
+        return;
+    // the threads of the parent don't exist here, and the locks they may
+    // have held stay locked, so the old scheduler is abandoned as it is
+    scheduler = new_scheduler();
+}
+
+Task *task_spawn(TaskFunc func, void *ctx, bool coroutine) {
+    auto &s = get_scheduler();
+    Task *task = new_task(func, ctx, coroutine, 2);
+    push_task(s, task);
+    return task;
+}
+
+void task_join(Task *task) {
+    auto &s = get_scheduler();
+    wait_until(s, [&]{ return task->done.load(); });
+    release_task(task);
+}
+
+void task_detach(Task *task) {
+    release_task(task);
+}
+
+void task_yield() {
+    auto &s = get_scheduler();
+    Task *task = get_current_task();
+    if (task && task->coroutine) {
+        yield_coroutine(task);
+    } else {
+        run_one(s);
+    }
+}
+
+Task *task_current_coroutine() {
+    Task *task = get_current_task();
+    return (task && task->coroutine)?task:nullptr;
+}
+
+void task_park(TaskParkFunc park, void *ctx) {
+    Task *task = task_current_coroutine();
+    assert(task);
+    task->park = park;
+    task->park_ctx = ctx;
+    yield_coroutine(task);
+}
+
+void task_resume(Task *task) {
+    push_task(get_scheduler(), task);
+}
+
+WaitGroup *waitgroup_new() {
+    auto wg = new WaitGroup();
+    wg->count.store(0);
+    return wg;
+}
+
+void waitgroup_add(WaitGroup *wg, int64_t count) {
+    wg->count.fetch_add(count);
+}
+
+void waitgroup_done(WaitGroup *wg) {
+    if (wg->count.fetch_sub(1) == 1) {
+        notify_sleepers(get_scheduler(), true);
+    }
+}
+
+void waitgroup_wait(WaitGroup *wg) {
+    auto &s = get_scheduler();
+    wait_until(s, [&]{ return wg->count.load() <= 0; });
+}
+
+void waitgroup_free(WaitGroup *wg) {
+    delete wg;
+}
+
+//------------------------------------------------------------------------------
+// PARALLEL LOOPS
+//------------------------------------------------------------------------------
+
+namespace {
+
+// the chunks of a thread's share that haven't been taken yet, packed as
+// [lo, hi) into one word, so that the owner taking from the front and thieves
+// taking from the back never need a lock.
+struct alignas(64) Share {
+    std::atomic<uint64_t> range;
+};
+
+static uint64_t pack_range(uint32_t lo, uint32_t hi) {
+    return (uint64_t)lo | ((uint64_t)hi << 32);
+}
+
+struct Job {
+    int64_t begin;
+    int64_t end;
+    int64_t chunk_size;
+    // index of the first chunk of this round
+    int64_t first_chunk;
+    ParallelChunkFunc func;
+    void *ctx;
+    std::unique_ptr<Share[]> shares;
+    int numshares;
+    WaitGroup helpers;
+
+    bool take_own(int i, uint32_t &chunk) {
+        auto &range = shares[i].range;
+        uint64_t r = range.load(std::memory_order_relaxed);
+        while (true) {
+            uint32_t lo = (uint32_t)r;
+            uint32_t hi = (uint32_t)(r >> 32);
+            if (lo >= hi)
+                return false;
+            if (range.compare_exchange_weak(r, pack_range(lo + 1, hi),
+                std::memory_order_acq_rel)) {
+                chunk = lo;
+                return true;
+            }
+        }
+    }
+
+    bool steal(int i, uint32_t &chunk) {
+        for (int k = 1; k < numshares; ++k) {
+            auto &range = shares[(i + k) % numshares].range;
+            uint64_t r = range.load(std::memory_order_relaxed);
+            while (true) {
+                uint32_t lo = (uint32_t)r;
+                uint32_t hi = (uint32_t)(r >> 32);
+                if (lo >= hi)
+                    break;
+                if (range.compare_exchange_weak(r, pack_range(lo, hi - 1),
+                    std::memory_order_acq_rel)) {
+                    chunk = hi - 1;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void run_chunk(uint32_t chunk) {
+        int64_t index = first_chunk + chunk;
+        int64_t b = begin + index * chunk_size;
+        int64_t e = std::min(end, b + chunk_size);
+        func(ctx, index, b, e);
+    }
+
+    // no chunks are ever added, so once all shares are empty, there is
+    // nothing left to take
+    void work(int i) {
+        uint32_t chunk;
+        while (take_own(i, chunk) || steal(i, chunk)) {
+            run_chunk(chunk);
+        }
+    }
+};
+
+struct JobHelper {
+    Job *job;
+    int share;
+};
+
+static void run_job_helper(void *ctx) {
+    auto helper = (JobHelper *)ctx;
+    helper->job->work(helper->share);
+    waitgroup_done(&helper->job->helpers);
+}
+
+} // namespace
+
+void parallel_for(int64_t begin, int64_t end, int64_t chunk_size,
+    ParallelChunkFunc func, void *ctx) {
+    assert(chunk_size > 0);
+    if (begin >= end)
+        return;
+    int64_t numchunks = (end - begin + chunk_size - 1) / chunk_size;
+    auto &s = get_scheduler();
+    int numshares = (int)std::min((int64_t)s.numqueues, numchunks);
+    if (numshares == 1) {
+        for (int64_t i = 0; i < numchunks; ++i) {
+            int64_t b = begin + i * chunk_size;
+            func(ctx, i, b, std::min(end, b + chunk_size));
+        }
+        return;
+    }
+    Job job;
+    job.begin = begin;
+    job.end = end;
+    job.chunk_size = chunk_size;
+    job.func = func;
+    job.ctx = ctx;
+    job.numshares = numshares;
+    job.shares.reset(new Share[numshares]);
+    std::vector<JobHelper> helpers;
+    for (int i = 1; i < numshares; ++i) {
+        helpers.push_back({ &job, i });
+    }
+    // shares count chunks in 32 bits, so huge loops run in rounds
+    const int64_t max_round = 0xffffffffll;
+    for (int64_t first = 0; first < numchunks; first += max_round) {
+        uint32_t count = (uint32_t)std::min(max_round, numchunks - first);
+        job.first_chunk = first;
+        for (int i = 0; i < numshares; ++i) {
+            uint32_t lo = (uint32_t)(((uint64_t)count * i) / numshares);
+            uint32_t hi = (uint32_t)(((uint64_t)count * (i + 1)) / numshares);
+            job.shares[i].range.store(pack_range(lo, hi));
+        }
+        job.helpers.count.store(numshares - 1);
+        for (auto &&helper : helpers) {
+            push_task(s, new_task(run_job_helper, &helper, false, 1));
+        }
+        job.work(0);
+        waitgroup_wait(&job.helpers);
+    }
+}
+
+} // namespace scopes
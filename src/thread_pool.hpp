@@ -0,0 +1,99 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_THREAD_POOL_HPP
+#define SCOPES_THREAD_POOL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// TASKS
+//------------------------------------------------------------------------------
+
+/* the task scheduler of the runtime. its threads are started on first use,
+   one less than there are cores, as threads outside the pool work along
+   while they wait. every pool thread pushes the tasks it spawns to the back
+   of its own queue and takes from there, so related work stays on one core;
+   a thread that runs dry steals from the front of another thread's queue.
+
+   a coroutine task runs on a stack of its own, so that it can yield, or wait
+   for other tasks, without holding on to its thread. any other task that
+   waits helps by running queued tasks in the meantime. */
+
+struct Task;
+struct WaitGroup;
+
+typedef void (*TaskFunc)(void *ctx);
+
+// the number of threads that run tasks, counting one thread outside the pool
+int thread_pool_size();
+// starts fresh pool threads in a child process that was forked while the
+// pool of the parent had no tasks queued or running
+void thread_pool_restart();
+
+// queues func(ctx) to run on the pool; the task must be joined or detached
+Task *task_spawn(TaskFunc func, void *ctx, bool coroutine);
+// waits for the task to complete and releases it
+void task_join(Task *task);
+// releases the task, which completes on its own
+void task_detach(Task *task);
+// lets other tasks run; suspends the calling coroutine, if there is one
+void task_yield();
+
+typedef void (*TaskParkFunc)(Task *task, void *ctx);
+
+// the coroutine task running on the calling thread, or null
+Task *task_current_coroutine();
+// suspends the calling coroutine until task_resume is called for it; once it
+// has been switched out, park(task, ctx) is called to hand the task to the
+// code that will resume it, so that resuming it right away is safe
+void task_park(TaskParkFunc park, void *ctx);
+// queues a parked coroutine to continue on the pool
+void task_resume(Task *task);
+
+WaitGroup *waitgroup_new();
+void waitgroup_add(WaitGroup *wg, int64_t count);
+void waitgroup_done(WaitGroup *wg);
+// waits until as many calls to waitgroup_done as were added have been made
+void waitgroup_wait(WaitGroup *wg);
+void waitgroup_free(WaitGroup *wg);
+
+//------------------------------------------------------------------------------
+// PARALLEL LOOPS
+//------------------------------------------------------------------------------
+
+/* a loop is split into chunks, and every thread starts on an equal share of
+   them; a thread that runs out of chunks steals the last remaining chunk of
+   another thread's share, so uneven chunks balance out. */
+
+typedef void (*ParallelChunkFunc)(void *ctx, int64_t chunk,
+    int64_t begin, int64_t end);
+
+// calls func once for every chunk of chunk_size indices in [begin, end), where
+// chunk is the number of the chunk in order; returns when all have completed.
+void parallel_for(int64_t begin, int64_t end, int64_t chunk_size,
+    ParallelChunkFunc func, void *ctx);
+
+// calls f(i) for every i in [0, count) on the pool
+template<typename F>
+void parallel_for_each(size_t count, F &&f) {
+    typedef typename std::remove_reference<F>::type FT;
+    parallel_for(0, (int64_t)count, 1,
+        [](void *ctx, int64_t chunk, int64_t begin, int64_t end) {
+            auto &f = *(FT *)ctx;
+            for (int64_t i = begin; i < end; ++i) {
+                f((size_t)i);
+            }
+        }, (void *)&f);
+}
+
+} // namespace scopes
+
+#endif // SCOPES_THREAD_POOL_HPP
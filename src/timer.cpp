@@ -5,58 +5,226 @@
 */
 
 #include "timer.hpp"
+#include "trace.hpp"
 #include "absl/container/flat_hash_map.h"
+#include "symbol_enum.inc"
+#include "scopes/config.h"
+
+#include <mutex>
 
 namespace scopes {
 
-struct TimerData {
-    double time;
+// totals are kept in nanoseconds
+struct TimerSlot {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> inclusive;
+    std::atomic<uint64_t> exclusive;
+    std::atomic<uint64_t> max;
+
+    constexpr TimerSlot() : count(0), inclusive(0), exclusive(0), max(0) {}
+
+    void record(uint64_t incl, uint64_t excl) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        inclusive.fetch_add(incl, std::memory_order_relaxed);
+        exclusive.fetch_add(excl, std::memory_order_relaxed);
+        auto prev = max.load(std::memory_order_relaxed);
+        while ((incl > prev)
+            && !max.compare_exchange_weak(prev, incl, std::memory_order_relaxed)) {
+        }
+    }
+
+    void reset() {
+        count.store(0, std::memory_order_relaxed);
+        inclusive.store(0, std::memory_order_relaxed);
+        exclusive.store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+};
+
+enum {
+#define T(NAME, STR) SLOT_ ## NAME,
+    SCOPES_TIMER_SYMBOLS()
+#undef T
+    SCOPES_TIMER_SLOTS
+};
 
-    TimerData() : time(0.0) {}
+static const KnownSymbol timer_slot_names[] = {
+#define T(NAME, STR) NAME,
+    SCOPES_TIMER_SYMBOLS()
+#undef T
 };
 
-static absl::flat_hash_map<Symbol, TimerData, Symbol::Hash> timers;
+// the known timers have fixed slots
+static TimerSlot timer_slots[SCOPES_TIMER_SLOTS];
+// any other names go here; slots are never freed
+static absl::flat_hash_map<Symbol, TimerSlot *, Symbol::Hash> other_timers;
+// timers can also run on background threads
+static std::mutex timers_mutex;
+
+static std::atomic<bool> timers_enabled(SCOPES_PRINT_TIMERS != 0);
+
+static TimerSlot &timer_slot(Symbol name) {
+    switch(name.value()) {
+#define T(NAME, STR) case NAME: return timer_slots[SLOT_ ## NAME];
+    SCOPES_TIMER_SYMBOLS()
+#undef T
+    default: break;
+    }
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    auto &slot = other_timers[name];
+    if (!slot)
+        slot = new TimerSlot();
+    return *slot;
+}
+
+static double ns_to_ms(uint64_t ns) {
+    return (double)ns * 1e-6;
+}
+
+static uint64_t to_ns(Timer::clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
 
 //------------------------------------------------------------------------------
 // TIMER
 //------------------------------------------------------------------------------
 
-static Timer *active_timer = nullptr;
+// every thread has its own stack of active timers
+static thread_local Timer *active_timer = nullptr;
 static Timer unknown_timer(TIMER_Unknown);
+// registered during static initialization
+static Counter *counters = nullptr;
+static MemoryStat *memory_stats = nullptr;
 
 void Timer::pause() {
-    std::chrono::duration<double> diff = std::chrono::high_resolution_clock::now() - start;
-    auto &&data = timers[name];
-    data.time += (diff.count() * 1000.0);
+    exclusive += clock::now() - start;
 }
 
 void Timer::resume() {
-    start = std::chrono::high_resolution_clock::now();
+    start = clock::now();
 }
 
-Timer::Timer(Symbol _name) : prev_timer(active_timer), name(_name) {
+Timer::Timer(Symbol _name) :
+    prev_timer(nullptr), name(_name),
+    active(timers_enabled.load(std::memory_order_relaxed)),
+    exclusive(clock::duration::zero()),
+    trace_start(trace_enabled()?trace_now():-1) {
+    if (!active)
+        return;
+    prev_timer = active_timer;
     if (active_timer)
         active_timer->pause();
     active_timer = this;
-    resume();
+    created = clock::now();
+    start = created;
 }
+
 Timer::~Timer() {
-    pause();
+    if (trace_start >= 0)
+        trace_complete("timer", name.name()->data, trace_start, trace_now());
+    if (!active)
+        return;
+    auto now = clock::now();
+    exclusive += now - start;
+    timer_slot(name).record(to_ns(now - created), to_ns(exclusive));
     active_timer = prev_timer;
     if (active_timer)
         active_timer->resume();
 }
 
+void Timer::set_enabled(bool enable) {
+    timers_enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool Timer::is_enabled() {
+    return timers_enabled.load(std::memory_order_relaxed);
+}
+
+static void add_stats(std::vector<TimerStats> &stats, Symbol name,
+    const TimerSlot &slot) {
+    auto count = slot.count.load(std::memory_order_relaxed);
+    if (!count)
+        return;
+    stats.push_back({ name, count,
+        ns_to_ms(slot.inclusive.load(std::memory_order_relaxed)),
+        ns_to_ms(slot.exclusive.load(std::memory_order_relaxed)),
+        ns_to_ms(slot.max.load(std::memory_order_relaxed)) });
+}
+
+void Timer::snapshot(std::vector<TimerStats> &stats) {
+    for (int i = 0; i < SCOPES_TIMER_SLOTS; ++i) {
+        add_stats(stats, Symbol(timer_slot_names[i]), timer_slots[i]);
+    }
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    for (auto &&it : other_timers) {
+        add_stats(stats, it.first, *it.second);
+    }
+}
+
+void Timer::reset_timers() {
+    for (int i = 0; i < SCOPES_TIMER_SLOTS; ++i) {
+        timer_slots[i].reset();
+    }
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    for (auto &&it : other_timers) {
+        it.second->reset();
+    }
+}
+
 void Timer::print_timers() {
     StyledStream ss;
+    std::vector<TimerStats> stats;
+    snapshot(stats);
     double real_sum = 0.0;
-    double non_user_sum = timers[TIMER_Main].time;
-    for (auto &&it : timers) {
-        ss << it.first.name()->data << ": " << it.second.time << "ms" << std::endl;
-        real_sum += it.second.time;
+    double non_user_sum = 0.0;
+    for (auto &&it : stats) {
+        ss << it.name.name()->data << ": " << it.exclusive << "ms"
+            << " (inclusive " << it.inclusive << "ms, "
+            << it.count << " runs, max " << it.max << "ms)" << std::endl;
+        real_sum += it.exclusive;
+        if (it.name == TIMER_Main)
+            non_user_sum = it.exclusive;
     }
     ss << "cumulative real: " << real_sum << "ms" << std::endl;
     ss << "cumulative user: " << (real_sum - non_user_sum) << "ms" << std::endl;
+    for (auto c = counters; c; c = c->next_counter) {
+        ss << c->name.name()->data << ": " << c->count.load() << std::endl;
+    }
+    std::vector< std::pair<const char *, MemoryUsage> > memory;
+    MemoryStat::snapshot(memory);
+    uint64_t total = 0;
+    for (auto &&it : memory) {
+        ss << it.first << ": " << it.second.objects << " objects, "
+            << (it.second.bytes >> 10) << "KB" << std::endl;
+        total += it.second.bytes;
+    }
+    ss << "accounted memory: " << (total >> 10) << "KB" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// COUNTER
+//------------------------------------------------------------------------------
+
+Counter::Counter(Symbol _name) : next_counter(counters), name(_name), count(0) {
+    counters = this;
+}
+
+//------------------------------------------------------------------------------
+// MEMORY STAT
+//------------------------------------------------------------------------------
+
+MemoryStat::MemoryStat(const char *_name, MeasureFunc _measure) :
+    next_stat(memory_stats), name(_name), measure(_measure) {
+    memory_stats = this;
+}
+
+void MemoryStat::snapshot(
+    std::vector< std::pair<const char *, MemoryUsage> > &stats) {
+    for (auto s = memory_stats; s; s = s->next_stat) {
+        MemoryUsage usage = { 0, 0 };
+        s->measure(usage);
+        stats.push_back({ s->name, usage });
+    }
 }
 
 } // namespace scopes
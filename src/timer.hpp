@@ -10,6 +10,9 @@
 #include "symbol.hpp"
 
 #include <chrono>
+#include <atomic>
+#include <stdint.h>
+#include <vector>
 
 namespace scopes {
 
@@ -17,11 +20,30 @@ namespace scopes {
 // TIMER
 //------------------------------------------------------------------------------
 
+// accumulated statistics of one timer name; times are in milliseconds
+struct TimerStats {
+    Symbol name;
+    uint64_t count;
+    // including the time spent in nested timers
+    double inclusive;
+    // excluding the time spent in nested timers
+    double exclusive;
+    // longest inclusive time of a single run
+    double max;
+};
+
 struct Timer {
+    typedef std::chrono::high_resolution_clock clock;
+
     Timer *prev_timer;
     Symbol name;
-    std::chrono::time_point<std::chrono::high_resolution_clock> start;
-    std::chrono::time_point<std::chrono::high_resolution_clock> end;
+    // timers created while timing is disabled record nothing
+    bool active;
+    clock::time_point created;
+    clock::time_point start;
+    clock::duration exclusive;
+    // start of the trace event, or -1 if tracing was off
+    int64_t trace_start;
 
     Timer(Symbol _name);
     ~Timer();
@@ -29,9 +51,66 @@ struct Timer {
     void pause();
     void resume();
 
+    // timing is enabled by default if SCOPES_PRINT_TIMERS is set
+    static void set_enabled(bool enable);
+    static bool is_enabled();
+    // lists every timer that has completed at least once since the last reset
+    static void snapshot(std::vector<TimerStats> &stats);
+    static void reset_timers();
     static void print_timers();
 };
 
+//------------------------------------------------------------------------------
+// COUNTER
+//------------------------------------------------------------------------------
+
+// an event count that is listed alongside the timers; counters are expected
+// to be static objects
+struct Counter {
+    Counter *next_counter;
+    Symbol name;
+    std::atomic<uint64_t> count;
+
+    Counter(Symbol _name);
+
+    void increment() {
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+//------------------------------------------------------------------------------
+// MEMORY STAT
+//------------------------------------------------------------------------------
+
+struct MemoryUsage {
+    uint64_t objects;
+    uint64_t bytes;
+};
+
+// a named source of memory usage that is listed alongside the timers; stats
+// are expected to be static objects. measure is only called when statistics
+// are collected; it may read tables without locking them, so figures are
+// approximate while other threads are compiling.
+struct MemoryStat {
+    typedef void (*MeasureFunc)(MemoryUsage &usage);
+
+    MemoryStat *next_stat;
+    const char *name;
+    MeasureFunc measure;
+
+    MemoryStat(const char *_name, MeasureFunc _measure);
+
+    static void snapshot(
+        std::vector< std::pair<const char *, MemoryUsage> > &stats);
+};
+
+// the memory held by an absl hash table itself, excluding what its elements
+// point to
+template<typename T>
+inline uint64_t hash_table_bytes(const T &table) {
+    return table.capacity() * (sizeof(typename T::value_type) + 1);
+}
+
 } // namespace scopes
 
 #endif // SCOPES_TIMER_HPP
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "trace.hpp"
+
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// TRACE
+//------------------------------------------------------------------------------
+
+struct TraceEvent {
+    const char *category;
+    std::string name;
+    int64_t start;
+    // -1 for instant events
+    int64_t duration;
+    int thread;
+};
+
+std::atomic<bool> g_trace_enabled(false);
+
+static std::vector<TraceEvent> trace_events;
+// events are recorded from background threads as well
+static std::mutex trace_mutex;
+static std::atomic<int> next_trace_thread(0);
+static thread_local int trace_thread = -1;
+
+static int get_trace_thread() {
+    if (trace_thread < 0)
+        trace_thread = next_trace_thread.fetch_add(1, std::memory_order_relaxed);
+    return trace_thread;
+}
+
+void set_trace_enabled(bool enable) {
+    g_trace_enabled.store(enable, std::memory_order_relaxed);
+}
+
+int64_t trace_now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+void trace_complete(const char *category, std::string name,
+    int64_t start, int64_t end) {
+    auto thread = get_trace_thread();
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_events.push_back({ category, std::move(name), start, end - start, thread });
+}
+
+void trace_instant(const char *category, std::string name) {
+    if (!trace_enabled())
+        return;
+    auto thread = get_trace_thread();
+    auto now = trace_now();
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_events.push_back({ category, std::move(name), now, -1, thread });
+}
+
+static void write_json_string(FILE *f, const std::string &s) {
+    fputc('"', f);
+    for (unsigned char c : s) {
+        switch(c) {
+        case '"': fputs("\\\"", f); break;
+        case '\\': fputs("\\\\", f); break;
+        case '\n': fputs("\\n", f); break;
+        case '\t': fputs("\\t", f); break;
+        default: {
+            if (c < 0x20) {
+                fprintf(f, "\\u%04x", c);
+            } else {
+                fputc(c, f);
+            }
+        } break;
+        }
+    }
+    fputc('"', f);
+}
+
+bool write_trace(const char *path) {
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        events.swap(trace_events);
+    }
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+    fputs("{\"traceEvents\":[\n", f);
+    bool first = true;
+    for (auto &&event : events) {
+        if (!first)
+            fputs(",\n", f);
+        first = false;
+        fputs("{\"name\":", f);
+        write_json_string(f, event.name);
+        fprintf(f, ",\"cat\":\"%s\"", event.category);
+        if (event.duration < 0) {
+            fprintf(f, ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld",
+                (long long)event.start);
+        } else {
+            fprintf(f, ",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld",
+                (long long)event.start, (long long)event.duration);
+        }
+        fprintf(f, ",\"pid\":1,\"tid\":%d}", event.thread);
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+    bool ok = !ferror(f);
+    return (fclose(f) == 0) && ok;
+}
+
+} // namespace scopes
@@ -0,0 +1,66 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_TRACE_HPP
+#define SCOPES_TRACE_HPP
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// TRACE
+//------------------------------------------------------------------------------
+
+/* an opt-in recorder of compiler events that is written out in the Chrome
+   trace event format, which chrome://tracing and Perfetto can display. while
+   tracing is disabled, a trace scope costs one relaxed load. */
+
+extern std::atomic<bool> g_trace_enabled;
+
+inline bool trace_enabled() {
+    return g_trace_enabled.load(std::memory_order_relaxed);
+}
+
+void set_trace_enabled(bool enable);
+// microseconds since the first call
+int64_t trace_now();
+void trace_complete(const char *category, std::string name,
+    int64_t start, int64_t end);
+// records an event without a duration
+void trace_instant(const char *category, std::string name);
+// writes all recorded events to path and discards them; returns false if the
+// file could not be written
+bool write_trace(const char *path);
+
+// records a complete event spanning the lifetime of the object; describe()
+// returns the name of the event and is only called while tracing
+struct TraceScope {
+    template<typename F>
+    TraceScope(const char *_category, F &&describe) :
+        category(_category), start(-1) {
+        if (trace_enabled()) {
+            name = describe();
+            start = trace_now();
+        }
+    }
+
+    ~TraceScope() {
+        if (start >= 0)
+            trace_complete(category, std::move(name), start, trace_now());
+    }
+
+protected:
+    const char *category;
+    std::string name;
+    int64_t start;
+};
+
+} // namespace scopes
+
+#endif // SCOPES_TRACE_HPP
@@ -32,7 +32,7 @@ B_TYPE_KIND()
 
 TypeKind Type::kind() const { return _kind; } // for this codebase
 
-Type::Type(TypeKind kind) : _kind(kind) {}
+Type::Type(TypeKind kind) : _kind(kind), _symbols_version(0) {}
 
 StyledStream& Type::stream(StyledStream& ost) const {
     StyledString ss = StyledString::plain();
@@ -43,8 +43,11 @@ StyledStream& Type::stream(StyledStream& ost) const {
     return ost;
 }
 
+static thread_local TypeDependencies *type_dependencies = nullptr;
+
 void Type::bind_with_doc(Symbol name, const TypeEntry &entry) const {
     symbols.replace(name, entry);
+    _symbols_version++;
 }
 
 void Type::bind(Symbol name, const ValueRef &value) const {
@@ -54,11 +57,14 @@ void Type::bind(Symbol name, const ValueRef &value) const {
 
 void Type::unbind(Symbol name) const {
     symbols.discard(name);
+    _symbols_version++;
 }
 
 bool Type::lookup(Symbol name, TypeEntry &dest) const {
     const Type *self = this;
     do {
+        if (type_dependencies)
+            type_dependencies->add(self);
         auto index = self->symbols.find_index(name);
         if (index >= 0) {
             dest = self->symbols.entries[index].second;
@@ -81,6 +87,8 @@ bool Type::lookup(Symbol name, ValueRef &dest) const {
 }
 
 bool Type::lookup_local(Symbol name, TypeEntry &dest) const {
+    if (type_dependencies)
+        type_dependencies->add(this);
     auto index = symbols.find_index(name);
     if (index >= 0) {
         dest = symbols.entries[index].second;
@@ -111,14 +119,54 @@ bool Type::lookup_quote_handler(ValueRef &dest) const {
 }
 
 const Type::Map &Type::get_symbols() const {
+    if (type_dependencies)
+        type_dependencies->add(this);
     return symbols;
 }
 
+uint64_t Type::symbols_version() const {
+    return _symbols_version;
+}
+
+//------------------------------------------------------------------------------
+
+void TypeDependencies::add(const Type *T) {
+    versions.insert({T, T->symbols_version()});
+}
+
+void TypeDependencies::merge(const TypeDependencies &other) {
+    for (auto &&entry : other.versions) {
+        versions.insert(entry);
+    }
+}
+
+bool TypeDependencies::valid() const {
+    for (auto &&entry : versions) {
+        if (entry.first->symbols_version() != entry.second)
+            return false;
+    }
+    return true;
+}
+
+TypeDependencyScope::TypeDependencyScope(TypeDependencies *deps) {
+    old_deps = type_dependencies;
+    type_dependencies = deps;
+}
+
+TypeDependencyScope::~TypeDependencyScope() {
+    type_dependencies = old_deps;
+}
+
+TypeDependencies *get_type_dependencies() {
+    return type_dependencies;
+}
+
 std::vector<Symbol> Type::find_closest_match(Symbol name) const {
     const String *s = name.name();
     absl::flat_hash_set<Symbol, Symbol::Hash> done;
     std::vector<Symbol> best_syms;
     size_t best_dist = (size_t)-1;
+    DistanceQuery query(s);
     const Type *self = this;
     do {
         auto &&map = self->symbols;
@@ -126,10 +174,12 @@ std::vector<Symbol> Type::find_closest_match(Symbol name) const {
         auto &&keys = map.entries;
         //auto &&values = map.values;
         for (int i = 0; i < count; ++i) {
+            if (map.is_discarded(i))
+                continue;
             Symbol sym = keys[i].first;
             if (done.count(sym))
                 continue;
-            size_t dist = distance(s, sym.name());
+            size_t dist = query(sym.name());
             if (dist == best_dist) {
                 best_syms.push_back(sym);
             } else if (dist < best_dist) {
@@ -426,8 +476,14 @@ SCOPES_RESULT(const Type *) qualified_storage_type(const Type *T) {
     //SCOPES_RESULT_TYPE(const Type *);
     auto rq = try_qualifier<ReferQualifier>(T);
     if (rq) {
-        T = strip_qualifiers(T);
-        return pointer_type(T, rq->flags, rq->storage_class);
+        // saves interning the pointer type again on every layout query
+        auto qt = cast<QualifyType>(T);
+        auto ST = qt->refer_storage.load(std::memory_order_relaxed);
+        if (!ST) {
+            ST = pointer_type(strip_qualifiers(T), rq->flags, rq->storage_class);
+            qt->refer_storage.store(ST, std::memory_order_relaxed);
+        }
+        return ST;
     } else {
         return storage_type(T);
     }
@@ -568,8 +624,14 @@ void init_types() {
     DEFINE_OPAQUE_HANDLE_TYPE("Anchor", Anchor, TYPE_Anchor, nullptr);
 
 
+#if SCOPES_COMPACT_VALUEREF
+    // the anchor is packed into the reference
+    DEFINE_BASIC_TYPE("Value", ValueRef, TYPE_ValueRef, nullptr,
+        tuple_type({ TYPE__Value }).assert_ok());
+#else
     DEFINE_BASIC_TYPE("Value", ValueRef, TYPE_ValueRef, nullptr,
         tuple_type({ TYPE__Value, TYPE_Anchor }).assert_ok());
+#endif
 
     DEFINE_BASIC_TYPE("CompileStage", ValueRef, TYPE_CompileStage,
         nullptr, storage_type(TYPE_ValueRef).assert_ok());
@@ -92,17 +92,45 @@ struct Type {
 
     const Map &get_symbols() const;
 
+    // incremented whenever a symbol of this type is bound or unbound
+    uint64_t symbols_version() const;
+
 private:
     const TypeKind _kind;
 
 protected:
     mutable Map symbols;
+    mutable uint64_t _symbols_version;
 };
 
 typedef std::vector<const Type *> Types;
 
 //------------------------------------------------------------------------------
 
+// the types whose symbols were read while the dependencies were being
+// recorded, with the version of their symbols at the time
+struct TypeDependencies {
+    void add(const Type *T);
+    void merge(const TypeDependencies &other);
+    // true if none of the recorded types has changed since
+    bool valid() const;
+
+    absl::flat_hash_map<const Type *, uint64_t> versions;
+};
+
+// while in scope, all symbol lookups on types are recorded by deps
+struct TypeDependencyScope {
+    TypeDependencyScope(TypeDependencies *deps);
+    ~TypeDependencyScope();
+
+    TypeDependencies *old_deps;
+};
+
+// the dependencies presently being recorded, if any
+TypeDependencies *get_type_dependencies();
+
+//------------------------------------------------------------------------------
+
 #define B_TYPES() \
     /* types */ \
     T(TYPE_Nothing, "Nothing") \
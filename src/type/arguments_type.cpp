@@ -5,9 +5,11 @@
 */
 
 #include "arguments_type.hpp"
+#include "../timer.hpp"
 #include "tuple_type.hpp"
 #include "typename_type.hpp"
 #include "../hash.hpp"
+#include "../intern.hpp"
 #include "../dyn_cast.inc"
 #include "../result.hpp"
 
@@ -20,11 +22,7 @@ namespace scopes {
 namespace ArgumentsSet {
     struct Hash {
         std::size_t operator()(const ArgumentsType *s) const {
-            std::size_t h = 0;
-            for (auto &&arg : s->values) {
-                h = hash2(h, std::hash<const Type *>{}(arg));
-            }
-            return h;
+            return s->prehash;
         }
     };
 
@@ -45,6 +43,11 @@ namespace ArgumentsSet {
 static absl::flat_hash_set<const ArgumentsType *,
     ArgumentsSet::Hash, ArgumentsSet::KeyEqual> arguments;
 
+static MemoryStat arguments_memory("argument types", [](MemoryUsage &usage) {
+    usage.objects = arguments.size();
+    usage.bytes = hash_table_bytes(arguments) + arguments.size() * sizeof(ArgumentsType);
+});
+
 //------------------------------------------------------------------------------
 // ARGUMENTS TYPE
 //------------------------------------------------------------------------------
@@ -71,8 +74,16 @@ const TupleType *ArgumentsType::to_tuple_type() const {
     return cast<TupleType>(tuple_type(storage_types).assert_ok());
 }
 
+static std::size_t hash_arguments(const Types &values) {
+    std::size_t h = 0;
+    for (auto &&arg : values) {
+        h = hash2(h, std::hash<const Type *>{}(arg));
+    }
+    return h;
+}
+
 ArgumentsType::ArgumentsType(const Types &_values) :
-    Type(TK_Arguments), values(_values) {
+    Type(TK_Arguments), values(_values), prehash(hash_arguments(_values)) {
 }
 
 SCOPES_RESULT(const Type *) ArgumentsType::type_at_index(size_t i) const {
@@ -99,12 +110,22 @@ const Type *arguments_type(const Types &values) {
         }
         idx++;
     }
+    static thread_local InternCache<const ArgumentsType *> cache;
+    auto h = hash_arguments(newvalues);
+    const ArgumentsType *result;
+    if (cache.find(h, result, [&](const ArgumentsType *T) {
+            return T->values == newvalues;
+        }))
+        return result;
     ArgumentsType key(newvalues);
     auto it = arguments.find(&key);
-    if (it != arguments.end())
-        return *it;
-    auto result = new ArgumentsType(newvalues);
-    arguments.insert(result);
+    if (it != arguments.end()) {
+        result = *it;
+    } else {
+        result = new ArgumentsType(newvalues);
+        arguments.insert(result);
+    }
+    cache.insert(h, result);
     return result;
 }
 
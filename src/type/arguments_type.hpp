@@ -27,6 +27,7 @@ struct ArgumentsType : Type {
     SCOPES_RESULT(const Type *) type_at_index(size_t i) const;
 
     Types values;
+    std::size_t prehash;
 };
 
 const Type *arguments_type(const Types &values);
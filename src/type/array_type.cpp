@@ -5,10 +5,10 @@
 */
 
 #include "array_type.hpp"
+#include "../timer.hpp"
 #include "../error.hpp"
 #include "../hash.hpp"
-
-#include "absl/container/flat_hash_set.h"
+#include "../intern.hpp"
 
 namespace scopes {
 
@@ -32,7 +32,12 @@ struct KeyEqual {
 };
 } // namespace ArraySet
 
-static absl::flat_hash_set<const ArrayType *, ArraySet::Hash, ArraySet::KeyEqual> arrays;
+static InternSet<const ArrayType *, ArraySet::Hash, ArraySet::KeyEqual> arrays;
+
+static MemoryStat arrays_memory("array types", [](MemoryUsage &usage) {
+    arrays.measure(usage.objects, usage.bytes);
+    usage.bytes += usage.objects * sizeof(ArrayType);
+});
 
 //------------------------------------------------------------------------------
 // ARRAY TYPE
@@ -68,14 +73,22 @@ SCOPES_RESULT(const Type *) array_type(
     key->element_type = element_type;
     key->_count = count;
     key->_zterm = zterm;
-    auto it = arrays.find(key);
-    if (it != arrays.end())
-        return *it;
+    // arrays of opaque types are never interned
     if (is_opaque(element_type)) {
         SCOPES_ERROR(OpaqueType, element_type);
     }
-    const ArrayType *result = new ArrayType(element_type, count, zterm);
-    arrays.insert(result);
+    // spares taking the lock of the shared table
+    static thread_local InternCache<const ArrayType *> cache;
+    auto h = ArraySet::Hash()(key);
+    const ArrayType *result;
+    if (cache.find(h, result, [&](const ArrayType *T) {
+            return ArraySet::KeyEqual()(T, key);
+        }))
+        return result;
+    result = arrays.intern(key, [&]() {
+        return (const ArrayType *)new ArrayType(element_type, count, zterm);
+    });
+    cache.insert(h, result);
     return result;
 }
 
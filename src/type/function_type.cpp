@@ -5,6 +5,7 @@
 */
 
 #include "function_type.hpp"
+#include "../timer.hpp"
 #include "arguments_type.hpp"
 #include "tuple_type.hpp"
 #include "pointer_type.hpp"
@@ -12,6 +13,7 @@
 #include "../error.hpp"
 #include "../dyn_cast.inc"
 #include "../hash.hpp"
+#include "../intern.hpp"
 
 #include "../qualifier/unique_qualifiers.hpp"
 #include "../qualifier.inc"
@@ -90,6 +92,14 @@ SCOPES_RESULT(const Type *) FunctionType::type_at_index(size_t i) const {
 
 //------------------------------------------------------------------------------
 
+// the type tables are local to function_type(), so they are only counted
+static std::atomic<uint64_t> function_type_count(0);
+
+static MemoryStat function_types_memory("function types", [](MemoryUsage &usage) {
+    usage.objects = function_type_count.load(std::memory_order_relaxed);
+    usage.bytes = usage.objects * sizeof(FunctionType);
+});
+
 static void canonicalize_unique_types(ID2SetMap &idmap, Types &types,
     int idoffset = 0, int idscale = 1) {
     int argcount = types.size();
@@ -162,6 +172,7 @@ const Type *raising_function_type(const Type *except_type, const Type *return_ty
         const Type *return_type;
         Types argtypes;
         uint32_t flags;
+        std::size_t prehash;
 
         TypeArgs() {}
         TypeArgs(const Type *_except_type,
@@ -171,9 +182,21 @@ const Type *raising_function_type(const Type *except_type, const Type *return_ty
             except_type(_except_type),
             return_type(_return_type),
             argtypes(_argument_types),
-            flags(_flags)
+            flags(_flags),
+            prehash(hash(_except_type, _return_type, _argument_types, _flags))
         {}
 
+        static std::size_t hash(const Type *except_type,
+            const Type *return_type, const Types &argtypes, uint32_t flags) {
+            std::size_t h = std::hash<const Type *>{}(except_type);
+            h = hash2(h, std::hash<const Type *>{}(return_type));
+            h = hash2(h, std::hash<uint32_t>{}(flags));
+            for (auto arg : argtypes) {
+                h = hash2(h, std::hash<const Type *>{}(arg));
+            }
+            return h;
+        }
+
         bool operator==(const TypeArgs &other) const {
             if (except_type != other.except_type) return false;
             if (return_type != other.return_type) return false;
@@ -188,13 +211,7 @@ const Type *raising_function_type(const Type *except_type, const Type *return_ty
 
         struct Hash {
             std::size_t operator()(const TypeArgs& s) const {
-                std::size_t h = std::hash<const Type *>{}(s.except_type);
-                h = hash2(h, std::hash<const Type *>{}(s.return_type));
-                h = hash2(h, std::hash<uint32_t>{}(s.flags));
-                for (auto arg : s.argtypes) {
-                    h = hash2(h, std::hash<const Type *>{}(arg));
-                }
-                return h;
+                return s.prehash;
             }
         };
     };
@@ -204,15 +221,29 @@ const Type *raising_function_type(const Type *except_type, const Type *return_ty
     static ArgMap map;
 
 #if 1
+    // spares copying the argument types into a key
+    static thread_local InternCache<const FunctionType *> cache;
+    auto h = TypeArgs::hash(except_type, return_type, argument_types, flags);
+    const FunctionType *result;
+    if (cache.find(h, result, [&](const FunctionType *T) {
+            return (T->except_type == except_type)
+                && (T->return_type == return_type)
+                && (T->flags == flags)
+                && (T->argument_types == argument_types);
+        }))
+        return result;
     TypeArgs ta(except_type, return_type, argument_types, flags);
     typename ArgMap::iterator it = map.find(ta);
     if (it == map.end()) {
         FunctionType *t = new FunctionType(except_type, return_type, argument_types, flags);
+        function_type_count.fetch_add(1, std::memory_order_relaxed);
         map.insert({ta, t});
-        return t;
+        result = t;
     } else {
-        return it->second;
+        result = it->second;
     }
+    cache.insert(h, result);
+    return result;
 #else
     TypeArgs ta(except_type, return_type, argument_types, flags);
     typename ArgMap::iterator it = map.find(ta);
@@ -247,6 +278,7 @@ const Type *raising_function_type(const Type *except_type, const Type *return_ty
         it = map.find(tb);
         if (it == map.end()) {
             FunctionType *t = new FunctionType(except_type, return_type, argument_types, flags);
+            function_type_count.fetch_add(1, std::memory_order_relaxed);
             map.insert({ta, t});
             if (!(ta == tb)) {
                 map.insert({tb, t});
@@ -5,6 +5,7 @@
 */
 
 #include "image_type.hpp"
+#include "../timer.hpp"
 #include "../hash.hpp"
 
 #include "absl/container/flat_hash_set.h"
@@ -43,6 +44,11 @@ namespace ImageSet {
 
 static absl::flat_hash_set<const ImageType *, ImageSet::Hash, ImageSet::KeyEqual> images;
 
+static MemoryStat images_memory("image types", [](MemoryUsage &usage) {
+    usage.objects = images.size();
+    usage.bytes = hash_table_bytes(images) + images.size() * sizeof(ImageType);
+});
+
 //------------------------------------------------------------------------------
 // IMAGE TYPE
 //------------------------------------------------------------------------------
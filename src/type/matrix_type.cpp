@@ -5,6 +5,7 @@
 */
 
 #include "matrix_type.hpp"
+#include "../timer.hpp"
 #include "vector_type.hpp"
 #include "typename_type.hpp"
 #include "../error.hpp"
@@ -36,6 +37,11 @@ struct KeyEqual {
 
 static absl::flat_hash_set<const MatrixType *, MatrixSet::Hash, MatrixSet::KeyEqual> matrices;
 
+static MemoryStat matrices_memory("matrix types", [](MemoryUsage &usage) {
+    usage.objects = matrices.size();
+    usage.bytes = hash_table_bytes(matrices) + matrices.size() * sizeof(MatrixType);
+});
+
 //------------------------------------------------------------------------------
 // MATRIX TYPE
 //------------------------------------------------------------------------------
@@ -5,6 +5,7 @@
 */
 
 #include "pointer_type.hpp"
+#include "../timer.hpp"
 #include "typename_type.hpp"
 #include "../hash.hpp"
 #include "../error.hpp"
@@ -37,6 +38,11 @@ namespace PointerSet {
 
 static absl::flat_hash_set<const PointerType *, PointerSet::Hash, PointerSet::KeyEqual> pointers;
 
+static MemoryStat pointers_memory("pointer types", [](MemoryUsage &usage) {
+    usage.objects = pointers.size();
+    usage.bytes = hash_table_bytes(pointers) + pointers.size() * sizeof(PointerType);
+});
+
 //------------------------------------------------------------------------------
 // POINTER TYPE
 //------------------------------------------------------------------------------
@@ -5,12 +5,13 @@
 */
 
 #include "qualify_type.hpp"
+#include "../timer.hpp"
 #include "../hash.hpp"
 #include "../dyn_cast.inc"
 #include "../qualifiers.hpp"
+#include "../intern.hpp"
 
 #include <algorithm>
-#include "absl/container/flat_hash_set.h"
 #include <cstring>
 
 namespace scopes {
@@ -55,7 +56,12 @@ struct KeyEqual {
 };
 } // namespace QualifySet
 
-static absl::flat_hash_set<const QualifyType *, QualifySet::Hash, QualifySet::KeyEqual> qualifys;
+static InternSet<const QualifyType *, QualifySet::Hash, QualifySet::KeyEqual> qualifys;
+
+static MemoryStat qualifys_memory("qualified types", [](MemoryUsage &usage) {
+    qualifys.measure(usage.objects, usage.bytes);
+    usage.bytes += usage.objects * sizeof(QualifyType);
+});
 
 //------------------------------------------------------------------------------
 
@@ -88,7 +94,7 @@ SCOPES_QUALIFIER_KIND()
 }
 
 QualifyType::QualifyType(const Type *_type, const Qualifier * const *_qualifiers)
-    : Type(TK_Qualify), type(_type), mask(0) {
+    : Type(TK_Qualify), type(_type), mask(0), refer_storage(nullptr) {
     std::size_t h = std::hash<const Type *>{}(type);
     for (int i = 0; i < QualifierCount; ++i) {
         qualifiers[i] = _qualifiers[i];
@@ -104,12 +110,18 @@ QualifyType::QualifyType(const Type *_type, const Qualifier * const *_qualifiers
 //------------------------------------------------------------------------------
 
 static const Type *_qualify(const Type *type, const Qualifier * const * quals) {
+    // spares taking the lock of the shared table
+    static thread_local InternCache<const QualifyType *> cache;
     QualifyType key(type, quals);
-    auto it = qualifys.find(&key);
-    if (it != qualifys.end())
-        return *it;
-    auto result = new QualifyType(type, quals);
-    qualifys.insert(result);
+    const QualifyType *result;
+    if (cache.find(key.prehash, result, [&](const QualifyType *T) {
+            return QualifySet::KeyEqual()(T, &key);
+        }))
+        return result;
+    result = qualifys.intern(&key, [&]() {
+        return (const QualifyType *)new QualifyType(type, quals);
+    });
+    cache.insert(key.prehash, result);
     return result;
 }
 
@@ -10,6 +10,7 @@
 #include "../type.hpp"
 
 #include <vector>
+#include <atomic>
 #include "absl/container/flat_hash_map.h"
 
 namespace scopes {
@@ -68,6 +69,8 @@ struct QualifyType : Type {
     uint32_t mask;
     const Qualifier *qualifiers[QualifierCount];
     std::size_t prehash;
+    // pointer type that a reference is stored as; set on first use
+    mutable std::atomic<const Type *> refer_storage;
 };
 
 //------------------------------------------------------------------------------
@@ -5,6 +5,7 @@
 */
 
 #include "sampledimage_type.hpp"
+#include "../timer.hpp"
 #include "image_type.hpp"
 #include "../dyn_cast.inc"
 #include "../hash.hpp"
@@ -29,6 +30,11 @@ namespace SampledImageSet {
 
 static absl::flat_hash_set<const SampledImageType *, SampledImageSet::Hash, SampledImageSet::KeyEqual> sampled_images;
 
+static MemoryStat sampled_images_memory("sampled image types", [](MemoryUsage &usage) {
+    usage.objects = sampled_images.size();
+    usage.bytes = hash_table_bytes(sampled_images) + sampled_images.size() * sizeof(SampledImageType);
+});
+
 //------------------------------------------------------------------------------
 // SAMPLED IMAGE TYPE
 //------------------------------------------------------------------------------
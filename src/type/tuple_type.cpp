@@ -5,9 +5,11 @@
 */
 
 #include "tuple_type.hpp"
+#include "../timer.hpp"
 #include "../error.hpp"
 #include "../utils.hpp"
 #include "../hash.hpp"
+#include "../intern.hpp"
 #include "../qualifier/key_qualifier.hpp"
 #include "../platform_abi.hpp"
 #include "array_type.hpp"
@@ -24,12 +26,7 @@ namespace scopes {
 namespace TupleSet {
     struct Hash {
         std::size_t operator()(const TupleType *s) const {
-            std::size_t h = std::hash<bool>{}(s->packed);
-            h = hash2(h, std::hash<size_t>{}(s->align));
-            for (auto &&arg : s->values) {
-                h = hash2(h, std::hash<const Type *>{}(arg));
-            }
-            return h;
+            return s->prehash;
         }
     };
 
@@ -51,6 +48,11 @@ namespace TupleSet {
 
 static absl::flat_hash_set<const TupleType *, TupleSet::Hash, TupleSet::KeyEqual> tuples;
 
+static MemoryStat tuples_memory("tuple types", [](MemoryUsage &usage) {
+    usage.objects = tuples.size();
+    usage.bytes = hash_table_bytes(tuples) + tuples.size() * sizeof(TupleType);
+});
+
 //------------------------------------------------------------------------------
 // TUPLE TYPE
 //------------------------------------------------------------------------------
@@ -105,6 +107,12 @@ TupleType::TupleType(const Types &_values, bool _packed, size_t _alignment)
     } else {
         explicit_alignment = false;
     }
+    std::size_t h = std::hash<bool>{}(packed);
+    h = hash2(h, std::hash<size_t>{}(align));
+    for (auto &&arg : values) {
+        h = hash2(h, std::hash<const Type *>{}(arg));
+    }
+    prehash = h;
 }
 
 SCOPES_RESULT(void *) TupleType::getelementptr(void *src, size_t i) const {
@@ -172,12 +180,30 @@ SCOPES_RESULT(const Type *) tuple_type(const Types &values,
             SCOPES_ERROR(OpaqueType, T);
         }
     }
+    // the front cache is keyed by the arguments, which spares computing
+    // the layout of a key
+    static thread_local InternCache<const TupleType *> cache;
+    std::size_t h = std::hash<bool>{}(packed);
+    h = hash2(h, std::hash<size_t>{}(alignment));
+    for (auto &&arg : values) {
+        h = hash2(h, std::hash<const Type *>{}(arg));
+    }
+    const TupleType *result;
+    if (cache.find(h, result, [&](const TupleType *T) {
+            return (T->packed == packed)
+                && (alignment?(T->align == alignment):!T->explicit_alignment)
+                && (T->values == values);
+        }))
+        return result;
     TupleType key(values, packed, alignment);
     auto it = tuples.find(&key);
-    if (it != tuples.end())
-        return *it;
-    auto result = new TupleType(values, packed, alignment);
-    tuples.insert(result);
+    if (it != tuples.end()) {
+        result = *it;
+    } else {
+        result = new TupleType(values, packed, alignment);
+        tuples.insert(result);
+    }
+    cache.insert(h, result);
     return result;
 }
 
@@ -36,6 +36,7 @@ struct TupleType : TupleLikeType {
     bool packed;
     bool explicit_alignment;
     std::vector<size_t> offsets;
+    std::size_t prehash;
 };
 
 //------------------------------------------------------------------------------
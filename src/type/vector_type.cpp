@@ -5,6 +5,7 @@
 */
 
 #include "vector_type.hpp"
+#include "../timer.hpp"
 #include "../error.hpp"
 #include "../dyn_cast.inc"
 #include "../hash.hpp"
@@ -34,6 +35,11 @@ struct KeyEqual {
 
 static absl::flat_hash_set<const VectorType *, VectorSet::Hash, VectorSet::KeyEqual> vectors;
 
+static MemoryStat vectors_memory("vector types", [](MemoryUsage &usage) {
+    usage.objects = vectors.size();
+    usage.bytes = hash_table_bytes(vectors) + vectors.size() * sizeof(VectorType);
+});
+
 //------------------------------------------------------------------------------
 // VECTOR TYPE
 //------------------------------------------------------------------------------
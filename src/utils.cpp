@@ -131,4 +131,21 @@ int stb_fprintf(FILE *out, const char *fmt, ...) {
     return c;
 }
 
+bool parse_size(const char *str, size_t &size) {
+    char *end = nullptr;
+    auto value = strtoull(str, &end, 10);
+    if (end == str)
+        return false;
+    switch(*end) {
+    case 'K': case 'k': value <<= 10; end++; break;
+    case 'M': case 'm': value <<= 20; end++; break;
+    case 'G': case 'g': value <<= 30; end++; break;
+    default: break;
+    }
+    if (*end)
+        return false;
+    size = value;
+    return true;
+}
+
 } // namespace scopes
\ No newline at end of file
@@ -17,6 +17,9 @@ namespace scopes {
 
 int stb_fprintf(FILE *out, const char *fmt, ...);
 
+// parses a size in bytes, optionally followed by a K, M or G suffix
+bool parse_size(const char *str, size_t &size);
+
 inline size_t align(size_t offset, size_t align) {
     return (offset + align - 1) & ~(align - 1);
 }
@@ -17,12 +17,40 @@
 #include "anchor.hpp"
 #include "prover.hpp"
 #include "alloc.hpp"
+#include "intern.hpp"
 
 #include <assert.h>
+#include <atomic>
 #include "absl/container/flat_hash_set.h"
 
+// integer constants of common types in this range are kept in a table
+#define SCOPES_SMALL_INT_MIN -128
+#define SCOPES_SMALL_INT_MAX 1023
+
 namespace scopes {
 
+//------------------------------------------------------------------------------
+
+static thread_local Arena *value_arena = nullptr;
+
+ValueArenaScope::ValueArenaScope(Arena *arena) {
+    old_arena = value_arena;
+    value_arena = arena;
+}
+
+ValueArenaScope::~ValueArenaScope() {
+    value_arena = old_arena;
+}
+
+template<typename T, typename ... Args>
+static T *new_instruction(Args&& ... args) {
+    if (value_arena)
+        return value_arena->make<T>(std::forward<Args>(args)...);
+    return new T(std::forward<Args>(args)...);
+}
+
+//------------------------------------------------------------------------------
+
 const char *get_value_kind_name(ValueKind kind) {
     switch(kind) {
 #define T(NAME, BNAME, CLASS) \
@@ -403,8 +431,12 @@ TypedValueRef ExtractArgument::from(const TypedValueRef &value, int index) {
 Template::Template(Symbol _name, const ParameterTemplates &_params, const ValueRef &_value)
     : UntypedValue(VK_Template),
         name(_name), params(_params), value(_value),
-        _is_inline(false), docstring(nullptr),
-        recursion(0) {
+        _is_inline(false), fast_math(0), docstring(nullptr),
+        recursion(0), fingerprint(0), fingerprint_value(nullptr) {
+    for (auto &&entry : instance_cache) {
+        entry.hash = 0;
+        entry.fn = nullptr;
+    }
     int index = 0;
     for (auto param : params) {
         param->set_owner(ref(unknown_anchor(), this), index++);
@@ -423,6 +455,13 @@ bool Template::is_inline() const {
     return _is_inline;
 }
 
+void Template::set_fast_math(uint32_t flags) {
+    fast_math = flags;
+    // the flags are part of the fingerprint
+    fingerprint = 0;
+    fingerprint_value = nullptr;
+}
+
 bool Template::is_hidden() const {
     return is_inline() && name == SYM_HiddenInline;
 }
@@ -456,7 +495,10 @@ Function::Function(Symbol _name, const Parameters &_params)
         original(TemplateRef()),
         label(LabelRef()),
         complete(false),
+        released(false),
+        fast_math(0),
         nextid(FirstUniquePrivate),
+        value_count(0),
         returning_hint(TYPE_NoReturn),
         raising_hint(TYPE_NoReturn),
         returning_anchor(nullptr),
@@ -481,6 +523,11 @@ int Function::unique_id() {
     return nextid++;
 }
 
+void Function::number_value(TypedValue *value) {
+    assert(value->value_id < 0);
+    value->value_id = value_count++;
+}
+
 void Function::try_bind_unique(const TypedValueRef &value) {
     auto T = value->get_type();
     int count = get_argument_count(T);
@@ -630,6 +677,36 @@ void Function::bind(const ValueRef &oldnode, const TypedValueRef &newnode) {
     }
 }
 
+// forget all bindings to values that live in arena
+static void unbind_arena_values(Function *fn, const Arena &arena) {
+    for (auto it = fn->map.begin(); it != fn->map.end();) {
+        if (arena.contains(it->second.unref())) {
+            fn->map.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    if (arena.contains(fn->label.unref())) {
+        fn->label = LabelRef();
+    }
+}
+
+void Function::release() {
+    assert(complete);
+    for (auto frame : inlines) {
+        unbind_arena_values(frame.unref(), arena);
+    }
+    inlines.clear();
+    unbind_arena_values(this, arena);
+    body.clear();
+    returns.clear();
+    raises.clear();
+    uniques.clear();
+    movers.clear();
+    arena.release();
+    released = true;
+}
+
 FunctionRef Function::from(Symbol name,
     const Parameters &params) {
     return ref(unknown_anchor(), new Function(name, params));
@@ -687,18 +764,14 @@ struct ConstSet {
         }
     };
 
-    absl::flat_hash_set<T *, Hash, Equal> map;
+    InternSet<T *, Hash, Equal> map;
 
     template<typename ... Args>
     TValueRef<T> from(Args ... args) {
         T key(args ...);
-        auto it = map.find(&key);
-        if (it != map.end()) {
-            return ref(unknown_anchor(), *it);
-        }
-        auto val = new T(args ...);
-        map.insert(val);
-        return ref(unknown_anchor(), val);
+        return ref(unknown_anchor(), map.intern(&key, [&]() {
+            return new T(args ...);
+        }));
     }
 };
 
@@ -941,7 +1014,7 @@ CondBr::CondBr(const TypedValueRef &_cond)
 
 CondBrRef CondBr::from(const TypedValueRef &cond) {
     validate_instruction(cond);
-    return ref(unknown_anchor(), new CondBr(cond));
+    return ref(unknown_anchor(), new_instruction<CondBr>(cond));
 }
 
 //------------------------------------------------------------------------------
@@ -1024,7 +1097,7 @@ Switch::Switch(const TypedValueRef &_expr, const Cases &_cases)
 
 SwitchRef Switch::from(const TypedValueRef &expr, const Cases &cases) {
     validate_instruction(expr);
-    return ref(unknown_anchor(), new Switch(expr, cases));
+    return ref(unknown_anchor(), new_instruction<Switch>(expr, cases));
 }
 
 Switch::Case &Switch::append_pass(const Anchor *anchor, const ConstIntRef &literal) {
@@ -1085,6 +1158,7 @@ void Parameter::set_owner(const FunctionRef &_owner, int _index) {
     assert(!owner);
     owner = _owner;
     index = _index;
+    owner->number_value(this);
 }
 
 void Parameter::retype(const Type *T) {
@@ -1146,13 +1220,13 @@ static const Type *get_cmp_type(const Type *T) {
 ICmp::ICmp(ICmpKind _cmp_kind, const TypedValueRef &_value1, const TypedValueRef &_value2)
     : Instruction(VK_ICmp, get_cmp_type(_value1->get_type())), cmp_kind(_cmp_kind), value1(_value1), value2(_value2) {}
 ICmpRef ICmp::from(ICmpKind cmp_kind, const TypedValueRef &value1, const TypedValueRef &value2) {
-    return ref(unknown_anchor(), new ICmp(cmp_kind, value1, value2));
+    return ref(unknown_anchor(), new_instruction<ICmp>(cmp_kind, value1, value2));
 }
 
 FCmp::FCmp(FCmpKind _cmp_kind, const TypedValueRef &_value1, const TypedValueRef &_value2)
     : Instruction(VK_FCmp, get_cmp_type(_value1->get_type())), cmp_kind(_cmp_kind), value1(_value1), value2(_value2) {}
 FCmpRef FCmp::from(FCmpKind cmp_kind, const TypedValueRef &value1, const TypedValueRef &value2) {
-    return ref(unknown_anchor(), new FCmp(cmp_kind, value1, value2));
+    return ref(unknown_anchor(), new_instruction<FCmp>(cmp_kind, value1, value2));
 }
 
 //------------------------------------------------------------------------------
@@ -1173,19 +1247,19 @@ static const Type *get_unop_type(UnOpKind _op, const Type *T) {
 UnOp::UnOp(UnOpKind _op, const TypedValueRef &_value)
     : Instruction(VK_UnOp, get_unop_type(_op, _value->get_type())), op(_op), value(_value) {}
 UnOpRef UnOp::from(UnOpKind op, const TypedValueRef &value) {
-    return ref(unknown_anchor(), new UnOp(op, value));
+    return ref(unknown_anchor(), new_instruction<UnOp>(op, value));
 }
 
 BinOp::BinOp(BinOpKind _op, const TypedValueRef &_value1, const TypedValueRef &_value2)
     : Instruction(VK_BinOp, _value1->get_type()), op(_op), value1(_value1), value2(_value2) {}
 BinOpRef BinOp::from(BinOpKind op, const TypedValueRef &value1, const TypedValueRef &value2) {
-    return ref(unknown_anchor(), new BinOp(op, value1, value2));
+    return ref(unknown_anchor(), new_instruction<BinOp>(op, value1, value2));
 }
 
 TriOp::TriOp(TriOpKind _op, const TypedValueRef &_value1, const TypedValueRef &_value2, const TypedValueRef &_value3)
     : Instruction(VK_TriOp, _value1->get_type()), op(_op), value1(_value1), value2(_value2), value3(_value3) {}
 TriOpRef TriOp::from(TriOpKind op, const TypedValueRef &value1, const TypedValueRef &value2, const TypedValueRef &value3) {
-    return ref(unknown_anchor(), new TriOp(op, value1, value2, value3));
+    return ref(unknown_anchor(), new_instruction<TriOp>(op, value1, value2, value3));
 }
 
 //------------------------------------------------------------------------------
@@ -1206,7 +1280,7 @@ static const Type *sampler_comp_type(const Type *T) {
 Sample::Sample(const TypedValueRef &_sampler, const TypedValueRef &_coords, const std::vector<Option> &_options)
     : Instruction(VK_Sample, sampler_comp_type(_sampler->get_type())), sampler(_sampler), coords(_coords), options(_options) {}
 SampleRef Sample::from(const TypedValueRef &sampler, const TypedValueRef &coords, const std::vector<Option> &options) {
-    return ref(unknown_anchor(), new Sample(sampler, coords, options));
+    return ref(unknown_anchor(), new_instruction<Sample>(sampler, coords, options));
 }
 
 static const Type *sampler_comp_size_type(const Type *T) {
@@ -1245,40 +1319,40 @@ bool ImageQuerySize::has_lod() const {
     return lod;
 }
 ImageQuerySizeRef ImageQuerySize::from(const TypedValueRef &sampler) {
-    return ref(unknown_anchor(), new ImageQuerySize(sampler, TypedValueRef()));
+    return ref(unknown_anchor(), new_instruction<ImageQuerySize>(sampler, TypedValueRef()));
 }
 ImageQuerySizeRef ImageQuerySize::from(const TypedValueRef &sampler, const TypedValueRef &lod) {
-    return ref(unknown_anchor(), new ImageQuerySize(sampler, lod));
+    return ref(unknown_anchor(), new_instruction<ImageQuerySize>(sampler, lod));
 }
 
 ImageQueryLod::ImageQueryLod(const TypedValueRef &_sampler, const TypedValueRef &_coords)
     : Instruction(VK_ImageQueryLod, vector_type(TYPE_F32, 2).assert_ok()), sampler(_sampler), coords(_coords) {}
 ImageQueryLodRef ImageQueryLod::from(const TypedValueRef &sampler, const TypedValueRef &coords) {
-    return ref(unknown_anchor(), new ImageQueryLod(sampler, coords));
+    return ref(unknown_anchor(), new_instruction<ImageQueryLod>(sampler, coords));
 }
 
 ImageQueryLevels::ImageQueryLevels(const TypedValueRef &_sampler)
     : Instruction(VK_ImageQueryLevels, TYPE_I32), sampler(_sampler) {}
 ImageQueryLevelsRef ImageQueryLevels::from(const TypedValueRef &sampler) {
-    return ref(unknown_anchor(), new ImageQueryLevels(sampler));
+    return ref(unknown_anchor(), new_instruction<ImageQueryLevels>(sampler));
 }
 
 ImageQuerySamples::ImageQuerySamples(const TypedValueRef &_sampler)
     : Instruction(VK_ImageQuerySamples, TYPE_I32), sampler(_sampler) {}
 ImageQuerySamplesRef ImageQuerySamples::from(const TypedValueRef &sampler) {
-    return ref(unknown_anchor(), new ImageQuerySamples(sampler));
+    return ref(unknown_anchor(), new_instruction<ImageQuerySamples>(sampler));
 }
 
 ImageRead::ImageRead(const TypedValueRef &_image, const TypedValueRef &_coords)
     : Instruction(VK_ImageRead, sampler_comp_type(_image->get_type())), image(_image), coords(_coords) {}
 ImageReadRef ImageRead::from(const TypedValueRef &image, const TypedValueRef &coords) {
-    return ref(unknown_anchor(), new ImageRead(image, coords));
+    return ref(unknown_anchor(), new_instruction<ImageRead>(image, coords));
 }
 
 ImageWrite::ImageWrite(const TypedValueRef &_image, const TypedValueRef &_coords, const TypedValueRef &_texel)
     : Instruction(VK_ImageWrite, empty_arguments_type()), image(_image), coords(_coords), texel(_texel) {}
 ImageWriteRef ImageWrite::from(const TypedValueRef &image, const TypedValueRef &coords, const TypedValueRef &texel) {
-    return ref(unknown_anchor(), new ImageWrite(image, coords, texel));
+    return ref(unknown_anchor(), new_instruction<ImageWrite>(image, coords, texel));
 }
 
 ExecutionMode::ExecutionMode(Symbol _mode, int v0, int v1, int v2)
@@ -1288,16 +1362,16 @@ ExecutionMode::ExecutionMode(Symbol _mode, int v0, int v1, int v2)
     values[2] = v2;
 }
 ExecutionModeRef ExecutionMode::from(Symbol mode) {
-    return ref(unknown_anchor(), new ExecutionMode(mode,-1,-1,-1));
+    return ref(unknown_anchor(), new_instruction<ExecutionMode>(mode,-1,-1,-1));
 }
 ExecutionModeRef ExecutionMode::from(Symbol mode, int v0) {
-    return ref(unknown_anchor(), new ExecutionMode(mode,v0,-1,-1));
+    return ref(unknown_anchor(), new_instruction<ExecutionMode>(mode,v0,-1,-1));
 }
 ExecutionModeRef ExecutionMode::from(Symbol mode, int v0, int v1) {
-    return ref(unknown_anchor(), new ExecutionMode(mode,v0,v1,-1));
+    return ref(unknown_anchor(), new_instruction<ExecutionMode>(mode,v0,v1,-1));
 }
 ExecutionModeRef ExecutionMode::from(Symbol mode, int v0, int v1, int v2) {
-    return ref(unknown_anchor(), new ExecutionMode(mode,v0,v1,v2));
+    return ref(unknown_anchor(), new_instruction<ExecutionMode>(mode,v0,v1,v2));
 }
 
 //------------------------------------------------------------------------------
@@ -1305,7 +1379,7 @@ ExecutionModeRef ExecutionMode::from(Symbol mode, int v0, int v1, int v2) {
 Annotate::Annotate(const TypedValues &_values)
     : Instruction(VK_Annotate, empty_arguments_type()), values(_values) {}
 AnnotateRef Annotate::from(const TypedValues &values) {
-    return ref(unknown_anchor(), new Annotate(values));
+    return ref(unknown_anchor(), new_instruction<Annotate>(values));
 }
 
 //------------------------------------------------------------------------------
@@ -1317,7 +1391,7 @@ Select::Select(const TypedValueRef &_cond,
 
 SelectRef Select::from(const TypedValueRef &cond,
     const TypedValueRef &value1, const TypedValueRef &value2) {
-    return ref(unknown_anchor(), new Select(cond, value1, value2));
+    return ref(unknown_anchor(), new_instruction<Select>(cond, value1, value2));
 }
 
 //------------------------------------------------------------------------------
@@ -1359,7 +1433,7 @@ GetElementPtr::GetElementPtr(const TypedValueRef &_value, const TypedValues &_in
     value(_value), indices(_indices) {}
 
 GetElementPtrRef GetElementPtr::from(const TypedValueRef &value, const TypedValues &indices) {
-    return ref(unknown_anchor(), new GetElementPtr(value, indices));
+    return ref(unknown_anchor(), new_instruction<GetElementPtr>(value, indices));
 }
 
 //------------------------------------------------------------------------------
@@ -1390,7 +1464,7 @@ TypedValueRef ExtractValue::from(const TypedValueRef &value, uint32_t index) {
         && is_plain(value->get_type())) {
         return get_field(value.cast<ConstAggregate>(), index);
     } else {
-        return ref(unknown_anchor(), new ExtractValue(value, index));
+        return ref(unknown_anchor(), new_instruction<ExtractValue>(value, index));
     }
 }
 
@@ -1407,7 +1481,7 @@ TypedValueRef InsertValue::from(const TypedValueRef &value, const TypedValueRef
         && is_plain(element->get_type())) {
         return set_field(value.cast<ConstAggregate>(), element.cast<Const>(), index);
     } else {
-        return ref(unknown_anchor(), new InsertValue(value, element, index));
+        return ref(unknown_anchor(), new_instruction<InsertValue>(value, element, index));
     }
 }
 
@@ -1421,7 +1495,7 @@ TypedValueRef ExtractElement::from(const TypedValueRef &value, const TypedValueR
         && is_plain(value->get_type())) {
         return get_field(value.cast<ConstAggregate>(), index.cast<ConstInt>()->msw());
     } else {
-        return ref(unknown_anchor(), new ExtractElement(value, index));
+        return ref(unknown_anchor(), new_instruction<ExtractElement>(value, index));
     }
 }
 
@@ -1435,7 +1509,7 @@ TypedValueRef InsertElement::from(const TypedValueRef &value, const TypedValueRe
         && is_plain(element->get_type())) {
         return set_field(value.cast<ConstAggregate>(), element.cast<Const>(), index.cast<ConstInt>()->msw());
     } else {
-        return ref(unknown_anchor(), new InsertElement(value, element, index));
+        return ref(unknown_anchor(), new_instruction<InsertElement>(value, element, index));
     }
 }
 
@@ -1443,7 +1517,7 @@ ShuffleVector::ShuffleVector(const TypedValueRef &_v1, const TypedValueRef &_v2,
     : Instruction(VK_ShuffleVector, vector_type(value_type_at_index(_v1->get_type(), 0), _mask.size()).assert_ok()),
     v1(_v1), v2(_v2), mask(_mask) {}
 ShuffleVectorRef ShuffleVector::from(const TypedValueRef &v1, const TypedValueRef &v2, const std::vector<uint32_t> &mask) {
-    return ref(unknown_anchor(), new ShuffleVector(v1, v2, mask));
+    return ref(unknown_anchor(), new_instruction<ShuffleVector>(v1, v2, mask));
 }
 
 //------------------------------------------------------------------------------
@@ -1451,10 +1525,10 @@ ShuffleVectorRef ShuffleVector::from(const TypedValueRef &v1, const TypedValueRe
 Alloca::Alloca(const Type *T, const TypedValueRef &_count)
     : Instruction(VK_Alloca, local_pointer_type(T)), type(T), count(_count) {}
 AllocaRef Alloca::from(const Type *T) {
-    return ref(unknown_anchor(), new Alloca(T, TypedValueRef()));
+    return ref(unknown_anchor(), new_instruction<Alloca>(T, TypedValueRef()));
 }
 AllocaRef Alloca::from(const Type *T, const TypedValueRef &count) {
-    return ref(unknown_anchor(), new Alloca(T, count));
+    return ref(unknown_anchor(), new_instruction<Alloca>(T, count));
 }
 bool Alloca::is_array() const {
     return count;
@@ -1463,10 +1537,10 @@ bool Alloca::is_array() const {
 Malloc::Malloc(const Type *T, const TypedValueRef &_count)
     : Instruction(VK_Malloc, native_pointer_type(T)), type(T), count(_count) {}
 MallocRef Malloc::from(const Type *T) {
-    return ref(unknown_anchor(), new Malloc(T, TypedValueRef()));
+    return ref(unknown_anchor(), new_instruction<Malloc>(T, TypedValueRef()));
 }
 MallocRef Malloc::from(const Type *T, const TypedValueRef &count) {
-    return ref(unknown_anchor(), new Malloc(T, count));
+    return ref(unknown_anchor(), new_instruction<Malloc>(T, count));
 }
 bool Malloc::is_array() const {
     return count;
@@ -1475,39 +1549,64 @@ bool Malloc::is_array() const {
 Free::Free(const TypedValueRef &_value)
     : Instruction(VK_Free, empty_arguments_type()), value(_value) {}
 FreeRef Free::from(const TypedValueRef &value) {
-    return ref(unknown_anchor(), new Free(value));
+    return ref(unknown_anchor(), new_instruction<Free>(value));
 }
 
-Load::Load(const TypedValueRef &_value, bool _is_volatile)
-    : Instruction(VK_Load, value_type_at_index(_value->get_type(),0)), value(_value), is_volatile(_is_volatile) {}
-LoadRef Load::from(const TypedValueRef &value, bool is_volatile) {
-    return ref(unknown_anchor(), new Load(value, is_volatile));
+Symbol memory_order_name(MemoryOrder order) {
+    switch(order) {
+#define T(NAME, BNAME) case NAME: return Symbol(BNAME);
+SCOPES_MEMORY_ORDER()
+#undef T
+    default: return Symbol("?memory-order");
+    }
 }
 
-Store::Store(const TypedValueRef &_value, const TypedValueRef &_target, bool _is_volatile)
-    : Instruction(VK_Store, empty_arguments_type()), value(_value), target(_target), is_volatile(_is_volatile) {}
-StoreRef Store::from(const TypedValueRef &value, const TypedValueRef &target, bool is_volatile) {
-    return ref(unknown_anchor(), new Store(value, target, is_volatile));
+Load::Load(const TypedValueRef &_value, bool _is_volatile, MemoryOrder _order)
+    : Instruction(VK_Load, value_type_at_index(_value->get_type(),0)), value(_value), is_volatile(_is_volatile), order(_order) {}
+LoadRef Load::from(const TypedValueRef &value, bool is_volatile, MemoryOrder order) {
+    return ref(unknown_anchor(), new_instruction<Load>(value, is_volatile, order));
+}
+bool Load::is_atomic() const {
+    return order != MemoryOrderNotAtomic;
 }
 
-AtomicRMW::AtomicRMW(AtomicRMWOpKind _op, const TypedValueRef &_target, const TypedValueRef &_value)
-    : Instruction(VK_AtomicRMW, value_type_at_index(_target->get_type(),0)), op(_op), target(_target), value(_value) {}
-AtomicRMWRef AtomicRMW::from(AtomicRMWOpKind op, const TypedValueRef &target, const TypedValueRef &value) {
-    return ref(unknown_anchor(), new AtomicRMW(op, target, value));
+Store::Store(const TypedValueRef &_value, const TypedValueRef &_target, bool _is_volatile, MemoryOrder _order)
+    : Instruction(VK_Store, empty_arguments_type()), value(_value), target(_target), is_volatile(_is_volatile), order(_order) {}
+StoreRef Store::from(const TypedValueRef &value, const TypedValueRef &target, bool is_volatile, MemoryOrder order) {
+    return ref(unknown_anchor(), new_instruction<Store>(value, target, is_volatile, order));
+}
+bool Store::is_atomic() const {
+    return order != MemoryOrderNotAtomic;
 }
 
-CmpXchg::CmpXchg(const TypedValueRef &_target, const TypedValueRef &_cmp, const TypedValueRef &_value)
+AtomicRMW::AtomicRMW(AtomicRMWOpKind _op, const TypedValueRef &_target, const TypedValueRef &_value, MemoryOrder _order)
+    : Instruction(VK_AtomicRMW, value_type_at_index(_target->get_type(),0)), op(_op), target(_target), value(_value), order(_order) {}
+AtomicRMWRef AtomicRMW::from(AtomicRMWOpKind op, const TypedValueRef &target, const TypedValueRef &value, MemoryOrder order) {
+    return ref(unknown_anchor(), new_instruction<AtomicRMW>(op, target, value, order));
+}
+
+CmpXchg::CmpXchg(const TypedValueRef &_target, const TypedValueRef &_cmp, const TypedValueRef &_value,
+    MemoryOrder _success_order, MemoryOrder _failure_order)
     : Instruction(VK_CmpXchg,
         arguments_type({value_type_at_index(_target->get_type(),0), TYPE_Bool})),
-        target(_target), cmp(_cmp), value(_value) {}
-CmpXchgRef CmpXchg::from(const TypedValueRef &target, const TypedValueRef &cmp, const TypedValueRef &value) {
-    return ref(unknown_anchor(), new CmpXchg(target, cmp, value));
+        target(_target), cmp(_cmp), value(_value),
+        success_order(_success_order), failure_order(_failure_order) {}
+CmpXchgRef CmpXchg::from(const TypedValueRef &target, const TypedValueRef &cmp, const TypedValueRef &value,
+    MemoryOrder success_order, MemoryOrder failure_order) {
+    return ref(unknown_anchor(), new_instruction<CmpXchg>(target, cmp, value,
+        success_order, failure_order));
 }
 
 Barrier::Barrier(BarrierKind _kind)
     : Instruction(VK_Barrier, empty_arguments_type()), kind(_kind) {}
 BarrierRef Barrier::from(BarrierKind kind) {
-    return ref(unknown_anchor(), new Barrier(kind));
+    return ref(unknown_anchor(), new_instruction<Barrier>(kind));
+}
+
+Fence::Fence(MemoryOrder _order)
+    : Instruction(VK_Fence, empty_arguments_type()), order(_order) {}
+FenceRef Fence::from(MemoryOrder order) {
+    return ref(unknown_anchor(), new_instruction<Fence>(order));
 }
 
 //------------------------------------------------------------------------------
@@ -1530,7 +1629,7 @@ Call::Call(const Type *type, const TypedValueRef &_callee, const TypedValues &_a
 CallRef Call::from(const Type *type, const TypedValueRef &callee, const TypedValues &args) {
     validate_instruction(callee);
     validate_instructions(args);
-    return ref(unknown_anchor(), new Call(type, callee, args));
+    return ref(unknown_anchor(), new_instruction<Call>(type, callee, args));
 }
 
 //------------------------------------------------------------------------------
@@ -1539,11 +1638,15 @@ Cast::Cast(CastKind _op, const TypedValueRef &_value, const Type *_type)
     : Instruction(VK_Cast, _type), op(_op), value(_value) {}
 
 CastRef Cast::from(CastKind op, const TypedValueRef &value, const Type *type) {
-    return ref(unknown_anchor(), new Cast(op, value,  type));
+    return ref(unknown_anchor(), new_instruction<Cast>(op, value,  type));
 }
 
 //------------------------------------------------------------------------------
 
+LoopHints::LoopHints()
+    : vectorize(0), unroll(0), vectorize_width(0), interleave_count(0),
+        unroll_count(0), independent(false) {}
+
 LoopLabel::LoopLabel(const TypedValues &_init, const LoopLabelArgumentsRef &_args)
     : Instruction(VK_LoopLabel, TYPE_NoReturn), init(_init), args(_args) {
     assert(args);
@@ -1551,7 +1654,7 @@ LoopLabel::LoopLabel(const TypedValues &_init, const LoopLabelArgumentsRef &_arg
 }
 
 LoopLabelRef LoopLabel::from(const TypedValues &init, const LoopLabelArgumentsRef &args) {
-    return ref(unknown_anchor(), new LoopLabel(init, args));
+    return ref(unknown_anchor(), new_instruction<LoopLabel>(init, args));
 }
 
 //------------------------------------------------------------------------------
@@ -1571,7 +1674,7 @@ Label::Label(LabelKind _kind, Symbol _name)
     : Instruction(VK_Label, empty_arguments_type()), name(_name), label_kind(_kind) {}
 
 LabelRef Label::from(LabelKind kind, Symbol name) {
-    return ref(unknown_anchor(), new Label(kind, name));
+    return ref(unknown_anchor(), new_instruction<Label>(kind, name));
 }
 
 void Label::change_type(const Type *type) {
@@ -1754,12 +1857,55 @@ ConstIntRef ConstInt::from(const Type *type, const uint64_t* cvalues, size_t num
     return constints.from(type, nvalues, numvalues);
 }
 
+namespace {
+enum { SMALL_INT_TYPE_COUNT = 11 };
+}
+
+// filled as constants are first requested; entries are interned, so every
+// thread that races to fill one stores the same pointer
+static std::atomic<ConstInt *> small_ints[SMALL_INT_TYPE_COUNT]
+    [SCOPES_SMALL_INT_MAX - SCOPES_SMALL_INT_MIN + 1];
+
+static int small_int_type_index(const Type *type) {
+    const Type *types[SMALL_INT_TYPE_COUNT] = {
+        TYPE_I32, TYPE_Bool, TYPE_I64, TYPE_USize, TYPE_U64, TYPE_U32,
+        TYPE_I8, TYPE_U8, TYPE_I16, TYPE_U16, TYPE_Char };
+    for (int i = 0; i < SMALL_INT_TYPE_COUNT; ++i) {
+        if (types[i] == type)
+            return i;
+    }
+    return -1;
+}
+
 ConstIntRef ConstInt::from(const Type *type, uint64_t value) {
+    int64_t sval = (int64_t)value;
+    if ((sval >= SCOPES_SMALL_INT_MIN) && (sval <= SCOPES_SMALL_INT_MAX)) {
+        int index = small_int_type_index(type);
+        if (index >= 0) {
+            auto &&entry = small_ints[index][sval - SCOPES_SMALL_INT_MIN];
+            auto cached = entry.load(std::memory_order_acquire);
+            if (cached)
+                return ref(unknown_anchor(), cached);
+            auto result = from(type, &value, 1);
+            entry.store(result.unref(), std::memory_order_release);
+            return result;
+        }
+    }
     return from(type, &value, 1);
 }
 
+// the constants of recently used symbols, keyed by the symbol itself
+static thread_local InternCache<ConstInt *> symbol_constants;
+
 ConstIntRef ConstInt::symbol_from(Symbol value) {
-    return from(TYPE_Symbol, value.value());
+    ConstInt *cached = nullptr;
+    if (symbol_constants.find(value.value(), cached,
+        [](ConstInt *) { return true; }))
+        return ref(unknown_anchor(), cached);
+    uint64_t word = value.value();
+    auto result = from(TYPE_Symbol, &word, 1);
+    symbol_constants.insert(value.value(), result.unref());
+    return result;
 }
 
 ConstIntRef ConstInt::builtin_from(Builtin value) {
@@ -1816,6 +1962,27 @@ ConstStringRef ConstString::from(const String *_value) {
     return from(T, _value);
 }
 
+SCOPES_RESULT(ConstStringRef) ConstString::blob_from(
+    const Type *element_type, const String *_value) {
+    SCOPES_RESULT_TYPE(ConstStringRef);
+    if (!is_plain(element_type)) {
+        SCOPES_ERROR(RTInvalidBlobElementType, element_type);
+    }
+    size_t size = SCOPES_GET_RESULT(size_of(element_type));
+    if (!size) {
+        SCOPES_ERROR(RTInvalidBlobElementType, element_type);
+    }
+    if (_value->count % size) {
+        SCOPES_ERROR(RTBlobSizeMismatch, element_type, (int)_value->count);
+    }
+    const Type *T =
+        refer_type(
+                SCOPES_GET_RESULT(array_type(element_type, _value->count / size)),
+                PTF_NonWritable,
+                SYM_SPIRV_StorageClassPrivate);
+    return from(T, _value);
+}
+
 //------------------------------------------------------------------------------
 
 static ConstSet<ConstAggregate> constaggs;
@@ -1861,11 +2028,40 @@ ConstAggregateRef ConstAggregate::none_from() {
     return from(TYPE_Nothing, {});
 }
 
+#if SCOPES_COMPACT_VALUEREF
+ConstAggregateRef ConstAggregate::ast_from(const ValueRef &node) {
+    // the packed word is what a reference looks like in memory
+    auto ptr = ConstPointer::from(TYPE__Value,
+        (const void *)pack_valueref(node.anchor(), node.unref())).unref();
+    return from(TYPE_ValueRef, { ptr });
+}
+
+ValueRef ConstAggregate::ast_value() const {
+    auto bits = (uintptr_t)cast<ConstPointer>(values[0])->value;
+    if (!bits)
+        return ValueRef();
+    if (bits & 1) {
+        auto cell = (const AnchoredValue *)(bits - 1);
+        return ref(cell->anchor, cell->value);
+    }
+    auto value = (Value *)bits;
+    return ref(get_home_anchor(value), value);
+}
+#else
 ConstAggregateRef ConstAggregate::ast_from(const ValueRef &node) {
     auto ptr = ConstPointer::from(TYPE__Value, node.unref()).unref();
     return from(TYPE_ValueRef, { ptr, ConstPointer::anchor_from(node.anchor()).unref() });
 }
 
+ValueRef ConstAggregate::ast_value() const {
+    auto value = (Value *)cast<ConstPointer>(values[0])->value;
+    auto anchor = (const Anchor *)cast<ConstPointer>(values[1])->value;
+    if (!value || !anchor)
+        return ValueRef();
+    return ref(anchor, value);
+}
+#endif
+
 ConstRef get_field(const ConstAggregateRef &value, uint32_t i) {
 #if 0
     auto VT = value_type_at_index(value->get_type(), i);
@@ -1930,7 +2126,7 @@ Repeat::Repeat(const LoopLabelRef &_loop, const TypedValues &values)
 }
 
 RepeatRef Repeat::from(const LoopLabelRef &loop, const TypedValues &values) {
-    return ref(unknown_anchor(), new Repeat(loop, values));
+    return ref(unknown_anchor(), new_instruction<Repeat>(loop, values));
 }
 
 //------------------------------------------------------------------------------
@@ -1940,7 +2136,7 @@ Return::Return(const TypedValues &values)
 }
 
 ReturnRef Return::from(const TypedValues &values) {
-    return ref(unknown_anchor(), new Return(values));
+    return ref(unknown_anchor(), new_instruction<Return>(values));
 }
 
 //------------------------------------------------------------------------------
@@ -1950,7 +2146,7 @@ Merge::Merge(const LabelRef &_label, const TypedValues &values)
 }
 
 MergeRef Merge::from(const LabelRef &label, const TypedValues &values) {
-    return ref(unknown_anchor(), new Merge(label, values));
+    return ref(unknown_anchor(), new_instruction<Merge>(label, values));
 }
 
 //------------------------------------------------------------------------------
@@ -1969,7 +2165,7 @@ Raise::Raise(const TypedValues &values)
 }
 
 RaiseRef Raise::from(const TypedValues &values) {
-    return ref(unknown_anchor(), new Raise(values));
+    return ref(unknown_anchor(), new_instruction<Raise>(values));
 }
 
 //------------------------------------------------------------------------------
@@ -1977,7 +2173,7 @@ RaiseRef Raise::from(const TypedValues &values) {
 Unreachable::Unreachable()
     : Terminator(VK_Unreachable, {}) {}
 UnreachableRef Unreachable::from() {
-    return ref(unknown_anchor(), new Unreachable());
+    return ref(unknown_anchor(), new_instruction<Unreachable>());
 }
 
 //------------------------------------------------------------------------------
@@ -1985,7 +2181,7 @@ UnreachableRef Unreachable::from() {
 Discard::Discard()
     : Terminator(VK_Discard, {}) {}
 DiscardRef Discard::from() {
-    return ref(unknown_anchor(), new Discard());
+    return ref(unknown_anchor(), new_instruction<Discard>());
 }
 
 //------------------------------------------------------------------------------
@@ -2023,8 +2219,57 @@ CompileStageRef CompileStage::from(const Anchor *anchor, const List *next, const
 ValueKind Value::kind() const { return _kind; }
 
 Value::Value(ValueKind kind)
-    : _kind(kind) {
+    : _kind(kind)
+#if SCOPES_COMPACT_VALUEREF
+    , _home_anchor(nullptr)
+#endif
+{
+}
+
+#if SCOPES_COMPACT_VALUEREF
+namespace AnchoredValueSet {
+
+struct Hash {
+    std::size_t operator()(const AnchoredValue *k) const {
+        return hash2(std::hash<Value *>{}(k->value),
+            std::hash<const Anchor *>{}(k->anchor));
+    }
+};
+
+struct Equal {
+    bool operator()(const AnchoredValue *self, const AnchoredValue *other) const {
+        return (self->value == other->value) && (self->anchor == other->anchor);
+    }
+};
+
+} // namespace AnchoredValueSet
+
+static InternSet<const AnchoredValue *,
+    AnchoredValueSet::Hash, AnchoredValueSet::Equal> anchored_values;
+
+uintptr_t pack_valueref(const Anchor *anchor, Value *value) {
+    if (!value)
+        return 0;
+    // the first reference defines the home anchor. values are referenced
+    // from the prefetch, shader and codegen threads too, so two first
+    // references may race; the loser gets a cell
+    const Anchor *home = nullptr;
+    if (value->_home_anchor.compare_exchange_strong(home, anchor,
+            std::memory_order_acq_rel, std::memory_order_acquire)
+        || (home == anchor))
+        return (uintptr_t)value;
+    AnchoredValue key = { value, anchor };
+    auto cell = anchored_values.intern(&key, [&]() {
+        return new AnchoredValue(key);
+    });
+    // cells are at least pointer aligned, which leaves the lowest bit free
+    return (uintptr_t)cell | 1;
+}
+
+const Anchor *get_home_anchor(const Value *value) {
+    return value->_home_anchor.load(std::memory_order_acquire);
 }
+#endif
 
 bool Value::is_accessible() const {
     switch(kind()) {
@@ -2120,7 +2365,7 @@ SCOPES_TYPED_VALUE_KIND()
 }
 
 TypedValue::TypedValue(ValueKind _kind, const Type *type)
-    : Value(_kind), _type(type) {
+    : Value(_kind), value_id(-1), _type(type) {
     assert(_type);
 }
 
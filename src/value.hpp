@@ -16,6 +16,9 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "span.h"
+#include "alloc.hpp"
+
+#include <atomic>
 
 #include "qualifier/unique_qualifiers.hpp"
 
@@ -87,11 +90,27 @@ struct Value {
 
 private:
     const ValueKind _kind;
+#if SCOPES_COMPACT_VALUEREF
+    friend uintptr_t pack_valueref(const Anchor *anchor, Value *value);
+    friend const Anchor *get_home_anchor(const Value *value);
+
+    // the anchor of references that don't need a cell of their own; set by
+    // the first reference, which may be made on any thread
+    std::atomic<const Anchor *> _home_anchor;
+#endif
 };
 
 const Anchor *get_best_anchor(const ValueRef &value);
 void set_best_anchor(const ValueRef &value, const Anchor *anchor);
 
+// while in scope, new instructions are allocated from arena instead of the heap
+struct ValueArenaScope {
+    ValueArenaScope(Arena *arena);
+    ~ValueArenaScope();
+
+    Arena *old_arena;
+};
+
 //------------------------------------------------------------------------------
 
 struct UntypedValue : Value {
@@ -111,6 +130,11 @@ struct TypedValue : Value {
     const Type *get_type() const;
     void hack_change_value(const Type *T);
 
+    // dense number of the value within the function that computes it, so
+    // that code generators can keep values in flat arrays; -1 for values
+    // that are shared between functions
+    int value_id;
+
 protected:
     const Type *_type;
 };
@@ -287,6 +311,7 @@ struct Template : UntypedValue {
     bool is_forward_decl() const;
     void set_inline();
     bool is_inline() const;
+    void set_fast_math(uint32_t flags);
     void append_param(const ParameterTemplateRef &sym);
     bool is_hidden() const;
 
@@ -297,8 +322,22 @@ struct Template : UntypedValue {
     ParameterTemplates params;
     ValueRef value;
     bool _is_inline;
+    // FMF_* flags for the instructions of every instance
+    uint32_t fast_math;
     const String *docstring;
     int recursion;
+
+    // recently proven instances, checked before the global function table
+    enum { InstanceCacheSize = 4 };
+    struct InstanceCacheEntry {
+        std::size_t hash;
+        Function *fn;
+    };
+    InstanceCacheEntry instance_cache[InstanceCacheSize];
+
+    // content hash of params and body, valid while value is fingerprint_value
+    uint64_t fingerprint;
+    const Value *fingerprint_value;
     SCOPES_DEFINITION_ANCHOR_API()
 };
 
@@ -692,6 +731,9 @@ struct FCmp : Instruction {
     T(UnOpDegrees, "unop-kind-degrees") \
     T(UnOpLength, "unop-kind-length") \
     T(UnOpNormalize, "unop-kind-normalize") \
+    T(UnOpAssume, "unop-kind-assume") \
+    T(UnOpPrefetch, "unop-kind-prefetch") \
+    T(UnOpPrefetchWrite, "unop-kind-prefetch-write") \
 
 
 enum UnOpKind {
@@ -729,6 +771,7 @@ SCOPES_UNOP_KIND()
     T(BinOpCross, "binop-kind-cross") \
     T(BinOpStep, "binop-kind-step") \
     T(BinOpPow, "binop-kind-pow") \
+    T(BinOpExpect, "binop-kind-expect") \
 
 
 enum BinOpKind {
@@ -986,23 +1029,46 @@ struct Free : Instruction {
     TypedValueRef value;
 };
 
+#define SCOPES_MEMORY_ORDER() \
+    T(MemoryOrderNotAtomic, "memory-order-not-atomic") \
+    T(MemoryOrderRelaxed, "memory-order-relaxed") \
+    T(MemoryOrderAcquire, "memory-order-acquire") \
+    T(MemoryOrderRelease, "memory-order-release") \
+    T(MemoryOrderAcqRel, "memory-order-acq-rel") \
+    T(MemoryOrderSeqCst, "memory-order-seq-cst") \
+
+
+enum MemoryOrder {
+#define T(NAME, BNAME) NAME,
+SCOPES_MEMORY_ORDER()
+#undef T
+};
+
+Symbol memory_order_name(MemoryOrder order);
+
 struct Load : Instruction {
     static bool classof(const Value *T);
 
-    Load(const TypedValueRef &value, bool is_volatile);
-    static LoadRef from(const TypedValueRef &value, bool is_volatile = false);
+    Load(const TypedValueRef &value, bool is_volatile, MemoryOrder order);
+    static LoadRef from(const TypedValueRef &value, bool is_volatile = false,
+        MemoryOrder order = MemoryOrderNotAtomic);
+    bool is_atomic() const;
     TypedValueRef value;
     bool is_volatile;
+    MemoryOrder order;
 };
 
 struct Store : Instruction {
     static bool classof(const Value *T);
 
-    Store(const TypedValueRef &value, const TypedValueRef &target, bool is_volatile);
-    static StoreRef from(const TypedValueRef &value, const TypedValueRef &target, bool is_volatile = false);
+    Store(const TypedValueRef &value, const TypedValueRef &target, bool is_volatile, MemoryOrder order);
+    static StoreRef from(const TypedValueRef &value, const TypedValueRef &target, bool is_volatile = false,
+        MemoryOrder order = MemoryOrderNotAtomic);
+    bool is_atomic() const;
     TypedValueRef value;
     TypedValueRef target;
     bool is_volatile;
+    MemoryOrder order;
 };
 
 #define SCOPES_ATOMICRMW_OP_KIND() \
@@ -1030,21 +1096,29 @@ SCOPES_ATOMICRMW_OP_KIND()
 struct AtomicRMW : Instruction {
     static bool classof(const Value *T);
 
-    AtomicRMW(AtomicRMWOpKind op, const TypedValueRef &target, const TypedValueRef &value);
-    static AtomicRMWRef from(AtomicRMWOpKind op, const TypedValueRef &target, const TypedValueRef &value);
+    AtomicRMW(AtomicRMWOpKind op, const TypedValueRef &target, const TypedValueRef &value, MemoryOrder order);
+    static AtomicRMWRef from(AtomicRMWOpKind op, const TypedValueRef &target, const TypedValueRef &value,
+        MemoryOrder order = MemoryOrderSeqCst);
     AtomicRMWOpKind op;
     TypedValueRef target;
     TypedValueRef value;
+    MemoryOrder order;
 };
 
 struct CmpXchg : Instruction {
     static bool classof(const Value *T);
 
-    CmpXchg(const TypedValueRef &target, const TypedValueRef &cmp, const TypedValueRef &value);
-    static CmpXchgRef from(const TypedValueRef &target, const TypedValueRef &cmp, const TypedValueRef &value);
+    CmpXchg(const TypedValueRef &target, const TypedValueRef &cmp, const TypedValueRef &value,
+        MemoryOrder success_order, MemoryOrder failure_order);
+    static CmpXchgRef from(const TypedValueRef &target, const TypedValueRef &cmp, const TypedValueRef &value,
+        MemoryOrder success_order = MemoryOrderSeqCst,
+        MemoryOrder failure_order = MemoryOrderSeqCst);
     TypedValueRef target;
     TypedValueRef cmp;
     TypedValueRef value;
+    // the ordering of the exchange, and of the load when the values differ
+    MemoryOrder success_order;
+    MemoryOrder failure_order;
 };
 
 
@@ -1071,6 +1145,14 @@ struct Barrier : Instruction {
     BarrierKind kind;
 };
 
+struct Fence : Instruction {
+    static bool classof(const Value *T);
+
+    Fence(MemoryOrder order);
+    static FenceRef from(MemoryOrder order);
+    MemoryOrder order;
+};
+
 //------------------------------------------------------------------------------
 
 struct PtrToRef {
@@ -1096,6 +1178,20 @@ struct Call : Instruction {
 
 //------------------------------------------------------------------------------
 
+// requested with loop-hint; left to the optimizer when zero
+struct LoopHints {
+    LoopHints();
+
+    // 1 to enable, -1 to disable
+    int vectorize;
+    int unroll;
+    int vectorize_width;
+    int interleave_count;
+    int unroll_count;
+    // iterations never access the same memory
+    bool independent;
+};
+
 struct LoopLabel : Instruction {
     static bool classof(const Value *T);
 
@@ -1108,6 +1204,7 @@ struct LoopLabel : Instruction {
     Block body;
     Repeats repeats;
     LoopLabelArgumentsRef args;
+    LoopHints hints;
 };
 
 //------------------------------------------------------------------------------
@@ -1162,10 +1259,14 @@ struct Function : Pure {
     std::size_t hash() const;
 
     int unique_id();
+    // assigns the next value number of the function to value
+    void number_value(TypedValue *value);
     void bind_unique(const UniqueInfo &info);
     void try_bind_unique(const TypedValueRef &value);
     const UniqueInfo &get_unique_info(int id) const;
     void build_valids();
+    // destroy all instructions allocated for this function
+    void release();
 
     Symbol name;
     Parameters params;
@@ -1176,7 +1277,12 @@ struct Function : Pure {
     TemplateRef original;
     LabelRef label;
     bool complete;
+    bool released;
+    // FMF_* flags, taken from the template
+    uint32_t fast_math;
     int nextid;
+    // the number of values numbered so far
+    int value_count;
     const Type *returning_hint;
     const Type *raising_hint;
     const Anchor *returning_anchor;
@@ -1200,6 +1306,12 @@ struct Function : Pure {
 
     const Anchor *get_best_mover_anchor(int id);
     void hint_mover(int id, const ValueRef &where);
+
+    // owns the instructions of this function and its inlined frames
+    Arena arena;
+    std::vector<FunctionRef> inlines;
+    // types whose symbols the proof of this function and its callees read
+    TypeDependencies deps;
 };
 
 //------------------------------------------------------------------------------
@@ -1259,6 +1371,10 @@ struct ConstString : Const {
 
     static ConstStringRef from(const Type *type, const String *value);
     static ConstStringRef from(const String *value);
+    // an array of values of element_type stored as the bytes of value,
+    // which is lowered as a single block of data
+    static SCOPES_RESULT(ConstStringRef) blob_from(
+        const Type *element_type, const String *value);
 
     const String *value;
 };
@@ -1277,6 +1393,10 @@ struct ConstAggregate : Const {
     static ConstAggregateRef none_from();
     static ConstAggregateRef ast_from(const ValueRef &node);
 
+    // returns the node that a constant made by ast_from refers to, or an
+    // empty reference if it refers to none
+    ValueRef ast_value() const;
+
     ConstantPtrs values;
     std::size_t _hash;
 };
@@ -1319,7 +1439,10 @@ struct ConstPointer : Const {
     /* if storage class is 'Input or 'Output, the value is not to be interpolated */ \
     T(GF_Flat, (1 << 7), "global-flag-flat") \
     /* LLVM specific flags */ \
-    T(GF_ThreadLocal, (1 << 8), "global-flag-thread-local")
+    T(GF_ThreadLocal, (1 << 8), "global-flag-thread-local") \
+    /* SPIR-V: a 'Private value that is initialized from a specialization */ \
+    /* constant; location is the constant id, the initializer its default */ \
+    T(GF_SpecConstant, (1 << 9), "global-flag-spec-constant")
 
 enum GlobalFlags {
 #define T(NAME, VALUE, SNAME) \
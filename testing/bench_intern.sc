@@ -0,0 +1,74 @@
+# microbenchmark for the interning tables: N threads concurrently intern a mix
+# of names that every thread shares and names that are unique to each thread,
+# first as strings, then as symbols.
+
+let C =
+    include
+        options "-I" (compiler-dir .. "/include")
+        """"#include "scopes/scopes.h"
+            #include <pthread.h>
+            #include <stdio.h>
+            #include <time.h>
+
+            #define BENCH_MAX_THREADS 16
+            #define BENCH_COUNT 200000
+            #define BENCH_SHARED 1024
+
+            typedef struct {
+                int index;
+                int run;
+                int symbols;
+            } bench_args;
+
+            static void *bench_thread(void *user) {
+                bench_args *args = (bench_args *)user;
+                char buf[64];
+                for (int i = 0; i < BENCH_COUNT; ++i) {
+                    int len;
+                    if (i & 1) {
+                        len = snprintf(buf, sizeof(buf), "shared%d.%d",
+                            args->run, i % BENCH_SHARED);
+                    } else {
+                        len = snprintf(buf, sizeof(buf), "unique%d.%d.%d",
+                            args->run, args->index, i);
+                    }
+                    const sc_string_t *str = sc_string_new(buf, len);
+                    if (args->symbols)
+                        sc_symbol_new(str);
+                }
+                return 0;
+            }
+
+            static double bench_now() {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return ts.tv_sec + ts.tv_nsec * 1e-9;
+            }
+
+            void bench_intern(int numthreads, int symbols) {
+                static int run = 0;
+                pthread_t threads[BENCH_MAX_THREADS];
+                bench_args args[BENCH_MAX_THREADS];
+                run++;
+                double t = bench_now();
+                for (int i = 0; i < numthreads; ++i) {
+                    args[i].index = i;
+                    args[i].run = run;
+                    args[i].symbols = symbols;
+                    pthread_create(&threads[i], 0, bench_thread, &args[i]);
+                }
+                for (int i = 0; i < numthreads; ++i) {
+                    pthread_join(threads[i], 0);
+                }
+                t = bench_now() - t;
+                printf("%s x %2d threads: %8.2f ms, %6.1f ns/op\n",
+                    symbols?"Symbol::get_symbol":"String::from      ",
+                    numthreads, t * 1000.0,
+                    t * 1e9 / ((double)numthreads * BENCH_COUNT));
+            }
+
+for symbols in (range 2)
+    for i in (range 5)
+        C.extern.bench_intern (1 << i) symbols
+
+;
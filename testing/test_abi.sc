@@ -170,3 +170,64 @@ do
     print a b c
 
 
+
+do
+    # short vectors and aggregates of them are passed in vector registers
+      where the C ABI does so
+    vvv bind vlib
+    include
+        """"typedef float v4f __attribute__((vector_size(16)));
+            typedef struct _VecBox { v4f v; } VecBox;
+            typedef struct _VecPair { v4f a; v4f b; } VecPair;
+            VecBox box_scale (VecBox box, float s) {
+                box.v *= s;
+                return box;
+            }
+            float pair_sum (VecPair p) {
+                v4f s = p.a + p.b;
+                return s[0] + s[1] + s[2] + s[3];
+            }
+            v4f vec_add (v4f a, v4f b) {
+                return a + b;
+            }
+
+    let box = (vlib.extern.box_scale (vlib.typedef.VecBox (vectorof f32 1 2 3 4)) 2.0)
+    test ((extractelement box.v 0) == 2.0)
+    test ((extractelement box.v 3) == 8.0)
+    let pair =
+        vlib.typedef.VecPair (vectorof f32 1 2 3 4) (vectorof f32 5 6 7 8)
+    test ((vlib.extern.pair_sum pair) == 36.0)
+    let v = (vlib.extern.vec_add (vectorof f32 1 2 3 4) (vectorof f32 1 1 1 1))
+    test ((extractelement v 2) == 4.0)
+
+do
+    # large aggregates returned from a local are built in the caller's slot
+    using import struct
+    struct Big plain
+        values : (array f32 16)
+        tag : i32
+
+    fn make-big (n)
+        local big : Big
+        for i in (range 16)
+            big.values @ i = (i * n) as f32
+        big.tag = n
+        if (n < 0)
+            big.tag = 0
+            return (deref big)
+        deref big
+
+    fn sum-big (big)
+        local total = 0.0
+        for i in (range 16)
+            total += big.values @ i
+        total
+
+    let a = (make-big 2)
+    let b = (make-big 3)
+    test (a.tag == 2)
+    test (b.tag == 3)
+    test ((sum-big a) == 240.0)
+    test ((sum-big b) == 360.0)
+    let c = (make-big -1)
+    test (c.tag == 0)
@@ -5,22 +5,26 @@ test-modules
     .test_abi
     .test_abs
     .test_alignment
+    .test_allocator
     .test_anchor
     .test_and_or
     .test_ansi_colors
     .test_array
     .test_ast_quote
     .test_atomic
+    .test_blob
     .test_bool
     .test_box
     .test_branch
     .test_assorted
     .test_borrowing
+    .test_cache
     .test_callback
     .test_capture
     .test_clang
     .test_closure
     .test_codegen
+    .test_concurrent
     .test_conversion
     .test_convert
     .test_copy
@@ -35,6 +39,7 @@ test-modules
     .test_enums
     .test_extraparams
     .test_feature_matrix
+    .test_flatmap
     .test_fnchain
     .test_folding
     .test_format
@@ -50,7 +55,9 @@ test-modules
     .test_import
     .test_inline
     .test_inplace_arithmetic
+    .test_interpreter
     .test_intrinsics
+    .test_io
     .test_iter2
     .test_itertools
     .test_label
@@ -63,11 +70,13 @@ test-modules
     .test_match
     .test_memoization
     .test_memory
+    .test_mmap
     .test_mutarray
     .test_namedargs
     .test_object
     .test_operators
     .test_option
+    .test_orderedmap
     .test_overload
     .test_parser
     .test_pointer
@@ -81,6 +90,9 @@ test-modules
     .test_scope_iter
     .test_scope
     .test_semicolon
+    .test_serialize
+    .test_soaarray
+    .test_span
     .test_spice
     .test_spice_attrib
     .test_spirv_loop
@@ -88,6 +100,7 @@ test-modules
     .test_struct
     .test_sugar
     .test_switch
+    .test_task
     .test_testing
     .test_try
     .test_tuple_array
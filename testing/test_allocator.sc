@@ -0,0 +1,155 @@
+using import testing
+using import Allocator
+using import Array
+using import String
+using import Map
+using import Box
+using import Rc
+using import struct
+using import task
+
+global arena : Arena (block-size = 256)
+let ArenaAllocator = (allocator-for arena)
+static-assert (ArenaAllocator < Allocator)
+static-assert (ArenaAllocator == (allocator-for arena))
+
+do
+    # containers allocating from an arena
+    let I32Array = (GrowingArray i32 ArenaAllocator)
+    static-assert (I32Array != (GrowingArray i32))
+    static-assert (I32Array == (Array i32 (allocator = ArenaAllocator)))
+    local a : I32Array
+    for i in (range 1000)
+        'append a i
+    for i in (range 1000)
+        test ((a @ i) == i)
+
+    local s : (GrowingString char ArenaAllocator)
+    for i in (range 100)
+        'append s "abc"
+    test ((countof s) == 300)
+    test ((s @ 299) == (99 as char))
+
+    local m : (Map i32 i32 (allocator = ArenaAllocator))
+    for i in (range 100)
+        'set m i (i * 2)
+    for i in (range 100)
+        test (('get m i) == (i * 2))
+    ;
+
+'reset arena
+do
+    let x = ('alloc-array arena i32 4)
+    x @ 3 = 7
+    test ((x @ 3) == 7)
+    let y = ('alloc-array arena f64 1)
+    test (((ptrtoint y usize) % (alignof f64)) == 0:usize)
+
+global pool : Pool (sizeof i64)
+let PoolAllocator = (allocator-for pool)
+
+do
+    # boxes recycle the blocks of a pool
+    let a = ((Box i64 PoolAllocator) 1)
+    let aptr = (ptrtoint (& (Box.view a)) usize)
+    drop a
+    let b = ((Box i64 PoolAllocator) 2)
+    test ((ptrtoint (& (Box.view b)) usize) == aptr)
+    test (b == 2)
+
+do
+    # blocks are handed out across chunks and reused in reverse order
+    local small-pool = (Pool 64 (chunk-blocks = 4))
+    test (('block-size small-pool) == 64:usize)
+    local blocks : (array (mutable @u8) 9)
+    for i in (range 9)
+        blocks @ i = ('alloc-array small-pool u8 64)
+    for i in (range 9)
+        'free small-pool (deref (blocks @ i))
+    let block = ('alloc-array small-pool u8 1)
+    test ((ptrtoint block usize) == (ptrtoint (deref (blocks @ 8)) usize))
+
+do
+    let RcP = (Rc i64 PoolAllocator)
+    let a = (RcP 5)
+    let b = (copy a)
+    test (a == b)
+    test ((Rc.strong-count a) == 2)
+    ;
+
+struct SlabNode
+    let __allocator = SlabAllocator
+    value : i64
+    next : i64
+
+do
+    # types choose the allocator of their boxes and reference counted values
+    static-assert (((Box SlabNode) . Allocator) == SlabAllocator)
+    static-assert (((Box SlabNode DefaultAllocator) . Allocator) == DefaultAllocator)
+    static-assert (((Rc SlabNode) . Allocator) == SlabAllocator)
+    let base = (SlabAllocator.live-count SlabNode)
+    let a = (Box.new SlabNode 1 2)
+    let aptr = (ptrtoint (& (Box.view a)) usize)
+    test ((SlabAllocator.live-count SlabNode) == (base + 1:i64))
+    drop a
+    test ((SlabAllocator.live-count SlabNode) == base)
+    # the most recently freed block is reused first
+    let b = (Box.new SlabNode 3 4)
+    test ((ptrtoint (& (Box.view b)) usize) == aptr)
+    test (b.value == 3)
+
+    let RcNode = (Rc SlabNode)
+    let rbase = (SlabAllocator.live-count RcNode.StorageType)
+    let r = (RcNode 5 6)
+    let r2 = (copy r)
+    test ((SlabAllocator.live-count RcNode.StorageType) == (rbase + 1:i64))
+    drop r
+    drop r2
+    test ((SlabAllocator.live-count RcNode.StorageType) == rbase)
+    ;
+
+do
+    # blocks freed by other threads return to the slab they came from
+    let count = 1000
+    local blocks : (array (mutable @i64) 1000)
+    for i in (range count)
+        let ptr = (SlabAllocator.alloc-array i64 1)
+        store (i as i64) ptr
+        blocks @ i = ptr
+    let live chunks = (SlabAllocator.stats i64)
+    test (live == 1000:i64)
+    test (chunks >= 1:u64)
+    let items = (& (blocks @ 0))
+    local tasks : (Array Task)
+    for t in (range 4)
+        'append tasks
+            spawn
+                inline (items t)
+                    for i in (range t 1000 4)
+                        test ((load (items @ i)) == (i as i64))
+                        SlabAllocator.free (deref (items @ i))
+                items
+                t
+    # dropping the handles joins the tasks
+    'clear tasks
+    test ((SlabAllocator.live-count i64) == 0:i64)
+    for i in (range count)
+        blocks @ i = (SlabAllocator.alloc-array i64 1)
+    let live2 chunks2 = (SlabAllocator.stats i64)
+    test (live2 == 1000:i64)
+    test (chunks2 == chunks)
+    for i in (range count)
+        SlabAllocator.free (deref (blocks @ i))
+    test ((SlabAllocator.live-count i64) == 0:i64)
+
+do
+    # the allocation profiler counts every new site and element type, whether
+      or not DefaultAllocator was compiled to use it
+    let base = (countof (sc_alloc_profile_stats))
+    let ptr = (sc_alloc_profile_malloc u16 (8:usize * (sizeof u16)))
+    test ((ptrtoint ptr usize) != 0:usize)
+    test ((countof (sc_alloc_profile_stats)) == (base + 1))
+    sc_alloc_profile_free ptr
+    test ((countof (sc_alloc_profile_stats)) == (base + 1))
+
+;
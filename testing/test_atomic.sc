@@ -15,4 +15,71 @@ test zs
 test (z == 15)
 test (x == 20)
 
-;
\ No newline at end of file
+;
+# explicit memory orders
+do
+    local x = 0
+    atomic-store 3 (& x) memory-order-relaxed
+    test ((atomic-load (& x) memory-order-seq-cst) == 3)
+    test ((atomicrmw add (& x) 1 memory-order-relaxed) == 3)
+    let z zs = (cmpxchg (& x) 4 5 memory-order-acq-rel)
+    test zs
+    let z zs = (cmpxchg (& x) 4 6 memory-order-release memory-order-relaxed)
+    test (not zs)
+    test (z == 5)
+    fence memory-order-acquire
+    fence memory-order-seq-cst
+    test ((atomic-load (& x)) == 5)
+
+# memory orders that an operation can not have are rejected
+test-compiler-error
+    do
+        local x = 0
+        atomic-load (& x) memory-order-release
+test-compiler-error
+    do
+        local x = 0
+        atomic-store 1 (& x) memory-order-acquire
+test-compiler-error
+    fence memory-order-relaxed
+
+using import atomic
+
+do
+    local counter = (Atomic i32)
+    test (('load counter) == 0)
+    'store counter 10 memory-order-relaxed
+    test (('fetch-add counter 5) == 10)
+    test (('fetch-sub counter 3 memory-order-acq-rel) == 15)
+    test (('exchange counter 7) == 12)
+    test (('fetch-max counter 9) == 7)
+    test (('fetch-min counter -1) == 9)
+    test (('fetch-or counter 0) == -1)
+    let old ok = ('compare-exchange counter -1 2 memory-order-acquire)
+    test ok
+    test (old == -1)
+    let old ok = ('compare-exchange counter 0 4)
+    test (not ok)
+    test (old == 2)
+    test (('update counter (inline (x) (x * 3))) == 2)
+    test (('load counter memory-order-seq-cst) == 6)
+
+do
+    local flags = ((Atomic u32) 0xf0:u32)
+    test (('fetch-and flags 0x30:u32) == 0xf0:u32)
+    test (('fetch-xor flags 0x11:u32) == 0x30:u32)
+    test (('fetch-max flags 0x80000000:u32) == 0x21:u32)
+    test (('load flags) == 0x80000000:u32)
+
+do
+    local total = ((Atomic f32) 1.5)
+    test (('fetch-add total 2.0) == 1.5)
+    test (('load total) == 3.5)
+
+do
+    test ((sizeof (CachePadded i32)) == CACHE_LINE_SIZE)
+    test ((sizeof (CachePadded (array u8 CACHE_LINE_SIZE))) == CACHE_LINE_SIZE)
+    test ((sizeof (CachePadded (array u8 (CACHE_LINE_SIZE + 1)))) == (2:usize * CACHE_LINE_SIZE))
+    local padded = ((CachePadded (Atomic u64)))
+    'fetch-add padded.value 1
+    test (('load padded.value) == 1:u64)
@@ -0,0 +1,24 @@
+
+using import testing
+
+do
+    let bytes = (blob u8 "abc")
+    static-assert ((countof bytes) == 3)
+    test ((bytes @ 0) == 97:u8)
+    test ((bytes @ 2) == 99:u8)
+
+    # elements are read in the byte order of the target
+    let words = (blob u16 "\x01\x00\x02\x01")
+    static-assert ((countof words) == 2)
+    test ((words @ 0) == 1:u16)
+    test ((words @ 1) == 0x0102:u16)
+
+    test-compiler-error (blob u16 "abc")
+
+do
+    # the source of this module, read at compile time
+    let source = (blob-file u8 (module-dir .. "/test_blob.sc"))
+    test ((source @ 1) == 117:u8)
+    test-compiler-error (blob-file u8 (module-dir .. "/missing.bin"))
+
+;
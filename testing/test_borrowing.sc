@@ -582,4 +582,39 @@ fn testfunc ()
 testfunc;
 One.test-refcount-balanced;
 
+# view ids are kept as a bitmap over words of 64 ids. sets that span many
+# words are the same set in whatever order their ids were added, and list
+# the ids in ascending order
+do
+    let T = ('view-type ('view-type ('view-type Handle 9000) 3) 700)
+    test (T == ('view-type ('view-type ('view-type Handle 700) 9000) 3))
+    test (T == ('view-type T 700))
+    test (T != ('view-type Handle 3))
+    test ((tostring T) == "(viewof Handle 3 700 9000)")
+    # dense ids across a word boundary
+    let T =
+        fold (T = Handle) for i in (range 60 70)
+            'view-type T i
+    let U =
+        fold (T = Handle) for i in (range 69 59 -1)
+            'view-type T i
+    test (T == U)
+    test ((tostring T) == "(viewof Handle 60 61 62 63 64 65 66 67 68 69)")
+
+# values made in a function have ids far above those of the arguments;
+# moving an argument removes it from the valid set and keeps the others
+    R1:Handle<-(1:Handle)(*)
+fn f (h)
+    let l = (Handle 0)
+    move h
+    l
+verify-type (typify f Handle) UHandleR1 UHandle1
+test-refcount (inline () (f (Handle 1)))
+
+fn f (h)
+    let l = (Handle 0)
+    move h
+    _ l h
+test-error (typify f Handle)
+
 ;
\ No newline at end of file
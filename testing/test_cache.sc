@@ -0,0 +1,162 @@
+# the object cache, as seen by child processes that share a cache directory
+    of their own
+
+using import testing
+using import mmap
+using import C.stdio
+
+inline run (command)
+    let result = (decons (sc_run_commands (list command) '() 1 ""))
+    let status seconds output = (decons (result as list) 3)
+    _ (status as i32) (output as string)
+
+let cache-dir =
+    do
+        let status output = (run "mktemp -d")
+        test (status == 0)
+        # without the newline
+        lslice output ((countof output) - 1:usize)
+let pack-path = (.. cache-dir "/scopes/objects.pack")
+
+fn pack-size ()
+    countof (MappedFile pack-path)
+
+# children print their cache statistics on the last line of their output
+let stat-source =
+    """"inline stat (name)
+            fold (result = 0) for entry in (sc_cache_stats)
+                let key value = (decons (entry as list) 2)
+                if ((key as Symbol) == name) ((value as u64) as i32)
+                else result
+let child-source =
+    .. stat-source "\n"
+        """"print (sc_cache_misses) (stat 'corrupt) (stat 'evicted_records)
+
+fn write-child (name source)
+    let f = (fopen (.. cache-dir "/" name ".sc") "wb")
+    fwrite (source as rawstring) 1 (countof source) f
+    fclose f
+    ;
+
+# returns the exit status of the child, and the first four numbers that it
+    printed last
+fn run-child (name env)
+    let status output =
+        run
+            .. env " SCOPES_SHARED_CACHE= SCOPES_CACHE=\"" cache-dir "\" \""
+                \ compiler-path "\" \"" cache-dir "/" name ".sc\""
+    let count = (countof output)
+    # the output ends with a newline
+    let start =
+        loop (i = (count - 1:usize))
+            if ((i == 0:usize) or (((output @ (i - 1:usize)) as i32) == 10))
+                break i
+            repeat (i - 1:usize)
+    local stats = (arrayof i32 0 0 0 0)
+    local k = 0
+    for i in (range start count)
+        let c = ((output @ i) as i32)
+        if (c == 32)
+            k += 1
+        elseif ((c >= 48) and (c <= 57) and (k < 4))
+            stats @ k = (stats @ k) * 10 + (c - 48)
+    _ status (stats @ 0) (stats @ 1) (stats @ 2) (stats @ 3)
+
+let default-watermarks = "SCOPES_CACHE_HIGH_WATERMARK= SCOPES_CACHE_LOW_WATERMARK="
+
+# children differ in what they print first, so their objects do too
+write-child "a" (.. "print \"a\"\n" child-source)
+write-child "b" (.. "print \"b\"\n" child-source)
+
+# fill the cache, then count the misses of a run that finds all its objects
+let status = (run-child "a" default-watermarks)
+test (status == 0)
+let status misses corrupt evicted = (run-child "a" default-watermarks)
+test (status == 0)
+test (corrupt == 0)
+test (evicted == 0)
+let warm-misses = misses
+
+do
+    # eviction keeps the entries that were used, and drops those that
+        were only written
+    let used-size = (pack-size)
+    let status = (run-child "b" default-watermarks)
+    test (status == 0)
+    let full-size = (pack-size)
+    test (full-size > used-size)
+    let status misses corrupt evicted =
+        run-child "a"
+            .. "SCOPES_CACHE_HIGH_WATERMARK=" (tostring (full-size as i32))
+                \ " SCOPES_CACHE_LOW_WATERMARK=" (tostring (used-size as i32))
+    test (status == 0)
+    test (evicted > 0)
+    test (misses == warm-misses)
+    test ((pack-size) <= used-size)
+
+do
+    # a corrupt entry is discarded and rebuilt. the pack header takes 16
+        bytes, and every record has a header of 96 bytes that holds the size
+        of its content at offset 8, followed by the content, padded to 16
+        bytes; the first byte of every content is flipped.
+    do
+        let map = (MappedFile pack-path (writable? = true))
+        let data = ('data map)
+        let size = (countof map)
+        loop (offset = 16:usize)
+            if ((offset + 96:usize) > size)
+                break;
+            let content-size =
+                deref (@ (bitcast (& (data @ (offset + 8:usize))) (pointer u64)))
+            let content-size = (content-size as usize)
+            if (content-size > 0:usize)
+                let i = (offset + 96:usize)
+                data @ i = ((data @ i) ^ 0xff:u8)
+            repeat
+                offset + (((96:usize + content-size + 15:usize) // 16:usize) * 16:usize)
+        'sync map
+    let status misses corrupt evicted = (run-child "a" default-watermarks)
+    test (status == 0)
+    test (corrupt > 0)
+    test (misses > warm-misses)
+    # the rebuilt entries replace the corrupt ones
+    let status misses corrupt evicted = (run-child "a" default-watermarks)
+    test (status == 0)
+    test (corrupt == 0)
+    test (misses == warm-misses)
+
+do
+    # a module that is emitted in partitions, which takes at least eight
+        functions per partition, is cached as one entry per partition, and
+        a later run loads them as separate objects
+    let parallel-source =
+        ..
+            fold (source = "") for i in (range 24)
+                .. source "fn part" (tostring i) " (x)\n    x + " (tostring i) "\n"
+            "fn parts (x)\n    "
+            fold (expr = "0") for i in (range 24)
+                .. "((part" (tostring i) " x) + " expr ")"
+            "\n" stat-source "\n"
+            """"let loaded = (stat 'objects_loaded)
+                let misses = (sc_cache_misses)
+                let f =
+                    sc_compile (typify parts i32)
+                        compile-flag-module | compile-flag-parallel
+                let f = (f as (pointer (function i32 i32)))
+                print (sc_thread_count) ((sc_cache_misses) - misses)
+                    \ ((stat 'objects_loaded) - loaded) (f 2)
+    write-child "p" parallel-source
+    let status threads misses loaded result = (run-child "p" default-watermarks)
+    test (status == 0)
+    test (misses > 0)
+    test (loaded == 0)
+    test (result == 324)
+    let status threads misses loaded result = (run-child "p" default-watermarks)
+    test (status == 0)
+    test (misses == 0)
+    test (loaded >= (? (threads > 1) 2 1))
+    test (result == 324)
+
+run (.. "rm -rf \"" cache-dir "\"")
+
+;
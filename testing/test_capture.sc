@@ -65,6 +65,25 @@ let b = "2!"
 for cb in callbacks
     cb;
 
+do
+    # small environments are stored in the capture, large ones on the heap
+    let CaptureT = (Capture (Capture.function i32 i32))
+    let a = (One 1)
+    let b = (One 2)
+    let pad = (arrayof i32 1 2 3 4 5 6)
+    let small = (capture (x) {a} (x + ('value a)))
+    let large = (capture (x) {b pad} (x + ('value b) + (pad @ 0)))
+    test ((sizeof (storageof (typeof small))) <= CaptureT.InlineSize)
+    test ((sizeof (storageof (typeof large))) > CaptureT.InlineSize)
+    let cs cl = (small as CaptureT) (large as CaptureT)
+    test ((cs 10) == 11)
+    test ((cl 10) == 13)
+    test ((One.refcount) == 2)
+    drop cs
+    drop cl
+    test ((One.refcount) == 0)
+One.test-refcount-balanced;
+
 do
     # unique borrowed arguments
     let a = (One 1)
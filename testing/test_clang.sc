@@ -24,6 +24,13 @@ include
         #define LONGVAL 3ll
         #define ULONGVAL 0x3ull
 
+        #define EXPRVAL ((INTVAL << 4) | 1)
+        #define CASTVAL ((unsigned short)-1)
+        #define NEGVAL (-ULONGVAL)
+        #define CHAINVAL ALIASVAL
+        #define ALIASVAL EXPRVAL
+        #define CONDVAL (EXPRVAL > 40 ? 1.5 : 2.5f)
+
         // initialized global
         int test_clang_global = 303;
         // uninitialized global
@@ -48,6 +55,14 @@ static-assert ((typeof UINTVAL) == u32)
 static-assert ((typeof LONGVAL) == i64)
 static-assert ((typeof ULONGVAL) == u64)
 
+static-assert (EXPRVAL == 49)
+static-assert ((typeof EXPRVAL) == i32)
+static-assert (CASTVAL == 65535:u16)
+static-assert ((NEGVAL + 3:u64) == 0:u64)
+static-assert (CHAINVAL == 49)
+static-assert (CONDVAL == 1.5)
+static-assert ((typeof CONDVAL) == f64)
+
 # bug: forward declaration after definition
 vvv include
 """"typedef struct X Y;
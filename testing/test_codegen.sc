@@ -1,5 +1,6 @@
 
 using import testing
+using import struct
 
 fn elidable (x)
     extractvalue (insertvalue x 1 0) 0
@@ -7,4 +8,140 @@ fn elidable (x)
 compile (static-typify elidable (tuple i32 i32)) 'dump-function 'dump-disassembly
 compile (static-typify elidable (tuple i32 i32)) 'dump-function 'dump-disassembly
 
-;
\ No newline at end of file
+# instructions of a released function are destroyed after compilation;
+# typifying it again builds a new specialization
+fn add2 (x y)
+    + x y
+
+let f = (compile (typify add2 i32 i32) 'release)
+let f = (f as (pointer (function i32 i32 i32)))
+test ((f 2 3) == 5)
+let g = (compile (typify add2 i32 i32) 'release)
+let g = (g as (pointer (function i32 i32 i32)))
+test ((g 3 4) == 7)
+
+# functions compiled for callers from C must pass everything in registers
+let h = (compile (typify add2 f32 f32) 'c-abi)
+let h = (h as (pointer (function f32 f32 f32)))
+test ((h 1.0 2.0) == 3.0)
+
+fn checked-add (x y)
+    if (x < 0)
+        raise false
+    + x y
+
+test-error (compile (typify checked-add i32 i32) 'c-abi)
+test-error (compile (typify add2 (array i64 8) (array i64 8)) 'c-abi)
+
+# fast-math functions tag their floating point instructions
+@@ fast-math
+fn muladd (x y z)
+    x * y + z
+
+@@ fast-math 'contract
+fn muladd-contract (x y z)
+    x * y + z
+
+test ((sc_template_get_fast_math (sc_closure_get_template muladd))
+    == fast-math-flag-fast)
+test ((sc_template_get_fast_math (sc_closure_get_template muladd-contract))
+    == fast-math-flag-contract)
+compile (typify muladd f32 f32 f32) 'dump-module
+test ((muladd 2.0 3.0 1.0) == 7.0)
+test ((muladd-contract 2.0 3.0 1.0) == 7.0)
+
+# identical functions keep their own addresses in the JIT, even at O3
+fn same-a (x)
+    x * 3 + 1
+fn same-b (x)
+    x * 3 + 1
+
+fn distinct-addresses ()
+    let a = (static-typify same-a i32)
+    let b = (static-typify same-b i32)
+    (ptrtoint a usize) != (ptrtoint b usize)
+
+let f = (compile (typify distinct-addresses) 'O3)
+let f = (f as (pointer (function bool)))
+test (f)
+
+# lazily compiled modules are split into partitions that are compiled on
+    their first call; calls between partitions, and to local functions, go
+    through stubs
+fn lazy-odd?
+fn lazy-even? (n)
+    if (n == 0)
+        return true
+    lazy-odd? (n - 1)
+fn lazy-odd? (n)
+    if (n == 0)
+        return false
+    lazy-even? (n - 1)
+fn lazy-square (x)
+    x * x
+
+fn lazy-entry (n)
+    fn cube (x)
+        (lazy-square x) * x
+    if (n < 0)
+        return (ptrtoint (static-typify lazy-square i32) usize)
+    ((cube n) + (? (lazy-even? n) 1 0)) as usize
+
+let f = (compile (typify lazy-entry i32) 'lazy)
+let f = (f as (pointer (function usize i32)))
+test ((f 4) == 65:usize)
+test ((f 5) == 125:usize)
+test ((f 4) == 65:usize)
+
+# a later module finds lazy-square by looking it up, and gets the address
+    that the lazy module uses itself
+fn lookup-square-address ()
+    ptrtoint (static-typify lazy-square i32) usize
+
+let g = (compile (typify lookup-square-address))
+let g = (g as (pointer (function usize)))
+test ((f -1) == (g))
+
+
+# tiered functions get optimized on a background thread once they have been
+    called often enough, and keep their results across the swap
+struct TierPoint plain
+    x : i64
+    y : i64
+    z : i64
+    w : i64
+
+# returns an aggregate too large for registers, built in a local array
+fn tier-point (n)
+    local values = (arrayof i64 0 0 0 0)
+    for i in (range 4)
+        values @ i = n * ((i + 1) as i64)
+    TierPoint (values @ 0) (values @ 1) (values @ 2) (values @ 3)
+
+fn tier-check (n)
+    loop (i = 0:i64)
+        if (i == n)
+            break true
+        let p = (tier-point i)
+        if ((p.x + p.y + p.z + p.w) != (10 * i))
+            break false
+        repeat (i + 1)
+
+let usleep = (extern 'usleep (function i32 u32))
+let f = (compile (typify tier-check i64) 'tiered)
+let f = (f as (pointer (function bool i64)))
+let tier-ups = (sc_tier_up_count)
+# makes both functions hot
+for i in (range 1100)
+    test (f 4)
+# keep calling while the optimized code is swapped in
+loop (i = 0)
+    test (f 64)
+    if ((((sc_tier_up_count) - tier-ups) >= 2) or (i == 10000))
+        break;
+    usleep 1000
+    repeat (i + 1)
+test (((sc_tier_up_count) - tier-ups) >= 2)
+test (f 2000)
+
+;
@@ -0,0 +1,120 @@
+
+using import testing
+using import concurrent
+using import itertools
+using import task
+using import String
+
+do
+    local queue = ((SPSCQueue i32) 5)
+    test (('capacity queue) == 8:usize)
+    test (not ('pop queue))
+    for i in (range 8)
+        test ('push queue i)
+    test (not ('push queue 8))
+    test ((countof queue) == 8:usize)
+    test (('unwrap ('pop queue)) == 0)
+    test ('push queue 8)
+
+    # a producer task hands values to the consuming thread
+    local stream = ((SPSCQueue i64) 64)
+    let producer =
+        spawn
+            inline (q)
+                for i in (range 10000)
+                    while (not ('push (@ q) (i as i64)))
+                        yield;
+            & stream
+    local sum = 0:i64
+    local received = 0
+    while (received < 10000)
+        let value = ('pop stream)
+        if value
+            sum += ('unwrap value)
+            received += 1
+        else
+            yield;
+    'join producer
+    test (sum == (10000:i64 * 9999:i64 // 2:i64))
+
+do
+    local queue = ((MPMCQueue i32) 4)
+    for i in (range 4)
+        test ('push queue i)
+    test (not ('push queue 4))
+    test (('unwrap ('pop queue)) == 0)
+    test ((countof queue) == 3:usize)
+
+    # many producers, then many consumers
+    let N = 100000
+    local shared = ((MPMCQueue i64) N)
+    let q = (& shared)
+    parallel-for N
+        inline (i q)
+            'push (@ q) (i as i64)
+        q
+    test ((countof shared) == (N as usize))
+    let total =
+        parallel-reduce N 0:i64
+            inline (i q)
+                'unwrap ('pop (@ q))
+            +
+            q
+    test (total == ((N as i64) * ((N - 1) as i64) // 2:i64))
+    test (not ('pop shared))
+
+do
+    local map = ((ConcurrentMap i32 i64))
+    'set map 1 10:i64
+    test ('in? map 1)
+    test (not ('in? map 2))
+    test (('unwrap ('get map 1)) == 10:i64)
+    test (not ('get map 2))
+    test (('getdefault map 2 5:i64) == 5:i64)
+
+    # counts from many threads land in the same keys
+    let m = (& map)
+    parallel-for 10000
+        inline (i m)
+            'update (@ m) ((i % 100) as i32) 0:i64
+                inline (count) (count + 1:i64)
+        m
+    test ((countof map) == 100:usize)
+    test (('getdefault map 42 0:i64) == 100:i64)
+    test (('getdefault map 1 0:i64) == 110:i64)
+    'discard map 1
+    test ((countof map) == 99:usize)
+    'clear map
+    test ((countof map) == 0:usize)
+
+do
+    local atoms = ((AtomTable))
+    let key = ('intern atoms "position")
+    # atoms are the symbols the compiler knows by the same name
+    test (key == 'position)
+    test (('intern atoms (String "position")) == key)
+    test (('intern atoms "") == (Symbol ""))
+    test ('in? atoms key)
+    test (not ('in? atoms 'velocity))
+    test (('name atoms key) == "position")
+    test (('name atoms 'velocity) == "velocity")
+    test ((countof atoms) == 1:usize)
+
+    # names interned by many threads are stored once
+    let a = (& atoms)
+    parallel-for 10000
+        inline (i a)
+            local name = (String "atom")
+            'append name ((97 + (i % 26)) as char)
+            'intern (@ a) name
+        a
+    test ((countof atoms) == 27:usize)
+    test (('intern atoms "atomq") == 'atomq)
+
+    using import Allocator
+    global arena : Arena
+    local scoped = ((AtomTable (allocator-for arena)))
+    test (('intern scoped "position") == key)
+    test (('name scoped key) == "position")
+
+;
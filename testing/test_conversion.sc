@@ -5,3 +5,14 @@ test
     (f32 5) == 5.0
 test
     (i32 5.0) == 5
+
+# implicit conversions follow changes to the symbols of the types involved
+typedef Flag : i32
+'set-symbol Flag '__tobool
+    inline (self) true
+run-stage;
+test (if (bitcast 0 Flag) true else false)
+'set-symbol Flag '__tobool
+    inline (self) false
+run-stage;
+test (not (if (bitcast 0 Flag) true else false))
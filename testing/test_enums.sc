@@ -12,6 +12,13 @@ spice make-enum (val)
             tag 'Q
             R
 
+# enum with count unit tags named T0, T1, ...
+sugar numbered-enum (name count)
+    let fields =
+        fold (fields = '()) for i in (range (count as i32))
+            cons (Symbol (.. "T" (tostring i))) fields
+    qq [enum] [name] (unquote-splice ('reverse fields))
+
 run-stage;
 
 do
@@ -274,6 +281,23 @@ do
 
     test (constant? (K.X == K.X))
 
+do
+    # large enums
+    numbered-enum Opcode 2000
+
+    test ((tostring (Opcode.T0)) == "T0")
+    test ((tostring (Opcode.T1999)) == "T1999")
+
+    fn opcode-class (op)
+        dispatch op
+        case T7 () 7
+        case T1500 () 1500
+        default -1
+
+    test ((opcode-class (Opcode.T7)) == 7)
+    test ((opcode-class (Opcode.T1500)) == 1500)
+    test ((opcode-class (Opcode.T8)) == -1)
+
 
 ;
 
@@ -0,0 +1,61 @@
+
+using import testing
+using import FlatMap
+
+do
+    local map : (FlatMap i32 i32)
+    for i in (range 1000)
+        'set map i (i * 3)
+    test ((countof map) == 1000)
+    test (500 in map)
+    test (not (2000 in map))
+    test (('get map 333) == 999)
+    test (('getdefault map -5 -1) == -1)
+    'set map 333 1
+    test (('get map 333) == 1)
+    test ((countof map) == 1000)
+    test-error ('get map 2000)
+
+    # erasing leaves deleted slots behind that probes must skip
+    for i in (range 0 1000 2)
+        'discard map i
+    test ((countof map) == 500)
+    for i in (range 1000)
+        test ((i in map) == ((i % 2) == 1))
+    for i in (range 0 1000 2)
+        'set map i i
+    test ((countof map) == 1000)
+
+    local sum = 0
+    for k v in map
+        sum += 1
+    test (sum == 1000)
+
+    let copied = (copy map)
+    test ((countof copied) == 1000)
+    test (('get copied 999) == (999 * 3))
+
+    'clear map
+    test (not map)
+    test (not (5 in map))
+
+do
+    using import String
+    local set : (FlatSet String)
+    'insert set (String "a")
+    'insert set (String "b")
+    'insert set (String "a")
+    test ((countof set) == 2)
+    test ((String "b") in set)
+    'discard set (String "a")
+    test (not ((String "a") in set))
+    for s in set
+        test (s == "b")
+
+    local ints : (FlatSet i32)
+    'reserve ints 100
+    let capacity = (deref ints._capacity)
+    for i in (range 100)
+        'insert ints i
+    test (ints._capacity == capacity)
+;
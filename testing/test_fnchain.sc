@@ -35,3 +35,23 @@ assert ((get_g_x) == 22)
 f;
 assert ((get_g_x) == 22)
 
+fnchain h
+'append h
+    fn (x)
+        (get_g_x) += x
+'prepend h
+    fn (x)
+        (get_g_x) *= x
+
+# frozen chains
+let h1 = ('freeze h i32)
+static-assert (h1 == ('freeze h i32))
+h1 2
+assert ((get_g_x) == 46)
+'append h
+    fn (x)
+        (get_g_x) -= 1
+let h2 = ('freeze h i32)
+static-assert (h1 != h2)
+h2 1
+assert ((get_g_x) == 46)
@@ -35,6 +35,38 @@ test
             .. (format "\{\} \{\} \{\}" "test" "test2" "test3")
         "{} {} {}"
 
+# formatting into a single string
+
+test
+    ==
+        format-string "{} {x} | {1} {}" -7 "a"
+            x = (local : String "b")
+        String "-7 b | a a"
+
+test
+    ==
+        format-string "{} {} {} {} {}" 0 255:u8 -9223372036854775808:i64
+            \ 18446744073709551615:u64 true
+        String "0 255 -9223372036854775808 18446744073709551615 true"
+
+# numbers read as they do with tostring
+fn runtime-values ()
+    _ 2.5 0.1:f64 1e30:f64 -42
+let a b c d = (runtime-values)
+test
+    ==
+        format-string "{} {} {} {}" a b c d
+        String (.. (tostring a) " " (tostring b) " " (tostring c) " " (tostring d))
+
+do
+    local line : String "> "
+    for i in (range 3)
+        'resize line 2
+        format-append line "{}/{}" i 3
+        test (line == (String (.. "> " (tostring i) "/3")))
+
+test-compiler-error
+    format-string "{test"
 test-compiler-error
     format "{test"
 test-compiler-error
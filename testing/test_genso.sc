@@ -35,9 +35,8 @@ compile-object
 
 # build a shared library
 let test_genso_so_path = (module-dir .. "/libtest_genso.so")
-let err = (system (report
-    (.. "gcc -o " test_genso_so_path " -shared " test_genso_object_path)))
-assert (err == 0)
+link-objects default-target-triple (list test_genso_object_path)
+    test_genso_so_path
 
 # write test client code to file
 let test_genso.c =
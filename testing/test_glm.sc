@@ -210,6 +210,49 @@ do
     test ((m * (vec4 2 3 4 5)) == (vec3 21 30 52))
     test (((vec3 2 3 4) * m) == (vec4 27 22 20 28))
 
+do
+    let m =
+        mat4
+            \ 2 0 0 0
+            \ 0 4 0 0
+            \ 1 0 1 0
+            \ 3 5 7 1
+    test
+        == (transpose m)
+            mat4
+                \ 2 0 1 3
+                \ 0 4 0 5
+                \ 0 0 1 7
+                \ 0 0 0 1
+    test ((transpose (transpose m)) == m)
+    test ((m * (vec4 1 1 1 1)) == (vec4 6 9 8 1))
+
+    # the entries of all inverses are exact in binary floating point
+    test ((m * (inverse m)) == (mat4))
+    test ((inverse m) * m == (mat4))
+    let m3 =
+        mat3
+            \ 2 0 0
+            \ 0 4 0
+            \ 2 0 1
+    test ((m3 * (inverse m3)) == (mat3))
+    let m2 =
+        mat2
+            \ 2 0
+            \ 2 4
+    test ((m2 * (inverse m2)) == (mat2))
+
+    local points = (arrayof vec3 (vec3 0 0 0) (vec3 1 2 3))
+    local moved : (array vec3 2)
+    transform-many moved points m
+    test ((moved @ 0) == (vec3 3 5 7))
+    test ((moved @ 1) == (vec3 8 13 10))
+    local dirs = (arrayof vec4 (vec4 1 0 0 0) (vec4 0 1 0 0))
+    local turned : (array vec4 2)
+    transform-many turned dirs m
+    test ((turned @ 0) == (vec4 2 0 0 0))
+    test ((turned @ 1) == (vec4 0 4 0 0))
+
 test ((floor (ivec2 1 2)) == (ivec2 1 2))
 test ((floor (vec2 1.5 2.5)) == (vec2 1 2))
 
@@ -263,5 +263,60 @@ do
     print
         static-compile-glsl 420 'vertex (static-typify vertex)
 
+# specialization constants
+do
+    using import glm
+    using import glsl
+
+    spec-constant use_red : bool
+        id = 0
+        default = true
+    spec-constant scale : f32
+        id = 1
+        default = 0.5
+    out out_Color : vec4
+        location = 0
+
+    fn main ()
+        out_Color =
+            ? use_red (vec4 scale 0 0 1) (vec4 0 scale 0 1)
+
+    let src = (compile-glsl 450 'fragment (static-typify main))
+    print src
+    test ('match? "constant_id = 1" src)
+    compile-spirv 0 'fragment (static-typify main)
+    none
+
+
+# subgroup reductions and scans
+do
+    using import glm
+    using import glsl
+
+    buffer values :
+        struct Values plain
+            data : (array f32)
+    buffer counts :
+        struct Counts plain
+            data : (array u32)
+
+    fn main ()
+        local_size 64 1 1
+        let i = gl_GlobalInvocationID.x
+        let x = (values.data @ i)
+        let total = (subgroupAdd x)
+        let prefix = (subgroupExclusiveAdd x)
+        let top = (subgroupMax (x as i32))
+        let lanes = (subgroupBallotBitCount (subgroupBallot (x > 0.0)))
+        let next = (subgroupShuffleDown x 1)
+        if (subgroupElect)
+            counts.data @ gl_SubgroupID = lanes
+        values.data @ i = (total + prefix + next + (top as f32))
+
+    let src = (compile-glsl 450 'compute (static-typify main))
+    print src
+    test ('match? "subgroupExclusiveAdd" src)
+    compile-spirv 0 'compute (static-typify main)
+    none
 
 ;
@@ -8,4 +8,16 @@ from (import "glm") let vec3
 # glm should not be in local scope
 test-compiler-error glm
 
-dump vec3
\ No newline at end of file
+dump vec3
+# an invalidated module is loaded again by the next import
+test ((invalidate-module (sc_realpath (.. module-dir "/submod/init.sc"))) >= 1)
+run-stage;
+import .submod
+assert (submod == true)
+
+# repeated lookups resolve to the same path, and a module that wasn't found
+  stays not found
+let submod-path = (find-module-path module-dir '.submod __env)
+test (submod-path == (find-module-path module-dir '.submod __env))
+test-error (find-module-path module-dir '.nosuchmodule __env)
+test-error (find-module-path module-dir '.nosuchmodule __env)
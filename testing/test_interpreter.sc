@@ -0,0 +1,20 @@
+
+# functions that only build values run without generating code for them
+fn quoted-one ()
+    `1
+
+let f = (sc_typify_template `quoted-one 0 (undef TypeArrayPointer))
+assert (sc_function_is_interpretable f)
+let result = (sc_interpret f)
+assert ('constant? result)
+assert ((result as i32) == 1)
+
+# everything else is left to the compiler
+fn printed-one ()
+    print "one"
+    `1
+
+let f = (sc_typify_template `printed-one 0 (undef TypeArrayPointer))
+assert (not (sc_function_is_interpretable f))
+
+true
@@ -49,3 +49,21 @@ test ((step 0.0 0.5) == 1.0)
 test
     all?
         ((step (vectorof f32 0.0 1.0) (vectorof f32 0.5 0.5)) == (vectorof f32 1.0 0.0))
+
+# branch, assumption and prefetch hints
+fn clamped-div (x y)
+    assume (y > 0)
+    if (unlikely (x < 0))
+        return 0
+    local values = (arrayof i32 x y)
+    prefetch (& (values @ 0))
+    prefetch (& (values @ 1)) 'write
+    if (likely (x < 100))
+        x // y
+    else
+        expect (x // y) 1
+
+compile (static-typify clamped-div i32 i32) 'dump-module
+test ((clamped-div 10 2) == 5)
+test ((clamped-div -10 2) == 0)
+test ((clamped-div 200 2) == 100)
@@ -0,0 +1,142 @@
+
+using import testing
+using import task
+using import io
+using import Span
+
+do
+    # buffers keep unread bytes ahead of their free space
+    local buffer = (Buffer)
+    'append buffer "hello "
+    'append buffer "world"
+    test ((countof buffer) == 11)
+    test ((string (bitcast ('data buffer) rawstring) 5) == "hello")
+    'consume buffer 6
+    test ((countof buffer) == 5)
+    # space is made by moving unread bytes to the front, or by growing
+    'reserve buffer 100000
+    test ((string (bitcast ('data buffer) rawstring) 5) == "world")
+    'consume buffer 5
+    test ((countof buffer) == 0)
+
+do
+    # a coroutine echoes everything it receives until the stream ends
+    let a b = (socket-pair)
+    let echo =
+        spawn-coroutine
+            inline (fd)
+                let socket = (bitcast fd Socket)
+                local buffer = (Buffer)
+                try
+                    while (('read-from buffer socket) > 0)
+                        'write-to buffer socket
+                except (err)
+                    ;
+            'fd b
+    lose b
+    let N = 100000
+    local sent = (Buffer)
+    let bytes = ('reserve sent N)
+    for i in (range N)
+        bytes @ i = ((i % 256) as u8)
+    'commit sent N
+    # the echo returns the data while it is still being sent
+    let writer =
+        spawn-coroutine
+            inline (fd data size)
+                let socket = (bitcast fd Socket)
+                try
+                    'write-all socket data size
+                except (err)
+                    ;
+                lose socket
+            'fd a
+            'data sent
+            N
+    local received = (Buffer)
+    while ((countof received) < N)
+        test (('read-from received a) > 0)
+    'join writer
+    local same = true
+    let sent-bytes = (bitcast ('data sent) rawstring)
+    let received-bytes = (bitcast ('data received) rawstring)
+    for i in (range N)
+        if ((sent-bytes @ i) != (received-bytes @ i))
+            same = false
+    test same
+    drop a
+    'join echo
+
+do
+    # tcp connections on a port picked by the system
+    let listener = (listen-tcp 0)
+    let port = ('local-port listener)
+    test (port > 0)
+    let server =
+        spawn-coroutine
+            inline (fd)
+                let listener = (bitcast fd Socket)
+                try
+                    let client = ('accept listener)
+                    'write-all client ("pong" as rawstring) 4
+                except (err)
+                    ;
+                lose listener
+            'fd listener
+    let client = (connect-tcp "127.0.0.1" port)
+    local reply = (Buffer)
+    while ((countof reply) < 4)
+        test (('read-from reply client) > 0)
+    test ((string (bitcast ('data reply) rawstring) 4) == "pong")
+    'join server
+
+let remove = (extern 'remove (function i32 rawstring))
+let path = (module-dir .. "/test_io.txt")
+
+do
+    # small writes are collected into chunks
+    let file = (File path 'write)
+    local writer = (Writer file 16)
+    for i in (range 100)
+        'write writer "line "
+        'write writer (tostring i)
+        'write writer "\n"
+    'writev writer "last" (StringView ("\n" as rawstring) 1) "tail"
+    test ((countof writer) == 0)
+    'flush writer
+
+do
+    # lines are read in place from chunks smaller than the file
+    let file = (File path)
+    'advise file 'sequential
+    local reader = (Reader file 64)
+    local count = 0
+    for line in ('lines reader)
+        if (count < 100)
+            test (line == (.. "line " (tostring count)))
+        count += 1
+    test (count == 102)
+
+do
+    # chunks and direct reads see every byte once
+    let file = (File path)
+    local reader = (Reader file 64)
+    local total = 0:usize
+    for chunk in ('chunks reader)
+        total += (countof chunk)
+    let file = (File path)
+    local reader = (Reader file 64)
+    local bytes = (arrayof u8 0 0 0 0 0 0 0 0 0 0)
+    test (('read reader &bytes 5) == 5)
+    test ((string (bitcast &bytes rawstring) 5) == "line ")
+    test (total > 500:usize)
+
+try
+    File (module-dir .. "/does_not_exist.txt")
+    test false
+except (err)
+    test (('code err) > 0)
+
+remove (path as rawstring)
+
+;
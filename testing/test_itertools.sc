@@ -180,4 +180,52 @@ do
         print i
 
 
+do
+    # parallel loops
+    using import Array
+    let N = 100000
+    local squares : (Array i64)
+    'resize squares N 0:i64
+    let items = (& (squares @ 0))
+    parallel-for N
+        inline (i items)
+            items @ i = i * i
+        items
+        chunk-size = 1000
+    test ((squares @ 99999) == (99999:i64 * 99999:i64))
+
+    local sum = 0:i64
+    for x in squares
+        sum += x
+    test
+        sum ==
+            parallel-reduce N 0:i64
+                inline (i items) (items @ i)
+                +
+                items
+
+    # combine only needs to be associative, as the chunks combine in order
+    let first-over =
+        parallel-reduce N -1:i64
+            inline (i items)
+                ? ((items @ i) > 1000000:i64) i -1:i64
+            inline (a b)
+                ? (a >= 0:i64) a b
+            items
+            chunk-size = 7
+    test (first-over == 1001:i64)
+
+    local hits : (Array i32)
+    'resize hits 16 0
+    let hit-items = (& (hits @ 0))
+    parallel-each squares
+        inline (x hit-items)
+            atomicrmw add (& (hit-items @ (x % 16:i64))) 1
+        hit-items
+    local total = 0
+    for x in hits
+        total += x
+    test (total == N)
+    test ((parallel-reduce 0 1:i64 (inline (i) i) *) == 1:i64)
+
 ;
\ No newline at end of file
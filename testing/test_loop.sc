@@ -159,4 +159,28 @@ do
     for i in (rrange 0:u32 10:u32)
         test ((i >= 0:u32) & (i < 10:u32))
 
+do
+    # loop hints
+    fn scale (dst src count)
+        for i in (range count)
+            loop-hint 'vectorize 4 'interleave 2 'independent
+            dst @ i = (src @ i) * 2.0
+        loop (i = 0)
+            loop-hint 'no-vectorize 'unroll 4
+            if (i == count)
+                break;
+            repeat (i + 1)
+
+    compile (static-typify scale (mutable @f32) @f32 i32) 'dump-module
+
+    let src = (alloca-array f32 5)
+    let dst = (alloca-array f32 5)
+    for i in (range 5)
+        src @ i = (i as f32)
+    scale dst src 5
+    test ((dst @ 4) == 8.0)
+
+    test-compiler-error
+        loop-hint 'vectorize
+
 true
@@ -146,4 +146,46 @@ do
     'set m 10 1
     if (not ('in? m 10:u8))
         error "key hashed incorrectly"
+
+do
+    # bulk construction, insertion and lookup
+    let IntMap = (Map i32 i32)
+    local squares : IntMap
+    'reserve squares 100
+    let mask = (deref squares._mask)
+    'insert-many squares
+        Generator
+            inline () 0
+            inline (i) (i < 100)
+            inline (i) (_ i (i * i))
+            inline (i) (i + 1)
+        100
+    test ((countof squares) == 100)
+    # reserving up front leaves nothing to rehash
+    test (squares._mask == mask)
+
+    local m = (IntMap.from-generator squares (countof squares))
+    test ((countof m) == 100)
+    test (('getdefault m 9 -1) == 81)
+
+    local keys = (arrayof i32 3 50 200 99 -1)
+    local found = 0
+    local missing = 0
+    'lookup-many squares keys
+        inline (i value)
+            test (value == (keys @ i) * (keys @ i))
+            found += 1
+        inline (i)
+            missing += 1
+    test (found == 3)
+    test (missing == 2)
+
+    let IntSet = (Set i32)
+    local s = (IntSet.from-generator (range 40) 40)
+    test ((countof s) == 40)
+    local present = 0
+    'lookup-many s keys
+        inline (i) (present += 1)
+        inline (i) ()
+    test (present == 1)
 ;
@@ -81,4 +81,26 @@ frec 5
 dump "x"
 frec 1
 
+# bounded memoization tables
+
+global squared-calls = 0
+fn squared (x)
+    squared-calls += 1
+    x * x
+let memoized-squared = (memoize squared)
+
+sc_memo_set_capacity `squared 2
+memoized-squared 1
+memoized-squared 2
+memoized-squared 3
+assert (squared-calls == 3)
+# 1 was used least recently, and made room for 3
+memoized-squared 2
+assert (squared-calls == 3)
+memoized-squared 1
+assert (squared-calls == 4)
+sc_memo_clear `squared
+memoized-squared 2
+assert (squared-calls == 5)
+
 true
@@ -0,0 +1,48 @@
+
+using import testing
+using import mmap
+
+let remove = (extern 'remove (function i32 rawstring))
+
+let path = (module-dir .. "/test_mmap.bin")
+let N = 100000
+
+do
+    # a writable map creates the file with the requested size
+    let map = (MappedFile path (writable? = true) (size = (N * 4)))
+    test ((countof map) == ((N * 4) as usize))
+    let values count = ('span map u32)
+    test (count == (N as usize))
+    for i in (range N)
+        values @ i = (i as u32)
+    'sync map
+
+do
+    let map = (MappedFile path)
+    'advise map 'sequential
+    let values count = ('span map u32)
+    local sum = 0:u64
+    for i in (range count)
+        sum += ((values @ i) as u64)
+    test (sum == ((N as u64) * ((N - 1) as u64) // 2:u64))
+    # bytes are little endian on all supported targets
+    test ((map @ 4) == 1:u8)
+    local total = 0:u64
+    for byte in map
+        total += (byte as u64)
+    test (total > 0:u64)
+    'advise map 'random 0 4096
+
+do
+    let map = (MappedFile path (writable? = true) (size = 0))
+    test ((countof map) == 0:usize)
+
+try
+    MappedFile (module-dir .. "/does_not_exist.bin")
+    test false
+except (err)
+    test (('code err) > 0)
+
+remove (path as rawstring)
+
+;
@@ -160,6 +160,38 @@ fn test-sort ()
 
 test-sort;
 
+fn test-sort-variants ()
+    let N = 10000
+    # radix sort of real keys with both signs
+    local f : (Array f32)
+    for i in (range N)
+        'append f (((i * 7919) % N - (N // 2)) as f32 * 0.25)
+    'sort f
+    for i in (range 1 N)
+        test ((f @ (i - 1)) <= (f @ i))
+
+    # introsort with a predicate, many duplicates
+    local a : i32Array
+    for i in (range N)
+        'append a ((i * 7919) % 17)
+    'predicated-sort a (inline (a b) (> a b))
+    for i in (range 1 N)
+        test ((a @ (i - 1)) >= (a @ i))
+
+    # stable sort keeps the insertion order of equal keys
+    local s : i32Array
+    for i in (range N)
+        'append s ((((i * 7919) % 13) * N) + i)
+    'stable-sort s (inline (x) (x // N))
+    for i in (range 1 N)
+        let x0 x1 = (s @ (i - 1)) (s @ i)
+        test ((x0 // N) <= (x1 // N))
+        if ((x0 // N) == (x1 // N))
+            test ((x0 % N) < (x1 % N))
+    ;
+
+test-sort-variants;
+
 fn test-one ()
     One.test-refcount-balanced;
 
@@ -274,4 +306,89 @@ fn test-copy ()
 test-copy;
 One.test-refcount-balanced;
 
+# small arrays keep their first elements inline
+fn test-small-array ()
+    One.test-refcount-balanced;
+
+    let T = (SmallArray One 4)
+    static-assert (T < SmallArray)
+    static-assert (T == (SmallArray One 4))
+    local a : T
+    test (('capacity a) == 4)
+    for i in (range 3)
+        'append a (One i)
+    test (('capacity a) == 4)
+    local b = (copy a)
+    test ((One.refcount) == 6)
+    # spill to the heap
+    for i in (range 3 10)
+        'append a (One i)
+    test ((countof a) == 10)
+    test (('capacity a) >= 10)
+    for i in (range 10)
+        test (('value (a @ i)) == i)
+    'remove a 0
+    test (('value (a @ 0)) == 1)
+    local c = (copy a)
+    test ((One.refcount) == 21)
+    drop a
+    drop c
+    test ((One.refcount) == 3)
+    test ((countof b) == 3)
+    test (('value ('last b)) == 2)
+
+    local v = ((SmallArray i32 8) 3 2 1)
+    test ((countof v) == 3)
+    'sort v
+    test ((v @ 0) == 1)
+    test ((v @ 2) == 3)
+    ;
+
+test-small-array;
+One.test-refcount-balanced;
+
+# element types can drop many elements at once
+global dropped-tokens = 0:usize
+typedef Token :: i32
+    inline... __typecall
+    case (cls : type,)
+        bitcast 0 cls
+    case (cls : type, x)
+        bitcast (x as i32) cls
+
+    inline __drop (self)
+        dropped-tokens += 1:usize
+
+    fn __drop-many (items count)
+        dropped-tokens += count
+
+do
+    local a : (Array Token)
+    for i in (range 10)
+        'append a (Token i)
+    'resize a 4
+    test (dropped-tokens == 6:usize)
+    test ((storagecast (view (a @ 3))) == 3)
+    'clear a
+    test (dropped-tokens == 10:usize)
+
+do
+    # unchecked indexing reads the same elements without the bounds check
+    local a : (Array i32)
+    for i in (range 8)
+        'append a (i * 3)
+    fn sum-unchecked (a)
+        fold (sum = 0) for i in (range (countof a))
+            sum + (unchecked@ a i)
+    test ((sum-unchecked a) == 84)
+    (unchecked@ a 2) = 5
+    test ((a @ 2) == 5)
+    # types without __unchecked@ are indexed by @
+    local nested = (arrayof (array i32 2) (arrayof i32 1 2) (arrayof i32 3 4))
+    test ((unchecked@ nested 1 0) == 3)
+    static-assert ((typeof bounds-checks?) == bool)
+    # the generator of an array checks its index once per element
+    let f = (static-typify sum-unchecked (mutable & (Array i32)))
+    compile f 'dump-module
+
 ;
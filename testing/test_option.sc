@@ -42,6 +42,42 @@ do
     test (result == (One 1234))
     ;
 
+do
+    # options of values that are never null are stored as null pointers
+    using import Box
+    using import Rc
+    let BoxT = (Box One)
+    let optT = (Option BoxT)
+    test ((sizeof optT) == (sizeof BoxT))
+    test ((sizeof (Option (Rc i32))) == (sizeof (Rc i32)))
+    test ((sizeof (Option voidstar)) > (sizeof voidstar))
+
+    let opt = (optT (BoxT 1234))
+    let empty = (optT)
+    test opt
+    test (not empty)
+    test ((One.refcount) == 1)
+    let result =
+        dispatch empty
+        case Some (val) false
+        default true
+    test result
+    let result =
+        dispatch opt
+        case Some (val) ('value val)
+        default -1
+    test (result == 1234)
+    test ((One.refcount) == 0)
+
+    let rc = ((Rc i32) 5)
+    let opt = ((Option (Rc i32)) (copy rc))
+    test ((Rc.strong-count rc) == 2)
+    do
+        let val = ('unwrap opt)
+        test (val == 5)
+    test ((Rc.strong-count rc) == 1)
+    ;
+
 One.test-refcount-balanced;
 
 ;
\ No newline at end of file
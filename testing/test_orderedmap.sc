@@ -0,0 +1,102 @@
+using import testing
+using import itertools
+using import String
+using import OrderedMap
+
+do
+    local map : (OrderedMap i32 i32)
+    # insert in a scattered order, so that nodes split all over the tree
+    for i in (range 1000)
+        let k = ((i * 7919) % 1000)
+        'set map k (k * 3)
+    test ((countof map) == 1000)
+    test (500 in map)
+    test (not (2000 in map))
+    test (('get map 333) == 999)
+    test (('getdefault map -5 -1) == -1)
+    'set map 333 1
+    test (('get map 333) == 1)
+    test ((countof map) == 1000)
+    test-error ('get map 2000)
+
+    # entries are visited in key order
+    local expected = 0
+    for k v in map
+        test (k == expected)
+        expected += 1
+    test (expected == 1000)
+
+    # range queries
+    local count = 0
+    for k v in ('range map 100 200)
+        test (k == (100 + count))
+        count += 1
+    test (count == 100)
+    for k v in ('lower-bound map 998)
+        test (k >= 998)
+    let sum =
+        fold (sum = 0) for k v in ('upper-bound map 997)
+            sum + k
+    test (sum == (998 + 999))
+
+    for i in (range 0 1000 2)
+        'discard map i
+    test ((countof map) == 500)
+    for i in (range 1000)
+        test ((i in map) == ((i % 2) == 1))
+    # ranges skip the leaves that erasing emptied
+    for i in (range 0 400)
+        'discard map i
+    local count = 0
+    for k v in ('range map 0 500)
+        count += 1
+    test (count == 50)
+
+    let copied = (copy map)
+    test ((countof copied) == (countof map))
+    test (('get copied 999) == (999 * 3))
+
+    'clear map
+    test (not map)
+    test (not (5 in map))
+    'set map 5 5
+    test (('get map 5) == 5)
+
+do
+    # sorted input is appended in bulk
+    local map : (OrderedMap i64 f32)
+    'load-sorted map
+        imap (range 100000)
+            inline (i) (_ ((i * 2) as i64) (i as f32))
+    test ((countof map) == 100000)
+    test (('get map 2000:i64) == 1000.0)
+    test (not (3:i64 in map))
+    # out of order input is inserted normally
+    'load-sorted map
+        imap (range 10)
+            inline (i) (_ ((i * 2 + 1) as i64) 0.0)
+    test ((countof map) == 100010)
+    local expected = 0:i64
+    for k v in ('range map 0:i64 30:i64)
+        test (k == expected)
+        expected += (? (k < 20:i64) 1:i64 2:i64)
+    test (expected == 30:i64)
+
+do
+    local set : (OrderedSet String)
+    'insert set (String "pear")
+    'insert set (String "apple")
+    'insert set (String "fig")
+    'insert set (String "apple")
+    test ((countof set) == 3)
+    test ((String "fig") in set)
+    local keys : String
+    for k in set
+        keys ..= k
+    test (keys == "applefigpear")
+    'discard set (String "fig")
+    test (not ((String "fig") in set))
+    let copied = (copy set)
+    test ((countof copied) == 2)
+
+;
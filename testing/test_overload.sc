@@ -65,6 +65,14 @@ fn... test2
 test ((test2 5) == 10)
 test ((test2 "hi") == "hihi")
 
+# repeated calls reuse the option that matched; appended options are seen
+test ((test2 5) == 10)
+'append test2
+    fn (a) 0
+    Arguments Unknown
+test ((test2 5) == 10)
+test ((test2 5.0) == 0)
+
 fn... test3
 case (a : integer = 3, b = 1, c = -1, d...)
     _ a b c d...
@@ -41,4 +41,55 @@ test
 "
         "thequickbrownfox"
 
+# an incremental reparse matches a full parse of the edited text
+do
+    let old = "let x = 1\nlet y = 2\nlet z =\n    x + y\n"
+    let new = "let x = 1\nlet y = 20\nlet z =\n    x + y\n"
+    let expr = (list-reparse (list-parse old) new 18 1 2)
+    test ((repr expr) == (repr (list-parse new)))
+
+# an AST image reads back as the tree that the AST prints as
+do
+    let expr = (Value (list-parse "let x = 1\nprint (x + 2.5) \"x\"\n"))
+    let tree = (sc_parse_ast_image (sc_value_ast_image expr))
+    test ((sc_value_ast_repr tree) == (sc_value_ast_repr expr))
+
+    fn f (x)
+        x * 2 + 1
+    spice ast-image-smaller? (value)
+        let image = (sc_value_ast_image value)
+        sc_parse_ast_image image
+        `[((countof image) < (countof (sc_value_ast_repr value)))]
+    run-stage;
+    test (ast-image-smaller? f)
+
+# decimal reals are read as the closest double
+inline bits (x)
+    bitcast x u64
+test ((bits 0.1) == 0x3fb999999999999a:u64)
+test ((bits 3.14159265358979323846) == 0x400921fb54442d18:u64)
+# the smallest normal and the largest finite double
+test ((bits 2.2250738585072014e-308) == 0x0010000000000000:u64)
+test ((bits 1.7976931348623157e308) == 0x7fefffffffffffff:u64)
+# powers of ten up to 1e22 are exact doubles, so they take the fast path
+test ((bits 1e22) == 0x4480f0cf064dd592:u64)
+test ((bits 1e23) == 0x44b52d02c7e14af6:u64)
+test ((bits 1e-22) == 0x3b5e392010175ee6:u64)
+test ((bits 1e-23) == 0x3b282db34012b251:u64)
+test ((bits 123456789012345678e5) == 0x4484ea15b273b38a:u64)
+# halfway between two doubles rounds to even
+test ((bits 9007199254740993.0) == 0x4340000000000000:u64)
+# 19 significant digits are read exactly, more are truncated
+test ((bits 1234567890123456789.0) == 0x43b12210f47de981:u64)
+test ((bits 12345678901234567890.0) == 0x43e56a95319d63e1:u64)
+test ((bits 0.1234567890123456789) == 0x3fbf9add3746f65f:u64)
+test ((bits 0.12345678901234567890) == 0x3fbf9add3746f65f:u64)
+test ((bits 0.000000000000000000001) == (bits 1e-21))
+test ((bits -0.0) == 0x8000000000000000:u64)
+test ((bits 0.0) == 0:u64)
+test ((typeof 1.5:f32) == f32)
+test (1.5:f32 == (1.5 as f32))
+test ((typeof 1e23:f64) == f64)
+test (1e23:f64 == 1e23)
+
 ;
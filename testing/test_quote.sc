@@ -48,4 +48,12 @@ do
     local k = `5
     test (('typeof `k) == i32)
 
+do
+    # lists of constants are built when they are quoted
+    let args = `(_ 1 2 3)
+    test (('argcount args) == 3)
+    test ((('getarg args 1) as i32) == 2)
+    let args = `(_ 1 k)
+    test (('argcount args) == 2)
+
 ;
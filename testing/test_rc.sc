@@ -324,6 +324,41 @@ do
     container = k
     ;
 
+do
+    # atomic and strong-only variants
+    let a = ((Arc i32) 5)
+    test ((typeof a) < Arc)
+    test ((Rc.strong-count a) == 1)
+    do
+        let a2 = (copy a)
+        test ((Rc.strong-count a) == 2)
+        let w = (a as Weak)
+        test ((Rc.weak-count a) == 1)
+        let a3 = ('force-upgrade w)
+        test ((Rc.strong-count a) == 3)
+        test (a3 == 5)
+    test ((Rc.strong-count a) == 1)
+    test ((Rc.weak-count a) == 0)
+    let w = (a as Weak)
+    drop a
+    test ((Rc.strong-count w) == 0)
+    test-error ('upgrade w)
+
+    let S = (Rc vec3 (weak? = false))
+    test ((typeof S.WeakType) == type)
+    test (S.WeakType == Nothing)
+    test (S.HeaderSize < ((Rc vec3) . HeaderSize))
+    let s = (S 1 2 3)
+    do
+        let s2 = (copy s)
+        test ((Rc.strong-count s) == 2)
+    test ((Rc.strong-count s) == 1)
+    test ((Rc.weak-count s) == 0)
+    test (s.y == 2)
+
+    let sa = (Arc.wrap (One 7))
+    'check sa
+    ;
 
 # TODO: uncomment and fix
 #do
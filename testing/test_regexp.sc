@@ -15,3 +15,19 @@ loop (i = 0)
         repeat (i + 1)
     break;
 
+
+let k i0 i1 = ('match-from? str"t.st" "tisttosttust" 1)
+assert k
+assert (i0 == 4)
+assert (i1 == 8)
+let k = ('match-from? str"^t" "tist" 1)
+assert (not k)
+
+local count = 0
+local last = -1
+for start end in ('matches str"[0-9]+" "a1b22c333")
+    assert (start > last)
+    last = end
+    count += 1
+assert (count == 3)
+assert (last == 9)
@@ -55,3 +55,56 @@ do
     test (('@ a 'x) as i32 == 6)
     let a = ('parent a)
     test (a == null)
+
+# enough names to split the nodes of the scope trie several levels deep
+do
+    let N = 2048
+    inline key (i)
+        Symbol (.. "key" (tostring i))
+    inline bound? (scope i)
+        try
+            '@ scope (key i)
+            true
+        except (err)
+            false
+
+    local scope = (Scope)
+    for i in (range N)
+        scope = ('bind scope (key i) i)
+    # rebind every third name
+    for i in (range 0 N 3)
+        scope = ('bind scope (key i) (i + N))
+    # and delete every fifth
+    for i in (range 0 N 5)
+        scope = ('unbind scope (key i))
+    for i in (range N)
+        if ((i % 5) == 0)
+            test (not (bound? scope i))
+        elseif ((i % 3) == 0)
+            test ((('@ scope (key i)) as i32) == (i + N))
+        else
+            test ((('@ scope (key i)) as i32) == i)
+
+    # names come in the order they were last bound in, so the values rise
+    local last = -1
+    local count = 0
+    for k v in scope
+        let v = (v as i32)
+        test (v > last)
+        test ((k as Symbol) == (key (v % N)))
+        last = v
+        count += 1
+    test (count == (N - (N + 4) // 5))
+
+    # lookups go on to the parent, where deleted names stay deleted
+    local child = (Scope scope)
+    test ((('@ child (key 1)) as i32) == 1)
+    test (not (bound? child 0))
+    # deleting from the child hides the names of the parent from it only
+    for i in (range 1 N 5)
+        child = ('unbind child (key i))
+    for i in (range 1 N 5)
+        test (not (bound? child i))
+        test (bound? scope i)
+    test ((('@ child (key 2)) as i32) == 2)
+    test ((('@ child (key 3)) as i32) == (3 + N))
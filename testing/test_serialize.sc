@@ -0,0 +1,109 @@
+using import testing
+using import struct
+using import enum
+using import Array
+using import String
+using import Span
+using import serialize
+
+struct Point plain
+    x : f32
+    y : f32
+
+struct Record
+    id : u32
+    name : String
+    points : (Array Point)
+    tags : (Array String)
+
+enum Shape
+    Empty
+    Circle : f32
+    Line : Point Point
+    Label : String
+
+do
+    # plain values are copied as they are in memory
+    local buffer : (Array u8)
+    encode buffer 42:i32
+    encode buffer (Point 1 2)
+    test ((countof buffer) == ((sizeof i32) + (sizeof Point)))
+    local d = (Decoder buffer)
+    test ((decode i32 d) == 42)
+    let p = (decode Point d)
+    test (p.x == 1.0)
+    test (p.y == 2.0)
+    test (('remaining d) == 0)
+
+do
+    # structs encode their fields, arrays their count and elements
+    local buffer : (Array u8)
+    local points : (Array Point)
+    'append points (Point 1 2)
+    'append points (Point 3 4)
+    local tags : (Array String)
+    'append tags (String "a")
+    'append tags (String "bc")
+    encode buffer (Record 7 (String "ada") points tags)
+    local d = (Decoder buffer)
+    let r = (decode Record d)
+    test (r.id == 7)
+    test (r.name == "ada")
+    test ((countof r.points) == 2)
+    test ((r.points @ 1) . y == 4.0)
+    test ((countof r.tags) == 2)
+    test ((r.tags @ 1) == "bc")
+    test (('remaining d) == 0)
+
+do
+    # enums encode their tag and payload
+    local buffer : (Array u8)
+    encode buffer (Shape.Circle 2.5)
+    encode buffer (Shape.Label (String "name"))
+    encode buffer (Shape.Line (Point 0 1) (Point 2 3))
+    encode buffer (Shape.Empty)
+    local d = (Decoder buffer)
+    let s = (decode Shape d)
+    dispatch s
+    case Circle (r) (test (r == 2.5))
+    default (test false)
+    let s = (decode Shape d)
+    dispatch s
+    case Label (text) (test (text == "name"))
+    default (test false)
+    let s = (decode Shape d)
+    dispatch s
+    case Line (a b) (test (b.x == 2.0))
+    default (test false)
+    let s = (decode Shape d)
+    dispatch s
+    case Empty () (test true)
+    default (test false)
+
+do
+    # truncated input raises
+    local buffer : (Array u8)
+    encode buffer (String "truncated")
+    'resize buffer ((countof buffer) - 1)
+    local d = (Decoder buffer)
+    test-error (decode String d)
+
+do
+    # fixed layout records are viewed in place
+    local buffer : (Array u8)
+    'append buffer 1:u8
+    local points : (Array Point)
+    for i in (range 10)
+        'append points (Point (i as f32) ((i * 2) as f32))
+    write-fixed buffer points
+    let offset = (((countof buffer) - (sizeof FixedHeader)) - (10 * (sizeof Point)))
+    let data = (& (buffer @ offset))
+    let records = (read-fixed Point data ((countof buffer) - offset))
+    test ((countof records) == 10)
+    test ((records @ 9) . y == 18.0)
+    test ((ptrtoint ('data records) usize) == (ptrtoint (& (buffer @ (offset + (sizeof FixedHeader)))) usize))
+    # a different record type is rejected
+    test-error (read-fixed u64 data ((countof buffer) - offset))
+    test-error (read-fixed Point data (sizeof FixedHeader))
+
+;
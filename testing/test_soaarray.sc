@@ -0,0 +1,68 @@
+
+using import testing
+using import struct
+using import glm
+using import String
+using import SoAArray
+
+struct Particle plain
+    position : vec3
+    velocity : vec3 = (vec3 0 1 0)
+    age : f32
+
+do
+    local particles : (SoAArray Particle)
+    test ((countof particles) == 0)
+    for i in (range 10)
+        'append particles
+            Particle (position = (vec3 (f32 i) 0 0)) (age = (f32 i))
+    'emplace-append particles (age = 10.0)
+    test ((countof particles) == 11)
+    test (('capacity particles) >= 11)
+
+    # fields read and assign through element views
+    test ((particles @ 3) . position == (vec3 3 0 0))
+    test ((particles @ 10) . velocity == (vec3 0 1 0))
+    (particles @ 3) . age = 30.0
+    test ((particles @ 3) . age == 30.0)
+    let p = (imply (particles @ 3) Particle)
+    test (p.age == 30.0)
+    test (p.position == (vec3 3 0 0))
+
+    # loops over a single field go through its span
+    let positions = ('span particles 'position)
+    let velocities = ('span particles 'velocity)
+    for i in (range (countof particles))
+        positions @ i += velocities @ i
+    test ((particles @ 5) . position == (vec3 5 1 0))
+
+    local total = 0.0
+    for element in particles
+        total += element.age
+    test (total == (45.0 - 3.0 + 30.0 + 10.0))
+
+    let copied = (copy particles)
+    test ((countof copied) == 11)
+    test ((copied @ 7) . position == (vec3 7 1 0))
+
+    'swap-remove particles 0
+    test ((countof particles) == 10)
+    test ((particles @ 0) . age == 10.0)
+    let last = ('pop particles)
+    test (last.age == 9.0)
+    test ((countof particles) == 9)
+
+    'resize particles 12
+    test ((particles @ 11) . velocity == (vec3 0 1 0))
+    'clear particles
+    test ((countof particles) == 0)
+
+    # spans stay contiguous across growth
+    for i in (range 100)
+        'emplace-append particles (age = (f32 i))
+    let ages = ('span particles 'age)
+    test ((ages @ 99) == 99.0)
+
+# fields that own memory can't be scattered
+test-compiler-error
+    SoAArray (tuple String)
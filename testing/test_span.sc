@@ -0,0 +1,82 @@
+using import testing
+using import String
+using import Array
+using import Map
+using import Span
+
+do
+    # slicing a view does not copy the string
+    local s = (String "key=value")
+    let v = ('span s)
+    test ((countof v) == 9)
+    test ((ptrtoint ('data v) usize) == (ptrtoint (& (s @ 0)) usize))
+    let key = (lslice v 3)
+    let value = (rslice v 4)
+    test (key == "key")
+    test (value == "value")
+    test ((ptrtoint ('data value) usize) == (ptrtoint (& (s @ 4)) usize))
+    test ((slice v 4 6) == "va")
+    test ((lslice v 100) == v)
+    test ((countof (rslice v 100)) == 0)
+    test (('span s 4) == value)
+    test (('span s 0 3) == key)
+
+    # views compare with strings and hash the same
+    test (s == v)
+    test ((lslice s 3) == key)
+    test (key < value)
+    test (value > key)
+    test ((hash key) == (hash (String "key")))
+    test ((key as string) == "key")
+    test ((String key) == "key")
+
+    # strings convert to views implicitly
+    fn count-chars (text c)
+        let text = (imply text StringView)
+        fold (n = 0) for x in text
+            ? (x == c) (n + 1) n
+    test ((count-chars s 101:char) == 2)
+    test ((count-chars "aaa" 97:char) == 3)
+
+    local t = (String "k:")
+    'append t value
+    test (t == "k:value")
+
+do
+    # maps keyed by strings are searched by views without building a key
+    local map : (Map String i32)
+    'set map (String "alpha") 1
+    'set map (String "beta") 2
+    local text = (String "alpha beta gamma")
+    let words = ('span text)
+    let alpha = (lslice words 5)
+    let beta = (slice words 6 10)
+    let gamma = (rslice words 11)
+    test ('in? map alpha)
+    test (('get map beta) == 2)
+    test (not ('in? map gamma))
+    test (('getdefault map gamma 3) == 3)
+    test (alpha in map)
+    'discard map alpha
+    test (not ('in? map alpha))
+
+do
+    # arrays view their elements as spans
+    local a : (Array i32)
+    for i in (range 8)
+        'append a i
+    let sp = ('span a 2 6)
+    test ((countof sp) == 4)
+    test ((sp @ 0) == 2)
+    test ((ptrtoint ('data sp) usize) == (ptrtoint (& (a @ 2)) usize))
+    local sum = 0
+    for x in sp
+        sum += x
+    test (sum == 14)
+    test (a == ('span a))
+    test ((hash a) == (hash ('span a)))
+    let empty = ((Span i32))
+    test ((countof empty) == 0)
+    test (empty == (lslice sp 0))
+
+;
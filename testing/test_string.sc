@@ -163,4 +163,32 @@ do
     local s = (String "0123456789")
     test ((slice s 2 7) == "23456")
 
+do
+    # short strings are stored inline until they outgrow the string object
+    local s = (String "short")
+    test ((countof s) == 5)
+    local t = (copy s)
+    'append t "er"
+    test (s == "short")
+    test (t == "shorter")
+    for i in (range 40)
+        'append s ((97 + (i % 26)) as char)
+        test ((countof s) == ((6 + i) as usize))
+        test ((s @ (countof s)) == 0:char) "not zero terminated"
+    test (s == "shortabcdefghijklmnopqrstuvwxyzabcdefghijklmn")
+    test ((countof s) < ('capacity s))
+    'pop s
+    test (('last s) == (109 as char))
+    'clear s
+    test ((countof s) == 0)
+
+do
+    # joining several strings at once interns only the joined string
+    let name = (tostring i32)
+    let s = (.. "<Map " name " " name ">")
+    static-assert ((typeof s) == string)
+    test (s == "<Map i32 i32>")
+    test (s == (.. (.. "<Map " name) (.. " " name ">")))
+    test ((.. name name name) == "i32i32i32")
+
 ;
\ No newline at end of file
@@ -297,4 +297,42 @@ do
 
     ;
 
+do
+    using import Map
+    # structs compare and hash without hand-written methods
+    struct Key plain
+        a : i32
+        b : u32
+    struct WideKey plain
+        a : u64
+        b : u64
+        c : i32
+        d : i32
+    struct Padded
+        x : u8
+        y : i64
+    struct Named
+        name : string
+        pos : (vector f32 2)
+
+    test ((Key 1 2) == (Key 1 2))
+    test ((Key 1 2) != (Key 2 1))
+    test ((hash (Key 1 2)) == (hash (Key 1 2)))
+    test ((hash (Key 1 2)) != (hash (Key 2 1)))
+    test ((WideKey 1 2 3 4) == (WideKey 1 2 3 4))
+    test ((WideKey 1 2 3 4) != (WideKey 1 2 3 5))
+    test ((hash (WideKey 1 2 3 4)) == (hash (WideKey 1 2 3 4)))
+    # structs with padding compare field by field
+    test ((Padded 1 2) == (Padded 1 2))
+    test ((Padded 1 2) != (Padded 1 3))
+    test ((hash (Padded 1 2)) == (hash (Padded 1 2)))
+    test ((Named "a" (vectorof f32 1 2)) == (Named "a" (vectorof f32 1 2)))
+    test ((Named "a" (vectorof f32 1 2)) != (Named "a" (vectorof f32 1 3)))
+
+    local map : (Map Key i32)
+    for i in (range 100)
+        'set map (Key i (i as u32)) i
+    test (('get map (Key 42 42)) == 42)
+    test (not ('in? map (Key 42 43)))
+
 none
@@ -25,11 +25,21 @@ sugar test2 (x y z args...)
         list (do +) 6 6
         next-expr
 
+# expansions of a pure sugar macro may be reused
+@@ pure-sugar
+sugar double (x)
+    list (do +) x x
+
 run-stage;
 
 assert
     (test 1 2 3 4 5 6) == 6
 
+assert
+    (double 3) == 6
+assert
+    (double (double 2)) == 8
+
 assert
     (test2 1 2 3 4 5 6) == 12
 
@@ -123,3 +123,47 @@ test ((get-arguments 3) == -1)
 test (constant? (get-arguments 2))
 
 
+
+# switches with many cases dispatch through tables
+fn dense-case (x)
+    switch x
+    case 0 10
+    case 1 11
+    pass 2
+    pass 3
+    do 23
+    case 4 14
+    case 6 16
+    default -1
+
+test ((dense-case 0) == 10)
+test ((dense-case 1) == 11)
+test ((dense-case 2) == 23)
+test ((dense-case 3) == 23)
+test ((dense-case 4) == 14)
+test ((dense-case 5) == -1)
+test ((dense-case 6) == 16)
+test ((dense-case 7) == -1)
+test ((dense-case -1) == -1)
+
+fn sparse-case (x)
+    switch x
+    case 'red 1
+    case 'green 2
+    case 'blue 3
+    case 'cyan 4
+    case 'magenta 5
+    pass 'yellow
+    pass 'black
+    do 6
+    default 0
+
+test ((sparse-case 'red) == 1)
+test ((sparse-case 'green) == 2)
+test ((sparse-case 'blue) == 3)
+test ((sparse-case 'cyan) == 4)
+test ((sparse-case 'magenta) == 5)
+test ((sparse-case 'yellow) == 6)
+test ((sparse-case 'black) == 6)
+test ((sparse-case 'white) == 0)
+test ((sparse-case (Symbol "red")) == 1)
@@ -0,0 +1,79 @@
+
+using import testing
+using import task
+using import Array
+using import itertools
+
+do
+    local results : (Array i64)
+    'resize results 100 0:i64
+    let items = (& (results @ 0))
+    local tasks : (Array Task)
+    for i in (range 100)
+        'append tasks
+            spawn
+                inline (i items)
+                    items @ i = i * i
+                i as i64
+                items
+    # dropping the handles joins the tasks
+    'clear tasks
+    test ((results @ 99) == (99:i64 * 99:i64))
+
+    let task =
+        spawn
+            inline (items)
+                items @ 0 = 7:i64
+            items
+    'join task
+    test ((results @ 0) == 7:i64)
+
+do
+    # coroutines yield and wait for tasks they spawn
+    local counter = 0:i64
+    local wg = (WaitGroup)
+    'add wg 8
+    for i in (range 8)
+        'detach
+            spawn-coroutine
+                inline (counter wg)
+                    for k in (range 4)
+                        atomicrmw add counter 1:i64
+                        yield;
+                    let child =
+                        spawn
+                            inline (counter)
+                                atomicrmw add counter 100:i64
+                                ;
+                            counter
+                    'join child
+                    'done (@ wg)
+                & counter
+                & wg
+    'wait wg
+    test (counter == (8:i64 * 104:i64))
+
+do
+    # parallel loops nested in tasks share the same threads
+    local sums : (Array i64)
+    'resize sums 4 0:i64
+    let sum-items = (& (sums @ 0))
+    local wg = (WaitGroup)
+    'add wg 4
+    for i in (range 4)
+        'detach
+            spawn
+                inline (i sum-items wg)
+                    sum-items @ i =
+                        parallel-reduce 1000 0:i64
+                            inline (k) (k as i64)
+                            +
+                    'done (@ wg)
+                i
+                sum-items
+                & wg
+    'wait wg
+    for x in sums
+        test (x == 499500:i64)
+
+;
@@ -95,6 +95,22 @@ do
 
     One.test-refcount-balanced;
 
+do
+    # a function hinted as raising that never raises doesn't make its callers
+      raise
+    fn never-raises (x)
+        raising Error
+        x + 1
+
+    fn calls-never-raises (x)
+        never-raises x
+
+    static-assert
+        (typeof (static-typify never-raises i32)) == (pointer (raises (function i32 i32) Error))
+    static-assert
+        (typeof (static-typify calls-never-raises i32)) == (pointer (function i32 i32))
+    test ((calls-never-raises 1) == 2)
+
 # test wrong syntax (previously crashed)
 test-compiler-error
     try
@@ -104,4 +104,46 @@ test-compiler-error M.A
 test (M.B == 2)
 test (M.C == 3)
 
+# discarding most of the symbols of a type compacts its table; iteration
+# and name suggestions only see the symbols that are left
+do
+    let T = (typename.type "CompactedSymbols" typename)
+    let N = 48
+    inline key (i)
+        Symbol (.. "field" (tostring i))
+    for i in (range N)
+        sc_type_set_symbol T (key i) (Value i)
+    # keep every fourth symbol
+    for i in (range N)
+        if ((i % 4) != 0)
+            sc_type_del_symbol T (key i)
+    # a symbol bound again after compaction comes last
+    sc_type_set_symbol T (key 1) (Value 1)
+
+    local expected = 0
+    local count = 0
+    loop (k v = (sc_type_next T unnamed))
+        if (k == unnamed)
+            break;
+        test (k == (key expected))
+        test ((v as i32) == expected)
+        count += 1
+        expected = (? (expected == 44) 1 (expected + 4))
+        sc_type_next T k
+    test (count == 13)
+
+    inline message (name)
+        try
+            sc_type_at T name
+            ""
+        except (err)
+            'format err
+    let msg = (message 'field5)
+    let suggested? = ('match? "Did you mean.*'field4'" msg)
+    test suggested?
+    let suggested? = ('match? "Did you mean.*'field6'" msg)
+    test (not suggested?)
+    let suggested? = ('match? "Did you mean.*'field5'" msg)
+    test (not suggested?)
+
 true
\ No newline at end of file
@@ -28,3 +28,34 @@ test (dststr == srcstr)
 
 test ((UTF-8.char32 "?") == 63)
 
+
+do
+    using import Array
+    using import String
+
+    # ASCII runs longer than a block, sequences of every length, and
+      sequences that straddle the end of a block
+    let text = "0123456789abcdefghijklmnopö🤔Thö Quöck Brüwn Föx🤔 tail"
+    test ((UTF-8.validate text (countof text)) == (countof text))
+    local codepoints : (GrowingArray i32)
+    test ((UTF-8.decode-into codepoints text) == 0)
+    test ((countof codepoints) == 53)
+    test ((codepoints @ 27) == 0x1f914)
+    local result : String
+    UTF-8.encode-into result codepoints
+    test (result == text)
+
+    # overlong forms, surrogates and truncated sequences are ill-formed
+    test ((UTF-8.validate "ab\xc0\xafcd" 6) == 2)
+    test ((UTF-8.validate "0123456789abcdef\xed\xa0\x80" 19) == 16)
+    test ((UTF-8.validate "\xf4\x90\x80\x80" 4) == 0)
+    test ((UTF-8.validate "ok\xe2\x82" 4) == 2)
+
+    # ill-formed bytes survive a round trip as negative numbers
+    let bad = "a\xffb"
+    local codepoints : (GrowingArray i32)
+    test ((UTF-8.decode-into codepoints bad) == 1)
+    test ((codepoints @ 1) == -0xff)
+    local result : String
+    UTF-8.encode-into result codepoints
+    test (result == bad)
@@ -1,6 +1,12 @@
 fn sum_two (x y)
     x + y
 
+fn sum_vec4 (x y)
+    sqrt (x + y)
+
+# vector code maps to wasm simd instructions
+set-object-target-cpu "generic" "+simd128,+bulk-memory"
+
 # generate webassembly
 compile-object
     "wasm32-unknown-unknown"
@@ -12,10 +18,16 @@ compile-object
                 static-typify sum_two i32 i32
             sum_two_float =
                 static-typify sum_two f32 f32
+            sum_vec4 =
+                static-typify sum_vec4 (vector f32 4) (vector f32 4)
         locals;
+    'O2
+
+set-object-target-cpu "" ""
 
 # link file using llvm's webassembly linker
-    wasm-ld --no-entry --export-dynamic _test.wasm -o test.wasm
+link-objects "wasm32-unknown-unknown" (list (module-dir .. "/_test.wasm"))
+    module-dir .. "/test.wasm"
 
 # serve locally with
     python2 -m SimpleHTTPServer 8000